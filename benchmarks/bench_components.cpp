@@ -0,0 +1,236 @@
+/**
+ * @file bench_components.cpp
+ * @brief Google Benchmark microbenchmarks for the packet hot path components
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ *
+ * Run with --benchmark_out=FILE --benchmark_out_format=json (or the
+ * `microbenchmarks` build target) to keep results comparable across
+ * releases. Setup such as filling a pool or compiling filter rules happens
+ * outside the timed loops.
+ */
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/message_view.hpp"
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/config/subnet_index.hpp"
+#include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/options/manager.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include "simple-dhcpd/production/security/manager.hpp"
+
+using namespace simple_dhcpd;
+
+namespace {
+
+MacAddress mac_for(uint32_t n) {
+    return MacAddress{0x02, 0x00, static_cast<uint8_t>(n >> 24), static_cast<uint8_t>(n >> 16),
+                      static_cast<uint8_t>(n >> 8), static_cast<uint8_t>(n)};
+}
+
+// A DISCOVER as typical clients send it: client id, hostname, vendor class, parameter list
+std::vector<uint8_t> client_discover(IpAddress relay_ip = 0) {
+    DhcpMessageBuilder builder;
+    builder.set_message_type(DhcpMessageType::DISCOVER)
+           .set_transaction_id(0x12345678)
+           .set_client_mac(mac_for(1))
+           .set_relay_ip(relay_ip)
+           .add_option(DhcpOptionCode::CLIENT_IDENTIFIER, std::vector<uint8_t>{1, 0x02, 0, 0, 0, 0, 1})
+           .add_option(DhcpOptionCode::HOST_NAME, std::string("workstation-01"))
+           .add_option(DhcpOptionCode::VENDOR_CLASS_IDENTIFIER, std::string("MSFT 5.0"))
+           .add_option(DhcpOptionCode::PARAMETER_REQUEST_LIST, std::vector<uint8_t>{1, 3, 6, 15, 31, 33, 43, 44, 46, 47, 119, 121, 249, 252});
+    DhcpMessage message = builder.build();
+    message.header.op = 1;
+    return DhcpParser::generate_message(message);
+}
+
+DhcpSubnet make_subnet(const std::string& name, uint32_t network_host, uint8_t prefix_length) {
+    DhcpSubnet subnet;
+    subnet.name = name;
+    subnet.network = htonl(network_host);
+    subnet.prefix_length = prefix_length;
+    const uint32_t size = 1u << (32 - prefix_length);
+    subnet.range_start = htonl(network_host + 1);
+    subnet.range_end = htonl(network_host + size - 2);
+    subnet.lease_time = 3600;
+    return subnet;
+}
+
+} // namespace
+
+// Parser
+
+static void BM_ParseMessage(benchmark::State& state) {
+    const std::vector<uint8_t> packet = client_discover();
+    for (auto _ : state) {
+        DhcpMessage message = DhcpParser::parse_message(packet);
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * packet.size()));
+}
+BENCHMARK(BM_ParseMessage);
+
+static void BM_GenerateMessage(benchmark::State& state) {
+    const IpAddress server_id = string_to_ip("10.0.0.1");
+    DhcpMessageBuilder builder;
+    builder.set_message_type(DhcpMessageType::OFFER)
+           .set_transaction_id(0x12345678)
+           .set_client_mac(mac_for(1))
+           .set_your_ip(string_to_ip("10.0.0.42"))
+           .set_server_ip(server_id)
+           .add_option(DhcpOptionCode::SERVER_IDENTIFIER, ip_to_bytes_be(server_id))
+           .add_option(DhcpOptionCode::SUBNET_MASK, ip_to_bytes_be(subnet_mask_for_prefix(24)))
+           .add_option(DhcpOptionCode::ROUTER, ip_to_bytes_be(server_id))
+           .add_option(DhcpOptionCode::DOMAIN_SERVER, std::vector<uint8_t>{8, 8, 8, 8, 8, 8, 4, 4})
+           .add_option(DhcpOptionCode::DOMAIN_NAME, std::string("example.com"))
+           .add_option(DhcpOptionCode::IP_ADDRESS_LEASE_TIME, uint32_to_option_bytes(3600))
+           .add_option(DhcpOptionCode::RENEWAL_TIME, uint32_to_option_bytes(1800))
+           .add_option(DhcpOptionCode::REBINDING_TIME, uint32_to_option_bytes(3150));
+    const DhcpMessage message = builder.build();
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::vector<uint8_t> packet = DhcpParser::generate_message(message);
+        bytes += packet.size();
+        benchmark::DoNotOptimize(packet.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_GenerateMessage);
+
+// Lease allocation
+
+// Arg: percentage of the /18 pool already leased. Each iteration allocates
+// one lease and releases it untimed, so the fill level stays put.
+static void BM_AllocateLease(benchmark::State& state) {
+    DhcpConfig config;
+    config.enable_logging = false;
+    const DhcpSubnet subnet = make_subnet("pool-18", 0x0A400000u, 18);
+    config.subnets.push_back(subnet);
+    LeaseManager manager(config);
+
+    const uint32_t pool_size = ntohl(subnet.range_end) - ntohl(subnet.range_start) + 1;
+    const uint32_t filled = static_cast<uint32_t>(pool_size * state.range(0) / 100);
+    for (uint32_t i = 0; i < filled; ++i) {
+        manager.allocate_lease(mac_for(i), 0, subnet.name);
+    }
+
+    uint32_t next_mac = pool_size;
+    for (auto _ : state) {
+        const MacAddress mac = mac_for(next_mac++);
+        const auto start = std::chrono::steady_clock::now();
+        DhcpLease lease = manager.allocate_lease(mac, 0, subnet.name);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        state.SetIterationTime(std::chrono::duration<double>(elapsed).count());
+        manager.release_lease(mac, lease.ip_address);
+    }
+    state.counters["pool"] = pool_size;
+}
+BENCHMARK(BM_AllocateLease)->ArgName("fill_pct")->Arg(0)->Arg(50)->Arg(90)->Arg(99)->UseManualTime();
+
+// Subnet selection
+
+// Arg: number of relayed /24 subnets; requests arrive from every relay in turn
+static void BM_FindSubnetForClient(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<DhcpSubnet> subnets;
+    subnets.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        subnets.push_back(make_subnet("relay-" + std::to_string(i), 0x0A000000u | static_cast<uint32_t>(i << 8), 24));
+    }
+    const std::shared_ptr<const SubnetTable> table = SubnetTable::build(subnets);
+
+    constexpr size_t kMessages = 256;
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<DhcpMessageView> views;
+    packets.reserve(kMessages);
+    views.reserve(kMessages);
+    for (size_t i = 0; i < kMessages; ++i) {
+        const uint32_t relay = 0x0A000001u | static_cast<uint32_t>(((i * 7919) % count) << 8);
+        packets.push_back(client_discover(htonl(relay)));
+        views.emplace_back(packets.back().data(), packets.back().size());
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const DhcpMessageView& view = views[i++ & (kMessages - 1)];
+        benchmark::DoNotOptimize(table->select_for_client(view.client_ip(), view.relay_ip()));
+    }
+}
+BENCHMARK(BM_FindSubnetForClient)->ArgName("subnets")->Arg(10)->Arg(1000)->Arg(10000);
+
+// Security checks
+
+// Arg: number of per-MAC rate limit rules in front of the "*" rule
+static void BM_CheckRateLimit(benchmark::State& state) {
+    DhcpSecurityManager security;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        security.add_rate_limit_rule(RateLimitRule(mac_to_string(mac_for(0x01000000u + static_cast<uint32_t>(i))),
+                                                   "mac", 1000000000, std::chrono::seconds(60)));
+    }
+    security.add_rate_limit_rule(RateLimitRule("*", "mac", 1000000000, std::chrono::seconds(60)));
+
+    uint32_t n = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(security.check_rate_limit(mac_for(n++ & 4095)));
+    }
+}
+BENCHMARK(BM_CheckRateLimit)->ArgName("rules")->Arg(1)->Arg(100)->Arg(1000);
+
+// Arg: number of exact MAC filter rules; a third of the lookups miss them all
+static void BM_CheckMacAddress(benchmark::State& state) {
+    const uint32_t count = static_cast<uint32_t>(state.range(0));
+    std::vector<MacFilterRule> rules;
+    rules.reserve(count + 2);
+    rules.emplace_back("00:00:5e:*", false, "deny VRRP OUI");
+    for (uint32_t i = 0; i < count; ++i) {
+        rules.emplace_back(mac_to_string(mac_for(i)), i % 2 == 0, "nac");
+    }
+    rules.emplace_back("*", false, "default deny");
+    DhcpSecurityManager security;
+    security.set_mac_filter_rules(rules);
+
+    const uint32_t span = count + count / 2 + 1;
+    uint32_t n = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(security.check_mac_address(mac_for(n)));
+        n = n + 1 == span ? 0 : n + 1;
+    }
+}
+BENCHMARK(BM_CheckMacAddress)->ArgName("rules")->Arg(10)->Arg(1000)->Arg(50000);
+
+// Option inheritance
+
+// Arg: number of inheritance rules, a quarter of them conditional
+static void BM_ApplyInheritance(benchmark::State& state) {
+    DhcpOptionsManager options;
+    const OptionMap global = {{DhcpOptionCode::DOMAIN_SERVER, {8, 8, 8, 8, 8, 8, 4, 4}},
+                              {DhcpOptionCode::DOMAIN_NAME, {'e', 'x', 'a', 'm', 'p', 'l', 'e'}},
+                              {DhcpOptionCode::NTP_SERVERS, {10, 0, 0, 123}}};
+    const OptionMap subnet = {{DhcpOptionCode::ROUTER, {10, 0, 0, 1}}};
+    const OptionMap host = {{DhcpOptionCode::HOST_NAME, {'h', 'o', 's', 't'}}};
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        OptionInheritanceRule rule("global", "subnet", i % 3 == 0 ? DhcpOptionCode::NTP_SERVERS
+                                                                 : DhcpOptionCode::DOMAIN_NAME, i % 2 == 0);
+        rule.condition = i % 4 == 0 ? "vendor_class" : "";
+        options.add_inheritance_rule(rule);
+    }
+    OptionsContext context;
+    context.vendor_class = "MSFT 5.0";
+    context.subnet_name = "subnet-0";
+
+    for (auto _ : state) {
+        OptionMap merged = options.apply_inheritance(global, subnet, {}, host, context);
+        benchmark::DoNotOptimize(merged);
+    }
+}
+BENCHMARK(BM_ApplyInheritance)->ArgName("rules")->Arg(0)->Arg(16)->Arg(256);
+
+BENCHMARK_MAIN();
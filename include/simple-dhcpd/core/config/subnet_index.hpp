@@ -0,0 +1,209 @@
+/**
+ * @file config/subnet_index.hpp
+ * @brief Subnet lookup by address and by name
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_CONFIG_SUBNET_INDEX_HPP
+#define SIMPLE_DHCPD_CONFIG_SUBNET_INDEX_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/utils/prefix_trie.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Dense subnet identifier: the subnet's slot in its SubnetTable
+ *
+ * Until the first reload this is the subnet's position in DhcpConfig::subnets.
+ */
+using SubnetId = uint32_t;
+
+/** Identifier returned when no subnet matches */
+constexpr SubnetId kNoSubnet = Ipv4PrefixTrie::kNoValue;
+
+/**
+ * @brief Index over the configured subnets, built once per configuration
+ *
+ * Address lookups (ciaddr, giaddr, lease addresses) are a longest-prefix
+ * match on network/prefix_length. A subnet without a prefix length is
+ * indexed by the smallest prefix covering its range. When two subnets
+ * share a prefix the first one in the configuration wins.
+ */
+class SubnetIndex {
+public:
+    /**
+     * @brief Constructor for an empty index
+     */
+    SubnetIndex();
+
+    /**
+     * @brief Rebuild the index
+     * @param subnets Subnets in configuration order; ids are their positions
+     */
+    void build(const std::vector<DhcpSubnet>& subnets);
+
+    /**
+     * @brief Add one subnet
+     * @param subnet Subnet
+     * @param id Id it is found by; subnets added earlier win shared prefixes and names
+     */
+    void add(const DhcpSubnet& subnet, SubnetId id);
+
+    /**
+     * @brief Find the most specific subnet containing an address
+     * @param address Address in network byte order
+     * @return Subnet id, kNoSubnet if none matches
+     */
+    SubnetId find_by_address(IpAddress address) const { return trie_.lookup(address); }
+
+    /**
+     * @brief Find a subnet by name
+     * @param name Subnet name
+     * @return Subnet id, kNoSubnet if no subnet has that name
+     */
+    SubnetId find_by_name(const std::string& name) const;
+
+    /**
+     * @brief Get number of indexed subnets
+     * @return Subnet count
+     */
+    size_t size() const { return count_; }
+
+private:
+    Ipv4PrefixTrie trie_;
+    std::unordered_map<std::string, SubnetId> names_;
+    size_t count_;
+};
+
+/**
+ * @brief How a subnet differs from the table a SubnetTable was updated from
+ */
+enum class SubnetChange : uint8_t {
+    UNCHANGED,   ///< Identical, or retired in an earlier table
+    SETTINGS,    ///< Same range and exclusions; gateway, options or lease times differ
+    POOL,        ///< Range or exclusions differ
+    ADDED,       ///< New subnet
+    REMOVED      ///< No longer configured; its id is retired
+};
+
+/**
+ * @brief Immutable set of subnets by stable id, with its index
+ *
+ * A subnet keeps its id across reloads as long as a subnet of that name is
+ * configured. A removed subnet leaves a retired slot and new subnets are
+ * appended, so an id taken from an older table never names a different
+ * subnet in a newer one and packets in flight across a reload stay
+ * consistent. Address and name lookups and the default subnet follow the
+ * configuration order, as with SubnetIndex::build.
+ */
+class SubnetTable {
+public:
+    /**
+     * @brief Build the table for a first configuration
+     * @param subnets Subnets in configuration order; ids are their positions
+     * @return Table, every subnet marked ADDED
+     */
+    static std::shared_ptr<const SubnetTable> build(const std::vector<DhcpSubnet>& subnets);
+
+    /**
+     * @brief Build the table for a reloaded configuration
+     * @param subnets Subnets in configuration order
+     * @return Table keeping this table's ids, with each slot's change recorded
+     */
+    std::shared_ptr<const SubnetTable> update(const std::vector<DhcpSubnet>& subnets) const;
+
+    /**
+     * @brief Get a subnet by id
+     * @param id Subnet id
+     * @return Subnet, nullptr if the id is retired or unknown
+     */
+    const DhcpSubnet* find(SubnetId id) const {
+        return id < subnets_.size() && !retired_[id] ? &subnets_[id] : nullptr;
+    }
+
+    /**
+     * @brief Get a subnet slot, retired or not
+     * @param id Subnet id below slots()
+     * @return Subnet; a retired slot keeps its last configuration
+     */
+    const DhcpSubnet& subnet(SubnetId id) const { return subnets_[id]; }
+
+    /**
+     * @brief Get the change of a slot relative to the previous table
+     * @param id Subnet id below slots()
+     * @return Change
+     */
+    SubnetChange change(SubnetId id) const { return changes_[id]; }
+
+    /**
+     * @brief Check whether a slot is retired
+     * @param id Subnet id below slots()
+     * @return true if no subnet is configured for the id
+     */
+    bool retired(SubnetId id) const { return retired_[id] != 0; }
+
+    /**
+     * @brief Get the address and name index over the configured subnets
+     * @return Index
+     */
+    const SubnetIndex& index() const { return index_; }
+
+    /**
+     * @brief Get the id of the first subnet in configuration order
+     * @return Subnet id, kNoSubnet without subnets
+     */
+    SubnetId default_id() const { return default_id_; }
+
+    /**
+     * @brief Choose the subnet a client message is served from
+     * @param client_ip Client address (ciaddr), 0 if none
+     * @param relay_ip Relay agent address (giaddr), 0 if none
+     * @return Most specific subnet containing ciaddr, then giaddr; the default subnet otherwise
+     */
+    SubnetId select_for_client(IpAddress client_ip, IpAddress relay_ip) const {
+        if (client_ip != 0) {
+            const SubnetId id = index_.find_by_address(client_ip);
+            if (id != kNoSubnet) {
+                return id;
+            }
+        }
+        if (relay_ip != 0) {
+            const SubnetId id = index_.find_by_address(relay_ip);
+            if (id != kNoSubnet) {
+                return id;
+            }
+        }
+        return default_id_;
+    }
+
+    /**
+     * @brief Get number of slots, retired ones included
+     * @return Slot count
+     */
+    size_t slots() const { return subnets_.size(); }
+
+    /**
+     * @brief Get number of configured subnets
+     * @return Subnet count
+     */
+    size_t size() const { return index_.size(); }
+
+private:
+    std::vector<DhcpSubnet> subnets_;      // by SubnetId
+    std::vector<uint8_t> retired_;
+    std::vector<SubnetChange> changes_;
+    SubnetIndex index_;
+    SubnetId default_id_ = kNoSubnet;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_CONFIG_SUBNET_INDEX_HPP
@@ -0,0 +1,67 @@
+/**
+ * @file core/early_drop.hpp
+ * @brief Checks on the raw packet that run before it is parsed
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_CORE_EARLY_DROP_HPP
+#define SIMPLE_DHCPD_CORE_EARLY_DROP_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Why a packet was dropped before parsing
+ */
+enum class EarlyDropReason {
+    NONE,              ///< Not dropped
+    TRUNCATED,         ///< Shorter than the fixed header and magic cookie
+    NOT_REQUEST,       ///< op is not BOOTREQUEST
+    BAD_HARDWARE,      ///< htype/hlen are not Ethernet's
+    BAD_MAGIC_COOKIE,  ///< No DHCP magic cookie after the header
+    MAC_FILTER,        ///< chaddr denied by the MAC filter
+    RATE_LIMIT,        ///< chaddr over its rate limit
+    COUNT
+};
+
+/**
+ * @brief Get the name of a drop reason, as used in metric labels
+ * @param reason Reason
+ * @return Lower-case name
+ */
+const char* early_drop_reason_name(EarlyDropReason reason);
+
+/**
+ * @brief Header sanity checks on the raw bytes of a received packet
+ *
+ * Reads only the fixed BOOTP header and the magic cookie, so a packet that
+ * cannot be a client request is rejected before any option is looked at.
+ * The MAC filter and rate limit checks that follow in the server take the
+ * client MAC from chaddr() the same way.
+ */
+class EarlyDropFilter {
+public:
+    /**
+     * @brief Check that a packet looks like a DHCP request from an Ethernet client
+     * @param data Packet bytes
+     * @param size Packet length
+     * @return NONE, or the first check the packet fails
+     */
+    static EarlyDropReason check_header(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Get the client MAC address of a packet that passed check_header()
+     * @param data Packet bytes
+     * @return First six bytes of chaddr
+     */
+    static MacAddress chaddr(const uint8_t* data);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_CORE_EARLY_DROP_HPP
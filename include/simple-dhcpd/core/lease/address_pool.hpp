@@ -0,0 +1,119 @@
+/**
+ * @file lease/address_pool.hpp
+ * @brief Free-address bitmap for one subnet range
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_ADDRESS_POOL_HPP
+#define SIMPLE_DHCPD_LEASE_ADDRESS_POOL_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Bitmap of the free addresses in a subnet's dynamic range
+ *
+ * One bit per address from range_start to range_end, set while the
+ * address can be handed out. Exclusions are cleared when the pool is built
+ * and stay cleared; leased and declined addresses are cleared by the
+ * lease manager. Searching starts at a rotating cursor and scans a 64-bit
+ * word at a time, so a just-released address is not immediately reused.
+ * Not thread-safe; the owner serializes access.
+ */
+class AddressPool {
+public:
+    /**
+     * @brief Constructor for an empty pool
+     */
+    AddressPool();
+
+    /**
+     * @brief Build the pool for a subnet with every non-excluded address free
+     * @param subnet Subnet configuration
+     */
+    explicit AddressPool(const DhcpSubnet& subnet);
+
+    /**
+     * @brief Check whether an address belongs to the range
+     * @param ip Address in network byte order
+     * @return true if inside range_start..range_end
+     */
+    bool contains(IpAddress ip) const;
+
+    /**
+     * @brief Check whether an address can be handed out
+     * @param ip Address in network byte order
+     * @return true if in range, not excluded and not in use
+     */
+    bool is_free(IpAddress ip) const;
+
+    /**
+     * @brief Mark an address as in use (leased or declined)
+     * @param ip Address in network byte order; ignored outside the range
+     */
+    void mark_used(IpAddress ip);
+
+    /**
+     * @brief Return an address to the pool
+     * @param ip Address in network byte order; excluded and out-of-range addresses are ignored
+     */
+    void mark_free(IpAddress ip);
+
+    /**
+     * @brief Find the next free address at or after the cursor, wrapping once
+     * @return Address in network byte order, 0 if the pool is exhausted
+     *
+     * The cursor moves past the returned address; the address itself stays
+     * free until mark_used().
+     */
+    IpAddress find_free() { return find_free(~uint64_t(0)); }
+
+    /**
+     * @brief Find the next free address among a subset of the range
+     * @param mask Applied to every 64-address block: bit n selects the
+     *        addresses whose offset from range_start is n modulo 64
+     * @return Address in network byte order, 0 if no selected address is free
+     *
+     * Lets two servers sharing a range allocate from disjoint halves, e.g.
+     * even and odd offsets, without coordinating each allocation.
+     */
+    IpAddress find_free(uint64_t mask);
+
+    /**
+     * @brief Get number of addresses in the range
+     * @return Range size
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Get number of free addresses
+     * @return Free address count
+     */
+    size_t free_count() const { return free_count_; }
+
+    /**
+     * @brief Get number of addresses that can ever be handed out
+     * @return Range size minus exclusions
+     */
+    size_t usable_count() const { return usable_count_; }
+
+private:
+    uint32_t base_;   // range_start in host byte order
+    size_t size_;
+    size_t usable_count_;
+    size_t free_count_;
+    size_t cursor_;
+    std::vector<uint64_t> free_;
+    std::vector<uint64_t> excluded_;
+
+    bool offset_of(IpAddress ip, size_t& offset) const;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_ADDRESS_POOL_HPP
@@ -0,0 +1,101 @@
+/**
+ * @file lease/expiry_heap.hpp
+ * @brief Indexed min-heap of expiry deadlines
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_EXPIRY_HEAP_HPP
+#define SIMPLE_DHCPD_LEASE_EXPIRY_HEAP_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Min-heap of deadlines keyed by dense ids
+ *
+ * Every id has at most one deadline. A position table indexed by id lets a
+ * deadline be moved or cancelled in O(log n), so renewals and releases do
+ * not leave stale entries behind, and the earliest deadline is O(1) to read.
+ * Ids are meant to be slab indices; the position table grows to the largest
+ * id seen. Not thread-safe; the owner serializes access.
+ */
+class ExpiryHeap {
+public:
+    /**
+     * @brief Set or move the deadline of an id
+     * @param id Dense id
+     * @param deadline Deadline in system_clock ticks
+     */
+    void schedule(uint32_t id, int64_t deadline);
+
+    /**
+     * @brief Make room for ids below a bound
+     * @param ids Bound on the ids about to be scheduled
+     */
+    void reserve(size_t ids) {
+        heap_.reserve(ids);
+        position_.reserve(ids);
+    }
+
+    /**
+     * @brief Remove the deadline of an id
+     * @param id Dense id; ignored if not scheduled
+     */
+    void cancel(uint32_t id);
+
+    /**
+     * @brief Check whether an id has a deadline
+     * @param id Dense id
+     * @return true if scheduled
+     */
+    bool contains(uint32_t id) const {
+        return id < position_.size() && position_[id] != kNotScheduled;
+    }
+
+    bool empty() const { return heap_.empty(); }
+    size_t size() const { return heap_.size(); }
+
+    /**
+     * @brief Get the id with the earliest deadline
+     * @return Id; the heap must not be empty
+     */
+    uint32_t top() const { return heap_.front().id; }
+
+    /**
+     * @brief Get the earliest deadline
+     * @return Deadline in system_clock ticks; the heap must not be empty
+     */
+    int64_t top_deadline() const { return heap_.front().deadline; }
+
+    /**
+     * @brief Estimate heap memory held
+     * @return Bytes
+     */
+    size_t memory_usage() const {
+        return heap_.capacity() * sizeof(Entry) + position_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    static constexpr uint32_t kNotScheduled = 0xFFFFFFFFu;
+
+    struct Entry {
+        int64_t deadline;
+        uint32_t id;
+    };
+
+    std::vector<Entry> heap_;
+    std::vector<uint32_t> position_;  // by id
+
+    void place(size_t index, const Entry& entry);
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_EXPIRY_HEAP_HPP
@@ -0,0 +1,193 @@
+/**
+ * @file lease/journal.hpp
+ * @brief Append-only binary lease journal with group commit
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_JOURNAL_HPP
+#define SIMPLE_DHCPD_LEASE_JOURNAL_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Lease journal exception
+ */
+class LeaseJournalException : public std::exception {
+public:
+    explicit LeaseJournalException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief Lease state change recorded in the journal
+ */
+enum class JournalOp : uint8_t {
+    ALLOCATE = 1,
+    RENEW = 2,
+    RELEASE = 3,
+    EXPIRE = 4
+};
+
+/**
+ * @brief Write-ahead log of lease changes
+ *
+ * A file starts with an 8-byte header (magic "SDLJ", format version) and
+ * holds length-prefixed, CRC-32 protected records in native byte order.
+ * Every record carries the whole lease (options excepted), so replaying a
+ * record twice is harmless. append() only queues the encoded record; a
+ * writer thread writes everything queued since its last round with one
+ * write() and one fdatasync(), so concurrent callers share a commit.
+ * A torn record at the end of the file, left by a crash, ends the replay
+ * and is truncated away when the journal is reopened.
+ *
+ * A failed write or sync (ENOSPC, EIO) is truncated back to the last
+ * committed record and retried with backoff, from 10 ms up to 1 s; its
+ * records stay queued and wait_durable() keeps blocking until a retry
+ * succeeds, so nothing is acknowledged that is not on disk.
+ */
+class LeaseJournal {
+public:
+    /**
+     * @brief Open a journal for appending, creating it if needed
+     * @param path Journal file
+     * @throws LeaseJournalException if the file cannot be opened or is not a journal
+     */
+    explicit LeaseJournal(const std::string& path);
+
+    /**
+     * @brief Destructor; commits what is queued
+     */
+    ~LeaseJournal();
+
+    LeaseJournal(const LeaseJournal&) = delete;
+    LeaseJournal& operator=(const LeaseJournal&) = delete;
+
+    /**
+     * @brief Queue a record
+     * @param op Change
+     * @param lease Lease after the change (before it, for RELEASE/EXPIRE)
+     * @return Sequence number to pass to wait_durable()
+     */
+    uint64_t append(JournalOp op, const DhcpLease& lease);
+
+    /**
+     * @brief Block until a record is on stable storage
+     * @param sequence Value returned by append()
+     * @throws LeaseJournalException if the journal is closed before the record could be written
+     */
+    void wait_durable(uint64_t sequence);
+
+    /**
+     * @brief Block until every queued record is on stable storage
+     * @throws LeaseJournalException if the journal is closed before they could be written
+     */
+    void flush();
+
+    /**
+     * @brief Close the current file under a new name and continue in a fresh one
+     * @param retired_path Name for the current file; replaced if it exists
+     * @throws LeaseJournalException if writes are failing or the files cannot be renamed or
+     *         created; the journal then keeps its current file under its own name
+     */
+    void rotate(const std::string& retired_path);
+
+    /**
+     * @brief Get the size the file will have once queued records are written
+     * @return Bytes
+     */
+    uint64_t size_bytes() const;
+
+    /**
+     * @brief Get number of records appended since the journal was opened
+     * @return Record count
+     */
+    uint64_t record_count() const { return records_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of fdatasync rounds since the journal was opened
+     * @return Commit count
+     */
+    uint64_t commit_count() const { return commits_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of write or sync rounds that failed and were retried
+     * @return Failure count
+     */
+    uint64_t write_failure_count() const { return write_failures_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Append the encoding of one record to a buffer
+     * @param op Change
+     * @param lease Lease
+     * @param out Buffer to append to
+     */
+    static void encode(JournalOp op, const DhcpLease& lease, std::string& out);
+
+    /**
+     * @brief Apply every intact record of a journal file in order
+     * @param path Journal file; a missing file holds no records
+     * @param apply Called per record with its change and lease
+     * @param valid_bytes If set, receives the length of the intact prefix
+     * @return Number of records applied
+     * @throws LeaseJournalException if the file exists but is not a journal
+     */
+    static size_t replay(const std::string& path,
+                         const std::function<void(JournalOp, const DhcpLease&)>& apply,
+                         uint64_t* valid_bytes = nullptr);
+
+    /**
+     * @brief Apply the intact records at the start of a buffer written by encode()
+     * @param data Records without a file header
+     * @param size Buffer size
+     * @param apply Called per record with its change and lease; may be empty
+     * @param records If set, receives the number of records decoded
+     * @return Length of the intact prefix
+     */
+    static size_t decode_records(const char* data, size_t size,
+                                 const std::function<void(JournalOp, const DhcpLease&)>& apply,
+                                 size_t* records = nullptr);
+
+private:
+    std::string path_;
+    int fd_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable durable_cv_;
+    std::string pending_;       // encoded records not yet handed to the writer
+    uint64_t appended_;         // sequence of the last queued record
+    uint64_t durable_;          // sequence of the last synced record
+    uint64_t file_bytes_;       // bytes written to the current file
+    bool writing_;
+    bool failing_;              // the last round failed; its records are queued again
+    bool stopped_;              // the writer has exited
+    bool stopping_;
+    std::atomic<uint64_t> records_;
+    std::atomic<uint64_t> commits_;
+    std::atomic<uint64_t> write_failures_;
+    std::thread writer_;
+
+    /**
+     * @brief Writer thread: write and sync queued records in batches
+     */
+    void writer_loop();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_JOURNAL_HPP
@@ -0,0 +1,157 @@
+/**
+ * @file lease/lease_history.hpp
+ * @brief Bounded per-address history of lease changes
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_HISTORY_HPP
+#define SIMPLE_DHCPD_LEASE_HISTORY_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/lease/journal.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Lease history exception
+ */
+class LeaseHistoryException : public std::exception {
+public:
+    explicit LeaseHistoryException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief One change of the lease on an address
+ */
+struct LeaseHistoryRecord {
+    int64_t lease_start;        ///< system_clock ticks, as LeaseRecord
+    int64_t lease_end;          ///< system_clock ticks, as LeaseRecord
+    MacAddress mac_address;
+    JournalOp event;
+};
+
+/**
+ * @brief Fixed-depth ring of lease changes per address
+ *
+ * Each address that sees a change gets a ring of `depth` compact records,
+ * allocated once; recording is one hash lookup and a copy into the ring,
+ * with no allocation after the address's first change. Addresses are
+ * spread over independently locked shards.
+ *
+ * With a spill file, a record pushed out of its ring is appended to the
+ * file instead of being lost. Spilled records are buffered and written in
+ * batches; get() streams the file for the address's older records. The
+ * file uses the host byte order and only grows; rotate it with the logs.
+ */
+class LeaseHistory {
+public:
+    /** Records kept in memory per address unless configured otherwise */
+    static constexpr size_t kDefaultDepth = 10;
+
+    /** Spilled bytes buffered before they are written */
+    static constexpr size_t kSpillBatch = 64 * 1024;
+
+    /**
+     * @brief Constructor
+     * @param depth Records kept in memory per address, at least 1
+     * @param spill_path Append-only file for older records; empty to drop them
+     * @throws LeaseHistoryException if the spill file cannot be opened
+     */
+    explicit LeaseHistory(size_t depth = kDefaultDepth, const std::string& spill_path = "");
+
+    /**
+     * @brief Destructor; writes buffered spilled records
+     */
+    ~LeaseHistory();
+
+    LeaseHistory(const LeaseHistory&) = delete;
+    LeaseHistory& operator=(const LeaseHistory&) = delete;
+
+    /**
+     * @brief Record a change
+     * @param op Change
+     * @param lease Lease after the change (or the lease given up)
+     */
+    void record(JournalOp op, const DhcpLease& lease);
+
+    /**
+     * @brief Get the recorded changes of an address
+     * @param ip_address Address, network byte order
+     * @return Spilled records followed by those in memory, oldest first
+     */
+    std::vector<LeaseHistoryRecord> get(IpAddress ip_address);
+
+    /**
+     * @brief Write buffered spilled records to the spill file
+     */
+    void flush();
+
+    /**
+     * @brief Get number of addresses with a ring
+     * @return Addresses seen
+     */
+    size_t addresses() const;
+
+    /**
+     * @brief Get records kept in memory per address
+     * @return Depth
+     */
+    size_t depth() const { return depth_; }
+
+private:
+    static constexpr size_t kShards = 16;
+
+    /** Spill file entry: the address in front of the record */
+    struct SpillEntry {
+        IpAddress ip_address;
+        uint32_t reserved;
+        LeaseHistoryRecord record;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<IpAddress, uint32_t> rings;   // address -> ring number
+        std::vector<LeaseHistoryRecord> records;         // ring n at [n * depth, (n + 1) * depth)
+        std::vector<uint64_t> written;                   // records ever written to ring n
+    };
+
+    const size_t depth_;
+    const std::string spill_path_;
+    int spill_fd_;
+    std::array<Shard, kShards> shards_;
+    std::mutex spill_mutex_;
+    std::vector<SpillEntry> spill_buffer_;
+
+    // Fibonacci hashing mixes every octet in, whatever the byte order
+    Shard& shard(IpAddress ip_address) { return shards_[(ip_address * 0x9E3779B1u) >> 28]; }
+
+    /**
+     * @brief Queue a record pushed out of its ring; caller holds no spill lock
+     */
+    void spill(IpAddress ip_address, const LeaseHistoryRecord& record);
+
+    /**
+     * @brief Write the spill buffer; caller holds spill_mutex_
+     */
+    void write_spill_locked();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_HISTORY_HPP
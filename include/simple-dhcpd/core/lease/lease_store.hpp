@@ -0,0 +1,499 @@
+/**
+ * @file lease/lease_store.hpp
+ * @brief Compact open-addressing lease tables
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_STORE_HPP
+#define SIMPLE_DHCPD_LEASE_STORE_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/lease/expiry_heap.hpp"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Fixed-size lease as kept in a LeaseStore
+ *
+ * Times are system_clock tick counts so they round-trip exactly; hostname
+ * and client identifier are ids into the store's StringPool, and options
+ * live in a side table only for the few leases that carry any.
+ */
+struct LeaseRecord {
+    int64_t lease_start;
+    int64_t lease_end;
+    int64_t renewal_time;
+    int64_t rebinding_time;
+    int64_t allocated_at;
+    int64_t expires_at;
+    IpAddress ip_address;
+    uint32_t lease_time;   // seconds
+    uint32_t hostname;     // StringPool id
+    uint32_t client_id;    // StringPool id
+    MacAddress mac_address;
+    uint8_t lease_type;
+    uint8_t flags;
+
+    static constexpr uint8_t kLive = 0x01;
+    static constexpr uint8_t kActive = 0x02;
+    static constexpr uint8_t kStatic = 0x04;
+    static constexpr uint8_t kHasOptions = 0x08;
+
+    bool is_active() const { return flags & kActive; }
+
+    static int64_t to_ticks(std::chrono::system_clock::time_point time) {
+        return time.time_since_epoch().count();
+    }
+
+    static std::chrono::system_clock::time_point from_ticks(int64_t ticks) {
+        return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks));
+    }
+};
+
+static_assert(sizeof(LeaseRecord) == 72, "LeaseRecord should stay packed into 72 bytes");
+
+/**
+ * @brief Reference-counted string interning
+ *
+ * Bytes live back to back in one arena and an open-addressing table maps
+ * contents to ids. Id 0 is the empty string and is never stored. Released
+ * ids are reused, and the arena is compacted once most of it is dead.
+ */
+class StringPool {
+public:
+    static constexpr uint32_t kEmpty = 0;
+
+    /**
+     * @brief Constructor
+     */
+    StringPool();
+
+    /**
+     * @brief Take a reference to a string
+     * @param value String to intern; must not view this pool's own storage
+     * @return Id of the string, kEmpty for an empty string
+     */
+    uint32_t intern(std::string_view value);
+
+    /**
+     * @brief Make room for more strings
+     * @param count Number of strings to add
+     * @param bytes Their total length
+     */
+    void reserve(size_t count, size_t bytes);
+    
+    /**
+     * @brief Drop a reference taken by intern()
+     * @param id String id
+     */
+    void release(uint32_t id);
+
+    /**
+     * @brief Look up a string without taking a reference
+     * @param value String
+     * @return Its id, kEmpty if the string is empty or not held
+     */
+    uint32_t find(std::string_view value) const;
+
+    /**
+     * @brief Get an interned string
+     * @param id String id
+     * @return View valid until the next intern() or release()
+     */
+    std::string_view get(uint32_t id) const {
+        const Entry& entry = entries_[id];
+        return std::string_view(bytes_.data() + entry.offset, entry.length);
+    }
+
+    /**
+     * @brief Get number of distinct strings held
+     * @return String count
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Estimate heap memory held by the pool
+     * @return Bytes
+     */
+    size_t memory_usage() const;
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t refs;
+        uint32_t hash;
+    };
+
+    std::vector<char> bytes_;
+    size_t dead_bytes_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> free_ids_;
+    std::vector<uint32_t> table_;  // string ids, kEmpty for a free slot
+    size_t size_;
+
+    size_t probe(std::string_view value, uint32_t hash) const;
+    void grow();
+    void compact();
+};
+
+/**
+ * @brief Leases keyed by MAC address
+ *
+ * Records sit in a slab with a free list, and an open-addressing table of
+ * slab indices (linear probing, backward-shift deletion) finds them, so a
+ * lookup touches one table entry and one 72-byte record instead of a chain
+ * of tree nodes and heap-allocated leases. Active records are also kept in
+ * an ExpiryHeap by lease_end, so expiry only visits leases that are due.
+ * Not thread-safe; the owner serializes access.
+ */
+class LeaseStore {
+public:
+    /**
+     * @brief Constructor
+     */
+    LeaseStore();
+
+    /**
+     * @brief Find the record of a client
+     * @param mac_address Client MAC address
+     * @return Record, nullptr if none; valid until the next put() or erase()
+     */
+    LeaseRecord* find(const MacAddress& mac_address);
+    const LeaseRecord* find(const MacAddress& mac_address) const;
+
+    /**
+     * @brief Insert a lease, replacing any record for the same MAC address
+     * @param lease Lease to store
+     * @return Stored record; valid until the next put() or erase()
+     */
+    LeaseRecord& put(const DhcpLease& lease);
+
+    /**
+     * @brief Make room for more records
+     * @param count Records about to be added; bulk loads avoid rehashing as they go
+     * @param string_bytes Their hostname and client id bytes
+     */
+    void reserve(size_t count, size_t string_bytes = 0);
+    
+    /**
+     * @brief Remove the record of a client
+     * @param mac_address Client MAC address
+     * @return true if a record was removed
+     */
+    bool erase(const MacAddress& mac_address);
+
+    /**
+     * @brief Refresh the expiry deadline of a record changed in place
+     * @param record Record of this store whose lease_end or active flag changed
+     */
+    void reschedule(const LeaseRecord& record);
+
+    /**
+     * @brief Get the active record that expires first, if it is already due
+     * @param now Current time in system_clock ticks
+     * @return Record whose lease_end is before now, nullptr if none is due
+     */
+    const LeaseRecord* next_expired(int64_t now) const;
+
+    /**
+     * @brief Expand a record into a full lease
+     * @param record Record of this store
+     * @return Lease
+     */
+    DhcpLease load(const LeaseRecord& record) const;
+
+    /**
+     * @brief Visit every record
+     * @param fn Called with each const LeaseRecord&; must not modify the store
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const auto& record : records_) {
+            if (record.flags & LeaseRecord::kLive) {
+                fn(record);
+            }
+        }
+    }
+
+    /**
+     * @brief Visit records from a slab position on, stopping when asked to
+     * @param position First slab index to look at; left after the last record visited
+     * @param fn Called with each const LeaseRecord&; returns false to stop after it
+     * @return true if the end of the slab was reached
+     */
+    template <typename Fn>
+    bool for_each_from(size_t& position, Fn&& fn) const {
+        while (position < records_.size()) {
+            const LeaseRecord& record = records_[position++];
+            if ((record.flags & LeaseRecord::kLive) && !fn(record)) {
+                return position == records_.size();
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Visit the records carrying a client identifier
+     * @param client_id Client identifier bytes
+     * @param fn Called with each const LeaseRecord&; must not modify the store
+     */
+    template <typename Fn>
+    void for_each_client_id(std::string_view client_id, Fn&& fn) const {
+        const uint32_t id = strings_.find(client_id);
+        if (id == StringPool::kEmpty) {
+            return;
+        }
+        const auto range = by_client_id_.equal_range(id);
+        for (auto it = range.first; it != range.second; ++it) {
+            fn(records_[it->second]);
+        }
+    }
+
+    /**
+     * @brief Get number of records
+     * @return Record count
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Estimate heap memory held by the store
+     * @return Bytes, including slab, index, strings and options
+     */
+    size_t memory_usage() const;
+
+private:
+    using OptionMap = std::map<DhcpOptionCode, std::vector<uint8_t>>;
+    static constexpr uint32_t kEmptySlot = 0;
+
+    /**
+     * @brief Index entry; the hash tag spares a record access on most mismatches
+     */
+    struct Slot {
+        uint32_t record;  // slab index + 1, kEmptySlot if free
+        uint32_t tag;     // key hash; its low bits are the home slot
+    };
+
+    std::vector<LeaseRecord> records_;
+    std::vector<uint32_t> free_records_;
+    std::vector<Slot> table_;
+    size_t size_;
+    StringPool strings_;
+    std::unordered_map<uint32_t, OptionMap> options_;  // by slab index
+    std::unordered_multimap<uint32_t, uint32_t> by_client_id_;  // client id string -> slab index
+    ExpiryHeap expiry_;  // active records by lease_end, keyed by slab index
+
+    size_t probe(const MacAddress& mac_address, uint32_t hash) const;
+    void grow() { rehash(table_.size() * 2); }
+    void rehash(size_t capacity);
+    void assign(uint32_t index, const DhcpLease& lease);
+    void release_fields(uint32_t index);
+};
+
+/**
+ * @brief Leased address to owning MAC address
+ *
+ * Open-addressing table of 12-byte entries with linear probing and
+ * backward-shift deletion. Not thread-safe; the owner serializes access.
+ */
+class AddressIndex {
+public:
+    /**
+     * @brief Constructor
+     */
+    AddressIndex();
+
+    /**
+     * @brief Look up the owner of an address
+     * @param ip_address Address in network byte order
+     * @param mac_address Receives the owner when found
+     * @return true if the address is indexed
+     */
+    bool find(IpAddress ip_address, MacAddress& mac_address) const;
+
+    /**
+     * @brief Check whether an address is indexed
+     * @param ip_address Address in network byte order
+     * @return true if the address is indexed
+     */
+    bool contains(IpAddress ip_address) const;
+
+    /**
+     * @brief Index an address, replacing any previous owner
+     * @param ip_address Address in network byte order
+     * @param mac_address Owner
+     * @return true if the address was not indexed before
+     */
+    bool insert(IpAddress ip_address, const MacAddress& mac_address);
+
+    /**
+     * @brief Make room for more addresses
+     * @param count Entries about to be added
+     */
+    void reserve(size_t count);
+    
+    /**
+     * @brief Unindex an address if a given client owns it
+     * @param ip_address Address in network byte order
+     * @param mac_address Expected owner
+     * @return true if the entry was removed
+     */
+    bool erase(IpAddress ip_address, const MacAddress& mac_address);
+
+    /**
+     * @brief Get number of indexed addresses
+     * @return Entry count
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Estimate heap memory held by the index
+     * @return Bytes
+     */
+    size_t memory_usage() const { return table_.capacity() * sizeof(Entry); }
+
+private:
+    struct Entry {
+        IpAddress ip_address;
+        MacAddress mac_address;
+        uint8_t used;
+        uint8_t reserved;
+    };
+
+    std::vector<Entry> table_;
+    size_t size_;
+
+    size_t probe(IpAddress ip_address) const;
+    void grow() { rehash(table_.size() * 2); }
+    void rehash(size_t capacity);
+};
+
+/**
+ * @brief Addresses offered to clients that have not sent a REQUEST yet
+ *
+ * One 24-byte entry per client MAC in an open-addressing table with linear
+ * probing and backward-shift deletion, plus the hold deadlines in order, so
+ * expiring offers costs only the due ones. An offer is not a lease: it is
+ * not journaled, not indexed by address and not seen by lease queries; the
+ * owner keeps the address marked used in its AddressPool while the offer is
+ * held. Times are system_clock ticks. Not thread-safe; the owner serializes
+ * access.
+ */
+class OfferTable {
+public:
+    /**
+     * @brief Constructor
+     */
+    OfferTable();
+
+    /**
+     * @brief Look up the address offered to a client
+     * @param mac_address Client MAC address
+     * @param ip_address Receives the offered address when found
+     * @return true if the client holds an offer
+     */
+    bool find(const MacAddress& mac_address, IpAddress& ip_address) const;
+
+    /**
+     * @brief Hold an address for a client, replacing any earlier offer of that client
+     * @param mac_address Client MAC address
+     * @param ip_address Offered address in network byte order
+     * @param until Deadline in system_clock ticks
+     */
+    void hold(const MacAddress& mac_address, IpAddress ip_address, int64_t until);
+
+    /**
+     * @brief Remove a client's offer
+     * @param mac_address Client MAC address
+     * @param ip_address Receives the offered address when found; it stays marked used
+     * @return true if the client held an offer
+     */
+    bool take(const MacAddress& mac_address, IpAddress& ip_address);
+
+    /**
+     * @brief Drop the offers that are due
+     * @param now Current time in system_clock ticks
+     * @param released Called with each address whose offer ended
+     */
+    template <typename Fn>
+    void release_due(int64_t now, Fn&& released) {
+        while (!order_.empty() && order_.top().first <= now) {
+            const Deadline due = order_.top();
+            order_.pop();
+            const size_t slot = probe(due.second);
+            if (!table_[slot].used || table_[slot].until != due.first) {
+                continue;  // taken, or superseded by a later offer
+            }
+            const IpAddress ip_address = table_[slot].ip_address;
+            erase_slot(slot);
+            released(ip_address);
+        }
+    }
+
+    /**
+     * @brief Call a function with every offered address
+     * @param fn Called with each address
+     */
+    template <typename Fn>
+    void for_each_address(Fn&& fn) const {
+        for (const Entry& entry : table_) {
+            if (entry.used) {
+                fn(entry.ip_address);
+            }
+        }
+    }
+
+    /**
+     * @brief Drop every offer
+     */
+    void clear();
+
+    /**
+     * @brief Get number of held offers
+     * @return Entry count
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Estimate heap memory held by the table
+     * @return Bytes
+     */
+    size_t memory_usage() const {
+        return table_.capacity() * sizeof(Entry) + order_.size() * sizeof(Deadline);
+    }
+
+private:
+    struct Entry {
+        MacAddress mac_address;
+        uint8_t used;
+        uint8_t reserved;
+        IpAddress ip_address;
+        int64_t until;
+    };
+
+    using Deadline = std::pair<int64_t, MacAddress>;
+
+    std::vector<Entry> table_;
+    size_t size_;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> order_;
+
+    size_t probe(const MacAddress& mac_address) const;
+    void erase_slot(size_t slot);
+    void grow() { rehash(table_.size() * 2); }
+    void rehash(size_t capacity);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_STORE_HPP
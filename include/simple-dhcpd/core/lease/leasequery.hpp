@@ -0,0 +1,214 @@
+/**
+ * @file lease/leasequery.hpp
+ * @brief DHCP leasequery (RFC 4388) and bulk leasequery (RFC 6926) responder
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASEQUERY_HPP
+#define SIMPLE_DHCPD_LEASEQUERY_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/message_view.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace simple_dhcpd {
+
+class LeaseManager;
+
+/**
+ * @brief Leasequery exception
+ */
+class LeasequeryException : public std::exception {
+public:
+    explicit LeasequeryException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief status-code option values (RFC 6926 6.2.2)
+ */
+enum class LeasequeryStatus : uint8_t {
+    SUCCESS = 0,
+    UNSPEC_FAIL = 1,
+    QUERY_TERMINATED = 2,
+    MALFORMED_QUERY = 3,
+    NOT_ALLOWED = 4
+};
+
+/**
+ * @brief Answers leasequeries from the lease table
+ *
+ * A query names its lease by ciaddr, else by chaddr, else by client
+ * identifier (option 61). A bulk query naming none of them asks for every
+ * active lease, optionally only those whose last transaction falls between
+ * query-start-time and query-end-time, which is how a requestor pulls the
+ * changes since its previous pull. Those walks read the table in chunks
+ * with LeaseManager::read_leases(), so they never hold a lease lock while
+ * replies are written. Queries by client identifier walk the table too:
+ * leases are not indexed by it.
+ *
+ * Relay-id and remote-id queries are refused with a status: relay agent
+ * information is not kept with the leases.
+ */
+class LeasequeryResponder {
+public:
+    /** Receives each encoded reply of a bulk query; returns false to abort it */
+    using Sink = std::function<bool(ByteView)>;
+
+    /** Leases read from the table per chunk of a bulk walk */
+    static constexpr size_t kBulkChunk = 256;
+
+    /**
+     * @brief Constructor
+     * @param leases Lease table; must outlive the responder
+     * @param server_id Server identifier put in replies, network byte order
+     */
+    LeasequeryResponder(LeaseManager& leases, IpAddress server_id);
+
+    /**
+     * @brief Change the server identifier put in replies
+     * @param server_id Server identifier, network byte order
+     */
+    void set_server_id(IpAddress server_id) { server_id_.store(server_id, std::memory_order_relaxed); }
+
+    /**
+     * @brief Answer one DHCPLEASEQUERY
+     * @param query Query
+     * @param writer Writer the reply is encoded with
+     * @return DHCPLEASEACTIVE, DHCPLEASEUNASSIGNED or DHCPLEASEUNKNOWN, viewing the writer's buffer
+     */
+    ByteView answer(const DhcpMessageView& query, DhcpMessageWriter& writer);
+
+    /**
+     * @brief Answer one DHCPBULKLEASEQUERY
+     * @param query Query
+     * @param send Called with one DHCPLEASEACTIVE per lease, then DHCPLEASEQUERYDONE,
+     *             or with a single DHCPLEASEQUERYSTATUS if the query is refused
+     * @return Leases sent; stops early if send returns false
+     */
+    size_t answer_bulk(const DhcpMessageView& query, const Sink& send);
+
+private:
+    LeaseManager& leases_;
+    std::atomic<IpAddress> server_id_;
+
+    /**
+     * @brief Start a reply to a query, about a lease or echoing the query's client
+     */
+    void begin(DhcpMessageWriter& writer, const DhcpMessageView& query, DhcpMessageType type,
+               const DhcpLease* lease);
+
+    /**
+     * @brief Write the lease's times and client identifier into a started reply
+     */
+    void write_lease(DhcpMessageWriter& writer, const DhcpLease& lease, int64_t now, bool bulk);
+
+    /**
+     * @brief Find the active lease a query names
+     * @return false if there is none
+     */
+    bool find_lease(const DhcpMessageView& query, DhcpLease& lease);
+};
+
+/**
+ * @brief TCP listener for RFC 6926 bulk leasequery on its own thread
+ *
+ * Messages travel with a two-byte length in front, in network byte
+ * order. The listener serves one connection at a time and any number of
+ * queries on it, each query's replies in order; connections idle for
+ * longer than a few seconds, or that stop reading replies, are closed.
+ */
+class BulkLeasequeryServer {
+public:
+    /** Largest message accepted from a requestor */
+    static constexpr size_t kMaxQuerySize = 1500;
+
+    /**
+     * @brief Constructor
+     * @param address IPv4 address to listen on
+     * @param port TCP port; 0 picks a free one
+     * @param responder Answers the queries; must outlive the server
+     */
+    BulkLeasequeryServer(const std::string& address, uint16_t port, LeasequeryResponder& responder);
+
+    /**
+     * @brief Destructor; stops the listener
+     */
+    ~BulkLeasequeryServer();
+
+    BulkLeasequeryServer(const BulkLeasequeryServer&) = delete;
+    BulkLeasequeryServer& operator=(const BulkLeasequeryServer&) = delete;
+
+    /**
+     * @brief Bind the socket and start the listener thread
+     * @throws LeasequeryException if the address cannot be bound
+     */
+    void start();
+
+    /**
+     * @brief Stop the listener thread and close the sockets
+     */
+    void stop();
+
+    /**
+     * @brief Get the port being listened on
+     * @return Port, the chosen one if constructed with 0
+     */
+    uint16_t port() const { return port_; }
+
+    /**
+     * @brief Get number of bulk queries answered
+     * @return Query count
+     */
+    uint64_t queries() const { return queries_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of leases sent
+     * @return DHCPLEASEACTIVE count
+     */
+    uint64_t leases_sent() const { return leases_sent_.load(std::memory_order_relaxed); }
+
+private:
+    std::string address_;
+    uint16_t port_;
+    LeasequeryResponder& responder_;
+    int listen_fd_;
+    int wake_fds_[2];   // stop() writes to [1] to wake the listener
+    std::thread thread_;
+    std::atomic<bool> stopping_;    // ends a bulk walk in progress
+    std::atomic<uint64_t> queries_;
+    std::atomic<uint64_t> leases_sent_;
+
+    /**
+     * @brief Listener thread function
+     */
+    void run();
+
+    /**
+     * @brief Answer the queries of one connection and close it
+     */
+    void serve(int client_fd);
+
+    /**
+     * @brief Close all descriptors
+     */
+    void close_fds();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASEQUERY_HPP
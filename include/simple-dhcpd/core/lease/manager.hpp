@@ -10,14 +10,26 @@
 #define SIMPLE_DHCPD_LEASE_MANAGER_HPP
 
 #include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/config/subnet_index.hpp"
+#include "simple-dhcpd/core/lease/address_pool.hpp"
+#include "simple-dhcpd/core/lease/lease_store.hpp"
+#include "simple-dhcpd/core/lease/journal.hpp"
+#include "simple-dhcpd/core/lease/snapshot.hpp"
+#include "simple-dhcpd/core/network/event_loop.hpp"
 #include <string>
 #include <map>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <array>
 #include <thread>
 #include <atomic>
 #include <functional>
+#include <condition_variable>
+#include <queue>
+#include <utility>
+#include <arpa/inet.h>
 
 namespace simple_dhcpd {
 
@@ -36,6 +48,27 @@ private:
     std::string message_;
 };
 
+/**
+ * @brief Address usage of one subnet's dynamic range
+ */
+struct PoolUsage {
+    std::string subnet_name;
+    size_t addresses;   ///< Range size minus exclusions
+    size_t free;        ///< Neither leased, offered nor held after a decline
+    size_t offered;     ///< Held for clients that have not sent a REQUEST yet
+};
+
+/**
+ * @brief Position of a walk over the lease table with LeaseManager::read_leases()
+ */
+struct LeaseCursor {
+    size_t shard = 0;       ///< Lease shard being read
+    size_t position = 0;    ///< Next slab index in that shard
+    bool finished = false;  ///< Every shard has been read
+
+    bool done() const { return finished; }
+};
+
 /**
  * @brief DHCP lease manager class
  */
@@ -50,13 +83,20 @@ public:
     /**
      * @brief Destructor
      */
-    ~LeaseManager();
+    virtual ~LeaseManager();
     
     /**
-     * @brief Start lease manager
+     * @brief Start lease manager with maintenance on a loop of its own
      */
     void start();
     
+    /**
+     * @brief Start lease manager with maintenance timers on a shared loop
+     * @param loop Loop running the timers; must outlive stop()
+     * @note A manager already started elsewhere moves its timers to this loop
+     */
+    void start(EventLoop& loop);
+    
     /**
      * @brief Stop lease manager
      */
@@ -72,6 +112,44 @@ public:
      */
     DhcpLease allocate_lease(const MacAddress& mac_address, IpAddress requested_ip, const std::string& subnet_name);
     
+    /**
+     * @brief Allocate a new lease
+     * @param mac_address Client MAC address
+     * @param requested_ip Requested IP address (0 for any)
+     * @param subnet_id Subnet id from the configuration's SubnetIndex
+     * @return Allocated lease
+     * @throws LeaseManagerException if allocation fails
+     */
+    DhcpLease allocate_lease(const MacAddress& mac_address, IpAddress requested_ip, SubnetId subnet_id);
+    
+    /**
+     * @brief Pick the address to offer a client and hold it until REQUEST
+     * @param mac_address Client MAC address
+     * @param requested_ip Address the client asked for (0 for any); a hint only
+     * @param subnet_id Subnet id from the configuration's SubnetIndex
+     * @param hold Time the address stays held for the client
+     * @return The client's active lease if it has one, otherwise the offer,
+     *         with the times a lease allocated now would get
+     * @throws LeaseManagerException if the subnet has no free address
+     *
+     * Nothing is stored in the lease tables or journaled: the address is
+     * marked used in the subnet's pool and kept in a small per-pool offer
+     * table. A later DISCOVER from the client within the hold gets the same
+     * address again; allocate_lease() for the client consumes the offer and
+     * the address is freed once the hold runs out without one.
+     */
+    DhcpLease reserve_offer(const MacAddress& mac_address, IpAddress requested_ip, SubnetId subnet_id,
+                            std::chrono::seconds hold);
+    
+    /**
+     * @brief Drop a client's offer, e.g. when its address turned out to be in use
+     * @param mac_address Client MAC address
+     * @param subnet_id Subnet the offer was made in
+     *
+     * The address goes back to the pool unless it is leased or declined.
+     */
+    void withdraw_offer(const MacAddress& mac_address, SubnetId subnet_id);
+    
     /**
      * @brief Renew an existing lease
      * @param mac_address Client MAC address
@@ -103,6 +181,13 @@ public:
      */
     std::shared_ptr<DhcpLease> get_lease_by_ip(IpAddress ip_address);
     
+    /**
+     * @brief Get the most recent active lease of a client identifier
+     * @param client_id Client identifier (option 61) bytes
+     * @return Lease if found, nullptr otherwise; an indexed lookup per shard, no table scan
+     */
+    std::shared_ptr<DhcpLease> get_lease_by_client_id(std::string_view client_id);
+    
     /**
      * @brief Check if IP address is available
      * @param ip_address IP address to check
@@ -111,6 +196,34 @@ public:
      */
     bool is_ip_available(IpAddress ip_address, const std::string& subnet_name);
     
+    /**
+     * @brief Check if IP address is available
+     * @param ip_address IP address to check
+     * @param subnet_id Subnet id
+     * @return true if IP is available
+     */
+    bool is_ip_available(IpAddress ip_address, SubnetId subnet_id);
+    
+    /**
+     * @brief Get the subnets by id, as of the last configuration
+     * @return Subnet table; ids passed to this manager refer to it
+     */
+    std::shared_ptr<const SubnetTable> subnet_table() const { return pool_table()->subnets; }
+    
+    /**
+     * @brief Apply a reloaded configuration's subnets, keeping every lease
+     * @param config Reloaded configuration
+     *
+     * Subnets keep their ids (see SubnetTable). Only the pools of subnets
+     * whose range or exclusions changed are rebuilt, in place and under
+     * their own mutex, marking the addresses still leased or declined;
+     * pools of added subnets are built the same way and removed subnets'
+     * pools are emptied. The new table is then published at once, so
+     * allocations in other subnets never wait. Journal and snapshot
+     * settings are not reloaded.
+     */
+    void reconfigure(const DhcpConfig& config);
+    
     /**
      * @brief Get all active leases
      * @return Vector of active leases
@@ -118,18 +231,64 @@ public:
     std::vector<std::shared_ptr<DhcpLease>> get_active_leases() const;
     
     /**
-     * @brief Get leases for subnet
+     * @brief Get the active leases in a subnet's range
      * @param subnet_name Subnet name
-     * @return Vector of leases for subnet
+     * @return Vector of leases for subnet; empty for an unknown subnet
      */
     std::vector<std::shared_ptr<DhcpLease>> get_leases_for_subnet(const std::string& subnet_name);
     
+    /**
+     * @brief Check whether an address is in a subnet's range
+     * @param ip_address IP address, network byte order
+     * @return true if some subnet's range holds the address, leased or not
+     */
+    bool is_pool_address(IpAddress ip_address) const;
+    
+    /**
+     * @brief Read the next chunk of active leases of a walk over the table
+     * @param cursor Walk position; start from a default LeaseCursor
+     * @param leases Cleared, then filled with up to max_leases leases
+     * @param max_leases Chunk size, at least 1
+     * @return Leases read; 0 once cursor.done()
+     *
+     * Each call holds one shard's shared lock at a time, for at most
+     * max_leases leases, so allocation is never blocked for a whole walk.
+     * The walk is not a snapshot: a lease that exists for the whole walk is
+     * returned once, in its state when its shard was read; leases changed
+     * meanwhile may or may not be seen.
+     */
+    size_t read_leases(LeaseCursor& cursor, std::vector<DhcpLease>& leases, size_t max_leases) const;
+    
+    /** Chunk size of the walks done inside the lease managers */
+    static constexpr size_t kReadChunk = 1024;
+    
+    /**
+     * @brief Get number of active leases
+     * @return Leases in the address index
+     */
+    size_t active_lease_count() const { return active_lease_count_.load(std::memory_order_relaxed); }
+    
+    /**
+     * @brief Get address usage of every subnet
+     * @return Usage by subnet, in configuration order
+     *
+     * Read from the counts the address pools keep as addresses are leased
+     * and freed, so the cost does not grow with the number of leases.
+     */
+    std::vector<PoolUsage> get_pool_usage() const;
+    
     /**
      * @brief Get lease statistics
      * @return Lease statistics
      */
     DhcpStats get_statistics() const;
     
+    /**
+     * @brief Get memory held by the lease and address tables
+     * @return Bytes
+     */
+    size_t memory_usage() const;
+    
     /**
      * @brief Set lease expiration callback
      * @param callback Callback function for lease expiration
@@ -137,9 +296,11 @@ public:
     void set_lease_expiration_callback(std::function<void(const DhcpLease&)> callback);
     
     /**
-     * @brief Load leases from file
+     * @brief Load leases from a text lease file
      * @param filename Lease file path
      * @throws LeaseManagerException if loading fails
+     *
+     * Kept for import; load_snapshot() is the fast startup path.
      */
     void load_leases(const std::string& filename);
     
@@ -150,29 +311,319 @@ public:
      */
     void save_leases(const std::string& filename);
 
+    /**
+     * @brief Bulk-load leases from a binary snapshot
+     * @param path Snapshot written by save_snapshot()
+     * @return false if the file does not exist
+     * @throws LeaseSnapshotException if the file is not a valid snapshot
+     *
+     * The file is mapped and its records inserted directly, with the lease
+     * tables presized, so no text is parsed. Call before serving traffic.
+     */
+    bool load_snapshot(const std::string& path);
+
+    /**
+     * @brief Write the active leases to a binary snapshot
+     * @param path Destination; replaced atomically
+     * @throws LeaseSnapshotException on I/O errors
+     */
+    void save_snapshot(const std::string& path);
+
+    /**
+     * @brief Restore leases from a journal and record every later change in it
+     * @param path Journal file; the compacted snapshot lives at path.snapshot
+     * @throws LeaseJournalException if the journal cannot be read or opened
+     * @throws LeaseSnapshotException if the snapshot is invalid
+     *
+     * Call before serving traffic. With lease_journal_sync set, allocate,
+     * renew and release return only once their record is on disk.
+     */
+    void open_journal(const std::string& path);
+
+    /**
+     * @brief Fold the journal into a fresh snapshot
+     * @return true if a journal is open and was compacted
+     * @throws LeaseJournalException or LeaseSnapshotException on I/O errors
+     *
+     * Runs from the cleanup thread once the journal grows past
+     * lease_journal_compact_mb; allocations continue meanwhile.
+     */
+    bool compact_journal();
+
     /**
      * @brief After DHCPDECLINE, avoid re-offering this address for hold duration.
      */
     void add_declined_ip(IpAddress ip, std::chrono::seconds hold);
 
+    /**
+     * @brief Observe every lease change as it is journaled
+     * @param listener Called with the change and the lease, under the lease's
+     *        shard lock, so it must only queue work; empty to stop
+     *
+     * Changes applied with apply_replicated() are not reported. Takes every
+     * shard lock, so the listener can be swapped while serving traffic.
+     */
+    void set_change_listener(std::function<void(JournalOp, const DhcpLease&)> listener);
+
+    /**
+     * @brief Restrict new dynamic allocations to part of every pool
+     * @param mask Passed to AddressPool::find_free(); all ones for the whole pool
+     *
+     * A pool with no free address in the selected part still allocates from
+     * the rest, so a lopsided split never refuses a client.
+     */
+    void set_allocation_mask(uint64_t mask) { allocation_mask_.store(mask, std::memory_order_relaxed); }
+
+    /**
+     * @brief Apply a lease change made by a failover peer
+     * @param op Change
+     * @param lease Lease as the peer journaled it
+     * @return true if the local tables changed
+     *
+     * The change is journaled locally but not reported to the change
+     * listener. When both servers hold a lease for the same client or
+     * address, the one started last wins.
+     */
+    bool apply_replicated(JournalOp op, const DhcpLease& lease);
+
 protected:
+    /** Number of independently locked partitions of each lease index */
+    static constexpr unsigned kLeaseShardBits = 6;
+    static constexpr size_t kLeaseShards = size_t(1) << kLeaseShardBits;
+
+    /**
+     * @brief Leases of the clients whose MAC hashes to this shard
+     */
+    struct MacShard {
+        mutable std::shared_mutex mutex;
+        LeaseStore leases;
+    };
+
+    /**
+     * @brief Address index for the addresses that hash to this shard
+     */
+    struct IpShard {
+        mutable std::shared_mutex mutex;
+        AddressIndex owners;
+    };
+
+    /**
+     * @brief Addresses held back after DHCPDECLINE, with their deadlines in order
+     */
+    struct DeclineHolds {
+        using Deadline = std::pair<int64_t, IpAddress>;  // system_clock ticks
+        
+        std::map<IpAddress, int64_t> until;
+        std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> order;
+        
+        bool contains(IpAddress ip) const { return until.count(ip) != 0; }
+        
+        void hold(IpAddress ip, int64_t deadline) {
+            until[ip] = deadline;
+            order.emplace(deadline, ip);
+        }
+        
+        /**
+         * @brief Drop the holds that are due
+         * @param now Current time in system_clock ticks
+         * @param released Called with each address whose hold ended
+         */
+        template <typename Fn>
+        void release_due(int64_t now, Fn&& released) {
+            while (!order.empty() && order.top().first <= now) {
+                const Deadline due = order.top();
+                order.pop();
+                auto it = until.find(due.second);
+                if (it == until.end() || it->second != due.first) {
+                    continue;  // superseded by a later hold
+                }
+                until.erase(it);
+                released(due.second);
+            }
+        }
+    };
+
+    /**
+     * @brief Free-address state of one subnet; allocations in a subnet serialize here
+     */
+    struct PoolShard {
+        std::mutex mutex;
+        AddressPool pool;
+        DeclineHolds declines;
+        OfferTable offers;
+    };
+
+    /**
+     * @brief Subnets and their pools, replaced as a whole by reconfigure()
+     */
+    struct PoolTable {
+        std::shared_ptr<const SubnetTable> subnets;
+        std::vector<PoolShard*> pools;  // indexed by SubnetId; owned by pool_storage_
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;  // pool ranges, host byte order; {1, 0} if retired
+        
+        bool in_range(SubnetId id, IpAddress ip) const {
+            const uint32_t host = ntohl(ip);
+            return host >= ranges[id].first && host <= ranges[id].second;
+        }
+        
+        void set_range(SubnetId id, const DhcpSubnet* subnet) {
+            ranges.resize(pools.size(), {1, 0});
+            ranges[id] = subnet ? std::make_pair(ntohl(subnet->range_start), ntohl(subnet->range_end))
+                                : std::make_pair(1u, 0u);
+        }
+    };
+
+    // Lock order: MacShard, then PoolShard, then IpShard. Readers take one shared lock.
     DhcpConfig config_;
-    std::map<MacAddress, std::shared_ptr<DhcpLease>> leases_by_mac_;
-    std::map<IpAddress, std::shared_ptr<DhcpLease>> leases_by_ip_;
-    mutable std::mutex mutex_;
+    std::shared_ptr<const PoolTable> pool_table_;  // std::atomic_load / std::atomic_store
+    std::vector<std::unique_ptr<PoolShard>> pool_storage_;  // never shrinks; grown under reconfigure_mutex_
+    std::mutex reconfigure_mutex_;
+    mutable std::array<MacShard, kLeaseShards> mac_shards_;
+    mutable std::array<IpShard, kLeaseShards> ip_shards_;
+    std::atomic<size_t> active_lease_count_;  // entries in the address index
+    mutable std::mutex mutex_;  // expiration callback and subclass bookkeeping
     std::atomic<bool> running_;
-    std::thread cleanup_thread_;
+    EventLoop* maintenance_loop_;                 // loop running the maintenance timers
+    std::unique_ptr<EventLoop> own_loop_;         // set when started without a shared loop
+    std::vector<EventLoop::TimerId> maintenance_timers_;
+    std::vector<int> maintenance_watches_;
     std::function<void(const DhcpLease&)> expiration_callback_;
-    std::map<IpAddress, std::chrono::system_clock::time_point> declined_until_;
-    std::chrono::steady_clock::time_point last_lease_cleanup_{};
+    std::mutex outside_declined_mutex_;
+    DeclineHolds outside_declines_;  // declines outside every pool
+    std::unique_ptr<LeaseJournal> journal_;  // set by open_journal() before traffic starts
+    std::string journal_path_;
+    std::mutex compact_mutex_;  // one compaction at a time
+    bool journal_retired_;  // <journal>.old is closed and only awaits a snapshot; under compact_mutex_
+    std::function<void(JournalOp, const DhcpLease&)> change_listener_;  // swapped under every MAC shard lock
+    std::atomic<uint64_t> allocation_mask_;
+    bool observe_changes_;  // set by a subclass constructor to have lease_changed() called
 
-    void prune_declined_unlocked();
+    /**
+     * @brief Get the current subnets and pools
+     * @return Table; hold it for as long as its subnets are used
+     */
+    std::shared_ptr<const PoolTable> pool_table() const { return std::atomic_load(&pool_table_); }
 
     /**
-     * @brief Cleanup expired leases
+     * @brief Rebuild a pool for a subnet, keeping leased, offered and declined addresses in use
+     * @param shard Pool; its mutex is taken here
+     * @param subnet Subnet the pool now serves
+     */
+    void rebuild_pool(PoolShard& shard, const DhcpSubnet& subnet);
+
+    MacShard& mac_shard(const MacAddress& mac_address) const;
+    IpShard& ip_shard(IpAddress ip_address) const;
+
+    /**
+     * @brief Check whether an address is in the address index
+     * @param ip_address IP address
+     * @return true if some client holds the address
+     */
+    bool is_address_leased(IpAddress ip_address) const;
+
+    /**
+     * @brief Drop the due declines and offers of a pool and return their addresses
+     * @param pool Pool, with its mutex held
+     */
+    void prune_holds_unlocked(PoolShard& pool);
+    
+    /**
+     * @brief Return an address whose offer ended to its pool unless it is leased or declined
+     * @param pool Pool, with its mutex held
+     * @param ip Offered address
+     */
+    void release_offered_unlocked(PoolShard& pool, IpAddress ip);
+    
+    /**
+     * @brief Get the pool whose range holds an address
+     * @param ip IP address
+     * @return Pool, nullptr if the address is outside every range
+     */
+    PoolShard* pool_for_ip(IpAddress ip);
+
+    /**
+     * @brief Expire the leases, offers and decline holds that are due
+     *
+     * One pass; each shard only pops the head of its expiry heap, so the
+     * cost follows the number of due leases rather than the table size.
      */
     void cleanup_expired_leases();
     
+    /**
+     * @brief Maintenance timer: run cleanup_expired_leases() and compact the
+     * journal once it outgrows its threshold
+     */
+    void maintenance_tick();
+    
+    /**
+     * @brief Add the maintenance timers; called by start() on the chosen loop
+     *
+     * Subclasses add their own periodic work with add_maintenance_timer()
+     * after calling this.
+     */
+    virtual void schedule_maintenance();
+    
+    /**
+     * @brief Add a timer cancelled by stop()
+     * @param interval Time between calls
+     * @param fn Callback, run on the maintenance loop
+     */
+    void add_maintenance_timer(std::chrono::milliseconds interval, EventLoop::Callback fn);
+    
+    /**
+     * @brief Watch a descriptor on the maintenance loop until stop()
+     * @param fd Non-blocking descriptor
+     * @param on_readable Callback, run on the maintenance loop
+     */
+    void add_maintenance_watch(int fd, EventLoop::Callback on_readable);
+    
+    /**
+     * @brief Cancel the maintenance timers and watches and drop the loop of its own
+     */
+    void cancel_maintenance();
+    
+    /**
+     * @brief Queue a journal record if a journal is open
+     * @param op Change
+     * @param lease Lease
+     * @return Sequence for journal_wait(), 0 without a journal
+     */
+    uint64_t journal_append(JournalOp op, const DhcpLease& lease);
+    
+    /**
+     * @brief Observe a change as it is journaled, when observe_changes_ is set
+     * @param op Change
+     * @param lease Lease
+     *
+     * Called under the lease's shard lock, like the change listener. Changes
+     * applied with apply_replicated() are not reported.
+     */
+    virtual void lease_changed(JournalOp op, const DhcpLease& lease);
+    
+    /**
+     * @brief Observe a requested address refused because another client holds it
+     * @param holder Client holding the address
+     * @param requester Client that asked for it
+     * @param ip_address Address
+     *
+     * Called by allocate_lease() under the pool lock, just before it throws;
+     * must not take lease locks.
+     */
+    virtual void address_conflict(const MacAddress& holder, const MacAddress& requester, IpAddress ip_address);
+    
+    /**
+     * @brief Wait for a journal record when synchronous journaling is on
+     * @param sequence Value returned by journal_append(); call without shard locks held
+     */
+    void journal_wait(uint64_t sequence);
+    
+    /**
+     * @brief Take the next free address of a pool, honouring the allocation mask
+     * @param pool Pool; caller holds its mutex
+     * @return Address, 0 if the pool is exhausted
+     */
+    IpAddress find_free_unlocked(PoolShard& pool);
+    
     /**
      * @brief Find available IP in subnet
      * @param subnet Subnet configuration
@@ -181,6 +632,15 @@ protected:
      */
     IpAddress find_available_ip(const DhcpSubnet& subnet);
     
+    /**
+     * @brief Check availability of an address
+     * @param ip_address IP address to check
+     * @param subnet Subnet configuration
+     * @param pool Pool of the subnet with its mutex held, nullptr for subnets without one
+     * @return true if IP is available
+     */
+    bool is_ip_available_unlocked(IpAddress ip_address, const DhcpSubnet& subnet, PoolShard* pool);
+    
     /**
      * @brief Check if IP is in range
      * @param ip IP address to check
@@ -199,11 +659,30 @@ protected:
     
     /**
      * @brief Get subnet by name
+     * @param subnets Subnet table
      * @param name Subnet name
-     * @return Subnet configuration
+     * @return Subnet id
      * @throws LeaseManagerException if subnet not found
      */
-    const DhcpSubnet& get_subnet_by_name(const std::string& name);
+    SubnetId get_subnet_by_name(const SubnetTable& subnets, const std::string& name) const;
+    
+    /**
+     * @brief Get subnet by id
+     * @param subnets Subnet table
+     * @param subnet_id Subnet id
+     * @return Subnet configuration, valid while the table is held
+     * @throws LeaseManagerException if the id is unknown or retired
+     */
+    const DhcpSubnet& get_subnet(const SubnetTable& subnets, SubnetId subnet_id) const;
+    
+    /**
+     * @brief Get the subnet a leased address belongs to
+     * @param subnets Subnet table
+     * @param ip IP address
+     * @return Matching subnet, or the first subnet if none matches; valid while the table is held
+     * @throws LeaseManagerException if no subnets are configured
+     */
+    const DhcpSubnet& get_subnet_for_ip(const SubnetTable& subnets, IpAddress ip) const;
     
     /**
      * @brief Add lease to internal structures
@@ -211,12 +690,46 @@ protected:
      */
     void add_lease(std::shared_ptr<DhcpLease> lease);
     
+    /**
+     * @brief Store a lease and index its address without journaling it
+     * @param shard MAC shard of the lease, locked exclusively by the caller
+     * @param lease Lease to store
+     */
+    void insert_lease_unlocked(MacShard& shard, const DhcpLease& lease);
+    
     /**
      * @brief Remove lease from internal structures
      * @param lease Lease to remove
      */
     void remove_lease(std::shared_ptr<DhcpLease> lease);
     
+    /**
+     * @brief Update a stored lease in place
+     * @param mac_address Client MAC address
+     * @param update Called with a copy of the lease; the result is written back
+     * @return true if the client has an active lease
+     *
+     * Leases handed out by the getters are snapshots, so subclasses change
+     * stored leases through here. A changed address is reindexed.
+     */
+    bool modify_lease(const MacAddress& mac_address, const std::function<void(DhcpLease&)>& update);
+    
+    /**
+     * @brief Index an address and take it out of its pool
+     * @param ip_address Address to index
+     * @param mac_address Owner, whose MAC shard is locked by the caller
+     * @param pool Pool holding the address with its mutex held, nullptr if none
+     */
+    void attach_address_unlocked(IpAddress ip_address, const MacAddress& mac_address, PoolShard* pool);
+    
+    /**
+     * @brief Unindex an address and return it to its pool
+     * @param ip_address Address to unindex
+     * @param mac_address Owner, whose MAC shard is locked by the caller;
+     *        nothing happens if the address is indexed to another client
+     */
+    void detach_address(IpAddress ip_address, const MacAddress& mac_address);
+    
     /**
      * @brief Update lease statistics
      * @param lease Lease that was updated
@@ -0,0 +1,268 @@
+/**
+ * @file lease/replication.hpp
+ * @brief Active/active lease replication between two failover peers
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_REPLICATION_HPP
+#define SIMPLE_DHCPD_LEASE_REPLICATION_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/lease/journal.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace simple_dhcpd {
+
+class LeaseManager;
+
+/**
+ * @brief Lease replication exception
+ */
+class LeaseReplicationException : public std::exception {
+public:
+    explicit LeaseReplicationException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief Side of a failover pair
+ */
+enum class FailoverRole : uint8_t {
+    PRIMARY = 1,    ///< Connects to the peer; serves the hash buckets below the split
+    SECONDARY = 2   ///< Listens for the peer; serves the buckets from the split up
+};
+
+/**
+ * @brief Replication counters
+ */
+struct ReplicationStats {
+    bool peer_up = false;           ///< Connected and handshaken with the peer
+    uint64_t records_sent = 0;      ///< Lease records written to the peer, resyncs included
+    uint64_t records_acked = 0;     ///< Records the peer confirmed applying
+    uint64_t records_received = 0;  ///< Records applied from the peer
+    uint64_t resyncs = 0;           ///< Full lease tables sent to the peer
+    uint64_t connections = 0;       ///< Handshakes completed
+};
+
+/**
+ * @brief Streams lease changes to a failover peer and applies the peer's
+ *
+ * Both servers answer clients at once. RFC 3074 load balancing hashes each
+ * client's hardware address into one of 256 buckets; the primary serves
+ * the buckets below the split and the secondary the rest, so every client
+ * has exactly one server while both are up. New addresses come from
+ * disjoint halves of every pool (even offsets on the primary, odd on the
+ * secondary), so the two never hand out the same free address. When the
+ * peer is unreachable this server takes over every bucket and the whole
+ * pool.
+ *
+ * Every change the lease manager journals is encoded as a journal record
+ * and queued; the replication thread sends everything queued since its
+ * last write as one batch over a TCP connection, and the peer acknowledges
+ * batches asynchronously. Nothing on the allocation path waits for the
+ * network. After each handshake each side first sends its whole active
+ * lease table, then the live changes, so a reconnecting peer catches up
+ * on everything it missed. A release made while the peer was unreachable
+ * is not resent; the peer's copy of that lease runs out at its end time.
+ *
+ * Records use the journal's native byte order; the handshake refuses a
+ * peer of the other endianness.
+ */
+class LeaseReplicator {
+public:
+    /**
+     * @brief Constructor
+     * @param leases Lease manager to replicate; must outlive the replicator
+     * @param role This server's side
+     * @param peer_address Peer's IPv4 address
+     * @param port Port the secondary listens on; 0 picks a free port (see port())
+     * @param split Hash buckets, of 256, the primary serves
+     * @throws LeaseReplicationException if the address is invalid or the split above 256
+     */
+    LeaseReplicator(LeaseManager& leases, FailoverRole role, const std::string& peer_address,
+                    uint16_t port, uint32_t split);
+
+    /**
+     * @brief Destructor; stops replicating
+     */
+    ~LeaseReplicator();
+
+    LeaseReplicator(const LeaseReplicator&) = delete;
+    LeaseReplicator& operator=(const LeaseReplicator&) = delete;
+
+    /**
+     * @brief Start the replication thread and observe the lease manager
+     * @throws LeaseReplicationException if the secondary cannot listen
+     */
+    void start();
+
+    /**
+     * @brief Stop observing, close the connection and join the thread
+     */
+    void stop();
+
+    /**
+     * @brief Check whether this server should answer a client
+     * @param mac_address Client hardware address
+     * @return true if the client hashes to this server's buckets or the peer is down
+     */
+    bool serves(const MacAddress& mac_address) const {
+        if (!peer_up_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        const bool primary_bucket = load_balance_hash(mac_address.data(), mac_address.size()) < split_;
+        return primary_bucket == (role_ == FailoverRole::PRIMARY);
+    }
+
+    /**
+     * @brief Check whether the peer is connected and handshaken
+     * @return true while the load is split
+     */
+    bool peer_up() const { return peer_up_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get the port the secondary listens on
+     * @return Port, resolved after start() when 0 was configured
+     */
+    uint16_t port() const { return port_; }
+
+    /**
+     * @brief Get replication counters
+     * @return Counters
+     */
+    ReplicationStats get_statistics() const;
+
+    /**
+     * @brief RFC 3074 load-balancing hash (Pearson's hash with the RFC's table)
+     * @param key Client identifier or hardware address
+     * @param length Key length
+     * @return Hash bucket
+     */
+    static uint8_t load_balance_hash(const uint8_t* key, size_t length);
+
+    /**
+     * @brief Parse a configured role
+     * @param name "primary" or "secondary"
+     * @return Role
+     * @throws LeaseReplicationException for other names
+     */
+    static FailoverRole parse_role(const std::string& name);
+
+private:
+    struct Link;
+
+    LeaseManager& leases_;
+    const FailoverRole role_;
+    const std::string peer_address_;
+    IpAddress peer_ip_;
+    uint16_t port_;
+    const uint32_t split_;
+    std::atomic<bool> peer_up_;
+    int listen_fd_;
+    int wake_fds_[2];
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+
+    // Shared with the lease manager's threads
+    mutable std::mutex mutex_;
+    std::string pending_;         // encoded records not yet framed
+    uint64_t pending_records_;
+    bool streaming_;              // queue changes: the current resync snapshot covers earlier ones
+    bool resync_requested_;       // pending_ overflowed; send the whole table again
+
+    std::atomic<uint64_t> records_sent_;
+    std::atomic<uint64_t> records_acked_;
+    std::atomic<uint64_t> records_received_;
+    std::atomic<uint64_t> resyncs_;
+    std::atomic<uint64_t> connections_;
+
+    /**
+     * @brief Change listener: queue one record for the peer
+     * @param op Change
+     * @param lease Lease
+     */
+    void enqueue(JournalOp op, const DhcpLease& lease);
+
+    /**
+     * @brief Wake the replication thread
+     */
+    void wake();
+
+    /**
+     * @brief Replication thread: connect or accept, then move frames both ways
+     */
+    void run();
+
+    /**
+     * @brief Start a connection attempt to the peer (primary)
+     * @param link Idle link
+     */
+    void connect_peer(Link& link);
+
+    /**
+     * @brief Accept a connection from the peer (secondary), replacing the current one
+     * @param link Link
+     */
+    void accept_peer(Link& link);
+
+    /**
+     * @brief Set up a newly connected socket and send the handshake
+     * @param link Link with its socket set
+     */
+    void on_connected(Link& link);
+
+    /**
+     * @brief Start sending the whole active lease table
+     * @param link Handshaken link
+     */
+    void begin_resync(Link& link);
+
+    /**
+     * @brief Queue resync chunks, the changes queued so far and heartbeats
+     * @param link Handshaken link
+     */
+    void fill_outbox(Link& link);
+
+    /**
+     * @brief Read what the peer sent and handle every complete frame
+     * @param link Connected link
+     * @return false if the connection closed or the peer broke the protocol
+     */
+    bool receive(Link& link);
+
+    /**
+     * @brief Write as much of the outbox as the socket takes
+     * @param link Connected link
+     * @return false on a socket error
+     */
+    bool flush(Link& link);
+
+    /**
+     * @brief Close the connection and take over the peer's clients
+     * @param link Link; reset to idle
+     * @param reason Logged when the peer was up; empty for a quiet shutdown
+     */
+    void drop_link(Link& link, const std::string& reason);
+
+    /**
+     * @brief Close the listening socket and the wake pipe
+     */
+    void close_fds();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_REPLICATION_HPP
@@ -0,0 +1,213 @@
+/**
+ * @file lease/snapshot.hpp
+ * @brief Versioned binary lease snapshot that can be memory-mapped
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LEASE_SNAPSHOT_HPP
+#define SIMPLE_DHCPD_LEASE_SNAPSHOT_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Lease snapshot exception
+ */
+class LeaseSnapshotException : public std::exception {
+public:
+    explicit LeaseSnapshotException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief Snapshot file header
+ *
+ * Records follow the header directly and the string area follows the
+ * records. header_crc covers the header bytes before it; body_crc covers
+ * records and strings. byte_order holds kByteOrder as written, so a file
+ * from a host of the other endianness is rejected instead of misread.
+ */
+struct SnapshotHeader {
+    char magic[4];           // "SDLS"
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint64_t record_count;
+    uint64_t strings_size;
+    int64_t created_at;      // system_clock ticks
+    uint32_t body_crc;
+    uint32_t byte_order;
+    uint32_t reserved[3];
+    uint32_t header_crc;
+
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kByteOrder = 0x01020304u;
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader is part of the file format");
+
+/**
+ * @brief One lease as laid out in a snapshot
+ *
+ * Records are sorted by MAC address so a mapped snapshot can be searched
+ * in place. Strings are offsets into the string area.
+ */
+struct SnapshotRecord {
+    int64_t lease_start;     // system_clock ticks
+    int64_t lease_end;
+    int64_t renewal_time;
+    int64_t rebinding_time;
+    int64_t allocated_at;
+    int64_t expires_at;
+    uint32_t hostname_offset;
+    uint32_t client_id_offset;
+    uint16_t hostname_length;
+    uint16_t client_id_length;
+    IpAddress ip_address;
+    uint32_t lease_time;     // seconds
+    MacAddress mac_address;
+    uint8_t lease_type;
+    uint8_t flags;
+    uint32_t reserved;
+
+    static constexpr uint8_t kActive = 0x01;
+    static constexpr uint8_t kStatic = 0x02;
+};
+
+static_assert(sizeof(SnapshotRecord) == 80, "SnapshotRecord is part of the file format");
+
+/**
+ * @brief Builds a snapshot file
+ */
+class LeaseSnapshotWriter {
+public:
+    /**
+     * @brief Reserve room for a number of leases
+     * @param count Expected lease count
+     */
+    void reserve(size_t count) { records_.reserve(count); }
+
+    /**
+     * @brief Add a lease; options are not kept
+     * @param lease Lease
+     */
+    void add(const DhcpLease& lease);
+
+    /**
+     * @brief Get number of leases added
+     * @return Lease count
+     */
+    size_t size() const { return records_.size(); }
+
+    /**
+     * @brief Sort the leases and atomically replace a file with the snapshot
+     * @param path Destination; written as path.tmp, synced and renamed
+     * @throws LeaseSnapshotException on I/O errors
+     */
+    void write(const std::string& path);
+
+private:
+    std::vector<SnapshotRecord> records_;
+    std::string strings_;
+};
+
+/**
+ * @brief Read-only view of a memory-mapped snapshot
+ *
+ * Opening maps the file and checks both checksums; records are then read
+ * in place without parsing, and find() binary-searches them by MAC.
+ */
+class LeaseSnapshot {
+public:
+    /**
+     * @brief Map and validate a snapshot
+     * @param path Snapshot file
+     * @throws LeaseSnapshotException if the file cannot be mapped, has an
+     *         unknown version or byte order, or fails its checksums
+     */
+    explicit LeaseSnapshot(const std::string& path);
+
+    /**
+     * @brief Destructor; unmaps the file
+     */
+    ~LeaseSnapshot();
+
+    LeaseSnapshot(const LeaseSnapshot&) = delete;
+    LeaseSnapshot& operator=(const LeaseSnapshot&) = delete;
+
+    /**
+     * @brief Get number of records
+     * @return Record count
+     */
+    size_t size() const { return count_; }
+
+    /**
+     * @brief Get a record
+     * @param index Record index, below size()
+     * @return Record in the mapping
+     */
+    const SnapshotRecord& record(size_t index) const { return records_[index]; }
+
+    /**
+     * @brief Get the hostname of a record
+     * @param record Record of this snapshot
+     * @return View into the mapping
+     */
+    std::string_view hostname(const SnapshotRecord& record) const {
+        return std::string_view(strings_ + record.hostname_offset, record.hostname_length);
+    }
+
+    /**
+     * @brief Get the client identifier of a record
+     * @param record Record of this snapshot
+     * @return View into the mapping
+     */
+    std::string_view client_id(const SnapshotRecord& record) const {
+        return std::string_view(strings_ + record.client_id_offset, record.client_id_length);
+    }
+
+    /**
+     * @brief Find the record of a client
+     * @param mac_address Client MAC address
+     * @return Record, nullptr if none
+     */
+    const SnapshotRecord* find(const MacAddress& mac_address) const;
+
+    /**
+     * @brief Expand a record into a full lease
+     * @param record Record of this snapshot
+     * @return Lease
+     */
+    DhcpLease load(const SnapshotRecord& record) const;
+
+    /**
+     * @brief Get when the snapshot was written
+     * @return Creation time
+     */
+    std::chrono::system_clock::time_point created_at() const;
+
+private:
+    void* mapping_;
+    size_t mapping_size_;
+    const SnapshotHeader* header_;
+    const SnapshotRecord* records_;
+    const char* strings_;
+    size_t count_;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LEASE_SNAPSHOT_HPP
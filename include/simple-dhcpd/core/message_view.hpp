@@ -0,0 +1,157 @@
+/**
+ * @file core/message_view.hpp
+ * @brief Allocation-free view of a received DHCP message
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_CORE_MESSAGE_VIEW_HPP
+#define SIMPLE_DHCPD_CORE_MESSAGE_VIEW_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <array>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Parsed DHCP message that borrows the packet bytes
+ *
+ * Options are stored as offset/length pairs into the original buffer, with
+ * a 256-entry table mapping each option code to its first occurrence, so
+ * parsing does not allocate and find lookups are O(1). The view is only
+ * valid while the underlying buffer is; use to_message() to take ownership.
+ * Options overloaded into the file/sname fields (option 52) are included.
+ */
+class DhcpMessageView {
+public:
+    /**
+     * Options recorded per message: every option of a full PacketBuffer,
+     * at two bytes each, in the options area and the overloaded file and
+     * sname fields. A longer message stops being indexed at this count.
+     */
+    static constexpr size_t kMaxOptions =
+        (PacketBuffer::kCapacity - sizeof(DhcpMessageHeader) + sizeof(DhcpMessageHeader::file) +
+         sizeof(DhcpMessageHeader::sname)) / 2;
+
+    /**
+     * @brief Constructor for an empty view
+     */
+    DhcpMessageView();
+
+    /**
+     * @brief Parse a message in place
+     * @param data Raw DHCP data
+     * @param size Data size
+     * @throws DhcpParserException if the message is truncated or has no valid message type
+     */
+    DhcpMessageView(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Parse a received packet in place
+     * @param packet Received packet
+     * @throws DhcpParserException if parsing fails
+     */
+    explicit DhcpMessageView(const PacketBuffer& packet);
+
+    /**
+     * @brief Get message header
+     * @return Header inside the packet buffer
+     */
+    const DhcpMessageHeader& header() const { return *header_; }
+
+    DhcpMessageType message_type() const { return message_type_; }
+    uint32_t xid() const { return header_->xid; }
+    IpAddress client_ip() const { return header_->ciaddr; }
+    IpAddress server_ip() const { return header_->siaddr; }
+    IpAddress relay_ip() const { return header_->giaddr; }
+
+    /**
+     * @brief Get client hardware address
+     * @return First six bytes of chaddr
+     */
+    MacAddress client_mac() const;
+
+    /**
+     * @brief Check whether an option is present
+     * @param code Option code
+     * @return true if the message carries the option
+     */
+    bool has_option(DhcpOptionCode code) const {
+        return index_[static_cast<uint8_t>(code)] != kNoOption;
+    }
+
+    /**
+     * @brief Get the data of the first occurrence of an option
+     * @param code Option code
+     * @return View of the option payload, empty if absent
+     */
+    ByteView option_data(DhcpOptionCode code) const;
+
+    /**
+     * @brief Get number of options (PAD and END excluded)
+     * @return Option count
+     */
+    size_t option_count() const { return option_count_; }
+
+    /**
+     * @brief Get code of an option by position
+     * @param index Position in wire order
+     * @return Option code
+     */
+    DhcpOptionCode option_code_at(size_t index) const {
+        return static_cast<DhcpOptionCode>(options_[index].code);
+    }
+
+    /**
+     * @brief Get data of an option by position
+     * @param index Position in wire order
+     * @return View of the option payload
+     */
+    ByteView option_data_at(size_t index) const {
+        return ByteView(data_ + options_[index].offset, options_[index].length);
+    }
+
+    /**
+     * @brief Get the raw message bytes
+     * @return View of the whole message
+     */
+    ByteView raw() const { return ByteView(data_, size_); }
+
+    /**
+     * @brief Copy into an owning DhcpMessage
+     * @return Message with its own option storage
+     */
+    DhcpMessage to_message() const;
+
+private:
+    static constexpr uint16_t kNoOption = 0xFFFF;
+
+    struct OptionRef {
+        uint16_t offset;
+        uint8_t code;
+        uint8_t length;
+    };
+
+    const uint8_t* data_;
+    size_t size_;
+    const DhcpMessageHeader* header_;
+    DhcpMessageType message_type_;
+    bool end_seen_;
+    uint16_t option_count_;
+    std::array<OptionRef, kMaxOptions> options_;
+    std::array<uint16_t, 256> index_;
+
+    /**
+     * @brief Collect options from one area of the message
+     * @param begin First byte of the area
+     * @param end One past the last byte of the area
+     * @throws DhcpParserException if the option table overflows
+     */
+    void parse_area(size_t begin, size_t end);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_CORE_MESSAGE_VIEW_HPP
@@ -0,0 +1,155 @@
+/**
+ * @file core/message_writer.hpp
+ * @brief Single DHCP message encoder writing into a reusable buffer
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_CORE_MESSAGE_WRITER_HPP
+#define SIMPLE_DHCPD_CORE_MESSAGE_WRITER_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Encodes DHCP messages option by option into a caller-owned buffer
+ *
+ * Layout is header, magic cookie, options, END. Options that do not fit in
+ * the options area spill into the file and then the sname field, announced
+ * with option 52 (RFC 2132 9.3); a field is only used for overload when the
+ * header leaves it empty. Running out of all three areas is an error rather
+ * than a silent truncation.
+ */
+class DhcpMessageWriter {
+public:
+    /** Default message size limit: header plus the 312-octet options field */
+    static constexpr size_t kDefaultMaxSize = sizeof(DhcpMessageHeader) + 312;
+
+    /**
+     * @brief Constructor
+     * @param buffer Output buffer
+     * @param capacity Output buffer size
+     */
+    DhcpMessageWriter(uint8_t* buffer, size_t capacity);
+
+    /**
+     * @brief Get the writer bound to this thread's reusable buffer
+     * @return Per-thread writer; valid until the next begin() on this thread
+     */
+    static DhcpMessageWriter& for_current_thread();
+
+    /**
+     * @brief Start a new message
+     * @param header Fixed header to copy into the buffer
+     * @param max_size Largest message to produce, clamped to the buffer capacity
+     */
+    void begin(const DhcpMessageHeader& header, size_t max_size = kDefaultMaxSize);
+
+    /**
+     * @brief Append an option
+     * @param code Option code (PAD and END are ignored)
+     * @param data Option payload
+     * @param length Payload length (at most 255)
+     * @throws DhcpParserException if the option does not fit anywhere
+     */
+    void add_option(DhcpOptionCode code, const uint8_t* data, size_t length);
+
+    /**
+     * @brief Append an option
+     * @param code Option code
+     * @param data Option payload
+     * @throws DhcpParserException if the option does not fit anywhere
+     */
+    void add_option(DhcpOptionCode code, const std::vector<uint8_t>& data) {
+        add_option(code, data.data(), data.size());
+    }
+
+    /**
+     * @brief Append a single-byte option
+     * @param code Option code
+     * @param value Option value
+     * @throws DhcpParserException if the option does not fit anywhere
+     */
+    void add_option_u8(DhcpOptionCode code, uint8_t value);
+
+    /**
+     * @brief Append a 32-bit big-endian option
+     * @param code Option code
+     * @param value Option value in host byte order
+     * @throws DhcpParserException if the option does not fit anywhere
+     */
+    void add_option_u32(DhcpOptionCode code, uint32_t value);
+
+    /**
+     * @brief Append an IPv4 address option
+     * @param code Option code
+     * @param address Address in network byte order
+     * @throws DhcpParserException if the option does not fit anywhere
+     */
+    void add_option_ip(DhcpOptionCode code, IpAddress address);
+
+    /**
+     * @brief Reserve contiguous space in the options area for pre-encoded options
+     * @param length Number of bytes
+     * @return Pointer to the reserved bytes, or nullptr if they do not fit
+     */
+    uint8_t* reserve(size_t length);
+
+    /**
+     * @brief Terminate the message
+     * @return View of the encoded message inside the buffer
+     */
+    ByteView finish();
+
+    /**
+     * @brief Encode a whole message with the per-thread writer
+     * @param message Message to encode
+     * @param max_size Largest message to produce
+     * @return View into the per-thread buffer, valid until the next encode on this thread
+     * @throws DhcpParserException if the options do not fit
+     */
+    static ByteView encode(const DhcpMessage& message, size_t max_size = kDefaultMaxSize);
+
+    /**
+     * @brief Get the overload flags used by the current message
+     * @return Option 52 value (1 = file, 2 = sname, 3 = both), 0 if none
+     */
+    uint8_t overload() const { return overload_; }
+
+private:
+    /**
+     * @brief One region options can be written to
+     */
+    struct Area {
+        size_t offset;
+        size_t end;
+        bool usable;
+    };
+
+    uint8_t* buffer_;
+    size_t capacity_;
+    size_t limit_;
+    Area main_;
+    Area file_;
+    Area sname_;
+    uint8_t overload_;
+
+    /**
+     * @brief Try writing an encoded option into an area
+     * @param area Area to write into
+     * @param reserved Bytes to keep free at the end of the area
+     * @param code Option code
+     * @param data Payload
+     * @param length Payload length
+     * @return true if the option was written
+     */
+    bool write_to(Area& area, size_t reserved, uint8_t code, const uint8_t* data, size_t length);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_CORE_MESSAGE_WRITER_HPP
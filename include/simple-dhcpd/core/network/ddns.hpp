@@ -0,0 +1,275 @@
+/**
+ * @file network/ddns.hpp
+ * @brief Asynchronous, batched dynamic DNS updates (RFC 2136, TSIG per RFC 8945)
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_DDNS_HPP
+#define SIMPLE_DHCPD_DDNS_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include "simple-dhcpd/core/utils/latency_histogram.hpp"
+#include "simple-dhcpd/core/utils/mpsc_queue.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief DDNS exception
+ */
+class DdnsException : public std::exception {
+public:
+    explicit DdnsException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief DDNS counters
+ */
+struct DdnsStats {
+    uint64_t queued = 0;            ///< Lease events accepted
+    uint64_t dropped = 0;           ///< Lease events refused because the queue was full
+    uint64_t coalesced = 0;         ///< Events folded into a later one, or already in DNS
+    uint64_t updates_sent = 0;      ///< UPDATE messages sent, retries included
+    uint64_t records_updated = 0;   ///< Address changes the DNS server confirmed
+    uint64_t failures = 0;          ///< Address changes given up on
+    uint64_t retries = 0;           ///< Batches sent again after a failure
+    uint64_t queue_depth = 0;       ///< Events and address changes not yet confirmed
+    uint64_t latency_count = 0;     ///< Confirmed changes timed, from lease event to DNS answer
+    uint64_t latency_sum_ns = 0;
+    uint64_t latency_p50_ns = 0;
+    uint64_t latency_p99_ns = 0;
+    uint64_t latency_max_ns = 0;
+};
+
+/**
+ * @brief Keeps A and PTR records in step with leases, off the packet path
+ *
+ * add() and remove() push a lease event onto a bounded lock-free queue and
+ * return; a full queue drops the event and counts it, so a slow or
+ * unreachable DNS server never holds up a DHCP handler. One thread drains
+ * the queue into a table of address changes, where later events for an
+ * address replace earlier ones, waits a few milliseconds for more, and
+ * sends the changes as one RFC 2136 UPDATE per zone (at most kMaxBatch
+ * changes each) over a persistent TCP connection, signed with TSIG when a
+ * key is configured. A batch that fails for a transient reason (no
+ * connection, timeout, SERVFAIL) is retried with exponential backoff, up
+ * to kMaxAttempts times; a refused one is dropped.
+ *
+ * An added name replaces the A records of the name and the PTR record of
+ * the address. A removal deletes only that A record, so a name that moved
+ * to another address keeps it. The names this server registered are kept
+ * in memory; after a restart a removal for an address registered earlier
+ * deletes its PTR record only. Answers are matched by message ID; their
+ * TSIG is not verified.
+ */
+class DdnsUpdater {
+public:
+    /** Address changes per UPDATE message */
+    static constexpr size_t kMaxBatch = 64;
+
+    /** Sends of a change before it is given up on */
+    static constexpr uint32_t kMaxAttempts = 5;
+
+    /**
+     * @brief Constructor
+     * @param config Configuration; the ddns_* settings are used
+     * @throws DdnsException if the server address or the TSIG secret is invalid
+     */
+    explicit DdnsUpdater(const DhcpConfig& config);
+
+    /**
+     * @brief Destructor; stops the update thread
+     */
+    ~DdnsUpdater();
+
+    DdnsUpdater(const DdnsUpdater&) = delete;
+    DdnsUpdater& operator=(const DdnsUpdater&) = delete;
+
+    /**
+     * @brief Start the update thread
+     * @throws DdnsException if the wake pipe cannot be created
+     */
+    void start();
+
+    /**
+     * @brief Stop the update thread; unsent changes are dropped
+     */
+    void stop();
+
+    /**
+     * @brief Queue an address now leased under a host name; never blocks
+     * @param host_label Host name label from host_label()
+     * @param ip_address Leased address, network byte order
+     * @return false if the label is empty or the queue is full
+     */
+    bool add(const std::string& host_label, IpAddress ip_address);
+
+    /**
+     * @brief Queue an address no longer leased; never blocks
+     * @param ip_address Released or expired address, network byte order
+     * @return false if the queue is full
+     */
+    bool remove(IpAddress ip_address);
+
+    /**
+     * @brief Get counters, queue depth and update latency
+     * @return Statistics
+     */
+    DdnsStats get_statistics() const;
+
+    /**
+     * @brief Turn a Host Name option into a DNS label
+     * @param host_name Option 12 data
+     * @return Lower-case letters, digits and hyphens of the first label, at most 63; empty if none
+     */
+    static std::string host_label(ByteView host_name);
+
+    /**
+     * @brief Get the in-addr.arpa name of an address
+     * @param ip_address Address, network byte order
+     * @return Name such as "4.3.2.1.in-addr.arpa"
+     */
+    static std::string reverse_name(IpAddress ip_address);
+
+    /**
+     * @brief Append a name in uncompressed wire format
+     * @param out Message
+     * @param name Dotted name; a trailing dot is optional
+     * @throws DdnsException if a label is empty or longer than 63 bytes
+     */
+    static void append_name(std::vector<uint8_t>& out, const std::string& name);
+
+    /**
+     * @brief Sign a message with a TSIG (HMAC-SHA256) record
+     * @param message Complete message; the record is appended and ARCOUNT raised
+     * @param key_name Key name
+     * @param secret Key secret
+     * @param time_signed Seconds since the epoch
+     */
+    static void sign(std::vector<uint8_t>& message, const std::string& key_name,
+                     const std::vector<uint8_t>& secret, uint64_t time_signed);
+
+    /**
+     * @brief Decode a base64 TSIG secret
+     * @param text Base64 text
+     * @param out Decoded bytes
+     * @return false if the text is not base64
+     */
+    static bool decode_base64(const std::string& text, std::vector<uint8_t>& out);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        bool add = false;
+        IpAddress ip_address = 0;
+        std::string label;
+        Clock::time_point queued;
+    };
+
+    struct Change {
+        bool add;
+        std::string label;
+        Clock::time_point queued;   // first event folded into the change
+        uint32_t attempts;
+    };
+
+    IpAddress server_ip_;
+    const uint16_t port_;
+    const std::string forward_zone_;
+    const std::string reverse_zone_;
+    const uint32_t ttl_;
+    const std::string key_name_;
+    std::vector<uint8_t> secret_;
+
+    BoundedMpscQueue<Event> queue_;
+    int wake_fds_[2];                           // a byte in [0] means the queue needs a drain
+    std::atomic<bool> signalled_;               // a wake byte is written and not yet drained
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+
+    // Update thread only
+    std::unordered_map<IpAddress, Change> pending_;
+    std::unordered_map<IpAddress, std::string> names_;   // labels registered by this server
+    int fd_;
+    uint16_t next_id_;
+    Clock::time_point retry_at_;
+    std::chrono::milliseconds backoff_;
+
+    std::atomic<uint64_t> queued_;
+    std::atomic<uint64_t> taken_;               // events drained into pending_
+    std::atomic<uint64_t> pending_count_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> coalesced_;
+    std::atomic<uint64_t> updates_sent_;
+    std::atomic<uint64_t> records_updated_;
+    std::atomic<uint64_t> failures_;
+    std::atomic<uint64_t> retries_;
+    LatencyHistogram latency_;
+
+    /**
+     * @brief Queue an event and wake the update thread once per drain
+     */
+    bool push(Event& event);
+
+    /**
+     * @brief Update thread function
+     */
+    void run();
+
+    /**
+     * @brief Fold the queued events into pending_
+     */
+    void drain_queue();
+
+    /**
+     * @brief Send one batch of pending_ changes per zone and apply the answers
+     */
+    void send_batch();
+
+    /**
+     * @brief Encode the UPDATE of one zone for a batch
+     * @return Message, empty if no change of the batch touches the zone
+     */
+    std::vector<uint8_t> encode_update(const std::vector<std::pair<IpAddress, Change>>& batch, bool forward,
+                                       uint16_t id) const;
+
+    /**
+     * @brief Send framed messages and read one answer per message
+     * @param messages Messages to send
+     * @param rcodes Receives the answer RCODE of each message
+     * @return false on a connection error or timeout
+     */
+    bool exchange(const std::vector<std::vector<uint8_t>>& messages, std::vector<uint8_t>& rcodes);
+
+    /**
+     * @brief Connect to the DNS server if not connected
+     * @return false if the connection failed
+     */
+    bool connect_server();
+
+    /**
+     * @brief Close the connection to the DNS server
+     */
+    void disconnect();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_DDNS_HPP
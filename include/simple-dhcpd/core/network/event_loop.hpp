@@ -0,0 +1,281 @@
+/**
+ * @file network/event_loop.hpp
+ * @brief Readiness event loop multiplexing sockets, timers and posted work
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_EVENT_LOOP_HPP
+#define SIMPLE_DHCPD_EVENT_LOOP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Event loop exception
+ */
+class EventLoopException : public std::exception {
+public:
+    explicit EventLoopException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief Readiness notification mechanism behind an EventLoop
+ */
+enum class EventBackendType {
+    AUTO,   ///< Best available: epoll on Linux, poll elsewhere
+    EPOLL,  ///< Linux epoll
+    POLL    ///< POSIX poll, rebuilt from the watched set on every wait
+};
+
+/**
+ * @brief Readable-descriptor multiplexer used by EventLoop
+ *
+ * Implementations report level-triggered readability. add() and remove()
+ * may be called from any thread while wait() runs; the loop also wakes
+ * itself after every change, so a backend that snapshots its set when
+ * wait() starts (as poll does) still sees the change on the next wait.
+ * A completion-based backend such as io_uring fits the same interface by
+ * arming a poll request per descriptor.
+ */
+class EventBackend {
+public:
+    virtual ~EventBackend() = default;
+
+    /**
+     * @brief Start reporting readability of a descriptor
+     * @param fd Descriptor
+     * @throws EventLoopException if the descriptor cannot be added
+     */
+    virtual void add(int fd) = 0;
+
+    /**
+     * @brief Stop reporting a descriptor
+     * @param fd Descriptor
+     */
+    virtual void remove(int fd) = 0;
+
+    /**
+     * @brief Wait for readable descriptors
+     * @param ready Receives the readable descriptors; cleared first
+     * @param timeout_ms Longest wait, -1 for none
+     */
+    virtual void wait(std::vector<int>& ready, int timeout_ms) = 0;
+
+    /**
+     * @brief Get backend name
+     * @return "epoll" or "poll"
+     */
+    virtual const char* name() const = 0;
+};
+
+/**
+ * @brief Create a backend
+ * @param type Requested backend
+ * @return Backend
+ * @throws EventLoopException if the backend is not available here
+ */
+std::unique_ptr<EventBackend> make_event_backend(EventBackendType type);
+
+/**
+ * @brief Parse a backend name from the configuration
+ * @param name "auto", "epoll" or "poll"
+ * @return Backend type
+ * @throws EventLoopException on any other name
+ */
+EventBackendType parse_event_backend(const std::string& name);
+
+/**
+ * @brief One thread waiting on sockets, periodic timers and a control channel
+ *
+ * A watched descriptor's callback runs on the loop thread each time the
+ * descriptor is readable; it is expected to read until EAGAIN (or a fair
+ * share) and return. Timers are kept in a deadline heap, so the wait
+ * timeout is the time to the next one and an idle loop does not wake.
+ * post() queues work for the loop thread through a self-pipe, which is
+ * also how changes made from other threads wake the wait.
+ *
+ * unwatch() and cancel_timer() return only once the callback is no longer
+ * running, so the object it points to can be destroyed right after.
+ */
+class EventLoop {
+public:
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t;
+
+    /**
+     * @brief Constructor
+     * @param backend Readiness backend
+     * @param name Name used in log messages
+     * @throws EventLoopException if the backend or the wake pipe cannot be created
+     */
+    explicit EventLoop(EventBackendType backend = EventBackendType::AUTO, const std::string& name = "event-loop");
+
+    /**
+     * @brief Destructor; stops the loop and joins its thread
+     *
+     * Must not run on the loop thread; if it does, the thread is detached
+     * and logged rather than terminating the process.
+     */
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+     * @brief Start the loop thread
+     * @param cpu CPU to pin the thread to, or -1 to leave scheduling to the kernel
+     *
+     * Called from a callback after stop(), the loop just keeps running.
+     */
+    void start(int cpu = -1);
+
+    /**
+     * @brief Stop the loop thread; watches and timers stay registered
+     *
+     * From a callback, the loop returns once the callback does and is joined
+     * by the next stop(), start() or the destructor on another thread.
+     */
+    void stop();
+
+    /**
+     * @brief Check whether the loop thread runs
+     * @return true between start() and stop()
+     */
+    bool is_running() const { return running_.load(); }
+
+    /**
+     * @brief Check whether the caller is the loop thread
+     * @return true on the loop thread
+     */
+    bool in_loop_thread() const { return loop_thread_.load() == std::this_thread::get_id(); }
+
+    /**
+     * @brief Call a function whenever a descriptor is readable
+     * @param fd Non-blocking descriptor
+     * @param on_readable Callback, run on the loop thread
+     * @throws EventLoopException if the backend refuses the descriptor
+     */
+    void watch(int fd, Callback on_readable);
+
+    /**
+     * @brief Stop watching a descriptor
+     * @param fd Descriptor
+     */
+    void unwatch(int fd);
+
+    /**
+     * @brief Call a function periodically on the loop thread
+     * @param interval Time between calls; the first call comes one interval from now
+     * @param fn Callback
+     * @return Id for cancel_timer()
+     */
+    TimerId add_timer(std::chrono::milliseconds interval, Callback fn);
+
+    /**
+     * @brief Stop a periodic timer
+     * @param id Id from add_timer()
+     */
+    void cancel_timer(TimerId id);
+
+    /**
+     * @brief Run a function once on the loop thread
+     * @param fn Callback
+     */
+    void post(Callback fn);
+
+    /**
+     * @brief Get backend name
+     * @return "epoll" or "poll"
+     */
+    const char* backend_name() const { return backend_->name(); }
+
+    /**
+     * @brief Get number of times the loop returned from waiting
+     * @return Wakeup count
+     */
+    uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+
+private:
+    struct Timer {
+        std::chrono::steady_clock::time_point due;
+        std::chrono::steady_clock::duration interval;
+        std::shared_ptr<Callback> fn;
+    };
+
+    using Deadline = std::pair<std::chrono::steady_clock::time_point, TimerId>;
+
+    std::string name_;
+    std::unique_ptr<EventBackend> backend_;
+    int wake_fds_[2];   // writing to [1] wakes the wait
+    std::atomic<bool> running_;
+    std::atomic<std::thread::id> loop_thread_;
+    std::thread thread_;
+    std::atomic<uint64_t> wakeups_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;   // signalled when a callback finishes
+    std::map<int, std::shared_ptr<Callback>> watchers_;
+    std::map<TimerId, Timer> timers_;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
+    std::vector<Callback> posted_;
+    TimerId next_timer_id_;
+    int active_fd_;          // descriptor whose callback runs, -1 if none
+    TimerId active_timer_;   // timer whose callback runs, 0 if none
+
+    /**
+     * @brief Loop thread function
+     */
+    void run();
+
+    /**
+     * @brief Wake the wait from another thread
+     */
+    void wake();
+
+    /**
+     * @brief Run the callback of one readable descriptor
+     */
+    void dispatch(int fd);
+
+    /**
+     * @brief Run the timers that are due and schedule their next call
+     */
+    void run_due_timers();
+
+    /**
+     * @brief Run the posted functions
+     */
+    void run_posted();
+
+    /**
+     * @brief Get the wait timeout until the next timer
+     * @return Milliseconds, -1 if no timer is set
+     */
+    int next_timeout_ms();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_EVENT_LOOP_HPP
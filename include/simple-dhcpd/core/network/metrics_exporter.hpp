@@ -0,0 +1,163 @@
+/**
+ * @file network/metrics_exporter.hpp
+ * @brief Prometheus text-format metrics endpoint
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_METRICS_EXPORTER_HPP
+#define SIMPLE_DHCPD_METRICS_EXPORTER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Metrics exporter exception
+ */
+class MetricsExporterException : public std::exception {
+public:
+    explicit MetricsExporterException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief Label name/value pairs of one sample
+ */
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @brief Builder for the Prometheus text exposition format (version 0.0.4)
+ *
+ * Call family() once per metric name, then sample() for each of its label
+ * sets. Label values are escaped; names are taken as given.
+ */
+class MetricsText {
+public:
+    /**
+     * @brief Start a metric family
+     * @param name Metric name
+     * @param type counter, gauge, summary or untyped
+     * @param help One-line description
+     */
+    void family(const std::string& name, const std::string& type, const std::string& help);
+
+    /**
+     * @brief Add a sample
+     * @param name Metric name, including any _count or _sum suffix
+     * @param value Value
+     * @param labels Labels
+     */
+    void sample(const std::string& name, double value, const MetricLabels& labels = {});
+
+    /**
+     * @brief Add an integer sample, written without rounding
+     */
+    void sample(const std::string& name, uint64_t value, const MetricLabels& labels = {});
+
+    /**
+     * @brief Get the text built so far
+     * @return Exposition text
+     */
+    const std::string& str() const { return text_; }
+
+private:
+    std::string text_;
+
+    void labels(const MetricLabels& labels);
+};
+
+/**
+ * @brief Minimal HTTP listener serving GET /metrics from its own thread
+ *
+ * The listener thread accepts one connection at a time, reads the request
+ * line, calls the renderer and writes the response, then closes the
+ * connection. Scrapes are rare and small, so nothing here touches the DHCP
+ * receive path; the renderer runs on the listener thread and must only take
+ * the locks a statistics read takes. Slow or silent clients are cut off
+ * after a short timeout.
+ */
+class MetricsExporter {
+public:
+    using Renderer = std::function<std::string()>;
+
+    /**
+     * @brief Constructor
+     * @param address IPv4 address to listen on
+     * @param port TCP port; 0 picks a free one
+     * @param renderer Produces the /metrics body
+     */
+    MetricsExporter(const std::string& address, uint16_t port, Renderer renderer);
+
+    /**
+     * @brief Destructor; stops the listener
+     */
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    /**
+     * @brief Bind the socket and start the listener thread
+     * @throws MetricsExporterException if the address cannot be bound
+     */
+    void start();
+
+    /**
+     * @brief Stop the listener thread and close the socket
+     */
+    void stop();
+
+    /**
+     * @brief Get the port being listened on
+     * @return Port, the chosen one if constructed with 0
+     */
+    uint16_t port() const { return port_; }
+
+    /**
+     * @brief Get number of /metrics requests served
+     * @return Scrape count
+     */
+    uint64_t scrapes() const { return scrapes_.load(std::memory_order_relaxed); }
+
+private:
+    std::string address_;
+    uint16_t port_;
+    Renderer renderer_;
+    int listen_fd_;
+    int wake_fds_[2];   // stop() writes to [1] to wake the listener
+    std::thread thread_;
+    std::atomic<uint64_t> scrapes_;
+
+    /**
+     * @brief Listener thread function
+     */
+    void run();
+
+    /**
+     * @brief Answer one connection and close it
+     */
+    void serve(int client_fd);
+
+    /**
+     * @brief Close all descriptors
+     */
+    void close_fds();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_METRICS_EXPORTER_HPP
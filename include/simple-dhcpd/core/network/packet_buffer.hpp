@@ -0,0 +1,190 @@
+/**
+ * @file network/packet_buffer.hpp
+ * @brief Fixed-size pooled packet buffers for the receive path
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_PACKET_BUFFER_HPP
+#define SIMPLE_DHCPD_PACKET_BUFFER_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <string>
+#include <netinet/in.h>
+
+namespace simple_dhcpd {
+
+class UdpSocket;
+
+/**
+ * @brief Non-owning read-only view of contiguous bytes
+ *
+ * Stand-in for std::span<const uint8_t> while the tree builds as C++17.
+ */
+class ByteView {
+public:
+    constexpr ByteView() : data_(nullptr), size_(0) {}
+    constexpr ByteView(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+    ByteView(const std::vector<uint8_t>& data) : data_(data.data()), size_(data.size()) {}
+
+    constexpr const uint8_t* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+    constexpr const uint8_t* begin() const { return data_; }
+    constexpr const uint8_t* end() const { return data_ + size_; }
+    constexpr const uint8_t& operator[](size_t index) const { return data_[index]; }
+
+    /**
+     * @brief Get a view of part of this view
+     * @param offset First byte of the sub-view
+     * @param count Number of bytes, clamped to the end of this view
+     * @return Sub-view, empty if offset is past the end
+     */
+    ByteView subview(size_t offset, size_t count = static_cast<size_t>(-1)) const {
+        if (offset >= size_) {
+            return ByteView();
+        }
+        return ByteView(data_ + offset, count < size_ - offset ? count : size_ - offset);
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+/**
+ * @brief Where a received datagram came in
+ *
+ * Filled by the receiving socket from IP_PKTINFO; a reply sent while the
+ * packet is dispatched leaves through the same socket and interface.
+ */
+struct PacketIngress {
+    UdpSocket* socket = nullptr;     ///< Socket the datagram was read from
+    int interface_index = 0;         ///< Receiving interface, 0 if unknown
+    IpAddress local_address = 0;     ///< Local address the interface answers from, network byte order
+    std::string interface_name;      ///< Receiving interface name, empty if unknown
+};
+
+/**
+ * @brief Fixed-size datagram buffer with the sender's address and ingress
+ *
+ * Large enough for one Ethernet-MTU datagram; buffers are recycled through a
+ * PacketBufferPool so receiving a packet never touches the heap.
+ */
+class PacketBuffer {
+public:
+    /** Storage capacity in bytes (standard MTU) */
+    static constexpr size_t kCapacity = 1500;
+
+    PacketBuffer() : size_(0) {
+        std::memset(&peer_, 0, sizeof(peer_));
+    }
+
+    uint8_t* data() { return storage_.data(); }
+    const uint8_t* data() const { return storage_.data(); }
+    size_t size() const { return size_; }
+    static constexpr size_t capacity() { return kCapacity; }
+
+    /**
+     * @brief Set the number of valid bytes
+     * @param size Datagram length, clamped to the capacity
+     */
+    void set_size(size_t size) { size_ = size < kCapacity ? size : kCapacity; }
+
+    /**
+     * @brief Get a view of the valid bytes
+     * @return Byte view of the datagram
+     */
+    ByteView view() const { return ByteView(storage_.data(), size_); }
+
+    struct sockaddr_in& peer() { return peer_; }
+    const struct sockaddr_in& peer() const { return peer_; }
+
+    /**
+     * @brief Get sender address
+     * @return Sender IPv4 address in network byte order
+     */
+    IpAddress peer_address() const { return peer_.sin_addr.s_addr; }
+
+    /**
+     * @brief Get sender port
+     * @return Sender UDP port in host byte order
+     */
+    uint16_t peer_port() const { return ntohs(peer_.sin_port); }
+
+    PacketIngress& ingress() { return ingress_; }
+    const PacketIngress& ingress() const { return ingress_; }
+
+private:
+    std::array<uint8_t, kCapacity> storage_;
+    size_t size_;
+    struct sockaddr_in peer_;
+    PacketIngress ingress_;
+};
+
+/**
+ * @brief Pool of preallocated packet buffers
+ *
+ * All buffers are allocated once at construction; acquire() hands one out
+ * and it returns to the pool when its handle goes out of scope.
+ */
+class PacketBufferPool {
+public:
+    /**
+     * @brief Returns a buffer to its pool
+     */
+    struct Releaser {
+        PacketBufferPool* pool;
+        void operator()(PacketBuffer* buffer) const;
+    };
+
+    using Handle = std::unique_ptr<PacketBuffer, Releaser>;
+
+    /**
+     * @brief Constructor
+     * @param count Number of buffers to preallocate
+     */
+    explicit PacketBufferPool(size_t count);
+
+    PacketBufferPool(const PacketBufferPool&) = delete;
+    PacketBufferPool& operator=(const PacketBufferPool&) = delete;
+
+    /**
+     * @brief Take a buffer from the pool
+     * @return Buffer handle, empty if the pool is exhausted
+     */
+    Handle acquire();
+
+    /**
+     * @brief Get number of free buffers
+     * @return Buffers currently available
+     */
+    size_t available() const;
+
+    /**
+     * @brief Get pool size
+     * @return Total number of buffers
+     */
+    size_t capacity() const;
+
+private:
+    std::vector<PacketBuffer> buffers_;
+    std::vector<PacketBuffer*> free_;
+    mutable std::mutex mutex_;
+
+    /**
+     * @brief Put a buffer back on the free list
+     * @param buffer Buffer obtained from acquire()
+     */
+    void release(PacketBuffer* buffer);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_PACKET_BUFFER_HPP
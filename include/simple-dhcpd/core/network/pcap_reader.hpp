@@ -0,0 +1,121 @@
+/**
+ * @file network/pcap_reader.hpp
+ * @brief Reader for the UDP datagrams of a pcap capture file
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_PCAP_READER_HPP
+#define SIMPLE_DHCPD_PCAP_READER_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Capture file exception
+ */
+class PcapReaderException : public std::exception {
+public:
+    explicit PcapReaderException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief One IPv4 UDP datagram taken from a capture
+ */
+struct PcapDatagram {
+    uint64_t timestamp_ns = 0;        ///< Capture time since the epoch
+    IpAddress source = 0;             ///< Network byte order
+    IpAddress destination = 0;        ///< Network byte order
+    uint16_t source_port = 0;         ///< Host byte order
+    uint16_t destination_port = 0;    ///< Host byte order
+    ByteView payload;                 ///< UDP payload, valid until the next read
+};
+
+/**
+ * @brief Reads IPv4 UDP datagrams from a classic libpcap file
+ *
+ * Handles both byte orders and both timestamp resolutions of the classic
+ * format, with Ethernet (802.1Q and 802.1ad tags included), Linux cooked
+ * (SLL and SLL2) and raw IPv4 link types. pcapng files are refused; convert
+ * them with `editcap -F pcap`. Frames that are not IPv4 UDP, IP fragments
+ * and frames cut short by the snap length are skipped and counted.
+ */
+class PcapReader {
+public:
+    /** Largest frame accepted before the file is considered corrupt */
+    static constexpr uint32_t kMaxFrameSize = 256 * 1024;
+
+    /**
+     * @brief Open a capture and read its file header
+     * @param path Capture file
+     * @throws PcapReaderException if the file cannot be read or is not a supported capture
+     */
+    explicit PcapReader(const std::string& path);
+
+    /**
+     * @brief Read the next UDP datagram
+     * @param datagram Filled in on success; its payload points into the reader
+     * @return false at the end of the capture; a final record cut short ends it too
+     * @throws PcapReaderException if a record header is corrupt
+     */
+    bool next(PcapDatagram& datagram);
+
+    /**
+     * @brief Get the capture's link type
+     * @return LINKTYPE_ value from the file header
+     */
+    uint32_t link_type() const { return link_type_; }
+
+    /**
+     * @brief Get number of frames read
+     * @return Frames, returned and skipped
+     */
+    uint64_t frames() const { return frames_; }
+
+    /**
+     * @brief Get number of frames skipped
+     * @return Frames that were not complete IPv4 UDP datagrams
+     */
+    uint64_t skipped() const { return skipped_; }
+
+    /**
+     * @brief Find the UDP datagram in one captured frame
+     * @param link_type LINKTYPE_ value of the capture
+     * @param frame Frame bytes
+     * @param length Captured length
+     * @param datagram Receives addresses, ports and the payload (pointing into frame)
+     * @return false if the frame is not a complete, unfragmented IPv4 UDP datagram
+     */
+    static bool decode_frame(uint32_t link_type, const uint8_t* frame, size_t length, PcapDatagram& datagram);
+
+private:
+    std::ifstream file_;
+    std::string path_;
+    bool swapped_;
+    bool nanoseconds_;
+    uint32_t link_type_;
+    std::vector<uint8_t> frame_;
+    uint64_t frames_;
+    uint64_t skipped_;
+
+    uint32_t read_u32(const uint8_t* bytes) const;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_PCAP_READER_HPP
@@ -0,0 +1,213 @@
+/**
+ * @file network/ping_check.hpp
+ * @brief Asynchronous ICMP echo probes for addresses about to be offered
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_PING_CHECK_HPP
+#define SIMPLE_DHCPD_PING_CHECK_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/event_loop.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Ping check exception
+ */
+class PingCheckException : public std::exception {
+public:
+    explicit PingCheckException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief What is known about an address from recent probes
+ */
+enum class PingStatus {
+    UNKNOWN,    ///< Not probed within the cache window
+    FREE,       ///< Probed recently, no echo reply
+    IN_USE      ///< Probed recently and answered
+};
+
+/**
+ * @brief Probes addresses with ICMP echo requests without blocking the caller
+ *
+ * All probes share one ICMP socket watched by an event loop: a raw socket
+ * when the process has CAP_NET_RAW, else a Linux ping socket. probe()
+ * sends the echo request and returns; the completion runs on the loop
+ * thread when the reply arrives or the timeout passes. Every probe has the
+ * same timeout, so outstanding probes expire in the order they were sent
+ * and are kept in a FIFO; a sweep timer runs only while probes are out.
+ *
+ * Results are cached for a window, so a client retransmitting DISCOVER
+ * does not cause a second probe of the address it was offered. Probes of
+ * an address already being probed wait for the same reply.
+ */
+class PingChecker {
+public:
+    /** Called on the loop thread with true if the address answered */
+    using Completion = std::function<void(bool in_use)>;
+
+    /** Probes outstanding at once; more are not sent */
+    static constexpr size_t kMaxOutstanding = 4096;
+
+    /** Completions waiting on one probe; more are dropped */
+    static constexpr size_t kMaxWaiters = 4;
+
+    /**
+     * @brief Constructor
+     * @param loop Loop the socket and sweep timer run on; must outlive the checker
+     * @param timeout Time to wait for an echo reply
+     * @param cache_window Time a result is reused for
+     */
+    PingChecker(EventLoop& loop, std::chrono::milliseconds timeout, std::chrono::seconds cache_window);
+
+    /**
+     * @brief Destructor; stops probing
+     */
+    ~PingChecker();
+
+    PingChecker(const PingChecker&) = delete;
+    PingChecker& operator=(const PingChecker&) = delete;
+
+    /**
+     * @brief Open the ICMP socket and start watching it
+     * @throws PingCheckException if no ICMP socket can be opened
+     */
+    void start();
+
+    /**
+     * @brief Stop watching the socket and drop outstanding probes without completing them
+     */
+    void stop();
+
+    /**
+     * @brief Check whether probes can be sent
+     * @return true between start() and stop()
+     */
+    bool is_running() const { return running_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Look up a recent result
+     * @param ip_address Address, network byte order
+     * @return Cached status, UNKNOWN if none is current
+     */
+    PingStatus cached(IpAddress ip_address);
+
+    /**
+     * @brief Probe an address
+     * @param ip_address Address, network byte order
+     * @param done Completion; not called if false is returned or the checker stops first
+     * @return false if no probe could be sent (not running, too many outstanding, send error)
+     */
+    bool probe(IpAddress ip_address, Completion done);
+
+    /**
+     * @brief Get number of echo requests sent
+     * @return Probe count
+     */
+    uint64_t probes_sent() const { return probes_sent_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of probes answered
+     * @return Addresses found in use
+     */
+    uint64_t probes_answered() const { return probes_answered_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of probes that timed out
+     * @return Addresses found free
+     */
+    uint64_t probes_timed_out() const { return probes_timed_out_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of cached() calls answered from the cache
+     * @return Cache hits
+     */
+    uint64_t cache_hits() const { return cache_hits_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Build an ICMP echo request
+     * @param id Identifier
+     * @param sequence Sequence number
+     * @return Header and payload with the checksum filled in
+     */
+    static std::vector<uint8_t> build_echo_request(uint16_t id, uint16_t sequence);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Probe {
+        IpAddress ip_address;
+        Clock::time_point deadline;
+        std::vector<Completion> waiters;
+    };
+
+    struct CacheEntry {
+        bool in_use;
+        Clock::time_point expires;
+    };
+
+    EventLoop& loop_;
+    const std::chrono::milliseconds timeout_;
+    const std::chrono::seconds cache_window_;
+    int fd_;
+    std::atomic<bool> running_;
+    bool raw_;                  // raw socket: replies carry the IP header and any process's echo replies
+    uint16_t id_;
+    uint16_t next_sequence_;
+    EventLoop::TimerId sweep_timer_;
+    std::mutex mutex_;
+    std::unordered_map<uint16_t, Probe> outstanding_;           // by sequence number
+    std::unordered_map<IpAddress, uint16_t> probing_;           // address -> sequence number
+    std::deque<std::pair<Clock::time_point, uint16_t>> deadlines_;   // oldest first
+    std::unordered_map<IpAddress, CacheEntry> cache_;
+    std::deque<std::pair<Clock::time_point, IpAddress>> cache_order_;  // oldest first
+    std::atomic<uint64_t> probes_sent_;
+    std::atomic<uint64_t> probes_answered_;
+    std::atomic<uint64_t> probes_timed_out_;
+    std::atomic<uint64_t> cache_hits_;
+
+    /**
+     * @brief Read echo replies until the socket is drained; runs on the loop thread
+     */
+    void on_readable();
+
+    /**
+     * @brief Complete the probes past their deadline; runs on the loop thread
+     */
+    void sweep();
+
+    /**
+     * @brief Remove a probe and cache its result; caller holds mutex_
+     * @return Completions to call once the lock is released
+     */
+    std::vector<Completion> finish_locked(uint16_t sequence, bool in_use, Clock::time_point now);
+
+    /**
+     * @brief Drop cache entries past their window; caller holds mutex_
+     */
+    void prune_cache_locked(Clock::time_point now);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_PING_CHECK_HPP
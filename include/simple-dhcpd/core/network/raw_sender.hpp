@@ -0,0 +1,155 @@
+/**
+ * @file network/raw_sender.hpp
+ * @brief Link-layer transmit ring for replies to clients without an address
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_RAW_SENDER_HPP
+#define SIMPLE_DHCPD_RAW_SENDER_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Raw socket exception
+ */
+class RawSocketException : public std::exception {
+public:
+    explicit RawSocketException(const std::string& message) : message_(message) {}
+
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+/**
+ * @brief Sends UDP datagrams as complete Ethernet frames on one interface
+ *
+ * RFC 2131 4.1 has the server unicast an OFFER or ACK to the client's
+ * hardware address when the client has no IP address yet and did not ask
+ * for a broadcast. The IP stack cannot address such a client without an
+ * ARP entry, so the frame is built here (Ethernet, IPv4 and UDP headers
+ * with checksums) and written to a PACKET_MMAP transmit ring. queue()
+ * only fills a ring slot; flush() hands every filled slot to the kernel
+ * with one send(), so replies produced while draining a socket go out
+ * in one batch.
+ *
+ * Needs CAP_NET_RAW and Linux; the constructor throws otherwise. Not
+ * thread-safe: it belongs to one receive socket and its loop thread.
+ */
+class RawFrameSender {
+public:
+    /** Size of one ring slot; holds an MTU-sized frame and the slot header */
+    static constexpr size_t kFrameSize = 2048;
+
+    /** Default number of ring slots */
+    static constexpr size_t kDefaultFrames = 64;
+
+    /** Ethernet, IPv4 and UDP header bytes in front of the payload */
+    static constexpr size_t kHeaderSize = 14 + 20 + 8;
+
+    /**
+     * @brief Constructor
+     * @param interface_index Interface to send on
+     * @param frames Ring slots, rounded up to whole pages
+     * @throws RawSocketException if the socket, ring or interface cannot be set up
+     */
+    explicit RawFrameSender(int interface_index, size_t frames = kDefaultFrames);
+
+    /**
+     * @brief Destructor; frames still queued are sent
+     */
+    ~RawFrameSender();
+
+    RawFrameSender(const RawFrameSender&) = delete;
+    RawFrameSender& operator=(const RawFrameSender&) = delete;
+
+    /**
+     * @brief Put a datagram in the ring
+     * @param destination_mac Client hardware address
+     * @param source_ip Source address, network byte order
+     * @param source_port Source port, host byte order
+     * @param destination_ip Destination address, network byte order
+     * @param destination_port Destination port, host byte order
+     * @param payload UDP payload
+     * @return false if the ring is full, even after a flush, or the payload does not fit a frame
+     */
+    bool queue(const MacAddress& destination_mac, IpAddress source_ip, uint16_t source_port,
+               IpAddress destination_ip, uint16_t destination_port, ByteView payload);
+
+    /**
+     * @brief Hand the queued frames to the kernel
+     * @return Number of frames submitted
+     */
+    size_t flush();
+
+    /**
+     * @brief Get number of frames queued since the last flush
+     * @return Frame count
+     */
+    size_t pending() const { return pending_; }
+
+    /**
+     * @brief Get interface the frames are sent on
+     * @return Interface index
+     */
+    int interface_index() const { return interface_index_; }
+
+    /**
+     * @brief Get hardware address frames are sent from
+     * @return Interface MAC address
+     */
+    const MacAddress& source_mac() const { return source_mac_; }
+
+    /**
+     * @brief Build an Ethernet/IPv4/UDP frame
+     * @param out Frame buffer
+     * @param capacity Buffer size
+     * @param source_mac Sender hardware address
+     * @param destination_mac Receiver hardware address
+     * @param source_ip Source address, network byte order
+     * @param source_port Source port, host byte order
+     * @param destination_ip Destination address, network byte order
+     * @param destination_port Destination port, host byte order
+     * @param payload UDP payload
+     * @return Frame length, 0 if it does not fit
+     */
+    static size_t build_frame(uint8_t* out, size_t capacity, const MacAddress& source_mac,
+                              const MacAddress& destination_mac, IpAddress source_ip, uint16_t source_port,
+                              IpAddress destination_ip, uint16_t destination_port, ByteView payload);
+
+private:
+    int socket_fd_;
+    int interface_index_;
+    MacAddress source_mac_;
+    uint8_t* ring_;
+    size_t ring_size_;
+    size_t frames_;
+    size_t next_;       // next slot to fill
+    size_t pending_;    // slots filled since the last flush
+
+    /**
+     * @brief Ask the kernel to send every slot marked for sending
+     * @param wait Return only once the kernel has sent them and the slots are free
+     */
+    void kick(bool wait);
+    
+    /**
+     * @brief Release the ring and the socket
+     */
+    void close_ring();
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_RAW_SENDER_HPP
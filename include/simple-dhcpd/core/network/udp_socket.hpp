@@ -10,13 +10,21 @@
 #define SIMPLE_DHCPD_UDP_SOCKET_HPP
 
 #include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include "simple-dhcpd/core/network/event_loop.hpp"
+#include "simple-dhcpd/core/network/raw_sender.hpp"
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
 #include <functional>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <chrono>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace simple_dhcpd {
 
@@ -35,11 +43,41 @@ private:
     std::string message_;
 };
 
+/**
+ * @brief Receive callback taking the pooled buffer directly
+ *
+ * The buffer is only valid for the duration of the call.
+ */
+using PacketCallback = std::function<void(const PacketBuffer&)>;
+
+/**
+ * @brief Where a reply goes, chosen from the request per RFC 2131 4.1
+ */
+struct ReplyRoute {
+    IpAddress address = 0;        ///< Destination, network byte order; INADDR_BROADCAST to broadcast
+    uint16_t port = 0;            ///< Destination port, host byte order
+    bool to_hardware = false;     ///< Client has no address yet: unicast to hardware at address
+    MacAddress hardware{};        ///< Client hardware address when to_hardware is set
+};
+
+/**
+ * @brief Receives replies in place of the sockets, e.g. while replaying a capture
+ *
+ * The packet is only valid for the duration of the call.
+ */
+using ReplySink = std::function<void(ByteView packet, const ReplyRoute& route)>;
+
 /**
  * @brief UDP socket class for DHCP communication
  */
 class UdpSocket {
 public:
+    /** Largest datagram received or queued for batched transmission (standard MTU) */
+    static constexpr size_t kMaxDatagramSize = PacketBuffer::kCapacity;
+    
+    /** Datagrams read per readiness notification before yielding to other sockets on the loop */
+    static constexpr size_t kMaxDrainDatagrams = 256;
+    
     /**
      * @brief Constructor
      * @param address Address to bind to
@@ -64,6 +102,27 @@ public:
      */
     void start_receiving(std::function<void(const std::vector<uint8_t>&, const std::string&, uint16_t)> callback);
     
+    /**
+     * @brief Start receiving data into pooled buffers on a loop of the socket's own
+     * @param callback Callback invoked with each received packet
+     * @throws UdpSocketException if the socket is not bound
+     */
+    void start_receiving(PacketCallback callback);
+    
+    /**
+     * @brief Start receiving data into pooled buffers on a shared event loop
+     *
+     * The socket is made non-blocking and watched by the loop; each time it
+     * is readable the loop thread reads datagrams until EAGAIN or
+     * kMaxDrainDatagrams, so sockets sharing a loop take turns, then
+     * flushes the replies queued meanwhile.
+     *
+     * @param callback Callback invoked with each received packet, on the loop thread
+     * @param loop Loop to watch the socket; must outlive stop_receiving()
+     * @throws UdpSocketException if the socket is not bound or cannot be watched
+     */
+    void start_receiving(PacketCallback callback, EventLoop& loop);
+    
     /**
      * @brief Stop receiving data
      */
@@ -98,6 +157,83 @@ public:
      */
     ssize_t send_broadcast(const std::vector<uint8_t>& data, uint16_t port);
     
+    /**
+     * @brief Send broadcast data
+     * @param data Data to send
+     * @param size Data length
+     * @param port Destination port
+     * @return Number of bytes sent
+     * @throws UdpSocketException if sending fails
+     */
+    ssize_t send_broadcast(const uint8_t* data, size_t size, uint16_t port);
+    
+    /**
+     * @brief Send data out of the interface a packet came in on
+     * @param data Data to send
+     * @param size Data length
+     * @param address Destination address
+     * @param port Destination port
+     * @param via Ingress of the packet being answered
+     * @return Number of bytes sent
+     * @throws UdpSocketException if sending fails
+     */
+    ssize_t send_to(const uint8_t* data, size_t size, const std::string& address, uint16_t port,
+                    const PacketIngress& via);
+    
+    /**
+     * @brief Broadcast data out of the interface a packet came in on
+     * @param data Data to send
+     * @param size Data length
+     * @param port Destination port
+     * @param via Ingress of the packet being answered
+     * @return Number of bytes sent
+     * @throws UdpSocketException if sending fails
+     */
+    ssize_t send_broadcast(const uint8_t* data, size_t size, uint16_t port, const PacketIngress& via);
+    
+    /**
+     * @brief Unicast data to a client that has no address yet
+     *
+     * With raw unicast enabled the datagram is framed for the client's
+     * hardware address and queued on the ingress interface's transmit ring,
+     * flushed with the rest of the batch; otherwise, or if the ring cannot
+     * be used, it is broadcast on the ingress interface.
+     *
+     * @param data Data to send
+     * @param size Data length
+     * @param hardware Client hardware address
+     * @param address Address the client is being given, network byte order
+     * @param port Destination port
+     * @param via Ingress of the packet being answered
+     * @return Number of bytes sent or queued
+     * @throws UdpSocketException if sending fails
+     */
+    ssize_t send_to_hardware(const uint8_t* data, size_t size, const MacAddress& hardware, IpAddress address,
+                             uint16_t port, const PacketIngress& via);
+    
+    /**
+     * @brief Send replies to address-less clients as link-layer unicast frames
+     * @param enabled true to use a PACKET_MMAP ring per interface, false to broadcast them
+     * @note Needs CAP_NET_RAW; without it replies fall back to broadcast
+     */
+    void set_raw_unicast(bool enabled);
+    
+    /**
+     * @brief Get the ingress of the packet whose callback runs on this thread
+     * @return Ingress, nullptr outside a receive callback
+     */
+    static const PacketIngress* current_ingress();
+    
+    /**
+     * @brief Answer a packet from outside its receive callback
+     * @param ingress Ingress of the packet being answered, nullptr when done
+     *
+     * Replies sent on this thread meanwhile leave through the packet's
+     * socket and interface, unbatched; replies to address-less clients are
+     * broadcast, as the raw frame sender belongs to the receive thread.
+     */
+    static void set_current_ingress(const PacketIngress* ingress);
+    
     /**
      * @brief Check if socket is bound
      * @return true if socket is bound
@@ -142,21 +278,158 @@ public:
      * @throws UdpSocketException if setting timeout fails
      */
     void set_receive_timeout(int timeout_seconds);
+    
+    /**
+     * @brief Allow several sockets to bind the same address and port (SO_REUSEPORT)
+     * @note Must be called before bind()
+     * @throws UdpSocketException if SO_REUSEPORT is unavailable or cannot be set
+     */
+    void enable_reuse_port();
+    
+    /**
+     * @brief Steer datagrams across a SO_REUSEPORT group by client hardware address
+     *
+     * Attaches a classic BPF program that hashes chaddr, so every packet of a
+     * client lands on the same socket of the group. Without it the kernel
+     * falls back to its 4-tuple hash, which is still stable per client.
+     *
+     * @param group_size Number of sockets in the group
+     * @return true if the steering program was attached
+     */
+    bool attach_shard_filter(uint32_t group_size);
+    
+    /**
+     * @brief Pin the socket's own receive loop to a CPU
+     * @param cpu CPU index, or -1 to leave scheduling to the kernel
+     * @note Takes effect the next time receiving starts without a shared loop
+     */
+    void set_cpu_affinity(int cpu);
+    
+    /**
+     * @brief Enable batched I/O with recvmmsg/sendmmsg
+     *
+     * The receive loop drains up to batch_size datagrams per syscall, and
+     * replies sent from the receive loop are queued and flushed with one
+     * sendmmsg once the datagrams read are dispatched, the queue is full or
+     * the oldest reply has waited flush_timeout. A lone datagram is handled
+     * as soon as it arrives, so latency at low load is unchanged.
+     *
+     * @param batch_size Datagrams per batch; 1 restores per-packet I/O
+     * @param flush_timeout Longest time a queued reply may wait
+     * @note Must be called before start_receiving()
+     */
+    void set_batch_mode(size_t batch_size, std::chrono::microseconds flush_timeout);
+    
+    /**
+     * @brief Get batch size
+     * @return Datagrams per batch (1 = per-packet I/O)
+     */
+    size_t get_batch_size() const;
 
 private:
+#ifdef __linux__
+    /** Ancillary data of one datagram: room for IP_PKTINFO */
+    union ControlBuffer {
+        struct cmsghdr align;
+        uint8_t data[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    };
+#endif
+    
     std::string address_;
     uint16_t port_;
     int socket_fd_;
     bool bound_;
+    int cpu_affinity_;
     std::atomic<bool> receiving_;
-    std::thread receive_thread_;
-    std::function<void(const std::vector<uint8_t>&, const std::string&, uint16_t)> callback_;
+    EventLoop* loop_;                     // loop watching the socket while receiving
+    std::unique_ptr<EventLoop> own_loop_; // set when receiving without a shared loop
+    PacketCallback callback_;
+    std::unique_ptr<PacketBufferPool> rx_pool_;
+    std::vector<PacketBufferPool::Handle> rx_buffers_;
+    std::vector<struct iovec> rx_iovecs_;
+#ifdef __linux__
+    std::vector<struct mmsghdr> rx_messages_;
+    std::vector<ControlBuffer> rx_control_;
+#endif
+    std::map<int, std::string> interface_names_;   // by index; only touched by the loop thread
+    bool raw_unicast_;
+    std::map<int, std::unique_ptr<RawFrameSender>> raw_senders_;   // by index, null if unusable; loop thread only
     mutable std::mutex mutex_;
     
+    // Batched I/O state; the transmit queue is only touched by the receive thread
+    size_t batch_size_;
+    std::chrono::microseconds flush_timeout_;
+    std::vector<uint8_t> tx_storage_;
+    std::vector<struct sockaddr_in> tx_addresses_;
+    std::vector<struct iovec> tx_iovecs_;
+#ifdef __linux__
+    std::vector<struct mmsghdr> tx_messages_;
+    std::vector<ControlBuffer> tx_control_;
+#endif
+    size_t tx_pending_;
+    std::chrono::steady_clock::time_point tx_oldest_;
+    
+    /**
+     * @brief Read the datagrams queued on the socket; runs on the loop thread
+     */
+    void drain();
+    
+    /**
+     * @brief Read queued datagrams one at a time
+     * @return false on a receive error
+     */
+    bool drain_single();
+    
+    /**
+     * @brief Read queued datagrams with recvmmsg
+     * @return false on a receive error
+     */
+    bool drain_batched();
+    
+    /**
+     * @brief Hand one received packet to the callback
+     * @param packet Received packet
+     */
+    void dispatch(const PacketBuffer& packet);
+    
+    /**
+     * @brief Record where a datagram came in from its ancillary data
+     * @param packet Received packet
+     * @param header Message header filled by the kernel, nullptr if none
+     */
+    void read_ingress(PacketBuffer& packet, const struct msghdr* header);
+    
+    /**
+     * @brief Get an interface name, cached by index
+     * @param index Interface index
+     * @return Name, empty if the index is unknown
+     */
+    const std::string& interface_name(int index);
+    
+    /**
+     * @brief Send a datagram, queueing it when called from a batching receive thread
+     * @param data Data to send
+     * @param size Data length
+     * @param to Destination address
+     * @param via Interface and source address to send from, nullptr to let routing decide
+     * @return Number of bytes sent or queued
+     * @throws UdpSocketException if sending fails
+     */
+    ssize_t send_datagram(const uint8_t* data, size_t size, const struct sockaddr_in& to,
+                          const PacketIngress* via = nullptr);
+    
+    /**
+     * @brief Flush queued replies with sendmmsg and the raw frames queued per interface
+     * @return Number of datagrams sent
+     */
+    size_t flush_pending();
+    
     /**
-     * @brief Receive loop
+     * @brief Get the transmit ring of an interface, opening it on first use
+     * @param interface_index Interface index
+     * @return Ring, nullptr if it cannot be opened
      */
-    void receive_loop();
+    RawFrameSender* raw_sender(int interface_index);
     
     /**
      * @brief Create socket
@@ -198,6 +471,12 @@ public:
      */
     void start_all(std::function<void(const std::vector<uint8_t>&, const std::string&, uint16_t)> callback);
     
+    /**
+     * @brief Start all sockets delivering pooled packet buffers
+     * @param callback Callback invoked with each received packet
+     */
+    void start_all(PacketCallback callback);
+    
     /**
      * @brief Stop all sockets
      */
@@ -210,15 +489,49 @@ public:
      * @param port Destination port
      * @return Number of bytes sent
      * @throws UdpSocketException if sending fails
+     * @note Inside a receive callback this uses the socket and interface the
+     * packet came in on, elsewhere the first socket
      */
     ssize_t send_dhcp_message(const DhcpMessage& message, const std::string& address, uint16_t port);
     
+    /**
+     * @brief Send an already encoded DHCP message
+     * @param packet Encoded message
+     * @param address Destination address
+     * @param port Destination port
+     * @return Number of bytes sent
+     * @throws UdpSocketException if sending fails
+     * @note Inside a receive callback this uses the socket and interface the
+     * packet came in on, elsewhere the first socket
+     */
+    ssize_t send_dhcp_packet(ByteView packet, const std::string& address, uint16_t port);
+    
+    /**
+     * @brief Send an encoded reply along a route chosen from its request
+     * @param packet Encoded reply
+     * @param route Destination; to_hardware routes need a receive callback's ingress
+     * @return Number of bytes sent or queued
+     * @throws UdpSocketException if sending fails
+     * @note Inside a receive callback this uses the socket and interface the
+     * request came in on, elsewhere the first socket
+     */
+    ssize_t send_dhcp_reply(ByteView packet, const ReplyRoute& route);
+    
+    /**
+     * @brief Divert replies from the sockets
+     * @param sink Called by send_dhcp_reply() instead of sending; empty to send again
+     * @note Set before any packet is handled; not synchronized with sending
+     */
+    void set_reply_sink(ReplySink sink);
+    
     /**
      * @brief Send DHCP broadcast message
      * @param message DHCP message to send
      * @param port Destination port
      * @return Number of bytes sent
      * @throws UdpSocketException if sending fails
+     * @note Inside a receive callback this uses the socket and interface the
+     * packet came in on, elsewhere the first socket
      */
     ssize_t send_dhcp_broadcast(const DhcpMessage& message, uint16_t port);
     
@@ -227,9 +540,31 @@ public:
      * @return true if any socket is receiving
      */
     bool is_receiving() const;
+    
+    /**
+     * @brief Get number of open sockets
+     * @return Socket count (listen addresses times workers)
+     */
+    size_t socket_count() const;
+    
+    /**
+     * @brief Get number of receive workers per listen address
+     * @return Worker count resolved at initialization
+     */
+    uint32_t worker_count() const;
+    
+    /**
+     * @brief Get name of the readiness backend the receive loops use
+     * @return "epoll" or "poll", empty before initialization
+     */
+    std::string event_backend_name() const;
 
 private:
+    // One loop per worker, watching that worker's socket on every listen address
+    std::vector<std::unique_ptr<EventLoop>> loops_;
     std::vector<std::unique_ptr<UdpSocket>> sockets_;
+    uint32_t workers_;
+    ReplySink reply_sink_;
     mutable std::mutex mutex_;
     
     /**
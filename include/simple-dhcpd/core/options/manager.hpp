@@ -10,8 +10,11 @@
 #define SIMPLE_DHCPD_OPTIONS_MANAGER_HPP
 
 #include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/utils/stat_counters.hpp"
+#include <array>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -92,6 +95,194 @@ struct OptionsContext {
     OptionsContext() = default;
 };
 
+/**
+ * @brief Option values by code, as configured for one scope
+ */
+using OptionMap = std::map<DhcpOptionCode, std::vector<uint8_t>>;
+
+/**
+ * @brief Options configured for the global, subnet and pool scopes
+ */
+struct OptionScopes {
+    OptionMap global;
+    std::map<std::string, OptionMap> subnets;                          // by subnet name
+    std::map<std::string, std::map<std::string, OptionMap>> pools;     // by subnet, then pool name
+};
+
+/**
+ * @brief Option inheritance rule with its scopes and condition decoded
+ */
+struct CompiledInheritanceRule {
+    /** Scope an option value is taken from */
+    enum class Scope : uint8_t { GLOBAL, SUBNET, POOL, HOST };
+
+    Scope source;
+    DhcpOptionCode option_code;
+    bool inherit;
+    uint8_t required_class;                // ClientClass bits the client must have
+    std::vector<uint8_t> override_value;
+};
+
+/**
+ * @brief One option resolved for a client
+ */
+struct ResolvedOption {
+    DhcpOptionCode code;
+    const uint8_t* data;    // into the plan, or into the host options passed in
+    size_t length;
+};
+
+class OptionResolutionPlan;
+
+/**
+ * @brief Options resolved for one request; reused from request to request
+ *
+ * Holds views, in request order, plus a reference keeping the plan they
+ * point into alive. Views of host options are valid as long as the host
+ * option map passed to the resolve call.
+ */
+class ResolvedOptions {
+public:
+    ResolvedOptions() : count_(0) {}
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    const ResolvedOption* begin() const { return options_.data(); }
+    const ResolvedOption* end() const { return options_.data() + count_; }
+    const ResolvedOption& operator[](size_t index) const { return options_[index]; }
+
+    /**
+     * @brief Find a resolved option
+     * @param code Option code
+     * @return Option, or nullptr if not resolved
+     */
+    const ResolvedOption* find(DhcpOptionCode code) const {
+        for (size_t i = 0; i < count_; ++i) {
+            if (options_[i].code == code) {
+                return &options_[i];
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    friend class OptionResolutionPlan;
+
+    std::array<ResolvedOption, 256> options_;
+    size_t count_;
+    std::shared_ptr<const OptionResolutionPlan> plan_;
+};
+
+/**
+ * @brief Option values pre-merged for every (subnet, pool, client class)
+ *
+ * Built once from the scope options, inheritance rules and option template
+ * defaults, then never modified; DhcpOptionsManager publishes it atomically
+ * and replaces it when any of those change. Each combination is a 256-entry
+ * table from option code to a slice of one shared byte buffer, so resolving
+ * a request is a table lookup per requested option, with only host options
+ * consulted on top. A client's class is whether it sent a vendor class and
+ * a user class, plus which registered vendor class it sent.
+ *
+ * Merge order, lowest first: template defaults, global options, inheritance
+ * rules (in order), subnet options, pool options, host options.
+ */
+class OptionResolutionPlan : public std::enable_shared_from_this<OptionResolutionPlan> {
+public:
+    /** Client class bits tested by inheritance rule conditions */
+    enum ClientClass : uint8_t {
+        HAS_VENDOR_CLASS = 1,     ///< Condition "vendor_class"
+        HAS_USER_CLASS = 2,       ///< Condition "user_class"
+        NEVER = 4                 ///< Any other condition; no client has it
+    };
+
+    /**
+     * @brief Compile a plan
+     * @param scopes Global, subnet and pool options
+     * @param rules Inheritance rules, applied in order; rules with unknown scopes are dropped
+     * @param template_defaults Template default values for clients without a registered
+     *        vendor class, then for each registered vendor class
+     * @return Plan
+     */
+    static std::shared_ptr<const OptionResolutionPlan> compile(
+        const OptionScopes& scopes, const std::vector<OptionInheritanceRule>& rules,
+        const std::vector<std::pair<std::string, OptionMap>>& template_defaults);
+
+    /**
+     * @brief Resolve the options a client asked for
+     * @param requested_options Requested option codes; repeats are resolved once
+     * @param context Client context; subnet_name, pool_name, vendor_class and user_class are used
+     * @param host_options Host-level options, or nullptr
+     * @param out Resolved options, replaced
+     *
+     * Unknown subnets resolve as global scope and unknown pools as their
+     * subnet. Takes no lock and allocates nothing.
+     */
+    void resolve(const std::vector<DhcpOptionCode>& requested_options, const OptionsContext& context,
+                 const OptionMap* host_options, ResolvedOptions& out) const;
+
+    /**
+     * @brief Get the decoded inheritance rules
+     * @return Rules, in order
+     */
+    const std::vector<CompiledInheritanceRule>& rules() const { return rules_; }
+
+    /**
+     * @brief Decode inheritance rules, dropping those with unknown scopes
+     * @param rules Rules
+     * @return Decoded rules, in order
+     */
+    static std::vector<CompiledInheritanceRule> compile_rules(const std::vector<OptionInheritanceRule>& rules);
+
+    /**
+     * @brief Get the class bits of a client
+     * @param context Client context
+     * @return ClientClass bits
+     */
+    static uint8_t client_class(const OptionsContext& context) {
+        return (context.vendor_class.empty() ? 0 : HAS_VENDOR_CLASS) |
+               (context.user_class.empty() ? 0 : HAS_USER_CLASS);
+    }
+
+    /**
+     * @brief Get number of pre-merged option tables
+     * @return Table count
+     */
+    size_t table_count() const { return tables_.size(); }
+
+private:
+    static constexpr size_t kClassBits = 4;   // combinations of HAS_VENDOR_CLASS and HAS_USER_CLASS
+
+    struct Slice {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    /** Merged options of one combination; slot 0 means absent, n means slices_[first + n - 1] */
+    struct Table {
+        uint32_t first;
+        std::array<uint16_t, 256> slot;
+    };
+
+    struct SubnetScope {
+        uint32_t scope;
+        std::vector<std::pair<std::string, uint32_t>> pools;   // pool name, scope
+    };
+
+    std::vector<CompiledInheritanceRule> rules_;
+    std::unordered_map<std::string, SubnetScope> subnets_;
+    std::unordered_map<std::string, uint32_t> vendor_classes_;  // registered vendor class, 1-based
+    size_t classes_;                                            // tables per scope
+    std::vector<Table> tables_;                                 // by scope, then class
+    std::vector<Slice> slices_;
+    std::vector<uint8_t> data_;
+
+    /**
+     * @brief Append one merged option set as a table
+     */
+    void add_table(const OptionMap& options);
+};
+
 /**
  * @brief Advanced DHCP options manager
  */
@@ -270,6 +461,59 @@ public:
         const std::vector<DhcpOptionCode>& requested_options,
         const OptionsContext& context);
     
+    /**
+     * @brief Process client options request through the resolution plan
+     * @param requested_options Client requested options
+     * @param context Options context
+     * @param host_options Host-level options, or nullptr
+     * @param out Resolved options, replaced
+     *
+     * Takes no lock and allocates nothing once the plan is compiled.
+     */
+    void process_client_request(const std::vector<DhcpOptionCode>& requested_options,
+                                const OptionsContext& context,
+                                const OptionMap* host_options,
+                                ResolvedOptions& out);
+    
+    // Scope options and resolution plan
+    /**
+     * @brief Set global options
+     * @param options Options
+     */
+    void set_global_options(const OptionMap& options);
+    
+    /**
+     * @brief Set the options of a subnet
+     * @param subnet_name Subnet name
+     * @param options Options
+     */
+    void set_subnet_options(const std::string& subnet_name, const OptionMap& options);
+    
+    /**
+     * @brief Set the options of a pool
+     * @param subnet_name Subnet name
+     * @param pool_name Pool name
+     * @param options Options
+     */
+    void set_pool_options(const std::string& subnet_name, const std::string& pool_name,
+                          const OptionMap& options);
+    
+    /**
+     * @brief Get the current resolution plan, compiling it if needed
+     * @return Plan
+     *
+     * Registering options, changing inheritance rules or scope options
+     * discards the plan; the next request compiles a new one. Callers
+     * holding a plan keep using it until they load it again.
+     */
+    std::shared_ptr<const OptionResolutionPlan> resolution_plan();
+    
+    /**
+     * @brief Compile and publish the resolution plan now
+     * @return Plan
+     */
+    std::shared_ptr<const OptionResolutionPlan> compile_resolution_plan();
+    
     /**
      * @brief Generate option 82 (Relay Agent Information)
      * @param circuit_id Circuit ID
@@ -333,12 +577,22 @@ private:
     std::map<DhcpOptionCode, std::shared_ptr<OptionTemplate>> custom_options_;
     std::vector<OptionInheritanceRule> inheritance_rules_;
     std::map<std::string, std::map<DhcpOptionCode, std::vector<uint8_t>>> option_templates_;
+    OptionScopes scopes_;
+    std::shared_ptr<const OptionResolutionPlan> plan_;   // atomic; null until compiled
     
     std::map<DhcpOptionCode, std::function<OptionValidationResult(const std::vector<uint8_t>&, 
                                                                  const OptionsContext&)>> custom_validators_;
     
-    std::map<DhcpOptionCode, size_t> option_usage_stats_;
-    std::map<std::string, size_t> validation_stats_;
+    /** Validation outcomes, reported by get_validation_stats() */
+    enum class ValidationCounter {
+        VALID,
+        INVALID,
+        ERRORS,
+        WARNINGS,
+        COUNT
+    };
+    StatCounters<DhcpOptionCode, 256> option_usage_stats_;
+    StatCounters<ValidationCounter> validation_stats_;
     
     mutable std::mutex mutex_;
     
@@ -375,13 +629,14 @@ private:
                                         const std::vector<uint8_t>& value);
     
     /**
-     * @brief Check inheritance condition
-     * @param rule Inheritance rule
-     * @param context Options context
-     * @return true if condition is met
+     * @brief Compile the plan and publish it; mutex_ held
+     */
+    std::shared_ptr<const OptionResolutionPlan> compile_plan_locked();
+    
+    /**
+     * @brief Discard the published plan; mutex_ held
      */
-    bool check_inheritance_condition(const OptionInheritanceRule& rule,
-                                    const OptionsContext& context);
+    void invalidate_plan();
     
     /**
      * @brief Update usage statistics
@@ -0,0 +1,83 @@
+/**
+ * @file options/subnet_options.hpp
+ * @brief Pre-encoded per-subnet reply options
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_SUBNET_OPTIONS_HPP
+#define SIMPLE_DHCPD_SUBNET_OPTIONS_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Options every OFFER/ACK for a subnet carries, encoded once
+ *
+ * The blob holds server identifier, lease time, T1, T2, subnet mask,
+ * router, DNS servers and domain name in wire format. Replies copy it in
+ * one memcpy and patch the lease-dependent values in place.
+ */
+class CompiledSubnetOptions {
+public:
+    /**
+     * @brief Constructor for an empty blob
+     */
+    CompiledSubnetOptions();
+
+    /**
+     * @brief Encode the reply options of a subnet
+     * @param subnet Subnet configuration
+     * @param server_id Server identifier used for the subnet
+     * @return Compiled options
+     */
+    static CompiledSubnetOptions compile(const DhcpSubnet& subnet, IpAddress server_id);
+
+    /**
+     * @brief Append the options with lease fields for an OFFER or ACK
+     * @param writer Writer for the reply being built
+     * @param lease_time Lease time in seconds; T1/T2 are derived as 1/2 and 7/8
+     * @param server_id Server identifier to put in the reply
+     * @throws DhcpParserException if the options do not fit the reply
+     */
+    void write(DhcpMessageWriter& writer, uint32_t lease_time, IpAddress server_id) const;
+
+    /**
+     * @brief Append the options without lease fields (DHCPINFORM replies)
+     * @param writer Writer for the reply being built
+     * @param server_id Server identifier to put in the reply
+     * @throws DhcpParserException if the options do not fit the reply
+     */
+    void write_without_lease(DhcpMessageWriter& writer, IpAddress server_id) const;
+
+    /**
+     * @brief Get the server identifier the blob was compiled with
+     * @return Server identifier
+     */
+    IpAddress server_id() const { return server_id_; }
+
+    /**
+     * @brief Get encoded size
+     * @return Blob size in bytes
+     */
+    size_t size() const { return bytes_.size(); }
+
+private:
+    // Fixed layout of the blob head; subnet options follow
+    static constexpr size_t kServerIdOffset = 0;
+    static constexpr size_t kLeaseTimeOffset = 6;
+    static constexpr size_t kRenewalOffset = 12;
+    static constexpr size_t kRebindingOffset = 18;
+    static constexpr size_t kSubnetOptionsOffset = 24;
+
+    std::vector<uint8_t> bytes_;
+    IpAddress server_id_;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_SUBNET_OPTIONS_HPP
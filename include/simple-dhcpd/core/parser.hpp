@@ -10,6 +10,8 @@
 #define SIMPLE_DHCPD_CORE_PARSER_HPP
 
 #include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include "simple-dhcpd/core/message_view.hpp"
 #include <vector>
 #include <string>
 
@@ -52,6 +54,22 @@ public:
      */
     static DhcpMessage parse_message(const uint8_t* data, size_t size);
     
+    /**
+     * @brief Parse DHCP message straight from a received packet buffer
+     * @param packet Received packet
+     * @return Parsed DHCP message
+     * @throws DhcpParserException if parsing fails
+     */
+    static DhcpMessage parse_message(const PacketBuffer& packet);
+    
+    /**
+     * @brief Parse DHCP message in place without copying options
+     * @param packet Received packet; must outlive the returned view
+     * @return Message view borrowing the packet bytes
+     * @throws DhcpParserException if parsing fails
+     */
+    static DhcpMessageView parse_view(const PacketBuffer& packet);
+    
     /**
      * @brief Generate DHCP message to raw data
      * @param message DHCP message to generate
@@ -91,76 +109,6 @@ public:
      * @return Pointer to option if found, nullptr otherwise
      */
     static const DhcpOption* find_option(const std::vector<DhcpOption>& options, DhcpOptionCode code);
-
-private:
-    /**
-     * @brief Parse DHCP header from raw data
-     * @param data Raw DHCP data
-     * @param size Data size
-     * @return Parsed DHCP header
-     * @throws DhcpParserException if parsing fails
-     */
-    static DhcpMessageHeader parse_header(const uint8_t* data, size_t size);
-    
-    /**
-     * @brief Parse DHCP options from raw data
-     * @param data Raw DHCP data
-     * @param size Data size
-     * @return Parsed DHCP options
-     * @throws DhcpParserException if parsing fails
-     */
-    static std::vector<DhcpOption> parse_options(const uint8_t* data, size_t size);
-    
-    /**
-     * @brief Parse single DHCP option
-     * @param data Raw DHCP data
-     * @param size Data size
-     * @param offset Current offset
-     * @return Parsed DHCP option and new offset
-     * @throws DhcpParserException if parsing fails
-     */
-    static std::pair<DhcpOption, size_t> parse_option(const uint8_t* data, size_t size, size_t offset);
-    
-    /**
-     * @brief Generate DHCP header to raw data
-     * @param header DHCP header to generate
-     * @param data Output buffer
-     * @param offset Current offset
-     * @return New offset
-     */
-    static size_t generate_header(const DhcpMessageHeader& header, uint8_t* data, size_t offset);
-    
-    /**
-     * @brief Generate DHCP options to raw data
-     * @param options DHCP options to generate
-     * @param data Output buffer
-     * @param offset Current offset
-     * @return New offset
-     */
-    static size_t generate_options(const std::vector<DhcpOption>& options, uint8_t* data, size_t offset);
-    
-    /**
-     * @brief Generate single DHCP option
-     * @param option DHCP option to generate
-     * @param data Output buffer
-     * @param offset Current offset
-     * @return New offset
-     */
-    static size_t generate_option(const DhcpOption& option, uint8_t* data, size_t offset);
-    
-    /**
-     * @brief Extract MAC address from DHCP header
-     * @param header DHCP header
-     * @return MAC address
-     */
-    static MacAddress extract_mac_address(const DhcpMessageHeader& header);
-    
-    /**
-     * @brief Extract IP address from DHCP header
-     * @param header DHCP header
-     * @return IP address
-     */
-    static IpAddress extract_ip_address(const DhcpMessageHeader& header);
 };
 
 /**
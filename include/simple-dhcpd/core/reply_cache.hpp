@@ -0,0 +1,155 @@
+/**
+ * @file core/reply_cache.hpp
+ * @brief Bounded cache of encoded replies for answering retransmissions
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_CORE_REPLY_CACHE_HPP
+#define SIMPLE_DHCPD_CORE_REPLY_CACHE_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Last encoded reply per (client MAC, xid, request type)
+ *
+ * A client that retransmits a DISCOVER or REQUEST keeps its xid, so the
+ * reply already sent can be sent again as is instead of running subnet
+ * selection, the lease manager and the option encoder a second time.
+ * Entries expire after a short TTL and are dropped for a MAC when that
+ * client releases or declines.
+ *
+ * Storage is a fixed number of 8-way sets split across independently
+ * locked shards; the set is chosen by MAC alone, so invalidating a client
+ * touches one set. A new entry takes an empty or expired slot, otherwise
+ * the one expiring first. Replies larger than kMaxReplySize are not cached.
+ */
+class ReplyCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /** Largest reply kept: the message size every client must accept (RFC 2131) */
+    static constexpr size_t kMaxReplySize = 576;
+
+    /** Default number of cached replies */
+    static constexpr size_t kDefaultCapacity = 4096;
+
+    /** Buffer a cached reply is copied into */
+    using Buffer = std::array<uint8_t, kMaxReplySize>;
+
+    /**
+     * @brief Constructor
+     * @param capacity Replies kept at once, rounded up to whole sets
+     * @param ttl Time a reply stays valid
+     */
+    explicit ReplyCache(size_t capacity = kDefaultCapacity,
+                        std::chrono::milliseconds ttl = std::chrono::seconds(3));
+
+    /**
+     * @brief Remember the reply sent for a request
+     * @param mac_address Client MAC address
+     * @param xid Transaction id of the request
+     * @param request_type Type of the request answered
+     * @param reply Encoded reply
+     * @param now Current time
+     */
+    void store(const MacAddress& mac_address, uint32_t xid, DhcpMessageType request_type,
+               ByteView reply, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Copy out the reply sent for an earlier copy of a request
+     * @param mac_address Client MAC address
+     * @param xid Transaction id of the request
+     * @param request_type Type of the request
+     * @param out Buffer receiving the reply
+     * @param now Current time
+     * @return Reply length, 0 on a miss
+     */
+    size_t lookup(const MacAddress& mac_address, uint32_t xid, DhcpMessageType request_type,
+                  Buffer& out, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Drop every cached reply of a client
+     * @param mac_address Client MAC address
+     */
+    void invalidate(const MacAddress& mac_address);
+
+    /**
+     * @brief Drop every cached reply
+     */
+    void clear();
+
+    /**
+     * @brief Set the time a reply stays valid; applies to replies stored afterwards
+     * @param ttl TTL
+     */
+    void set_ttl(std::chrono::milliseconds ttl) { ttl_ns_.store(to_ns(ttl), std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of replies that can be kept at once
+     * @return Slot count
+     */
+    size_t capacity() const { return shard_count_ * sets_per_shard_ * kWays; }
+
+    /**
+     * @brief Get number of lookups answered from the cache
+     * @return Hit count
+     */
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of lookups not answered from the cache
+     * @return Miss count
+     */
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kWays = 8;
+    static constexpr size_t kShards = 16;
+
+    struct Entry {
+        uint64_t mac_key;        // 0 = empty
+        uint32_t xid;
+        uint8_t request_type;
+        uint16_t length;
+        int64_t expires_ns;
+        uint8_t data[kMaxReplySize];
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Entry> entries;   // sets_per_shard_ * kWays
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_count_;
+    size_t sets_per_shard_;
+    std::atomic<int64_t> ttl_ns_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+
+    /**
+     * @brief Get the shard and first slot of a client's set
+     */
+    Entry* set_for(uint64_t mac_key, Shard*& shard);
+
+    static uint64_t mac_key(const MacAddress& mac_address);
+
+    static int64_t to_ns(Clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_CORE_REPLY_CACHE_HPP
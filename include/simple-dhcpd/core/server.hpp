@@ -11,11 +11,23 @@
 
 #include "simple-dhcpd/core/types.hpp"
 #include "simple-dhcpd/core/config/manager.hpp"
+#include "simple-dhcpd/core/config/subnet_index.hpp"
 #include "simple-dhcpd/core/network/udp_socket.hpp"
+#include "simple-dhcpd/core/network/metrics_exporter.hpp"
+#include "simple-dhcpd/core/network/ping_check.hpp"
+#include "simple-dhcpd/core/network/ddns.hpp"
 #include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
+#include "simple-dhcpd/core/reply_cache.hpp"
+#include "simple-dhcpd/core/early_drop.hpp"
+#include "simple-dhcpd/core/options/subnet_options.hpp"
 #include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/lease/replication.hpp"
+#include "simple-dhcpd/core/lease/leasequery.hpp"
 #include "simple-dhcpd/production/security/manager.hpp"
 #include "simple-dhcpd/core/utils/logger.hpp"
+#include "simple-dhcpd/core/utils/stat_counters.hpp"
+#include "simple-dhcpd/core/utils/latency_histogram.hpp"
 #include <memory>
 #include <atomic>
 #include <thread>
@@ -78,17 +90,81 @@ public:
     bool is_running() const;
     
     /**
-     * @brief Reload configuration
+     * @brief Reload configuration without interrupting service
      * @throws DhcpServerException if reload fails
+     *
+     * Builds a new configuration snapshot and publishes it with one atomic
+     * pointer swap; packet handlers use it from their next packet on. The
+     * sockets, the lease manager with its leases and the security manager
+     * with its state are kept. Only subnets that changed have their reply
+     * options recompiled and pools rebuilt. Listen addresses, workers,
+     * socket batching and lease storage settings take effect on restart.
      */
     void reload_config();
     
+    /**
+     * @brief Run without the network, replies going to a sink
+     * @param sink Receives every reply the server would send
+     *
+     * Call before initialize(), which then opens no sockets and turns off
+     * lease storage, logging, failover and metrics, so replaying a capture
+     * against a production configuration leaves the network and its files
+     * alone. Packets are then fed with replay_packet() instead of start().
+     */
+    void enable_replay(ReplySink sink);
+    
+    /**
+     * @brief Handle one packet as if a receive worker had read it
+     * @param packet Packet with its sender filled in; needs initialize()
+     *
+     * Replies reach the replay sink before this returns.
+     */
+    void replay_packet(const PacketBuffer& packet) { handle_dhcp_message(packet); }
+    
     /**
      * @brief Get server statistics
      * @return Server statistics
      */
     DhcpStats get_statistics() const;
     
+    /**
+     * @brief Get per-stage packet latency, by message type
+     * @return Summaries of every stage timed so far; empty if the server was
+     *         built without ENABLE_LATENCY_HISTOGRAMS
+     */
+    std::vector<LatencySummary> get_latency_statistics() const;
+    
+    /**
+     * @brief Get number of packets dropped before parsing
+     * @param reason Drop reason
+     * @return Drops since start
+     */
+    uint64_t get_early_drop_count(EarlyDropReason reason) const { return early_drops_.get(reason); }
+    
+    /**
+     * @brief Render packet, pool, security and latency metrics
+     * @return Prometheus text exposition, as served at /metrics
+     */
+    std::string render_metrics() const;
+    
+    /**
+     * @brief Get the port the metrics endpoint listens on
+     * @return Port, 0 if the endpoint is not running
+     */
+    uint16_t metrics_port() const;
+    
+    /**
+     * @brief Get the port the bulk leasequery listener is on
+     * @return Port, 0 if the listener is not running
+     */
+    uint16_t bulk_leasequery_port() const;
+    
+    /**
+     * @brief Get dynamic DNS counters and update latency
+     * @return Statistics, all zero without DDNS
+     */
+    DdnsStats get_ddns_statistics() const;
+    
     /**
      * @brief Set signal handler
      * @param handler Signal handler function
@@ -97,136 +173,266 @@ public:
 
 private:
     std::string config_file_;
+    ReplySink replay_sink_;    // set: replay mode, see enable_replay()
     std::unique_ptr<ConfigManager> config_manager_;
     std::unique_ptr<DhcpSocketManager> socket_manager_;
+    /** Lease and security maintenance timers; declared first so it outlives both managers */
+    std::unique_ptr<EventLoop> maintenance_loop_;
+    /** Null without DDNS; fixed after initialize(), and outlives the lease manager's expiration callback */
+    std::unique_ptr<DdnsUpdater> ddns_;
     std::unique_ptr<LeaseManager> lease_manager_;
-    std::unique_ptr<DhcpSecurityManager> security_manager_;
+    std::shared_ptr<DhcpSecurityManager> security_manager_;
+    std::unique_ptr<MetricsExporter> metrics_exporter_;
+    std::unique_ptr<ReplyCache> reply_cache_;        // null when disabled; fixed after initialize()
+    std::unique_ptr<LeaseReplicator> replicator_;    // null without a failover peer; fixed after initialize()
+    std::unique_ptr<LeasequeryResponder> leasequery_;   // fixed after initialize()
+    std::unique_ptr<PingChecker> ping_checker_;     // null when disabled; fixed after initialize()
+    std::unique_ptr<BulkLeasequeryServer> bulk_leasequery_;
     std::atomic<bool> running_;
     std::atomic<bool> initialized_;
     mutable std::mutex mutex_;
-    mutable std::mutex stats_mutex_;
-    DhcpStats packet_stats_;
+    /** Per-packet counters, summed by get_statistics() */
+    enum class PacketCounter {
+        TOTAL_REQUESTS,
+        DISCOVER,
+        REQUEST,
+        RELEASE,
+        DECLINE,
+        INFORM,
+        OFFER,
+        ACK,
+        NAK,
+        ERRORS,
+        REPLY_CACHE_HITS,
+        PEER_BUCKET,        // left to the failover peer by RFC 3074 load balancing
+        COUNT
+    };
+    StatCounters<PacketCounter> packet_counters_;
+    StatCounters<EarlyDropReason> early_drops_;
+    PipelineLatency latency_;
+
+    /**
+     * @brief Everything a packet handler reads from the configuration, never modified once published
+     */
+    struct ConfigSnapshot {
+        DhcpConfig config;
+        std::shared_ptr<const SubnetTable> subnets;          // ids shared with the lease manager
+        std::vector<CompiledSubnetOptions> subnet_options;   // indexed by SubnetId
+        std::shared_ptr<DhcpSecurityManager> security;       // null when security is disabled
+        IpAddress server_id;                                 // NAK server identifier
+    };
+    std::shared_ptr<const ConfigSnapshot> snapshot_;  // std::atomic_load / std::atomic_store
 
-    IpAddress dhcp_server_ip(const DhcpSubnet* subnet) const;
-    bool security_allow_message(const DhcpMessage& message, const std::string& recv_interface);
+    static IpAddress dhcp_server_ip(const DhcpConfig& config, const DhcpSubnet* subnet);
+    
+    /**
+     * @brief Build the snapshot for a configuration
+     * @param config Configuration the server is running with
+     * @param previous Snapshot being replaced, nullptr at startup; options of unchanged subnets are reused
+     * @return Snapshot over the lease manager's current subnet table
+     */
+    std::shared_ptr<const ConfigSnapshot> build_snapshot(const DhcpConfig& config, const ConfigSnapshot* previous) const;
+    
+    /**
+     * @brief Create the global logger and start its writer thread if configured
+     * @param config Configuration the server is running with
+     */
+    void init_logging(const DhcpConfig& config);
+    
+    /**
+     * @brief Restore leases from the journal, the binary snapshot or the text lease file
+     * @param config Configuration the server is running with
+     */
+    void restore_leases(const DhcpConfig& config);
+    
+    /**
+     * @brief Run the security checks that need the parsed message: snooping, IP filter and Option 82
+     * @param security Security manager of the snapshot, nullptr if disabled
+     * @param message Parsed message
+     * @param recv_interface Interface the packet arrived on, empty if unknown
+     * @return true if the message may be handled
+     */
+    bool security_allow_message(DhcpSecurityManager* security, const DhcpMessageView& message,
+                                const std::string& recv_interface);
+    
+    /**
+     * @brief Run the checks that need no parsing: header sanity, MAC filter and rate limit
+     * @param security Security manager of the snapshot, nullptr if disabled
+     * @param packet Received packet
+     * @return NONE, or why the packet is dropped
+     */
+    EarlyDropReason early_drop_reason(DhcpSecurityManager* security, const PacketBuffer& packet);
     
     /**
      * @brief Handle received DHCP message
-     * @param data Received data
-     * @param client_address Client address
-     * @param client_port Client port
+     * @param packet Received packet (valid for the duration of the call)
      */
-    void handle_dhcp_message(const std::vector<uint8_t>& data, const std::string& client_address, uint16_t client_port);
+    void handle_dhcp_message(const PacketBuffer& packet);
     
     /**
      * @brief Handle DHCP Discover message
+     * @param snapshot Configuration the packet is handled with
      * @param message DHCP message
-     * @param client_address Client address
-     * @param client_port Client port
      */
-    void handle_discover(const DhcpMessage& message, const std::string& client_address, uint16_t client_port);
+    void handle_discover(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
     
     /**
      * @brief Handle DHCP Request message
+     * @param snapshot Configuration the packet is handled with
      * @param message DHCP message
-     * @param client_address Client address
-     * @param client_port Client port
      */
-    void handle_request(const DhcpMessage& message, const std::string& client_address, uint16_t client_port);
+    void handle_request(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
     
     /**
      * @brief Handle DHCP Release message
+     * @param snapshot Configuration the packet is handled with
      * @param message DHCP message
-     * @param client_address Client address
-     * @param client_port Client port
      */
-    void handle_release(const DhcpMessage& message, const std::string& client_address, uint16_t client_port);
+    void handle_release(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
     
     /**
      * @brief Handle DHCP Decline message
+     * @param snapshot Configuration the packet is handled with
      * @param message DHCP message
-     * @param client_address Client address
-     * @param client_port Client port
      */
-    void handle_decline(const DhcpMessage& message, const std::string& client_address, uint16_t client_port);
+    void handle_decline(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
     
     /**
      * @brief Handle DHCP Inform message
+     * @param snapshot Configuration the packet is handled with
+     * @param message DHCP message
+     */
+    void handle_inform(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
+    
+    /** A DISCOVER whose OFFER waits for a ping check of the offered address */
+    struct PendingOffer {
+        std::vector<uint8_t> packet;    // the DISCOVER; the receive buffer is reused meanwhile
+        PacketIngress ingress;
+        bool has_ingress;
+        SubnetId subnet_id;
+        DhcpLease lease;
+        uint32_t attempt;               // addresses found in use before this one
+    };
+    
+    /** Addresses probed per DISCOVER before giving up on it */
+    static constexpr uint32_t kMaxPingAttempts = 3;
+    
+    /**
+     * @brief Reserve an offer and send it once its address is known not to answer ping
+     * @param snapshot Configuration the packet is handled with
+     * @param message DHCP Discover message
+     * @param subnet_id Subnet the client is in
+     * @param attempt Addresses found in use so far
+     *
+     * Returns at once; without a cached result the OFFER is sent from
+     * complete_ping_check() on the maintenance loop.
+     */
+    void offer_after_ping_check(const ConfigSnapshot& snapshot, const DhcpMessageView& message, SubnetId subnet_id,
+                                uint32_t attempt);
+    
+    /**
+     * @brief Send a pending offer, or decline its address and offer another
+     * @param pending Offer waiting for the probe
+     * @param in_use true if the address answered
+     */
+    void complete_ping_check(const PendingOffer& pending, bool in_use);
+    
+    /**
+     * @brief Hold an address that answered ping and drop the client's offer of it
+     */
+    void decline_answering_address(const ConfigSnapshot& snapshot, const MacAddress& mac_address,
+                                   IpAddress ip_address, SubnetId subnet_id);
+    
+    /**
+     * @brief Handle DHCP Leasequery message from a relay agent
+     * @param snapshot Configuration the packet is handled with
      * @param message DHCP message
-     * @param client_address Client address
-     * @param client_port Client port
      */
-    void handle_inform(const DhcpMessage& message, const std::string& client_address, uint16_t client_port);
+    void handle_leasequery(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
     
     /**
      * @brief Send DHCP Offer message
+     * @param snapshot Configuration the packet is handled with
      * @param message Original DHCP message
      * @param lease Allocated lease
-     * @param client_address Client address
-     * @param client_port Client port
+     * @param subnet_id Subnet of the lease
      */
-    void send_offer(const DhcpMessage& message, const DhcpLease& lease, const std::string& client_address, uint16_t client_port);
+    void send_offer(const ConfigSnapshot& snapshot, const DhcpMessageView& message, const DhcpLease& lease, SubnetId subnet_id);
     
     /**
      * @brief Send DHCP ACK message
+     * @param snapshot Configuration the packet is handled with
      * @param message Original DHCP message
      * @param lease Allocated lease
-     * @param client_address Client address
-     * @param client_port Client port
+     * @param subnet_id Subnet of the lease
      */
-    void send_ack(const DhcpMessage& message, const DhcpLease& lease, const std::string& client_address, uint16_t client_port);
+    void send_ack(const ConfigSnapshot& snapshot, const DhcpMessageView& message, const DhcpLease& lease, SubnetId subnet_id);
     
     /**
      * @brief Send DHCP NAK message
+     * @param snapshot Configuration the packet is handled with
      * @param message Original DHCP message
-     * @param client_address Client address
-     * @param client_port Client port
      */
-    void send_nak(const DhcpMessage& message, const std::string& client_address, uint16_t client_port);
+    void send_nak(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
+    
+    /**
+     * @brief Resend the cached reply of a retransmitted DISCOVER or REQUEST
+     * @param message DHCP message
+     * @return true if the message was answered; RELEASE and DECLINE drop the client's replies
+     */
+    bool answer_from_cache(const DhcpMessageView& message);
     
     /**
      * @brief Find appropriate subnet for client
+     * @param snapshot Configuration the packet is handled with
      * @param message DHCP message
-     * @return Subnet name
+     * @return Most specific subnet containing ciaddr, then giaddr; the first subnet otherwise
      * @throws DhcpServerException if no subnet found
      */
-    std::string find_subnet_for_client(const DhcpMessage& message);
+    static SubnetId find_subnet_for_client(const ConfigSnapshot& snapshot, const DhcpMessageView& message);
     
     /**
-     * @brief Build DHCP options for subnet
-     * @param subnet Subnet configuration
-     * @return DHCP options
+     * @brief Start a reply to a client message in the per-thread writer
+     * @param message Client message being answered
+     * @param type Reply message type
+     * @param your_ip Address offered to the client (yiaddr)
+     * @param server_id Server identifier (siaddr)
+     * @return Writer positioned after the message type option
      */
-    std::vector<DhcpOption> build_subnet_options(const DhcpSubnet& subnet);
+    DhcpMessageWriter& begin_reply(const DhcpMessageView& message, DhcpMessageType type,
+                                   IpAddress your_ip, IpAddress server_id);
     
     /**
-     * @brief Build DHCP options for lease
-     * @param lease Lease information
-     * @param subnet Subnet configuration
-     * @return DHCP options
+     * @brief Choose where a reply goes (RFC 2131 4.1)
+     * @param message Client message being answered
+     * @param type Reply message type
+     * @param your_ip Address given to the client (yiaddr)
+     * @return The relay at port 67; else ciaddr; else a broadcast for NAKs, the
+     * broadcast flag and replies without yiaddr; else yiaddr at chaddr
      */
-    std::vector<DhcpOption> build_lease_options(const DhcpLease& lease, const DhcpSubnet& subnet);
+    static ReplyRoute route_reply(const DhcpMessageView& message, DhcpMessageType type, IpAddress your_ip);
+    
+    /**
+     * @brief Lease time to announce for a lease
+     * @param lease Allocated lease
+     * @param subnet Subnet of the lease
+     * @return Lease duration in seconds, the subnet default if the lease has none
+     */
+    static uint32_t reply_lease_time(const DhcpLease& lease, const DhcpSubnet& subnet);
     
     /**
      * @brief Log DHCP message
      * @param message DHCP message
      * @param action Action taken
      */
-    void log_dhcp_message(const DhcpMessage& message, const std::string& action);
+    void log_dhcp_message(const DhcpMessageView& message, const std::string& action);
     
     /**
      * @brief Update server statistics
      * @param message_type Message type
      */
     void update_statistics(DhcpMessageType message_type);
-    
-    /**
-     * @brief Check if IP is in subnet range
-     * @param ip IP address to check
-     * @param subnet Subnet configuration
-     * @return true if IP is in subnet range
-     */
-    bool is_ip_in_subnet(IpAddress ip, const DhcpSubnet& subnet);
+
 };
 
 } // namespace simple_dhcpd
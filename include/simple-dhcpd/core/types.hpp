@@ -30,7 +30,14 @@ enum class DhcpMessageType : uint8_t {
     ACK = 5,
     NAK = 6,
     RELEASE = 7,
-    INFORM = 8
+    INFORM = 8,
+    LEASEQUERY = 10,            // RFC 4388
+    LEASEUNASSIGNED = 11,
+    LEASEUNKNOWN = 12,
+    LEASEACTIVE = 13,
+    BULKLEASEQUERY = 14,        // RFC 6926
+    LEASEQUERYDONE = 15,
+    LEASEQUERYSTATUS = 17
 };
 
 /**
@@ -261,6 +268,13 @@ enum class DhcpOptionCode : uint8_t {
     PXE_FD = 128,
     PXE_FE = 128,
     PXE_FF = 128,
+    STATUS_CODE = 151,          // RFC 6926
+    BASE_TIME = 152,
+    START_TIME_OF_STATE = 153,
+    QUERY_START_TIME = 154,
+    QUERY_END_TIME = 155,
+    DHCP_STATE = 156,
+    DATA_SOURCE = 157,
     END = 255
 };
 
@@ -396,6 +410,14 @@ struct DhcpConfig {
     std::string lease_file;
     std::string log_file;
     bool enable_logging;
+    /** Hand log lines to a background writer instead of writing them inline. */
+    bool log_async;
+    /** Lines the async logger can queue before its overflow policy applies. */
+    uint32_t log_buffer_lines;
+    /** Longest time a queued log line waits before it is written (milliseconds). */
+    uint32_t log_flush_interval_ms;
+    /** When the log queue is full, wait for room instead of dropping the line. */
+    bool log_block_when_full;
     bool enable_security;
     uint32_t max_leases;
     /** DHCP Server Identifier (RFC 2131). 0 = derive from matching subnet gateway. */
@@ -404,15 +426,114 @@ struct DhcpConfig {
     std::string security_policy_file;
     /** Non-empty: use AdvancedLeaseManager with this LEASE:/STATIC: database path. */
     std::string advanced_lease_database;
+    /** Lease changes AdvancedLeaseManager keeps in memory per address. */
+    uint32_t lease_history_depth;
+    /** Non-empty: AdvancedLeaseManager appends history records pushed out of memory to this file. */
+    std::string lease_history_file;
+    /** Non-empty: binary lease snapshot read at startup and written at shutdown; lease_file stays a text export. */
+    std::string lease_snapshot;
+    /** Non-empty: journal lease changes to this file instead of loading lease_file at startup. */
+    std::string lease_journal;
+    /** Make allocate/renew/release wait for their journal record to reach disk. */
+    bool lease_journal_sync;
+    /** Compact the journal into its snapshot once it grows past this size (MiB). */
+    uint32_t lease_journal_compact_mb;
     /** After DHCPDECLINE, suppress offering this IP (seconds). */
     uint32_t decline_hold_seconds;
+    /** Hold an offered address for the client this long before a REQUEST (seconds). 0 = lease on DISCOVER. */
+    uint32_t offer_hold_seconds;
+    /** Probe an address with ICMP echo before offering it; an answer marks it declined. Needs offer_hold_seconds. */
+    bool ping_check_enabled;
+    /** Time to wait for an echo reply before offering the address (milliseconds). */
+    uint32_t ping_check_timeout_ms;
+    /** Time a probe result is reused for repeated DISCOVERs (seconds). */
+    uint32_t ping_check_cache_seconds;
+    /** Receive workers per listen address, sharing the port via SO_REUSEPORT. 0 = one per CPU. */
+    uint32_t worker_threads;
+    /** Datagrams per recvmmsg/sendmmsg batch. 1 = one syscall per datagram. */
+    uint32_t io_batch_size;
+    /** Longest time a batched reply may stay queued (microseconds). */
+    uint32_t io_flush_timeout_us;
+    /** Readiness backend of the receive loops: "auto", "epoll" or "poll". */
+    std::string event_backend;
+    /** Unicast replies to clients without an address as raw frames (needs CAP_NET_RAW) instead of broadcasting. */
+    bool raw_unicast_replies;
+    /** OFFER/ACK replies kept for answering retransmitted requests. 0 = no reply cache. */
+    uint32_t reply_cache_size;
+    /** Time a cached reply stays valid (milliseconds). */
+    uint32_t reply_cache_ttl_ms;
+    /** Serve Prometheus metrics over HTTP at /metrics. */
+    bool metrics_enabled;
+    /** Address the metrics endpoint listens on. */
+    std::string metrics_address;
+    /** TCP port of the metrics endpoint. */
+    uint16_t metrics_port;
+    /** Answer DHCPLEASEQUERY (RFC 4388) from relay agents. */
+    bool leasequery_enabled;
+    /** Address the bulk leasequery (RFC 6926) TCP listener binds. Empty = no bulk leasequery. */
+    std::string bulk_leasequery_address;
+    /** TCP port of the bulk leasequery listener. */
+    uint16_t bulk_leasequery_port;
+    /** Address of the failover peer that lease changes are replicated with. Empty = standalone. */
+    std::string failover_peer;
+    /** TCP port the secondary listens on and the primary connects to. */
+    uint16_t failover_port;
+    /** This server's side of the failover pair: "primary" or "secondary". */
+    std::string failover_role;
+    /** RFC 3074 hash buckets (of 256) the primary serves while both servers are up. */
+    uint32_t failover_split;
+    /** IPv4 address of the DNS server sent RFC 2136 updates for leased names. Empty = no DDNS. */
+    std::string ddns_server;
+    /** TCP port of the DNS server. */
+    uint16_t ddns_port;
+    /** Zone the A records of client host names are added to. */
+    std::string ddns_forward_zone;
+    /** in-addr.arpa zone PTR records are added to. Empty = no reverse updates. */
+    std::string ddns_reverse_zone;
+    /** TTL of the records added (seconds). */
+    uint32_t ddns_ttl;
+    /** Name of the TSIG (HMAC-SHA256) key updates are signed with. Empty = unsigned. */
+    std::string ddns_tsig_key;
+    /** Base64 secret of the TSIG key. */
+    std::string ddns_tsig_secret;
+    /** Lease events that may wait for the DDNS thread; more are dropped. */
+    uint32_t ddns_queue_size;
 
     DhcpConfig()
         : enable_logging(true),
+          log_async(true),
+          log_buffer_lines(8192),
+          log_flush_interval_ms(100),
+          log_block_when_full(false),
           enable_security(true),
           max_leases(10000),
           server_identifier(0),
-          decline_hold_seconds(3600) {}
+          lease_history_depth(10),
+          lease_journal_sync(true),
+          lease_journal_compact_mb(64),
+          decline_hold_seconds(3600),
+          offer_hold_seconds(30),
+          ping_check_enabled(false),
+          ping_check_timeout_ms(500),
+          ping_check_cache_seconds(60),
+          worker_threads(1),
+          io_batch_size(1),
+          io_flush_timeout_us(200),
+          event_backend("auto"),
+          raw_unicast_replies(false),
+          reply_cache_size(4096),
+          reply_cache_ttl_ms(3000),
+          metrics_enabled(false),
+          metrics_address("127.0.0.1"),
+          metrics_port(9547),
+          leasequery_enabled(false),
+          bulk_leasequery_port(67),
+          failover_port(647),
+          failover_role("primary"),
+          failover_split(128),
+          ddns_port(53),
+          ddns_ttl(300),
+          ddns_queue_size(8192) {}
     
     // Copy constructor
     DhcpConfig(const DhcpConfig& other) = default;
@@ -460,11 +581,13 @@ struct DhcpStats {
     uint64_t total_leases_created;
     uint64_t total_leases_expired;
     uint64_t total_errors;
+    uint64_t reply_cache_hits;
     
     DhcpStats() : total_requests(0), discover_count(0), request_count(0),
                   release_count(0), decline_count(0), inform_count(0),
                   offer_count(0), ack_count(0), nak_count(0), active_leases(0),
-                  total_leases_created(0), total_leases_expired(0), total_errors(0) {}
+                  total_leases_created(0), total_leases_expired(0), total_errors(0),
+                  reply_cache_hits(0) {}
 };
 
 } // namespace simple_dhcpd
@@ -0,0 +1,28 @@
+/**
+ * @file utils/crc32.hpp
+ * @brief CRC-32 checksums for on-disk records
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_UTILS_CRC32_HPP
+#define SIMPLE_DHCPD_UTILS_CRC32_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Compute or extend a CRC-32 (IEEE 802.3, reflected)
+ * @param data Bytes to checksum
+ * @param size Number of bytes
+ * @param crc Checksum of the preceding bytes, 0 to start
+ * @return Checksum of everything so far
+ */
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_UTILS_CRC32_HPP
@@ -0,0 +1,45 @@
+/**
+ * @file utils/durable_file.hpp
+ * @brief Crash-safe file writing helpers
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_UTILS_DURABLE_FILE_HPP
+#define SIMPLE_DHCPD_UTILS_DURABLE_FILE_HPP
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Write a whole buffer, retrying short writes and EINTR
+ * @param fd File descriptor
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return false on error, with errno set
+ */
+bool write_fully(int fd, const void* data, size_t size);
+
+/**
+ * @brief Sync the directory holding a path so a rename or create in it survives a crash
+ * @param path File whose directory is synced
+ */
+void sync_parent_directory(const std::string& path);
+
+/**
+ * @brief Replace a file so that after a crash it holds either the old or the new contents
+ * @param path Destination; written as path.tmp, synced and renamed
+ * @param parts Byte ranges written in order
+ * @param error Receives a description of the failure
+ * @return true on success
+ */
+bool replace_file_durably(const std::string& path, std::initializer_list<std::string_view> parts, std::string& error);
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_UTILS_DURABLE_FILE_HPP
@@ -0,0 +1,345 @@
+/**
+ * @file utils/latency_histogram.hpp
+ * @brief Log-linear latency histograms for the packet pipeline
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_LATENCY_HISTOGRAM_HPP
+#define SIMPLE_DHCPD_LATENCY_HISTOGRAM_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Set to 0 (CMake: -DENABLE_LATENCY_HISTOGRAMS=OFF) to compile the pipeline
+ * instrumentation out; PipelineLatency then has no storage and its calls
+ * are empty.
+ */
+#ifndef SIMPLE_DHCPD_LATENCY_HISTOGRAMS
+#define SIMPLE_DHCPD_LATENCY_HISTOGRAMS 1
+#endif
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Fixed-size histogram of nanosecond latencies
+ *
+ * Buckets follow the HDR layout: values below 16 ns have a bucket each and
+ * every power of two above is split into 16 equal sub-buckets, so any
+ * recorded value is known to within 1/16 (about 6%) of itself. Values of
+ * 2^32 ns (about 4.3 s) and more share the last bucket. Recording is one
+ * relaxed atomic add on a bucket plus one on the running sum, with no
+ * allocation and no lock.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr uint64_t kSubBuckets = 1u << kSubBucketBits;
+    static constexpr unsigned kMaxExponent = 32;
+    static constexpr size_t kBuckets = kSubBuckets + (kMaxExponent - kSubBucketBits) * kSubBuckets;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * @brief Record one latency; safe from any thread
+     * @param nanoseconds Latency
+     */
+    void record(uint64_t nanoseconds) {
+        buckets_[bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t seen = max_.load(std::memory_order_relaxed);
+        while (nanoseconds > seen && !max_.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Get number of recorded values
+     * @return Count
+     */
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (const auto& bucket : buckets_) {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /**
+     * @brief Get the latency below which a fraction of the values fall
+     * @param quantile Fraction, 0.0 to 1.0
+     * @return Highest value of the bucket holding the quantile, 0 if empty
+     */
+    uint64_t percentile(double quantile) const {
+        const uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total) + 0.5);
+        rank = rank == 0 ? 1 : (rank > total ? total : rank);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                const uint64_t highest = bucket_upper(i);
+                const uint64_t max = max_.load(std::memory_order_relaxed);
+                return highest < max ? highest : max;
+            }
+        }
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the largest recorded value
+     * @return Latency in nanoseconds
+     */
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get the sum of recorded values
+     * @return Nanoseconds
+     */
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Forget all recorded values
+     */
+    void reset() {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get bucket for a value
+     * @param value Nanoseconds
+     * @return Bucket index
+     */
+    static size_t bucket_index(uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        if (value >> kMaxExponent) {
+            return kBuckets - 1;
+        }
+        const unsigned exponent = 63u - static_cast<unsigned>(__builtin_clzll(value));
+        const uint64_t sub_bucket = (value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+        return static_cast<size_t>(kSubBuckets + (exponent - kSubBucketBits) * kSubBuckets + sub_bucket);
+    }
+
+    /**
+     * @brief Get the highest value a bucket holds
+     * @param index Bucket index
+     * @return Nanoseconds
+     */
+    static uint64_t bucket_upper(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        const unsigned exponent = static_cast<unsigned>((index - kSubBuckets) / kSubBuckets) + kSubBucketBits;
+        const uint64_t sub_bucket = (index - kSubBuckets) % kSubBuckets;
+        const uint64_t width = 1ull << (exponent - kSubBucketBits);
+        return (1ull << exponent) + (sub_bucket + 1) * width - 1;
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets];
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+/**
+ * @brief Pipeline stage timed by PipelineLatency
+ */
+enum class PipelineStage {
+    PARSE,       ///< Parsing the packet into a message view
+    SECURITY,    ///< Filters, rate limiting and Option 82 checks
+    LEASE,       ///< Subnet selection and the lease manager call
+    REPLY,       ///< Building the reply and its options
+    SEND,        ///< Handing the reply to the socket
+    TOTAL,       ///< Whole packet, from handler entry to return
+    COUNT
+};
+
+/**
+ * @brief Latency summary of one stage for one message type
+ */
+struct LatencySummary {
+    std::string stage;
+    std::string message_type;
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+    uint64_t mean_ns;
+    uint64_t sum_ns;
+};
+
+/**
+ * @brief Per-stage, per-message-type latency histograms for the packet pipeline
+ *
+ * A packet handler calls begin() on entry, set_message_type() once the
+ * packet is parsed, mark() at the end of each stage and finish() on return.
+ * Each mark reads the clock once and records the time since the previous
+ * mark; the running timestamps are kept per thread, so concurrent handlers
+ * need no coordination.
+ */
+class PipelineLatency {
+public:
+    /**
+     * @brief Get the stage time summaries of all stages that recorded anything
+     * @return Summaries, by message type then stage; empty when compiled out
+     */
+    std::vector<LatencySummary> summaries() const;
+
+    /**
+     * @brief Forget all recorded latencies
+     */
+    void reset();
+
+#if SIMPLE_DHCPD_LATENCY_HISTOGRAMS
+    /**
+     * @brief Start timing a packet on the calling thread
+     */
+    void begin() {
+        Trace& trace = current_trace();
+        trace.start_ns = now_ns();
+        trace.last_ns = trace.start_ns;
+        trace.type = kOtherType;
+    }
+
+    /**
+     * @brief Attribute the packet being timed to a message type
+     * @param type Message type from the parsed packet
+     */
+    void set_message_type(DhcpMessageType type) {
+        current_trace().type = type_index(type);
+    }
+
+    /**
+     * @brief Record the time since the previous mark as a stage
+     * @param stage Stage that just ended
+     */
+    void mark(PipelineStage stage) {
+        Trace& trace = current_trace();
+        const uint64_t now = now_ns();
+        histograms_[trace.type][static_cast<size_t>(stage)].record(now - trace.last_ns);
+        trace.last_ns = now;
+    }
+
+    /**
+     * @brief Record the time since begin() as PipelineStage::TOTAL
+     */
+    void finish() {
+        Trace& trace = current_trace();
+        histograms_[trace.type][static_cast<size_t>(PipelineStage::TOTAL)].record(now_ns() - trace.start_ns);
+    }
+
+    /**
+     * @brief Get one histogram
+     * @param type Message type
+     * @param stage Stage
+     * @return Histogram
+     */
+    const LatencyHistogram& histogram(DhcpMessageType type, PipelineStage stage) const {
+        return histograms_[type_index(type)][static_cast<size_t>(stage)];
+    }
+#else
+    void begin() {}
+    void set_message_type(DhcpMessageType) {}
+    void mark(PipelineStage) {}
+    void finish() {}
+#endif
+
+private:
+#if SIMPLE_DHCPD_LATENCY_HISTOGRAMS
+    // DISCOVER, REQUEST, RELEASE, INFORM, DECLINE, then everything else
+    static constexpr size_t kTypes = 6;
+    static constexpr size_t kOtherType = kTypes - 1;
+    static constexpr size_t kStages = static_cast<size_t>(PipelineStage::COUNT);
+
+    struct Trace {
+        uint64_t start_ns;
+        uint64_t last_ns;
+        size_t type;
+    };
+
+    LatencyHistogram histograms_[kTypes][kStages];
+
+    static Trace& current_trace() {
+        thread_local Trace trace{0, 0, kOtherType};
+        return trace;
+    }
+
+    static uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static size_t type_index(DhcpMessageType type) {
+        switch (type) {
+            case DhcpMessageType::DISCOVER: return 0;
+            case DhcpMessageType::REQUEST: return 1;
+            case DhcpMessageType::RELEASE: return 2;
+            case DhcpMessageType::INFORM: return 3;
+            case DhcpMessageType::DECLINE: return 4;
+            default: return kOtherType;
+        }
+    }
+#endif
+};
+
+#if SIMPLE_DHCPD_LATENCY_HISTOGRAMS
+inline std::vector<LatencySummary> PipelineLatency::summaries() const {
+    static const char* const type_names[kTypes] = {"DISCOVER", "REQUEST", "RELEASE", "INFORM", "DECLINE", "OTHER"};
+    static const char* const stage_names[kStages] = {"parse", "security", "lease", "reply", "send", "total"};
+    std::vector<LatencySummary> result;
+    for (size_t type = 0; type < kTypes; ++type) {
+        for (size_t stage = 0; stage < kStages; ++stage) {
+            const LatencyHistogram& histogram = histograms_[type][stage];
+            const uint64_t count = histogram.count();
+            if (count == 0) {
+                continue;
+            }
+            result.push_back(LatencySummary{stage_names[stage], type_names[type], count,
+                                            histogram.percentile(0.5), histogram.percentile(0.9),
+                                            histogram.percentile(0.99), histogram.percentile(0.999),
+                                            histogram.max(), histogram.sum() / count, histogram.sum()});
+        }
+    }
+    return result;
+}
+
+inline void PipelineLatency::reset() {
+    for (auto& by_type : histograms_) {
+        for (auto& histogram : by_type) {
+            histogram.reset();
+        }
+    }
+}
+#else
+inline std::vector<LatencySummary> PipelineLatency::summaries() const {
+    return {};
+}
+
+inline void PipelineLatency::reset() {}
+#endif
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_LATENCY_HISTOGRAM_HPP
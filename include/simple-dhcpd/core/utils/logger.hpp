@@ -9,10 +9,14 @@
 #ifndef SIMPLE_DHCPD_LOGGER_HPP
 #define SIMPLE_DHCPD_LOGGER_HPP
 
+#include "simple-dhcpd/core/utils/mpsc_queue.hpp"
+#include <atomic>
 #include <string>
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <sstream>
 #include <chrono>
 #include <iomanip>
@@ -30,8 +34,21 @@ enum class LogLevel {
     FATAL = 4
 };
 
+/**
+ * @brief What an asynchronous logger does when its buffer is full
+ */
+enum class LogOverflowPolicy {
+    DROP = 0,    ///< Discard the line and count it
+    BLOCK = 1    ///< Wait for the writer to make room
+};
+
 /**
  * @brief Logger class
+ *
+ * Lines are written synchronously until start_async() is called. From then
+ * on callers format the line and push it into a bounded lock-free queue,
+ * and a writer thread appends queued lines in batches, flushing once per
+ * batch instead of once per line.
  */
 class Logger {
 public:
@@ -58,6 +75,15 @@ public:
      * @return Current log level
      */
     LogLevel get_level() const;
+
+    /**
+     * @brief Check whether a level would be logged; lock-free
+     * @param level Log level
+     * @return True if messages at this level are written
+     */
+    bool is_enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
     
     /**
      * @brief Log a message
@@ -109,17 +135,67 @@ public:
     void set_file_output(bool enable);
     
     /**
-     * @brief Flush log output
+     * @brief Flush log output; in async mode, waits until every line logged
+     *        before the call has been written
      */
     void flush();
 
+    /**
+     * @brief Hand writing over to a background thread
+     * @param buffer_lines Queue capacity in lines
+     * @param flush_interval Longest time a line may wait in the queue
+     * @param policy What to do when the queue is full
+     */
+    void start_async(size_t buffer_lines, std::chrono::milliseconds flush_interval,
+                     LogOverflowPolicy policy = LogOverflowPolicy::DROP);
+
+    /**
+     * @brief Write what is queued, stop the writer thread and go back to
+     *        synchronous writes
+     */
+    void stop_async();
+
+    /**
+     * @brief Check whether a writer thread is running
+     * @return True in async mode
+     */
+    bool is_async() const { return async_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Get number of lines discarded because the queue was full
+     * @return Dropped line count
+     */
+    uint64_t dropped_count() const { return dropped_.load(std::memory_order_relaxed); }
+
 private:
+    struct LogRecord {
+        LogLevel level = LogLevel::INFO;
+        std::string line;
+    };
+
     std::string log_file_;
-    LogLevel level_;
-    bool console_output_;
-    bool file_output_;
+    std::atomic<LogLevel> level_;
+    std::atomic<bool> console_output_;
+    std::atomic<bool> file_output_;
     std::unique_ptr<std::ofstream> file_stream_;
     mutable std::mutex mutex_;
+
+    // Async mode
+    std::unique_ptr<BoundedMpscQueue<LogRecord>> queue_;
+    std::thread writer_thread_;
+    std::atomic<bool> async_;
+    LogOverflowPolicy policy_;
+    std::chrono::milliseconds flush_interval_;
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    std::condition_variable written_cv_;
+    bool stopping_;
+    bool wake_requested_;
+    uint64_t written_;
+    uint64_t reported_drops_;
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint32_t> producers_;
     
     /**
      * @brief Get current timestamp string
@@ -132,7 +208,7 @@ private:
      * @param level Log level
      * @return Log level string
      */
-    std::string get_level_string(LogLevel level) const;
+    const char* get_level_string(LogLevel level) const;
     
     /**
      * @brief Write log message
@@ -140,6 +216,25 @@ private:
      * @param message Message to write
      */
     void write_log(LogLevel level, const std::string& message);
+
+    /**
+     * @brief Queue a formatted line, applying the overflow policy
+     * @param record Line to queue
+     */
+    void enqueue(LogRecord& record);
+
+    /**
+     * @brief Write formatted lines to the enabled outputs; mutex_ held
+     * @param out Lines for stdout and the file
+     * @param err Lines for stderr and the file
+     * @param file Lines for the file, in logging order
+     */
+    void write_batch(const std::string& out, const std::string& err, const std::string& file);
+
+    /**
+     * @brief Writer thread body
+     */
+    void writer_loop();
 };
 
 /**
@@ -161,10 +256,11 @@ void init_logger(const std::string& log_file = "", LogLevel level = LogLevel::IN
 Logger& get_logger();
 
 /**
- * @brief Log macros for convenience
+ * @brief Log macros for convenience; the message is only formatted when
+ *        its level is enabled
  */
 #define LOG_DEBUG(msg) do { \
-    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->get_level() <= simple_dhcpd::LogLevel::DEBUG) { \
+    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->is_enabled(simple_dhcpd::LogLevel::DEBUG)) { \
         std::ostringstream oss; \
         oss << msg; \
         simple_dhcpd::g_logger->debug(oss.str()); \
@@ -172,7 +268,7 @@ Logger& get_logger();
 } while(0)
 
 #define LOG_INFO(msg) do { \
-    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->get_level() <= simple_dhcpd::LogLevel::INFO) { \
+    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->is_enabled(simple_dhcpd::LogLevel::INFO)) { \
         std::ostringstream oss; \
         oss << msg; \
         simple_dhcpd::g_logger->info(oss.str()); \
@@ -180,7 +276,7 @@ Logger& get_logger();
 } while(0)
 
 #define LOG_WARN(msg) do { \
-    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->get_level() <= simple_dhcpd::LogLevel::WARN) { \
+    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->is_enabled(simple_dhcpd::LogLevel::WARN)) { \
         std::ostringstream oss; \
         oss << msg; \
         simple_dhcpd::g_logger->warn(oss.str()); \
@@ -188,7 +284,7 @@ Logger& get_logger();
 } while(0)
 
 #define LOG_ERROR(msg) do { \
-    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->get_level() <= simple_dhcpd::LogLevel::ERROR) { \
+    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->is_enabled(simple_dhcpd::LogLevel::ERROR)) { \
         std::ostringstream oss; \
         oss << msg; \
         simple_dhcpd::g_logger->error(oss.str()); \
@@ -196,7 +292,7 @@ Logger& get_logger();
 } while(0)
 
 #define LOG_FATAL(msg) do { \
-    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->get_level() <= simple_dhcpd::LogLevel::FATAL) { \
+    if (simple_dhcpd::g_logger && simple_dhcpd::g_logger->is_enabled(simple_dhcpd::LogLevel::FATAL)) { \
         std::ostringstream oss; \
         oss << msg; \
         simple_dhcpd::g_logger->fatal(oss.str()); \
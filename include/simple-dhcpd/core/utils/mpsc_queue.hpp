@@ -0,0 +1,115 @@
+/**
+ * @file utils/mpsc_queue.hpp
+ * @brief Bounded lock-free multi-producer, single-consumer queue
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_MPSC_QUEUE_HPP
+#define SIMPLE_DHCPD_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Fixed-capacity ring shared by many producers and one consumer
+ *
+ * Each cell carries a sequence number telling producers and the consumer
+ * whose turn it is (Vyukov's bounded queue). Producers claim a position with
+ * one CAS and never wait on each other beyond that; a full queue is
+ * reported rather than waited on, so the caller picks the overflow policy.
+ *
+ * @tparam T Element type; must be default-constructible and movable
+ */
+template <typename T>
+class BoundedMpscQueue {
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Minimum number of elements; rounded up to a power of two
+     */
+    explicit BoundedMpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMpscQueue(const BoundedMpscQueue&) = delete;
+    BoundedMpscQueue& operator=(const BoundedMpscQueue&) = delete;
+
+    /**
+     * @brief Append an element; safe from any thread
+     * @param value Element; left untouched when the queue is full
+     * @return false if the queue is full
+     */
+    bool try_push(T& value) {
+        size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[position & mask_];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest element; only one thread may call this
+     * @param value Receives the element
+     * @return false if the queue is empty
+     */
+    bool try_pop(T& value) {
+        Cell& cell = cells_[dequeue_position_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeue_position_ + 1) {
+            return false;
+        }
+        value = std::move(cell.value);
+        cell.sequence.store(dequeue_position_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_position_;
+        return true;
+    }
+
+    /**
+     * @brief Get the number of elements the queue can hold
+     * @return Capacity
+     */
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_position_{0};
+    alignas(64) size_t dequeue_position_ = 0;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_MPSC_QUEUE_HPP
@@ -0,0 +1,90 @@
+/**
+ * @file utils/prefix_trie.hpp
+ * @brief IPv4 longest-prefix-match trie
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_UTILS_PREFIX_TRIE_HPP
+#define SIMPLE_DHCPD_UTILS_PREFIX_TRIE_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Binary radix trie mapping IPv4 prefixes to 32-bit values
+ *
+ * Nodes live in one contiguous vector and refer to their children by
+ * index, so a lookup is at most 32 dependent loads and never allocates.
+ * Inserting a prefix that is already present keeps the first value, which
+ * preserves first-match order when prefixes come from an ordered list.
+ */
+class Ipv4PrefixTrie {
+public:
+    /** Value returned when no prefix matches */
+    static constexpr uint32_t kNoValue = 0xFFFFFFFFu;
+
+    /**
+     * @brief Constructor for an empty trie
+     */
+    Ipv4PrefixTrie();
+
+    /**
+     * @brief Add a prefix
+     * @param network Network address in network byte order; host bits are ignored
+     * @param prefix_length Prefix length (0-32, larger values are clamped)
+     * @param value Value to return for addresses inside the prefix
+     * @return true if added, false if the prefix was already present
+     */
+    bool insert(IpAddress network, uint8_t prefix_length, uint32_t value);
+
+    /**
+     * @brief Find the longest prefix containing an address
+     * @param address Address in network byte order
+     * @return Value of the longest matching prefix, kNoValue if none
+     */
+    uint32_t lookup(IpAddress address) const;
+
+    /**
+     * @brief Find the value stored for an exact prefix
+     * @param network Network address in network byte order
+     * @param prefix_length Prefix length
+     * @return Stored value, kNoValue if the prefix is not present
+     */
+    uint32_t find_exact(IpAddress network, uint8_t prefix_length) const;
+
+    /**
+     * @brief Remove all prefixes
+     */
+    void clear();
+
+    /**
+     * @brief Get number of stored prefixes
+     * @return Prefix count
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Check whether the trie is empty
+     * @return true if no prefix is stored
+     */
+    bool empty() const { return size_ == 0; }
+
+private:
+    static constexpr uint32_t kNoNode = 0;  // node 0 is the root, never a child
+
+    struct Node {
+        uint32_t child[2];
+        uint32_t value;
+    };
+
+    std::vector<Node> nodes_;
+    size_t size_;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_UTILS_PREFIX_TRIE_HPP
@@ -0,0 +1,129 @@
+/**
+ * @file utils/stat_counters.hpp
+ * @brief Enum-indexed statistics counters with per-thread slots
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_STAT_COUNTERS_HPP
+#define SIMPLE_DHCPD_STAT_COUNTERS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Slot index of the calling thread, assigned on first use
+ * @return Index, distinct for the first threads that count anything
+ */
+inline size_t stat_thread_index() {
+    static std::atomic<size_t> next_index{0};
+    thread_local const size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+/**
+ * @brief Counters indexed by an enum, kept per thread and summed on demand
+ *
+ * Each thread increments its own cache-line-aligned copy of the counters
+ * with a relaxed atomic add, so counting takes no lock and shares no cache
+ * line with other threads. Threads beyond the slot count share slots, which
+ * stays correct and only reintroduces some line sharing. snapshot() adds up
+ * the slots; reset() records the current totals as a baseline instead of
+ * zeroing, so increments racing with it are never lost.
+ *
+ * @tparam Counter Enum whose values index the counters
+ * @tparam N Number of counters; defaults to Counter::COUNT
+ * @tparam Slots Number of per-thread copies
+ */
+template <typename Counter, size_t N = static_cast<size_t>(Counter::COUNT), size_t Slots = 16>
+class StatCounters {
+public:
+    using Values = std::array<uint64_t, N>;
+
+    StatCounters() : baseline_{} {}
+
+    StatCounters(const StatCounters&) = delete;
+    StatCounters& operator=(const StatCounters&) = delete;
+
+    /**
+     * @brief Add to a counter; safe from any thread
+     * @param counter Counter
+     * @param amount Amount to add
+     */
+    void increment(Counter counter, uint64_t amount = 1) {
+        slots_[stat_thread_index() % Slots].values[static_cast<size_t>(counter)].fetch_add(
+            amount, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get every counter summed over all threads
+     * @return Totals since construction or the last reset()
+     */
+    Values snapshot() const {
+        Values totals{};
+        for (const Slot& slot : slots_) {
+            for (size_t i = 0; i < N; ++i) {
+                totals[i] += slot.values[i].load(std::memory_order_relaxed);
+            }
+        }
+        std::lock_guard<std::mutex> lock(baseline_mutex_);
+        for (size_t i = 0; i < N; ++i) {
+            totals[i] -= baseline_[i];
+        }
+        return totals;
+    }
+
+    /**
+     * @brief Get one counter summed over all threads
+     * @param counter Counter
+     * @return Total since construction or the last reset()
+     */
+    uint64_t get(Counter counter) const {
+        const size_t i = static_cast<size_t>(counter);
+        uint64_t total = 0;
+        for (const Slot& slot : slots_) {
+            total += slot.values[i].load(std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(baseline_mutex_);
+        return total - baseline_[i];
+    }
+
+    /**
+     * @brief Start counting from zero again
+     */
+    void reset() {
+        Values totals{};
+        for (const Slot& slot : slots_) {
+            for (size_t i = 0; i < N; ++i) {
+                totals[i] += slot.values[i].load(std::memory_order_relaxed);
+            }
+        }
+        std::lock_guard<std::mutex> lock(baseline_mutex_);
+        baseline_ = totals;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> values[N];
+
+        Slot() {
+            for (auto& value : values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    Slot slots_[Slots];
+    mutable std::mutex baseline_mutex_;
+    Values baseline_;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_STAT_COUNTERS_HPP
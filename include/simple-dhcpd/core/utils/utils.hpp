@@ -152,6 +152,13 @@ inline std::string get_message_type_name(DhcpMessageType type) {
         case DhcpMessageType::NAK: return "NAK";
         case DhcpMessageType::RELEASE: return "RELEASE";
         case DhcpMessageType::INFORM: return "INFORM";
+        case DhcpMessageType::LEASEQUERY: return "LEASEQUERY";
+        case DhcpMessageType::LEASEUNASSIGNED: return "LEASEUNASSIGNED";
+        case DhcpMessageType::LEASEUNKNOWN: return "LEASEUNKNOWN";
+        case DhcpMessageType::LEASEACTIVE: return "LEASEACTIVE";
+        case DhcpMessageType::BULKLEASEQUERY: return "BULKLEASEQUERY";
+        case DhcpMessageType::LEASEQUERYDONE: return "LEASEQUERYDONE";
+        case DhcpMessageType::LEASEQUERYSTATUS: return "LEASEQUERYSTATUS";
         default: return "UNKNOWN";
     }
 }
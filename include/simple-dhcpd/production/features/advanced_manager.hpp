@@ -10,7 +10,9 @@
 #define SIMPLE_DHCPD_ADVANCED_LEASE_MANAGER_HPP
 
 #include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/lease/lease_history.hpp"
 #include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/utils/mpsc_queue.hpp"
 #include <string>
 #include <map>
 #include <vector>
@@ -20,7 +22,6 @@
 #include <atomic>
 #include <functional>
 #include <chrono>
-#include <queue>
 #include <set>
 
 namespace simple_dhcpd {
@@ -67,6 +68,9 @@ struct LeaseConflict {
     ConflictResolutionStrategy resolution;
     std::string reason;
     
+    LeaseConflict()
+        : existing_mac{}, conflicting_mac{}, ip_address(0), resolution(ConflictResolutionStrategy::REJECT) {}
+    
     LeaseConflict(const MacAddress& existing, const MacAddress& conflicting,
                   const IpAddress& ip, const std::string& reason = "")
         : existing_mac(existing), conflicting_mac(conflicting), ip_address(ip),
@@ -91,9 +95,19 @@ struct LeaseDatabaseStats {
 
 /**
  * @brief Advanced lease manager with static leases and conflict resolution
+ *
+ * A conflict (a client asking for an address another client holds) is
+ * detected by allocate_lease() in the critical section that refuses the
+ * address, and pushed onto a bounded lock-free queue. The first push into
+ * an empty queue writes one byte to a wake pipe watched by the maintenance
+ * loop, which drains the queue, calls the conflict callback and applies the
+ * resolution strategy; nothing polls for conflicts.
  */
 class AdvancedLeaseManager : public LeaseManager {
 public:
+    /** Conflicts that may wait for resolution; more are dropped */
+    static constexpr size_t kConflictQueueSize = 1024;
+    
     /**
      * @brief Constructor
      * @param config DHCP configuration
@@ -159,18 +173,22 @@ public:
      * @brief Resolve lease conflict
      * @param conflict Lease conflict to resolve
      * @return true if conflict was resolved
+     *
+     * Called on the maintenance loop for every detected conflict. REPLACE
+     * releases the holder's lease, so the requesting client gets the
+     * address when it asks again.
      */
     bool resolve_lease_conflict(const LeaseConflict& conflict);
     
     /**
-     * @brief Get pending conflicts
-     * @return Vector of pending conflicts
+     * @brief Take the conflicts queued for negotiation
+     * @return Conflicts resolved with NEGOTIATE since the last call
      */
     std::vector<LeaseConflict> get_pending_conflicts();
     
     /**
      * @brief Set conflict resolution callback
-     * @param callback Callback function for conflict resolution
+     * @param callback Called on the maintenance loop with each detected conflict
      */
     void set_conflict_callback(std::function<void(const LeaseConflict&)> callback);
     
@@ -182,7 +200,7 @@ public:
      * @param subnet_name Subnet name
      * @param client_id Client identifier
      * @return Allocated lease
-     * @throws LeaseManagerException if allocation fails
+     * @throws LeaseManagerException if allocation fails, a conflict included
      */
     DhcpLease allocate_lease_advanced(const MacAddress& mac_address, IpAddress requested_ip, 
                                      const std::string& subnet_name, const std::string& client_id = "");
@@ -247,9 +265,9 @@ public:
     /**
      * @brief Get lease history for IP address
      * @param ip_address IP address
-     * @return Vector of lease history entries
+     * @return Changes of the address, oldest first; older ones come from the history file
      */
-    std::vector<DhcpLease> get_lease_history(IpAddress ip_address);
+    std::vector<LeaseHistoryRecord> get_lease_history(IpAddress ip_address);
     
     /**
      * @brief Get leases expiring soon
@@ -272,12 +290,14 @@ public:
     /**
      * @brief Set database auto-save interval
      * @param interval Auto-save interval in seconds
+     * @note Applies the next time the manager is started
      */
     void set_auto_save_interval(std::chrono::seconds interval);
     
     /**
      * @brief Set lease cleanup interval
      * @param interval Cleanup interval in seconds
+     * @note Applies the next time the manager is started
      */
     void set_cleanup_interval(std::chrono::seconds interval);
     
@@ -286,13 +306,20 @@ public:
      * @param enabled Enable conflict detection
      */
     void set_conflict_detection_enabled(bool enabled);
+    
+    /**
+     * @brief Get number of conflicts dropped because the queue was full
+     * @return Drop count
+     */
+    uint64_t conflicts_dropped() const { return conflicts_dropped_.load(std::memory_order_relaxed); }
 
 private:
     std::string database_path_;
     std::map<MacAddress, std::shared_ptr<StaticLease>> static_leases_;
-    std::queue<LeaseConflict> pending_conflicts_;
+    BoundedMpscQueue<LeaseConflict> detected_conflicts_;
+    std::vector<LeaseConflict> pending_conflicts_;      // awaiting negotiation
     std::vector<LeaseConflict> conflict_history_;
-    std::map<IpAddress, std::vector<DhcpLease>> lease_history_;
+    std::unique_ptr<LeaseHistory> history_;
     mutable std::mutex static_leases_mutex_;
     mutable std::mutex conflicts_mutex_;
     mutable std::mutex database_mutex_;
@@ -303,32 +330,35 @@ private:
     std::chrono::seconds cleanup_interval_;
     std::atomic<bool> conflict_detection_enabled_;
     std::atomic<bool> auto_save_enabled_;
+    int conflict_wake_fds_[2];                  // a byte in [0] means detected_conflicts_ needs a drain
+    std::atomic<bool> conflict_signalled_;      // a wake byte is written and not yet drained
+    std::atomic<uint64_t> conflicts_dropped_;
+    uint64_t reported_conflict_drops_;          // maintenance loop only
     
-    std::thread auto_save_thread_;
-    std::thread cleanup_thread_;
-    std::thread conflict_resolution_thread_;
+    /**
+     * @brief Add the auto-save and history cleanup timers and watch the conflict wake pipe
+     */
+    void schedule_maintenance() override;
     
     /**
-     * @brief Auto-save thread function
+     * @brief Auto-save timer: write the lease database
      */
-    void auto_save_worker();
+    void auto_save_tick();
     
     /**
-     * @brief Enhanced cleanup thread function
+     * @brief Cleanup timer: expire leases and drop conflict history older than a day
      */
-    void enhanced_cleanup_worker();
+    void enhanced_cleanup_tick();
     
     /**
-     * @brief Conflict resolution thread function
+     * @brief Wake pipe callback: resolve the detected conflicts and move them to the history
      */
-    void conflict_resolution_worker();
+    void drain_conflicts();
     
     /**
-     * @brief Detect lease conflicts
-     * @param lease Lease to check for conflicts
-     * @return true if conflicts detected
+     * @brief Queue a conflict found by allocate_lease() and wake the maintenance loop
      */
-    bool detect_conflicts(const DhcpLease& lease);
+    void address_conflict(const MacAddress& holder, const MacAddress& requester, IpAddress ip_address) override;
     
     /**
      * @brief Find best available IP for allocation
@@ -340,16 +370,15 @@ private:
     
     /**
      * @brief Calculate IP utilization for subnet
-     * @param subnet Subnet configuration
+     * @param usage Address usage of the subnet's pool
      * @return Utilization percentage
      */
-    double calculate_subnet_utilization(const DhcpSubnet& subnet);
+    double calculate_subnet_utilization(const PoolUsage& usage);
     
     /**
-     * @brief Add lease to history
-     * @param lease Lease to add to history
+     * @brief Record every allocation, renewal, release and expiry in the history
      */
-    void add_to_history(const DhcpLease& lease);
+    void lease_changed(JournalOp op, const DhcpLease& lease) override;
     
     /**
      * @brief Serialize lease to database format
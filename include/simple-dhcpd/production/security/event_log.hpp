@@ -0,0 +1,284 @@
+/**
+ * @file production/security/event_log.hpp
+ * @brief Bounded security event history and background event dispatch
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_SECURITY_EVENT_LOG_HPP
+#define SIMPLE_DHCPD_SECURITY_EVENT_LOG_HPP
+
+#include "simple-dhcpd/core/utils/mpsc_queue.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace simple_dhcpd {
+
+/**
+ * @brief Security threat level
+ */
+enum class ThreatLevel {
+    LOW,
+    MEDIUM,
+    HIGH,
+    CRITICAL
+};
+
+/**
+ * @brief Security event type
+ */
+enum class SecurityEventType {
+    UNAUTHORIZED_DHCP_SERVER,
+    MAC_SPOOFING,
+    IP_SPOOFING,
+    RATE_LIMIT_EXCEEDED,
+    INVALID_OPTION_82,
+    SUSPICIOUS_ACTIVITY,
+    LEASE_CONFLICT,
+    UNAUTHORIZED_CLIENT,
+    /** Do not filter by type in get_security_events (return all matching time range). */
+    ANY
+};
+
+/**
+ * @brief Security event
+ */
+struct SecurityEvent {
+    SecurityEventType type;
+    ThreatLevel level;
+    std::string description;
+    std::string client_mac;
+    std::string client_ip;
+    std::string source_interface;
+    std::chrono::system_clock::time_point timestamp;
+    std::map<std::string, std::string> additional_data;
+
+    SecurityEvent(SecurityEventType t, ThreatLevel l, const std::string& desc,
+                  const std::string& mac = "", const std::string& ip = "",
+                  const std::string& iface = "")
+        : type(t), level(l), description(desc), client_mac(mac), client_ip(ip),
+          source_interface(iface), timestamp(std::chrono::system_clock::now()) {}
+};
+
+/**
+ * @brief Fixed-capacity, time-ordered history of security events
+ *
+ * Events live in a ring that overwrites the oldest entry once full. An
+ * event stamped earlier than the newest one already stored (reports from
+ * several threads race by microseconds) is moved back to its place, so the
+ * ring stays sorted by timestamp and a time-range query is two binary
+ * searches plus a copy of the matching span.
+ */
+class SecurityEventLog {
+public:
+    /** Default number of events kept */
+    static constexpr size_t kDefaultCapacity = 4096;
+
+    /**
+     * @brief Constructor
+     * @param capacity Events kept before the oldest is overwritten
+     */
+    explicit SecurityEventLog(size_t capacity = kDefaultCapacity);
+
+    /**
+     * @brief Store an event
+     * @param event Event
+     */
+    void append(const SecurityEvent& event);
+
+    /**
+     * @brief Get stored events in a time range, oldest first
+     * @param start_time First timestamp included
+     * @param end_time Last timestamp included
+     * @param event_type Type to keep, or SecurityEventType::ANY
+     * @return Matching events
+     */
+    std::vector<SecurityEvent> query(std::chrono::system_clock::time_point start_time,
+                                     std::chrono::system_clock::time_point end_time,
+                                     SecurityEventType event_type) const;
+
+    /**
+     * @brief Forget all stored events
+     */
+    void clear();
+
+    /**
+     * @brief Get number of stored events
+     * @return Event count
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get number of events kept at most
+     * @return Capacity
+     */
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * @brief Get number of events overwritten by newer ones
+     * @return Overwrite count
+     */
+    uint64_t overwritten() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<SecurityEvent> events_;   // ring; grows to capacity_ first
+    size_t capacity_;
+    size_t head_;                         // oldest event once the ring is full
+    uint64_t overwritten_;
+
+    /**
+     * @brief Map a logical position (0 = oldest) to a slot; mutex_ held
+     */
+    size_t slot(size_t position) const { return (head_ + position) % events_.size(); }
+
+    /**
+     * @brief First logical position whose timestamp is not before a time; mutex_ held
+     * @param upper Use "after" instead of "not before"
+     */
+    size_t bound(std::chrono::system_clock::time_point time, bool upper) const;
+};
+
+/**
+ * @brief Delivers security events to the log and a callback off the packet path
+ *
+ * Reporting threads push events into a bounded lock-free queue; one thread
+ * logs them and invokes the callback. Repeats of an event identical to the
+ * last one delivered for its type (same level, description, client and
+ * interface) within the coalescing window are only counted, and one summary
+ * event carrying the repeat count follows when the window closes. A full
+ * queue drops the event from delivery only; its history and statistics are
+ * recorded by the caller before posting.
+ *
+ * Until start() is called, and after stop(), events are delivered inline.
+ */
+class SecurityEventDispatcher {
+public:
+    using Callback = std::function<void(const SecurityEvent&)>;
+
+    /** Default number of events waiting for delivery */
+    static constexpr size_t kDefaultQueueSize = 4096;
+
+    /**
+     * @brief Constructor
+     * @param queue_size Events that may wait for delivery
+     * @param coalesce_window Window in which identical events are counted, not delivered
+     */
+    explicit SecurityEventDispatcher(size_t queue_size = kDefaultQueueSize,
+                                     std::chrono::milliseconds coalesce_window = std::chrono::seconds(1));
+
+    /**
+     * @brief Destructor; delivers pending events
+     */
+    ~SecurityEventDispatcher();
+
+    SecurityEventDispatcher(const SecurityEventDispatcher&) = delete;
+    SecurityEventDispatcher& operator=(const SecurityEventDispatcher&) = delete;
+
+    /**
+     * @brief Set the event callback; safe while events are being delivered
+     * @param callback Callback, or an empty function for none
+     */
+    void set_callback(Callback callback);
+
+    /**
+     * @brief Hand an event over for delivery
+     * @param event Event
+     */
+    void post(const SecurityEvent& event);
+
+    /**
+     * @brief Start the delivery thread
+     */
+    void start();
+
+    /**
+     * @brief Deliver pending events and repeat summaries, then stop the thread
+     */
+    void stop();
+
+    /**
+     * @brief Wait until every event posted so far, and any pending repeat summary, is delivered
+     */
+    void flush();
+
+    /**
+     * @brief Get number of events dropped because the queue was full
+     * @return Drop count
+     */
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of events folded into a repeat summary
+     * @return Coalesced event count
+     */
+    uint64_t coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kEventTypes = static_cast<size_t>(SecurityEventType::ANY);
+
+    struct Repeats {
+        std::unique_ptr<SecurityEvent> last;   // last event delivered for the type
+        std::chrono::steady_clock::time_point since;
+        uint64_t count = 0;                    // identical events since then
+    };
+
+    BoundedMpscQueue<std::unique_ptr<SecurityEvent>> queue_;
+    std::chrono::milliseconds coalesce_window_;
+    Repeats repeats_[kEventTypes];             // delivery thread only
+
+    std::mutex callback_mutex_;
+    Callback callback_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<uint32_t> producers_;
+    std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable delivered_cv_;
+    bool stopping_;
+    bool wake_requested_;
+    bool flush_requested_;
+    uint64_t delivered_;                       // by mutex_
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> coalesced_;
+
+    /**
+     * @brief Delivery thread function
+     */
+    void run();
+
+    /**
+     * @brief Coalesce or deliver one event; delivery thread only
+     */
+    void dispatch(std::unique_ptr<SecurityEvent> event, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Deliver repeat summaries whose window closed, or all if forced; delivery thread only
+     */
+    void close_windows(std::chrono::steady_clock::time_point now, bool force);
+
+    /**
+     * @brief Deliver the repeat summary of one type, if any, and reset it; delivery thread only
+     */
+    void close_window(Repeats& repeats);
+
+    /**
+     * @brief Log an event and invoke the callback
+     */
+    void deliver(const SecurityEvent& event);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_SECURITY_EVENT_LOG_HPP
@@ -0,0 +1,171 @@
+/**
+ * @file production/security/filter_table.hpp
+ * @brief Compiled MAC and IP filter rules for lock-free lookups
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_FILTER_TABLE_HPP
+#define SIMPLE_DHCPD_FILTER_TABLE_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/utils/prefix_trie.hpp"
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+struct MacFilterRule;
+struct IpFilterRule;
+
+/**
+ * @brief Outcome of a filter lookup
+ */
+enum class FilterMatch {
+    NONE,    ///< No enabled, unexpired rule matches
+    ALLOW,
+    DENY
+};
+
+/**
+ * @brief MAC filter rules compiled for lookup by binary address
+ *
+ * Full addresses go into a hash map and "prefix*" patterns (OUIs and other
+ * whole-nibble prefixes, including a bare "*") into one hash map per prefix
+ * length. Other glob patterns are kept in a short list and matched against
+ * the address as text. Each entry remembers the position of the first rule
+ * that produced it, and a lookup returns the lowest position among the
+ * matches, so the answer is the same as scanning the rules in order.
+ *
+ * A table is immutable once built; the security manager builds a new one
+ * whenever rules change and publishes it atomically.
+ */
+class MacFilterTable {
+public:
+    /**
+     * @brief Build an empty table
+     */
+    MacFilterTable() = default;
+
+    /**
+     * @brief Compile rules
+     * @param rules Rules in priority order; disabled rules are skipped
+     */
+    explicit MacFilterTable(const std::vector<MacFilterRule>& rules);
+
+    /**
+     * @brief Look up a client
+     * @param mac_address Client MAC address
+     * @return Verdict of the first matching rule
+     */
+    FilterMatch match(const MacAddress& mac_address) const;
+
+    /**
+     * @brief Look up a client given as text that is not a plain MAC address
+     * @param text Client identifier; compared as lowercase text without separators
+     * @return Verdict of the first matching rule
+     */
+    FilterMatch match_text(const std::string& text) const;
+
+    /**
+     * @brief Check whether any rule was compiled
+     * @return true if match() always returns NONE
+     */
+    bool empty() const { return rules_.empty(); }
+
+    /**
+     * @brief Parse a MAC address, with ':' or '-' separators or none
+     * @param text Address text
+     * @param mac_address Receives the address
+     * @return false if text is not a MAC address
+     */
+    static bool parse(const std::string& text, MacAddress& mac_address);
+
+private:
+    static constexpr uint32_t kNoRule = 0xFFFFFFFFu;
+
+    struct Rule {
+        bool allow;
+        bool expires;            // expires_at is not time_point::max()
+        std::chrono::system_clock::time_point expires_at;
+        std::string pattern;     // normalized: lowercase hex digits and wildcards
+    };
+
+    struct PrefixMap {
+        uint32_t nibbles;
+        std::unordered_map<uint64_t, uint32_t> rules;
+    };
+
+    std::vector<Rule> rules_;
+    std::unordered_map<uint64_t, uint32_t> exact_;
+    std::vector<PrefixMap> prefixes_;
+    std::vector<uint32_t> globs_;        // rule positions, ascending
+    bool any_expiry_ = false;
+
+    /**
+     * @brief Verdict of the first unexpired rule matching a text, in list order
+     */
+    FilterMatch scan(const std::string& text) const;
+};
+
+/**
+ * @brief IP filter rules compiled into a longest-prefix-match trie
+ *
+ * Rules with a contiguous mask (or no mask, meaning one address) become
+ * trie prefixes. The value stored for a prefix is the lowest rule position
+ * among itself and every shorter prefix containing it, so the longest
+ * match yields the first matching rule in list order. Non-contiguous masks
+ * are checked one by one.
+ */
+class IpFilterTable {
+public:
+    /**
+     * @brief Build an empty table
+     */
+    IpFilterTable() = default;
+
+    /**
+     * @brief Compile rules
+     * @param rules Rules in priority order; disabled rules are skipped
+     */
+    explicit IpFilterTable(const std::vector<IpFilterRule>& rules);
+
+    /**
+     * @brief Look up an address
+     * @param ip_address Address, in the same byte order as the rules
+     * @return Verdict of the first matching rule
+     */
+    FilterMatch match(IpAddress ip_address) const;
+
+    /**
+     * @brief Check whether any rule was compiled
+     * @return true if match() always returns NONE
+     */
+    bool empty() const { return rules_.empty(); }
+
+private:
+    struct Rule {
+        IpAddress address;
+        IpAddress mask;          // 0 = exact address
+        bool allow;
+        bool expires;
+        std::chrono::system_clock::time_point expires_at;
+    };
+
+    std::vector<Rule> rules_;
+    Ipv4PrefixTrie trie_;
+    std::vector<uint32_t> masked_;      // rule positions with non-contiguous masks
+    bool any_expiry_ = false;
+
+    /**
+     * @brief Verdict of the first unexpired rule matching an address, in list order
+     */
+    FilterMatch scan(IpAddress ip_address) const;
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_FILTER_TABLE_HPP
@@ -10,6 +10,12 @@
 #define SIMPLE_DHCPD_SECURITY_MANAGER_HPP
 
 #include "simple-dhcpd/core/types.hpp"
+#include "simple-dhcpd/core/utils/stat_counters.hpp"
+#include "simple-dhcpd/core/network/event_loop.hpp"
+#include "simple-dhcpd/production/security/event_log.hpp"
+#include "simple-dhcpd/production/security/filter_table.hpp"
+#include "simple-dhcpd/production/security/rate_limiter.hpp"
+#include "simple-dhcpd/production/security/relay_table.hpp"
 #include <string>
 #include <map>
 #include <vector>
@@ -19,56 +25,11 @@
 #include <atomic>
 #include <chrono>
 #include <set>
+#include <unordered_map>
 #include <functional>
 
 namespace simple_dhcpd {
 
-/**
- * @brief Security threat level
- */
-enum class ThreatLevel {
-    LOW,
-    MEDIUM,
-    HIGH,
-    CRITICAL
-};
-
-/**
- * @brief Security event type
- */
-enum class SecurityEventType {
-    UNAUTHORIZED_DHCP_SERVER,
-    MAC_SPOOFING,
-    IP_SPOOFING,
-    RATE_LIMIT_EXCEEDED,
-    INVALID_OPTION_82,
-    SUSPICIOUS_ACTIVITY,
-    LEASE_CONFLICT,
-    UNAUTHORIZED_CLIENT,
-    /** Do not filter by type in get_security_events (return all matching time range). */
-    ANY
-};
-
-/**
- * @brief Security event
- */
-struct SecurityEvent {
-    SecurityEventType type;
-    ThreatLevel level;
-    std::string description;
-    std::string client_mac;
-    std::string client_ip;
-    std::string source_interface;
-    std::chrono::system_clock::time_point timestamp;
-    std::map<std::string, std::string> additional_data;
-    
-    SecurityEvent(SecurityEventType t, ThreatLevel l, const std::string& desc,
-                  const std::string& mac = "", const std::string& ip = "",
-                  const std::string& iface = "")
-        : type(t), level(l), description(desc), client_mac(mac), client_ip(ip),
-          source_interface(iface), timestamp(std::chrono::system_clock::now()) {}
-};
-
 /**
  * @brief MAC address filter rule
  */
@@ -258,8 +219,8 @@ public:
     bool is_interface_trusted(const std::string& interface_name) const;
     
     /**
-     * @brief Add snooping binding
-     * @param binding Snooping binding
+     * @brief Add snooping binding, replacing one for the same MAC and IP address
+     * @param binding Snooping binding; ignored if its MAC address does not parse
      */
     void add_snooping_binding(const DhcpSnoopingBinding& binding);
     
@@ -297,6 +258,12 @@ public:
      */
     void remove_mac_filter_rule(const std::string& mac_address);
     
+    /**
+     * @brief Replace all MAC filter rules, compiling the lookup table once
+     * @param rules Rules in priority order
+     */
+    void set_mac_filter_rules(const std::vector<MacFilterRule>& rules);
+    
     /**
      * @brief Check MAC address against filters
      * @param mac_address MAC address to check
@@ -304,6 +271,13 @@ public:
      */
     bool check_mac_address(const std::string& mac_address);
     
+    /**
+     * @brief Check a binary MAC address against filters
+     * @param mac_address MAC address to check
+     * @return true if allowed
+     */
+    bool check_mac_address(const MacAddress& mac_address);
+    
     /**
      * @brief Get MAC filter rules
      * @return Vector of MAC filter rules
@@ -323,6 +297,12 @@ public:
      */
     void remove_ip_filter_rule(const IpAddress& ip_address);
     
+    /**
+     * @brief Replace all IP filter rules, compiling the lookup table once
+     * @param rules Rules in priority order
+     */
+    void set_ip_filter_rules(const std::vector<IpFilterRule>& rules);
+    
     /**
      * @brief Check IP address against filters
      * @param ip_address IP address to check
@@ -358,6 +338,13 @@ public:
      */
     bool check_rate_limit(const std::string& identifier, const std::string& identifier_type);
     
+    /**
+     * @brief Check rate limit for a client MAC address without formatting it
+     * @param mac_address Client MAC address
+     * @return true if within limits
+     */
+    bool check_rate_limit(const MacAddress& mac_address);
+    
     /**
      * @brief Get rate limit rules
      * @return Vector of rate limit rules
@@ -386,6 +373,17 @@ public:
     bool validate_option_82(const std::vector<uint8_t>& option_82_data, 
                            const std::string& source_interface);
     
+    /**
+     * @brief Validate Option 82 in place, without copying it out of the packet
+     * @param option_82_data Option 82 data
+     * @param source_interface Source interface
+     * @return true if valid
+     *
+     * Once trusted relay agents are configured, a required Option 82 must
+     * also carry the circuit and remote IDs of one of them.
+     */
+    bool validate_option_82(ByteView option_82_data, const std::string& source_interface);
+    
     /**
      * @brief Manage Option 82 interface rules
      */
@@ -443,6 +441,11 @@ public:
     // Security event handling
     /**
      * @brief Report security event
+     *
+     * The event is counted and stored in the bounded history at once; the
+     * log line and callback follow on the dispatcher thread once start()
+     * has been called, with identical repeats coalesced.
+     *
      * @param event Security event
      */
     void report_security_event(const SecurityEvent& event);
@@ -454,7 +457,12 @@ public:
     void set_security_event_callback(std::function<void(const SecurityEvent&)> callback);
     
     /**
-     * @brief Get security events
+     * @brief Wait until all reported events have been delivered
+     */
+    void flush_security_events();
+    
+    /**
+     * @brief Get security events, oldest first
      * @param start_time Start time filter
      * @param end_time End time filter
      * @param event_type Event type filter
@@ -492,10 +500,16 @@ public:
     bool save_security_configuration(const std::string& config_file);
     
     /**
-     * @brief Start security manager
+     * @brief Start security manager with its cleanup timer on a loop of its own
      */
     void start();
     
+    /**
+     * @brief Start security manager with its cleanup timer on a shared loop
+     * @param loop Loop running the timer; must outlive stop()
+     */
+    void start(EventLoop& loop);
+    
     /**
      * @brief Stop security manager
      */
@@ -509,6 +523,18 @@ private:
     
     std::set<std::string> trusted_interfaces_;
     std::vector<DhcpSnoopingBinding> snooping_bindings_;
+    /** (binary MAC, IP) -> position in snooping_bindings_ */
+    struct SnoopingKey {
+        MacAddress mac_address;
+        IpAddress ip_address;
+        bool operator==(const SnoopingKey& other) const {
+            return mac_address == other.mac_address && ip_address == other.ip_address;
+        }
+    };
+    struct SnoopingKeyHash {
+        size_t operator()(const SnoopingKey& key) const;
+    };
+    std::unordered_map<SnoopingKey, size_t, SnoopingKeyHash> snooping_index_;
     std::vector<MacFilterRule> mac_filter_rules_;
     std::vector<IpFilterRule> ip_filter_rules_;
     std::vector<RateLimitRule> rate_limit_rules_;
@@ -517,60 +543,98 @@ private:
     std::map<std::string, ClientCredentials> client_credentials_;
     
     std::string authentication_key_;
-    std::vector<SecurityEvent> security_events_;
-    SecurityStats security_stats_;
     
-    std::function<void(const SecurityEvent&)> security_event_callback_;
+    /** Named request counters, then events by level and by type */
+    enum class SecurityCounter {
+        MAC_ALLOWED,
+        MAC_BLOCKED,
+        IP_ALLOWED,
+        IP_BLOCKED,
+        RATE_LIMIT_ALLOWED,
+        RATE_LIMIT_BLOCKED,
+        RATE_LIMIT_EXCEEDED,
+        OPTION_82_ALLOWED,
+        OPTION_82_VALID,
+        OPTION_82_MISSING,
+        OPTION_82_INVALID,
+        OPTION_82_INCOMPLETE,
+        AUTH_SUCCESS,
+        AUTH_FAILED,
+        AUTH_CLIENT_NOT_FOUND,
+        AUTH_CLIENT_DISABLED,
+        AUTH_CLIENT_EXPIRED,
+        AUTH_DATA_MISSING,
+        EVENTS_LOW,                          // one per ThreatLevel
+        EVENTS_MEDIUM,
+        EVENTS_HIGH,
+        EVENTS_CRITICAL,
+        EVENTS_UNAUTHORIZED_DHCP_SERVER,     // one per SecurityEventType
+        EVENTS_MAC_SPOOFING,
+        EVENTS_IP_SPOOFING,
+        EVENTS_RATE_LIMIT_EXCEEDED,
+        EVENTS_INVALID_OPTION_82,
+        EVENTS_SUSPICIOUS_ACTIVITY,
+        EVENTS_LEASE_CONFLICT,
+        EVENTS_UNAUTHORIZED_CLIENT,
+        COUNT
+    };
+    /** Counted without mutex_; summed by get_security_statistics() */
+    StatCounters<SecurityCounter> counters_;
+    std::chrono::system_clock::time_point stats_reset_time_;
     
-    /** Recursive: many paths call update_security_stats while already holding the lock. */
+    /** Event history and delivery; both have their own locks. */
+    SecurityEventLog security_events_;
+    SecurityEventDispatcher event_dispatcher_;
+    
+    /** Recursive: several paths re-enter while already holding the lock. */
     mutable std::recursive_mutex mutex_;
-    std::thread cleanup_thread_;
-    std::chrono::steady_clock::time_point last_security_cleanup_{};
+    EventLoop* cleanup_loop_ = nullptr;        // loop running the cleanup timer
+    std::unique_ptr<EventLoop> own_loop_;      // set when started without a shared loop
+    EventLoop::TimerId cleanup_timer_ = 0;
 
-    // Rate limiting tracking
-    struct RateLimitTracker {
-        std::vector<std::chrono::system_clock::time_point> requests;
-        std::chrono::system_clock::time_point window_start;
-        std::chrono::system_clock::time_point blocked_until;
-    };
-    std::map<std::string, RateLimitTracker> rate_limit_trackers_;
+    /** Buckets for rate_limit_rules_; checked without taking mutex_. */
+    RateLimiter rate_limiter_;
+    /** Compiled mac_filter_rules_/ip_filter_rules_, swapped with std::atomic_store. */
+    std::shared_ptr<const MacFilterTable> mac_filter_table_;
+    std::shared_ptr<const IpFilterTable> ip_filter_table_;
+    /** Compiled option_82_rules_/trusted_relay_agents_, swapped with std::atomic_store. */
+    std::shared_ptr<const RelayAgentTable> relay_table_;
     
     // Helper for updating security statistics
-    void update_security_stats(const std::string& stat_name);
+    void update_security_stats(SecurityCounter counter);
     
     /**
      * @brief Cleanup expired rules and bindings
      */
     void cleanup_expired_items();
     
+    /** Time between cleanup_expired_items() runs */
+    static constexpr std::chrono::minutes kCleanupInterval{5};
+    
     /**
-     * @brief Cleanup thread function
+     * @brief Compile the filter rules and publish the tables; mutex_ held
      */
-    void cleanup_worker();
+    void rebuild_filter_tables();
     
     /**
-     * @brief Check if MAC address matches filter rule
-     * @param mac_address MAC address
-     * @param rule Filter rule
-     * @return true if matches
+     * @brief Compile the Option 82 rules and trusted agents and publish the table; mutex_ held
      */
-    bool mac_matches_rule(const std::string& mac_address, const MacFilterRule& rule);
+    void rebuild_relay_table();
     
     /**
-     * @brief Check if IP address matches filter rule
-     * @param ip_address IP address
-     * @param rule Filter rule
-     * @return true if matches
+     * @brief Record the outcome of a MAC filter lookup
+     * @param match Filter verdict
+     * @return true if allowed
      */
-    bool ip_matches_rule(const IpAddress& ip_address, const IpFilterRule& rule);
+    bool apply_mac_filter_match(FilterMatch match);
     
     /**
-     * @brief Update rate limit tracker
-     * @param identifier Identifier
-     * @param identifier_type Identifier type
-     * @return true if within limits
+     * @brief Record the outcome of a rate limit check
+     * @param verdict Limiter verdict
+     * @param identifier Identifier for the security event
+     * @return true if the request may proceed
      */
-    bool update_rate_limit_tracker(const std::string& identifier, const std::string& identifier_type);
+    bool apply_rate_limit_verdict(RateLimitVerdict verdict, const std::string& identifier);
     
     /**
      * @brief Generate authentication hash
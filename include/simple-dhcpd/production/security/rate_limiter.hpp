@@ -0,0 +1,175 @@
+/**
+ * @file production/security/rate_limiter.hpp
+ * @brief Token-bucket rate limiter with a fixed-size, sharded tracker table
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_RATE_LIMITER_HPP
+#define SIMPLE_DHCPD_RATE_LIMITER_HPP
+
+#include "simple-dhcpd/core/types.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+struct RateLimitRule;
+
+/**
+ * @brief Outcome of a rate limit check
+ */
+enum class RateLimitVerdict {
+    UNLIMITED,   ///< No enabled, unexpired rule applies
+    ALLOWED,     ///< A token was available
+    EXCEEDED,    ///< Bucket empty; the block window starts now
+    BLOCKED      ///< Still inside a block window
+};
+
+/**
+ * @brief Per-client rate limiting with bounded memory
+ *
+ * Each rule becomes a token bucket holding max_requests tokens that refill
+ * evenly over time_window, tracked with the generic cell rate algorithm:
+ * a client's whole state is the time its bucket will be full again plus
+ * the end of its block window. Clients are keyed by a 64-bit binary key
+ * (MAC or IPv4 address, or a hash for other identifier types).
+ *
+ * State lives in a fixed number of 8-way sets split across independently
+ * locked shards. A new client takes an empty or refilled slot of its set;
+ * when every slot holds live state, the one closest to refilled is evicted,
+ * so a flood of spoofed clients costs a bounded table and evicts idle
+ * clients before active or blocked ones.
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /** Default number of tracked clients */
+    static constexpr size_t kDefaultCapacity = 65536;
+
+    /**
+     * @brief Constructor
+     * @param capacity Clients tracked at once, rounded up to whole sets
+     */
+    explicit RateLimiter(size_t capacity = kDefaultCapacity);
+
+    /**
+     * @brief Replace the rules; safe while checks are running
+     * @param rules Rules in priority order; for a client the first enabled
+     *              rule naming it or "*" for its type applies
+     */
+    void set_rules(const std::vector<RateLimitRule>& rules);
+
+    /**
+     * @brief Count a request from a client MAC address
+     * @param mac_address Client MAC address
+     * @param now Current time
+     * @return Verdict
+     */
+    RateLimitVerdict check(const MacAddress& mac_address, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Count a request from an identifier of any type
+     * @param identifier MAC address, IP address or interface name
+     * @param identifier_type "mac", "ip" or another type name
+     * @param now Current time
+     * @return Verdict
+     */
+    RateLimitVerdict check(const std::string& identifier, const std::string& identifier_type,
+                           Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Forget all tracked clients; rules are kept
+     */
+    void clear();
+
+    /**
+     * @brief Get number of clients with tracked state
+     * @return Occupied slots
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get number of clients that can be tracked at once
+     * @return Slot count
+     */
+    size_t capacity() const { return shard_count_ * sets_per_shard_ * kWays; }
+
+    /**
+     * @brief Get number of clients whose live state was evicted for another
+     * @return Eviction count
+     */
+    uint64_t evictions() const { return evictions_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get binary key for a MAC address
+     * @param mac_address MAC address
+     * @return Key
+     */
+    static uint64_t mac_key(const MacAddress& mac_address);
+
+    /**
+     * @brief Get binary key for an identifier
+     * @param identifier Identifier text
+     * @param identifier_type Identifier type
+     * @return Key; MAC and IP identifiers map to the same key as their binary form
+     */
+    static uint64_t identifier_key(const std::string& identifier, const std::string& identifier_type);
+
+private:
+    static constexpr size_t kWays = 8;
+    static constexpr size_t kShards = 16;
+
+    struct Limit {
+        int64_t interval_ns;     // time to earn one token
+        int64_t tolerance_ns;    // interval * (burst - 1)
+        int64_t block_ns;
+        bool deny_all;           // max_requests == 0
+        std::chrono::system_clock::time_point expires;
+    };
+
+    struct RuleSet {
+        std::unordered_map<uint64_t, uint32_t> exact;    // key -> first rule
+        std::unordered_map<std::string, uint32_t> wildcard;  // type -> first "*" rule
+        std::vector<Limit> limits;                       // by rule position
+    };
+
+    struct Entry {
+        uint64_t key;            // 0 = empty
+        int64_t tat_ns;          // theoretical arrival time: bucket full again
+        int64_t blocked_until_ns;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;   // sets_per_shard_ * kWays
+    };
+
+    std::shared_ptr<const RuleSet> rules_;
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_count_;
+    size_t sets_per_shard_;
+    std::atomic<uint64_t> evictions_;
+
+    /**
+     * @brief Find the limit for a key under the current rules
+     * @return Limit, nullptr if none applies
+     */
+    const Limit* resolve(const RuleSet& rules, uint64_t key, const std::string& identifier_type) const;
+
+    /**
+     * @brief Apply a limit to a key's bucket
+     */
+    RateLimitVerdict consume(uint64_t key, const Limit& limit, Clock::time_point now);
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_RATE_LIMITER_HPP
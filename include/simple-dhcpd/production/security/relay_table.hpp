@@ -0,0 +1,118 @@
+/**
+ * @file production/security/relay_table.hpp
+ * @brief Compiled Option 82 rules and trusted relay agents for lock-free lookups
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#ifndef SIMPLE_DHCPD_RELAY_TABLE_HPP
+#define SIMPLE_DHCPD_RELAY_TABLE_HPP
+
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simple_dhcpd {
+
+struct Option82Rule;
+struct TrustedRelayAgent;
+
+/**
+ * @brief Sub-options of a Relay Agent Information option (RFC 3046)
+ *
+ * The views point into the option data, which must outlive them.
+ */
+struct RelayAgentOption {
+    ByteView circuit_id;        ///< Sub-option 1
+    ByteView remote_id;         ///< Sub-option 2
+    bool has_circuit_id = false;
+    bool has_remote_id = false;
+
+    /**
+     * @brief Find the circuit and remote IDs in option 82 data
+     * @param data Option data, without the option code and length
+     * @param option Receives views of the sub-options found
+     * @return true if both a circuit ID and a remote ID are present
+     *
+     * A sub-option running past the end of the data ends the scan; the
+     * sub-options before it still count.
+     */
+    static bool parse(ByteView data, RelayAgentOption& option);
+};
+
+/**
+ * @brief Option 82 rules and trusted relay agents compiled for lookup
+ *
+ * Rules are indexed by interface, each interface remembering the position
+ * of its first enabled rule; a lookup takes the lower of that and the
+ * first "*" rule, so the answer is the same as scanning the rules in
+ * order. Trusted agents are indexed by a hash of their circuit and remote
+ * IDs and compared byte for byte against views of the packet.
+ *
+ * A table is immutable once built; the security manager builds a new one
+ * whenever rules or agents change and publishes it atomically.
+ */
+class RelayAgentTable {
+public:
+    /**
+     * @brief Build an empty table
+     */
+    RelayAgentTable() = default;
+
+    /**
+     * @brief Compile rules and agents
+     * @param rules Rules in priority order; disabled rules are skipped
+     * @param agents Trusted relay agents; disabled agents are skipped
+     */
+    RelayAgentTable(const std::vector<Option82Rule>& rules, const std::vector<TrustedRelayAgent>& agents);
+
+    /**
+     * @brief Check whether Option 82 is required on an interface
+     * @param interface_name Receiving interface
+     * @return Required flag of the first enabled rule for the interface or "*"; false without one
+     */
+    bool required(const std::string& interface_name) const;
+
+    /**
+     * @brief Check whether a relay agent is trusted
+     * @param circuit_id Circuit ID as sent
+     * @param remote_id Remote ID as sent
+     * @return true if an enabled agent has exactly these IDs
+     */
+    bool trusts(ByteView circuit_id, ByteView remote_id) const;
+
+    /**
+     * @brief Check whether any trusted agent was compiled
+     * @return true if relayed packets are checked against trusted agents
+     */
+    bool has_trusted_agents() const { return !agents_.empty(); }
+
+    /**
+     * @brief Hash a circuit and remote ID pair
+     * @param circuit_id Circuit ID
+     * @param remote_id Remote ID
+     * @return FNV-1a over both IDs, with the circuit ID's length between them
+     */
+    static uint64_t agent_key(ByteView circuit_id, ByteView remote_id);
+
+private:
+    static constexpr uint32_t kNoRule = 0xFFFFFFFFu;
+
+    struct Agent {
+        std::string circuit_id;
+        std::string remote_id;
+    };
+
+    std::vector<bool> rule_required_;                        // by rule position
+    std::unordered_map<std::string, uint32_t> interfaces_;   // interface -> first rule position
+    uint32_t wildcard_ = kNoRule;                            // first "*" rule position
+    std::vector<Agent> agents_;
+    std::unordered_multimap<uint64_t, uint32_t> agent_index_;   // agent_key() -> agents_ position
+};
+
+} // namespace simple_dhcpd
+
+#endif // SIMPLE_DHCPD_RELAY_TABLE_HPP
@@ -0,0 +1,758 @@
+/**
+ * @file bench.cpp
+ * @brief Load generator driving a running DHCP server over the wire
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ *
+ * Simulates many clients acting as if behind one relay agent: each client
+ * runs DISCOVER/OFFER/REQUEST/ACK, optionally renews, then releases its
+ * address and starts over. Messages carry the bench's own address as
+ * giaddr, so the server answers at giaddr port 67 and one socket sees every
+ * reply; the server and the bench therefore need different local addresses
+ * (e.g. the server on 127.0.0.1 and the bench on 127.0.0.2).
+ *
+ * With --replay it instead feeds the DHCP datagrams of a pcap capture
+ * straight into a DhcpServer built in this process, bypassing the sockets,
+ * and reports throughput, replies and handling latency per message type.
+ */
+
+#include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/message_view.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
+#include "simple-dhcpd/core/network/udp_socket.hpp"
+#include "simple-dhcpd/core/network/pcap_reader.hpp"
+#include "simple-dhcpd/core/server.hpp"
+#include "simple-dhcpd/core/utils/latency_histogram.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace simple_dhcpd;
+
+namespace {
+
+std::atomic<bool> g_running{true};
+
+/**
+ * @brief Command line settings
+ */
+struct BenchOptions {
+    std::string server = "127.0.0.1";
+    uint16_t server_port = 67;
+    std::string relay = "127.0.0.2";
+    size_t clients = 1000;
+    double rate = 1000.0;
+    int duration_seconds = 10;
+    size_t threads = 1;
+    unsigned renewals = 1;
+    bool release = true;
+    int timeout_ms = 1000;
+    std::string replay_file;    // set: replay this capture instead of driving a server
+    std::string config_file;    // configuration of the replay server
+    double speed = 0.0;         // replay pacing relative to the capture; 0 = as fast as possible
+};
+
+/**
+ * @brief Where a simulated client is in its exchange
+ *
+ * BUSY marks a client one thread is updating; whoever moves a client into
+ * BUSY owns its fields until it stores the next state.
+ */
+enum class ClientState : uint8_t {
+    IDLE,
+    SELECTING,    ///< DISCOVER sent
+    REQUESTING,   ///< REQUEST for the offered address sent
+    BOUND,
+    RENEWING,     ///< Renewal REQUEST sent
+    BUSY
+};
+
+struct SimulatedClient {
+    std::atomic<uint8_t> state{static_cast<uint8_t>(ClientState::IDLE)};
+    MacAddress mac{};
+    uint32_t xid = 0;              // generation in the top byte, client index below
+    uint8_t generation = 0;
+    unsigned renewals_done = 0;
+    IpAddress address = 0;         // network byte order
+    std::vector<uint8_t> server_id;
+    int64_t sent_ns = 0;           // last request of the current stage
+    int64_t started_ns = 0;        // DISCOVER of the current lease
+};
+
+/**
+ * @brief Exchange stages reported separately
+ */
+enum class Stage : size_t {
+    DISCOVER,   ///< DISCOVER until OFFER
+    REQUEST,    ///< REQUEST until ACK
+    RENEW,      ///< Renewal REQUEST until ACK
+    RELEASE,    ///< RELEASE, which has no answer
+    COUNT
+};
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::DISCOVER: return "discover-offer";
+        case Stage::REQUEST: return "request-ack";
+        case Stage::RENEW: return "renew-ack";
+        case Stage::RELEASE: return "release";
+        default: return "unknown";
+    }
+}
+
+struct StageStats {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> answered{0};
+    std::atomic<uint64_t> naks{0};
+    std::atomic<uint64_t> lost{0};
+    LatencyHistogram latency;
+};
+
+/** Clients are numbered in the low 24 bits of the transaction ID */
+constexpr size_t kMaxClients = 1u << 24;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Runs and measures the simulated clients
+ */
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const BenchOptions& options)
+        : options_(options), clients_(new SimulatedClient[options.clients]), socket_(options.relay, 67),
+          relay_ip_(inet_addr(options.relay.c_str())), stalled_(0), unexpected_(0), received_(0) {
+        for (size_t i = 0; i < options_.clients; ++i) {
+            // Locally administered MACs, unique per client index
+            clients_[i].mac = {0x02, 0xbe, static_cast<uint8_t>(i >> 24), static_cast<uint8_t>(i >> 16),
+                               static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i)};
+        }
+        socket_.set_socket_option(SO_RCVBUF, 4 << 20);
+        socket_.bind();
+    }
+
+    /**
+     * @brief Run the load for the configured duration and wait for late replies
+     */
+    void run() {
+        socket_.start_receiving(PacketCallback([this](const PacketBuffer& packet) { on_reply(packet); }));
+
+        start_ns_ = now_ns();
+        const int64_t end_ns = start_ns_ + static_cast<int64_t>(options_.duration_seconds) * 1000000000;
+        std::vector<std::thread> senders;
+        for (size_t t = 0; t < options_.threads; ++t) {
+            senders.emplace_back(&LoadGenerator::send_loop, this, t, end_ns);
+        }
+        for (auto& sender : senders) {
+            sender.join();
+        }
+        stop_ns_ = now_ns();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(options_.timeout_ms));
+        socket_.stop_receiving();
+
+        // Whatever is still in flight did not get an answer in time
+        for (size_t i = 0; i < options_.clients; ++i) {
+            switch (static_cast<ClientState>(clients_[i].state.load())) {
+                case ClientState::SELECTING: stage(Stage::DISCOVER).lost++; break;
+                case ClientState::REQUESTING: stage(Stage::REQUEST).lost++; break;
+                case ClientState::RENEWING: stage(Stage::RENEW).lost++; break;
+                default: break;
+            }
+        }
+    }
+
+    /**
+     * @brief Print the results table
+     */
+    void report() const {
+        const double seconds = static_cast<double>(stop_ns_ - start_ns_) / 1e9;
+        uint64_t sent = 0;
+        uint64_t answered = 0;
+        for (size_t i = 0; i < static_cast<size_t>(Stage::COUNT); ++i) {
+            sent += stages_[i].sent.load();
+            answered += stages_[i].answered.load();
+        }
+
+        std::printf("Clients %zu, threads %zu, target %.0f/s, %.1f s\n",
+                    options_.clients, options_.threads, options_.rate, seconds);
+        std::printf("Sent %.0f msg/s, received %.0f msg/s, completed DORA %.0f/s\n",
+                    static_cast<double>(sent) / seconds, static_cast<double>(received_.load()) / seconds,
+                    static_cast<double>(dora_.count()) / seconds);
+        if (stalled_.load() > 0) {
+            std::printf("Rate not reached: %llu sends had no idle client; add clients\n",
+                        static_cast<unsigned long long>(stalled_.load()));
+        }
+        if (unexpected_.load() > 0) {
+            std::printf("Ignored %llu late or unmatched replies\n",
+                        static_cast<unsigned long long>(unexpected_.load()));
+        }
+
+        std::printf("\n%-15s %10s %10s %6s %8s %7s %9s %9s %9s %9s %9s\n", "stage", "sent", "answered", "nak",
+                    "lost", "loss%", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+        for (size_t i = 0; i < static_cast<size_t>(Stage::COUNT); ++i) {
+            const StageStats& stats = stages_[i];
+            const uint64_t stage_sent = stats.sent.load();
+            const bool answers = static_cast<Stage>(i) != Stage::RELEASE;
+            const double loss = stage_sent && answers ? 100.0 * static_cast<double>(stats.lost.load()) /
+                                                        static_cast<double>(stage_sent) : 0.0;
+            std::printf("%-15s %10llu %10llu %6llu %8llu %6.2f%%", stage_name(static_cast<Stage>(i)),
+                        static_cast<unsigned long long>(stage_sent),
+                        static_cast<unsigned long long>(stats.answered.load()),
+                        static_cast<unsigned long long>(stats.naks.load()),
+                        static_cast<unsigned long long>(stats.lost.load()), loss);
+            print_percentiles(stats.latency, answers);
+        }
+        std::printf("%-15s %10s %10llu %6s %8s %7s", "dora", "",
+                    static_cast<unsigned long long>(dora_.count()), "", "", "");
+        print_percentiles(dora_, true);
+    }
+
+private:
+    BenchOptions options_;
+    std::unique_ptr<SimulatedClient[]> clients_;
+    UdpSocket socket_;
+    IpAddress relay_ip_;
+    StageStats stages_[static_cast<size_t>(Stage::COUNT)];
+    LatencyHistogram dora_;
+    std::atomic<uint64_t> stalled_;
+    std::atomic<uint64_t> unexpected_;
+    std::atomic<uint64_t> received_;
+    int64_t start_ns_ = 0;
+    int64_t stop_ns_ = 0;
+
+    StageStats& stage(Stage which) { return stages_[static_cast<size_t>(which)]; }
+
+    static void print_percentiles(const LatencyHistogram& histogram, bool answers) {
+        if (!answers || histogram.count() == 0) {
+            std::printf("\n");
+            return;
+        }
+        std::printf(" %9.1f %9.1f %9.1f %9.1f %9.1f\n", histogram.percentile(0.5) / 1e3,
+                    histogram.percentile(0.9) / 1e3, histogram.percentile(0.99) / 1e3,
+                    histogram.percentile(0.999) / 1e3, histogram.max() / 1e3);
+    }
+
+    static bool acquire(SimulatedClient& client, ClientState from) {
+        uint8_t expected = static_cast<uint8_t>(from);
+        return client.state.compare_exchange_strong(expected, static_cast<uint8_t>(ClientState::BUSY),
+                                                    std::memory_order_acq_rel);
+    }
+
+    static void publish(SimulatedClient& client, ClientState to) {
+        client.state.store(static_cast<uint8_t>(to), std::memory_order_release);
+    }
+
+    /**
+     * @brief Encode a client message as a relay agent would forward it
+     * @return View into the per-thread encode buffer
+     */
+    ByteView encode(DhcpMessageType type, const SimulatedClient& client, bool selecting) {
+        thread_local DhcpMessageBuilder builder;
+        builder.reset()
+               .set_message_type(type)
+               .set_transaction_id(client.xid)
+               .set_client_mac(client.mac)
+               .set_relay_ip(relay_ip_);
+        if (type == DhcpMessageType::REQUEST && selecting) {
+            builder.add_option_ip(DhcpOptionCode::REQUESTED_IP_ADDRESS, ntohl(client.address));
+            builder.add_option(DhcpOptionCode::SERVER_IDENTIFIER, client.server_id);
+        } else if (type != DhcpMessageType::DISCOVER) {
+            builder.set_client_ip(client.address);
+            if (type == DhcpMessageType::RELEASE) {
+                builder.add_option(DhcpOptionCode::SERVER_IDENTIFIER, client.server_id);
+            }
+        }
+        DhcpMessage message = builder.build();
+        message.header.op = 1;     // BOOTREQUEST
+        message.header.hops = 1;
+        return DhcpMessageWriter::encode(message);
+    }
+
+    void send(ByteView message) {
+        try {
+            socket_.send_to(message.data(), message.size(), options_.server, options_.server_port);
+        } catch (const UdpSocketException& e) {
+            std::cerr << "Send failed: " << e.what() << std::endl;
+        }
+    }
+
+    /**
+     * @brief Start a new transaction for a client this thread owns
+     */
+    void begin(SimulatedClient& client, size_t index, DhcpMessageType type, Stage which, ClientState next) {
+        if (type != DhcpMessageType::RELEASE) {
+            client.generation++;
+            client.xid = (static_cast<uint32_t>(client.generation) << 24) | static_cast<uint32_t>(index);
+        }
+        const ByteView message = encode(type, client, false);
+        client.sent_ns = now_ns();
+        if (type == DhcpMessageType::DISCOVER) {
+            client.started_ns = client.sent_ns;
+            client.renewals_done = 0;
+        }
+        publish(client, next);
+        send(message);
+        stage(which).sent++;
+    }
+
+    /**
+     * @brief Give the next ready client of this thread its next message
+     * @return false if every client of the thread is waiting for an answer
+     */
+    bool step(size_t thread, size_t& cursor, int64_t timeout_ns) {
+        const size_t owned = (options_.clients - thread + options_.threads - 1) / options_.threads;
+        for (size_t scanned = 0; scanned < owned; ++scanned) {
+            const size_t index = thread + cursor * options_.threads;
+            cursor = (cursor + 1) % owned;
+            SimulatedClient& client = clients_[index];
+
+            const auto state = static_cast<ClientState>(client.state.load(std::memory_order_acquire));
+            if (state == ClientState::BUSY || !acquire(client, state)) {
+                continue;
+            }
+            switch (state) {
+                case ClientState::SELECTING:
+                case ClientState::REQUESTING:
+                case ClientState::RENEWING:
+                    if (now_ns() - client.sent_ns < timeout_ns) {
+                        publish(client, state);
+                        continue;
+                    }
+                    stage(state == ClientState::SELECTING ? Stage::DISCOVER
+                          : state == ClientState::REQUESTING ? Stage::REQUEST : Stage::RENEW).lost++;
+                    begin(client, index, DhcpMessageType::DISCOVER, Stage::DISCOVER, ClientState::SELECTING);
+                    return true;
+                case ClientState::BOUND:
+                    if (client.renewals_done < options_.renewals) {
+                        begin(client, index, DhcpMessageType::REQUEST, Stage::RENEW, ClientState::RENEWING);
+                    } else if (options_.release) {
+                        begin(client, index, DhcpMessageType::RELEASE, Stage::RELEASE, ClientState::IDLE);
+                    } else {
+                        begin(client, index, DhcpMessageType::DISCOVER, Stage::DISCOVER, ClientState::SELECTING);
+                    }
+                    return true;
+                case ClientState::IDLE:
+                default:
+                    begin(client, index, DhcpMessageType::DISCOVER, Stage::DISCOVER, ClientState::SELECTING);
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Sender thread: paces this thread's share of the target rate
+     */
+    void send_loop(size_t thread, int64_t end_ns) {
+        if (thread >= options_.clients) {
+            return;
+        }
+        const double per_ns = options_.rate / static_cast<double>(options_.threads) / 1e9;
+        const int64_t timeout_ns = static_cast<int64_t>(options_.timeout_ms) * 1000000;
+        size_t cursor = 0;
+        uint64_t actions = 0;
+        for (int64_t now = now_ns(); now < end_ns && g_running.load(); now = now_ns()) {
+            const uint64_t due = static_cast<uint64_t>(static_cast<double>(now - start_ns_) * per_ns);
+            if (actions >= due) {
+                const int64_t next = start_ns_ + static_cast<int64_t>(static_cast<double>(actions + 1) / per_ns);
+                std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<int64_t>(next - now, 1000000)));
+                continue;
+            }
+            if (!step(thread, cursor, timeout_ns)) {
+                stalled_++;
+            }
+            actions++;
+        }
+    }
+
+    /**
+     * @brief Receive loop: match a reply to its client and move it on
+     */
+    void on_reply(const PacketBuffer& packet) {
+        received_++;
+        const int64_t now = now_ns();
+        DhcpMessageView reply;
+        try {
+            reply = DhcpMessageView(packet.data(), packet.size());
+        } catch (const DhcpParserException&) {
+            unexpected_++;
+            return;
+        }
+        const size_t index = reply.xid() & (kMaxClients - 1);
+        if (index >= options_.clients) {
+            unexpected_++;
+            return;
+        }
+        SimulatedClient& client = clients_[index];
+
+        ClientState state;
+        if (reply.message_type() == DhcpMessageType::OFFER) {
+            state = ClientState::SELECTING;
+        } else if (reply.message_type() == DhcpMessageType::ACK || reply.message_type() == DhcpMessageType::NAK) {
+            state = static_cast<ClientState>(client.state.load(std::memory_order_acquire));
+            if (state != ClientState::REQUESTING && state != ClientState::RENEWING) {
+                unexpected_++;
+                return;
+            }
+        } else {
+            unexpected_++;
+            return;
+        }
+        if (!acquire(client, state)) {
+            unexpected_++;
+            return;
+        }
+        if (client.xid != reply.xid()) {
+            publish(client, state);
+            unexpected_++;
+            return;
+        }
+
+        const Stage which = state == ClientState::SELECTING ? Stage::DISCOVER
+                            : state == ClientState::REQUESTING ? Stage::REQUEST : Stage::RENEW;
+        StageStats& stats = stage(which);
+        stats.answered++;
+        stats.latency.record(static_cast<uint64_t>(now - client.sent_ns));
+
+        if (reply.message_type() == DhcpMessageType::NAK) {
+            stats.naks++;
+            publish(client, ClientState::IDLE);
+            return;
+        }
+        if (state == ClientState::SELECTING) {
+            client.address = reply.header().yiaddr;
+            const ByteView server_id = reply.option_data(DhcpOptionCode::SERVER_IDENTIFIER);
+            client.server_id.assign(server_id.begin(), server_id.end());
+            const ByteView request = encode(DhcpMessageType::REQUEST, client, true);
+            client.sent_ns = now_ns();
+            publish(client, ClientState::REQUESTING);
+            send(request);
+            stage(Stage::REQUEST).sent++;
+            return;
+        }
+        if (state == ClientState::REQUESTING) {
+            dora_.record(static_cast<uint64_t>(now - client.started_ns));
+        } else {
+            client.renewals_done++;
+        }
+        publish(client, ClientState::BOUND);
+    }
+};
+
+/**
+ * @brief Replays a capture into an in-process server and measures it
+ *
+ * Datagrams are handled one at a time in capture order on this thread, so
+ * retransmissions and the lease state they depend on line up with the
+ * capture. The latency of a message is the time handle_dhcp_message takes
+ * for it, reply encoding included.
+ */
+class CaptureReplayer {
+public:
+    explicit CaptureReplayer(const BenchOptions& options)
+        : options_(options), server_(options.config_file), current_(nullptr) {
+        server_.enable_replay([this](ByteView packet, const ReplyRoute&) { on_reply(packet); });
+        server_.initialize();
+        // Per-packet warnings and errors would swamp the report and the timings;
+        // the silent column counts the messages they are about
+        get_logger().set_level(LogLevel::FATAL);
+    }
+
+    /**
+     * @brief Replay the whole capture, or until interrupted
+     * @throws PcapReaderException if the capture cannot be read
+     */
+    void run() {
+        PcapReader reader(options_.replay_file);
+        PcapDatagram datagram;
+        PacketBuffer packet;
+        packet.peer().sin_family = AF_INET;
+        uint64_t first_capture_ns = 0;
+
+        start_ns_ = now_ns();
+        while (g_running.load() && reader.next(datagram)) {
+            if (datagram.destination_port != options_.server_port || datagram.payload.size() > packet.capacity()) {
+                other_datagrams_++;
+                continue;
+            }
+            if (options_.speed > 0) {
+                if (first_capture_ns == 0) {
+                    first_capture_ns = datagram.timestamp_ns;
+                }
+                const double offset_ns = static_cast<double>(datagram.timestamp_ns - first_capture_ns) / options_.speed;
+                const int64_t due = start_ns_ + static_cast<int64_t>(offset_ns);
+                const int64_t now = now_ns();
+                if (due > now) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+                }
+            }
+
+            std::memcpy(packet.data(), datagram.payload.data(), datagram.payload.size());
+            packet.set_size(datagram.payload.size());
+            packet.peer().sin_addr.s_addr = datagram.source;
+            packet.peer().sin_port = htons(datagram.source_port);
+
+            TypeStats& stats = type_stats(packet);
+            stats.messages++;
+            current_ = &stats;
+            const int64_t begin = now_ns();
+            server_.replay_packet(packet);
+            stats.latency.record(static_cast<uint64_t>(now_ns() - begin));
+            current_ = nullptr;
+        }
+        stop_ns_ = now_ns();
+        skipped_frames_ = reader.skipped();
+    }
+
+    /**
+     * @brief Print the results table
+     */
+    void report() const {
+        const double seconds = std::max(static_cast<double>(stop_ns_ - start_ns_) / 1e9, 1e-9);
+        uint64_t messages = 0;
+        for (const TypeStats& stats : stats_) {
+            messages += stats.messages;
+        }
+        std::printf("Replayed %llu messages from %s in %.3f s, %.0f msg/s (%s)\n",
+                    static_cast<unsigned long long>(messages), options_.replay_file.c_str(), seconds,
+                    static_cast<double>(messages) / seconds,
+                    options_.speed > 0 ? "capture timing" : "as fast as possible");
+        if (skipped_frames_ > 0 || other_datagrams_ > 0) {
+            std::printf("Skipped %llu frames that are not IPv4 UDP and %llu datagrams not for port %u\n",
+                        static_cast<unsigned long long>(skipped_frames_),
+                        static_cast<unsigned long long>(other_datagrams_), options_.server_port);
+        }
+
+        std::printf("\n%-9s %10s %10s %8s %8s %8s %8s %9s %9s %9s %9s %9s\n", "type", "messages", "msg/s",
+                    "offer", "ack", "nak", "silent", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+        for (size_t i = 0; i < kTypeSlots; ++i) {
+            const TypeStats& stats = stats_[i];
+            if (stats.messages == 0) {
+                continue;
+            }
+            std::printf("%-9s %10llu %10.0f %8llu %8llu %8llu %8llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                        type_name(i), static_cast<unsigned long long>(stats.messages),
+                        static_cast<double>(stats.messages) / seconds,
+                        static_cast<unsigned long long>(stats.offers),
+                        static_cast<unsigned long long>(stats.acks),
+                        static_cast<unsigned long long>(stats.naks),
+                        static_cast<unsigned long long>(stats.silent()),
+                        stats.latency.percentile(0.5) / 1e3, stats.latency.percentile(0.9) / 1e3,
+                        stats.latency.percentile(0.99) / 1e3, stats.latency.percentile(0.999) / 1e3,
+                        stats.latency.max() / 1e3);
+        }
+    }
+
+private:
+    /** Slot 0 holds messages without a valid type; slots 1 to 8 follow DhcpMessageType */
+    static constexpr size_t kTypeSlots = static_cast<size_t>(DhcpMessageType::INFORM) + 1;
+
+    struct TypeStats {
+        uint64_t messages = 0;
+        uint64_t offers = 0;
+        uint64_t acks = 0;
+        uint64_t naks = 0;
+        uint64_t replies = 0;
+        LatencyHistogram latency;
+
+        uint64_t silent() const { return messages > replies ? messages - replies : 0; }
+    };
+
+    BenchOptions options_;
+    DhcpServer server_;
+    TypeStats stats_[kTypeSlots];
+    TypeStats* current_;     // message being handled, credited with its replies
+    uint64_t other_datagrams_ = 0;
+    uint64_t skipped_frames_ = 0;
+    int64_t start_ns_ = 0;
+    int64_t stop_ns_ = 0;
+
+    static const char* type_name(size_t slot) {
+        static const char* const names[kTypeSlots] = {"invalid", "discover", "offer", "request", "decline",
+                                                      "ack", "nak", "release", "inform"};
+        return names[slot];
+    }
+
+    TypeStats& type_stats(const PacketBuffer& packet) {
+        try {
+            const size_t type = static_cast<size_t>(DhcpMessageView(packet.data(), packet.size()).message_type());
+            return stats_[type < kTypeSlots ? type : 0];
+        } catch (const DhcpParserException&) {
+            return stats_[0];
+        }
+    }
+
+    void on_reply(ByteView packet) {
+        if (!current_) {
+            return;
+        }
+        current_->replies++;
+        try {
+            switch (DhcpMessageView(packet.data(), packet.size()).message_type()) {
+                case DhcpMessageType::OFFER: current_->offers++; break;
+                case DhcpMessageType::ACK: current_->acks++; break;
+                case DhcpMessageType::NAK: current_->naks++; break;
+                default: break;
+            }
+        } catch (const DhcpParserException&) {
+        }
+    }
+};
+
+void signal_handler(int) {
+    g_running = false;
+}
+
+/**
+ * @brief Print usage information
+ * @param program_name Program name
+ */
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [OPTIONS]\n"
+              << "Drives a running simple-dhcpd with simulated relayed clients.\n"
+              << "Options:\n"
+              << "  -s, --server ADDR      Server address (default 127.0.0.1)\n"
+              << "  -p, --port PORT        Server port (default 67)\n"
+              << "  -l, --relay ADDR       Local address used as giaddr; replies come back to\n"
+              << "                         it on port 67 (default 127.0.0.2)\n"
+              << "  -n, --clients N        Simulated clients (default 1000)\n"
+              << "  -r, --rate R           Client messages started per second (default 1000)\n"
+              << "  -d, --duration SEC     Run time (default 10)\n"
+              << "  -t, --threads N        Sending threads (default 1)\n"
+              << "  -R, --renewals N       Renewals per lease before release (default 1)\n"
+              << "      --no-release       Start over with DISCOVER instead of releasing\n"
+              << "  -w, --timeout MS       Wait for an answer before counting it lost (default 1000)\n"
+              << "      --replay FILE      Replay the DHCP datagrams of a pcap capture into an\n"
+              << "                         in-process server instead (no sockets, no lease files)\n"
+              << "  -c, --config FILE      Server configuration for --replay (default built-in)\n"
+              << "      --speed X          Replay at X times the captured pace; 0 replays as fast\n"
+              << "                         as possible (default 0). -p selects the server port\n"
+              << "  -h, --help             Show this help message\n"
+              << std::endl;
+}
+
+/**
+ * @brief Parse a numeric option value
+ * @return false (after printing why) if the value is missing or not a number
+ */
+template <typename T>
+bool parse_number(int argc, char* argv[], int& i, T& value) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+        std::cerr << "Error: " << arg << " requires a value" << std::endl;
+        return false;
+    }
+    try {
+        size_t used = 0;
+        const double parsed = std::stod(argv[++i], &used);
+        if (used != std::strlen(argv[i]) || parsed < 0) {
+            throw std::invalid_argument(argv[i]);
+        }
+        value = static_cast<T>(parsed);
+    } catch (const std::exception&) {
+        std::cerr << "Error: invalid value for " << arg << ": " << argv[i] << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Main function
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return Exit code
+ */
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        bool ok = true;
+
+        if ((arg == "-s" || arg == "--server" || arg == "-l" || arg == "--relay") && i + 1 < argc) {
+            (arg == "-s" || arg == "--server" ? options.server : options.relay) = argv[++i];
+        } else if (arg == "-p" || arg == "--port") {
+            ok = parse_number(argc, argv, i, options.server_port);
+        } else if (arg == "-n" || arg == "--clients") {
+            ok = parse_number(argc, argv, i, options.clients);
+        } else if (arg == "-r" || arg == "--rate") {
+            ok = parse_number(argc, argv, i, options.rate);
+        } else if (arg == "-d" || arg == "--duration") {
+            ok = parse_number(argc, argv, i, options.duration_seconds);
+        } else if (arg == "-t" || arg == "--threads") {
+            ok = parse_number(argc, argv, i, options.threads);
+        } else if (arg == "-R" || arg == "--renewals") {
+            ok = parse_number(argc, argv, i, options.renewals);
+        } else if (arg == "--no-release") {
+            options.release = false;
+        } else if (arg == "-w" || arg == "--timeout") {
+            ok = parse_number(argc, argv, i, options.timeout_ms);
+        } else if ((arg == "--replay" || arg == "-c" || arg == "--config") && i + 1 < argc) {
+            (arg == "--replay" ? options.replay_file : options.config_file) = argv[++i];
+        } else if (arg == "--speed") {
+            ok = parse_number(argc, argv, i, options.speed);
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Error: Unknown option or missing value: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (!ok) {
+            return 1;
+        }
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    if (!options.replay_file.empty()) {
+        try {
+            CaptureReplayer replayer(options);
+            replayer.run();
+            replayer.report();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (options.clients == 0 || options.clients > kMaxClients || options.threads == 0 ||
+        options.rate <= 0 || options.duration_seconds <= 0) {
+        std::cerr << "Error: need 1 to " << kMaxClients << " clients, at least one thread, "
+                  << "and a positive rate and duration" << std::endl;
+        return 1;
+    }
+    if (inet_addr(options.relay.c_str()) == INADDR_NONE) {
+        std::cerr << "Error: relay address must be an IPv4 address" << std::endl;
+        return 1;
+    }
+
+    try {
+        LoadGenerator generator(options);
+        generator.run();
+        generator.report();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
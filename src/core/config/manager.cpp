@@ -148,10 +148,54 @@ void ConfigManager::save_config(const std::string& config_file) const {
     
     // Performance settings
     root["dhcp"]["performance"]["max_leases"] = static_cast<int>(config_.max_leases);
+    root["dhcp"]["performance"]["worker_threads"] = config_.worker_threads;
+    root["dhcp"]["performance"]["io_batch_size"] = config_.io_batch_size;
+    root["dhcp"]["performance"]["io_flush_timeout_us"] = config_.io_flush_timeout_us;
+    root["dhcp"]["performance"]["event_backend"] = config_.event_backend;
+    root["dhcp"]["performance"]["raw_unicast_replies"] = config_.raw_unicast_replies;
+    root["dhcp"]["performance"]["reply_cache_size"] = config_.reply_cache_size;
+    root["dhcp"]["performance"]["reply_cache_ttl_ms"] = config_.reply_cache_ttl_ms;
+    root["dhcp"]["performance"]["journal_sync"] = config_.lease_journal_sync;
+    root["dhcp"]["performance"]["journal_compact_mb"] = config_.lease_journal_compact_mb;
     
     // Logging settings
     root["dhcp"]["logging"]["enable"] = config_.enable_logging;
     root["dhcp"]["logging"]["log_file"] = config_.log_file;
+    root["dhcp"]["logging"]["async"] = config_.log_async;
+    root["dhcp"]["logging"]["buffer_lines"] = config_.log_buffer_lines;
+    root["dhcp"]["logging"]["flush_interval_ms"] = config_.log_flush_interval_ms;
+    root["dhcp"]["logging"]["overflow"] = config_.log_block_when_full ? "block" : "drop";
+    
+    // Metrics endpoint
+    root["dhcp"]["metrics"]["enabled"] = config_.metrics_enabled;
+    root["dhcp"]["metrics"]["address"] = config_.metrics_address;
+    root["dhcp"]["metrics"]["port"] = config_.metrics_port;
+    
+    // Ping check
+    root["dhcp"]["ping_check"]["enabled"] = config_.ping_check_enabled;
+    root["dhcp"]["ping_check"]["timeout_ms"] = config_.ping_check_timeout_ms;
+    root["dhcp"]["ping_check"]["cache_seconds"] = config_.ping_check_cache_seconds;
+    
+    // Leasequery
+    root["dhcp"]["leasequery"]["enabled"] = config_.leasequery_enabled;
+    root["dhcp"]["leasequery"]["bulk_address"] = config_.bulk_leasequery_address;
+    root["dhcp"]["leasequery"]["bulk_port"] = config_.bulk_leasequery_port;
+    
+    // Failover peer
+    root["dhcp"]["failover"]["peer"] = config_.failover_peer;
+    root["dhcp"]["failover"]["port"] = config_.failover_port;
+    root["dhcp"]["failover"]["role"] = config_.failover_role;
+    root["dhcp"]["failover"]["split"] = config_.failover_split;
+    
+    // Dynamic DNS
+    root["dhcp"]["ddns"]["server"] = config_.ddns_server;
+    root["dhcp"]["ddns"]["port"] = config_.ddns_port;
+    root["dhcp"]["ddns"]["forward_zone"] = config_.ddns_forward_zone;
+    root["dhcp"]["ddns"]["reverse_zone"] = config_.ddns_reverse_zone;
+    root["dhcp"]["ddns"]["ttl"] = config_.ddns_ttl;
+    root["dhcp"]["ddns"]["tsig_key"] = config_.ddns_tsig_key;
+    root["dhcp"]["ddns"]["tsig_secret"] = config_.ddns_tsig_secret;
+    root["dhcp"]["ddns"]["queue_size"] = config_.ddns_queue_size;
     
     // Write to file
     std::ofstream file(config_file);
@@ -190,6 +234,40 @@ void ConfigManager::validate_config() const {
         validate_subnet_config(subnet);
     }
     
+    const std::string& backend = config_.event_backend;
+    if (!backend.empty() && backend != "auto" && backend != "epoll" && backend != "poll") {
+        throw ConfigException("Unknown event backend: " + backend);
+    }
+    
+    if (config_.lease_history_depth == 0) {
+        throw ConfigException("Lease history depth must be at least 1");
+    }
+    
+    if (config_.ping_check_enabled && config_.ping_check_timeout_ms == 0) {
+        throw ConfigException("Ping check timeout must be at least 1 ms");
+    }
+    
+    if (!config_.failover_peer.empty()) {
+        if (config_.failover_role != "primary" && config_.failover_role != "secondary") {
+            throw ConfigException("Failover role must be primary or secondary: " + config_.failover_role);
+        }
+        if (config_.failover_split > 256) {
+            throw ConfigException("Failover split must be between 0 and 256");
+        }
+    }
+    
+    if (!config_.ddns_server.empty()) {
+        if (config_.ddns_forward_zone.empty()) {
+            throw ConfigException("DDNS needs a forward zone");
+        }
+        if (!config_.ddns_tsig_key.empty() && config_.ddns_tsig_secret.empty()) {
+            throw ConfigException("DDNS TSIG key has no secret: " + config_.ddns_tsig_key);
+        }
+        if (config_.ddns_queue_size == 0) {
+            throw ConfigException("DDNS queue size must be at least 1");
+        }
+    }
+    
     LOG_DEBUG("Configuration validation passed");
 }
 
@@ -265,15 +343,30 @@ void ConfigManager::parse_json_config(const std::string& json_config) {
         if (dhcp.isMember("lease_file")) {
             config_.lease_file = dhcp["lease_file"].asString();
         }
+        if (dhcp.isMember("lease_snapshot")) {
+            config_.lease_snapshot = dhcp["lease_snapshot"].asString();
+        }
+        if (dhcp.isMember("lease_journal")) {
+            config_.lease_journal = dhcp["lease_journal"].asString();
+        }
         if (dhcp.isMember("server_identifier")) {
             config_.server_identifier = string_to_ip(dhcp["server_identifier"].asString());
         }
         if (dhcp.isMember("advanced_lease_database")) {
             config_.advanced_lease_database = dhcp["advanced_lease_database"].asString();
         }
+        if (dhcp.isMember("lease_history_depth")) {
+            config_.lease_history_depth = dhcp["lease_history_depth"].asUInt();
+        }
+        if (dhcp.isMember("lease_history_file")) {
+            config_.lease_history_file = dhcp["lease_history_file"].asString();
+        }
         if (dhcp.isMember("decline_hold_seconds")) {
             config_.decline_hold_seconds = static_cast<uint32_t>(dhcp["decline_hold_seconds"].asUInt());
         }
+        if (dhcp.isMember("offer_hold_seconds")) {
+            config_.offer_hold_seconds = static_cast<uint32_t>(dhcp["offer_hold_seconds"].asUInt());
+        }
         
         // Performance settings
         if (dhcp.isMember("performance")) {
@@ -281,6 +374,33 @@ void ConfigManager::parse_json_config(const std::string& json_config) {
             if (performance.isMember("max_leases")) {
                 config_.max_leases = static_cast<uint32_t>(performance["max_leases"].asInt());
             }
+            if (performance.isMember("worker_threads")) {
+                config_.worker_threads = performance["worker_threads"].asUInt();
+            }
+            if (performance.isMember("io_batch_size")) {
+                config_.io_batch_size = performance["io_batch_size"].asUInt();
+            }
+            if (performance.isMember("io_flush_timeout_us")) {
+                config_.io_flush_timeout_us = performance["io_flush_timeout_us"].asUInt();
+            }
+            if (performance.isMember("event_backend")) {
+                config_.event_backend = performance["event_backend"].asString();
+            }
+            if (performance.isMember("raw_unicast_replies")) {
+                config_.raw_unicast_replies = performance["raw_unicast_replies"].asBool();
+            }
+            if (performance.isMember("reply_cache_size")) {
+                config_.reply_cache_size = performance["reply_cache_size"].asUInt();
+            }
+            if (performance.isMember("reply_cache_ttl_ms")) {
+                config_.reply_cache_ttl_ms = performance["reply_cache_ttl_ms"].asUInt();
+            }
+            if (performance.isMember("journal_sync")) {
+                config_.lease_journal_sync = performance["journal_sync"].asBool();
+            }
+            if (performance.isMember("journal_compact_mb")) {
+                config_.lease_journal_compact_mb = performance["journal_compact_mb"].asUInt();
+            }
         }
         
         // Logging settings
@@ -292,6 +412,106 @@ void ConfigManager::parse_json_config(const std::string& json_config) {
             if (logging.isMember("log_file")) {
                 config_.log_file = logging["log_file"].asString();
             }
+            if (logging.isMember("async")) {
+                config_.log_async = logging["async"].asBool();
+            }
+            if (logging.isMember("buffer_lines")) {
+                config_.log_buffer_lines = logging["buffer_lines"].asUInt();
+            }
+            if (logging.isMember("flush_interval_ms")) {
+                config_.log_flush_interval_ms = logging["flush_interval_ms"].asUInt();
+            }
+            if (logging.isMember("overflow")) {
+                config_.log_block_when_full = logging["overflow"].asString() == "block";
+            }
+        }
+
+        // Metrics endpoint
+        if (dhcp.isMember("metrics")) {
+            const Json::Value& metrics = dhcp["metrics"];
+            if (metrics.isMember("enabled")) {
+                config_.metrics_enabled = metrics["enabled"].asBool();
+            }
+            if (metrics.isMember("address")) {
+                config_.metrics_address = metrics["address"].asString();
+            }
+            if (metrics.isMember("port")) {
+                config_.metrics_port = static_cast<uint16_t>(metrics["port"].asUInt());
+            }
+        }
+
+        // Ping check
+        if (dhcp.isMember("ping_check")) {
+            const Json::Value& ping_check = dhcp["ping_check"];
+            if (ping_check.isMember("enabled")) {
+                config_.ping_check_enabled = ping_check["enabled"].asBool();
+            }
+            if (ping_check.isMember("timeout_ms")) {
+                config_.ping_check_timeout_ms = ping_check["timeout_ms"].asUInt();
+            }
+            if (ping_check.isMember("cache_seconds")) {
+                config_.ping_check_cache_seconds = ping_check["cache_seconds"].asUInt();
+            }
+        }
+
+        // Leasequery
+        if (dhcp.isMember("leasequery")) {
+            const Json::Value& leasequery = dhcp["leasequery"];
+            if (leasequery.isMember("enabled")) {
+                config_.leasequery_enabled = leasequery["enabled"].asBool();
+            }
+            if (leasequery.isMember("bulk_address")) {
+                config_.bulk_leasequery_address = leasequery["bulk_address"].asString();
+            }
+            if (leasequery.isMember("bulk_port")) {
+                config_.bulk_leasequery_port = static_cast<uint16_t>(leasequery["bulk_port"].asUInt());
+            }
+        }
+
+        // Failover peer
+        if (dhcp.isMember("failover")) {
+            const Json::Value& failover = dhcp["failover"];
+            if (failover.isMember("peer")) {
+                config_.failover_peer = failover["peer"].asString();
+            }
+            if (failover.isMember("port")) {
+                config_.failover_port = static_cast<uint16_t>(failover["port"].asUInt());
+            }
+            if (failover.isMember("role")) {
+                config_.failover_role = failover["role"].asString();
+            }
+            if (failover.isMember("split")) {
+                config_.failover_split = failover["split"].asUInt();
+            }
+        }
+
+        // Dynamic DNS
+        if (dhcp.isMember("ddns")) {
+            const Json::Value& ddns = dhcp["ddns"];
+            if (ddns.isMember("server")) {
+                config_.ddns_server = ddns["server"].asString();
+            }
+            if (ddns.isMember("port")) {
+                config_.ddns_port = static_cast<uint16_t>(ddns["port"].asUInt());
+            }
+            if (ddns.isMember("forward_zone")) {
+                config_.ddns_forward_zone = ddns["forward_zone"].asString();
+            }
+            if (ddns.isMember("reverse_zone")) {
+                config_.ddns_reverse_zone = ddns["reverse_zone"].asString();
+            }
+            if (ddns.isMember("ttl")) {
+                config_.ddns_ttl = ddns["ttl"].asUInt();
+            }
+            if (ddns.isMember("tsig_key")) {
+                config_.ddns_tsig_key = ddns["tsig_key"].asString();
+            }
+            if (ddns.isMember("tsig_secret")) {
+                config_.ddns_tsig_secret = ddns["tsig_secret"].asString();
+            }
+            if (ddns.isMember("queue_size")) {
+                config_.ddns_queue_size = ddns["queue_size"].asUInt();
+            }
         }
 
         if (!dhcp.isMember("listen") || !dhcp.isMember("subnets")) {
@@ -345,6 +565,44 @@ void ConfigManager::parse_yaml_config(const std::string& yaml_config) {
             if (key == "enable_logging") parsed.enable_logging = (val == "true");
             else if (key == "enable_security") parsed.enable_security = (val == "true");
             else if (key == "max_leases") parsed.max_leases = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "worker_threads") parsed.worker_threads = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "io_batch_size") parsed.io_batch_size = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "io_flush_timeout_us") parsed.io_flush_timeout_us = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "event_backend") parsed.event_backend = val;
+            else if (key == "raw_unicast_replies") parsed.raw_unicast_replies = (val == "true");
+            else if (key == "reply_cache_size") parsed.reply_cache_size = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "reply_cache_ttl_ms") parsed.reply_cache_ttl_ms = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "lease_snapshot") parsed.lease_snapshot = val;
+            else if (key == "lease_journal") parsed.lease_journal = val;
+            else if (key == "lease_history_depth") parsed.lease_history_depth = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "lease_history_file") parsed.lease_history_file = val;
+            else if (key == "journal_sync") parsed.lease_journal_sync = (val == "true");
+            else if (key == "journal_compact_mb") parsed.lease_journal_compact_mb = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "log_async") parsed.log_async = (val == "true");
+            else if (key == "log_buffer_lines") parsed.log_buffer_lines = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "log_flush_interval_ms") parsed.log_flush_interval_ms = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "log_overflow") parsed.log_block_when_full = (val == "block");
+            else if (key == "metrics_enabled") parsed.metrics_enabled = (val == "true");
+            else if (key == "metrics_address") parsed.metrics_address = val;
+            else if (key == "metrics_port") parsed.metrics_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "ping_check_enabled") parsed.ping_check_enabled = (val == "true");
+            else if (key == "ping_check_timeout_ms") parsed.ping_check_timeout_ms = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "ping_check_cache_seconds") parsed.ping_check_cache_seconds = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "leasequery_enabled") parsed.leasequery_enabled = (val == "true");
+            else if (key == "bulk_leasequery_address") parsed.bulk_leasequery_address = val;
+            else if (key == "bulk_leasequery_port") parsed.bulk_leasequery_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "failover_peer") parsed.failover_peer = val;
+            else if (key == "failover_port") parsed.failover_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "failover_role") parsed.failover_role = val;
+            else if (key == "failover_split") parsed.failover_split = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "ddns_server") parsed.ddns_server = val;
+            else if (key == "ddns_port") parsed.ddns_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "ddns_forward_zone") parsed.ddns_forward_zone = val;
+            else if (key == "ddns_reverse_zone") parsed.ddns_reverse_zone = val;
+            else if (key == "ddns_ttl") parsed.ddns_ttl = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "ddns_tsig_key") parsed.ddns_tsig_key = val;
+            else if (key == "ddns_tsig_secret") parsed.ddns_tsig_secret = val;
+            else if (key == "ddns_queue_size") parsed.ddns_queue_size = static_cast<uint32_t>(std::stoul(val));
         } else if (current_section == "subnets") {
             if (t[0] == '-') {
                 // Start new subnet
@@ -440,6 +698,44 @@ void ConfigManager::parse_ini_config(const std::string& ini_config) {
             if (key == "enable_logging") parsed.enable_logging = (val == "true");
             else if (key == "enable_security") parsed.enable_security = (val == "true");
             else if (key == "max_leases") parsed.max_leases = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "worker_threads") parsed.worker_threads = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "io_batch_size") parsed.io_batch_size = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "io_flush_timeout_us") parsed.io_flush_timeout_us = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "event_backend") parsed.event_backend = val;
+            else if (key == "raw_unicast_replies") parsed.raw_unicast_replies = (val == "true");
+            else if (key == "reply_cache_size") parsed.reply_cache_size = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "reply_cache_ttl_ms") parsed.reply_cache_ttl_ms = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "lease_snapshot") parsed.lease_snapshot = val;
+            else if (key == "lease_journal") parsed.lease_journal = val;
+            else if (key == "lease_history_depth") parsed.lease_history_depth = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "lease_history_file") parsed.lease_history_file = val;
+            else if (key == "journal_sync") parsed.lease_journal_sync = (val == "true");
+            else if (key == "journal_compact_mb") parsed.lease_journal_compact_mb = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "log_async") parsed.log_async = (val == "true");
+            else if (key == "log_buffer_lines") parsed.log_buffer_lines = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "log_flush_interval_ms") parsed.log_flush_interval_ms = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "log_overflow") parsed.log_block_when_full = (val == "block");
+            else if (key == "metrics_enabled") parsed.metrics_enabled = (val == "true");
+            else if (key == "metrics_address") parsed.metrics_address = val;
+            else if (key == "metrics_port") parsed.metrics_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "ping_check_enabled") parsed.ping_check_enabled = (val == "true");
+            else if (key == "ping_check_timeout_ms") parsed.ping_check_timeout_ms = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "ping_check_cache_seconds") parsed.ping_check_cache_seconds = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "leasequery_enabled") parsed.leasequery_enabled = (val == "true");
+            else if (key == "bulk_leasequery_address") parsed.bulk_leasequery_address = val;
+            else if (key == "bulk_leasequery_port") parsed.bulk_leasequery_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "failover_peer") parsed.failover_peer = val;
+            else if (key == "failover_port") parsed.failover_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "failover_role") parsed.failover_role = val;
+            else if (key == "failover_split") parsed.failover_split = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "ddns_server") parsed.ddns_server = val;
+            else if (key == "ddns_port") parsed.ddns_port = static_cast<uint16_t>(std::stoul(val));
+            else if (key == "ddns_forward_zone") parsed.ddns_forward_zone = val;
+            else if (key == "ddns_reverse_zone") parsed.ddns_reverse_zone = val;
+            else if (key == "ddns_ttl") parsed.ddns_ttl = static_cast<uint32_t>(std::stoul(val));
+            else if (key == "ddns_tsig_key") parsed.ddns_tsig_key = val;
+            else if (key == "ddns_tsig_secret") parsed.ddns_tsig_secret = val;
+            else if (key == "ddns_queue_size") parsed.ddns_queue_size = static_cast<uint32_t>(std::stoul(val));
         } else if (section == "global_options") {
             // Expect lines like: dns_servers = 6:1.1.1.1,8.8.8.8 or domain_name = 15:example.com
             auto colon = val.find(':');
@@ -670,6 +966,31 @@ DhcpConfig get_default_config() {
     
     // Default settings
     config.enable_logging = true;
+    config.log_async = true;
+    config.log_buffer_lines = 8192;
+    config.log_flush_interval_ms = 100;
+    config.log_block_when_full = false;
+    config.metrics_enabled = false;
+    config.metrics_address = "127.0.0.1";
+    config.metrics_port = 9547;
+    config.ping_check_enabled = false;
+    config.ping_check_timeout_ms = 500;
+    config.ping_check_cache_seconds = 60;
+    config.leasequery_enabled = false;
+    config.bulk_leasequery_address.clear();
+    config.bulk_leasequery_port = 67;
+    config.failover_peer.clear();
+    config.failover_port = 647;
+    config.failover_role = "primary";
+    config.failover_split = 128;
+    config.ddns_server.clear();
+    config.ddns_port = 53;
+    config.ddns_forward_zone.clear();
+    config.ddns_reverse_zone.clear();
+    config.ddns_ttl = 300;
+    config.ddns_tsig_key.clear();
+    config.ddns_tsig_secret.clear();
+    config.ddns_queue_size = 8192;
     config.enable_security = true;
     config.max_leases = 10000;
     config.log_file = "/var/log/simple-dhcpd.log";
@@ -677,7 +998,21 @@ DhcpConfig get_default_config() {
     config.server_identifier = 0;
     config.security_policy_file.clear();
     config.advanced_lease_database.clear();
+    config.lease_history_depth = 10;
+    config.lease_history_file.clear();
     config.decline_hold_seconds = 3600;
+    config.offer_hold_seconds = 30;
+    config.worker_threads = 1;
+    config.io_batch_size = 1;
+    config.io_flush_timeout_us = 200;
+    config.event_backend = "auto";
+    config.raw_unicast_replies = false;
+    config.reply_cache_size = 4096;
+    config.reply_cache_ttl_ms = 3000;
+    config.lease_snapshot.clear();
+    config.lease_journal.clear();
+    config.lease_journal_sync = true;
+    config.lease_journal_compact_mb = 64;
 
     return config;
 }
@@ -0,0 +1,150 @@
+/**
+ * @file config/subnet_index.cpp
+ * @brief Subnet lookup index implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/config/subnet_index.hpp"
+#include <arpa/inet.h>
+#include <utility>
+
+namespace simple_dhcpd {
+
+namespace {
+
+/**
+ * Prefix a subnet is indexed by. Subnets built in code often set only the
+ * range, so derive the covering prefix from it when no length is given.
+ */
+void indexed_prefix(const DhcpSubnet& subnet, IpAddress& network, uint8_t& prefix_length) {
+    network = subnet.network;
+    prefix_length = subnet.prefix_length;
+    if (prefix_length == 0 && (subnet.range_start != 0 || subnet.range_end != 0)) {
+        const uint32_t start = ntohl(subnet.range_start);
+        const uint32_t diff = start ^ ntohl(subnet.range_end);
+        prefix_length = diff == 0 ? 32 : static_cast<uint8_t>(__builtin_clz(diff));
+        network = subnet.range_start;
+    }
+}
+
+bool same_options(const std::vector<DhcpOption>& a, const std::vector<DhcpOption>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].code != b[i].code || a[i].data != b[i].data) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool same_reservations(const std::map<MacAddress, DhcpLease>& a, const std::map<MacAddress, DhcpLease>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j) {
+        if (i->first != j->first || i->second.ip_address != j->second.ip_address ||
+            i->second.hostname != j->second.hostname) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SubnetChange compare(const DhcpSubnet& before, const DhcpSubnet& after) {
+    if (before.range_start != after.range_start || before.range_end != after.range_end ||
+        before.exclusions != after.exclusions) {
+        return SubnetChange::POOL;
+    }
+    const bool same = before.network == after.network && before.prefix_length == after.prefix_length &&
+                      before.gateway == after.gateway && before.dns_servers == after.dns_servers &&
+                      before.domain_name == after.domain_name && before.lease_time == after.lease_time &&
+                      before.max_lease_time == after.max_lease_time &&
+                      same_options(before.options, after.options) &&
+                      same_reservations(before.reservations, after.reservations);
+    return same ? SubnetChange::UNCHANGED : SubnetChange::SETTINGS;
+}
+
+} // namespace
+
+SubnetIndex::SubnetIndex() : count_(0) {}
+
+void SubnetIndex::build(const std::vector<DhcpSubnet>& subnets) {
+    trie_.clear();
+    names_.clear();
+    names_.reserve(subnets.size());
+    count_ = 0;
+
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        add(subnets[i], static_cast<SubnetId>(i));
+    }
+    count_ = subnets.size();
+}
+
+void SubnetIndex::add(const DhcpSubnet& subnet, SubnetId id) {
+    IpAddress network;
+    uint8_t prefix_length;
+    indexed_prefix(subnet, network, prefix_length);
+    trie_.insert(network, prefix_length, id);
+    names_.emplace(subnet.name, id);
+    ++count_;
+}
+
+SubnetId SubnetIndex::find_by_name(const std::string& name) const {
+    auto it = names_.find(name);
+    return it == names_.end() ? kNoSubnet : it->second;
+}
+
+std::shared_ptr<const SubnetTable> SubnetTable::build(const std::vector<DhcpSubnet>& subnets) {
+    return SubnetTable().update(subnets);
+}
+
+std::shared_ptr<const SubnetTable> SubnetTable::update(const std::vector<DhcpSubnet>& subnets) const {
+    auto next = std::make_shared<SubnetTable>();
+    next->subnets_ = subnets_;
+    next->retired_ = retired_;
+    next->changes_.assign(subnets_.size(), SubnetChange::UNCHANGED);
+
+    // Configured subnets of each name, in order; a slot claims the first unclaimed one
+    std::unordered_map<std::string, std::vector<size_t>> by_name;
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        by_name[subnets[i].name].push_back(i);
+    }
+    std::unordered_map<std::string, size_t> claimed;
+    std::vector<SubnetId> slot_of(subnets.size(), kNoSubnet);
+    for (size_t id = 0; id < subnets_.size(); ++id) {
+        if (retired_[id]) {
+            continue;
+        }
+        auto it = by_name.find(subnets_[id].name);
+        size_t& next_claim = claimed[subnets_[id].name];
+        if (it == by_name.end() || next_claim == it->second.size()) {
+            next->retired_[id] = 1;
+            next->changes_[id] = SubnetChange::REMOVED;
+            continue;
+        }
+        const size_t position = it->second[next_claim++];
+        slot_of[position] = static_cast<SubnetId>(id);
+        next->changes_[id] = compare(subnets_[id], subnets[position]);
+        next->subnets_[id] = subnets[position];
+    }
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        if (slot_of[i] == kNoSubnet) {
+            slot_of[i] = static_cast<SubnetId>(next->subnets_.size());
+            next->subnets_.push_back(subnets[i]);
+            next->retired_.push_back(0);
+            next->changes_.push_back(SubnetChange::ADDED);
+        }
+    }
+
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        next->index_.add(subnets[i], slot_of[i]);
+    }
+    next->default_id_ = subnets.empty() ? kNoSubnet : slot_of[0];
+    return next;
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,58 @@
+/**
+ * @file core/early_drop.cpp
+ * @brief Checks on the raw packet that run before it is parsed
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/early_drop.hpp"
+#include <cstddef>
+#include <cstring>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr uint8_t kBootRequest = 1;
+constexpr uint8_t kEthernet = 1;
+constexpr uint8_t kEthernetAddressLength = 6;
+constexpr uint8_t kMagicCookie[4] = {99, 130, 83, 99};
+}
+
+const char* early_drop_reason_name(EarlyDropReason reason) {
+    switch (reason) {
+        case EarlyDropReason::NONE: return "none";
+        case EarlyDropReason::TRUNCATED: return "truncated";
+        case EarlyDropReason::NOT_REQUEST: return "not_request";
+        case EarlyDropReason::BAD_HARDWARE: return "bad_hardware";
+        case EarlyDropReason::BAD_MAGIC_COOKIE: return "bad_magic_cookie";
+        case EarlyDropReason::MAC_FILTER: return "mac_filter";
+        case EarlyDropReason::RATE_LIMIT: return "rate_limit";
+        default: return "unknown";
+    }
+}
+
+EarlyDropReason EarlyDropFilter::check_header(const uint8_t* data, size_t size) {
+    if (size < sizeof(DhcpMessageHeader) + sizeof(kMagicCookie)) {
+        return EarlyDropReason::TRUNCATED;
+    }
+    if (data[offsetof(DhcpMessageHeader, op)] != kBootRequest) {
+        return EarlyDropReason::NOT_REQUEST;
+    }
+    if (data[offsetof(DhcpMessageHeader, htype)] != kEthernet ||
+        data[offsetof(DhcpMessageHeader, hlen)] != kEthernetAddressLength) {
+        return EarlyDropReason::BAD_HARDWARE;
+    }
+    if (std::memcmp(data + sizeof(DhcpMessageHeader), kMagicCookie, sizeof(kMagicCookie)) != 0) {
+        return EarlyDropReason::BAD_MAGIC_COOKIE;
+    }
+    return EarlyDropReason::NONE;
+}
+
+MacAddress EarlyDropFilter::chaddr(const uint8_t* data) {
+    MacAddress mac_address;
+    std::memcpy(mac_address.data(), data + offsetof(DhcpMessageHeader, chaddr), mac_address.size());
+    return mac_address;
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,155 @@
+/**
+ * @file message_view.cpp
+ * @brief Allocation-free DHCP message view implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/message_view.hpp"
+#include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <cstddef>
+#include <cstring>
+
+namespace simple_dhcpd {
+
+static_assert(DhcpMessageView::kMaxOptions < 0xFFFF, "option positions must fit the code index");
+
+namespace {
+constexpr uint8_t kOverloadFile = 1;
+constexpr uint8_t kOverloadSname = 2;
+}
+
+DhcpMessageView::DhcpMessageView()
+    : data_(nullptr), size_(0), header_(nullptr), message_type_(DhcpMessageType::DISCOVER),
+      end_seen_(false), option_count_(0) {
+    index_.fill(kNoOption);
+}
+
+DhcpMessageView::DhcpMessageView(const PacketBuffer& packet)
+    : DhcpMessageView(packet.data(), packet.size()) {}
+
+DhcpMessageView::DhcpMessageView(const uint8_t* data, size_t size) : DhcpMessageView() {
+    if (size < sizeof(DhcpMessageHeader)) {
+        throw DhcpParserException("Message too short");
+    }
+
+    data_ = data;
+    size_ = size;
+    header_ = reinterpret_cast<const DhcpMessageHeader*>(data);
+
+    size_t offset = sizeof(DhcpMessageHeader);
+
+    // Check for magic cookie (99, 130, 83, 99)
+    if (offset + 4 <= size &&
+        data[offset] == 99 && data[offset + 1] == 130 &&
+        data[offset + 2] == 83 && data[offset + 3] == 99) {
+        offset += 4;
+    }
+    parse_area(offset, size);
+
+    // Option overload (RFC 2132 9.3): file is read before sname
+    ByteView overload = option_data(DhcpOptionCode::OPTION_OVERLOAD);
+    if (overload.size() == 1) {
+        if (overload[0] & kOverloadFile) {
+            const size_t file = offsetof(DhcpMessageHeader, file);
+            parse_area(file, file + sizeof(header_->file));
+        }
+        if (overload[0] & kOverloadSname) {
+            const size_t sname = offsetof(DhcpMessageHeader, sname);
+            parse_area(sname, sname + sizeof(header_->sname));
+        }
+    }
+
+    ByteView type = option_data(DhcpOptionCode::DHCP_MESSAGE_TYPE);
+    if (type.size() != 1) {
+        throw DhcpParserException("Missing or invalid DHCP message type");
+    }
+    message_type_ = option_value_to_message_type(type[0]);
+}
+
+void DhcpMessageView::parse_area(size_t begin, size_t end) {
+    const bool main_area = begin >= sizeof(DhcpMessageHeader);
+    size_t offset = begin;
+
+    while (offset < end) {
+        const uint8_t code = data_[offset++];
+
+        if (code == static_cast<uint8_t>(DhcpOptionCode::END)) {
+            if (main_area) {
+                end_seen_ = true;
+            }
+            return;
+        }
+        if (code == static_cast<uint8_t>(DhcpOptionCode::PAD)) {
+            continue;
+        }
+
+        // A truncated option ends the area, as in DhcpParser::parse_options
+        if (offset >= end) {
+            return;
+        }
+        const uint8_t length = data_[offset++];
+        if (offset + length > end) {
+            return;
+        }
+
+        if (option_count_ == kMaxOptions) {
+            return;     // only a message longer than a PacketBuffer gets here
+        }
+        if (index_[code] == kNoOption) {
+            index_[code] = option_count_;
+        }
+        options_[option_count_++] = OptionRef{static_cast<uint16_t>(offset), code, length};
+        offset += length;
+    }
+}
+
+MacAddress DhcpMessageView::client_mac() const {
+    MacAddress mac;
+    std::memcpy(mac.data(), header_->chaddr, mac.size());
+    return mac;
+}
+
+ByteView DhcpMessageView::option_data(DhcpOptionCode code) const {
+    const uint16_t index = index_[static_cast<uint8_t>(code)];
+    if (index == kNoOption) {
+        return ByteView();
+    }
+    return option_data_at(index);
+}
+
+DhcpMessage DhcpMessageView::to_message() const {
+    DhcpMessage message;
+    if (!header_) {
+        return message;
+    }
+
+    std::memcpy(&message.header, header_, sizeof(DhcpMessageHeader));
+
+    message.options.reserve(option_count_ + 1);
+    for (size_t i = 0; i < option_count_; ++i) {
+        DhcpOption option;
+        option.code = option_code_at(i);
+        option.length = options_[i].length;
+        ByteView payload = option_data_at(i);
+        option.data.assign(payload.begin(), payload.end());
+        message.options.push_back(std::move(option));
+    }
+    if (end_seen_) {
+        DhcpOption end_option;
+        end_option.code = DhcpOptionCode::END;
+        end_option.length = 0;
+        message.options.push_back(std::move(end_option));
+    }
+
+    message.message_type = message_type_;
+    message.client_mac = client_mac();
+    message.client_ip = client_ip();
+    message.server_ip = server_ip();
+    message.relay_ip = relay_ip();
+    return message;
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,151 @@
+/**
+ * @file message_writer.cpp
+ * @brief DHCP message encoder implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/message_writer.hpp"
+#include "simple-dhcpd/core/parser.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <arpa/inet.h>
+
+namespace simple_dhcpd {
+
+namespace {
+// Option 52 (3 bytes) plus END must always fit in the options area
+constexpr size_t kMainReserve = 4;
+constexpr size_t kMaxOptionLength = 255;
+
+bool field_is_empty(const uint8_t* field, size_t size) {
+    return std::all_of(field, field + size, [](uint8_t b) { return b == 0; });
+}
+}
+
+DhcpMessageWriter::DhcpMessageWriter(uint8_t* buffer, size_t capacity)
+    : buffer_(buffer), capacity_(capacity), limit_(0),
+      main_{0, 0, false}, file_{0, 0, false}, sname_{0, 0, false}, overload_(0) {}
+
+DhcpMessageWriter& DhcpMessageWriter::for_current_thread() {
+    thread_local std::array<uint8_t, PacketBuffer::kCapacity> buffer;
+    thread_local DhcpMessageWriter writer(buffer.data(), buffer.size());
+    return writer;
+}
+
+void DhcpMessageWriter::begin(const DhcpMessageHeader& header, size_t max_size) {
+    const size_t minimum = sizeof(DhcpMessageHeader) + 4 + kMainReserve;
+    if (capacity_ < minimum) {
+        throw DhcpParserException("Output buffer too small");
+    }
+    limit_ = std::max(minimum, std::min(max_size, capacity_));
+    overload_ = 0;
+
+    std::memcpy(buffer_, &header, sizeof(DhcpMessageHeader));
+
+    size_t offset = sizeof(DhcpMessageHeader);
+    buffer_[offset++] = 99;
+    buffer_[offset++] = 130;
+    buffer_[offset++] = 83;
+    buffer_[offset++] = 99;
+    main_ = Area{offset, limit_, true};
+
+    const size_t file = offsetof(DhcpMessageHeader, file);
+    const size_t sname = offsetof(DhcpMessageHeader, sname);
+    file_ = Area{file, file + sizeof(header.file), field_is_empty(header.file, sizeof(header.file))};
+    sname_ = Area{sname, sname + sizeof(header.sname), field_is_empty(header.sname, sizeof(header.sname))};
+}
+
+bool DhcpMessageWriter::write_to(Area& area, size_t reserved, uint8_t code, const uint8_t* data, size_t length) {
+    if (!area.usable || area.offset + 2 + length + reserved > area.end) {
+        return false;
+    }
+    buffer_[area.offset++] = code;
+    buffer_[area.offset++] = static_cast<uint8_t>(length);
+    if (length > 0) {
+        std::memcpy(buffer_ + area.offset, data, length);
+        area.offset += length;
+    }
+    return true;
+}
+
+void DhcpMessageWriter::add_option(DhcpOptionCode code, const uint8_t* data, size_t length) {
+    if (code == DhcpOptionCode::PAD || code == DhcpOptionCode::END) {
+        return;
+    }
+
+    const uint8_t raw_code = static_cast<uint8_t>(code);
+    size_t written = 0;
+    // Payloads over 255 bytes go out as consecutive instances (RFC 3396)
+    do {
+        const size_t chunk = std::min(length - written, kMaxOptionLength);
+        const uint8_t* chunk_data = data + written;
+
+        if (!write_to(main_, kMainReserve, raw_code, chunk_data, chunk)) {
+            if (write_to(file_, 1, raw_code, chunk_data, chunk)) {
+                overload_ |= 1;
+            } else if (write_to(sname_, 1, raw_code, chunk_data, chunk)) {
+                overload_ |= 2;
+            } else {
+                throw DhcpParserException("DHCP option " + std::to_string(raw_code) +
+                                          " does not fit in message");
+            }
+        }
+        written += chunk;
+    } while (written < length);
+}
+
+void DhcpMessageWriter::add_option_u8(DhcpOptionCode code, uint8_t value) {
+    add_option(code, &value, 1);
+}
+
+void DhcpMessageWriter::add_option_u32(DhcpOptionCode code, uint32_t value) {
+    const uint32_t be = htonl(value);
+    add_option(code, reinterpret_cast<const uint8_t*>(&be), sizeof(be));
+}
+
+void DhcpMessageWriter::add_option_ip(DhcpOptionCode code, IpAddress address) {
+    add_option(code, reinterpret_cast<const uint8_t*>(&address), sizeof(address));
+}
+
+uint8_t* DhcpMessageWriter::reserve(size_t length) {
+    if (!main_.usable || main_.offset + length + kMainReserve > main_.end) {
+        return nullptr;
+    }
+    uint8_t* reserved = buffer_ + main_.offset;
+    main_.offset += length;
+    return reserved;
+}
+
+ByteView DhcpMessageWriter::finish() {
+    if (overload_) {
+        buffer_[main_.offset++] = static_cast<uint8_t>(DhcpOptionCode::OPTION_OVERLOAD);
+        buffer_[main_.offset++] = 1;
+        buffer_[main_.offset++] = overload_;
+        if (overload_ & 1) {
+            buffer_[file_.offset] = static_cast<uint8_t>(DhcpOptionCode::END);
+        }
+        if (overload_ & 2) {
+            buffer_[sname_.offset] = static_cast<uint8_t>(DhcpOptionCode::END);
+        }
+    }
+    buffer_[main_.offset++] = static_cast<uint8_t>(DhcpOptionCode::END);
+
+    // Seal the areas so stray writes after finish() cannot corrupt the message
+    main_.usable = file_.usable = sname_.usable = false;
+    return ByteView(buffer_, main_.offset);
+}
+
+ByteView DhcpMessageWriter::encode(const DhcpMessage& message, size_t max_size) {
+    DhcpMessageWriter& writer = for_current_thread();
+    writer.begin(message.header, max_size);
+    for (const auto& option : message.options) {
+        writer.add_option(option.code, option.data.data(), option.data.size());
+    }
+    return writer.finish();
+}
+
+} // namespace simple_dhcpd
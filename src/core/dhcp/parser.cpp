@@ -7,6 +7,7 @@
  */
 
 #include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
 #include "simple-dhcpd/core/utils/logger.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
 #include <cstring>
@@ -18,32 +19,12 @@ DhcpMessage DhcpParser::parse_message(const std::vector<uint8_t>& data) {
     return parse_message(data.data(), data.size());
 }
 
+DhcpMessage DhcpParser::parse_message(const PacketBuffer& packet) {
+    return parse_message(packet.data(), packet.size());
+}
+
 DhcpMessage DhcpParser::parse_message(const uint8_t* data, size_t size) {
-    if (size < sizeof(DhcpMessageHeader)) {
-        throw DhcpParserException("Message too short");
-    }
-    
-    DhcpMessage message;
-    
-    // Parse header
-    message.header = parse_header(data, size);
-    
-    // Parse options
-    message.options = parse_options(data, size);
-    
-    // Extract message type
-    const DhcpOption* type_option = find_option(message.options, DhcpOptionCode::DHCP_MESSAGE_TYPE);
-    if (type_option && type_option->length == 1) {
-        message.message_type = option_value_to_message_type(type_option->data[0]);
-    } else {
-        throw DhcpParserException("Missing or invalid DHCP message type");
-    }
-    
-    // Extract addresses
-    message.client_mac = extract_mac_address(message.header);
-    message.client_ip = extract_ip_address(message.header);
-    message.server_ip = message.header.siaddr;
-    message.relay_ip = message.header.giaddr;
+    DhcpMessage message = DhcpMessageView(data, size).to_message();
     
     LOG_DEBUG("Parsed DHCP " + get_message_type_name(message.message_type) + 
               " from " + mac_to_string(message.client_mac));
@@ -51,25 +32,17 @@ DhcpMessage DhcpParser::parse_message(const uint8_t* data, size_t size) {
     return message;
 }
 
+DhcpMessageView DhcpParser::parse_view(const PacketBuffer& packet) {
+    return DhcpMessageView(packet);
+}
+
 std::vector<uint8_t> DhcpParser::generate_message(const DhcpMessage& message) {
-    std::vector<uint8_t> data;
-    data.resize(sizeof(DhcpMessageHeader) + 312); // Header + max options
-    
-    size_t offset = 0;
-    
-    // Generate header
-    offset = generate_header(message.header, data.data(), offset);
-    
-    // Generate options
-    offset = generate_options(message.options, data.data(), offset);
-    
-    // Resize to actual size
-    data.resize(offset);
+    ByteView encoded = DhcpMessageWriter::encode(message);
     
     LOG_DEBUG("Generated DHCP " + get_message_type_name(message.message_type) + 
               " for " + mac_to_string(message.client_mac));
     
-    return data;
+    return std::vector<uint8_t>(encoded.begin(), encoded.end());
 }
 
 bool DhcpParser::validate_message(const DhcpMessage& message) {
@@ -102,148 +75,7 @@ DhcpMessageType DhcpParser::get_message_type(const std::vector<uint8_t>& data) {
 }
 
 DhcpMessageType DhcpParser::get_message_type(const uint8_t* data, size_t size) {
-    if (size < sizeof(DhcpMessageHeader)) {
-        throw DhcpParserException("Message too short");
-    }
-    
-    // Parse options to find message type
-    std::vector<DhcpOption> options = parse_options(data, size);
-    const DhcpOption* type_option = find_option(options, DhcpOptionCode::DHCP_MESSAGE_TYPE);
-    
-    if (!type_option || type_option->length != 1) {
-        throw DhcpParserException("Missing or invalid DHCP message type");
-    }
-    
-    return option_value_to_message_type(type_option->data[0]);
-}
-
-DhcpMessageHeader DhcpParser::parse_header(const uint8_t* data, size_t size) {
-    if (size < sizeof(DhcpMessageHeader)) {
-        throw DhcpParserException("Message too short for header");
-    }
-    
-    DhcpMessageHeader header;
-    memcpy(&header, data, sizeof(DhcpMessageHeader));
-    
-    return header;
-}
-
-std::vector<DhcpOption> DhcpParser::parse_options(const uint8_t* data, size_t size) {
-    std::vector<DhcpOption> options;
-    
-    if (size < sizeof(DhcpMessageHeader)) {
-        return options;
-    }
-    
-    size_t offset = sizeof(DhcpMessageHeader);
-    
-    // Check for magic cookie (99, 130, 83, 99)
-    if (offset + 4 <= size && 
-        data[offset] == 99 && data[offset + 1] == 130 && 
-        data[offset + 2] == 83 && data[offset + 3] == 99) {
-        offset += 4; // Skip magic cookie
-    }
-    
-    while (offset < size) {
-        try {
-            auto [option, new_offset] = parse_option(data, size, offset);
-            options.push_back(option);
-            offset = new_offset;
-            
-            // Check for END option
-            if (option.code == DhcpOptionCode::END) {
-                break;
-            }
-        } catch (const DhcpParserException&) {
-            break;
-        }
-    }
-    
-    return options;
-}
-
-std::pair<DhcpOption, size_t> DhcpParser::parse_option(const uint8_t* data, size_t size, size_t offset) {
-    if (offset >= size) {
-        throw DhcpParserException("Unexpected end of data");
-    }
-    
-    DhcpOption option;
-    option.code = static_cast<DhcpOptionCode>(data[offset++]);
-    
-    // Check for END option
-    if (option.code == DhcpOptionCode::END) {
-        option.length = 0;
-        return {option, offset};
-    }
-    
-    // Check for PAD option
-    if (option.code == DhcpOptionCode::PAD) {
-        option.length = 0;
-        return {option, offset};
-    }
-    
-    if (offset >= size) {
-        throw DhcpParserException("Unexpected end of data");
-    }
-    
-    option.length = data[offset++];
-    
-    if (offset + option.length > size) {
-        throw DhcpParserException("Option data extends beyond message");
-    }
-    
-    option.data.resize(option.length);
-    memcpy(option.data.data(), data + offset, option.length);
-    offset += option.length;
-    
-    return {option, offset};
-}
-
-size_t DhcpParser::generate_header(const DhcpMessageHeader& header, uint8_t* data, size_t offset) {
-    if (offset + sizeof(DhcpMessageHeader) > 1500) {
-        throw DhcpParserException("Message too large");
-    }
-    
-    memcpy(data + offset, &header, sizeof(DhcpMessageHeader));
-    return offset + sizeof(DhcpMessageHeader);
-}
-
-size_t DhcpParser::generate_options(const std::vector<DhcpOption>& options, uint8_t* data, size_t offset) {
-    // Add magic cookie (99, 130, 83, 99)
-    data[offset++] = 99;
-    data[offset++] = 130;
-    data[offset++] = 83;
-    data[offset++] = 99;
-    
-    for (const auto& option : options) {
-        offset = generate_option(option, data, offset);
-    }
-    
-    // Add END option if not present
-    if (options.empty() || options.back().code != DhcpOptionCode::END) {
-        DhcpOption end_option;
-        end_option.code = DhcpOptionCode::END;
-        end_option.length = 0;
-        offset = generate_option(end_option, data, offset);
-    }
-    
-    return offset;
-}
-
-size_t DhcpParser::generate_option(const DhcpOption& option, uint8_t* data, size_t offset) {
-    if (offset + 2 + option.length > 1500) {
-        throw DhcpParserException("Message too large");
-    }
-    
-    data[offset++] = static_cast<uint8_t>(option.code);
-    data[offset++] = option.length;
-    
-    if (option.length > 0) {
-        memcpy(data + offset, option.data.data(), option.length);
-        offset += option.length;
-    }
-    
-    return offset;
+    return DhcpMessageView(data, size).message_type();
 }
 
 const DhcpOption* DhcpParser::find_option(const std::vector<DhcpOption>& options, DhcpOptionCode code) {
@@ -255,16 +87,6 @@ const DhcpOption* DhcpParser::find_option(const std::vector<DhcpOption>& options
     return nullptr;
 }
 
-MacAddress DhcpParser::extract_mac_address(const DhcpMessageHeader& header) {
-    MacAddress mac;
-    memcpy(mac.data(), header.chaddr, 6);
-    return mac;
-}
-
-IpAddress DhcpParser::extract_ip_address(const DhcpMessageHeader& header) {
-    return header.ciaddr;
-}
-
 // DhcpMessageBuilder implementation
 
 DhcpMessageBuilder::DhcpMessageBuilder() {
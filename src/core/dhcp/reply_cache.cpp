@@ -0,0 +1,142 @@
+/**
+ * @file core/reply_cache.cpp
+ * @brief Bounded reply cache implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/reply_cache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace simple_dhcpd {
+
+namespace {
+// Marks MAC keys so an all-zero MAC is not mistaken for an empty slot
+constexpr uint64_t kMacTag = 1ull << 63;
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+}
+
+ReplyCache::ReplyCache(size_t capacity, std::chrono::milliseconds ttl)
+    : shard_count_(kShards), sets_per_shard_(1), ttl_ns_(to_ns(ttl)), hits_(0), misses_(0) {
+    const size_t sets_needed = (std::max<size_t>(capacity, 1) + kWays - 1) / kWays;
+    while (sets_per_shard_ * shard_count_ < sets_needed) {
+        sets_per_shard_ <<= 1;
+    }
+    shards_.reset(new Shard[shard_count_]);
+    for (size_t i = 0; i < shard_count_; ++i) {
+        shards_[i].entries.resize(sets_per_shard_ * kWays);
+        for (auto& entry : shards_[i].entries) {
+            entry.mac_key = 0;
+        }
+    }
+}
+
+uint64_t ReplyCache::mac_key(const MacAddress& mac_address) {
+    uint64_t key = 0;
+    for (uint8_t byte : mac_address) {
+        key = (key << 8) | byte;
+    }
+    return kMacTag | key;
+}
+
+ReplyCache::Entry* ReplyCache::set_for(uint64_t key, Shard*& shard) {
+    const uint64_t hash = mix(key);
+    shard = &shards_[(hash >> 32) % shard_count_];
+    return &shard->entries[(hash & (sets_per_shard_ - 1)) * kWays];
+}
+
+void ReplyCache::store(const MacAddress& mac_address, uint32_t xid, DhcpMessageType request_type,
+                       ByteView reply, Clock::time_point now) {
+    if (reply.empty() || reply.size() > kMaxReplySize) {
+        return;
+    }
+    const uint64_t key = mac_key(mac_address);
+    const uint8_t type = static_cast<uint8_t>(request_type);
+    const int64_t now_ns = to_ns(now.time_since_epoch());
+    Shard* shard;
+    Entry* set = set_for(key, shard);
+
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    Entry* slot = set;
+    int64_t slot_expires = std::numeric_limits<int64_t>::max();
+    for (size_t way = 0; way < kWays; ++way) {
+        Entry& candidate = set[way];
+        if (candidate.mac_key == key && candidate.xid == xid && candidate.request_type == type) {
+            slot = &candidate;
+            break;
+        }
+        // Empty and expired slots first, then the entry closest to expiring
+        const int64_t expires = candidate.mac_key == 0 || candidate.expires_ns <= now_ns
+                                    ? std::numeric_limits<int64_t>::min() : candidate.expires_ns;
+        if (expires < slot_expires) {
+            slot = &candidate;
+            slot_expires = expires;
+        }
+    }
+    slot->mac_key = key;
+    slot->xid = xid;
+    slot->request_type = type;
+    slot->length = static_cast<uint16_t>(reply.size());
+    slot->expires_ns = now_ns + ttl_ns_.load(std::memory_order_relaxed);
+    std::memcpy(slot->data, reply.data(), reply.size());
+}
+
+size_t ReplyCache::lookup(const MacAddress& mac_address, uint32_t xid, DhcpMessageType request_type,
+                          Buffer& out, Clock::time_point now) {
+    const uint64_t key = mac_key(mac_address);
+    const uint8_t type = static_cast<uint8_t>(request_type);
+    const int64_t now_ns = to_ns(now.time_since_epoch());
+    Shard* shard;
+    Entry* set = set_for(key, shard);
+
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    for (size_t way = 0; way < kWays; ++way) {
+        Entry& entry = set[way];
+        if (entry.mac_key == key && entry.xid == xid && entry.request_type == type) {
+            if (entry.expires_ns <= now_ns) {
+                entry.mac_key = 0;
+                break;
+            }
+            std::memcpy(out.data(), entry.data, entry.length);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return entry.length;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+void ReplyCache::invalidate(const MacAddress& mac_address) {
+    const uint64_t key = mac_key(mac_address);
+    Shard* shard;
+    Entry* set = set_for(key, shard);
+
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    for (size_t way = 0; way < kWays; ++way) {
+        if (set[way].mac_key == key) {
+            set[way].mac_key = 0;
+        }
+    }
+}
+
+void ReplyCache::clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        for (auto& entry : shards_[i].entries) {
+            entry.mac_key = 0;
+        }
+    }
+}
+
+} // namespace simple_dhcpd
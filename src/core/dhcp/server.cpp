@@ -9,11 +9,34 @@
 #include "simple-dhcpd/core/server.hpp"
 #include "simple-dhcpd/production/features/advanced_manager.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
+#include <algorithm>
 #include <csignal>
+#include <cstddef>
 #include <cstring>
+#include <arpa/inet.h>
 
 namespace simple_dhcpd {
 
+namespace {
+constexpr uint16_t kServerPort = 67;
+constexpr uint16_t kClientPort = 68;
+constexpr uint16_t kBroadcastFlag = 0x8000;
+
+// RFC 3074 splits the messages of clients without an address: DISCOVER and
+// the SELECTING/INIT-REBOOT REQUEST. Renewing and rebinding clients are
+// answered by whichever server they reach; both hold the lease.
+bool load_balanced(const DhcpMessageView& message) {
+    switch (message.message_type()) {
+        case DhcpMessageType::DISCOVER:
+            return true;
+        case DhcpMessageType::REQUEST:
+            return message.client_ip() == 0;
+        default:
+            return false;
+    }
+}
+}
+
 DhcpServer::DhcpServer(const std::string& config_file)
     : config_file_(config_file), running_(false), initialized_(false) {
     LOG_DEBUG("DHCP server created");
@@ -39,36 +62,77 @@ void DhcpServer::initialize() {
             config_manager_->set_config(get_default_config());
         }
         
+        // A replay only measures the server: nothing is stored, logged or sent to a peer
+        if (replay_sink_) {
+            DhcpConfig offline = config_manager_->get_config();
+            offline.enable_logging = false;
+            offline.lease_file.clear();
+            offline.lease_snapshot.clear();
+            offline.lease_journal.clear();
+            offline.advanced_lease_database.clear();
+            offline.failover_peer.clear();
+            offline.metrics_enabled = false;
+            offline.bulk_leasequery_address.clear();
+            offline.ping_check_enabled = false;
+            offline.ddns_server.clear();
+            config_manager_->set_config(offline);
+        }
+        
         // Initialize logger
         const auto& config = config_manager_->get_config();
-        if (config.enable_logging) {
-            init_logger(config.log_file, LogLevel::INFO);
-        } else {
-            init_logger("", LogLevel::WARN);
-        }
+        init_logging(config);
         
         // Initialize socket manager
         socket_manager_ = std::make_unique<DhcpSocketManager>();
-        socket_manager_->initialize(config);
+        if (replay_sink_) {
+            socket_manager_->set_reply_sink(replay_sink_);
+        } else {
+            socket_manager_->initialize(config);
+        }
+        
+        maintenance_loop_ = std::make_unique<EventLoop>(parse_event_backend(config.event_backend), "maintenance");
+        maintenance_loop_->start();
         
         if (!config.advanced_lease_database.empty()) {
             lease_manager_ = std::make_unique<AdvancedLeaseManager>(config, config.advanced_lease_database);
         } else {
             lease_manager_ = std::make_unique<LeaseManager>(config);
         }
-        lease_manager_->start();
+        lease_manager_->start(*maintenance_loop_);
 
-        if (!config.lease_file.empty() && config.advanced_lease_database.empty()) {
-            lease_manager_->load_leases(config.lease_file);
-        }
+        restore_leases(config);
 
         if (config.enable_security) {
-            security_manager_ = std::make_unique<DhcpSecurityManager>();
-            security_manager_->start();
+            security_manager_ = std::make_shared<DhcpSecurityManager>();
+            security_manager_->start(*maintenance_loop_);
             if (!config.security_policy_file.empty()) {
                 security_manager_->load_security_configuration(config.security_policy_file);
             }
         }
+        if (config.reply_cache_size > 0) {
+            reply_cache_ = std::make_unique<ReplyCache>(config.reply_cache_size,
+                                                        std::chrono::milliseconds(config.reply_cache_ttl_ms));
+        }
+        if (!config.failover_peer.empty()) {
+            replicator_ = std::make_unique<LeaseReplicator>(*lease_manager_,
+                                                            LeaseReplicator::parse_role(config.failover_role),
+                                                            config.failover_peer, config.failover_port,
+                                                            config.failover_split);
+        }
+        std::atomic_store(&snapshot_, build_snapshot(config, nullptr));
+        leasequery_ = std::make_unique<LeasequeryResponder>(*lease_manager_, std::atomic_load(&snapshot_)->server_id);
+        if (config.ping_check_enabled) {
+            ping_checker_ = std::make_unique<PingChecker>(*maintenance_loop_,
+                                                          std::chrono::milliseconds(config.ping_check_timeout_ms),
+                                                          std::chrono::seconds(config.ping_check_cache_seconds));
+        }
+        if (!config.ddns_server.empty()) {
+            ddns_ = std::make_unique<DdnsUpdater>(config);
+            DdnsUpdater* ddns = ddns_.get();
+            lease_manager_->set_lease_expiration_callback([ddns](const DhcpLease& lease) {
+                ddns->remove(lease.ip_address);
+            });
+        }
         
         initialized_ = true;
         LOG_INFO("DHCP server initialized successfully");
@@ -91,13 +155,57 @@ void DhcpServer::start() {
     }
     
     try {
+        // Catch up with the failover peer while the sockets open
+        if (replicator_) {
+            replicator_->start();
+        }
+        
         // Start socket manager
-        socket_manager_->start_all([this](const std::vector<uint8_t>& data, const std::string& client_address, uint16_t client_port) {
-            handle_dhcp_message(data, client_address, client_port);
-        });
+        socket_manager_->start_all(PacketCallback([this](const PacketBuffer& packet) {
+            handle_dhcp_message(packet);
+        }));
         
         running_ = true;
         LOG_INFO("DHCP server started");
+
+        const auto& config = config_manager_->get_config();
+        if (config.metrics_enabled) {
+            // Monitoring is optional; a port clash must not keep DHCP down
+            auto exporter = std::make_unique<MetricsExporter>(config.metrics_address, config.metrics_port,
+                                                              [this]() { return render_metrics(); });
+            try {
+                exporter->start();
+                metrics_exporter_ = std::move(exporter);
+            } catch (const MetricsExporterException& e) {
+                LOG_ERROR("Metrics endpoint disabled: " + std::string(e.what()));
+            }
+        }
+        if (ping_checker_) {
+            // Without an ICMP socket addresses are offered unprobed, as before
+            try {
+                ping_checker_->start();
+            } catch (const PingCheckException& e) {
+                LOG_ERROR("Ping check disabled: " + std::string(e.what()));
+            }
+        }
+        if (ddns_) {
+            // Events queue until the thread runs; without it they only count as dropped
+            try {
+                ddns_->start();
+            } catch (const DdnsException& e) {
+                LOG_ERROR("DDNS disabled: " + std::string(e.what()));
+            }
+        }
+        if (!config.bulk_leasequery_address.empty()) {
+            auto bulk = std::make_unique<BulkLeasequeryServer>(config.bulk_leasequery_address,
+                                                               config.bulk_leasequery_port, *leasequery_);
+            try {
+                bulk->start();
+                bulk_leasequery_ = std::move(bulk);
+            } catch (const LeasequeryException& e) {
+                LOG_ERROR("Bulk leasequery disabled: " + std::string(e.what()));
+            }
+        }
         
     } catch (const std::exception& e) {
         LOG_ERROR("Failed to start DHCP server: " + std::string(e.what()));
@@ -106,6 +214,17 @@ void DhcpServer::start() {
 }
 
 void DhcpServer::stop() {
+    // The endpoint renders under mutex_, so it is joined without holding it
+    std::unique_ptr<MetricsExporter> exporter;
+    std::unique_ptr<BulkLeasequeryServer> bulk;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exporter = std::move(metrics_exporter_);
+        bulk = std::move(bulk_leasequery_);
+    }
+    exporter.reset();
+    bulk.reset();
+
     std::lock_guard<std::mutex> lock(mutex_);
     
     if (!running_) {
@@ -113,12 +232,26 @@ void DhcpServer::stop() {
     }
     
     try {
+        // Pending offers are dropped; their clients retransmit
+        if (ping_checker_) {
+            ping_checker_->stop();
+        }
+        
         // Stop socket manager
         if (socket_manager_) {
             socket_manager_->stop_all();
         }
+        if (replicator_) {
+            replicator_->stop();
+        }
+        if (ddns_) {
+            ddns_->stop();
+        }
         
         // Save leases
+        if (lease_manager_ && !config_manager_->get_config().lease_snapshot.empty()) {
+            lease_manager_->save_snapshot(config_manager_->get_config().lease_snapshot);
+        }
         if (lease_manager_ && !config_manager_->get_config().lease_file.empty()) {
             lease_manager_->save_leases(config_manager_->get_config().lease_file);
         }
@@ -135,6 +268,9 @@ void DhcpServer::stop() {
         
         running_ = false;
         LOG_INFO("DHCP server stopped");
+        if (g_logger) {
+            g_logger->flush();
+        }
         
     } catch (const std::exception& e) {
         LOG_ERROR("Error stopping DHCP server: " + std::string(e.what()));
@@ -146,7 +282,16 @@ bool DhcpServer::is_running() const {
     return running_;
 }
 
+void DhcpServer::enable_replay(ReplySink sink) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (initialized_) {
+        throw DhcpServerException("Replay must be enabled before initialization");
+    }
+    replay_sink_ = std::move(sink);
+}
+
 void DhcpServer::reload_config() {
+    // Serializes control operations only; packet handlers never take mutex_
     std::lock_guard<std::mutex> lock(mutex_);
     
     if (!initialized_) {
@@ -154,40 +299,83 @@ void DhcpServer::reload_config() {
     }
     
     try {
-        // Reload configuration
-        config_manager_->reload_config();
+        const auto previous = std::atomic_load(&snapshot_);
+        const DhcpConfig& old_config = previous->config;
         
-        // Reinitialize components with new configuration
-        const auto& config = config_manager_->get_config();
+        // Parse and validate first; a bad file leaves the running configuration alone
+        auto config_manager = std::make_unique<ConfigManager>();
+        config_manager->load_config(config_manager_->get_config_file());
+        const DhcpConfig& config = config_manager->get_config();
         
-        // Update logger
-        if (config.enable_logging) {
-            init_logger(config.log_file, LogLevel::INFO);
+        if (config.listen_addresses != old_config.listen_addresses ||
+            config.worker_threads != old_config.worker_threads ||
+            config.io_batch_size != old_config.io_batch_size ||
+            config.io_flush_timeout_us != old_config.io_flush_timeout_us ||
+            config.event_backend != old_config.event_backend ||
+            config.raw_unicast_replies != old_config.raw_unicast_replies ||
+            config.reply_cache_size != old_config.reply_cache_size) {
+            LOG_WARN("Listen address and socket settings change on restart; keeping the open sockets");
         }
-        
-        // Reinitialize socket manager
-        socket_manager_->initialize(config);
-
-        if (security_manager_) {
-            security_manager_->stop();
-            security_manager_.reset();
+        if (config.lease_journal != old_config.lease_journal ||
+            config.lease_snapshot != old_config.lease_snapshot ||
+            config.advanced_lease_database != old_config.advanced_lease_database ||
+            config.lease_history_depth != old_config.lease_history_depth ||
+            config.lease_history_file != old_config.lease_history_file) {
+            LOG_WARN("Lease storage settings change on restart; keeping the running lease database");
+        }
+        if (config.failover_peer != old_config.failover_peer || config.failover_port != old_config.failover_port ||
+            config.failover_role != old_config.failover_role || config.failover_split != old_config.failover_split) {
+            LOG_WARN("Failover settings change on restart; keeping the peer connection");
+        }
+        if (config.ping_check_enabled != old_config.ping_check_enabled ||
+            config.ping_check_timeout_ms != old_config.ping_check_timeout_ms ||
+            config.ping_check_cache_seconds != old_config.ping_check_cache_seconds) {
+            LOG_WARN("Ping check settings change on restart; keeping the running checker");
+        }
+        if (config.ddns_server != old_config.ddns_server || config.ddns_port != old_config.ddns_port ||
+            config.ddns_forward_zone != old_config.ddns_forward_zone ||
+            config.ddns_reverse_zone != old_config.ddns_reverse_zone || config.ddns_ttl != old_config.ddns_ttl ||
+            config.ddns_tsig_key != old_config.ddns_tsig_key ||
+            config.ddns_tsig_secret != old_config.ddns_tsig_secret ||
+            config.ddns_queue_size != old_config.ddns_queue_size) {
+            LOG_WARN("DDNS settings change on restart; keeping the running updater");
+        }
+        if (config.bulk_leasequery_address != old_config.bulk_leasequery_address ||
+            config.bulk_leasequery_port != old_config.bulk_leasequery_port) {
+            LOG_WARN("Bulk leasequery settings change on restart; keeping the listener");
         }
+        if (config.enable_logging != old_config.enable_logging || config.log_file != old_config.log_file ||
+            config.log_async != old_config.log_async) {
+            init_logging(config);
+        }
+        
+        // The security manager keeps its rate limits and history; only its policy is reread
+        std::shared_ptr<DhcpSecurityManager> retired_security;
         if (config.enable_security) {
-            security_manager_ = std::make_unique<DhcpSecurityManager>();
-            security_manager_->start();
+            if (!security_manager_) {
+                security_manager_ = std::make_shared<DhcpSecurityManager>();
+                security_manager_->start(*maintenance_loop_);
+            }
             if (!config.security_policy_file.empty()) {
                 security_manager_->load_security_configuration(config.security_policy_file);
             }
-        }
-
-        if (!config.advanced_lease_database.empty()) {
-            lease_manager_ = std::make_unique<AdvancedLeaseManager>(config, config.advanced_lease_database);
         } else {
-            lease_manager_ = std::make_unique<LeaseManager>(config);
+            retired_security = std::move(security_manager_);
+        }
+        
+        lease_manager_->reconfigure(config);
+        std::atomic_store(&snapshot_, build_snapshot(config, previous.get()));
+        leasequery_->set_server_id(std::atomic_load(&snapshot_)->server_id);
+        if (reply_cache_) {
+            // Cached replies carry the old options
+            reply_cache_->set_ttl(std::chrono::milliseconds(config.reply_cache_ttl_ms));
+            reply_cache_->clear();
         }
-        lease_manager_->start();
-        if (!config.lease_file.empty() && config.advanced_lease_database.empty()) {
-            lease_manager_->load_leases(config.lease_file);
+        config_manager_ = std::move(config_manager);
+        
+        // Packets still holding the old snapshot keep the manager alive until they finish
+        if (retired_security) {
+            retired_security->stop();
         }
         
         LOG_INFO("Configuration reloaded successfully");
@@ -204,24 +392,181 @@ DhcpStats DhcpServer::get_statistics() const {
     if (lease_manager_) {
         merged = lease_manager_->get_statistics();
     }
+    const auto counts = packet_counters_.snapshot();
+    auto count = [&counts](PacketCounter counter) { return counts[static_cast<size_t>(counter)]; };
+    merged.total_requests = count(PacketCounter::TOTAL_REQUESTS);
+    merged.discover_count = count(PacketCounter::DISCOVER);
+    merged.request_count = count(PacketCounter::REQUEST);
+    merged.release_count = count(PacketCounter::RELEASE);
+    merged.decline_count = count(PacketCounter::DECLINE);
+    merged.inform_count = count(PacketCounter::INFORM);
+    merged.offer_count = count(PacketCounter::OFFER);
+    merged.ack_count = count(PacketCounter::ACK);
+    merged.nak_count = count(PacketCounter::NAK);
+    merged.total_errors = count(PacketCounter::ERRORS);
+    merged.reply_cache_hits = count(PacketCounter::REPLY_CACHE_HITS);
+    return merged;
+}
+
+std::vector<LatencySummary> DhcpServer::get_latency_statistics() const {
+    return latency_.summaries();
+}
+
+uint16_t DhcpServer::metrics_port() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metrics_exporter_ ? metrics_exporter_->port() : 0;
+}
+
+uint16_t DhcpServer::bulk_leasequery_port() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bulk_leasequery_ ? bulk_leasequery_->port() : 0;
+}
+
+DdnsStats DhcpServer::get_ddns_statistics() const {
+    return ddns_ ? ddns_->get_statistics() : DdnsStats();
+}
+
+std::string DhcpServer::render_metrics() const {
+    const DhcpStats stats = get_statistics();
+    std::vector<PoolUsage> pools;
+    std::unique_ptr<SecurityStats> security;
     {
-        std::lock_guard<std::mutex> sl(stats_mutex_);
-        merged.total_requests = packet_stats_.total_requests;
-        merged.discover_count = packet_stats_.discover_count;
-        merged.request_count = packet_stats_.request_count;
-        merged.release_count = packet_stats_.release_count;
-        merged.decline_count = packet_stats_.decline_count;
-        merged.inform_count = packet_stats_.inform_count;
-        merged.offer_count = packet_stats_.offer_count;
-        merged.ack_count = packet_stats_.ack_count;
-        merged.nak_count = packet_stats_.nak_count;
-        merged.total_errors = packet_stats_.total_errors;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (lease_manager_) {
+            pools = lease_manager_->get_pool_usage();
+        }
+        if (security_manager_) {
+            security = std::make_unique<SecurityStats>(security_manager_->get_security_statistics());
+        }
     }
-    return merged;
+
+    MetricsText text;
+    text.family("simple_dhcpd_requests_total", "counter", "DHCP messages received");
+    text.sample("simple_dhcpd_requests_total", stats.total_requests);
+    text.family("simple_dhcpd_messages_received_total", "counter", "DHCP messages received by type");
+    text.sample("simple_dhcpd_messages_received_total", stats.discover_count, {{"type", "discover"}});
+    text.sample("simple_dhcpd_messages_received_total", stats.request_count, {{"type", "request"}});
+    text.sample("simple_dhcpd_messages_received_total", stats.release_count, {{"type", "release"}});
+    text.sample("simple_dhcpd_messages_received_total", stats.decline_count, {{"type", "decline"}});
+    text.sample("simple_dhcpd_messages_received_total", stats.inform_count, {{"type", "inform"}});
+    text.family("simple_dhcpd_replies_sent_total", "counter", "DHCP replies sent by type");
+    text.sample("simple_dhcpd_replies_sent_total", stats.offer_count, {{"type", "offer"}});
+    text.sample("simple_dhcpd_replies_sent_total", stats.ack_count, {{"type", "ack"}});
+    text.sample("simple_dhcpd_replies_sent_total", stats.nak_count, {{"type", "nak"}});
+    text.family("simple_dhcpd_reply_cache_hits_total", "counter", "Retransmitted requests answered from the reply cache");
+    text.sample("simple_dhcpd_reply_cache_hits_total", stats.reply_cache_hits);
+    text.family("simple_dhcpd_errors_total", "counter", "Messages that failed to parse or be handled");
+    text.sample("simple_dhcpd_errors_total", stats.total_errors);
+    text.family("simple_dhcpd_early_drops_total", "counter", "Packets dropped before parsing, by reason");
+    for (size_t i = 1; i < static_cast<size_t>(EarlyDropReason::COUNT); ++i) {
+        const auto reason = static_cast<EarlyDropReason>(i);
+        text.sample("simple_dhcpd_early_drops_total", early_drops_.get(reason), {{"reason", early_drop_reason_name(reason)}});
+    }
+    if (replicator_) {
+        const ReplicationStats replication = replicator_->get_statistics();
+        text.family("simple_dhcpd_failover_peer_up", "gauge", "1 while the failover peer is connected and the load is split");
+        text.sample("simple_dhcpd_failover_peer_up", uint64_t(replication.peer_up ? 1 : 0));
+        text.family("simple_dhcpd_failover_records_total", "counter", "Lease records replicated with the failover peer");
+        text.sample("simple_dhcpd_failover_records_total", replication.records_sent, {{"direction", "sent"}});
+        text.sample("simple_dhcpd_failover_records_total", replication.records_acked, {{"direction", "acked"}});
+        text.sample("simple_dhcpd_failover_records_total", replication.records_received, {{"direction", "received"}});
+        text.family("simple_dhcpd_failover_resyncs_total", "counter", "Full lease tables sent to the failover peer");
+        text.sample("simple_dhcpd_failover_resyncs_total", replication.resyncs);
+        text.family("simple_dhcpd_failover_peer_bucket_drops_total", "counter",
+                    "Messages left to the failover peer by load balancing");
+        text.sample("simple_dhcpd_failover_peer_bucket_drops_total",
+                    packet_counters_.get(PacketCounter::PEER_BUCKET));
+    }
+    if (ping_checker_ && ping_checker_->is_running()) {
+        text.family("simple_dhcpd_ping_checks_total", "counter", "Addresses probed before being offered, by outcome");
+        text.sample("simple_dhcpd_ping_checks_total", ping_checker_->probes_timed_out(), {{"result", "free"}});
+        text.sample("simple_dhcpd_ping_checks_total", ping_checker_->probes_answered(), {{"result", "in_use"}});
+        text.family("simple_dhcpd_ping_check_cache_hits_total", "counter", "Offers that reused a recent probe result");
+        text.sample("simple_dhcpd_ping_check_cache_hits_total", ping_checker_->cache_hits());
+    }
+    if (ddns_) {
+        const DdnsStats ddns = ddns_->get_statistics();
+        text.family("simple_dhcpd_ddns_queue_depth", "gauge", "Lease events and address changes not yet in DNS");
+        text.sample("simple_dhcpd_ddns_queue_depth", ddns.queue_depth);
+        text.family("simple_dhcpd_ddns_updates_total", "counter", "Address changes sent to DNS, by outcome");
+        text.sample("simple_dhcpd_ddns_updates_total", ddns.records_updated, {{"result", "confirmed"}});
+        text.sample("simple_dhcpd_ddns_updates_total", ddns.failures, {{"result", "failed"}});
+        text.family("simple_dhcpd_ddns_dropped_total", "counter", "Lease events dropped because the DDNS queue was full");
+        text.sample("simple_dhcpd_ddns_dropped_total", ddns.dropped);
+        text.family("simple_dhcpd_ddns_coalesced_total", "counter", "Lease events folded into a later one or already in DNS");
+        text.sample("simple_dhcpd_ddns_coalesced_total", ddns.coalesced);
+        text.family("simple_dhcpd_ddns_retries_total", "counter", "DDNS batches sent again after a failure");
+        text.sample("simple_dhcpd_ddns_retries_total", ddns.retries);
+        text.family("simple_dhcpd_ddns_update_latency_seconds", "summary", "Time from lease event to DNS confirmation");
+        text.sample("simple_dhcpd_ddns_update_latency_seconds", ddns.latency_p50_ns / 1e9, {{"quantile", "0.5"}});
+        text.sample("simple_dhcpd_ddns_update_latency_seconds", ddns.latency_p99_ns / 1e9, {{"quantile", "0.99"}});
+        text.sample("simple_dhcpd_ddns_update_latency_seconds_sum", ddns.latency_sum_ns / 1e9);
+        text.sample("simple_dhcpd_ddns_update_latency_seconds_count", ddns.latency_count);
+    }
+    text.family("simple_dhcpd_active_leases", "gauge", "Leases currently held");
+    text.sample("simple_dhcpd_active_leases", stats.active_leases);
+
+    text.family("simple_dhcpd_pool_addresses", "gauge", "Addresses in the dynamic range, minus exclusions");
+    for (const auto& pool : pools) {
+        text.sample("simple_dhcpd_pool_addresses", static_cast<uint64_t>(pool.addresses), {{"subnet", pool.subnet_name}});
+    }
+    text.family("simple_dhcpd_pool_free_addresses", "gauge", "Addresses neither leased, offered nor held after a decline");
+    for (const auto& pool : pools) {
+        text.sample("simple_dhcpd_pool_free_addresses", static_cast<uint64_t>(pool.free), {{"subnet", pool.subnet_name}});
+    }
+    text.family("simple_dhcpd_pool_offered_addresses", "gauge", "Addresses held for clients between OFFER and REQUEST");
+    for (const auto& pool : pools) {
+        text.sample("simple_dhcpd_pool_offered_addresses", static_cast<uint64_t>(pool.offered), {{"subnet", pool.subnet_name}});
+    }
+    text.family("simple_dhcpd_pool_utilization_ratio", "gauge", "Fraction of the pool in use");
+    for (const auto& pool : pools) {
+        const double ratio = pool.addresses == 0 ? 0.0
+            : static_cast<double>(pool.addresses - pool.free) / static_cast<double>(pool.addresses);
+        text.sample("simple_dhcpd_pool_utilization_ratio", ratio, {{"subnet", pool.subnet_name}});
+    }
+
+    if (security) {
+        static const char* const level_names[] = {"low", "medium", "high", "critical"};
+        text.family("simple_dhcpd_security_requests_total", "counter", "Requests passed or refused by security checks");
+        text.sample("simple_dhcpd_security_requests_total", static_cast<uint64_t>(security->allowed_requests),
+                    {{"result", "allowed"}});
+        text.sample("simple_dhcpd_security_requests_total", static_cast<uint64_t>(security->blocked_requests),
+                    {{"result", "blocked"}});
+        text.family("simple_dhcpd_security_checks_total", "counter", "Security check outcomes");
+        for (const auto& entry : security->stats) {
+            text.sample("simple_dhcpd_security_checks_total", static_cast<uint64_t>(entry.second),
+                        {{"check", entry.first}});
+        }
+        text.family("simple_dhcpd_security_events_total", "counter", "Security events reported by threat level");
+        for (size_t level = 0; level < 4; ++level) {
+            text.sample("simple_dhcpd_security_events_total", static_cast<uint64_t>(security->events_by_level[level]),
+                        {{"level", level_names[level]}});
+        }
+    }
+
+    const auto latencies = latency_.summaries();
+    if (!latencies.empty()) {
+        static const std::pair<const char*, uint64_t LatencySummary::*> quantiles[] = {
+            {"0.5", &LatencySummary::p50_ns}, {"0.9", &LatencySummary::p90_ns},
+            {"0.99", &LatencySummary::p99_ns}, {"0.999", &LatencySummary::p999_ns}};
+        text.family("simple_dhcpd_stage_latency_seconds", "summary", "Packet pipeline time per stage and message type");
+        for (const auto& summary : latencies) {
+            std::string type = summary.message_type;
+            std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+            for (const auto& quantile : quantiles) {
+                text.sample("simple_dhcpd_stage_latency_seconds", static_cast<double>(summary.*quantile.second) / 1e9,
+                            {{"stage", summary.stage}, {"type", type}, {"quantile", quantile.first}});
+            }
+            text.sample("simple_dhcpd_stage_latency_seconds_sum", static_cast<double>(summary.sum_ns) / 1e9,
+                        {{"stage", summary.stage}, {"type", type}});
+            text.sample("simple_dhcpd_stage_latency_seconds_count", summary.count,
+                        {{"stage", summary.stage}, {"type", type}});
+        }
+    }
+    return text.str();
 }
 
-IpAddress DhcpServer::dhcp_server_ip(const DhcpSubnet* subnet) const {
-    const auto& c = config_manager_->get_config();
+IpAddress DhcpServer::dhcp_server_ip(const DhcpConfig& c, const DhcpSubnet* subnet) {
     if (c.server_identifier != 0) {
         return c.server_identifier;
     }
@@ -234,26 +579,90 @@ IpAddress DhcpServer::dhcp_server_ip(const DhcpSubnet* subnet) const {
     return string_to_ip("192.168.1.1");
 }
 
-bool DhcpServer::security_allow_message(const DhcpMessage& message, const std::string& recv_interface) {
-    if (!security_manager_) {
-        return true;
+void DhcpServer::init_logging(const DhcpConfig& config) {
+    if (config.enable_logging) {
+        init_logger(config.log_file, LogLevel::INFO);
+    } else {
+        init_logger("", LogLevel::WARN);
     }
-    if (!security_manager_->validate_dhcp_message(message, recv_interface)) {
-        return false;
+    if (config.log_async) {
+        get_logger().start_async(config.log_buffer_lines,
+                                 std::chrono::milliseconds(config.log_flush_interval_ms),
+                                 config.log_block_when_full ? LogOverflowPolicy::BLOCK : LogOverflowPolicy::DROP);
     }
-    const std::string mac_str = mac_to_string(message.client_mac);
-    if (!security_manager_->check_mac_address(mac_str)) {
-        return false;
+}
+
+void DhcpServer::restore_leases(const DhcpConfig& config) {
+    if (!config.lease_journal.empty()) {
+        lease_manager_->open_journal(config.lease_journal);
+        return;
     }
-    if (!security_manager_->check_ip_address(message.client_ip)) {
-        return false;
+    if (!config.lease_snapshot.empty() && lease_manager_->load_snapshot(config.lease_snapshot)) {
+        return;
+    }
+    // No binary state yet: import the text lease file
+    if (!config.lease_file.empty() && config.advanced_lease_database.empty()) {
+        lease_manager_->load_leases(config.lease_file);
+    }
+}
+
+std::shared_ptr<const DhcpServer::ConfigSnapshot> DhcpServer::build_snapshot(const DhcpConfig& config,
+                                                                            const ConfigSnapshot* previous) const {
+    auto snapshot = std::make_shared<ConfigSnapshot>();
+    snapshot->config = config;
+    snapshot->subnets = lease_manager_->subnet_table();
+    snapshot->security = security_manager_;
+    snapshot->server_id = dhcp_server_ip(config, nullptr);
+    
+    // The server identifier falls back to the first gateway, so a change there touches every subnet
+    const bool same_server_id = previous && previous->server_id == snapshot->server_id;
+    const SubnetTable& subnets = *snapshot->subnets;
+    snapshot->subnet_options.resize(subnets.slots());
+    size_t compiled = 0;
+    for (SubnetId id = 0; id < subnets.slots(); ++id) {
+        if (subnets.retired(id)) {
+            continue;
+        }
+        if (same_server_id && subnets.change(id) == SubnetChange::UNCHANGED && id < previous->subnet_options.size()) {
+            snapshot->subnet_options[id] = previous->subnet_options[id];
+            continue;
+        }
+        const DhcpSubnet& subnet = subnets.subnet(id);
+        snapshot->subnet_options[id] = CompiledSubnetOptions::compile(subnet, dhcp_server_ip(config, &subnet));
+        ++compiled;
+    }
+    if (previous) {
+        LOG_INFO("Recompiled reply options for " + std::to_string(compiled) + " of " +
+                 std::to_string(subnets.size()) + " subnets");
+    }
+    return snapshot;
+}
+
+bool DhcpServer::security_allow_message(DhcpSecurityManager* security, const DhcpMessageView& message,
+                                        const std::string& recv_interface) {
+    if (!security) {
+        return true;
     }
-    if (!security_manager_->check_rate_limit(mac_str, "mac")) {
+    if (security->is_dhcp_snooping_enabled()) {
+        // Snooping only looks at the addresses and type, so skip copying options
+        DhcpMessage summary;
+        summary.header = message.header();
+        summary.message_type = message.message_type();
+        summary.client_mac = message.client_mac();
+        summary.client_ip = message.client_ip();
+        summary.server_ip = message.server_ip();
+        summary.relay_ip = message.relay_ip();
+        if (!security->validate_dhcp_message(summary, recv_interface)) {
+            return false;
+        }
+    }
+    // The MAC filter and rate limit already ran in early_drop_reason()
+    if (!security->check_ip_address(message.client_ip())) {
         return false;
     }
-    for (const auto& opt : message.options) {
-        if (opt.code == DhcpOptionCode::RELAY_AGENT_INFORMATION) {
-            if (!security_manager_->validate_option_82(opt.data, recv_interface)) {
+    for (size_t i = 0; i < message.option_count(); ++i) {
+        if (message.option_code_at(i) == DhcpOptionCode::RELAY_AGENT_INFORMATION) {
+            if (!security->validate_option_82(message.option_data_at(i), recv_interface)) {
                 return false;
             }
         }
@@ -266,70 +675,127 @@ void DhcpServer::set_signal_handler(std::function<void(int)> handler) {
     // This method is kept for interface compatibility
 }
 
-void DhcpServer::handle_dhcp_message(const std::vector<uint8_t>& data, const std::string& client_address, uint16_t client_port) {
+EarlyDropReason DhcpServer::early_drop_reason(DhcpSecurityManager* security, const PacketBuffer& packet) {
+    const EarlyDropReason header = EarlyDropFilter::check_header(packet.data(), packet.size());
+    if (header != EarlyDropReason::NONE || !security) {
+        return header;
+    }
+    const MacAddress client_mac = EarlyDropFilter::chaddr(packet.data());
+    if (!security->check_mac_address(client_mac)) {
+        return EarlyDropReason::MAC_FILTER;
+    }
+    if (!security->check_rate_limit(client_mac)) {
+        return EarlyDropReason::RATE_LIMIT;
+    }
+    return EarlyDropReason::NONE;
+}
+
+void DhcpServer::handle_dhcp_message(const PacketBuffer& packet) {
+    latency_.begin();
+    // One snapshot per packet: a reload in the middle does not mix configurations
+    const auto snapshot = std::atomic_load(&snapshot_);
+    
+    // Spoofed floods and junk are refused from the raw header, before any parsing
+    const EarlyDropReason drop = early_drop_reason(snapshot->security.get(), packet);
+    if (drop != EarlyDropReason::NONE) {
+        early_drops_.increment(drop);
+        packet_counters_.increment(PacketCounter::ERRORS);
+        latency_.finish();
+        return;
+    }
+    
     try {
-        // Parse DHCP message
-        DhcpMessage message = DhcpParser::parse_message(data);
+        // Parse DHCP message in place; options stay in the packet buffer
+        DhcpMessageView message = DhcpParser::parse_view(packet);
+        latency_.set_message_type(message.message_type());
+        latency_.mark(PipelineStage::PARSE);
+        
+        if (replicator_ && load_balanced(message) && !replicator_->serves(message.client_mac())) {
+            packet_counters_.increment(PacketCounter::PEER_BUCKET);
+            latency_.finish();
+            return;
+        }
 
-        if (!security_allow_message(message, std::string())) {
+        if (!security_allow_message(snapshot->security.get(), message, packet.ingress().interface_name)) {
             LOG_WARN("DHCP message rejected by security policy");
-            std::lock_guard<std::mutex> sl(stats_mutex_);
-            packet_stats_.total_errors++;
+            packet_counters_.increment(PacketCounter::ERRORS);
+            latency_.finish();
             return;
         }
+        latency_.mark(PipelineStage::SECURITY);
         
         // Log message
         log_dhcp_message(message, "Received");
         
         // Update statistics
-        update_statistics(message.message_type);
+        update_statistics(message.message_type());
+        
+        // A retransmission keeps its xid: send the reply already built for it
+        if (reply_cache_ && answer_from_cache(message)) {
+            latency_.finish();
+            return;
+        }
         
         // Handle message based on type
-        switch (message.message_type) {
+        switch (message.message_type()) {
             case DhcpMessageType::DISCOVER:
-                handle_discover(message, client_address, client_port);
+                handle_discover(*snapshot, message);
                 break;
                 
             case DhcpMessageType::REQUEST:
-                handle_request(message, client_address, client_port);
+                handle_request(*snapshot, message);
                 break;
                 
             case DhcpMessageType::RELEASE:
-                handle_release(message, client_address, client_port);
+                handle_release(*snapshot, message);
                 break;
                 
             case DhcpMessageType::DECLINE:
-                handle_decline(message, client_address, client_port);
+                handle_decline(*snapshot, message);
                 break;
                 
             case DhcpMessageType::INFORM:
-                handle_inform(message, client_address, client_port);
+                handle_inform(*snapshot, message);
+                break;
+                
+            case DhcpMessageType::LEASEQUERY:
+                handle_leasequery(*snapshot, message);
                 break;
                 
             default:
-                LOG_WARN("Unsupported DHCP message type: " + get_message_type_name(message.message_type));
+                LOG_WARN("Unsupported DHCP message type: " + get_message_type_name(message.message_type()));
                 break;
         }
+        latency_.finish();
         
     } catch (const std::exception& e) {
         LOG_ERROR("Error handling DHCP message: " + std::string(e.what()));
-        std::lock_guard<std::mutex> sl(stats_mutex_);
-        packet_stats_.total_errors++;
+        packet_counters_.increment(PacketCounter::ERRORS);
+        latency_.finish();
     }
 }
 
-void DhcpServer::handle_discover(const DhcpMessage& message, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::handle_discover(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
     try {
         // Find appropriate subnet
-        std::string subnet_name = find_subnet_for_client(message);
+        const SubnetId subnet_id = find_subnet_for_client(snapshot, message);
         
-        // Allocate lease
-        DhcpLease lease = lease_manager_->allocate_lease(message.client_mac, message.client_ip, subnet_name);
+        // Hold an address until the client's REQUEST; the lease is created on ACK
+        const uint32_t offer_hold = snapshot.config.offer_hold_seconds;
+        if (offer_hold > 0 && ping_checker_ && ping_checker_->is_running()) {
+            offer_after_ping_check(snapshot, message, subnet_id, 0);
+            return;
+        }
+        DhcpLease lease = offer_hold > 0
+            ? lease_manager_->reserve_offer(message.client_mac(), message.client_ip(), subnet_id,
+                                            std::chrono::seconds(offer_hold))
+            : lease_manager_->allocate_lease(message.client_mac(), message.client_ip(), subnet_id);
+        latency_.mark(PipelineStage::LEASE);
         
         // Send offer
-        send_offer(message, lease, client_address, client_port);
+        send_offer(snapshot, message, lease, subnet_id);
         
-        LOG_INFO("Sent DHCP Offer to " + mac_to_string(message.client_mac) + 
+        LOG_INFO("Sent DHCP Offer to " + mac_to_string(message.client_mac()) + 
                  " for " + ip_to_string(lease.ip_address));
         
     } catch (const std::exception& e) {
@@ -337,29 +803,112 @@ void DhcpServer::handle_discover(const DhcpMessage& message, const std::string&
     }
 }
 
-void DhcpServer::handle_request(const DhcpMessage& message, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::offer_after_ping_check(const ConfigSnapshot& snapshot, const DhcpMessageView& message,
+                                        SubnetId subnet_id, uint32_t attempt) {
+    const std::chrono::seconds hold(snapshot.config.offer_hold_seconds);
+    for (; attempt < kMaxPingAttempts; ++attempt) {
+        DhcpLease lease = lease_manager_->reserve_offer(message.client_mac(), message.client_ip(), subnet_id, hold);
+        latency_.mark(PipelineStage::LEASE);
+        
+        // The client's own lease would answer for the client
+        const PingStatus known = lease.is_active ? PingStatus::FREE : ping_checker_->cached(lease.ip_address);
+        if (known == PingStatus::IN_USE) {
+            decline_answering_address(snapshot, message.client_mac(), lease.ip_address, subnet_id);
+            continue;
+        }
+        if (known == PingStatus::UNKNOWN) {
+            auto pending = std::make_shared<PendingOffer>();
+            pending->packet.assign(message.raw().data(), message.raw().data() + message.raw().size());
+            const PacketIngress* ingress = UdpSocket::current_ingress();
+            pending->has_ingress = ingress != nullptr;
+            if (ingress) {
+                pending->ingress = *ingress;
+            }
+            pending->subnet_id = subnet_id;
+            pending->lease = lease;
+            pending->attempt = attempt;
+            if (ping_checker_->probe(lease.ip_address,
+                                     [this, pending](bool in_use) { complete_ping_check(*pending, in_use); })) {
+                return;
+            }
+            // Not probed (checker stopping, too many probes out): offer as without a check
+        }
+        
+        send_offer(snapshot, message, lease, subnet_id);
+        LOG_INFO("Sent DHCP Offer to " + mac_to_string(message.client_mac()) +
+                 " for " + ip_to_string(lease.ip_address));
+        return;
+    }
+    LOG_WARN("No offer for " + mac_to_string(message.client_mac()) + ": " + std::to_string(kMaxPingAttempts) +
+             " addresses in a row answered ping");
+}
+
+void DhcpServer::complete_ping_check(const PendingOffer& pending, bool in_use) {
+    if (!running_) {
+        return;
+    }
+    const auto snapshot = std::atomic_load(&snapshot_);
+    if (pending.has_ingress) {
+        UdpSocket::set_current_ingress(&pending.ingress);
+    }
+    try {
+        const DhcpMessageView message(pending.packet.data(), pending.packet.size());
+        // Only the stages after the probe are timed here
+        latency_.begin();
+        latency_.set_message_type(DhcpMessageType::DISCOVER);
+        if (!in_use) {
+            send_offer(*snapshot, message, pending.lease, pending.subnet_id);
+            LOG_INFO("Sent DHCP Offer to " + mac_to_string(message.client_mac()) +
+                     " for " + ip_to_string(pending.lease.ip_address) + " after ping check");
+        } else {
+            decline_answering_address(*snapshot, message.client_mac(), pending.lease.ip_address, pending.subnet_id);
+            offer_after_ping_check(*snapshot, message, pending.subnet_id, pending.attempt + 1);
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("Error completing ping check: " + std::string(e.what()));
+    }
+    UdpSocket::set_current_ingress(nullptr);
+}
+
+void DhcpServer::decline_answering_address(const ConfigSnapshot& snapshot, const MacAddress& mac_address,
+                                           IpAddress ip_address, SubnetId subnet_id) {
+    LOG_WARN("Address " + ip_to_string(ip_address) + " answers ping; holding it as declined");
+    lease_manager_->add_declined_ip(ip_address, std::chrono::seconds(snapshot.config.decline_hold_seconds));
+    lease_manager_->withdraw_offer(mac_address, subnet_id);
+}
+
+void DhcpServer::handle_request(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
     try {
+        const SubnetId subnet_id = find_subnet_for_client(snapshot, message);
+        
         // Check if client has existing lease
-        auto existing_lease = lease_manager_->get_lease_by_mac(message.client_mac);
+        auto existing_lease = lease_manager_->get_lease_by_mac(message.client_mac());
         
         if (existing_lease) {
             // Renew existing lease
-            DhcpLease lease = lease_manager_->renew_lease(message.client_mac, message.client_ip);
+            DhcpLease lease = lease_manager_->renew_lease(message.client_mac(), message.client_ip());
+            latency_.mark(PipelineStage::LEASE);
             
             // Send ACK
-            send_ack(message, lease, client_address, client_port);
+            send_ack(snapshot, message, lease, subnet_id);            
+            if (ddns_) {
+                ddns_->add(DdnsUpdater::host_label(message.option_data(DhcpOptionCode::HOST_NAME)), lease.ip_address);
+            }
             
-            LOG_INFO("Sent DHCP ACK to " + mac_to_string(message.client_mac) + 
+            LOG_INFO("Sent DHCP ACK to " + mac_to_string(message.client_mac()) + 
                      " for " + ip_to_string(lease.ip_address));
         } else {
             // Allocate new lease
-            std::string subnet_name = find_subnet_for_client(message);
-            DhcpLease lease = lease_manager_->allocate_lease(message.client_mac, message.client_ip, subnet_name);
+            DhcpLease lease = lease_manager_->allocate_lease(message.client_mac(), message.client_ip(), subnet_id);
+            latency_.mark(PipelineStage::LEASE);
             
             // Send ACK
-            send_ack(message, lease, client_address, client_port);
+            send_ack(snapshot, message, lease, subnet_id);            
+            if (ddns_) {
+                ddns_->add(DdnsUpdater::host_label(message.option_data(DhcpOptionCode::HOST_NAME)), lease.ip_address);
+            }
             
-            LOG_INFO("Sent DHCP ACK to " + mac_to_string(message.client_mac) + 
+            LOG_INFO("Sent DHCP ACK to " + mac_to_string(message.client_mac()) + 
                      " for " + ip_to_string(lease.ip_address));
         }
         
@@ -367,21 +916,25 @@ void DhcpServer::handle_request(const DhcpMessage& message, const std::string& c
         LOG_ERROR("Error handling DHCP Request: " + std::string(e.what()));
         
         // Send NAK
-        send_nak(message, client_address, client_port);
+        send_nak(snapshot, message);
     }
 }
 
-void DhcpServer::handle_release(const DhcpMessage& message, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::handle_release(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
     try {
         // Release lease
-        bool released = lease_manager_->release_lease(message.client_mac, message.client_ip);
+        bool released = lease_manager_->release_lease(message.client_mac(), message.client_ip());
+        latency_.mark(PipelineStage::LEASE);
         
         if (released) {
-            LOG_INFO("Released lease for " + mac_to_string(message.client_mac) + 
-                     " at " + ip_to_string(message.client_ip));
+            if (ddns_) {
+                ddns_->remove(message.client_ip());
+            }
+            LOG_INFO("Released lease for " + mac_to_string(message.client_mac()) + 
+                     " at " + ip_to_string(message.client_ip()));
         } else {
-            LOG_WARN("Failed to release lease for " + mac_to_string(message.client_mac) + 
-                     " at " + ip_to_string(message.client_ip));
+            LOG_WARN("Failed to release lease for " + mac_to_string(message.client_mac()) + 
+                     " at " + ip_to_string(message.client_ip()));
         }
         
     } catch (const std::exception& e) {
@@ -389,131 +942,92 @@ void DhcpServer::handle_release(const DhcpMessage& message, const std::string& c
     }
 }
 
-void DhcpServer::handle_decline(const DhcpMessage& message, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::handle_decline(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
     try {
-        auto existing_lease = lease_manager_->get_lease_by_mac(message.client_mac);
-        IpAddress declined_ip = message.client_ip;
+        auto existing_lease = lease_manager_->get_lease_by_mac(message.client_mac());
+        IpAddress declined_ip = message.client_ip();
         if (declined_ip == 0 && existing_lease) {
             declined_ip = existing_lease->ip_address;
         }
         LOG_INFO("Client declined IP " + ip_to_string(declined_ip) +
-                 " for " + mac_to_string(message.client_mac));
+                 " for " + mac_to_string(message.client_mac()));
 
         if (existing_lease) {
-            lease_manager_->release_lease(message.client_mac, existing_lease->ip_address);
+            lease_manager_->release_lease(message.client_mac(), existing_lease->ip_address);
+            if (ddns_) {
+                ddns_->remove(existing_lease->ip_address);
+            }
         }
         if (declined_ip != 0) {
-            const auto& cfg = config_manager_->get_config();
-            lease_manager_->add_declined_ip(declined_ip, std::chrono::seconds(cfg.decline_hold_seconds));
+            lease_manager_->add_declined_ip(declined_ip, std::chrono::seconds(snapshot.config.decline_hold_seconds));
         }
+        latency_.mark(PipelineStage::LEASE);
         
     } catch (const std::exception& e) {
         LOG_ERROR("Error handling DHCP Decline: " + std::string(e.what()));
     }
 }
 
-void DhcpServer::handle_inform(const DhcpMessage& message, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::handle_inform(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
     try {
         // Handle inform request (client already has IP)
-        LOG_INFO("Received DHCP Inform from " + mac_to_string(message.client_mac));
+        LOG_INFO("Received DHCP Inform from " + mac_to_string(message.client_mac()));
         
         // Find appropriate subnet
-        std::string subnet_name = find_subnet_for_client(message);
-        const auto& config = config_manager_->get_config();
-        const DhcpSubnet* subnet = nullptr;
+        const CompiledSubnetOptions& options = snapshot.subnet_options[find_subnet_for_client(snapshot, message)];
+        latency_.mark(PipelineStage::LEASE);
         
-        for (const auto& s : config.subnets) {
-            if (s.name == subnet_name) {
-                subnet = &s;
-                break;
-            }
-        }
-        
-        if (!subnet) {
-            LOG_WARN("No subnet found for DHCP Inform from " + mac_to_string(message.client_mac));
-            return;
-        }
-
-        const IpAddress sid = dhcp_server_ip(subnet);
-        DhcpMessageBuilder builder;
-        builder.set_message_type(DhcpMessageType::ACK)
-               .set_transaction_id(message.header.xid)
-               .set_client_mac(message.client_mac)
-               .set_your_ip(message.client_ip)
-               .set_server_ip(sid)
-               .add_option(DhcpOptionCode::DHCP_MESSAGE_TYPE, 
-                          std::vector<uint8_t>{message_type_to_option_value(DhcpMessageType::ACK)})
-               .add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, sid);
-        
-        // Add subnet options
-        auto options = build_subnet_options(*subnet);
-        for (const auto& option : options) {
-            builder.add_option(option);
-        }
-        
-        DhcpMessage ack = builder.build();
+        // yiaddr stays zero: the client already has its address (RFC 2131 3.4)
+        DhcpMessageWriter& writer = begin_reply(message, DhcpMessageType::ACK, 0, options.server_id());
+        options.write_without_lease(writer, options.server_id());
+        const ByteView reply = writer.finish();
+        latency_.mark(PipelineStage::REPLY);
         
         // Send ACK
-        socket_manager_->send_dhcp_message(ack, client_address, client_port);
-        {
-            std::lock_guard<std::mutex> sl(stats_mutex_);
-            packet_stats_.ack_count++;
-        }
+        socket_manager_->send_dhcp_reply(reply, route_reply(message, DhcpMessageType::ACK, 0));
+        latency_.mark(PipelineStage::SEND);
+        packet_counters_.increment(PacketCounter::ACK);
         
-        LOG_INFO("Sent DHCP ACK to " + mac_to_string(message.client_mac) + " for Inform");
+        LOG_INFO("Sent DHCP ACK to " + mac_to_string(message.client_mac()) + " for Inform");
         
     } catch (const std::exception& e) {
         LOG_ERROR("Error handling DHCP Inform: " + std::string(e.what()));
     }
 }
 
-void DhcpServer::send_offer(const DhcpMessage& message, const DhcpLease& lease, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::handle_leasequery(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
+    // RFC 4388 6.1: only relay agents ask, and the answer goes back to them
+    if (!snapshot.config.leasequery_enabled || message.relay_ip() == 0) {
+        LOG_DEBUG("Ignoring DHCP Leasequery from " + ip_to_string(message.client_ip()));
+        return;
+    }
     try {
-        // Find subnet for lease
-        std::string subnet_name = find_subnet_for_client(message);
-        const auto& config = config_manager_->get_config();
-        const DhcpSubnet* subnet = nullptr;
+        const ByteView reply = leasequery_->answer(message, DhcpMessageWriter::for_current_thread());
+        latency_.mark(PipelineStage::REPLY);
+        socket_manager_->send_dhcp_reply(reply, route_reply(message, DhcpMessageType::LEASEACTIVE, 0));
+        latency_.mark(PipelineStage::SEND);
         
-        for (const auto& s : config.subnets) {
-            if (s.name == subnet_name) {
-                subnet = &s;
-                break;
-            }
-        }
-        
-        if (!subnet) {
-            throw DhcpServerException("Subnet not found: " + subnet_name);
-        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("Error handling DHCP Leasequery: " + std::string(e.what()));
+    }
+}
 
-        const IpAddress sid = dhcp_server_ip(subnet);
-        DhcpMessageBuilder builder;
-        builder.set_message_type(DhcpMessageType::OFFER)
-               .set_transaction_id(message.header.xid)
-               .set_client_mac(message.client_mac)
-               .set_your_ip(lease.ip_address)
-               .set_server_ip(sid)
-               .add_option(DhcpOptionCode::DHCP_MESSAGE_TYPE, 
-                          std::vector<uint8_t>{message_type_to_option_value(DhcpMessageType::OFFER)})
-               .add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, sid);
-        
-        // Add subnet options
-        auto options = build_subnet_options(*subnet);
-        for (const auto& option : options) {
-            builder.add_option(option);
-        }
-        
-        // Add lease options
-        auto lease_options = build_lease_options(lease, *subnet);
-        for (const auto& option : lease_options) {
-            builder.add_option(option);
-        }
+void DhcpServer::send_offer(const ConfigSnapshot& snapshot, const DhcpMessageView& message, const DhcpLease& lease, SubnetId subnet_id) {
+    try {
+        const auto& subnet = snapshot.subnets->subnet(subnet_id);
+        const CompiledSubnetOptions& options = snapshot.subnet_options[subnet_id];
         
-        DhcpMessage offer = builder.build();
+        DhcpMessageWriter& writer = begin_reply(message, DhcpMessageType::OFFER, lease.ip_address,
+                                                options.server_id());
+        options.write(writer, reply_lease_time(lease, subnet), options.server_id());
+        const ByteView reply = writer.finish();
+        latency_.mark(PipelineStage::REPLY);
         
-        socket_manager_->send_dhcp_message(offer, client_address, client_port);
-        {
-            std::lock_guard<std::mutex> sl(stats_mutex_);
-            packet_stats_.offer_count++;
+        socket_manager_->send_dhcp_reply(reply, route_reply(message, DhcpMessageType::OFFER, lease.ip_address));
+        latency_.mark(PipelineStage::SEND);
+        packet_counters_.increment(PacketCounter::OFFER);
+        if (reply_cache_) {
+            reply_cache_->store(message.client_mac(), message.header().xid, DhcpMessageType::DISCOVER, reply);
         }
         
     } catch (const std::exception& e) {
@@ -521,53 +1035,22 @@ void DhcpServer::send_offer(const DhcpMessage& message, const DhcpLease& lease,
     }
 }
 
-void DhcpServer::send_ack(const DhcpMessage& message, const DhcpLease& lease, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::send_ack(const ConfigSnapshot& snapshot, const DhcpMessageView& message, const DhcpLease& lease, SubnetId subnet_id) {
     try {
-        // Find subnet for lease
-        std::string subnet_name = find_subnet_for_client(message);
-        const auto& config = config_manager_->get_config();
-        const DhcpSubnet* subnet = nullptr;
-        
-        for (const auto& s : config.subnets) {
-            if (s.name == subnet_name) {
-                subnet = &s;
-                break;
-            }
-        }
-        
-        if (!subnet) {
-            throw DhcpServerException("Subnet not found: " + subnet_name);
-        }
-
-        const IpAddress sid = dhcp_server_ip(subnet);
-        DhcpMessageBuilder builder;
-        builder.set_message_type(DhcpMessageType::ACK)
-               .set_transaction_id(message.header.xid)
-               .set_client_mac(message.client_mac)
-               .set_your_ip(lease.ip_address)
-               .set_server_ip(sid)
-               .add_option(DhcpOptionCode::DHCP_MESSAGE_TYPE, 
-                          std::vector<uint8_t>{message_type_to_option_value(DhcpMessageType::ACK)})
-               .add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, sid);
-        
-        // Add subnet options
-        auto options = build_subnet_options(*subnet);
-        for (const auto& option : options) {
-            builder.add_option(option);
-        }
-        
-        // Add lease options
-        auto lease_options = build_lease_options(lease, *subnet);
-        for (const auto& option : lease_options) {
-            builder.add_option(option);
-        }
+        const auto& subnet = snapshot.subnets->subnet(subnet_id);
+        const CompiledSubnetOptions& options = snapshot.subnet_options[subnet_id];
         
-        DhcpMessage ack = builder.build();
+        DhcpMessageWriter& writer = begin_reply(message, DhcpMessageType::ACK, lease.ip_address,
+                                                options.server_id());
+        options.write(writer, reply_lease_time(lease, subnet), options.server_id());
+        const ByteView reply = writer.finish();
+        latency_.mark(PipelineStage::REPLY);
         
-        socket_manager_->send_dhcp_message(ack, client_address, client_port);
-        {
-            std::lock_guard<std::mutex> sl(stats_mutex_);
-            packet_stats_.ack_count++;
+        socket_manager_->send_dhcp_reply(reply, route_reply(message, DhcpMessageType::ACK, lease.ip_address));
+        latency_.mark(PipelineStage::SEND);
+        packet_counters_.increment(PacketCounter::ACK);
+        if (reply_cache_) {
+            reply_cache_->store(message.client_mac(), message.header().xid, DhcpMessageType::REQUEST, reply);
         }
         
     } catch (const std::exception& e) {
@@ -575,121 +1058,123 @@ void DhcpServer::send_ack(const DhcpMessage& message, const DhcpLease& lease, co
     }
 }
 
-void DhcpServer::send_nak(const DhcpMessage& message, const std::string& client_address, uint16_t client_port) {
+void DhcpServer::send_nak(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
     try {
-        const IpAddress sid = dhcp_server_ip(nullptr);
-        DhcpMessageBuilder builder;
-        builder.set_message_type(DhcpMessageType::NAK)
-               .set_transaction_id(message.header.xid)
-               .set_client_mac(message.client_mac)
-               .set_server_ip(sid)
-               .add_option(DhcpOptionCode::DHCP_MESSAGE_TYPE, 
-                          std::vector<uint8_t>{message_type_to_option_value(DhcpMessageType::NAK)})
-               .add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, sid);
+        const IpAddress sid = snapshot.server_id;
+        DhcpMessageWriter& writer = begin_reply(message, DhcpMessageType::NAK, 0, sid);
+        writer.add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, sid);
+        const ByteView reply = writer.finish();
+        latency_.mark(PipelineStage::REPLY);
         
-        DhcpMessage nak = builder.build();
-        
-        socket_manager_->send_dhcp_message(nak, client_address, client_port);
-        {
-            std::lock_guard<std::mutex> sl(stats_mutex_);
-            packet_stats_.nak_count++;
-        }
+        socket_manager_->send_dhcp_reply(reply, route_reply(message, DhcpMessageType::NAK, 0));
+        latency_.mark(PipelineStage::SEND);
+        packet_counters_.increment(PacketCounter::NAK);
         
     } catch (const std::exception& e) {
         LOG_ERROR("Error sending DHCP NAK: " + std::string(e.what()));
     }
 }
 
-std::string DhcpServer::find_subnet_for_client(const DhcpMessage& message) {
-    const auto& config = config_manager_->get_config();
-    if (config.subnets.empty()) {
-        throw DhcpServerException("No subnets configured");
+bool DhcpServer::answer_from_cache(const DhcpMessageView& message) {
+    const DhcpMessageType type = message.message_type();
+    if (type == DhcpMessageType::RELEASE || type == DhcpMessageType::DECLINE) {
+        reply_cache_->invalidate(message.client_mac());
+        return false;
     }
-    
-    // If client has an IP, try to find matching subnet
-    if (message.client_ip != 0) {
-        for (const auto& subnet : config.subnets) {
-            if (is_ip_in_subnet(message.client_ip, subnet)) {
-                return subnet.name;
-            }
-        }
+    if (type != DhcpMessageType::DISCOVER && type != DhcpMessageType::REQUEST) {
+        return false;
     }
     
-    // If client has relay IP, try to find matching subnet
-    if (message.relay_ip != 0) {
-        for (const auto& subnet : config.subnets) {
-            if (is_ip_in_subnet(message.relay_ip, subnet)) {
-                return subnet.name;
-            }
-        }
+    thread_local ReplyCache::Buffer cached;
+    const size_t length = reply_cache_->lookup(message.client_mac(), message.header().xid, type, cached);
+    if (length == 0) {
+        return false;
     }
-    
-    // Default to first subnet
-    return config.subnets[0].name;
+    // Cached replies are OFFERs and ACKs; their yiaddr picks the route as it did the first time
+    IpAddress your_ip;
+    std::memcpy(&your_ip, cached.data() + offsetof(DhcpMessageHeader, yiaddr), sizeof(your_ip));
+    const DhcpMessageType reply_type = type == DhcpMessageType::DISCOVER ? DhcpMessageType::OFFER
+                                                                         : DhcpMessageType::ACK;
+    socket_manager_->send_dhcp_reply(ByteView(cached.data(), length), route_reply(message, reply_type, your_ip));
+    latency_.mark(PipelineStage::SEND);
+    packet_counters_.increment(type == DhcpMessageType::DISCOVER ? PacketCounter::OFFER : PacketCounter::ACK);
+    packet_counters_.increment(PacketCounter::REPLY_CACHE_HITS);
+    return true;
 }
 
-std::vector<DhcpOption> DhcpServer::build_subnet_options(const DhcpSubnet& subnet) {
-    std::vector<DhcpOption> options;
-    
-    const IpAddress mask = subnet_mask_for_prefix(subnet.prefix_length);
-    options.push_back({DhcpOptionCode::SUBNET_MASK, ip_to_bytes_be(mask)});
-    
-    if (subnet.gateway != 0) {
-        options.push_back({DhcpOptionCode::ROUTER, ip_to_bytes_be(subnet.gateway)});
+ReplyRoute DhcpServer::route_reply(const DhcpMessageView& message, DhcpMessageType type, IpAddress your_ip) {
+    const DhcpMessageHeader& header = message.header();
+    ReplyRoute route;
+    route.port = kClientPort;
+    if (header.giaddr != 0) {
+        route.address = header.giaddr;
+        route.port = kServerPort;
+    } else if (type != DhcpMessageType::NAK && header.ciaddr != 0) {
+        route.address = header.ciaddr;
+    } else if (type == DhcpMessageType::NAK || (ntohs(header.flags) & kBroadcastFlag) != 0 || your_ip == 0) {
+        route.address = INADDR_BROADCAST;
+    } else {
+        route.address = your_ip;
+        route.to_hardware = true;
+        route.hardware = message.client_mac();
     }
-    
-    if (!subnet.dns_servers.empty()) {
-        std::vector<uint8_t> dns_data;
-        for (IpAddress d : subnet.dns_servers) {
-            const auto o = ip_to_bytes_be(d);
-            dns_data.insert(dns_data.end(), o.begin(), o.end());
-        }
-        options.push_back({DhcpOptionCode::DOMAIN_SERVER, std::move(dns_data)});
-    }
-    
-    if (!subnet.domain_name.empty()) {
-        options.push_back({DhcpOptionCode::DOMAIN_NAME, 
-                          std::vector<uint8_t>(subnet.domain_name.begin(), subnet.domain_name.end())});
+    return route;
+}
+
+SubnetId DhcpServer::find_subnet_for_client(const ConfigSnapshot& snapshot, const DhcpMessageView& message) {
+    const SubnetTable& subnets = *snapshot.subnets;
+    if (subnets.size() == 0) {
+        throw DhcpServerException("No subnets configured");
     }
     
-    return options;
+    return subnets.select_for_client(message.client_ip(), message.relay_ip());
 }
 
-std::vector<DhcpOption> DhcpServer::build_lease_options(const DhcpLease& lease, const DhcpSubnet& subnet) {
-    std::vector<DhcpOption> options;
+DhcpMessageWriter& DhcpServer::begin_reply(const DhcpMessageView& message, DhcpMessageType type,
+                                           IpAddress your_ip, IpAddress server_id) {
+    const DhcpMessageHeader& request = message.header();
+    DhcpMessageHeader reply;
+    std::memset(&reply, 0, sizeof(reply));
+    reply.op = 2; // BOOTREPLY
+    reply.htype = 1; // Ethernet
+    reply.hlen = 6;
+    reply.xid = request.xid;
+    reply.flags = request.flags;
+    reply.yiaddr = your_ip;
+    reply.siaddr = server_id;
+    reply.giaddr = request.giaddr;
+    std::memcpy(reply.chaddr, request.chaddr, 6);
     
-    options.push_back({DhcpOptionCode::IP_ADDRESS_LEASE_TIME, uint32_to_option_bytes(subnet.lease_time)});
-    
-    const uint32_t renewal = subnet.lease_time / 2;
-    const uint32_t rebind = (subnet.lease_time * 7) / 8;
-    options.push_back({DhcpOptionCode::RENEWAL_TIME, uint32_to_option_bytes(renewal)});
-    options.push_back({DhcpOptionCode::REBINDING_TIME, uint32_to_option_bytes(rebind)});
-    
-    return options;
+    DhcpMessageWriter& writer = DhcpMessageWriter::for_current_thread();
+    writer.begin(reply);
+    writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(type));
+    return writer;
 }
 
-void DhcpServer::log_dhcp_message(const DhcpMessage& message, const std::string& action) {
-    LOG_INFO(action + " DHCP " + get_message_type_name(message.message_type) + 
-             " from " + mac_to_string(message.client_mac) + 
-             " (" + ip_to_string(message.client_ip) + ")");
+uint32_t DhcpServer::reply_lease_time(const DhcpLease& lease, const DhcpSubnet& subnet) {
+    const auto duration = std::chrono::duration_cast<std::chrono::seconds>(lease.lease_end - lease.lease_start);
+    if (duration.count() > 0) {
+        return static_cast<uint32_t>(duration.count());
+    }
+    return subnet.lease_time;
+}
+
+void DhcpServer::log_dhcp_message(const DhcpMessageView& message, const std::string& action) {
+    LOG_INFO(action << " DHCP " << get_message_type_name(message.message_type()) <<
+             " from " << mac_to_string(message.client_mac()) <<
+             " (" << ip_to_string(message.client_ip()) << ")");
 }
 
 void DhcpServer::update_statistics(DhcpMessageType message_type) {
-    std::lock_guard<std::mutex> sl(stats_mutex_);
-    packet_stats_.total_requests++;
+    packet_counters_.increment(PacketCounter::TOTAL_REQUESTS);
     switch (message_type) {
-        case DhcpMessageType::DISCOVER: packet_stats_.discover_count++; break;
-        case DhcpMessageType::REQUEST: packet_stats_.request_count++; break;
-        case DhcpMessageType::RELEASE: packet_stats_.release_count++; break;
-        case DhcpMessageType::DECLINE: packet_stats_.decline_count++; break;
-        case DhcpMessageType::INFORM: packet_stats_.inform_count++; break;
+        case DhcpMessageType::DISCOVER: packet_counters_.increment(PacketCounter::DISCOVER); break;
+        case DhcpMessageType::REQUEST: packet_counters_.increment(PacketCounter::REQUEST); break;
+        case DhcpMessageType::RELEASE: packet_counters_.increment(PacketCounter::RELEASE); break;
+        case DhcpMessageType::DECLINE: packet_counters_.increment(PacketCounter::DECLINE); break;
+        case DhcpMessageType::INFORM: packet_counters_.increment(PacketCounter::INFORM); break;
         default: break;
     }
 }
 
-bool DhcpServer::is_ip_in_subnet(IpAddress ip, const DhcpSubnet& subnet) {
-    // Check if IP is within the subnet range
-    return ntohl(ip) >= ntohl(subnet.range_start) && ntohl(ip) <= ntohl(subnet.range_end);
-}
-
 } // namespace simple_dhcpd
@@ -0,0 +1,124 @@
+/**
+ * @file lease/address_pool.cpp
+ * @brief Free-address bitmap implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/address_pool.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kWordBits = 64;
+
+inline uint64_t bit(size_t offset) {
+    return uint64_t(1) << (offset % kWordBits);
+}
+}
+
+AddressPool::AddressPool() : base_(0), size_(0), usable_count_(0), free_count_(0), cursor_(0) {}
+
+AddressPool::AddressPool(const DhcpSubnet& subnet) : AddressPool() {
+    const uint32_t start = ntohl(subnet.range_start);
+    const uint32_t end = ntohl(subnet.range_end);
+    if (end < start) {
+        return;
+    }
+
+    base_ = start;
+    size_ = static_cast<size_t>(end - start) + 1;
+    const size_t words = (size_ + kWordBits - 1) / kWordBits;
+    free_.assign(words, ~uint64_t(0));
+    excluded_.assign(words, 0);
+    if (size_ % kWordBits != 0) {
+        free_.back() = bit(size_) - 1;  // no bits past range_end
+    }
+
+    for (const auto& exclusion : subnet.exclusions) {
+        const uint32_t first = std::max(ntohl(exclusion.first), start);
+        const uint32_t last = std::min(ntohl(exclusion.second), end);
+        for (uint64_t ip = first; ip <= last; ++ip) {
+            const size_t offset = static_cast<size_t>(ip - start);
+            excluded_[offset / kWordBits] |= bit(offset);
+            free_[offset / kWordBits] &= ~bit(offset);
+        }
+    }
+
+    free_count_ = 0;
+    for (uint64_t word : free_) {
+        free_count_ += static_cast<size_t>(__builtin_popcountll(word));
+    }
+    usable_count_ = free_count_;
+}
+
+bool AddressPool::offset_of(IpAddress ip, size_t& offset) const {
+    const uint32_t host = ntohl(ip);
+    if (size_ == 0 || host < base_ || host - base_ >= size_) {
+        return false;
+    }
+    offset = host - base_;
+    return true;
+}
+
+bool AddressPool::contains(IpAddress ip) const {
+    size_t offset;
+    return offset_of(ip, offset);
+}
+
+bool AddressPool::is_free(IpAddress ip) const {
+    size_t offset;
+    return offset_of(ip, offset) && (free_[offset / kWordBits] & bit(offset)) != 0;
+}
+
+void AddressPool::mark_used(IpAddress ip) {
+    size_t offset;
+    if (!offset_of(ip, offset)) {
+        return;
+    }
+    uint64_t& word = free_[offset / kWordBits];
+    if (word & bit(offset)) {
+        word &= ~bit(offset);
+        --free_count_;
+    }
+}
+
+void AddressPool::mark_free(IpAddress ip) {
+    size_t offset;
+    if (!offset_of(ip, offset) || (excluded_[offset / kWordBits] & bit(offset))) {
+        return;
+    }
+    uint64_t& word = free_[offset / kWordBits];
+    if (!(word & bit(offset))) {
+        word |= bit(offset);
+        ++free_count_;
+    }
+}
+
+IpAddress AddressPool::find_free(uint64_t mask) {
+    if (free_count_ == 0) {
+        return 0;
+    }
+
+    const size_t words = free_.size();
+    const size_t start_word = cursor_ / kWordBits;
+    // First pass masks off bits below the cursor; the last pass revisits them
+    uint64_t word = free_[start_word] & mask & (~uint64_t(0) << (cursor_ % kWordBits));
+    for (size_t step = 0; step <= words; ++step) {
+        const size_t index = (start_word + step) % words;
+        if (step > 0) {
+            word = free_[index] & mask;
+        }
+        if (word != 0) {
+            const size_t offset = index * kWordBits + static_cast<size_t>(__builtin_ctzll(word));
+            cursor_ = offset + 1 == size_ ? 0 : offset + 1;
+            return htonl(base_ + static_cast<uint32_t>(offset));
+        }
+    }
+    return 0;
+}
+
+} // namespace simple_dhcpd
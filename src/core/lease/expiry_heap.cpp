@@ -0,0 +1,95 @@
+/**
+ * @file lease/expiry_heap.cpp
+ * @brief Indexed min-heap of expiry deadlines implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/expiry_heap.hpp"
+
+namespace simple_dhcpd {
+
+void ExpiryHeap::schedule(uint32_t id, int64_t deadline) {
+    if (id >= position_.size()) {
+        position_.resize(static_cast<size_t>(id) + 1, kNotScheduled);
+    }
+
+    const uint32_t index = position_[id];
+    if (index == kNotScheduled) {
+        heap_.push_back(Entry{deadline, id});
+        position_[id] = static_cast<uint32_t>(heap_.size() - 1);
+        sift_up(heap_.size() - 1);
+        return;
+    }
+
+    const int64_t previous = heap_[index].deadline;
+    heap_[index].deadline = deadline;
+    if (deadline < previous) {
+        sift_up(index);
+    } else {
+        sift_down(index);
+    }
+}
+
+void ExpiryHeap::cancel(uint32_t id) {
+    if (!contains(id)) {
+        return;
+    }
+
+    const size_t index = position_[id];
+    position_[id] = kNotScheduled;
+    const Entry last = heap_.back();
+    heap_.pop_back();
+    if (index == heap_.size()) {
+        return;
+    }
+
+    // The former last entry fills the hole and may need to move either way
+    place(index, last);
+    if (index > 0 && heap_[(index - 1) / 2].deadline > last.deadline) {
+        sift_up(index);
+    } else {
+        sift_down(index);
+    }
+}
+
+void ExpiryHeap::place(size_t index, const Entry& entry) {
+    heap_[index] = entry;
+    position_[entry.id] = static_cast<uint32_t>(index);
+}
+
+void ExpiryHeap::sift_up(size_t index) {
+    const Entry entry = heap_[index];
+    while (index > 0) {
+        const size_t parent = (index - 1) / 2;
+        if (heap_[parent].deadline <= entry.deadline) {
+            break;
+        }
+        place(index, heap_[parent]);
+        index = parent;
+    }
+    place(index, entry);
+}
+
+void ExpiryHeap::sift_down(size_t index) {
+    const Entry entry = heap_[index];
+    const size_t size = heap_.size();
+    while (true) {
+        size_t child = 2 * index + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && heap_[child + 1].deadline < heap_[child].deadline) {
+            ++child;
+        }
+        if (entry.deadline <= heap_[child].deadline) {
+            break;
+        }
+        place(index, heap_[child]);
+        index = child;
+    }
+    place(index, entry);
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,371 @@
+/**
+ * @file lease/journal.cpp
+ * @brief Append-only binary lease journal implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/journal.hpp"
+#include "simple-dhcpd/core/utils/crc32.hpp"
+#include "simple-dhcpd/core/utils/durable_file.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr char kMagic[4] = {'S', 'D', 'L', 'J'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 8;
+constexpr size_t kFrameSize = 8;      // payload length, payload CRC
+constexpr size_t kFixedPayload = 72;  // payload bytes before hostname and client id
+
+constexpr uint8_t kFlagActive = 0x01;
+constexpr uint8_t kFlagStatic = 0x02;
+
+constexpr auto kInitialRetry = std::chrono::milliseconds(10);
+constexpr auto kMaxRetry = std::chrono::milliseconds(1000);
+
+template <typename T>
+void put(std::string& out, size_t offset, T value) {
+    std::memcpy(&out[offset], &value, sizeof(value));
+}
+
+template <typename T>
+T get(const char* data, size_t offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+int64_t ticks(std::chrono::system_clock::time_point time) {
+    return time.time_since_epoch().count();
+}
+
+std::chrono::system_clock::time_point from_ticks(int64_t value) {
+    return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(value));
+}
+
+std::string header() {
+    std::string bytes(kMagic, sizeof(kMagic));
+    bytes.append(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+    return bytes;
+}
+
+std::string errno_message(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+bool decode(const char* payload, size_t length, JournalOp& op, DhcpLease& lease) {
+    if (length < kFixedPayload) {
+        return false;
+    }
+    const uint8_t raw_op = get<uint8_t>(payload, 0);
+    const size_t hostname_length = get<uint16_t>(payload, 10);
+    const size_t client_id_length = get<uint16_t>(payload, 20);
+    if (raw_op < static_cast<uint8_t>(JournalOp::ALLOCATE) || raw_op > static_cast<uint8_t>(JournalOp::EXPIRE) ||
+        kFixedPayload + hostname_length + client_id_length != length) {
+        return false;
+    }
+
+    op = static_cast<JournalOp>(raw_op);
+    const uint8_t flags = get<uint8_t>(payload, 1);
+    lease.is_active = flags & kFlagActive;
+    lease.is_static = flags & kFlagStatic;
+    lease.lease_type = static_cast<LeaseType>(get<uint8_t>(payload, 2));
+    std::memcpy(lease.mac_address.data(), payload + 4, lease.mac_address.size());
+    lease.ip_address = get<uint32_t>(payload, 12);
+    lease.lease_time = std::chrono::seconds(get<uint32_t>(payload, 16));
+    lease.lease_start = from_ticks(get<int64_t>(payload, 24));
+    lease.lease_end = from_ticks(get<int64_t>(payload, 32));
+    lease.renewal_time = from_ticks(get<int64_t>(payload, 40));
+    lease.rebinding_time = from_ticks(get<int64_t>(payload, 48));
+    lease.allocated_at = from_ticks(get<int64_t>(payload, 56));
+    lease.expires_at = from_ticks(get<int64_t>(payload, 64));
+    lease.hostname.assign(payload + kFixedPayload, hostname_length);
+    lease.client_id.assign(payload + kFixedPayload + hostname_length, client_id_length);
+    return true;
+}
+}
+
+LeaseJournal::LeaseJournal(const std::string& path)
+    : path_(path), fd_(-1), appended_(0), durable_(0), file_bytes_(0),
+      writing_(false), failing_(false), stopped_(false), stopping_(false), records_(0), commits_(0),
+      write_failures_(0) {
+    uint64_t valid_bytes = 0;
+    replay(path_, nullptr, &valid_bytes);
+
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw LeaseJournalException(errno_message("Cannot open lease journal", path_));
+    }
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        ::close(fd_);
+        throw LeaseJournalException(errno_message("Cannot stat lease journal", path_));
+    }
+    if (valid_bytes == 0) {
+        const std::string bytes = header();
+        if (::ftruncate(fd_, 0) != 0 || !write_fully(fd_, bytes.data(), bytes.size()) || ::fdatasync(fd_) != 0) {
+            ::close(fd_);
+            throw LeaseJournalException(errno_message("Cannot initialize lease journal", path_));
+        }
+        valid_bytes = bytes.size();
+    } else if (static_cast<uint64_t>(st.st_size) > valid_bytes) {
+        LOG_WARN("Truncating torn records at the end of lease journal " + path_);
+        if (::ftruncate(fd_, static_cast<off_t>(valid_bytes)) != 0) {
+            ::close(fd_);
+            throw LeaseJournalException(errno_message("Cannot truncate lease journal", path_));
+        }
+    }
+    ::lseek(fd_, static_cast<off_t>(valid_bytes), SEEK_SET);
+    file_bytes_ = valid_bytes;
+
+    writer_ = std::thread(&LeaseJournal::writer_loop, this);
+}
+
+LeaseJournal::~LeaseJournal() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+uint64_t LeaseJournal::append(JournalOp op, const DhcpLease& lease) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    encode(op, lease, pending_);
+    const uint64_t sequence = ++appended_;
+    lock.unlock();
+
+    records_.fetch_add(1, std::memory_order_relaxed);
+    work_cv_.notify_one();
+    return sequence;
+}
+
+void LeaseJournal::wait_durable(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_cv_.wait(lock, [this, sequence] { return durable_ >= sequence || stopped_; });
+    if (durable_ < sequence) {
+        throw LeaseJournalException("Lease journal closed before the record was written: " + path_);
+    }
+}
+
+void LeaseJournal::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t sequence = appended_;
+    lock.unlock();
+    wait_durable(sequence);
+}
+
+void LeaseJournal::rotate(const std::string& retired_path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Appenders wait on the mutex while the writer finishes its round
+    durable_cv_.wait(lock, [this] { return (durable_ == appended_ && !writing_) || failing_ || stopped_; });
+    if (durable_ != appended_ || writing_) {
+        throw LeaseJournalException("Cannot retire lease journal while writes to it fail: " + path_);
+    }
+
+    if (::rename(path_.c_str(), retired_path.c_str()) != 0) {
+        throw LeaseJournalException(errno_message("Cannot retire lease journal", path_));
+    }
+    const int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    const std::string bytes = header();
+    if (fd < 0 || !write_fully(fd, bytes.data(), bytes.size()) || ::fdatasync(fd) != 0) {
+        const std::string message = errno_message("Cannot start lease journal", path_);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        // fd_ still writes to the retired file; give it back its name so a
+        // compaction cannot delete it while it is in use
+        if (::rename(retired_path.c_str(), path_.c_str()) != 0) {
+            LOG_ERROR(errno_message("Cannot restore lease journal", path_));
+        }
+        throw LeaseJournalException(message);
+    }
+    sync_parent_directory(path_);
+
+    ::close(fd_);
+    fd_ = fd;
+    file_bytes_ = bytes.size();
+}
+
+uint64_t LeaseJournal::size_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_bytes_ + pending_.size();
+}
+
+void LeaseJournal::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::string batch;
+    auto retry = kInitialRetry;
+    while (true) {
+        work_cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {
+            break;  // stopping and drained
+        }
+
+        // Everything queued while the previous round was syncing goes out together
+        batch.clear();
+        batch.swap(pending_);
+        const uint64_t sequence = appended_;
+        writing_ = true;
+        lock.unlock();
+
+        if (!write_fully(fd_, batch.data(), batch.size()) || ::fdatasync(fd_) != 0) {
+            LOG_ERROR(errno_message("Lease journal write failed on", path_));
+            write_failures_.fetch_add(1, std::memory_order_relaxed);
+            // Cut off a partly written batch so the retry lands on a record boundary
+            const off_t intact = static_cast<off_t>(file_bytes_);
+            if (::ftruncate(fd_, intact) != 0 || ::lseek(fd_, intact, SEEK_SET) != intact) {
+                LOG_ERROR(errno_message("Cannot truncate lease journal", path_));
+            }
+
+            // The records stay queued and their waiters blocked until a retry succeeds
+            lock.lock();
+            batch.append(pending_);
+            pending_.swap(batch);
+            writing_ = false;
+            failing_ = true;
+            durable_cv_.notify_all();
+            if (stopping_) {
+                LOG_ERROR("Lease journal " + path_ + " closed with " + std::to_string(appended_ - durable_) +
+                          " records unwritten");
+                break;
+            }
+            work_cv_.wait_for(lock, retry, [this] { return stopping_; });
+            retry = std::min(retry * 2, kMaxRetry);
+            continue;
+        }
+
+        lock.lock();
+        file_bytes_ += batch.size();
+        durable_ = sequence;
+        writing_ = false;
+        if (failing_) {
+            LOG_INFO("Lease journal writes to " + path_ + " recovered");
+            failing_ = false;
+        }
+        retry = kInitialRetry;
+        commits_.fetch_add(1, std::memory_order_relaxed);
+        durable_cv_.notify_all();
+    }
+    stopped_ = true;
+    durable_cv_.notify_all();
+}
+
+void LeaseJournal::encode(JournalOp op, const DhcpLease& lease, std::string& out) {
+    const size_t hostname_length = std::min<size_t>(lease.hostname.size(), 0xFFFF);
+    const size_t client_id_length = std::min<size_t>(lease.client_id.size(), 0xFFFF);
+    const size_t length = kFixedPayload + hostname_length + client_id_length;
+
+    const size_t frame = out.size();
+    out.resize(frame + kFrameSize + length);
+    const size_t payload = frame + kFrameSize;
+
+    uint8_t flags = 0;
+    if (lease.is_active) {
+        flags |= kFlagActive;
+    }
+    if (lease.is_static) {
+        flags |= kFlagStatic;
+    }
+    put<uint8_t>(out, payload + 0, static_cast<uint8_t>(op));
+    put<uint8_t>(out, payload + 1, flags);
+    put<uint8_t>(out, payload + 2, static_cast<uint8_t>(lease.lease_type));
+    put<uint8_t>(out, payload + 3, 0);
+    std::memcpy(&out[payload + 4], lease.mac_address.data(), lease.mac_address.size());
+    put<uint16_t>(out, payload + 10, static_cast<uint16_t>(hostname_length));
+    put<uint32_t>(out, payload + 12, lease.ip_address);
+    put<uint32_t>(out, payload + 16, static_cast<uint32_t>(lease.lease_time.count()));
+    put<uint16_t>(out, payload + 20, static_cast<uint16_t>(client_id_length));
+    put<uint16_t>(out, payload + 22, 0);
+    put<int64_t>(out, payload + 24, ticks(lease.lease_start));
+    put<int64_t>(out, payload + 32, ticks(lease.lease_end));
+    put<int64_t>(out, payload + 40, ticks(lease.renewal_time));
+    put<int64_t>(out, payload + 48, ticks(lease.rebinding_time));
+    put<int64_t>(out, payload + 56, ticks(lease.allocated_at));
+    put<int64_t>(out, payload + 64, ticks(lease.expires_at));
+    std::memcpy(&out[payload + kFixedPayload], lease.hostname.data(), hostname_length);
+    std::memcpy(&out[payload + kFixedPayload + hostname_length], lease.client_id.data(), client_id_length);
+
+    put<uint32_t>(out, frame, static_cast<uint32_t>(length));
+    put<uint32_t>(out, frame + 4, crc32(&out[payload], length));
+}
+
+size_t LeaseJournal::replay(const std::string& path,
+                            const std::function<void(JournalOp, const DhcpLease&)>& apply,
+                            uint64_t* valid_bytes) {
+    if (valid_bytes) {
+        *valid_bytes = 0;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+    const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.empty()) {
+        return 0;
+    }
+    if (data.size() < kHeaderSize || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        throw LeaseJournalException("Not a lease journal: " + path);
+    }
+    if (get<uint32_t>(data.data(), sizeof(kMagic)) != kVersion) {
+        throw LeaseJournalException("Unsupported lease journal version: " + path);
+    }
+
+    size_t applied = 0;
+    const size_t offset = kHeaderSize + decode_records(data.data() + kHeaderSize, data.size() - kHeaderSize,
+                                                       apply, &applied);
+    if (valid_bytes) {
+        *valid_bytes = offset;
+    }
+    return applied;
+}
+
+size_t LeaseJournal::decode_records(const char* data, size_t size,
+                                    const std::function<void(JournalOp, const DhcpLease&)>& apply,
+                                    size_t* records) {
+    size_t offset = 0;
+    size_t decoded = 0;
+    JournalOp op;
+    while (offset + kFrameSize <= size) {
+        const uint32_t length = get<uint32_t>(data, offset);
+        const uint32_t checksum = get<uint32_t>(data, offset + 4);
+        const char* payload = data + offset + kFrameSize;
+        if (length > size - offset - kFrameSize || crc32(payload, length) != checksum) {
+            break;  // torn or corrupt: nothing after it can be trusted
+        }
+        DhcpLease lease;
+        if (!decode(payload, length, op, lease)) {
+            break;
+        }
+        if (apply) {
+            apply(op, lease);
+        }
+        ++decoded;
+        offset += kFrameSize + length;
+    }
+    if (records) {
+        *records = decoded;
+    }
+    return offset;
+}
+
+} // namespace simple_dhcpd
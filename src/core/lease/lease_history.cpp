@@ -0,0 +1,165 @@
+/**
+ * @file lease_history.cpp
+ * @brief Bounded per-address history of lease changes
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/lease_history.hpp"
+#include "simple-dhcpd/core/lease/lease_store.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+namespace {
+// Records read from the spill file per read()
+constexpr size_t kStreamEntries = 2048;
+}
+
+LeaseHistory::LeaseHistory(size_t depth, const std::string& spill_path)
+    : depth_(std::max<size_t>(depth, 1)), spill_path_(spill_path), spill_fd_(-1) {
+    if (!spill_path_.empty()) {
+        spill_fd_ = ::open(spill_path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (spill_fd_ < 0) {
+            throw LeaseHistoryException("Cannot open lease history file " + spill_path_ + ": " +
+                                        std::strerror(errno));
+        }
+        // A record torn by a crash would shift every later one: cut it off
+        struct stat info;
+        if (::fstat(spill_fd_, &info) == 0 && info.st_size % static_cast<off_t>(sizeof(SpillEntry)) != 0 &&
+            ::ftruncate(spill_fd_, info.st_size - info.st_size % static_cast<off_t>(sizeof(SpillEntry))) != 0) {
+            LOG_WARN("Cannot trim torn record from lease history file " + spill_path_);
+        }
+        spill_buffer_.reserve(kSpillBatch / sizeof(SpillEntry));
+    }
+}
+
+LeaseHistory::~LeaseHistory() {
+    flush();
+    if (spill_fd_ >= 0) {
+        ::close(spill_fd_);
+    }
+}
+
+void LeaseHistory::record(JournalOp op, const DhcpLease& lease) {
+    const LeaseHistoryRecord entry{LeaseRecord::to_ticks(lease.lease_start), LeaseRecord::to_ticks(lease.lease_end),
+                                   lease.mac_address, op};
+    Shard& target = shard(lease.ip_address);
+    LeaseHistoryRecord evicted{};
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        const auto inserted = target.rings.emplace(lease.ip_address, static_cast<uint32_t>(target.written.size()));
+        const uint32_t ring = inserted.first->second;
+        if (inserted.second) {
+            target.records.resize(target.records.size() + depth_);
+            target.written.push_back(0);
+        }
+        uint64_t& written = target.written[ring];
+        LeaseHistoryRecord& slot = target.records[ring * depth_ + written % depth_];
+        full = written >= depth_;
+        if (full) {
+            evicted = slot;
+        }
+        slot = entry;
+        ++written;
+    }
+    if (full && spill_fd_ >= 0) {
+        spill(lease.ip_address, evicted);
+    }
+}
+
+std::vector<LeaseHistoryRecord> LeaseHistory::get(IpAddress ip_address) {
+    std::vector<LeaseHistoryRecord> result;
+
+    // Older records first: stream the spill file, picking this address out
+    if (spill_fd_ >= 0) {
+        std::lock_guard<std::mutex> lock(spill_mutex_);
+        write_spill_locked();
+        std::vector<SpillEntry> chunk(kStreamEntries);
+        off_t offset = 0;
+        while (true) {
+            const ssize_t got = ::pread(spill_fd_, chunk.data(), chunk.size() * sizeof(SpillEntry), offset);
+            if (got <= 0) {
+                break;
+            }
+            const size_t entries = static_cast<size_t>(got) / sizeof(SpillEntry);   // a torn tail is ignored
+            for (size_t i = 0; i < entries; ++i) {
+                if (chunk[i].ip_address == ip_address) {
+                    result.push_back(chunk[i].record);
+                }
+            }
+            if (entries < chunk.size()) {
+                break;
+            }
+            offset += got;
+        }
+    }
+
+    Shard& target = shard(ip_address);
+    std::lock_guard<std::mutex> lock(target.mutex);
+    const auto it = target.rings.find(ip_address);
+    if (it == target.rings.end()) {
+        return result;
+    }
+    const uint64_t written = target.written[it->second];
+    const LeaseHistoryRecord* ring = &target.records[it->second * depth_];
+    const uint64_t kept = std::min<uint64_t>(written, depth_);
+    for (uint64_t i = written - kept; i < written; ++i) {
+        result.push_back(ring[i % depth_]);
+    }
+    return result;
+}
+
+void LeaseHistory::flush() {
+    if (spill_fd_ < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    write_spill_locked();
+}
+
+size_t LeaseHistory::addresses() const {
+    size_t total = 0;
+    for (const Shard& each : shards_) {
+        std::lock_guard<std::mutex> lock(each.mutex);
+        total += each.rings.size();
+    }
+    return total;
+}
+
+void LeaseHistory::spill(IpAddress ip_address, const LeaseHistoryRecord& record) {
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    spill_buffer_.push_back(SpillEntry{ip_address, 0, record});
+    if (spill_buffer_.size() * sizeof(SpillEntry) >= kSpillBatch) {
+        write_spill_locked();
+    }
+}
+
+void LeaseHistory::write_spill_locked() {
+    const char* data = reinterpret_cast<const char*>(spill_buffer_.data());
+    size_t remaining = spill_buffer_.size() * sizeof(SpillEntry);
+    while (remaining > 0) {
+        const ssize_t written = ::write(spill_fd_, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // History is diagnostic: losing a batch must not fail lease changes
+            LOG_ERROR("Lease history file " + spill_path_ + " write failed: " + std::strerror(errno));
+            break;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    spill_buffer_.clear();
+}
+
+} // namespace simple_dhcpd
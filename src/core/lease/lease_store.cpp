@@ -0,0 +1,575 @@
+/**
+ * @file lease/lease_store.cpp
+ * @brief Compact open-addressing lease tables implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/lease_store.hpp"
+#include <cstring>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kInitialCapacity = 16;
+
+// Grow once entries exceed 7/10 of the table
+inline bool over_load(size_t entries, size_t capacity) {
+    return entries * 10 > capacity * 7;
+}
+
+inline uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+inline uint32_t hash_mac(const MacAddress& mac_address) {
+    uint64_t key = 0;
+    std::memcpy(&key, mac_address.data(), mac_address.size());
+    return static_cast<uint32_t>(mix(key));
+}
+
+inline size_t hash_ip(IpAddress ip_address) {
+    return static_cast<size_t>(mix(ip_address));
+}
+
+// FNV-1a
+inline uint32_t hash_string(std::string_view value) {
+    uint32_t hash = 2166136261u;
+    for (const char c : value) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+// With linear probing, the entry at `next` may fill the hole at `hole` unless
+// its home slot lies cyclically in (hole, next]
+inline bool can_fill(size_t hole, size_t next, size_t home) {
+    return hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+}
+}
+
+StringPool::StringPool() : dead_bytes_(0), table_(kInitialCapacity, kEmpty), size_(0) {
+    entries_.push_back(Entry{0, 0, 0, 0});
+}
+
+size_t StringPool::probe(std::string_view value, uint32_t hash) const {
+    const size_t mask = table_.size() - 1;
+    size_t slot = mix(hash) & mask;
+    while (table_[slot] != kEmpty &&
+           (entries_[table_[slot]].hash != hash || get(table_[slot]) != value)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+uint32_t StringPool::intern(std::string_view value) {
+    if (value.empty()) {
+        return kEmpty;
+    }
+    const uint32_t hash = hash_string(value);
+    size_t slot = probe(value, hash);
+    if (table_[slot] != kEmpty) {
+        ++entries_[table_[slot]].refs;
+        return table_[slot];
+    }
+    if (over_load(size_ + 1, table_.size())) {
+        grow();
+        slot = probe(value, hash);
+    }
+
+    uint32_t id;
+    if (!free_ids_.empty()) {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+    } else {
+        id = static_cast<uint32_t>(entries_.size());
+        entries_.emplace_back();
+    }
+    entries_[id] = Entry{static_cast<uint32_t>(bytes_.size()), static_cast<uint32_t>(value.size()), 1, hash};
+    bytes_.insert(bytes_.end(), value.begin(), value.end());
+    table_[slot] = id;
+    ++size_;
+    return id;
+}
+
+uint32_t StringPool::find(std::string_view value) const {
+    if (value.empty()) {
+        return kEmpty;
+    }
+    return table_[probe(value, hash_string(value))];
+}
+
+void StringPool::reserve(size_t count, size_t bytes) {
+    entries_.reserve(entries_.size() + count);
+    bytes_.reserve(bytes_.size() + bytes);
+    size_t capacity = table_.size();
+    while (over_load(size_ + count, capacity)) {
+        capacity *= 2;
+    }
+    while (table_.size() < capacity) {
+        grow();
+    }
+}
+
+void StringPool::release(uint32_t id) {
+    if (id == kEmpty || entries_[id].refs == 0 || --entries_[id].refs != 0) {
+        return;
+    }
+
+    const size_t mask = table_.size() - 1;
+    size_t hole = mix(entries_[id].hash) & mask;
+    while (table_[hole] != id) {
+        hole = (hole + 1) & mask;
+    }
+    for (size_t next = (hole + 1) & mask; table_[next] != kEmpty; next = (next + 1) & mask) {
+        if (can_fill(hole, next, mix(entries_[table_[next]].hash) & mask)) {
+            table_[hole] = table_[next];
+            hole = next;
+        }
+    }
+    table_[hole] = kEmpty;
+
+    dead_bytes_ += entries_[id].length;
+    entries_[id].length = 0;
+    free_ids_.push_back(id);
+    --size_;
+
+    if (dead_bytes_ > 4096 && dead_bytes_ * 2 > bytes_.size()) {
+        compact();
+    }
+}
+
+size_t StringPool::memory_usage() const {
+    return bytes_.capacity() +
+           entries_.capacity() * sizeof(Entry) +
+           free_ids_.capacity() * sizeof(uint32_t) +
+           table_.capacity() * sizeof(uint32_t);
+}
+
+void StringPool::grow() {
+    std::vector<uint32_t> old_table(table_.size() * 2, kEmpty);
+    old_table.swap(table_);
+    const size_t mask = table_.size() - 1;
+    for (const uint32_t id : old_table) {
+        if (id == kEmpty) {
+            continue;
+        }
+        size_t slot = mix(entries_[id].hash) & mask;
+        while (table_[slot] != kEmpty) {
+            slot = (slot + 1) & mask;
+        }
+        table_[slot] = id;
+    }
+}
+
+void StringPool::compact() {
+    std::vector<char> bytes;
+    bytes.reserve(bytes_.size() - dead_bytes_);
+    for (auto& entry : entries_) {
+        if (entry.refs == 0) {
+            continue;
+        }
+        const uint32_t offset = static_cast<uint32_t>(bytes.size());
+        bytes.insert(bytes.end(), bytes_.begin() + entry.offset, bytes_.begin() + entry.offset + entry.length);
+        entry.offset = offset;
+    }
+    bytes_.swap(bytes);
+    dead_bytes_ = 0;
+}
+
+LeaseStore::LeaseStore() : table_(kInitialCapacity, Slot{kEmptySlot, 0}), size_(0) {}
+
+size_t LeaseStore::probe(const MacAddress& mac_address, uint32_t hash) const {
+    const size_t mask = table_.size() - 1;
+    size_t slot = hash & mask;
+    while (table_[slot].record != kEmptySlot &&
+           (table_[slot].tag != hash || records_[table_[slot].record - 1].mac_address != mac_address)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+LeaseRecord* LeaseStore::find(const MacAddress& mac_address) {
+    const uint32_t entry = table_[probe(mac_address, hash_mac(mac_address))].record;
+    return entry == kEmptySlot ? nullptr : &records_[entry - 1];
+}
+
+const LeaseRecord* LeaseStore::find(const MacAddress& mac_address) const {
+    const uint32_t entry = table_[probe(mac_address, hash_mac(mac_address))].record;
+    return entry == kEmptySlot ? nullptr : &records_[entry - 1];
+}
+
+LeaseRecord& LeaseStore::put(const DhcpLease& lease) {
+    const uint32_t hash = hash_mac(lease.mac_address);
+    size_t slot = probe(lease.mac_address, hash);
+    if (table_[slot].record != kEmptySlot) {
+        const uint32_t index = table_[slot].record - 1;
+        assign(index, lease);
+        reschedule(records_[index]);
+        return records_[index];
+    }
+
+    if (over_load(size_ + 1, table_.size())) {
+        grow();
+        slot = probe(lease.mac_address, hash);
+    }
+
+    uint32_t index;
+    if (!free_records_.empty()) {
+        index = free_records_.back();
+        free_records_.pop_back();
+    } else {
+        index = static_cast<uint32_t>(records_.size());
+        records_.emplace_back();
+    }
+    LeaseRecord& record = records_[index];
+    record.hostname = StringPool::kEmpty;
+    record.client_id = StringPool::kEmpty;
+    record.flags = LeaseRecord::kLive;
+    assign(index, lease);
+    reschedule(record);
+
+    table_[slot] = Slot{index + 1, hash};
+    ++size_;
+    return record;
+}
+
+bool LeaseStore::erase(const MacAddress& mac_address) {
+    const size_t mask = table_.size() - 1;
+    size_t hole = probe(mac_address, hash_mac(mac_address));
+    if (table_[hole].record == kEmptySlot) {
+        return false;
+    }
+
+    const uint32_t index = table_[hole].record - 1;
+    release_fields(index);
+    expiry_.cancel(index);
+    records_[index].flags = 0;
+    free_records_.push_back(index);
+    --size_;
+
+    for (size_t next = (hole + 1) & mask; table_[next].record != kEmptySlot; next = (next + 1) & mask) {
+        if (can_fill(hole, next, table_[next].tag & mask)) {
+            table_[hole] = table_[next];
+            hole = next;
+        }
+    }
+    table_[hole].record = kEmptySlot;
+    return true;
+}
+
+void LeaseStore::reschedule(const LeaseRecord& record) {
+    const uint32_t index = static_cast<uint32_t>(&record - records_.data());
+    if (record.is_active()) {
+        expiry_.schedule(index, record.lease_end);
+    } else {
+        expiry_.cancel(index);
+    }
+}
+
+const LeaseRecord* LeaseStore::next_expired(int64_t now) const {
+    if (expiry_.empty() || expiry_.top_deadline() >= now) {
+        return nullptr;
+    }
+    return &records_[expiry_.top()];
+}
+
+DhcpLease LeaseStore::load(const LeaseRecord& record) const {
+    DhcpLease lease;
+    lease.mac_address = record.mac_address;
+    lease.ip_address = record.ip_address;
+    lease.hostname = std::string(strings_.get(record.hostname));
+    lease.lease_start = LeaseRecord::from_ticks(record.lease_start);
+    lease.lease_end = LeaseRecord::from_ticks(record.lease_end);
+    lease.renewal_time = LeaseRecord::from_ticks(record.renewal_time);
+    lease.rebinding_time = LeaseRecord::from_ticks(record.rebinding_time);
+    lease.allocated_at = LeaseRecord::from_ticks(record.allocated_at);
+    lease.expires_at = LeaseRecord::from_ticks(record.expires_at);
+    lease.lease_time = std::chrono::seconds(record.lease_time);
+    lease.lease_type = static_cast<LeaseType>(record.lease_type);
+    lease.client_id = std::string(strings_.get(record.client_id));
+    if (record.flags & LeaseRecord::kHasOptions) {
+        const uint32_t index = static_cast<uint32_t>(&record - records_.data());
+        auto it = options_.find(index);
+        if (it != options_.end()) {
+            lease.options = it->second;
+        }
+    }
+    lease.is_static = record.flags & LeaseRecord::kStatic;
+    lease.is_active = record.flags & LeaseRecord::kActive;
+    return lease;
+}
+
+size_t LeaseStore::memory_usage() const {
+    size_t bytes = records_.capacity() * sizeof(LeaseRecord) +
+                   free_records_.capacity() * sizeof(uint32_t) +
+                   table_.capacity() * sizeof(Slot) +
+                   strings_.memory_usage() +
+                   expiry_.memory_usage() +
+                   by_client_id_.size() * (sizeof(std::pair<uint32_t, uint32_t>) + 2 * sizeof(void*)) +
+                   by_client_id_.bucket_count() * sizeof(void*);
+    for (const auto& entry : options_) {
+        bytes += sizeof(entry) + 2 * sizeof(void*);
+        for (const auto& option : entry.second) {
+            bytes += sizeof(option) + 4 * sizeof(void*) + option.second.capacity();
+        }
+    }
+    return bytes;
+}
+
+void LeaseStore::reserve(size_t count, size_t string_bytes) {
+    records_.reserve(records_.size() + count);
+    expiry_.reserve(records_.size() + count);
+    if (string_bytes != 0) {
+        strings_.reserve(count, string_bytes);
+    }
+    size_t capacity = table_.size();
+    while (over_load(size_ + count, capacity)) {
+        capacity *= 2;
+    }
+    if (capacity != table_.size()) {
+        rehash(capacity);
+    }
+}
+
+void LeaseStore::rehash(size_t capacity) {
+    std::vector<Slot> old_table(capacity, Slot{kEmptySlot, 0});
+    old_table.swap(table_);
+    const size_t mask = table_.size() - 1;
+    for (const Slot& entry : old_table) {
+        if (entry.record == kEmptySlot) {
+            continue;
+        }
+        size_t slot = entry.tag & mask;
+        while (table_[slot].record != kEmptySlot) {
+            slot = (slot + 1) & mask;
+        }
+        table_[slot] = entry;
+    }
+}
+
+void LeaseStore::assign(uint32_t index, const DhcpLease& lease) {
+    LeaseRecord& record = records_[index];
+    // Intern before releasing so an unchanged string keeps its id
+    const uint32_t hostname = strings_.intern(lease.hostname);
+    const uint32_t client_id = strings_.intern(lease.client_id);
+    release_fields(index);
+
+    record.lease_start = LeaseRecord::to_ticks(lease.lease_start);
+    record.lease_end = LeaseRecord::to_ticks(lease.lease_end);
+    record.renewal_time = LeaseRecord::to_ticks(lease.renewal_time);
+    record.rebinding_time = LeaseRecord::to_ticks(lease.rebinding_time);
+    record.allocated_at = LeaseRecord::to_ticks(lease.allocated_at);
+    record.expires_at = LeaseRecord::to_ticks(lease.expires_at);
+    record.ip_address = lease.ip_address;
+    record.lease_time = static_cast<uint32_t>(lease.lease_time.count());
+    record.hostname = hostname;
+    record.client_id = client_id;
+    if (client_id != StringPool::kEmpty) {
+        by_client_id_.emplace(client_id, index);
+    }
+    record.mac_address = lease.mac_address;
+    record.lease_type = static_cast<uint8_t>(lease.lease_type);
+    record.flags = LeaseRecord::kLive;
+    if (lease.is_active) {
+        record.flags |= LeaseRecord::kActive;
+    }
+    if (lease.is_static) {
+        record.flags |= LeaseRecord::kStatic;
+    }
+    if (!lease.options.empty()) {
+        record.flags |= LeaseRecord::kHasOptions;
+        options_[index] = lease.options;
+    }
+}
+
+void LeaseStore::release_fields(uint32_t index) {
+    LeaseRecord& record = records_[index];
+    if (record.client_id != StringPool::kEmpty) {
+        const auto range = by_client_id_.equal_range(record.client_id);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == index) {
+                by_client_id_.erase(it);
+                break;
+            }
+        }
+    }
+    strings_.release(record.hostname);
+    strings_.release(record.client_id);
+    record.hostname = StringPool::kEmpty;
+    record.client_id = StringPool::kEmpty;
+    if (record.flags & LeaseRecord::kHasOptions) {
+        options_.erase(index);
+        record.flags &= static_cast<uint8_t>(~LeaseRecord::kHasOptions);
+    }
+}
+
+AddressIndex::AddressIndex() : table_(kInitialCapacity), size_(0) {}
+
+size_t AddressIndex::probe(IpAddress ip_address) const {
+    const size_t mask = table_.size() - 1;
+    size_t slot = hash_ip(ip_address) & mask;
+    while (table_[slot].used && table_[slot].ip_address != ip_address) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+bool AddressIndex::find(IpAddress ip_address, MacAddress& mac_address) const {
+    const Entry& entry = table_[probe(ip_address)];
+    if (!entry.used) {
+        return false;
+    }
+    mac_address = entry.mac_address;
+    return true;
+}
+
+bool AddressIndex::contains(IpAddress ip_address) const {
+    return table_[probe(ip_address)].used;
+}
+
+bool AddressIndex::insert(IpAddress ip_address, const MacAddress& mac_address) {
+    size_t slot = probe(ip_address);
+    if (table_[slot].used) {
+        table_[slot].mac_address = mac_address;
+        return false;
+    }
+    if (over_load(size_ + 1, table_.size())) {
+        grow();
+        slot = probe(ip_address);
+    }
+    table_[slot] = Entry{ip_address, mac_address, 1, 0};
+    ++size_;
+    return true;
+}
+
+bool AddressIndex::erase(IpAddress ip_address, const MacAddress& mac_address) {
+    const size_t mask = table_.size() - 1;
+    size_t hole = probe(ip_address);
+    if (!table_[hole].used || table_[hole].mac_address != mac_address) {
+        return false;
+    }
+    --size_;
+
+    for (size_t next = (hole + 1) & mask; table_[next].used; next = (next + 1) & mask) {
+        const size_t home = hash_ip(table_[next].ip_address) & mask;
+        if (can_fill(hole, next, home)) {
+            table_[hole] = table_[next];
+            hole = next;
+        }
+    }
+    table_[hole].used = 0;
+    return true;
+}
+
+void AddressIndex::reserve(size_t count) {
+    size_t capacity = table_.size();
+    while (over_load(size_ + count, capacity)) {
+        capacity *= 2;
+    }
+    if (capacity != table_.size()) {
+        rehash(capacity);
+    }
+}
+
+void AddressIndex::rehash(size_t capacity) {
+    std::vector<Entry> old_table(capacity);
+    old_table.swap(table_);
+    const size_t mask = table_.size() - 1;
+    for (const Entry& entry : old_table) {
+        if (!entry.used) {
+            continue;
+        }
+        size_t slot = hash_ip(entry.ip_address) & mask;
+        while (table_[slot].used) {
+            slot = (slot + 1) & mask;
+        }
+        table_[slot] = entry;
+    }
+}
+
+OfferTable::OfferTable() : table_(kInitialCapacity), size_(0) {}
+
+size_t OfferTable::probe(const MacAddress& mac_address) const {
+    const size_t mask = table_.size() - 1;
+    size_t slot = hash_mac(mac_address) & mask;
+    while (table_[slot].used && table_[slot].mac_address != mac_address) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+bool OfferTable::find(const MacAddress& mac_address, IpAddress& ip_address) const {
+    const Entry& entry = table_[probe(mac_address)];
+    if (!entry.used) {
+        return false;
+    }
+    ip_address = entry.ip_address;
+    return true;
+}
+
+void OfferTable::hold(const MacAddress& mac_address, IpAddress ip_address, int64_t until) {
+    size_t slot = probe(mac_address);
+    if (!table_[slot].used) {
+        if (over_load(size_ + 1, table_.size())) {
+            grow();
+            slot = probe(mac_address);
+        }
+        ++size_;
+    }
+    table_[slot] = Entry{mac_address, 1, 0, ip_address, until};
+    order_.emplace(until, mac_address);
+}
+
+bool OfferTable::take(const MacAddress& mac_address, IpAddress& ip_address) {
+    const size_t slot = probe(mac_address);
+    if (!table_[slot].used) {
+        return false;
+    }
+    ip_address = table_[slot].ip_address;
+    erase_slot(slot);
+    return true;
+}
+
+void OfferTable::erase_slot(size_t hole) {
+    const size_t mask = table_.size() - 1;
+    --size_;
+    for (size_t next = (hole + 1) & mask; table_[next].used; next = (next + 1) & mask) {
+        const size_t home = hash_mac(table_[next].mac_address) & mask;
+        if (can_fill(hole, next, home)) {
+            table_[hole] = table_[next];
+            hole = next;
+        }
+    }
+    table_[hole].used = 0;
+}
+
+void OfferTable::clear() {
+    std::vector<Entry>(kInitialCapacity).swap(table_);
+    size_ = 0;
+    order_ = decltype(order_)();
+}
+
+void OfferTable::rehash(size_t capacity) {
+    std::vector<Entry> old_table(capacity);
+    old_table.swap(table_);
+    const size_t mask = table_.size() - 1;
+    for (const Entry& entry : old_table) {
+        if (!entry.used) {
+            continue;
+        }
+        size_t slot = hash_mac(entry.mac_address) & mask;
+        while (table_[slot].used) {
+            slot = (slot + 1) & mask;
+        }
+        table_[slot] = entry;
+    }
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,440 @@
+/**
+ * @file lease/leasequery.cpp
+ * @brief DHCP leasequery and bulk leasequery responder implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/leasequery.hpp"
+#include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr uint8_t kRemoteIdSubOption = 2;
+constexpr uint8_t kRelayIdSubOption = 12;      // RFC 6925
+constexpr uint8_t kStateActive = 2;             // dhcp-state option, RFC 6926 6.2.4
+constexpr int kIdleTimeoutSeconds = 10;
+constexpr int kSocketTimeoutSeconds = 5;
+constexpr size_t kSendBatch = 64 * 1024;        // reply bytes buffered per send()
+
+int64_t seconds_since_epoch(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+uint32_t clamp_seconds(int64_t seconds) {
+    return seconds <= 0 ? 0 : seconds > 0xFFFFFFFFll ? 0xFFFFFFFFu : static_cast<uint32_t>(seconds);
+}
+
+bool read_u32(ByteView data, uint32_t& value) {
+    if (data.size() != sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, data.data(), sizeof(value));
+    value = ntohl(value);
+    return true;
+}
+
+bool has_chaddr(const DhcpMessageHeader& header) {
+    if (header.hlen == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        if (header.chaddr[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A query by relay-id or remote-id carries the sub-option in option 82
+bool names_relay_agent(ByteView relay_information) {
+    size_t pos = 0;
+    while (pos + 2 <= relay_information.size()) {
+        const uint8_t sub_option = relay_information[pos];
+        if (sub_option == kRelayIdSubOption || sub_option == kRemoteIdSubOption) {
+            return true;
+        }
+        pos += 2 + relay_information[pos + 1];
+    }
+    return false;
+}
+
+bool read_exact(int fd, uint8_t* data, size_t length) {
+    size_t got = 0;
+    while (got < length) {
+        const ssize_t n = ::recv(fd, data + got, length - got, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void append_frame(std::string& out, ByteView message) {
+    const uint16_t length = htons(static_cast<uint16_t>(message.size()));
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(reinterpret_cast<const char*>(message.data()), message.size());
+}
+}
+
+LeasequeryResponder::LeasequeryResponder(LeaseManager& leases, IpAddress server_id)
+    : leases_(leases), server_id_(server_id) {
+}
+
+ByteView LeasequeryResponder::answer(const DhcpMessageView& query, DhcpMessageWriter& writer) {
+    const int64_t now = seconds_since_epoch(std::chrono::system_clock::now());
+    DhcpLease lease;
+    if (find_lease(query, lease)) {
+        begin(writer, query, DhcpMessageType::LEASEACTIVE, &lease);
+        write_lease(writer, lease, now, false);
+        return writer.finish();
+    }
+
+    // Only a query by address can tell "ours but free" from "not ours"
+    const IpAddress queried = query.client_ip();
+    const bool unassigned = queried != 0 && leases_.is_pool_address(queried);
+    begin(writer, query, unassigned ? DhcpMessageType::LEASEUNASSIGNED : DhcpMessageType::LEASEUNKNOWN, nullptr);
+    writer.add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, server_id_.load(std::memory_order_relaxed));
+    return writer.finish();
+}
+
+size_t LeasequeryResponder::answer_bulk(const DhcpMessageView& query, const Sink& send) {
+    DhcpMessageWriter& writer = DhcpMessageWriter::for_current_thread();
+    const int64_t now = seconds_since_epoch(std::chrono::system_clock::now());
+
+    const auto refuse = [&](LeasequeryStatus status, const char* message) {
+        begin(writer, query, DhcpMessageType::LEASEQUERYSTATUS, nullptr);
+        std::vector<uint8_t> status_code(1, static_cast<uint8_t>(status));
+        status_code.insert(status_code.end(), message, message + std::strlen(message));
+        writer.add_option(DhcpOptionCode::STATUS_CODE, status_code);
+        send(writer.finish());
+        return size_t(0);
+    };
+
+    const bool by_lease = query.client_ip() != 0 || has_chaddr(query.header()) ||
+                          query.has_option(DhcpOptionCode::CLIENT_IDENTIFIER);
+    if (!by_lease && names_relay_agent(query.option_data(DhcpOptionCode::RELAY_AGENT_INFORMATION))) {
+        return refuse(LeasequeryStatus::NOT_ALLOWED, "Relay-id and remote-id queries are not supported");
+    }
+
+    uint32_t start_time = 0;
+    uint32_t end_time = 0xFFFFFFFFu;
+    if ((query.has_option(DhcpOptionCode::QUERY_START_TIME) &&
+         !read_u32(query.option_data(DhcpOptionCode::QUERY_START_TIME), start_time)) ||
+        (query.has_option(DhcpOptionCode::QUERY_END_TIME) &&
+         !read_u32(query.option_data(DhcpOptionCode::QUERY_END_TIME), end_time))) {
+        return refuse(LeasequeryStatus::MALFORMED_QUERY, "Bad query-start-time or query-end-time");
+    }
+
+    size_t sent = 0;
+    bool open = true;
+    if (by_lease) {
+        DhcpLease lease;
+        if (find_lease(query, lease)) {
+            begin(writer, query, DhcpMessageType::LEASEACTIVE, &lease);
+            write_lease(writer, lease, now, true);
+            open = send(writer.finish());
+            sent = open ? 1 : 0;
+        }
+    } else {
+        LeaseCursor cursor;
+        std::vector<DhcpLease> chunk;
+        while (open && leases_.read_leases(cursor, chunk, kBulkChunk) > 0) {
+            for (const DhcpLease& lease : chunk) {
+                const int64_t changed = seconds_since_epoch(lease.lease_start);
+                if (changed < start_time || changed > end_time) {
+                    continue;
+                }
+                begin(writer, query, DhcpMessageType::LEASEACTIVE, &lease);
+                write_lease(writer, lease, now, true);
+                if (!send(writer.finish())) {
+                    open = false;
+                    break;
+                }
+                ++sent;
+            }
+        }
+    }
+    if (!open) {
+        return sent;
+    }
+
+    begin(writer, query, DhcpMessageType::LEASEQUERYDONE, nullptr);
+    writer.add_option_u32(DhcpOptionCode::BASE_TIME, clamp_seconds(now));
+    const uint8_t success = static_cast<uint8_t>(LeasequeryStatus::SUCCESS);
+    writer.add_option(DhcpOptionCode::STATUS_CODE, &success, sizeof(success));
+    send(writer.finish());
+    return sent;
+}
+
+void LeasequeryResponder::begin(DhcpMessageWriter& writer, const DhcpMessageView& query, DhcpMessageType type,
+                                const DhcpLease* lease) {
+    const DhcpMessageHeader& request = query.header();
+    DhcpMessageHeader reply;
+    std::memset(&reply, 0, sizeof(reply));
+    reply.op = 2; // BOOTREPLY
+    reply.xid = request.xid;
+    reply.giaddr = request.giaddr;
+    if (lease) {
+        reply.htype = 1; // Ethernet
+        reply.hlen = 6;
+        reply.ciaddr = lease->ip_address;
+        std::memcpy(reply.chaddr, lease->mac_address.data(), 6);
+    } else {
+        // Not found: echo what was asked for
+        reply.htype = request.htype;
+        reply.hlen = request.hlen;
+        reply.ciaddr = request.ciaddr;
+        std::memcpy(reply.chaddr, request.chaddr, sizeof(reply.chaddr));
+    }
+
+    writer.begin(reply);
+    writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(type));
+}
+
+void LeasequeryResponder::write_lease(DhcpMessageWriter& writer, const DhcpLease& lease, int64_t now, bool bulk) {
+    const int64_t start = seconds_since_epoch(lease.lease_start);
+    writer.add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, server_id_.load(std::memory_order_relaxed));
+    writer.add_option_u32(DhcpOptionCode::IP_ADDRESS_LEASE_TIME,
+                          clamp_seconds(seconds_since_epoch(lease.lease_end) - now));
+    writer.add_option_u32(DhcpOptionCode::LAST_TRANSACTION_TIME, clamp_seconds(now - start));
+    if (!lease.client_id.empty()) {
+        writer.add_option(DhcpOptionCode::CLIENT_IDENTIFIER, reinterpret_cast<const uint8_t*>(lease.client_id.data()),
+                          lease.client_id.size());
+    }
+    if (bulk) {
+        writer.add_option_u32(DhcpOptionCode::BASE_TIME, clamp_seconds(now));
+        writer.add_option_u32(DhcpOptionCode::START_TIME_OF_STATE, clamp_seconds(now - start));
+        writer.add_option_u8(DhcpOptionCode::DHCP_STATE, kStateActive);
+    }
+}
+
+bool LeasequeryResponder::find_lease(const DhcpMessageView& query, DhcpLease& lease) {
+    std::shared_ptr<DhcpLease> found;
+    if (query.client_ip() != 0) {
+        found = leases_.get_lease_by_ip(query.client_ip());
+    } else if (has_chaddr(query.header())) {
+        found = leases_.get_lease_by_mac(query.client_mac());
+    } else if (query.has_option(DhcpOptionCode::CLIENT_IDENTIFIER)) {
+        const ByteView wanted = query.option_data(DhcpOptionCode::CLIENT_IDENTIFIER);
+        if (wanted.empty()) {
+            return false;
+        }
+        // Indexed per shard; a query never walks the lease table
+        found = leases_.get_lease_by_client_id(
+            std::string_view(reinterpret_cast<const char*>(wanted.data()), wanted.size()));
+    }
+    if (!found) {
+        return false;
+    }
+    lease = *found;
+    return true;
+}
+
+BulkLeasequeryServer::BulkLeasequeryServer(const std::string& address, uint16_t port, LeasequeryResponder& responder)
+    : address_(address), port_(port), responder_(responder), listen_fd_(-1), wake_fds_{-1, -1},
+      stopping_(false), queries_(0), leases_sent_(0) {
+}
+
+BulkLeasequeryServer::~BulkLeasequeryServer() {
+    stop();
+}
+
+void BulkLeasequeryServer::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    if (inet_pton(AF_INET, address_.c_str(), &addr.sin_addr) != 1) {
+        throw LeasequeryException("Invalid bulk leasequery address: " + address_);
+    }
+
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw LeasequeryException("Failed to create bulk leasequery socket: " + std::string(strerror(errno)));
+    }
+    int opt = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd_, 16) < 0) {
+        const std::string error = strerror(errno);
+        close_fds();
+        throw LeasequeryException("Failed to listen on " + address_ + ":" + std::to_string(port_) + ": " + error);
+    }
+
+    socklen_t length = sizeof(addr);
+    if (getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &length) == 0) {
+        port_ = ntohs(addr.sin_port);
+    }
+    if (::pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        const std::string error = strerror(errno);
+        close_fds();
+        throw LeasequeryException("Failed to create bulk leasequery wake pipe: " + error);
+    }
+
+    stopping_.store(false, std::memory_order_relaxed);
+    thread_ = std::thread(&BulkLeasequeryServer::run, this);
+    LOG_INFO("Bulk leasequery listening on " + address_ + ":" + std::to_string(port_));
+}
+
+void BulkLeasequeryServer::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stopping_.store(true, std::memory_order_relaxed);
+    const char wake = 1;
+    while (::write(wake_fds_[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+    close_fds();
+}
+
+void BulkLeasequeryServer::close_fds() {
+    for (int* fd : {&listen_fd_, &wake_fds_[0], &wake_fds_[1]}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void BulkLeasequeryServer::run() {
+    struct pollfd fds[2];
+    fds[0].fd = listen_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_fds_[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Bulk leasequery poll failed: " + std::string(strerror(errno)));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            const int client_fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd >= 0) {
+                serve(client_fd);
+                ::close(client_fd);
+            }
+        }
+    }
+}
+
+void BulkLeasequeryServer::serve(int client_fd) {
+    // The timeouts bound a message that arrives in pieces and a requestor
+    // that stops reading; waiting for the next query is bounded by poll()
+    struct timeval timeout;
+    timeout.tv_sec = kSocketTimeoutSeconds;
+    timeout.tv_usec = 0;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct pollfd fds[2];
+    fds[0].fd = client_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_fds_[0];
+    fds[1].events = POLLIN;
+
+    uint8_t query[kMaxQuerySize];
+    std::string out;
+    out.reserve(kSendBatch + DhcpMessageWriter::kDefaultMaxSize);
+    for (;;) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        const int ready = ::poll(fds, 2, kIdleTimeoutSeconds * 1000);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0 || fds[1].revents != 0 || !(fds[0].revents & POLLIN)) {
+            return;
+        }
+
+        uint16_t length;
+        if (!read_exact(client_fd, reinterpret_cast<uint8_t*>(&length), sizeof(length))) {
+            return;
+        }
+        length = ntohs(length);
+        if (length == 0 || length > kMaxQuerySize || !read_exact(client_fd, query, length)) {
+            return;
+        }
+
+        DhcpMessageView view;
+        try {
+            view = DhcpMessageView(query, length);
+        } catch (const DhcpParserException& e) {
+            LOG_WARN("Dropping bulk leasequery connection: " + std::string(e.what()));
+            return;
+        }
+
+        bool open = true;
+        if (view.message_type() == DhcpMessageType::BULKLEASEQUERY) {
+            const auto send = [&](ByteView reply) {
+                append_frame(out, reply);
+                if (out.size() >= kSendBatch) {
+                    open = write_all(client_fd, out);
+                    out.clear();
+                }
+                return open && !stopping_.load(std::memory_order_relaxed);
+            };
+            leases_sent_.fetch_add(responder_.answer_bulk(view, send), std::memory_order_relaxed);
+            queries_.fetch_add(1, std::memory_order_relaxed);
+        } else if (view.message_type() == DhcpMessageType::LEASEQUERY) {
+            append_frame(out, responder_.answer(view, DhcpMessageWriter::for_current_thread()));
+        } else {
+            LOG_WARN("Dropping bulk leasequery connection: unexpected " +
+                     std::string(get_message_type_name(view.message_type())));
+            return;
+        }
+        if (!open || !write_all(client_fd, out) || stopping_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        out.clear();
+    }
+}
+
+} // namespace simple_dhcpd
@@ -13,11 +13,60 @@
 #include <sstream>
 #include <algorithm>
 #include <chrono>
+#include <exception>
+#include <unistd.h>
 
 namespace simple_dhcpd {
 
+namespace {
+/**
+ * @brief Run fn(shard) for every shard index on up to eight threads
+ * @param shards Number of shards
+ * @param fn Called once per index; takes the locks it needs
+ */
+template <typename Fn>
+void for_each_shard_parallel(size_t shards, Fn&& fn) {
+    const size_t workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), 8);
+    std::atomic<size_t> next(0);
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    auto run = [&] {
+        try {
+            for (size_t shard; (shard = next.fetch_add(1)) < shards;) {
+                fn(shard);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            failure = std::current_exception();
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+}
+
 LeaseManager::LeaseManager(const DhcpConfig& config) 
-    : config_(config), running_(false) {
+    : config_(config), active_lease_count_(0), running_(false), maintenance_loop_(nullptr), journal_retired_(false),
+      allocation_mask_(~uint64_t(0)), observe_changes_(false) {
+    auto table = std::make_shared<PoolTable>();
+    table->subnets = SubnetTable::build(config_.subnets);
+    for (const auto& subnet : config_.subnets) {
+        pool_storage_.push_back(std::make_unique<PoolShard>());
+        pool_storage_.back()->pool = AddressPool(subnet);
+        table->pools.push_back(pool_storage_.back().get());
+        table->set_range(static_cast<SubnetId>(table->pools.size() - 1), &subnet);
+    }
+    pool_table_ = std::move(table);
     LOG_DEBUG("Lease manager initialized");
 }
 
@@ -30,8 +79,22 @@ void LeaseManager::start() {
         return;
     }
     
+    own_loop_ = std::make_unique<EventLoop>(EventBackendType::AUTO, "lease maintenance");
+    own_loop_->start();
+    start(*own_loop_);
+}
+
+void LeaseManager::start(EventLoop& loop) {
+    if (running_) {
+        if (maintenance_loop_ == &loop) {
+            return;
+        }
+        cancel_maintenance();
+    }
+    
+    maintenance_loop_ = &loop;
+    schedule_maintenance();
     running_ = true;
-    cleanup_thread_ = std::thread(&LeaseManager::cleanup_expired_leases, this);
     
     LOG_INFO("Lease manager started");
 }
@@ -42,71 +105,167 @@ void LeaseManager::stop() {
     }
     
     running_ = false;
-    
-    if (cleanup_thread_.joinable()) {
-        cleanup_thread_.join();
+    cancel_maintenance();
+    if (journal_) {
+        journal_->flush();
     }
     
     LOG_INFO("Lease manager stopped");
 }
 
 DhcpLease LeaseManager::allocate_lease(const MacAddress& mac_address, IpAddress requested_ip, const std::string& subnet_name) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    return allocate_lease(mac_address, requested_ip, get_subnet_by_name(*subnet_table(), subnet_name));
+}
+
+DhcpLease LeaseManager::allocate_lease(const MacAddress& mac_address, IpAddress requested_ip, SubnetId subnet_id) {
+    MacShard& shard = mac_shard(mac_address);
+    std::unique_lock<std::shared_mutex> mac_lock(shard.mutex);
     
     // Check if client already has a lease
-    auto existing_lease = leases_by_mac_.find(mac_address);
-    if (existing_lease != leases_by_mac_.end() && existing_lease->second->is_active) {
+    const LeaseRecord* existing_lease = shard.leases.find(mac_address);
+    if (existing_lease && existing_lease->is_active()) {
         // Client already has an active lease, return it
-        return *existing_lease->second;
+        return shard.leases.load(*existing_lease);
     }
     
     // Get subnet configuration
-    const DhcpSubnet& subnet = get_subnet_by_name(subnet_name);
+    const auto table = pool_table();
+    const DhcpSubnet& subnet = get_subnet(*table->subnets, subnet_id);
+    PoolShard& pool = *table->pools[subnet_id];
+    std::unique_lock<std::mutex> pool_lock(pool.mutex);
     
-    // Determine IP address to allocate
+    // Determine IP address to allocate; an address offered to this client is already marked used
     IpAddress ip_to_allocate = requested_ip;
+    IpAddress offered_ip = 0;
+    prune_holds_unlocked(pool);
+    const bool offered = pool.offers.take(mac_address, offered_ip);
     
-    if (ip_to_allocate == 0) {
+    if (offered && (requested_ip == 0 || requested_ip == offered_ip)) {
+        ip_to_allocate = offered_ip;
+    } else if (ip_to_allocate == 0) {
         // No specific IP requested, find an available one
-        ip_to_allocate = find_available_ip(subnet);
+        ip_to_allocate = find_free_unlocked(pool);
+        if (ip_to_allocate == 0) {
+            throw LeaseManagerException("No available IP addresses in subnet: " + subnet.name);
+        }
     } else {
-        // Check if requested IP is available
-        if (!is_ip_available(ip_to_allocate, subnet_name)) {
+        // Check if requested IP is available; an offer of another address is dropped
+        if (offered) {
+            release_offered_unlocked(pool, offered_ip);
+        }
+        if (!is_ip_available_unlocked(ip_to_allocate, subnet, &pool)) {
+            MacAddress holder;
+            bool held;
+            {
+                const IpShard& owners = ip_shard(ip_to_allocate);
+                std::shared_lock<std::shared_mutex> ip_lock(owners.mutex);
+                held = owners.owners.find(ip_to_allocate, holder);
+            }
+            if (held && holder != mac_address) {
+                address_conflict(holder, mac_address, ip_to_allocate);
+            }
             throw LeaseManagerException("Requested IP address not available: " + ip_to_string(ip_to_allocate));
         }
     }
     
     // Create new lease
-    auto lease = std::make_shared<DhcpLease>();
-    lease->mac_address = mac_address;
-    lease->ip_address = ip_to_allocate;
-    lease->hostname = "";
-    lease->lease_start = get_current_time();
-    lease->lease_end = calculate_lease_end(lease->lease_start, subnet.lease_time);
-    lease->renewal_time = calculate_renewal_time(lease->lease_start, subnet.lease_time);
-    lease->rebinding_time = calculate_rebinding_time(lease->lease_start, subnet.lease_time);
-    lease->is_static = false;
-    lease->is_active = true;
-    
-    // Add lease to internal structures
-    add_lease(lease);
+    DhcpLease lease;
+    lease.mac_address = mac_address;
+    lease.ip_address = ip_to_allocate;
+    lease.hostname = "";
+    lease.lease_start = get_current_time();
+    lease.lease_end = calculate_lease_end(lease.lease_start, subnet.lease_time);
+    lease.renewal_time = calculate_renewal_time(lease.lease_start, subnet.lease_time);
+    lease.rebinding_time = calculate_rebinding_time(lease.lease_start, subnet.lease_time);
+    lease.lease_time = std::chrono::seconds(0);
+    lease.lease_type = LeaseType::DYNAMIC;
+    lease.is_static = false;
+    lease.is_active = true;
+    
+    // Add lease to internal structures; an inactive entry for this MAC is replaced
+    shard.leases.put(lease);
+    attach_address_unlocked(ip_to_allocate, mac_address, pool.pool.contains(ip_to_allocate) ? &pool : nullptr);
+    const uint64_t sequence = journal_append(JournalOp::ALLOCATE, lease);
+    pool_lock.unlock();
+    mac_lock.unlock();
+    journal_wait(sequence);
     
     LOG_INFO("Allocated lease: " + mac_to_string(mac_address) + " -> " + ip_to_string(ip_to_allocate));
     
-    return *lease;
+    return lease;
+}
+
+DhcpLease LeaseManager::reserve_offer(const MacAddress& mac_address, IpAddress requested_ip, SubnetId subnet_id,
+                                      std::chrono::seconds hold) {
+    MacShard& shard = mac_shard(mac_address);
+    std::shared_lock<std::shared_mutex> mac_lock(shard.mutex);
+    
+    const LeaseRecord* existing_lease = shard.leases.find(mac_address);
+    if (existing_lease && existing_lease->is_active()) {
+        return shard.leases.load(*existing_lease);
+    }
+    
+    const auto table = pool_table();
+    const DhcpSubnet& subnet = get_subnet(*table->subnets, subnet_id);
+    PoolShard& pool = *table->pools[subnet_id];
+    std::lock_guard<std::mutex> pool_lock(pool.mutex);
+    prune_holds_unlocked(pool);
+    
+    // Keep an earlier offer unless the client now asks for another free address
+    IpAddress ip = 0;
+    if (pool.offers.find(mac_address, ip) && requested_ip != 0 && requested_ip != ip &&
+        pool.pool.is_free(requested_ip)) {
+        pool.offers.take(mac_address, ip);
+        release_offered_unlocked(pool, ip);
+        ip = 0;
+    }
+    if (ip == 0) {
+        ip = requested_ip != 0 && pool.pool.is_free(requested_ip) ? requested_ip : find_free_unlocked(pool);
+        if (ip == 0) {
+            throw LeaseManagerException("No available IP addresses in subnet: " + subnet.name);
+        }
+        pool.pool.mark_used(ip);
+    }
+    
+    DhcpLease offer;
+    offer.mac_address = mac_address;
+    offer.ip_address = ip;
+    offer.lease_start = get_current_time();
+    offer.lease_end = calculate_lease_end(offer.lease_start, subnet.lease_time);
+    offer.renewal_time = calculate_renewal_time(offer.lease_start, subnet.lease_time);
+    offer.rebinding_time = calculate_rebinding_time(offer.lease_start, subnet.lease_time);
+    offer.lease_time = std::chrono::seconds(0);
+    offer.lease_type = LeaseType::DYNAMIC;
+    offer.is_static = false;
+    offer.is_active = false;
+    pool.offers.hold(mac_address, ip, LeaseRecord::to_ticks(offer.lease_start + hold));
+    return offer;
+}
+
+void LeaseManager::withdraw_offer(const MacAddress& mac_address, SubnetId subnet_id) {
+    const auto table = pool_table();
+    if (subnet_id >= table->pools.size()) {
+        return;
+    }
+    PoolShard& pool = *table->pools[subnet_id];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    IpAddress ip = 0;
+    if (pool.offers.take(mac_address, ip)) {
+        release_offered_unlocked(pool, ip);
+    }
 }
 
 DhcpLease LeaseManager::renew_lease(const MacAddress& mac_address, IpAddress ip_address) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    MacShard& shard = mac_shard(mac_address);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
     
     // Find existing lease
-    auto lease_it = leases_by_mac_.find(mac_address);
-    if (lease_it == leases_by_mac_.end()) {
+    LeaseRecord* lease = shard.leases.find(mac_address);
+    if (!lease) {
         throw LeaseManagerException("No lease found for MAC address: " + mac_to_string(mac_address));
     }
     
-    auto lease = lease_it->second;
-    if (!lease->is_active) {
+    if (!lease->is_active()) {
         throw LeaseManagerException("Lease is not active for MAC address: " + mac_to_string(mac_address));
     }
     
@@ -114,37 +273,43 @@ DhcpLease LeaseManager::renew_lease(const MacAddress& mac_address, IpAddress ip_
         throw LeaseManagerException("IP address mismatch for lease renewal");
     }
     
-    // Get subnet configuration (simplified - use first subnet)
-    const DhcpSubnet& subnet = config_.subnets[0];
+    const auto subnets = subnet_table();
+    const DhcpSubnet& subnet = get_subnet_for_ip(*subnets, ip_address);
     
-    // Renew lease
-    lease->lease_start = get_current_time();
-    lease->lease_end = calculate_lease_end(lease->lease_start, subnet.lease_time);
-    lease->renewal_time = calculate_renewal_time(lease->lease_start, subnet.lease_time);
-    lease->rebinding_time = calculate_rebinding_time(lease->lease_start, subnet.lease_time);
+    // Renew lease; only the fixed-size times change, so the record is patched in place
+    const auto lease_start = get_current_time();
+    lease->lease_start = LeaseRecord::to_ticks(lease_start);
+    lease->lease_end = LeaseRecord::to_ticks(calculate_lease_end(lease_start, subnet.lease_time));
+    lease->renewal_time = LeaseRecord::to_ticks(calculate_renewal_time(lease_start, subnet.lease_time));
+    lease->rebinding_time = LeaseRecord::to_ticks(calculate_rebinding_time(lease_start, subnet.lease_time));
+    shard.leases.reschedule(*lease);
+    DhcpLease renewed = shard.leases.load(*lease);
+    const uint64_t sequence = journal_append(JournalOp::RENEW, renewed);
+    lock.unlock();
+    journal_wait(sequence);
     
     LOG_INFO("Renewed lease: " + mac_to_string(mac_address) + " -> " + ip_to_string(ip_address));
     
-    return *lease;
+    return renewed;
 }
 
 bool LeaseManager::release_lease(const MacAddress& mac_address, IpAddress ip_address) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    MacShard& shard = mac_shard(mac_address);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
     
     // Find lease by MAC address
-    auto lease_it = leases_by_mac_.find(mac_address);
-    if (lease_it == leases_by_mac_.end()) {
-        return false;
-    }
-    
-    auto lease = lease_it->second;
-    if (lease->ip_address != ip_address) {
+    const LeaseRecord* lease = shard.leases.find(mac_address);
+    if (!lease || lease->ip_address != ip_address) {
         return false;
     }
     
     // Release lease
-    lease->is_active = false;
-    remove_lease(lease);
+    const uint64_t sequence = journal_ || change_listener_ || observe_changes_
+        ? journal_append(JournalOp::RELEASE, shard.leases.load(*lease)) : 0;
+    shard.leases.erase(mac_address);
+    detach_address(ip_address, mac_address);
+    lock.unlock();
+    journal_wait(sequence);
     
     LOG_INFO("Released lease: " + mac_to_string(mac_address) + " -> " + ip_to_string(ip_address));
     
@@ -152,46 +317,80 @@ bool LeaseManager::release_lease(const MacAddress& mac_address, IpAddress ip_add
 }
 
 std::shared_ptr<DhcpLease> LeaseManager::get_lease_by_mac(const MacAddress& mac_address) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    const MacShard& shard = mac_shard(mac_address);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
     
-    auto it = leases_by_mac_.find(mac_address);
-    if (it != leases_by_mac_.end() && it->second->is_active) {
-        return it->second;
+    const LeaseRecord* lease = shard.leases.find(mac_address);
+    if (lease && lease->is_active()) {
+        return std::make_shared<DhcpLease>(shard.leases.load(*lease));
     }
     
     return nullptr;
 }
 
 std::shared_ptr<DhcpLease> LeaseManager::get_lease_by_ip(IpAddress ip_address) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    MacAddress owner;
+    {
+        const IpShard& shard = ip_shard(ip_address);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (!shard.owners.find(ip_address, owner)) {
+            return nullptr;
+        }
+    }
     
-    auto it = leases_by_ip_.find(ip_address);
-    if (it != leases_by_ip_.end() && it->second->is_active) {
-        return it->second;
+    // The owner may have moved on between the two lookups
+    auto lease = get_lease_by_mac(owner);
+    if (lease && lease->ip_address == ip_address) {
+        return lease;
     }
     
     return nullptr;
 }
 
+std::shared_ptr<DhcpLease> LeaseManager::get_lease_by_client_id(std::string_view client_id) {
+    std::shared_ptr<DhcpLease> latest;
+    for (const auto& shard : mac_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        shard.leases.for_each_client_id(client_id, [&](const LeaseRecord& record) {
+            if (record.is_active() &&
+                (!latest || record.lease_start > LeaseRecord::to_ticks(latest->lease_start))) {
+                latest = std::make_shared<DhcpLease>(shard.leases.load(record));
+            }
+        });
+    }
+    return latest;
+}
+
+bool LeaseManager::is_address_leased(IpAddress ip_address) const {
+    const IpShard& shard = ip_shard(ip_address);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.owners.contains(ip_address);
+}
+
 bool LeaseManager::is_ip_available(IpAddress ip_address, const std::string& subnet_name) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    prune_declined_unlocked();
+    return is_ip_available(ip_address, get_subnet_by_name(*subnet_table(), subnet_name));
+}
 
-    // Check if IP is already leased
-    auto it = leases_by_ip_.find(ip_address);
-    if (it != leases_by_ip_.end() && it->second->is_active) {
-        return false;
+bool LeaseManager::is_ip_available(IpAddress ip_address, SubnetId subnet_id) {
+    const auto table = pool_table();
+    const DhcpSubnet& subnet = get_subnet(*table->subnets, subnet_id);
+    PoolShard& pool = *table->pools[subnet_id];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return is_ip_available_unlocked(ip_address, subnet, &pool);
+}
+
+bool LeaseManager::is_ip_available_unlocked(IpAddress ip_address, const DhcpSubnet& subnet, PoolShard* pool) {
+    if (pool) {
+        // The bitmap already accounts for leases, declines and exclusions
+        prune_holds_unlocked(*pool);
+        return pool->pool.is_free(ip_address);
     }
 
-    auto dit = declined_until_.find(ip_address);
-    if (dit != declined_until_.end() && std::chrono::system_clock::now() < dit->second) {
+    // Check if IP is already leased
+    if (is_address_leased(ip_address)) {
         return false;
     }
     
-    // Get subnet configuration
-    const DhcpSubnet& subnet = get_subnet_by_name(subnet_name);
-    
     // Check if IP is in range
     if (!is_ip_in_range(ip_address, subnet)) {
         return false;
@@ -206,55 +405,115 @@ bool LeaseManager::is_ip_available(IpAddress ip_address, const std::string& subn
 }
 
 std::vector<std::shared_ptr<DhcpLease>> LeaseManager::get_active_leases() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     std::vector<std::shared_ptr<DhcpLease>> active_leases;
-    for (const auto& pair : leases_by_mac_) {
-        if (pair.second->is_active) {
-            active_leases.push_back(pair.second);
-        }
+    active_leases.reserve(active_lease_count_.load(std::memory_order_relaxed));
+    for (const auto& shard : mac_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        shard.leases.for_each([&](const LeaseRecord& lease) {
+            if (lease.is_active()) {
+                active_leases.push_back(std::make_shared<DhcpLease>(shard.leases.load(lease)));
+            }
+        });
     }
     
     return active_leases;
 }
 
 std::vector<std::shared_ptr<DhcpLease>> LeaseManager::get_leases_for_subnet(const std::string& subnet_name) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     std::vector<std::shared_ptr<DhcpLease>> subnet_leases;
-    for (const auto& pair : leases_by_mac_) {
-        if (pair.second->is_active) {
-            // Check if lease belongs to subnet (simplified)
-            subnet_leases.push_back(pair.second);
-        }
+    const auto table = pool_table();
+    const SubnetId id = table->subnets->index().find_by_name(subnet_name);
+    if (id == kNoSubnet) {
+        return subnet_leases;
     }
     
+    LeaseCursor cursor;
+    std::vector<DhcpLease> chunk;
+    while (read_leases(cursor, chunk, kReadChunk) > 0) {
+        for (auto& lease : chunk) {
+            if (table->in_range(id, lease.ip_address)) {
+                subnet_leases.push_back(std::make_shared<DhcpLease>(std::move(lease)));
+            }
+        }
+    }
     return subnet_leases;
 }
 
-DhcpStats LeaseManager::get_statistics() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    DhcpStats stats;
-    stats.active_leases = 0;
-    
-    for (const auto& pair : leases_by_mac_) {
-        if (pair.second->is_active) {
-            stats.active_leases++;
+bool LeaseManager::is_pool_address(IpAddress ip_address) const {
+    const auto table = pool_table();
+    const SubnetId id = table->subnets->index().find_by_address(ip_address);
+    return id != kNoSubnet && table->in_range(id, ip_address);
+}
+
+size_t LeaseManager::read_leases(LeaseCursor& cursor, std::vector<DhcpLease>& leases, size_t max_leases) const {
+    leases.clear();
+    max_leases = std::max<size_t>(max_leases, 1);
+    while (!cursor.finished && leases.size() < max_leases) {
+        const MacShard& shard = mac_shards_[cursor.shard];
+        bool shard_done;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            shard_done = shard.leases.for_each_from(cursor.position, [&](const LeaseRecord& record) {
+                if (record.is_active()) {
+                    leases.push_back(shard.leases.load(record));
+                }
+                return leases.size() < max_leases;
+            });
+        }
+        if (shard_done) {
+            cursor.position = 0;
+            cursor.finished = ++cursor.shard == kLeaseShards;
         }
     }
-    
+    return leases.size();
+}
+
+std::vector<PoolUsage> LeaseManager::get_pool_usage() const {
+    const auto table = pool_table();
+    const SubnetTable& subnets = *table->subnets;
+    std::vector<PoolUsage> usage;
+    usage.reserve(subnets.size());
+    for (SubnetId id = 0; id < subnets.slots(); ++id) {
+        if (subnets.retired(id)) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(table->pools[id]->mutex);
+        const AddressPool& pool = table->pools[id]->pool;
+        usage.push_back(PoolUsage{subnets.subnet(id).name, pool.usable_count(), pool.free_count(),
+                                  table->pools[id]->offers.size()});
+    }
+    return usage;
+}
+
+DhcpStats LeaseManager::get_statistics() const {
+    DhcpStats stats;
+    stats.active_leases = active_lease_count_.load(std::memory_order_relaxed);
     return stats;
 }
 
+size_t LeaseManager::memory_usage() const {
+    size_t bytes = 0;
+    for (const auto& shard : mac_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        bytes += shard.leases.memory_usage();
+    }
+    for (const auto& shard : ip_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        bytes += shard.owners.memory_usage();
+    }
+    for (PoolShard* pool : pool_table()->pools) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        bytes += pool->offers.memory_usage();
+    }
+    return bytes;
+}
+
 void LeaseManager::set_lease_expiration_callback(std::function<void(const DhcpLease&)> callback) {
     std::lock_guard<std::mutex> lock(mutex_);
     expiration_callback_ = callback;
 }
 
 void LeaseManager::load_leases(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     std::ifstream file(filename);
     if (!file.is_open()) {
         LOG_WARN("Cannot open lease file: " + filename);
@@ -294,8 +553,6 @@ void LeaseManager::load_leases(const std::string& filename) {
 }
 
 void LeaseManager::save_leases(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     std::ofstream file(filename);
     if (!file.is_open()) {
         throw LeaseManagerException("Cannot open lease file for writing: " + filename);
@@ -304,97 +561,437 @@ void LeaseManager::save_leases(const std::string& filename) {
     file << "# DHCP Lease Database\n";
     file << "# Format: MAC IP HOSTNAME START_TIME END_TIME\n";
     
-    for (const auto& pair : leases_by_mac_) {
-        const auto& lease = pair.second;
-        if (lease->is_active) {
-            auto start_time = std::chrono::system_clock::to_time_t(lease->lease_start);
-            auto end_time = std::chrono::system_clock::to_time_t(lease->lease_end);
-            
-            file << mac_to_string(lease->mac_address) << " "
-                 << ip_to_string(lease->ip_address) << " "
-                 << lease->hostname << " "
-                 << start_time << " "
-                 << end_time << "\n";
-        }
+    // One shard at a time, so allocations in other shards keep going
+    for (const auto& shard : mac_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        shard.leases.for_each([&](const LeaseRecord& record) {
+            if (record.is_active()) {
+                const DhcpLease lease = shard.leases.load(record);
+                auto start_time = std::chrono::system_clock::to_time_t(lease.lease_start);
+                auto end_time = std::chrono::system_clock::to_time_t(lease.lease_end);
+                
+                file << mac_to_string(lease.mac_address) << " "
+                     << ip_to_string(lease.ip_address) << " "
+                     << lease.hostname << " "
+                     << start_time << " "
+                     << end_time << "\n";
+            }
+        });
     }
     
     file.close();
     LOG_INFO("Saved leases to: " + filename);
 }
 
-void LeaseManager::cleanup_expired_leases() {
-    last_lease_cleanup_ = std::chrono::steady_clock::now();
-    while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        if (!running_) {
-            break;
-        }
-        const auto steady_now = std::chrono::steady_clock::now();
-        if (steady_now - last_lease_cleanup_ < std::chrono::seconds(60)) {
-            continue;
+void LeaseManager::open_journal(const std::string& path) {
+    const std::string retired = path + ".old";
+    load_snapshot(path + ".snapshot");
+    
+    // Records hold whole leases, so applying them in file order rebuilds the table
+    auto apply = [this](JournalOp op, const DhcpLease& lease) {
+        auto stored = std::make_shared<DhcpLease>(lease);
+        if (op == JournalOp::ALLOCATE || op == JournalOp::RENEW) {
+            add_lease(stored);
+        } else {
+            remove_lease(stored);
         }
-        last_lease_cleanup_ = steady_now;
+    };
+    size_t records = LeaseJournal::replay(retired, apply);
+    records += LeaseJournal::replay(path, apply);
+    
+    journal_ = std::make_unique<LeaseJournal>(path);
+    journal_path_ = path;
+    LOG_INFO("Replayed " + std::to_string(records) + " lease journal records from: " + path);
+    
+    // A compaction was interrupted after rotating; finish it
+    if (::access(retired.c_str(), F_OK) == 0) {
+        journal_retired_ = true;
+        compact_journal();
+    }
+}
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        auto now = get_current_time();
-        prune_declined_unlocked();
+bool LeaseManager::compact_journal() {
+    std::lock_guard<std::mutex> compact_lock(compact_mutex_);
+    if (!journal_) {
+        return false;
+    }
+    
+    // New changes go to a fresh journal while the snapshot is taken, so the
+    // snapshot covers everything in the retired file
+    // The retired file is deleted only once a rotation is known to have closed it
+    const std::string retired = journal_path_ + ".old";
+    if (!journal_retired_) {
+        journal_->rotate(retired);
+        journal_retired_ = true;
+    }
+    
+    save_snapshot(journal_path_ + ".snapshot");
+    ::unlink(retired.c_str());
+    journal_retired_ = false;
+    
+    LOG_INFO("Compacted lease journal: " + journal_path_);
+    return true;
+}
 
-        std::vector<std::shared_ptr<DhcpLease>> expired_leases;
-        
-        for (const auto& pair : leases_by_mac_) {
-            const auto& lease = pair.second;
-            if (lease->is_active && now > lease->lease_end) {
-                expired_leases.push_back(lease);
+uint64_t LeaseManager::journal_append(JournalOp op, const DhcpLease& lease) {
+    if (change_listener_) {
+        change_listener_(op, lease);
+    }
+    if (observe_changes_) {
+        lease_changed(op, lease);
+    }
+    return journal_ ? journal_->append(op, lease) : 0;
+}
+
+void LeaseManager::lease_changed(JournalOp, const DhcpLease&) {}
+
+void LeaseManager::address_conflict(const MacAddress&, const MacAddress&, IpAddress) {}
+
+void LeaseManager::journal_wait(uint64_t sequence) {
+    if (sequence != 0 && config_.lease_journal_sync) {
+        journal_->wait_durable(sequence);
+    }
+}
+
+void LeaseManager::set_change_listener(std::function<void(JournalOp, const DhcpLease&)> listener) {
+    // Every change is journaled under its MAC shard lock, so holding them all swaps the listener safely
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    locks.reserve(kLeaseShards);
+    for (auto& shard : mac_shards_) {
+        locks.emplace_back(shard.mutex);
+    }
+    change_listener_ = std::move(listener);
+}
+
+bool LeaseManager::apply_replicated(JournalOp op, const DhcpLease& lease) {
+    const int64_t start = LeaseRecord::to_ticks(lease.lease_start);
+    // Both servers resolve a clash the same way: later start, then higher MAC
+    auto local_wins = [&](const LeaseRecord& local) {
+        return local.lease_start != start ? local.lease_start > start : local.mac_address > lease.mac_address;
+    };
+    MacShard& shard = mac_shard(lease.mac_address);
+    
+    if (op == JournalOp::RELEASE || op == JournalOp::EXPIRE) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        const LeaseRecord* existing = shard.leases.find(lease.mac_address);
+        // A renewal here after the peer's change keeps the lease
+        if (!existing || existing->ip_address != lease.ip_address || existing->lease_start > start) {
+            return false;
+        }
+        if (journal_) {
+            journal_->append(op, lease);
+        }
+        shard.leases.erase(lease.mac_address);
+        detach_address(lease.ip_address, lease.mac_address);
+        return true;
+    }
+    if (!lease.is_active) {
+        return false;
+    }
+    
+    // Another client holding the address here gives it up unless its lease is newer
+    MacAddress owner;
+    bool owned;
+    {
+        const IpShard& ip = ip_shard(lease.ip_address);
+        std::shared_lock<std::shared_mutex> lock(ip.mutex);
+        owned = ip.owners.find(lease.ip_address, owner);
+    }
+    if (owned && owner != lease.mac_address) {
+        MacShard& other = mac_shard(owner);
+        std::unique_lock<std::shared_mutex> lock(other.mutex);
+        const LeaseRecord* held = other.leases.find(owner);
+        if (held && held->ip_address == lease.ip_address) {
+            if (local_wins(*held)) {
+                return false;
             }
+            if (journal_) {
+                journal_->append(JournalOp::RELEASE, other.leases.load(*held));
+            }
+            other.leases.erase(owner);
+            detach_address(lease.ip_address, owner);
+            LOG_WARN("Failover peer leased " + ip_to_string(lease.ip_address) + " to " +
+                     mac_to_string(lease.mac_address) + "; dropped the lease of " + mac_to_string(owner));
         }
-        
-        for (const auto& lease : expired_leases) {
-            lease->is_active = false;
-            remove_lease(lease);
-            
-            if (expiration_callback_) {
-                expiration_callback_(*lease);
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    const LeaseRecord* existing = shard.leases.find(lease.mac_address);
+    if (existing && existing->is_active() && existing->lease_start > start) {
+        return false;
+    }
+    if (journal_) {
+        journal_->append(op, lease);
+    }
+    insert_lease_unlocked(shard, lease);
+    return true;
+}
+
+bool LeaseManager::load_snapshot(const std::string& path) {
+    if (::access(path.c_str(), F_OK) != 0) {
+        return false;
+    }
+    const LeaseSnapshot snapshot(path);
+    
+    // One sequential pass over the mapping copies the active records into
+    // per-shard runs. Each shard is then filled from contiguous memory while
+    // its tables are hot in cache, and separate shards fill in parallel.
+    struct Address {
+        IpAddress ip_address;
+        MacAddress mac_address;
+    };
+    auto mac_index = [this](const SnapshotRecord& record) {
+        return static_cast<size_t>(&mac_shard(record.mac_address) - mac_shards_.data());
+    };
+    auto ip_index = [this](const SnapshotRecord& record) {
+        return static_cast<size_t>(&ip_shard(record.ip_address) - ip_shards_.data());
+    };
+    std::vector<size_t> mac_start(kLeaseShards + 1, 0);
+    std::vector<size_t> ip_start(kLeaseShards + 1, 0);
+    std::vector<size_t> string_bytes(kLeaseShards, 0);
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        const SnapshotRecord& record = snapshot.record(i);
+        if (record.flags & SnapshotRecord::kActive) {
+            const size_t shard = mac_index(record);
+            ++mac_start[shard + 1];
+            string_bytes[shard] += record.hostname_length + record.client_id_length;
+            ++ip_start[ip_index(record) + 1];
+        }
+    }
+    for (size_t shard = 0; shard < kLeaseShards; ++shard) {
+        mac_start[shard + 1] += mac_start[shard];
+        ip_start[shard + 1] += ip_start[shard];
+    }
+    std::vector<SnapshotRecord> by_mac(mac_start.back());
+    std::vector<Address> by_ip(ip_start.back());
+    {
+        std::vector<size_t> mac_next(mac_start.begin(), mac_start.end() - 1);
+        std::vector<size_t> ip_next(ip_start.begin(), ip_start.end() - 1);
+        for (size_t i = 0; i < snapshot.size(); ++i) {
+            const SnapshotRecord& record = snapshot.record(i);
+            if (record.flags & SnapshotRecord::kActive) {
+                by_mac[mac_next[mac_index(record)]++] = record;
+                by_ip[ip_next[ip_index(record)]++] = Address{record.ip_address, record.mac_address};
+            }
+        }
+    }
+    
+    for_each_shard_parallel(kLeaseShards, [&](size_t i) {
+        MacShard& shard = mac_shards_[i];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.leases.reserve(mac_start[i + 1] - mac_start[i], string_bytes[i]);
+        for (size_t k = mac_start[i]; k < mac_start[i + 1]; ++k) {
+            const SnapshotRecord& record = by_mac[k];
+            const LeaseRecord* existing = shard.leases.find(record.mac_address);
+            if (existing && existing->ip_address != record.ip_address) {
+                detach_address(existing->ip_address, record.mac_address);
+            }
+            shard.leases.put(snapshot.load(record));
+        }
+    });
+    for_each_shard_parallel(kLeaseShards, [&](size_t i) {
+        IpShard& shard = ip_shards_[i];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.owners.reserve(ip_start[i + 1] - ip_start[i]);
+        size_t added = 0;
+        for (size_t k = ip_start[i]; k < ip_start[i + 1]; ++k) {
+            added += shard.owners.insert(by_ip[k].ip_address, by_ip[k].mac_address);
+        }
+        active_lease_count_.fetch_add(added, std::memory_order_relaxed);
+    });
+    
+    // Take the leased addresses out of their pools; most share the last one's pool
+    PoolShard* pool = nullptr;
+    std::unique_lock<std::mutex> pool_lock;
+    for (const Address& address : by_ip) {
+        if (!pool || !pool->pool.contains(address.ip_address)) {
+            if (pool_lock.owns_lock()) {
+                pool_lock.unlock();
+            }
+            pool = pool_for_ip(address.ip_address);
+            if (!pool) {
+                continue;
             }
-            
-            LOG_INFO("Expired lease: " + mac_to_string(lease->mac_address) + " -> " + ip_to_string(lease->ip_address));
+            pool_lock = std::unique_lock<std::mutex>(pool->mutex);
         }
+        pool->pool.mark_used(address.ip_address);
+    }
+    
+    LOG_INFO("Loaded " + std::to_string(by_mac.size()) + " leases from snapshot: " + path);
+    return true;
+}
+
+void LeaseManager::save_snapshot(const std::string& path) {
+    LeaseSnapshotWriter writer;
+    writer.reserve(active_lease_count_.load(std::memory_order_relaxed));
+    // One shard at a time, so allocations in other shards keep going
+    for (const auto& shard : mac_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        shard.leases.for_each([&](const LeaseRecord& record) {
+            if (record.is_active()) {
+                writer.add(shard.leases.load(record));
+            }
+        });
+    }
+    writer.write(path);
+    LOG_INFO("Saved " + std::to_string(writer.size()) + " leases to snapshot: " + path);
+}
+
+void LeaseManager::maintenance_tick() {
+    const uint64_t compact_bytes = uint64_t(config_.lease_journal_compact_mb) << 20;
+    cleanup_expired_leases();
+    if (journal_ && compact_bytes != 0 && journal_->size_bytes() > compact_bytes) {
+        try {
+            compact_journal();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Lease journal compaction failed: " + std::string(e.what()));
+        }
+    }
+}
+
+void LeaseManager::schedule_maintenance() {
+    add_maintenance_timer(std::chrono::seconds(1), [this]() { maintenance_tick(); });
+}
+
+void LeaseManager::add_maintenance_timer(std::chrono::milliseconds interval, EventLoop::Callback fn) {
+    maintenance_timers_.push_back(maintenance_loop_->add_timer(interval, std::move(fn)));
+}
+
+void LeaseManager::add_maintenance_watch(int fd, EventLoop::Callback on_readable) {
+    maintenance_loop_->watch(fd, std::move(on_readable));
+    maintenance_watches_.push_back(fd);
+}
+
+void LeaseManager::cancel_maintenance() {
+    // cancel_timer() and unwatch() return once a running callback has finished
+    for (EventLoop::TimerId id : maintenance_timers_) {
+        maintenance_loop_->cancel_timer(id);
+    }
+    maintenance_timers_.clear();
+    for (int fd : maintenance_watches_) {
+        maintenance_loop_->unwatch(fd);
+    }
+    maintenance_watches_.clear();
+    maintenance_loop_ = nullptr;
+    if (own_loop_) {
+        own_loop_->stop();
+        own_loop_.reset();
+    }
+}
+
+void LeaseManager::cleanup_expired_leases() {
+    for (PoolShard* pool : pool_table()->pools) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        prune_holds_unlocked(*pool);
+    }
+    {
+        std::lock_guard<std::mutex> lock(outside_declined_mutex_);
+        outside_declines_.release_due(LeaseRecord::to_ticks(std::chrono::system_clock::now()), [](IpAddress) {});
+    }
+    
+    std::vector<DhcpLease> expired_leases;
+    const int64_t now = LeaseRecord::to_ticks(get_current_time());
+    
+    // Shards are visited one at a time; only clients hashed to the shard wait
+    for (auto& shard : mac_shards_) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        while (const LeaseRecord* due = shard.leases.next_expired(now)) {
+            DhcpLease lease = shard.leases.load(*due);
+            journal_append(JournalOp::EXPIRE, lease);
+            lease.is_active = false;
+            shard.leases.erase(lease.mac_address);
+            detach_address(lease.ip_address, lease.mac_address);
+            expired_leases.push_back(std::move(lease));
+        }
+    }
+    
+    if (expired_leases.empty()) {
+        return;
+    }
+    std::function<void(const DhcpLease&)> callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callback = expiration_callback_;
+    }
+    for (const auto& lease : expired_leases) {
+        if (callback) {
+            callback(lease);
+        }
+        
+        LOG_INFO("Expired lease: " + mac_to_string(lease.mac_address) + " -> " + ip_to_string(lease.ip_address));
     }
 }
 
 void LeaseManager::add_declined_ip(IpAddress ip, std::chrono::seconds hold) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    declined_until_[ip] = std::chrono::system_clock::now() + hold;
+    const int64_t until = LeaseRecord::to_ticks(std::chrono::system_clock::now() + hold);
+    if (PoolShard* pool = pool_for_ip(ip)) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->declines.hold(ip, until);
+        pool->pool.mark_used(ip);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(outside_declined_mutex_);
+    outside_declines_.hold(ip, until);
 }
 
-void LeaseManager::prune_declined_unlocked() {
-    const auto now = std::chrono::system_clock::now();
-    for (auto it = declined_until_.begin(); it != declined_until_.end(); ) {
-        if (it->second <= now) {
-            it = declined_until_.erase(it);
-        } else {
-            ++it;
+void LeaseManager::prune_holds_unlocked(PoolShard& pool) {
+    if (pool.declines.order.empty() && pool.offers.size() == 0) {
+        return;
+    }
+    const int64_t now = LeaseRecord::to_ticks(std::chrono::system_clock::now());
+    pool.declines.release_due(now, [&](IpAddress ip) {
+        if (!is_address_leased(ip)) {
+            pool.pool.mark_free(ip);
         }
+    });
+    pool.offers.release_due(now, [&](IpAddress ip) {
+        release_offered_unlocked(pool, ip);
+    });
+}
+
+void LeaseManager::release_offered_unlocked(PoolShard& pool, IpAddress ip) {
+    if (!pool.declines.contains(ip) && !is_address_leased(ip)) {
+        pool.pool.mark_free(ip);
     }
 }
 
+IpAddress LeaseManager::find_free_unlocked(PoolShard& pool) {
+    const uint64_t mask = allocation_mask_.load(std::memory_order_relaxed);
+    const IpAddress ip = pool.pool.find_free(mask);
+    return ip != 0 || mask == ~uint64_t(0) ? ip : pool.pool.find_free();
+}
+
 IpAddress LeaseManager::find_available_ip(const DhcpSubnet& subnet) {
-    prune_declined_unlocked();
+    const auto table = pool_table();
+    const SubnetId subnet_id = table->subnets->index().find_by_name(subnet.name);
+    if (subnet_id != kNoSubnet) {
+        // Leased, declined and excluded addresses are already cleared in the bitmap
+        PoolShard& pool = *table->pools[subnet_id];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        prune_holds_unlocked(pool);
+        const IpAddress ip = pool.pool.find_free();
+        if (ip != 0) {
+            return ip;
+        }
+        throw LeaseManagerException("No available IP addresses in subnet: " + subnet.name);
+    }
 
+    // Subnet not from this manager's configuration: scan the range
     for (uint32_t ip = ntohl(subnet.range_start); ip <= ntohl(subnet.range_end); ++ip) {
         IpAddress network_ip = htonl(ip);
         
         // Check if IP is already leased
-        if (leases_by_ip_.find(network_ip) != leases_by_ip_.end()) {
-            continue;
-        }
-
-        auto dit = declined_until_.find(network_ip);
-        if (dit != declined_until_.end() && std::chrono::system_clock::now() < dit->second) {
+        if (is_address_leased(network_ip)) {
             continue;
         }
         
-        // Check if IP is excluded
+        // Check if IP is declined or excluded
+        if (PoolShard* pool = pool_for_ip(network_ip)) {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            if (pool->declines.contains(network_ip)) {
+                continue;
+            }
+        }
         if (is_ip_excluded(network_ip, subnet)) {
             continue;
         }
@@ -418,24 +1015,210 @@ bool LeaseManager::is_ip_excluded(IpAddress ip, const DhcpSubnet& subnet) {
     return false;
 }
 
-const DhcpSubnet& LeaseManager::get_subnet_by_name(const std::string& name) {
-    for (const auto& subnet : config_.subnets) {
-        if (subnet.name == name) {
-            return subnet;
+SubnetId LeaseManager::get_subnet_by_name(const SubnetTable& subnets, const std::string& name) const {
+    const SubnetId subnet_id = subnets.index().find_by_name(name);
+    if (subnet_id == kNoSubnet) {
+        throw LeaseManagerException("Subnet not found: " + name);
+    }
+    return subnet_id;
+}
+
+const DhcpSubnet& LeaseManager::get_subnet(const SubnetTable& subnets, SubnetId subnet_id) const {
+    const DhcpSubnet* subnet = subnets.find(subnet_id);
+    if (!subnet) {
+        throw LeaseManagerException("Subnet not found: id " + std::to_string(subnet_id));
+    }
+    return *subnet;
+}
+
+const DhcpSubnet& LeaseManager::get_subnet_for_ip(const SubnetTable& subnets, IpAddress ip) const {
+    if (subnets.size() == 0) {
+        throw LeaseManagerException("No subnets configured");
+    }
+    const SubnetId subnet_id = subnets.index().find_by_address(ip);
+    return subnets.subnet(subnet_id == kNoSubnet ? subnets.default_id() : subnet_id);
+}
+
+void LeaseManager::reconfigure(const DhcpConfig& config) {
+    std::lock_guard<std::mutex> lock(reconfigure_mutex_);
+    const auto current = pool_table();
+    auto next = std::make_shared<PoolTable>();
+    next->subnets = current->subnets->update(config.subnets);
+    next->pools = current->pools;
+    next->ranges = current->ranges;
+    
+    const SubnetTable& subnets = *next->subnets;
+    size_t rebuilt = 0;
+    for (SubnetId id = 0; id < subnets.slots(); ++id) {
+        switch (subnets.change(id)) {
+            case SubnetChange::ADDED:
+                pool_storage_.push_back(std::make_unique<PoolShard>());
+                next->pools.push_back(pool_storage_.back().get());
+                next->set_range(id, &subnets.subnet(id));
+                rebuild_pool(*next->pools[id], subnets.subnet(id));
+                ++rebuilt;
+                break;
+            case SubnetChange::POOL:
+                next->set_range(id, &subnets.subnet(id));
+                rebuild_pool(*next->pools[id], subnets.subnet(id));
+                ++rebuilt;
+                break;
+            case SubnetChange::REMOVED: {
+                // Leases in a removed subnet run out; their addresses have no pool
+                next->set_range(id, nullptr);
+                std::lock_guard<std::mutex> pool_lock(next->pools[id]->mutex);
+                next->pools[id]->pool = AddressPool();
+                next->pools[id]->offers.clear();
+                ++rebuilt;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    
+    std::atomic_store(&pool_table_, std::shared_ptr<const PoolTable>(std::move(next)));
+    LOG_INFO("Lease manager reconfigured: " + std::to_string(subnets.size()) + " subnets, " +
+             std::to_string(rebuilt) + " pools rebuilt");
+}
+
+void LeaseManager::rebuild_pool(PoolShard& shard, const DhcpSubnet& subnet) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    AddressPool pool(subnet);
+    // Allocations into this pool hold its mutex, so the address index is settled for its range
+    const uint64_t end = ntohl(subnet.range_end);
+    for (uint64_t host = ntohl(subnet.range_start); host <= end; ++host) {
+        const IpAddress ip = htonl(static_cast<uint32_t>(host));
+        if (pool.is_free(ip) && (shard.declines.contains(ip) || is_address_leased(ip))) {
+            pool.mark_used(ip);
         }
     }
-    throw LeaseManagerException("Subnet not found: " + name);
+    shard.offers.for_each_address([&](IpAddress ip) { pool.mark_used(ip); });
+    shard.pool = std::move(pool);
+}
+
+LeaseManager::MacShard& LeaseManager::mac_shard(const MacAddress& mac_address) const {
+    // NIC-specific bytes vary most; fold them with a multiplicative hash
+    uint32_t key = (uint32_t(mac_address[2]) << 24) | (uint32_t(mac_address[3]) << 16) |
+                   (uint32_t(mac_address[4]) << 8) | uint32_t(mac_address[5]);
+    key ^= (uint32_t(mac_address[0]) << 8) | uint32_t(mac_address[1]);
+    return mac_shards_[(key * 2654435761u) >> (32 - kLeaseShardBits)];
+}
+
+LeaseManager::IpShard& LeaseManager::ip_shard(IpAddress ip_address) const {
+    return ip_shards_[(ntohl(ip_address) * 2654435761u) >> (32 - kLeaseShardBits)];
 }
 
 void LeaseManager::add_lease(std::shared_ptr<DhcpLease> lease) {
-    leases_by_mac_[lease->mac_address] = lease;
-    leases_by_ip_[lease->ip_address] = lease;
-    update_statistics(*lease);
+    MacShard& shard = mac_shard(lease->mac_address);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    insert_lease_unlocked(shard, *lease);
+    journal_append(JournalOp::ALLOCATE, *lease);
+}
+
+void LeaseManager::insert_lease_unlocked(MacShard& shard, const DhcpLease& lease) {
+    const LeaseRecord* existing = shard.leases.find(lease.mac_address);
+    if (existing && existing->ip_address != lease.ip_address) {
+        detach_address(existing->ip_address, lease.mac_address);
+    }
+    shard.leases.put(lease);
+    
+    PoolShard* pool = pool_for_ip(lease.ip_address);
+    if (pool) {
+        std::lock_guard<std::mutex> pool_lock(pool->mutex);
+        attach_address_unlocked(lease.ip_address, lease.mac_address, pool);
+    } else {
+        attach_address_unlocked(lease.ip_address, lease.mac_address, nullptr);
+    }
 }
 
 void LeaseManager::remove_lease(std::shared_ptr<DhcpLease> lease) {
-    leases_by_mac_.erase(lease->mac_address);
-    leases_by_ip_.erase(lease->ip_address);
+    MacShard& shard = mac_shard(lease->mac_address);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    
+    const LeaseRecord* existing = shard.leases.find(lease->mac_address);
+    if (existing && existing->ip_address == lease->ip_address) {
+        journal_append(JournalOp::RELEASE, *lease);
+        shard.leases.erase(lease->mac_address);
+    }
+    detach_address(lease->ip_address, lease->mac_address);
+}
+
+bool LeaseManager::modify_lease(const MacAddress& mac_address, const std::function<void(DhcpLease&)>& update) {
+    MacShard& shard = mac_shard(mac_address);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    
+    const LeaseRecord* existing = shard.leases.find(mac_address);
+    if (!existing || !existing->is_active()) {
+        return false;
+    }
+    
+    DhcpLease lease = shard.leases.load(*existing);
+    const IpAddress old_ip = lease.ip_address;
+    update(lease);
+    lease.mac_address = mac_address;
+    shard.leases.put(lease);
+    journal_append(JournalOp::RENEW, lease);
+    
+    if (lease.ip_address != old_ip) {
+        detach_address(old_ip, mac_address);
+        PoolShard* pool = pool_for_ip(lease.ip_address);
+        std::unique_lock<std::mutex> pool_lock;
+        if (pool) {
+            pool_lock = std::unique_lock<std::mutex>(pool->mutex);
+        }
+        attach_address_unlocked(lease.ip_address, mac_address, pool);
+    }
+    return true;
+}
+
+void LeaseManager::attach_address_unlocked(IpAddress ip_address, const MacAddress& mac_address, PoolShard* pool) {
+    if (pool) {
+        pool->pool.mark_used(ip_address);
+    }
+    IpShard& shard = ip_shard(ip_address);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.owners.insert(ip_address, mac_address)) {
+        active_lease_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void LeaseManager::detach_address(IpAddress ip_address, const MacAddress& mac_address) {
+    PoolShard* pool = pool_for_ip(ip_address);
+    std::unique_lock<std::mutex> pool_lock;
+    if (pool) {
+        pool_lock = std::unique_lock<std::mutex>(pool->mutex);
+    }
+    
+    {
+        IpShard& shard = ip_shard(ip_address);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (!shard.owners.erase(ip_address, mac_address)) {
+            return;  // address already re-leased to someone else
+        }
+    }
+    active_lease_count_.fetch_sub(1, std::memory_order_relaxed);
+    
+    if (pool && !pool->declines.contains(ip_address)) {
+        pool->pool.mark_free(ip_address);
+    }
+}
+
+LeaseManager::PoolShard* LeaseManager::pool_for_ip(IpAddress ip) {
+    // Pools outlive every table, so the pointer stays valid after the table is dropped.
+    // The table's ranges are immutable; a pool rebuilt since ignores addresses outside its new range.
+    const auto table = pool_table();
+    const SubnetId subnet_id = table->subnets->index().find_by_address(ip);
+    if (subnet_id != kNoSubnet && table->in_range(subnet_id, ip)) {
+        return table->pools[subnet_id];
+    }
+    // Ranges are not always inside the indexed prefix; fall back to a scan
+    for (SubnetId id = 0; id < table->pools.size(); ++id) {
+        if (table->in_range(id, ip)) {
+            return table->pools[id];
+        }
+    }
+    return nullptr;
 }
 
 void LeaseManager::update_statistics(const DhcpLease& lease) {
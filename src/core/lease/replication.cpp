@@ -0,0 +1,652 @@
+/**
+ * @file lease/replication.cpp
+ * @brief Active/active lease replication implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/replication.hpp"
+#include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace simple_dhcpd {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr uint8_t kProtocolVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// Frame: 4-byte body length (network order), 1-byte type, body
+constexpr size_t kFrameHeader = 5;
+constexpr uint8_t kHello = 1;        // version, role, split (2), byte order mark (native)
+constexpr uint8_t kUpdate = 2;       // journal records
+constexpr uint8_t kResyncDone = 3;   // the sender's whole table has been sent
+constexpr uint8_t kAck = 4;          // records applied on this connection (8)
+constexpr uint8_t kHeartbeat = 5;
+
+constexpr size_t kMaxFrameBytes = size_t(16) << 20;
+constexpr size_t kMaxPendingBytes = size_t(8) << 20;   // beyond this, resync instead
+constexpr size_t kOutboxLowWater = size_t(256) << 10;  // refill below this
+constexpr size_t kResyncChunk = 1024;                  // leases per resync frame
+
+constexpr auto kPollInterval = std::chrono::milliseconds(100);
+constexpr auto kHeartbeatInterval = std::chrono::milliseconds(1000);
+constexpr auto kPeerTimeout = std::chrono::milliseconds(3000);
+constexpr auto kReconnectInterval = std::chrono::milliseconds(1000);
+
+// Whole-pool halves; see AddressPool::find_free(uint64_t)
+constexpr uint64_t kEvenOffsets = 0x5555555555555555ull;
+constexpr uint64_t kOddOffsets = 0xAAAAAAAAAAAAAAAAull;
+constexpr uint64_t kWholePool = ~uint64_t(0);
+
+// RFC 3074 section 6
+constexpr uint8_t kLoadBalanceTable[256] = {
+    251, 175, 119, 215,  81,  14,  79, 191, 103,  49, 181, 143, 186, 157,   0, 232,
+     31,  32,  55,  60, 152,  58,  17, 237, 174,  70, 160, 144, 220,  90,  57, 223,
+     59,   3,  18, 140, 111, 166, 203, 196, 134, 243, 124,  95, 222, 179, 197,  65,
+    180,  48,  36,  15, 107,  46, 233, 130, 165,  30, 123, 161, 209,  23,  97,  16,
+     40,  91, 219,  61, 100,  10, 210, 109, 250, 127,  22, 138,  29, 108, 244,  67,
+    207,   9, 178, 204,  74,  98, 126, 249, 167, 116,  34,  77, 193, 200, 121,   5,
+     20, 113,  71,  35, 128,  13, 182,  94,  25, 226, 227, 199,  75,  27,  41, 245,
+    230, 224,  43, 225, 177,  26, 155, 150, 212, 142, 218, 115, 241,  73,  88, 105,
+     39, 114,  62, 255, 192, 201, 145, 214, 168, 158, 221, 148, 154, 122,  12,  84,
+     82, 163,  44, 139, 228, 236, 205, 242, 217,  11, 187, 146, 159,  64,  86, 239,
+    195,  42, 106, 198, 118, 112, 184, 172,  87,   2, 173, 117, 176, 229, 247, 253,
+    137, 185,  99, 164, 102, 147,  45,  66, 231,  52, 141, 211, 194, 206, 246, 238,
+     56, 110,  78, 248,  63, 240, 189,  93,  92,  51,  53, 183,  19, 171,  72,  50,
+     33, 104, 101,  69,   8, 252,  83, 120,  76, 135,  85,  54, 202, 125, 188, 213,
+     96, 235, 136, 208, 162, 129, 190, 132, 156,  38,  47,   1,   7, 254,  24,   4,
+    216, 131,  89,  21,  28, 133,  37, 153, 149,  80, 170,  68,   6, 169, 234, 151
+};
+
+uint32_t get_be32(const char* data) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+    return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | bytes[3];
+}
+
+uint64_t get_be64(const char* data) {
+    return uint64_t(get_be32(data)) << 32 | get_be32(data + 4);
+}
+
+void put_be32(std::string& out, size_t offset, uint32_t value) {
+    for (int i = 3; i >= 0; --i) {
+        out[offset + i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+// Appends a frame header; end_frame() fills in the length once the body is written
+size_t begin_frame(std::string& out, uint8_t type) {
+    const size_t start = out.size();
+    out.resize(start + kFrameHeader);
+    out[start + 4] = static_cast<char>(type);
+    return start;
+}
+
+void end_frame(std::string& out, size_t start) {
+    put_be32(out, start, static_cast<uint32_t>(out.size() - start - kFrameHeader));
+}
+
+void append_u64_frame(std::string& out, uint8_t type, uint64_t value) {
+    const size_t start = begin_frame(out, type);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+    end_frame(out, start);
+}
+}
+
+struct LeaseReplicator::Link {
+    int fd = -1;
+    bool connecting = false;   // non-blocking connect() in progress
+    bool handshaken = false;
+    std::string inbox;
+    std::string outbox;
+    size_t out_offset = 0;     // bytes of outbox already written
+    std::vector<std::shared_ptr<DhcpLease>> resync;
+    size_t resync_next = 0;
+    bool resyncing = false;
+    uint64_t applied = 0;      // records applied from the peer on this connection
+    uint64_t acked = 0;        // records the peer confirmed on this connection
+    Clock::time_point last_receive;
+    Clock::time_point last_send;
+
+    size_t unsent() const { return outbox.size() - out_offset; }
+};
+
+LeaseReplicator::LeaseReplicator(LeaseManager& leases, FailoverRole role, const std::string& peer_address,
+                                 uint16_t port, uint32_t split)
+    : leases_(leases), role_(role), peer_address_(peer_address), peer_ip_(0), port_(port), split_(split),
+      peer_up_(false), listen_fd_(-1), wake_fds_{-1, -1}, stopping_(false),
+      pending_records_(0), streaming_(false), resync_requested_(false),
+      records_sent_(0), records_acked_(0), records_received_(0), resyncs_(0), connections_(0) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, peer_address_.c_str(), &addr) != 1) {
+        throw LeaseReplicationException("Invalid failover peer address: " + peer_address_);
+    }
+    peer_ip_ = addr.s_addr;
+    if (split_ > 256) {
+        throw LeaseReplicationException("Failover split must be between 0 and 256");
+    }
+}
+
+LeaseReplicator::~LeaseReplicator() {
+    stop();
+}
+
+void LeaseReplicator::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+
+    if (::pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw LeaseReplicationException("Failed to create replication wake pipe: " + std::string(strerror(errno)));
+    }
+    if (role_ == FailoverRole::SECONDARY) {
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (listen_fd_ < 0) {
+            const std::string error = strerror(errno);
+            close_fds();
+            throw LeaseReplicationException("Failed to create failover socket: " + error);
+        }
+        int opt = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            ::listen(listen_fd_, 4) < 0) {
+            const std::string error = strerror(errno);
+            close_fds();
+            throw LeaseReplicationException("Failed to listen for the failover peer on port " +
+                                            std::to_string(port_) + ": " + error);
+        }
+        socklen_t length = sizeof(addr);
+        if (getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &length) == 0) {
+            port_ = ntohs(addr.sin_port);
+        }
+    }
+
+    stopping_ = false;
+    leases_.set_change_listener([this](JournalOp op, const DhcpLease& lease) { enqueue(op, lease); });
+    thread_ = std::thread(&LeaseReplicator::run, this);
+    LOG_INFO(std::string("Lease replication started as ") +
+             (role_ == FailoverRole::PRIMARY ? "primary" : "secondary") + " with peer " +
+             peer_address_ + ":" + std::to_string(port_));
+}
+
+void LeaseReplicator::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    leases_.set_change_listener(nullptr);
+    stopping_ = true;
+    wake();
+    thread_.join();
+    close_fds();
+}
+
+ReplicationStats LeaseReplicator::get_statistics() const {
+    ReplicationStats stats;
+    stats.peer_up = peer_up_.load(std::memory_order_relaxed);
+    stats.records_sent = records_sent_.load(std::memory_order_relaxed);
+    stats.records_acked = records_acked_.load(std::memory_order_relaxed);
+    stats.records_received = records_received_.load(std::memory_order_relaxed);
+    stats.resyncs = resyncs_.load(std::memory_order_relaxed);
+    stats.connections = connections_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint8_t LeaseReplicator::load_balance_hash(const uint8_t* key, size_t length) {
+    uint8_t hash = static_cast<uint8_t>(length);
+    for (size_t i = length; i > 0;) {
+        hash = kLoadBalanceTable[hash ^ key[--i]];
+    }
+    return hash;
+}
+
+FailoverRole LeaseReplicator::parse_role(const std::string& name) {
+    if (name == "primary") {
+        return FailoverRole::PRIMARY;
+    }
+    if (name == "secondary") {
+        return FailoverRole::SECONDARY;
+    }
+    throw LeaseReplicationException("Failover role must be primary or secondary: " + name);
+}
+
+void LeaseReplicator::enqueue(JournalOp op, const DhcpLease& lease) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!streaming_) {
+        return;  // the next resync snapshot carries this change
+    }
+    const bool idle = pending_.empty();
+    LeaseJournal::encode(op, lease, pending_);
+    ++pending_records_;
+    const bool overflow = pending_.size() > kMaxPendingBytes;
+    if (overflow) {
+        // The peer is not keeping up; a fresh snapshot is cheaper than the backlog
+        pending_.clear();
+        pending_records_ = 0;
+        streaming_ = false;
+        resync_requested_ = true;
+    }
+    lock.unlock();
+
+    if (idle || overflow) {
+        wake();
+    }
+}
+
+void LeaseReplicator::wake() {
+    const char byte = 1;
+    // A full pipe already holds a wake-up, so EAGAIN is fine
+    while (::write(wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+}
+
+void LeaseReplicator::close_fds() {
+    for (int* fd : {&listen_fd_, &wake_fds_[0], &wake_fds_[1]}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void LeaseReplicator::run() {
+    Link link;
+    Clock::time_point next_connect = Clock::now();
+
+    while (!stopping_) {
+        const Clock::time_point now = Clock::now();
+        if (link.fd < 0 && role_ == FailoverRole::PRIMARY && now >= next_connect) {
+            next_connect = now + kReconnectInterval;
+            connect_peer(link);
+        }
+        if (link.fd >= 0 && !link.connecting) {
+            if (now - link.last_receive > kPeerTimeout) {
+                drop_link(link, "no traffic for " + std::to_string(kPeerTimeout.count()) + " ms");
+                continue;
+            }
+            fill_outbox(link);
+            if (link.unsent() > 0 && !flush(link)) {
+                drop_link(link, "send failed: " + std::string(strerror(errno)));
+                continue;
+            }
+        }
+
+        struct pollfd fds[3];
+        nfds_t count = 0;
+        fds[count++] = {wake_fds_[0], POLLIN, 0};
+        const nfds_t listen_slot = count;
+        if (listen_fd_ >= 0) {
+            fds[count++] = {listen_fd_, POLLIN, 0};
+        }
+        const nfds_t link_slot = count;
+        if (link.fd >= 0) {
+            short events = link.connecting ? POLLOUT : POLLIN;
+            if (!link.connecting && link.unsent() > 0) {
+                events |= POLLOUT;
+            }
+            fds[count++] = {link.fd, events, 0};
+        }
+
+        if (::poll(fds, count, static_cast<int>(kPollInterval.count())) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Lease replication poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        if (fds[0].revents != 0) {
+            char drain[64];
+            while (::read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        if (listen_fd_ >= 0 && (fds[listen_slot].revents & POLLIN)) {
+            accept_peer(link);
+            continue;  // the link slot may now describe another socket
+        }
+        if (link.fd < 0 || link_slot >= count || fds[link_slot].revents == 0) {
+            continue;
+        }
+
+        const short revents = fds[link_slot].revents;
+        if (link.connecting) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(link.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                LOG_DEBUG("Failover peer " + peer_address_ + " not reachable: " + strerror(error));
+                drop_link(link, "");
+                continue;
+            }
+            link.connecting = false;
+            on_connected(link);
+            continue;
+        }
+        if ((revents & (POLLIN | POLLHUP | POLLERR)) && !receive(link)) {
+            continue;  // receive() dropped the link
+        }
+        if ((revents & POLLOUT) && link.fd >= 0 && !flush(link)) {
+            drop_link(link, "send failed: " + std::string(strerror(errno)));
+        }
+    }
+
+    drop_link(link, "");
+}
+
+void LeaseReplicator::connect_peer(Link& link) {
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = peer_ip_;
+
+    link.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (link.fd < 0) {
+        LOG_ERROR("Failed to create failover socket: " + std::string(strerror(errno)));
+        return;
+    }
+    if (::connect(link.fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+        on_connected(link);
+    } else if (errno == EINPROGRESS) {
+        link.connecting = true;
+    } else {
+        LOG_DEBUG("Failover peer " + peer_address_ + " not reachable: " + strerror(errno));
+        drop_link(link, "");
+    }
+}
+
+void LeaseReplicator::accept_peer(Link& link) {
+    struct sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    const int fd = ::accept4(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &length,
+                             SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+    if (addr.sin_addr.s_addr != peer_ip_) {
+        LOG_WARN("Refused failover connection from " + ip_to_string(addr.sin_addr.s_addr));
+        ::close(fd);
+        return;
+    }
+    // The peer only reconnects once it has given up on the old connection
+    if (link.fd >= 0) {
+        drop_link(link, "peer reconnected");
+    }
+    link.fd = fd;
+    on_connected(link);
+}
+
+void LeaseReplicator::on_connected(Link& link) {
+    int opt = 1;
+    setsockopt(link.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    link.last_receive = link.last_send = Clock::now();
+
+    const size_t start = begin_frame(link.outbox, kHello);
+    link.outbox.push_back(static_cast<char>(kProtocolVersion));
+    link.outbox.push_back(static_cast<char>(role_));
+    link.outbox.push_back(static_cast<char>(split_ >> 8));
+    link.outbox.push_back(static_cast<char>(split_ & 0xFF));
+    link.outbox.append(reinterpret_cast<const char*>(&kByteOrderMark), sizeof(kByteOrderMark));
+    end_frame(link.outbox, start);
+}
+
+void LeaseReplicator::begin_resync(Link& link) {
+    // Changes from now on are queued; the snapshot taken after covers every earlier one
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.clear();
+        pending_records_ = 0;
+        streaming_ = true;
+        resync_requested_ = false;
+    }
+    link.resync = leases_.get_active_leases();
+    link.resync_next = 0;
+    link.resyncing = true;
+    resyncs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LeaseReplicator::fill_outbox(Link& link) {
+    if (!link.handshaken) {
+        return;
+    }
+    bool resync;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        resync = resync_requested_;
+    }
+    if (resync) {
+        LOG_WARN("Lease replication fell behind; resending the lease table to " + peer_address_);
+        begin_resync(link);
+    }
+
+    while (link.resyncing && link.unsent() < kOutboxLowWater) {
+        if (link.resync_next == link.resync.size()) {
+            const size_t start = begin_frame(link.outbox, kResyncDone);
+            end_frame(link.outbox, start);
+            LOG_INFO("Sent " + std::to_string(link.resync.size()) + " leases to failover peer " + peer_address_);
+            link.resync.clear();
+            link.resync.shrink_to_fit();
+            link.resyncing = false;
+            break;
+        }
+        const size_t end = std::min(link.resync.size(), link.resync_next + kResyncChunk);
+        const size_t start = begin_frame(link.outbox, kUpdate);
+        for (size_t i = link.resync_next; i < end; ++i) {
+            LeaseJournal::encode(JournalOp::ALLOCATE, *link.resync[i], link.outbox);
+        }
+        end_frame(link.outbox, start);
+        records_sent_.fetch_add(end - link.resync_next, std::memory_order_relaxed);
+        link.resync_next = end;
+    }
+
+    // Live changes follow the snapshot, so an older snapshot entry never overwrites them
+    if (!link.resyncing && link.unsent() < kOutboxLowWater) {
+        std::string batch;
+        uint64_t records;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch.swap(pending_);
+            records = pending_records_;
+            pending_records_ = 0;
+        }
+        if (!batch.empty()) {
+            const size_t start = begin_frame(link.outbox, kUpdate);
+            link.outbox.append(batch);
+            end_frame(link.outbox, start);
+            records_sent_.fetch_add(records, std::memory_order_relaxed);
+        }
+    }
+
+    if (link.unsent() == 0 && Clock::now() - link.last_send >= kHeartbeatInterval) {
+        const size_t start = begin_frame(link.outbox, kHeartbeat);
+        end_frame(link.outbox, start);
+    }
+}
+
+bool LeaseReplicator::receive(Link& link) {
+    char chunk[65536];
+    for (;;) {
+        const ssize_t n = ::recv(link.fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            link.inbox.append(chunk, static_cast<size_t>(n));
+            if (static_cast<size_t>(n) < sizeof(chunk)) {
+                break;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        drop_link(link, n == 0 ? "connection closed" : "receive failed: " + std::string(strerror(errno)));
+        return false;
+    }
+    link.last_receive = Clock::now();
+
+    size_t offset = 0;
+    bool ack_due = false;
+    auto fail = [&](const std::string& reason) {
+        LOG_ERROR("Failover peer " + peer_address_ + ": " + reason);
+        drop_link(link, reason);
+        return false;
+    };
+    while (link.inbox.size() - offset >= kFrameHeader) {
+        const size_t length = get_be32(link.inbox.data() + offset);
+        const uint8_t type = static_cast<uint8_t>(link.inbox[offset + 4]);
+        if (length > kMaxFrameBytes) {
+            return fail("frame of " + std::to_string(length) + " bytes");
+        }
+        if (link.inbox.size() - offset - kFrameHeader < length) {
+            break;
+        }
+        const char* body = link.inbox.data() + offset + kFrameHeader;
+        offset += kFrameHeader + length;
+
+        if (type != kHello && !link.handshaken) {
+            return fail("frame before the handshake");
+        }
+        switch (type) {
+            case kHello: {
+                uint32_t mark = 0;
+                if (length == 8) {
+                    std::memcpy(&mark, body + 4, sizeof(mark));
+                }
+                const uint32_t split = length == 8 ? uint32_t(uint8_t(body[2])) << 8 | uint8_t(body[3]) : 0;
+                if (length != 8 || uint8_t(body[0]) != kProtocolVersion) {
+                    return fail("unsupported replication protocol");
+                }
+                if (uint8_t(body[1]) == static_cast<uint8_t>(role_)) {
+                    return fail("both servers are configured with the same failover role");
+                }
+                if (split != split_) {
+                    return fail("peer splits at " + std::to_string(split) + ", this server at " +
+                                std::to_string(split_));
+                }
+                if (mark != kByteOrderMark) {
+                    return fail("peer has a different byte order");
+                }
+                link.handshaken = true;
+                connections_.fetch_add(1, std::memory_order_relaxed);
+                leases_.set_allocation_mask(role_ == FailoverRole::PRIMARY ? kEvenOffsets : kOddOffsets);
+                peer_up_ = true;
+                const uint32_t buckets = role_ == FailoverRole::PRIMARY ? split_ : 256 - split_;
+                LOG_INFO("Failover peer " + peer_address_ + " up; serving " + std::to_string(buckets) +
+                         " of 256 hash buckets");
+                begin_resync(link);
+                break;
+            }
+            case kUpdate: {
+                size_t records = 0;
+                const size_t decoded = LeaseJournal::decode_records(body, length,
+                    [this](JournalOp op, const DhcpLease& lease) { leases_.apply_replicated(op, lease); },
+                    &records);
+                link.applied += records;
+                records_received_.fetch_add(records, std::memory_order_relaxed);
+                if (decoded != length) {
+                    return fail("corrupt lease update");
+                }
+                ack_due = true;
+                break;
+            }
+            case kResyncDone:
+                LOG_INFO("Caught up with the lease table of failover peer " + peer_address_);
+                break;
+            case kAck: {
+                if (length != 8) {
+                    return fail("malformed acknowledgement");
+                }
+                const uint64_t acked = get_be64(body);
+                if (acked > link.acked) {
+                    records_acked_.fetch_add(acked - link.acked, std::memory_order_relaxed);
+                    link.acked = acked;
+                }
+                break;
+            }
+            case kHeartbeat:
+                break;
+            default:
+                return fail("unknown frame type " + std::to_string(type));
+        }
+    }
+    link.inbox.erase(0, offset);
+
+    // One acknowledgement covers every batch handled in this pass
+    if (ack_due) {
+        append_u64_frame(link.outbox, kAck, link.applied);
+    }
+    return true;
+}
+
+bool LeaseReplicator::flush(Link& link) {
+    while (link.unsent() > 0) {
+        const ssize_t n = ::send(link.fd, link.outbox.data() + link.out_offset, link.unsent(),
+                                 MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        link.out_offset += static_cast<size_t>(n);
+        link.last_send = Clock::now();
+    }
+    if (link.out_offset == link.outbox.size()) {
+        link.outbox.clear();
+        link.out_offset = 0;
+    } else if (link.out_offset > kOutboxLowWater) {
+        link.outbox.erase(0, link.out_offset);
+        link.out_offset = 0;
+    }
+    return true;
+}
+
+void LeaseReplicator::drop_link(Link& link, const std::string& reason) {
+    if (link.fd >= 0) {
+        ::close(link.fd);
+    }
+    if (link.handshaken) {
+        peer_up_ = false;
+        leases_.set_allocation_mask(kWholePool);
+        if (!reason.empty()) {
+            LOG_WARN("Failover peer " + peer_address_ + " down (" + reason + "); serving every client");
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streaming_ = false;
+        resync_requested_ = false;
+        pending_.clear();
+        pending_records_ = 0;
+    }
+    link = Link();
+}
+
+} // namespace simple_dhcpd
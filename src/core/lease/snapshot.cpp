@@ -0,0 +1,200 @@
+/**
+ * @file lease/snapshot.cpp
+ * @brief Versioned binary lease snapshot implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/lease/snapshot.hpp"
+#include "simple-dhcpd/core/utils/crc32.hpp"
+#include "simple-dhcpd/core/utils/durable_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr char kMagic[4] = {'S', 'D', 'L', 'S'};
+
+int64_t ticks(std::chrono::system_clock::time_point time) {
+    return time.time_since_epoch().count();
+}
+
+std::chrono::system_clock::time_point from_ticks(int64_t value) {
+    return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(value));
+}
+
+bool mac_less(const SnapshotRecord& record, const MacAddress& mac_address) {
+    return std::memcmp(record.mac_address.data(), mac_address.data(), mac_address.size()) < 0;
+}
+}
+
+void LeaseSnapshotWriter::add(const DhcpLease& lease) {
+    SnapshotRecord record{};
+    record.lease_start = ticks(lease.lease_start);
+    record.lease_end = ticks(lease.lease_end);
+    record.renewal_time = ticks(lease.renewal_time);
+    record.rebinding_time = ticks(lease.rebinding_time);
+    record.allocated_at = ticks(lease.allocated_at);
+    record.expires_at = ticks(lease.expires_at);
+    record.ip_address = lease.ip_address;
+    record.lease_time = static_cast<uint32_t>(lease.lease_time.count());
+    record.mac_address = lease.mac_address;
+    record.lease_type = static_cast<uint8_t>(lease.lease_type);
+    if (lease.is_active) {
+        record.flags |= SnapshotRecord::kActive;
+    }
+    if (lease.is_static) {
+        record.flags |= SnapshotRecord::kStatic;
+    }
+
+    record.hostname_length = static_cast<uint16_t>(std::min<size_t>(lease.hostname.size(), 0xFFFF));
+    record.hostname_offset = static_cast<uint32_t>(strings_.size());
+    strings_.append(lease.hostname, 0, record.hostname_length);
+    record.client_id_length = static_cast<uint16_t>(std::min<size_t>(lease.client_id.size(), 0xFFFF));
+    record.client_id_offset = static_cast<uint32_t>(strings_.size());
+    strings_.append(lease.client_id, 0, record.client_id_length);
+    if (strings_.size() > 0xFFFFFFFFu) {
+        throw LeaseSnapshotException("Lease snapshot string area exceeds 4 GiB");
+    }
+
+    records_.push_back(record);
+}
+
+void LeaseSnapshotWriter::write(const std::string& path) {
+    std::sort(records_.begin(), records_.end(), [](const SnapshotRecord& a, const SnapshotRecord& b) {
+        return mac_less(a, b.mac_address);
+    });
+
+    const size_t records_size = records_.size() * sizeof(SnapshotRecord);
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = SnapshotHeader::kVersion;
+    header.header_size = sizeof(SnapshotHeader);
+    header.record_size = sizeof(SnapshotRecord);
+    header.record_count = records_.size();
+    header.strings_size = strings_.size();
+    header.created_at = ticks(std::chrono::system_clock::now());
+    header.body_crc = crc32(strings_.data(), strings_.size(), crc32(records_.data(), records_size));
+    header.byte_order = SnapshotHeader::kByteOrder;
+    header.header_crc = crc32(&header, offsetof(SnapshotHeader, header_crc));
+
+    std::string error;
+    const bool written = replace_file_durably(path, {
+        std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)),
+        std::string_view(reinterpret_cast<const char*>(records_.data()), records_size),
+        std::string_view(strings_)
+    }, error);
+    if (!written) {
+        throw LeaseSnapshotException(error);
+    }
+}
+
+LeaseSnapshot::LeaseSnapshot(const std::string& path)
+    : mapping_(nullptr), mapping_size_(0), header_(nullptr), records_(nullptr), strings_(nullptr), count_(0) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw LeaseSnapshotException("Cannot open lease snapshot " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw LeaseSnapshotException("Lease snapshot too short: " + path);
+    }
+    mapping_size_ = static_cast<size_t>(st.st_size);
+    mapping_ = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        const std::string reason = std::strerror(errno);
+        ::close(fd);
+        throw LeaseSnapshotException("Cannot map lease snapshot " + path + ": " + reason);
+    }
+    ::close(fd);
+    // The checksum pass reads everything once, front to back
+    ::madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+
+    const char* base = static_cast<const char*>(mapping_);
+    header_ = reinterpret_cast<const SnapshotHeader*>(base);
+    std::string problem;
+    if (std::memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0) {
+        problem = "not a lease snapshot";
+    } else if (header_->header_crc != crc32(header_, offsetof(SnapshotHeader, header_crc))) {
+        problem = "header checksum mismatch";
+    } else if (header_->version != SnapshotHeader::kVersion) {
+        problem = "unsupported version " + std::to_string(header_->version);
+    } else if (header_->byte_order != SnapshotHeader::kByteOrder) {
+        problem = "written with a different byte order";
+    } else if (header_->header_size != sizeof(SnapshotHeader) || header_->record_size != sizeof(SnapshotRecord) ||
+               header_->record_count > (mapping_size_ - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord) ||
+               sizeof(SnapshotHeader) + header_->record_count * sizeof(SnapshotRecord) + header_->strings_size !=
+                   mapping_size_) {
+        problem = "size does not match its header";
+    } else if (header_->body_crc != crc32(base + sizeof(SnapshotHeader), mapping_size_ - sizeof(SnapshotHeader))) {
+        problem = "body checksum mismatch";
+    }
+    if (!problem.empty()) {
+        ::munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        throw LeaseSnapshotException("Invalid lease snapshot " + path + ": " + problem);
+    }
+
+    count_ = static_cast<size_t>(header_->record_count);
+    records_ = reinterpret_cast<const SnapshotRecord*>(base + sizeof(SnapshotHeader));
+    strings_ = base + sizeof(SnapshotHeader) + count_ * sizeof(SnapshotRecord);
+    for (size_t i = 0; i < count_; ++i) {
+        const SnapshotRecord& record = records_[i];
+        if (size_t(record.hostname_offset) + record.hostname_length > header_->strings_size ||
+            size_t(record.client_id_offset) + record.client_id_length > header_->strings_size) {
+            ::munmap(mapping_, mapping_size_);
+            mapping_ = nullptr;
+            throw LeaseSnapshotException("Invalid lease snapshot " + path + ": string out of range");
+        }
+    }
+}
+
+LeaseSnapshot::~LeaseSnapshot() {
+    if (mapping_) {
+        ::munmap(mapping_, mapping_size_);
+    }
+}
+
+const SnapshotRecord* LeaseSnapshot::find(const MacAddress& mac_address) const {
+    const SnapshotRecord* end = records_ + count_;
+    const SnapshotRecord* record = std::lower_bound(records_, end, mac_address, mac_less);
+    if (record != end && record->mac_address == mac_address) {
+        return record;
+    }
+    return nullptr;
+}
+
+DhcpLease LeaseSnapshot::load(const SnapshotRecord& record) const {
+    DhcpLease lease;
+    lease.mac_address = record.mac_address;
+    lease.ip_address = record.ip_address;
+    lease.hostname.assign(hostname(record));
+    lease.client_id.assign(client_id(record));
+    lease.lease_start = from_ticks(record.lease_start);
+    lease.lease_end = from_ticks(record.lease_end);
+    lease.renewal_time = from_ticks(record.renewal_time);
+    lease.rebinding_time = from_ticks(record.rebinding_time);
+    lease.allocated_at = from_ticks(record.allocated_at);
+    lease.expires_at = from_ticks(record.expires_at);
+    lease.lease_time = std::chrono::seconds(record.lease_time);
+    lease.lease_type = static_cast<LeaseType>(record.lease_type);
+    lease.is_active = record.flags & SnapshotRecord::kActive;
+    lease.is_static = record.flags & SnapshotRecord::kStatic;
+    return lease;
+}
+
+std::chrono::system_clock::time_point LeaseSnapshot::created_at() const {
+    return from_ticks(header_->created_at);
+}
+
+} // namespace simple_dhcpd
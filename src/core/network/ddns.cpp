@@ -0,0 +1,607 @@
+/**
+ * @file network/ddns.cpp
+ * @brief Asynchronous, batched dynamic DNS updates implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/ddns.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr uint8_t kOpcodeUpdate = 5;
+constexpr uint16_t kTypeA = 1;
+constexpr uint16_t kTypeSoa = 6;
+constexpr uint16_t kTypePtr = 12;
+constexpr uint16_t kTypeTsig = 250;
+constexpr uint16_t kClassIn = 1;
+constexpr uint16_t kClassNone = 254;
+constexpr uint16_t kClassAny = 255;
+constexpr uint8_t kRcodeServfail = 2;
+constexpr uint16_t kTsigFudge = 300;
+const char* const kTsigAlgorithm = "hmac-sha256";
+
+constexpr size_t kHeaderSize = 12;
+constexpr auto kBatchWindow = std::chrono::milliseconds(10);      // events arriving within it share a batch
+constexpr auto kInitialBackoff = std::chrono::milliseconds(1000);
+constexpr auto kMaxBackoff = std::chrono::milliseconds(30000);
+constexpr int kIoTimeoutSeconds = 2;
+
+void push16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void push32(std::vector<uint8_t>& out, uint32_t value) {
+    push16(out, static_cast<uint16_t>(value >> 16));
+    push16(out, static_cast<uint16_t>(value));
+}
+
+void put16(std::vector<uint8_t>& out, size_t offset, uint16_t value) {
+    out[offset] = static_cast<uint8_t>(value >> 8);
+    out[offset + 1] = static_cast<uint8_t>(value);
+}
+
+uint16_t get16(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] << 8 | in[1]);
+}
+
+/** Append a record header; the caller appends rdata of rdlength bytes */
+void push_record(std::vector<uint8_t>& out, const std::string& name, uint16_t type, uint16_t rr_class,
+                 uint32_t ttl, uint16_t rdlength) {
+    DdnsUpdater::append_name(out, name);
+    push16(out, type);
+    push16(out, rr_class);
+    push32(out, ttl);
+    push16(out, rdlength);
+}
+
+void push_address(std::vector<uint8_t>& out, IpAddress ip_address) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&ip_address);
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+std::string lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+bool ends_with_zone(const std::string& name, const std::string& zone) {
+    std::string suffix = zone;
+    if (!suffix.empty() && suffix.back() == '.') {
+        suffix.pop_back();
+    }
+    return name.size() > suffix.size() && name[name.size() - suffix.size() - 1] == '.' &&
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool send_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recv_all(int fd, uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = ::recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+}
+
+DdnsUpdater::DdnsUpdater(const DhcpConfig& config)
+    : server_ip_(0), port_(config.ddns_port), forward_zone_(lower(config.ddns_forward_zone)),
+      reverse_zone_(lower(config.ddns_reverse_zone)), ttl_(config.ddns_ttl), key_name_(lower(config.ddns_tsig_key)),
+      queue_(config.ddns_queue_size), wake_fds_{-1, -1}, signalled_(false), stopping_(false), fd_(-1),
+      next_id_(static_cast<uint16_t>(::getpid())), retry_at_(Clock::now()), backoff_(kInitialBackoff),
+      queued_(0), taken_(0), pending_count_(0), dropped_(0), coalesced_(0), updates_sent_(0),
+      records_updated_(0), failures_(0), retries_(0) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, config.ddns_server.c_str(), &addr) != 1) {
+        throw DdnsException("Invalid DDNS server address: " + config.ddns_server);
+    }
+    server_ip_ = addr.s_addr;
+    if (!key_name_.empty() && (!decode_base64(config.ddns_tsig_secret, secret_) || secret_.empty())) {
+        throw DdnsException("Invalid TSIG secret for key " + key_name_);
+    }
+}
+
+DdnsUpdater::~DdnsUpdater() {
+    stop();
+}
+
+void DdnsUpdater::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    if (::pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw DdnsException("Failed to create DDNS wake pipe: " + std::string(strerror(errno)));
+    }
+    stopping_ = false;
+    thread_ = std::thread(&DdnsUpdater::run, this);
+    LOG_INFO("DDNS updates to " + ip_to_string(server_ip_) + ":" + std::to_string(port_) + " for zone " +
+             forward_zone_ + (key_name_.empty() ? ", unsigned" : ", signed with " + key_name_));
+}
+
+void DdnsUpdater::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stopping_ = true;
+    const char byte = 1;
+    while (::write(wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+    disconnect();
+    for (int* fd : {&wake_fds_[0], &wake_fds_[1]}) {
+        ::close(*fd);
+        *fd = -1;
+    }
+    if (!pending_.empty()) {
+        LOG_WARN("DDNS stopped with " + std::to_string(pending_.size()) + " address changes unsent");
+    }
+}
+
+bool DdnsUpdater::add(const std::string& host_label, IpAddress ip_address) {
+    if (host_label.empty()) {
+        return false;
+    }
+    Event event;
+    event.add = true;
+    event.ip_address = ip_address;
+    event.label = host_label;
+    return push(event);
+}
+
+bool DdnsUpdater::remove(IpAddress ip_address) {
+    Event event;
+    event.ip_address = ip_address;
+    return push(event);
+}
+
+bool DdnsUpdater::push(Event& event) {
+    event.queued = Clock::now();
+    if (!queue_.try_push(event)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    // One wake byte per drain; the update thread clears the flag before it pops
+    if (!signalled_.exchange(true) && wake_fds_[1] >= 0) {
+        const char byte = 1;
+        while (::write(wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
+        }
+    }
+    return true;
+}
+
+DdnsStats DdnsUpdater::get_statistics() const {
+    DdnsStats stats;
+    const uint64_t taken = taken_.load(std::memory_order_relaxed);
+    stats.queued = queued_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+    stats.updates_sent = updates_sent_.load(std::memory_order_relaxed);
+    stats.records_updated = records_updated_.load(std::memory_order_relaxed);
+    stats.failures = failures_.load(std::memory_order_relaxed);
+    stats.retries = retries_.load(std::memory_order_relaxed);
+    stats.queue_depth = (stats.queued > taken ? stats.queued - taken : 0) +
+                        pending_count_.load(std::memory_order_relaxed);
+    stats.latency_count = latency_.count();
+    stats.latency_sum_ns = latency_.sum();
+    stats.latency_p50_ns = latency_.percentile(0.5);
+    stats.latency_p99_ns = latency_.percentile(0.99);
+    stats.latency_max_ns = latency_.max();
+    return stats;
+}
+
+std::string DdnsUpdater::host_label(ByteView host_name) {
+    std::string label;
+    for (uint8_t byte : host_name) {
+        if (byte == '.' || byte == 0 || label.size() == 63) {
+            break;
+        }
+        const char c = static_cast<char>(std::tolower(byte));
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c == '-' && !label.empty())) {
+            label.push_back(c);
+        }
+    }
+    while (!label.empty() && label.back() == '-') {
+        label.pop_back();
+    }
+    return label;
+}
+
+std::string DdnsUpdater::reverse_name(IpAddress ip_address) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&ip_address);
+    return std::to_string(bytes[3]) + "." + std::to_string(bytes[2]) + "." + std::to_string(bytes[1]) + "." +
+           std::to_string(bytes[0]) + ".in-addr.arpa";
+}
+
+void DdnsUpdater::append_name(std::vector<uint8_t>& out, const std::string& name) {
+    size_t start = 0;
+    while (start < name.size()) {
+        size_t end = name.find('.', start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        const size_t length = end - start;
+        if (length == 0 || length > 63) {
+            throw DdnsException("Invalid DNS name: " + name);
+        }
+        out.push_back(static_cast<uint8_t>(length));
+        out.insert(out.end(), name.begin() + static_cast<std::ptrdiff_t>(start),
+                   name.begin() + static_cast<std::ptrdiff_t>(end));
+        start = end + 1;
+    }
+    out.push_back(0);
+}
+
+void DdnsUpdater::sign(std::vector<uint8_t>& message, const std::string& key_name,
+                       const std::vector<uint8_t>& secret, uint64_t time_signed) {
+    // RFC 8945 4.3.3: the message, then the TSIG variables, canonical names
+    std::vector<uint8_t> signed_data(message);
+    append_name(signed_data, lower(key_name));
+    push16(signed_data, kClassAny);
+    push32(signed_data, 0);
+    append_name(signed_data, kTsigAlgorithm);
+    push16(signed_data, static_cast<uint16_t>(time_signed >> 32));
+    push32(signed_data, static_cast<uint32_t>(time_signed));
+    push16(signed_data, kTsigFudge);
+    push16(signed_data, 0);     // error
+    push16(signed_data, 0);     // other len
+
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_size = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()), signed_data.data(), signed_data.size(),
+         mac, &mac_size);
+
+    std::vector<uint8_t> rdata;
+    append_name(rdata, kTsigAlgorithm);
+    push16(rdata, static_cast<uint16_t>(time_signed >> 32));
+    push32(rdata, static_cast<uint32_t>(time_signed));
+    push16(rdata, kTsigFudge);
+    push16(rdata, static_cast<uint16_t>(mac_size));
+    rdata.insert(rdata.end(), mac, mac + mac_size);
+    rdata.push_back(message[0]);    // original id
+    rdata.push_back(message[1]);
+    push16(rdata, 0);
+    push16(rdata, 0);
+
+    push_record(message, lower(key_name), kTypeTsig, kClassAny, 0, static_cast<uint16_t>(rdata.size()));
+    message.insert(message.end(), rdata.begin(), rdata.end());
+    put16(message, 10, static_cast<uint16_t>(get16(&message[10]) + 1));
+}
+
+bool DdnsUpdater::decode_base64(const std::string& text, std::vector<uint8_t>& out) {
+    std::string clean;
+    for (char c : text) {
+        if (!std::isspace(static_cast<unsigned char>(c))) {
+            clean.push_back(c);
+        }
+    }
+    if (clean.size() % 4 != 0) {
+        return false;
+    }
+    out.assign(clean.size() / 4 * 3, 0);
+    const int length = EVP_DecodeBlock(out.data(), reinterpret_cast<const unsigned char*>(clean.data()),
+                                       static_cast<int>(clean.size()));
+    if (length < 0) {
+        return false;
+    }
+    // EVP_DecodeBlock counts the padding as zero bytes
+    size_t padding = 0;
+    for (size_t i = clean.size(); i > 0 && clean[i - 1] == '='; --i) {
+        ++padding;
+    }
+    out.resize(static_cast<size_t>(length) - std::min(padding, static_cast<size_t>(length)));
+    return true;
+}
+
+void DdnsUpdater::run() {
+    Clock::time_point batch_due = Clock::now();
+    while (!stopping_) {
+        signalled_.store(false);
+        const bool was_idle = pending_.empty();
+        drain_queue();
+        Clock::time_point now = Clock::now();
+        if (was_idle && !pending_.empty()) {
+            batch_due = now + kBatchWindow;
+        }
+
+        int timeout_ms = -1;
+        if (!pending_.empty()) {
+            const Clock::time_point due = pending_.size() >= kMaxBatch ? retry_at_ : std::max(batch_due, retry_at_);
+            if (now >= due) {
+                send_batch();
+                continue;
+            }
+            timeout_ms = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count()) + 1;
+        }
+
+        struct pollfd wake = {wake_fds_[0], POLLIN, 0};
+        if (::poll(&wake, 1, timeout_ms) < 0 && errno != EINTR) {
+            LOG_ERROR("DDNS poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        char drain[64];
+        while (::read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+}
+
+void DdnsUpdater::drain_queue() {
+    Event event;
+    uint64_t taken = 0;
+    while (queue_.try_pop(event)) {
+        ++taken;
+        auto it = pending_.find(event.ip_address);
+        if (it == pending_.end()) {
+            pending_.emplace(event.ip_address, Change{event.add, std::move(event.label), event.queued, 0});
+            continue;
+        }
+        // The latest event wins; latency still counts from the first
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+        it->second.add = event.add;
+        it->second.label = std::move(event.label);
+    }
+    taken_.fetch_add(taken, std::memory_order_relaxed);
+    pending_count_.store(pending_.size(), std::memory_order_relaxed);
+}
+
+void DdnsUpdater::send_batch() {
+    std::vector<std::pair<IpAddress, Change>> batch;
+    for (auto it = pending_.begin(); it != pending_.end() && batch.size() < kMaxBatch;) {
+        const auto name = names_.find(it->first);
+        const bool registered = name != names_.end();
+        const bool no_op = it->second.add ? registered && name->second == it->second.label
+                                          : !registered && reverse_zone_.empty();
+        if (no_op) {
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            batch.emplace_back(it->first, std::move(it->second));
+        }
+        it = pending_.erase(it);
+    }
+    pending_count_.store(pending_.size() + batch.size(), std::memory_order_relaxed);
+    if (batch.empty()) {
+        return;
+    }
+
+    std::vector<std::vector<uint8_t>> messages;
+    for (const bool forward : {true, false}) {
+        std::vector<uint8_t> message = encode_update(batch, forward, next_id_);
+        if (!message.empty()) {
+            ++next_id_;
+            messages.push_back(std::move(message));
+        }
+    }
+
+    std::vector<uint8_t> rcodes;
+    bool sent = messages.empty() || exchange(messages, rcodes);
+    updates_sent_.fetch_add(messages.size(), std::memory_order_relaxed);
+    uint8_t refused = 0;
+    for (uint8_t rcode : rcodes) {
+        if (rcode != 0) {
+            sent = false;
+            if (rcode != kRcodeServfail) {
+                refused = rcode;
+            }
+        }
+    }
+
+    const Clock::time_point now = Clock::now();
+    if (sent) {
+        for (const auto& entry : batch) {
+            if (entry.second.add) {
+                names_[entry.first] = entry.second.label;
+            } else {
+                names_.erase(entry.first);
+            }
+            latency_.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.second.queued).count()));
+        }
+        records_updated_.fetch_add(batch.size(), std::memory_order_relaxed);
+        backoff_ = kInitialBackoff;
+    } else if (refused != 0) {
+        failures_.fetch_add(batch.size(), std::memory_order_relaxed);
+        LOG_ERROR("DNS server refused an update of " + std::to_string(batch.size()) + " addresses, rcode " +
+                  std::to_string(refused));
+    } else {
+        retries_.fetch_add(1, std::memory_order_relaxed);
+        for (auto& entry : batch) {
+            if (++entry.second.attempts >= kMaxAttempts) {
+                failures_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                pending_.emplace(entry.first, std::move(entry.second));
+            }
+        }
+        LOG_WARN("DDNS update failed, retrying in " + std::to_string(backoff_.count()) + " ms");
+        retry_at_ = now + backoff_;
+        backoff_ = std::min(backoff_ * 2, kMaxBackoff);
+    }
+    pending_count_.store(pending_.size(), std::memory_order_relaxed);
+}
+
+std::vector<uint8_t> DdnsUpdater::encode_update(const std::vector<std::pair<IpAddress, Change>>& batch,
+                                                bool forward, uint16_t id) const {
+    const std::string& zone = forward ? forward_zone_ : reverse_zone_;
+    if (zone.empty()) {
+        return {};
+    }
+    std::vector<uint8_t> out(kHeaderSize, 0);
+    put16(out, 0, id);
+    out[2] = kOpcodeUpdate << 3;
+    put16(out, 4, 1);           // ZOCOUNT
+    append_name(out, zone);
+    push16(out, kTypeSoa);
+    push16(out, kClassIn);
+
+    uint16_t updates = 0;
+    for (const auto& entry : batch) {
+        const IpAddress ip = entry.first;
+        const Change& change = entry.second;
+        const std::string fqdn = change.label + "." + zone;
+        if (forward) {
+            // Drop this address from the name it was registered under, if that changes
+            const auto old = names_.find(ip);
+            if (old != names_.end() && (!change.add || old->second != change.label)) {
+                push_record(out, old->second + "." + zone, kTypeA, kClassNone, 0, 4);
+                push_address(out, ip);
+                ++updates;
+            }
+            if (change.add) {
+                push_record(out, fqdn, kTypeA, kClassAny, 0, 0);
+                push_record(out, fqdn, kTypeA, kClassIn, ttl_, 4);
+                push_address(out, ip);
+                updates += 2;
+            }
+            continue;
+        }
+        const std::string name = reverse_name(ip);
+        if (!ends_with_zone(name, zone)) {
+            continue;
+        }
+        push_record(out, name, kTypePtr, kClassAny, 0, 0);
+        ++updates;
+        if (change.add) {
+            const std::string target = change.label + "." + forward_zone_;
+            std::vector<uint8_t> rdata;
+            append_name(rdata, target);
+            push_record(out, name, kTypePtr, kClassIn, ttl_, static_cast<uint16_t>(rdata.size()));
+            out.insert(out.end(), rdata.begin(), rdata.end());
+            ++updates;
+        }
+    }
+    if (updates == 0) {
+        return {};
+    }
+    put16(out, 8, updates);     // UPCOUNT
+    if (!key_name_.empty()) {
+        sign(out, key_name_, secret_, static_cast<uint64_t>(std::time(nullptr)));
+    }
+    return out;
+}
+
+bool DdnsUpdater::exchange(const std::vector<std::vector<uint8_t>>& messages, std::vector<uint8_t>& rcodes) {
+    if (!connect_server()) {
+        return false;
+    }
+    std::vector<uint8_t> frames;
+    for (const auto& message : messages) {
+        push16(frames, static_cast<uint16_t>(message.size()));
+        frames.insert(frames.end(), message.begin(), message.end());
+    }
+    if (!send_all(fd_, frames.data(), frames.size())) {
+        LOG_DEBUG("DDNS send failed: " + std::string(strerror(errno)));
+        disconnect();
+        return false;
+    }
+
+    // Answers on one connection may come back in any order
+    rcodes.assign(messages.size(), 0);
+    std::vector<bool> answered(messages.size(), false);
+    for (size_t received = 0; received < messages.size();) {
+        uint8_t length[2];
+        std::vector<uint8_t> answer;
+        if (recv_all(fd_, length, 2)) {
+            answer.resize(get16(length));
+        }
+        if (answer.size() < kHeaderSize || !recv_all(fd_, answer.data(), answer.size())) {
+            LOG_DEBUG("DDNS answer not received: " + std::string(strerror(errno)));
+            disconnect();
+            return false;
+        }
+        const uint16_t id = get16(answer.data());
+        for (size_t i = 0; i < messages.size(); ++i) {
+            if (!answered[i] && get16(messages[i].data()) == id && (answer[2] & 0x80)) {
+                answered[i] = true;
+                rcodes[i] = answer[3] & 0x0f;
+                ++received;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool DdnsUpdater::connect_server() {
+    if (fd_ >= 0) {
+        // A server closing an idle connection leaves it readable
+        struct pollfd check = {fd_, POLLIN, 0};
+        if (::poll(&check, 1, 0) == 0) {
+            return true;
+        }
+        disconnect();
+    }
+
+    fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        LOG_ERROR("Failed to create DDNS socket: " + std::string(strerror(errno)));
+        return false;
+    }
+    // Bounds connect() as well as each send and receive
+    struct timeval timeout = {kIoTimeoutSeconds, 0};
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int opt = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = server_ip_;
+    if (::connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        LOG_DEBUG("DNS server " + ip_to_string(server_ip_) + " not reachable: " + strerror(errno));
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void DdnsUpdater::disconnect() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,414 @@
+/**
+ * @file network/event_loop.cpp
+ * @brief Readiness event loop implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/event_loop.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#endif
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kMaxEvents = 64;
+
+#ifdef __linux__
+class EpollBackend : public EventBackend {
+public:
+    EpollBackend() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), events_(kMaxEvents) {
+        if (epoll_fd_ < 0) {
+            throw EventLoopException("Failed to create epoll instance: " + std::string(strerror(errno)));
+        }
+    }
+
+    ~EpollBackend() override {
+        close(epoll_fd_);
+    }
+
+    void add(int fd) override {
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            throw EventLoopException("Failed to watch descriptor: " + std::string(strerror(errno)));
+        }
+    }
+
+    void remove(int fd) override {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void wait(std::vector<int>& ready, int timeout_ms) override {
+        ready.clear();
+        const int count = epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout_ms);
+        if (count < 0) {
+            if (errno != EINTR) {
+                LOG_ERROR("epoll_wait failed: " + std::string(strerror(errno)));
+            }
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            ready.push_back(events_[i].data.fd);
+        }
+    }
+
+    const char* name() const override { return "epoll"; }
+
+private:
+    int epoll_fd_;
+    std::vector<struct epoll_event> events_;
+};
+#endif
+
+class PollBackend : public EventBackend {
+public:
+    void add(int fd) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (std::find(fds_.begin(), fds_.end(), fd) == fds_.end()) {
+            fds_.push_back(fd);
+        }
+    }
+
+    void remove(int fd) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fds_.erase(std::remove(fds_.begin(), fds_.end(), fd), fds_.end());
+    }
+
+    void wait(std::vector<int>& ready, int timeout_ms) override {
+        ready.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            polled_.resize(fds_.size());
+            for (size_t i = 0; i < fds_.size(); ++i) {
+                polled_[i].fd = fds_[i];
+                polled_[i].events = POLLIN;
+                polled_[i].revents = 0;
+            }
+        }
+        const int count = ::poll(polled_.data(), polled_.size(), timeout_ms);
+        if (count < 0) {
+            if (errno != EINTR) {
+                LOG_ERROR("poll failed: " + std::string(strerror(errno)));
+            }
+            return;
+        }
+        for (const auto& entry : polled_) {
+            if (entry.revents != 0) {
+                ready.push_back(entry.fd);
+            }
+        }
+    }
+
+    const char* name() const override { return "poll"; }
+
+private:
+    std::mutex mutex_;
+    std::vector<int> fds_;
+    std::vector<struct pollfd> polled_;   // only touched by the waiting thread
+};
+}
+
+std::unique_ptr<EventBackend> make_event_backend(EventBackendType type) {
+    switch (type) {
+        case EventBackendType::POLL:
+            return std::make_unique<PollBackend>();
+        case EventBackendType::EPOLL:
+#ifndef __linux__
+            throw EventLoopException("epoll is not available on this platform");
+#endif
+        case EventBackendType::AUTO:
+        default:
+#ifdef __linux__
+            return std::make_unique<EpollBackend>();
+#else
+            return std::make_unique<PollBackend>();
+#endif
+    }
+}
+
+EventBackendType parse_event_backend(const std::string& name) {
+    if (name.empty() || name == "auto") {
+        return EventBackendType::AUTO;
+    }
+    if (name == "epoll") {
+        return EventBackendType::EPOLL;
+    }
+    if (name == "poll") {
+        return EventBackendType::POLL;
+    }
+    throw EventLoopException("Unknown event backend: " + name);
+}
+
+EventLoop::EventLoop(EventBackendType backend, const std::string& name)
+    : name_(name), backend_(make_event_backend(backend)), wake_fds_{-1, -1}, running_(false),
+      loop_thread_(std::thread::id()), wakeups_(0), next_timer_id_(1), active_fd_(-1), active_timer_(0) {
+    if (::pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw EventLoopException("Failed to create wake pipe: " + std::string(strerror(errno)));
+    }
+    backend_->add(wake_fds_[0]);
+}
+
+EventLoop::~EventLoop() {
+    stop();
+    if (thread_.joinable()) {
+        // Destroyed from one of its own callbacks: the thread cannot join itself
+        LOG_ERROR(name_ + " destroyed on its own thread");
+        thread_.detach();
+    }
+    backend_.reset();
+    for (int fd : wake_fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void EventLoop::start(int cpu) {
+    if (thread_.joinable() && !running_.load()) {
+        if (in_loop_thread()) {
+            // Stopped from a callback that has not returned yet: keep looping
+            running_.store(true);
+            return;
+        }
+        thread_.join();     // stopped from a callback; the thread has exited or is about to
+    }
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&EventLoop::run, this);
+
+#ifdef __linux__
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu % CPU_SETSIZE, &cpus);
+        const int rc = pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus);
+        if (rc != 0) {
+            LOG_WARN("Failed to pin " + name_ + " to CPU " + std::to_string(cpu) + ": " + strerror(rc));
+        }
+    }
+#else
+    (void)cpu;
+#endif
+    LOG_DEBUG("Started " + name_ + " (" + backend_->name() + ")");
+}
+
+void EventLoop::stop() {
+    const bool was_running = running_.exchange(false);
+    if (in_loop_thread()) {
+        // The loop returns after the current callback; the next stop(), start()
+        // or the destructor, called from another thread, joins it
+        return;
+    }
+    if (thread_.joinable()) {
+        wake();
+        thread_.join();
+    }
+    if (was_running) {
+        LOG_DEBUG("Stopped " + name_);
+    }
+}
+
+void EventLoop::watch(int fd, Callback on_readable) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        watchers_[fd] = std::make_shared<Callback>(std::move(on_readable));
+    }
+    try {
+        backend_->add(fd);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        watchers_.erase(fd);
+        throw;
+    }
+    wake();
+}
+
+void EventLoop::unwatch(int fd) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (watchers_.erase(fd) == 0) {
+        return;
+    }
+    backend_->remove(fd);
+    if (!in_loop_thread()) {
+        idle_cv_.wait(lock, [&] { return active_fd_ != fd; });
+    }
+    lock.unlock();
+    wake();
+}
+
+EventLoop::TimerId EventLoop::add_timer(std::chrono::milliseconds interval, Callback fn) {
+    const auto period = std::max<std::chrono::steady_clock::duration>(interval, std::chrono::milliseconds(1));
+    TimerId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_timer_id_++;
+        const auto due = std::chrono::steady_clock::now() + period;
+        timers_[id] = Timer{due, period, std::make_shared<Callback>(std::move(fn))};
+        deadlines_.emplace(due, id);
+    }
+    wake();
+    return id;
+}
+
+void EventLoop::cancel_timer(TimerId id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    timers_.erase(id);
+    if (!in_loop_thread()) {
+        idle_cv_.wait(lock, [&] { return active_timer_ != id; });
+    }
+}
+
+void EventLoop::post(Callback fn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        posted_.push_back(std::move(fn));
+    }
+    wake();
+}
+
+void EventLoop::wake() {
+    const char byte = 1;
+    // A full pipe already guarantees a wakeup
+    while (::write(wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+}
+
+void EventLoop::run() {
+    loop_thread_.store(std::this_thread::get_id());
+    std::vector<int> ready;
+    ready.reserve(kMaxEvents);
+
+    while (running_.load()) {
+        backend_->wait(ready, next_timeout_ms());
+        wakeups_.fetch_add(1, std::memory_order_relaxed);
+        for (int fd : ready) {
+            if (fd == wake_fds_[0]) {
+                char drain[64];
+                while (::read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+                }
+                continue;
+            }
+            dispatch(fd);
+        }
+        run_posted();
+        run_due_timers();
+    }
+    run_posted();
+    loop_thread_.store(std::thread::id());
+}
+
+void EventLoop::dispatch(int fd) {
+    std::shared_ptr<Callback> callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = watchers_.find(fd);
+        if (it == watchers_.end()) {
+            return;  // unwatched after the wait returned
+        }
+        callback = it->second;
+        active_fd_ = fd;
+    }
+    try {
+        (*callback)();
+    } catch (const std::exception& e) {
+        LOG_ERROR(name_ + " descriptor callback failed: " + std::string(e.what()));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        active_fd_ = -1;
+    }
+    idle_cv_.notify_all();
+}
+
+void EventLoop::run_due_timers() {
+    const auto now = std::chrono::steady_clock::now();
+    for (;;) {
+        std::shared_ptr<Callback> callback;
+        TimerId id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (deadlines_.empty() || deadlines_.top().first > now) {
+                return;
+            }
+            const Deadline due = deadlines_.top();
+            deadlines_.pop();
+            id = due.second;
+            auto it = timers_.find(id);
+            if (it == timers_.end() || it->second.due != due.first) {
+                continue;  // cancelled
+            }
+            // A late loop does not replay missed calls
+            Timer& timer = it->second;
+            timer.due += timer.interval;
+            if (timer.due <= now) {
+                timer.due = now + timer.interval;
+            }
+            deadlines_.emplace(timer.due, id);
+            callback = timer.fn;
+            active_timer_ = id;
+        }
+        try {
+            (*callback)();
+        } catch (const std::exception& e) {
+            LOG_ERROR(name_ + " timer callback failed: " + std::string(e.what()));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_timer_ = 0;
+        }
+        idle_cv_.notify_all();
+    }
+}
+
+void EventLoop::run_posted() {
+    std::vector<Callback> work;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        work.swap(posted_);
+    }
+    for (auto& fn : work) {
+        try {
+            fn();
+        } catch (const std::exception& e) {
+            LOG_ERROR(name_ + " posted callback failed: " + std::string(e.what()));
+        }
+    }
+}
+
+int EventLoop::next_timeout_ms() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!deadlines_.empty()) {
+        auto it = timers_.find(deadlines_.top().second);
+        if (it != timers_.end() && it->second.due == deadlines_.top().first) {
+            break;
+        }
+        deadlines_.pop();  // cancelled or rescheduled
+    }
+    if (deadlines_.empty()) {
+        return -1;
+    }
+    const auto wait = deadlines_.top().first - std::chrono::steady_clock::now();
+    if (wait <= std::chrono::steady_clock::duration::zero()) {
+        return 0;
+    }
+    // Round up so the loop does not wake just before the deadline
+    return static_cast<int>(std::min<int64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(wait).count() + 1, 60000));
+}
+
+} // namespace simple_dhcpd
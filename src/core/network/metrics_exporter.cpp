@@ -0,0 +1,265 @@
+/**
+ * @file network/metrics_exporter.cpp
+ * @brief Prometheus text-format metrics endpoint implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/metrics_exporter.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kMaxRequestBytes = 8192;
+constexpr int kClientTimeoutSeconds = 2;
+constexpr const char* kContentType = "text/plain; version=0.0.4; charset=utf-8";
+
+std::string format_value(double value) {
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string response(const char* status, const char* content_type, const std::string& body) {
+    std::string head = "HTTP/1.1 ";
+    head += status;
+    head += "\r\nContent-Type: ";
+    head += content_type;
+    head += "\r\nContent-Length: " + std::to_string(body.size());
+    head += "\r\nConnection: close\r\n\r\n";
+    return head + body;
+}
+}
+
+void MetricsText::family(const std::string& name, const std::string& type, const std::string& help) {
+    text_ += "# HELP " + name + " " + help + "\n";
+    text_ += "# TYPE " + name + " " + type + "\n";
+}
+
+void MetricsText::sample(const std::string& name, double value, const MetricLabels& sample_labels) {
+    text_ += name;
+    labels(sample_labels);
+    text_ += " " + format_value(value) + "\n";
+}
+
+void MetricsText::sample(const std::string& name, uint64_t value, const MetricLabels& sample_labels) {
+    text_ += name;
+    labels(sample_labels);
+    text_ += " " + std::to_string(value) + "\n";
+}
+
+void MetricsText::labels(const MetricLabels& sample_labels) {
+    if (sample_labels.empty()) {
+        return;
+    }
+    text_ += '{';
+    for (size_t i = 0; i < sample_labels.size(); ++i) {
+        if (i > 0) {
+            text_ += ',';
+        }
+        text_ += sample_labels[i].first + "=\"";
+        for (char c : sample_labels[i].second) {
+            switch (c) {
+                case '\\': text_ += "\\\\"; break;
+                case '"': text_ += "\\\""; break;
+                case '\n': text_ += "\\n"; break;
+                default: text_ += c; break;
+            }
+        }
+        text_ += '"';
+    }
+    text_ += '}';
+}
+
+MetricsExporter::MetricsExporter(const std::string& address, uint16_t port, Renderer renderer)
+    : address_(address), port_(port), renderer_(std::move(renderer)), listen_fd_(-1),
+      wake_fds_{-1, -1}, scrapes_(0) {
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+void MetricsExporter::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    if (inet_pton(AF_INET, address_.c_str(), &addr.sin_addr) != 1) {
+        throw MetricsExporterException("Invalid metrics address: " + address_);
+    }
+
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw MetricsExporterException("Failed to create metrics socket: " + std::string(strerror(errno)));
+    }
+    int opt = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd_, 16) < 0) {
+        const std::string error = strerror(errno);
+        close_fds();
+        throw MetricsExporterException("Failed to listen on " + address_ + ":" + std::to_string(port_) +
+                                       ": " + error);
+    }
+
+    socklen_t length = sizeof(addr);
+    if (getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &length) == 0) {
+        port_ = ntohs(addr.sin_port);
+    }
+    if (::pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        const std::string error = strerror(errno);
+        close_fds();
+        throw MetricsExporterException("Failed to create metrics wake pipe: " + error);
+    }
+
+    thread_ = std::thread(&MetricsExporter::run, this);
+    LOG_INFO("Metrics endpoint listening on http://" + address_ + ":" + std::to_string(port_) + "/metrics");
+}
+
+void MetricsExporter::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    const char wake = 1;
+    while (::write(wake_fds_[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+    close_fds();
+}
+
+void MetricsExporter::close_fds() {
+    for (int* fd : {&listen_fd_, &wake_fds_[0], &wake_fds_[1]}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void MetricsExporter::run() {
+    struct pollfd fds[2];
+    fds[0].fd = listen_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_fds_[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Metrics endpoint poll failed: " + std::string(strerror(errno)));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            const int client_fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd >= 0) {
+                serve(client_fd);
+                ::close(client_fd);
+            }
+        }
+    }
+}
+
+void MetricsExporter::serve(int client_fd) {
+    struct timeval timeout;
+    timeout.tv_sec = kClientTimeoutSeconds;
+    timeout.tv_usec = 0;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters; stop at the end of the headers
+    std::string request;
+    char chunk[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestBytes) {
+        const ssize_t n = ::recv(client_fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        request.append(chunk, static_cast<size_t>(n));
+    }
+
+    const size_t line_end = request.find("\r\n");
+    if (line_end == std::string::npos) {
+        write_all(client_fd, response("400 Bad Request", "text/plain", "Bad Request\n"));
+        return;
+    }
+    const std::string line = request.substr(0, line_end);
+    const size_t method_end = line.find(' ');
+    const size_t target_end = line.find(' ', method_end == std::string::npos ? 0 : method_end + 1);
+    if (method_end == std::string::npos || target_end == std::string::npos) {
+        write_all(client_fd, response("400 Bad Request", "text/plain", "Bad Request\n"));
+        return;
+    }
+    const std::string method = line.substr(0, method_end);
+    std::string target = line.substr(method_end + 1, target_end - method_end - 1);
+    target = target.substr(0, target.find('?'));
+
+    if (target != "/metrics") {
+        write_all(client_fd, response("404 Not Found", "text/plain", "Not Found\n"));
+        return;
+    }
+    if (method != "GET") {
+        write_all(client_fd, response("405 Method Not Allowed", "text/plain", "Method Not Allowed\n"));
+        return;
+    }
+
+    std::string body;
+    try {
+        body = renderer_();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to render metrics: " + std::string(e.what()));
+        write_all(client_fd, response("500 Internal Server Error", "text/plain", "Internal Server Error\n"));
+        return;
+    }
+    scrapes_.fetch_add(1, std::memory_order_relaxed);
+    write_all(client_fd, response("200 OK", kContentType, body));
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,52 @@
+/**
+ * @file network/packet_buffer.cpp
+ * @brief Packet buffer pool implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/packet_buffer.hpp"
+
+namespace simple_dhcpd {
+
+void PacketBufferPool::Releaser::operator()(PacketBuffer* buffer) const {
+    if (pool && buffer) {
+        pool->release(buffer);
+    }
+}
+
+PacketBufferPool::PacketBufferPool(size_t count) : buffers_(count) {
+    free_.reserve(count);
+    for (auto& buffer : buffers_) {
+        free_.push_back(&buffer);
+    }
+}
+
+PacketBufferPool::Handle PacketBufferPool::acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        return Handle(nullptr, Releaser{this});
+    }
+
+    PacketBuffer* buffer = free_.back();
+    free_.pop_back();
+    buffer->set_size(0);
+    return Handle(buffer, Releaser{this});
+}
+
+size_t PacketBufferPool::available() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
+
+size_t PacketBufferPool::capacity() const {
+    return buffers_.size();
+}
+
+void PacketBufferPool::release(PacketBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buffer);
+}
+
+} // namespace simple_dhcpd
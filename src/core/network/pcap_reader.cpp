@@ -0,0 +1,191 @@
+/**
+ * @file pcap_reader.cpp
+ * @brief Reader for the UDP datagrams of a pcap capture file
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/pcap_reader.hpp"
+#include <cstring>
+
+namespace simple_dhcpd {
+
+namespace {
+
+constexpr uint32_t kMagicMicroseconds = 0xa1b2c3d4;
+constexpr uint32_t kMagicNanoseconds = 0xa1b23c4d;
+constexpr uint32_t kMagicPcapng = 0x0a0d0d0a;
+constexpr size_t kFileHeaderSize = 24;
+constexpr size_t kRecordHeaderSize = 16;
+
+constexpr uint32_t kLinkEthernet = 1;
+constexpr uint32_t kLinkRaw = 101;
+constexpr uint32_t kLinkLinuxSll = 113;
+constexpr uint32_t kLinkIpv4 = 228;
+constexpr uint32_t kLinkLinuxSll2 = 276;
+
+constexpr uint16_t kEtherTypeIpv4 = 0x0800;
+constexpr uint16_t kEtherTypeVlan = 0x8100;
+constexpr uint16_t kEtherTypeQinQ = 0x88a8;
+constexpr uint8_t kProtocolUdp = 17;
+
+uint16_t be16(const uint8_t* bytes) {
+    return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+uint32_t swap32(uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+
+bool supported_link_type(uint32_t link_type) {
+    switch (link_type) {
+        case kLinkEthernet:
+        case kLinkRaw:
+        case kLinkLinuxSll:
+        case kLinkIpv4:
+        case kLinkLinuxSll2:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+PcapReader::PcapReader(const std::string& path)
+    : file_(path, std::ios::binary), path_(path), swapped_(false), nanoseconds_(false),
+      link_type_(0), frames_(0), skipped_(0) {
+    if (!file_) {
+        throw PcapReaderException("Cannot open capture " + path);
+    }
+    uint8_t header[kFileHeaderSize];
+    if (!file_.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        throw PcapReaderException("Capture " + path + " is too short for a pcap header");
+    }
+
+    uint32_t magic;
+    std::memcpy(&magic, header, sizeof(magic));
+    if (magic == kMagicMicroseconds || magic == kMagicNanoseconds) {
+        swapped_ = false;
+    } else if (swap32(magic) == kMagicMicroseconds || swap32(magic) == kMagicNanoseconds) {
+        swapped_ = true;
+        magic = swap32(magic);
+    } else if (magic == kMagicPcapng) {
+        throw PcapReaderException("Capture " + path + " is pcapng; convert it with editcap -F pcap");
+    } else {
+        throw PcapReaderException("Capture " + path + " is not a pcap file");
+    }
+    nanoseconds_ = magic == kMagicNanoseconds;
+
+    link_type_ = read_u32(header + 20) & 0x0fffffff;    // the top bits carry FCS information
+    if (!supported_link_type(link_type_)) {
+        throw PcapReaderException("Capture " + path + " has unsupported link type " + std::to_string(link_type_));
+    }
+}
+
+bool PcapReader::next(PcapDatagram& datagram) {
+    while (true) {
+        uint8_t header[kRecordHeaderSize];
+        if (!file_.read(reinterpret_cast<char*>(header), sizeof(header))) {
+            return false;
+        }
+        const uint32_t seconds = read_u32(header);
+        const uint32_t fraction = read_u32(header + 4);
+        const uint32_t captured = read_u32(header + 8);
+        if (captured > kMaxFrameSize) {
+            throw PcapReaderException("Capture " + path_ + " has a corrupt record of " +
+                                      std::to_string(captured) + " bytes");
+        }
+        frame_.resize(captured);
+        if (!file_.read(reinterpret_cast<char*>(frame_.data()), captured)) {
+            return false;
+        }
+        ++frames_;
+        if (!decode_frame(link_type_, frame_.data(), frame_.size(), datagram)) {
+            ++skipped_;
+            continue;
+        }
+        datagram.timestamp_ns = static_cast<uint64_t>(seconds) * 1000000000ull +
+                                (nanoseconds_ ? fraction : static_cast<uint64_t>(fraction) * 1000);
+        return true;
+    }
+}
+
+bool PcapReader::decode_frame(uint32_t link_type, const uint8_t* frame, size_t length, PcapDatagram& datagram) {
+    size_t offset = 0;
+    switch (link_type) {
+        case kLinkEthernet: {
+            offset = 12;
+            if (length < offset + 2) {
+                return false;
+            }
+            uint16_t ether_type = be16(frame + offset);
+            while (ether_type == kEtherTypeVlan || ether_type == kEtherTypeQinQ) {
+                offset += 4;
+                if (length < offset + 2) {
+                    return false;
+                }
+                ether_type = be16(frame + offset);
+            }
+            if (ether_type != kEtherTypeIpv4) {
+                return false;
+            }
+            offset += 2;
+            break;
+        }
+        case kLinkLinuxSll:
+            if (length < 16 || be16(frame + 14) != kEtherTypeIpv4) {
+                return false;
+            }
+            offset = 16;
+            break;
+        case kLinkLinuxSll2:
+            if (length < 20 || be16(frame) != kEtherTypeIpv4) {
+                return false;
+            }
+            offset = 20;
+            break;
+        case kLinkRaw:
+        case kLinkIpv4:
+            break;
+        default:
+            return false;
+    }
+
+    // IPv4 header
+    const uint8_t* ip = frame + offset;
+    const size_t available = length - offset;
+    if (available < 20 || (ip[0] >> 4) != 4) {
+        return false;
+    }
+    const size_t header_length = static_cast<size_t>(ip[0] & 0x0f) * 4;
+    const size_t total_length = be16(ip + 2);
+    if (header_length < 20 || total_length < header_length + 8 || total_length > available) {
+        return false;
+    }
+    if ((be16(ip + 6) & 0x3fff) != 0 || ip[9] != kProtocolUdp) {
+        return false;       // a fragment (more fragments set or a non-zero offset), or not UDP
+    }
+
+    // UDP header
+    const uint8_t* udp = ip + header_length;
+    const size_t udp_length = be16(udp + 4);
+    if (udp_length < 8 || udp_length > total_length - header_length) {
+        return false;
+    }
+    std::memcpy(&datagram.source, ip + 12, sizeof(datagram.source));
+    std::memcpy(&datagram.destination, ip + 16, sizeof(datagram.destination));
+    datagram.source_port = be16(udp);
+    datagram.destination_port = be16(udp + 2);
+    datagram.payload = ByteView(udp + 8, udp_length - 8);
+    return true;
+}
+
+uint32_t PcapReader::read_u32(const uint8_t* bytes) const {
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return swapped_ ? swap32(value) : value;
+}
+
+} // namespace simple_dhcpd
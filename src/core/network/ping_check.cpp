@@ -0,0 +1,292 @@
+/**
+ * @file network/ping_check.cpp
+ * @brief Asynchronous ICMP echo probes implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/ping_check.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kEchoHeader = 8;
+constexpr size_t kEchoPayload = 8;
+constexpr size_t kMaxDrainReplies = 256;
+const uint8_t kPayload[kEchoPayload] = {'s', 'd', 'h', 'c', 'p', 'd', 'p', 'c'};
+
+#ifdef __linux__
+// From <linux/icmp.h>, which clashes with <netinet/ip_icmp.h>
+constexpr int kIcmpFilter = 1;
+#endif
+
+uint16_t read16(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] << 8 | in[1]);
+}
+
+void put16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+}
+
+PingChecker::PingChecker(EventLoop& loop, std::chrono::milliseconds timeout, std::chrono::seconds cache_window)
+    : loop_(loop), timeout_(timeout), cache_window_(cache_window), fd_(-1), running_(false), raw_(false),
+      id_(0), next_sequence_(0), sweep_timer_(0), probes_sent_(0), probes_answered_(0), probes_timed_out_(0),
+      cache_hits_(0) {
+}
+
+PingChecker::~PingChecker() {
+    stop();
+}
+
+void PingChecker::start() {
+    if (running_.load()) {
+        return;
+    }
+
+    raw_ = true;
+    fd_ = ::socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+    if (fd_ < 0 && (errno == EPERM || errno == EACCES)) {
+        // Unprivileged ping socket (net.ipv4.ping_group_range): sees only its own replies
+        raw_ = false;
+        fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+    }
+    if (fd_ < 0) {
+        throw PingCheckException("Failed to open ICMP socket: " + std::string(strerror(errno)));
+    }
+#ifdef __linux__
+    if (raw_) {
+        // Everything but echo replies is dropped in the kernel
+        uint32_t filter = ~(1u << ICMP_ECHOREPLY);
+        setsockopt(fd_, SOL_RAW, kIcmpFilter, &filter, sizeof(filter));
+    }
+#endif
+    // A ping socket's identifier is chosen by the kernel and checked there
+    id_ = raw_ ? static_cast<uint16_t>(::getpid()) : 0;
+
+    try {
+        loop_.watch(fd_, [this]() { on_readable(); });
+    } catch (const EventLoopException& e) {
+        ::close(fd_);
+        fd_ = -1;
+        throw PingCheckException("Failed to watch ICMP socket: " + std::string(e.what()));
+    }
+    running_.store(true);
+    LOG_INFO(std::string("Ping check probing with a ") + (raw_ ? "raw" : "ping") + " ICMP socket");
+}
+
+void PingChecker::stop() {
+    EventLoop::TimerId timer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.load()) {
+            return;
+        }
+        running_.store(false);
+        timer = sweep_timer_;
+        sweep_timer_ = 0;
+        outstanding_.clear();
+        probing_.clear();
+        deadlines_.clear();
+    }
+    // Both wait for a running callback, which takes mutex_
+    loop_.unwatch(fd_);
+    if (timer != 0) {
+        loop_.cancel_timer(timer);
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+PingStatus PingChecker::cached(IpAddress ip_address) {
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    prune_cache_locked(now);
+    const auto it = cache_.find(ip_address);
+    if (it == cache_.end()) {
+        return PingStatus::UNKNOWN;
+    }
+    cache_hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second.in_use ? PingStatus::IN_USE : PingStatus::FREE;
+}
+
+bool PingChecker::probe(IpAddress ip_address, Completion done) {
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.load()) {
+        return false;
+    }
+
+    const auto probing = probing_.find(ip_address);
+    if (probing != probing_.end()) {
+        std::vector<Completion>& waiters = outstanding_[probing->second].waiters;
+        if (waiters.size() < kMaxWaiters) {
+            waiters.push_back(std::move(done));
+        }
+        return true;
+    }
+    if (outstanding_.size() >= kMaxOutstanding) {
+        return false;
+    }
+
+    // Sequence numbers wrap; skip any still waiting for a reply
+    uint16_t sequence = next_sequence_++;
+    while (outstanding_.count(sequence) != 0) {
+        sequence = next_sequence_++;
+    }
+    const std::vector<uint8_t> request = build_echo_request(id_, sequence);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = ip_address;
+    if (::sendto(fd_, request.data(), request.size(), MSG_DONTWAIT, reinterpret_cast<struct sockaddr*>(&addr),
+                 sizeof(addr)) < 0) {
+        LOG_DEBUG("Ping check of " + ip_to_string(ip_address) + " not sent: " + strerror(errno));
+        return false;
+    }
+    probes_sent_.fetch_add(1, std::memory_order_relaxed);
+
+    Probe& entry = outstanding_[sequence];
+    entry.ip_address = ip_address;
+    entry.deadline = now + timeout_;
+    entry.waiters.push_back(std::move(done));
+    probing_[ip_address] = sequence;
+    deadlines_.emplace_back(entry.deadline, sequence);
+
+    if (sweep_timer_ == 0) {
+        // Fine enough that a probe completes within a quarter timeout of its deadline
+        const auto interval = std::max(std::chrono::milliseconds(5), timeout_ / 4);
+        sweep_timer_ = loop_.add_timer(interval, [this]() { sweep(); });
+    }
+    return true;
+}
+
+std::vector<uint8_t> PingChecker::build_echo_request(uint16_t id, uint16_t sequence) {
+    std::vector<uint8_t> packet(kEchoHeader + kEchoPayload, 0);
+    packet[0] = ICMP_ECHO;
+    packet[1] = 0;
+    put16(&packet[4], id);
+    put16(&packet[6], sequence);
+    std::memcpy(&packet[kEchoHeader], kPayload, kEchoPayload);
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < packet.size(); i += 2) {
+        sum += read16(&packet[i]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    put16(&packet[2], static_cast<uint16_t>(~sum));
+    return packet;
+}
+
+void PingChecker::on_readable() {
+    uint8_t buffer[1500];
+    std::vector<Completion> completions;
+    for (size_t i = 0; i < kMaxDrainReplies; ++i) {
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        const ssize_t n = ::recvfrom(fd_, buffer, sizeof(buffer), MSG_DONTWAIT,
+                                     reinterpret_cast<struct sockaddr*>(&from), &from_length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;  // EAGAIN, or an error queued by an unreachable destination
+        }
+
+        // A raw socket delivers the IP header too
+        size_t offset = 0;
+        if (raw_) {
+            if (n < 1) {
+                continue;
+            }
+            offset = static_cast<size_t>(buffer[0] & 0x0f) * 4;
+        }
+        if (static_cast<size_t>(n) < offset + kEchoHeader || buffer[offset] != ICMP_ECHOREPLY ||
+            (raw_ && read16(&buffer[offset + 4]) != id_)) {
+            continue;
+        }
+        const uint16_t sequence = read16(&buffer[offset + 6]);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = outstanding_.find(sequence);
+        if (it == outstanding_.end() || it->second.ip_address != from.sin_addr.s_addr) {
+            continue;   // late, or another host answering for a recycled sequence number
+        }
+        probes_answered_.fetch_add(1, std::memory_order_relaxed);
+        for (Completion& done : finish_locked(sequence, true, Clock::now())) {
+            completions.push_back(std::move(done));
+        }
+    }
+    for (Completion& done : completions) {
+        done(true);
+    }
+}
+
+void PingChecker::sweep() {
+    std::vector<Completion> completions;
+    {
+        const auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!deadlines_.empty() && deadlines_.front().first <= now) {
+            const auto due = deadlines_.front();
+            deadlines_.pop_front();
+            const auto it = outstanding_.find(due.second);
+            if (it == outstanding_.end() || it->second.deadline != due.first) {
+                continue;   // answered already
+            }
+            probes_timed_out_.fetch_add(1, std::memory_order_relaxed);
+            for (Completion& done : finish_locked(due.second, false, now)) {
+                completions.push_back(std::move(done));
+            }
+        }
+        if (deadlines_.empty() && sweep_timer_ != 0) {
+            loop_.cancel_timer(sweep_timer_);
+            sweep_timer_ = 0;
+        }
+    }
+    for (Completion& done : completions) {
+        done(false);
+    }
+}
+
+std::vector<PingChecker::Completion> PingChecker::finish_locked(uint16_t sequence, bool in_use,
+                                                                 Clock::time_point now) {
+    const auto it = outstanding_.find(sequence);
+    std::vector<Completion> waiters = std::move(it->second.waiters);
+    const IpAddress ip_address = it->second.ip_address;
+    outstanding_.erase(it);
+    probing_.erase(ip_address);
+
+    prune_cache_locked(now);
+    const auto expires = now + cache_window_;
+    cache_[ip_address] = CacheEntry{in_use, expires};
+    cache_order_.emplace_back(expires, ip_address);
+    return waiters;
+}
+
+void PingChecker::prune_cache_locked(Clock::time_point now) {
+    while (!cache_order_.empty() && cache_order_.front().first <= now) {
+        const auto it = cache_.find(cache_order_.front().second);
+        // A later result for the address has its own entry further back
+        if (it != cache_.end() && it->second.expires <= now) {
+            cache_.erase(it);
+        }
+        cache_order_.pop_front();
+    }
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,262 @@
+/**
+ * @file network/raw_sender.cpp
+ * @brief Link-layer transmit ring implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/network/raw_sender.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <sys/mman.h>
+#endif
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kEthernetHeader = 14;
+constexpr size_t kIpHeader = 20;
+constexpr size_t kUdpHeader = 8;
+
+void put16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+// One's complement sum of 16-bit big-endian words, not yet folded
+uint32_t sum_words(const uint8_t* data, size_t length, uint32_t sum = 0) {
+    for (size_t i = 0; i + 1 < length; i += 2) {
+        sum += static_cast<uint32_t>(data[i]) << 8 | data[i + 1];
+    }
+    if (length & 1) {
+        sum += static_cast<uint32_t>(data[length - 1]) << 8;
+    }
+    return sum;
+}
+
+uint16_t fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+}
+
+size_t RawFrameSender::build_frame(uint8_t* out, size_t capacity, const MacAddress& source_mac,
+                                   const MacAddress& destination_mac, IpAddress source_ip, uint16_t source_port,
+                                   IpAddress destination_ip, uint16_t destination_port, ByteView payload) {
+    const size_t udp_length = kUdpHeader + payload.size();
+    const size_t length = kEthernetHeader + kIpHeader + udp_length;
+    if (length > capacity || kIpHeader + udp_length > 0xffff) {
+        return 0;
+    }
+
+    uint8_t* ethernet = out;
+    std::memcpy(ethernet, destination_mac.data(), 6);
+    std::memcpy(ethernet + 6, source_mac.data(), 6);
+    put16(ethernet + 12, 0x0800);  // IPv4
+
+    uint8_t* ip = ethernet + kEthernetHeader;
+    ip[0] = 0x45;                  // version 4, 20-byte header
+    ip[1] = 0x10;                  // low delay, as DHCP clients' own raw sends use
+    put16(ip + 2, static_cast<uint16_t>(kIpHeader + udp_length));
+    put16(ip + 4, 0);              // identification
+    put16(ip + 6, 0x4000);         // don't fragment
+    ip[8] = 64;                    // TTL
+    ip[9] = 17;                    // UDP
+    put16(ip + 10, 0);
+    std::memcpy(ip + 12, &source_ip, 4);
+    std::memcpy(ip + 16, &destination_ip, 4);
+    put16(ip + 10, fold(sum_words(ip, kIpHeader)));
+
+    uint8_t* udp = ip + kIpHeader;
+    put16(udp, source_port);
+    put16(udp + 2, destination_port);
+    put16(udp + 4, static_cast<uint16_t>(udp_length));
+    put16(udp + 6, 0);
+    std::memcpy(udp + kUdpHeader, payload.data(), payload.size());
+
+    // Pseudo-header: addresses, protocol and UDP length
+    uint32_t sum = sum_words(ip + 12, 8);
+    sum += 17 + static_cast<uint32_t>(udp_length);
+    uint16_t checksum = fold(sum_words(udp, udp_length, sum));
+    put16(udp + 6, checksum == 0 ? 0xffff : checksum);  // 0 would mean "no checksum"
+    return length;
+}
+
+#ifdef __linux__
+
+RawFrameSender::RawFrameSender(int interface_index, size_t frames)
+    : socket_fd_(-1), interface_index_(interface_index), source_mac_{}, ring_(nullptr), ring_size_(0),
+      frames_(0), next_(0), pending_(0) {
+    // Protocol 0: the socket only transmits and never sees incoming frames
+    socket_fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (socket_fd_ < 0) {
+        throw RawSocketException("Failed to create packet socket: " + std::string(strerror(errno)));
+    }
+
+    char name[IF_NAMESIZE] = {};
+    struct ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    if (if_indextoname(static_cast<unsigned int>(interface_index), name) == nullptr) {
+        close_ring();
+        throw RawSocketException("Unknown interface index " + std::to_string(interface_index));
+    }
+    std::strncpy(request.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(socket_fd_, SIOCGIFHWADDR, &request) < 0) {
+        const std::string error = strerror(errno);
+        close_ring();
+        throw RawSocketException("Failed to read hardware address of " + std::string(name) + ": " + error);
+    }
+    std::memcpy(source_mac_.data(), request.ifr_hwaddr.sa_data, 6);
+
+    int version = TPACKET_V2;
+    if (setsockopt(socket_fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        const std::string error = strerror(errno);
+        close_ring();
+        throw RawSocketException("Failed to select TPACKET_V2: " + error);
+    }
+
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t frames_per_block = page / kFrameSize;
+    struct tpacket_req ring;
+    std::memset(&ring, 0, sizeof(ring));
+    ring.tp_block_size = static_cast<unsigned int>(page);
+    ring.tp_block_nr = static_cast<unsigned int>((std::max<size_t>(frames, 1) + frames_per_block - 1) / frames_per_block);
+    ring.tp_frame_size = static_cast<unsigned int>(kFrameSize);
+    ring.tp_frame_nr = ring.tp_block_nr * static_cast<unsigned int>(frames_per_block);
+    if (setsockopt(socket_fd_, SOL_PACKET, PACKET_TX_RING, &ring, sizeof(ring)) < 0) {
+        const std::string error = strerror(errno);
+        close_ring();
+        throw RawSocketException("Failed to set up transmit ring: " + error);
+    }
+    ring_size_ = static_cast<size_t>(ring.tp_block_size) * ring.tp_block_nr;
+    void* mapped = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED, socket_fd_, 0);
+    if (mapped == MAP_FAILED) {
+        const std::string error = strerror(errno);
+        ring_size_ = 0;
+        close_ring();
+        throw RawSocketException("Failed to map transmit ring: " + error);
+    }
+    ring_ = static_cast<uint8_t*>(mapped);
+    frames_ = ring.tp_frame_nr;
+
+    struct sockaddr_ll address;
+    std::memset(&address, 0, sizeof(address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_IP);
+    address.sll_ifindex = interface_index;
+    if (bind(socket_fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+        const std::string error = strerror(errno);
+        close_ring();
+        throw RawSocketException("Failed to bind packet socket to " + std::string(name) + ": " + error);
+    }
+
+    LOG_DEBUG("Raw transmit ring on " + std::string(name) + ": " + std::to_string(frames_) + " frames");
+}
+
+RawFrameSender::~RawFrameSender() {
+    flush();
+    close_ring();
+}
+
+bool RawFrameSender::queue(const MacAddress& destination_mac, IpAddress source_ip, uint16_t source_port,
+                           IpAddress destination_ip, uint16_t destination_port, ByteView payload) {
+    constexpr size_t kDataOffset = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+
+    auto* slot = reinterpret_cast<struct tpacket2_hdr*>(ring_ + next_ * kFrameSize);
+    uint32_t status = __atomic_load_n(&slot->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+        // Ring full: wait for the kernel to send what is queued, then look again
+        pending_ = 0;
+        kick(true);
+        status = __atomic_load_n(&slot->tp_status, __ATOMIC_ACQUIRE);
+        if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+            return false;
+        }
+    }
+
+    uint8_t* frame = reinterpret_cast<uint8_t*>(slot) + kDataOffset;
+    const size_t length = build_frame(frame, kFrameSize - kDataOffset, source_mac_, destination_mac,
+                                      source_ip, source_port, destination_ip, destination_port, payload);
+    if (length == 0) {
+        return false;
+    }
+    slot->tp_len = static_cast<uint32_t>(length);
+    __atomic_store_n(&slot->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    next_ = (next_ + 1) % frames_;
+    ++pending_;
+    return true;
+}
+
+size_t RawFrameSender::flush() {
+    if (pending_ == 0) {
+        return 0;
+    }
+    const size_t submitted = pending_;
+    pending_ = 0;
+    kick(false);
+    return submitted;
+}
+
+void RawFrameSender::kick(bool wait) {
+    // Every slot marked SEND_REQUEST goes out with this one call
+    while (::send(socket_fd_, nullptr, 0, wait ? 0 : MSG_DONTWAIT) < 0) {
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_ERROR("Failed to submit raw frames: " + std::string(strerror(errno)));
+        }
+        break;
+    }
+}
+
+void RawFrameSender::close_ring() {
+    if (ring_) {
+        munmap(ring_, ring_size_);
+        ring_ = nullptr;
+    }
+    if (socket_fd_ >= 0) {
+        close(socket_fd_);
+        socket_fd_ = -1;
+    }
+}
+
+#else
+
+RawFrameSender::RawFrameSender(int interface_index, size_t)
+    : socket_fd_(-1), interface_index_(interface_index), source_mac_{}, ring_(nullptr), ring_size_(0),
+      frames_(0), next_(0), pending_(0) {
+    throw RawSocketException("Raw transmit rings need Linux PACKET_MMAP");
+}
+
+RawFrameSender::~RawFrameSender() {}
+
+bool RawFrameSender::queue(const MacAddress&, IpAddress, uint16_t, IpAddress, uint16_t, ByteView) {
+    return false;
+}
+
+size_t RawFrameSender::flush() {
+    return 0;
+}
+
+void RawFrameSender::kick(bool) {}
+
+void RawFrameSender::close_ring() {}
+
+#endif
+
+} // namespace simple_dhcpd
@@ -7,6 +7,7 @@
  */
 
 #include "simple-dhcpd/core/network/udp_socket.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
 #include "simple-dhcpd/core/utils/logger.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -15,11 +16,41 @@
 #include <fcntl.h>
 #include <cstring>
 #include <algorithm>
+#include <net/if.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 namespace simple_dhcpd {
 
+namespace {
+// Socket whose receive loop runs on this thread; replies it sends are batched
+thread_local const UdpSocket* t_receiving_socket = nullptr;
+// Ingress of the packet whose callback runs on this thread
+thread_local const PacketIngress* t_current_ingress = nullptr;
+// Set by set_current_ingress(): the reply is sent off the receive thread
+thread_local bool t_deferred_reply = false;
+
+#ifdef __linux__
+// Ask the kernel to send from the interface and address a packet came in on
+template <typename Control>
+size_t write_pktinfo(Control& control, const PacketIngress& via) {
+    std::memset(&control, 0, sizeof(control));
+    struct cmsghdr* cmsg = reinterpret_cast<struct cmsghdr*>(control.data);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_PKTINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+    struct in_pktinfo* info = reinterpret_cast<struct in_pktinfo*>(CMSG_DATA(cmsg));
+    info->ipi_ifindex = via.interface_index;
+    info->ipi_spec_dst.s_addr = via.local_address;
+    return CMSG_SPACE(sizeof(struct in_pktinfo));
+}
+#endif
+}
+
 UdpSocket::UdpSocket(const std::string& address, uint16_t port)
-    : address_(address), port_(port), socket_fd_(-1), bound_(false), receiving_(false) {
+    : address_(address), port_(port), socket_fd_(-1), bound_(false), cpu_affinity_(-1), receiving_(false),
+      loop_(nullptr), raw_unicast_(false), batch_size_(1), flush_timeout_(0), tx_pending_(0) {
     create_socket();
 }
 
@@ -44,6 +75,13 @@ void UdpSocket::create_socket() {
     // Enable broadcast
     enable_broadcast();
     
+#ifdef __linux__
+    // Report the receiving interface so replies can leave through it
+    if (setsockopt(socket_fd_, IPPROTO_IP, IP_PKTINFO, &opt, sizeof(opt)) < 0) {
+        LOG_WARN("Failed to enable IP_PKTINFO: " + std::string(strerror(errno)));
+    }
+#endif
+    
     LOG_DEBUG("UDP socket created for " + address_ + ":" + std::to_string(port_));
 }
 
@@ -76,6 +114,37 @@ void UdpSocket::bind() {
 }
 
 void UdpSocket::start_receiving(std::function<void(const std::vector<uint8_t>&, const std::string&, uint16_t)> callback) {
+    // Compatibility path: copy each packet into a vector for the caller
+    start_receiving(PacketCallback([callback](const PacketBuffer& packet) {
+        char address_buffer[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &packet.peer().sin_addr, address_buffer, sizeof(address_buffer));
+        std::vector<uint8_t> data(packet.data(), packet.data() + packet.size());
+        callback(data, address_buffer, packet.peer_port());
+    }));
+}
+
+void UdpSocket::start_receiving(PacketCallback callback) {
+    if (receiving_) {
+        return;
+    }
+    
+    // A loop kept by stop_receiving() on its own thread is reused
+    if (!own_loop_) {
+        own_loop_ = std::make_unique<EventLoop>(EventBackendType::AUTO, "receive loop " + address_ + ":" + std::to_string(port_));
+    }
+    own_loop_->start(cpu_affinity_);
+    try {
+        start_receiving(std::move(callback), *own_loop_);
+    } catch (...) {
+        own_loop_->stop();
+        if (!own_loop_->in_loop_thread()) {
+            own_loop_.reset();
+        }
+        throw;
+    }
+}
+
+void UdpSocket::start_receiving(PacketCallback callback, EventLoop& loop) {
     if (!bound_) {
         throw UdpSocketException("Socket not bound");
     }
@@ -84,13 +153,41 @@ void UdpSocket::start_receiving(std::function<void(const std::vector<uint8_t>&,
         return;
     }
     
-    callback_ = callback;
+    int flags = fcntl(socket_fd_, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket_fd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw UdpSocketException("Failed to make socket non-blocking: " + std::string(strerror(errno)));
+    }
+    
+    callback_ = std::move(callback);
+    // A restart returns the previous buffers to their pool before the pool goes
+    rx_buffers_.clear();
+    rx_pool_ = std::make_unique<PacketBufferPool>(batch_size_);
+    rx_iovecs_.assign(batch_size_, iovec{});
+#ifdef __linux__
+    rx_messages_.assign(batch_size_, mmsghdr{});
+    rx_control_.assign(batch_size_, ControlBuffer{});
+#endif
+    for (size_t i = 0; i < batch_size_; ++i) {
+        rx_buffers_.push_back(rx_pool_->acquire());
+        rx_iovecs_[i].iov_base = rx_buffers_[i]->data();
+        rx_iovecs_[i].iov_len = PacketBuffer::kCapacity;
+#ifdef __linux__
+        rx_messages_[i].msg_hdr.msg_iov = &rx_iovecs_[i];
+        rx_messages_[i].msg_hdr.msg_iovlen = 1;
+        rx_messages_[i].msg_hdr.msg_name = &rx_buffers_[i]->peer();
+        rx_messages_[i].msg_hdr.msg_control = rx_control_[i].data;
+#endif
+    }
+    
+    try {
+        loop.watch(socket_fd_, [this]() { drain(); });
+    } catch (const EventLoopException& e) {
+        throw UdpSocketException("Failed to watch socket: " + std::string(e.what()));
+    }
+    loop_ = &loop;
     receiving_ = true;
-    // Bounded wait in receive_loop so stop_receiving() can join without blocking forever.
-    set_receive_timeout(1);
-    receive_thread_ = std::thread(&UdpSocket::receive_loop, this);
     
-    LOG_DEBUG("Started receiving on " + address_ + ":" + std::to_string(port_));
+    LOG_DEBUG("Started receiving on " + address_ + ":" + std::to_string(port_) + " (" + loop.backend_name() + ")");
 }
 
 void UdpSocket::stop_receiving() {
@@ -100,8 +197,16 @@ void UdpSocket::stop_receiving() {
     
     receiving_ = false;
     
-    if (receive_thread_.joinable()) {
-        receive_thread_.join();
+    // Returns once drain() is no longer running, so the buffers can go
+    loop_->unwatch(socket_fd_);
+    loop_ = nullptr;
+    if (own_loop_) {
+        own_loop_->stop();
+        // Called from the receive callback the loop cannot be destroyed under
+        // itself; it is joined by the next start or the destructor
+        if (!own_loop_->in_loop_thread()) {
+            own_loop_.reset();
+        }
     }
     
     LOG_DEBUG("Stopped receiving on " + address_ + ":" + std::to_string(port_));
@@ -125,16 +230,16 @@ ssize_t UdpSocket::send_to(const uint8_t* data, size_t size, const std::string&
         throw UdpSocketException("Invalid destination address: " + address);
     }
     
-    ssize_t bytes_sent = sendto(socket_fd_, data, size, 0, (struct sockaddr*)&addr, sizeof(addr));
-    if (bytes_sent < 0) {
-        throw UdpSocketException("Failed to send data: " + std::string(strerror(errno)));
-    }
-    
+    ssize_t bytes_sent = send_datagram(data, size, addr);
     LOG_DEBUG("Sent " + std::to_string(bytes_sent) + " bytes to " + address + ":" + std::to_string(port));
     return bytes_sent;
 }
 
 ssize_t UdpSocket::send_broadcast(const std::vector<uint8_t>& data, uint16_t port) {
+    return send_broadcast(data.data(), data.size(), port);
+}
+
+ssize_t UdpSocket::send_broadcast(const uint8_t* data, size_t size, uint16_t port) {
     if (!bound_) {
         throw UdpSocketException("Socket not bound");
     }
@@ -145,15 +250,191 @@ ssize_t UdpSocket::send_broadcast(const std::vector<uint8_t>& data, uint16_t por
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_BROADCAST;
     
-    ssize_t bytes_sent = sendto(socket_fd_, data.data(), data.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
-    if (bytes_sent < 0) {
-        throw UdpSocketException("Failed to send broadcast: " + std::string(strerror(errno)));
+    ssize_t bytes_sent = send_datagram(data, size, addr);
+    LOG_DEBUG("Sent " + std::to_string(bytes_sent) + " bytes broadcast to port " + std::to_string(port));
+    return bytes_sent;
+}
+
+ssize_t UdpSocket::send_to(const uint8_t* data, size_t size, const std::string& address, uint16_t port,
+                           const PacketIngress& via) {
+    if (!bound_) {
+        throw UdpSocketException("Socket not bound");
     }
     
-    LOG_DEBUG("Sent " + std::to_string(bytes_sent) + " bytes broadcast to port " + std::to_string(port));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    
+    if (inet_aton(address.c_str(), &addr.sin_addr) == 0) {
+        throw UdpSocketException("Invalid destination address: " + address);
+    }
+    
+    ssize_t bytes_sent = send_datagram(data, size, addr, &via);
+    LOG_DEBUG("Sent " + std::to_string(bytes_sent) + " bytes to " + address + ":" + std::to_string(port) +
+              " via " + (via.interface_name.empty() ? address_ : via.interface_name));
+    return bytes_sent;
+}
+
+ssize_t UdpSocket::send_broadcast(const uint8_t* data, size_t size, uint16_t port, const PacketIngress& via) {
+    if (!bound_) {
+        throw UdpSocketException("Socket not bound");
+    }
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_BROADCAST;
+    
+    ssize_t bytes_sent = send_datagram(data, size, addr, &via);
+    LOG_DEBUG("Sent " + std::to_string(bytes_sent) + " bytes broadcast to port " + std::to_string(port) +
+              " via " + (via.interface_name.empty() ? address_ : via.interface_name));
     return bytes_sent;
 }
 
+ssize_t UdpSocket::send_to_hardware(const uint8_t* data, size_t size, const MacAddress& hardware, IpAddress address,
+                                    uint16_t port, const PacketIngress& via) {
+    if (raw_unicast_ && via.local_address != 0 && !t_deferred_reply) {
+        if (RawFrameSender* sender = raw_sender(via.interface_index)) {
+            if (sender->queue(hardware, via.local_address, port_, address, port, ByteView(data, size))) {
+                // Outside the receive loop nothing else flushes the ring
+                if (t_receiving_socket != this) {
+                    sender->flush();
+                }
+                return static_cast<ssize_t>(size);
+            }
+        }
+    }
+    return send_broadcast(data, size, port, via);
+}
+
+void UdpSocket::set_raw_unicast(bool enabled) {
+    if (receiving_) {
+        throw UdpSocketException("Raw unicast must be set before receiving starts");
+    }
+    raw_unicast_ = enabled;
+    raw_senders_.clear();
+}
+
+RawFrameSender* UdpSocket::raw_sender(int interface_index) {
+    if (interface_index <= 0) {
+        return nullptr;
+    }
+    auto it = raw_senders_.find(interface_index);
+    if (it == raw_senders_.end()) {
+        std::unique_ptr<RawFrameSender> sender;
+        try {
+            sender = std::make_unique<RawFrameSender>(interface_index, std::max<size_t>(batch_size_, RawFrameSender::kDefaultFrames));
+        } catch (const RawSocketException& e) {
+            // Remembered as unusable, so the warning is logged once per interface
+            LOG_WARN("Raw unicast unavailable, broadcasting instead: " + std::string(e.what()));
+        }
+        it = raw_senders_.emplace(interface_index, std::move(sender)).first;
+    }
+    return it->second.get();
+}
+
+const PacketIngress* UdpSocket::current_ingress() {
+    return t_current_ingress;
+}
+
+void UdpSocket::set_current_ingress(const PacketIngress* ingress) {
+    t_current_ingress = ingress;
+    t_deferred_reply = ingress != nullptr;
+}
+
+ssize_t UdpSocket::send_datagram(const uint8_t* data, size_t size, const struct sockaddr_in& to,
+                                 const PacketIngress* via) {
+    // Without a known interface the routing table picks one, as for any socket
+    if (via && via->interface_index == 0) {
+        via = nullptr;
+    }
+    
+    if (batch_size_ > 1 && t_receiving_socket == this && size <= kMaxDatagramSize) {
+        auto now = std::chrono::steady_clock::now();
+        if (tx_pending_ == 0) {
+            tx_oldest_ = now;
+        }
+        
+        memcpy(tx_storage_.data() + tx_pending_ * kMaxDatagramSize, data, size);
+        tx_iovecs_[tx_pending_].iov_len = size;
+        tx_addresses_[tx_pending_] = to;
+#ifdef __linux__
+        struct msghdr& header = tx_messages_[tx_pending_].msg_hdr;
+        header.msg_control = via ? tx_control_[tx_pending_].data : nullptr;
+        header.msg_controllen = via ? write_pktinfo(tx_control_[tx_pending_], *via) : 0;
+#endif
+        ++tx_pending_;
+        
+        if (tx_pending_ == batch_size_ || now - tx_oldest_ >= flush_timeout_) {
+            flush_pending();
+        }
+        return static_cast<ssize_t>(size);
+    }
+    
+    ssize_t bytes_sent;
+#ifdef __linux__
+    if (via) {
+        ControlBuffer control;
+        struct iovec iov;
+        iov.iov_base = const_cast<uint8_t*>(data);
+        iov.iov_len = size;
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_name = const_cast<struct sockaddr_in*>(&to);
+        header.msg_namelen = sizeof(to);
+        header.msg_iov = &iov;
+        header.msg_iovlen = 1;
+        header.msg_control = control.data;
+        header.msg_controllen = write_pktinfo(control, *via);
+        bytes_sent = sendmsg(socket_fd_, &header, 0);
+    } else
+#endif
+    {
+        bytes_sent = sendto(socket_fd_, data, size, 0, (const struct sockaddr*)&to, sizeof(to));
+    }
+    if (bytes_sent < 0) {
+        throw UdpSocketException("Failed to send data: " + std::string(strerror(errno)));
+    }
+    return bytes_sent;
+}
+
+size_t UdpSocket::flush_pending() {
+    size_t sent = 0;
+    
+#ifdef __linux__
+    while (sent < tx_pending_) {
+        int rc = sendmmsg(socket_fd_, &tx_messages_[sent], static_cast<unsigned int>(tx_pending_ - sent), 0);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Drop the datagram that failed and carry on with the rest of the batch
+            LOG_ERROR("Failed to send batched data: " + std::string(strerror(errno)));
+            ++sent;
+            continue;
+        }
+        sent += static_cast<size_t>(rc);
+    }
+#else
+    for (; sent < tx_pending_; ++sent) {
+        if (sendto(socket_fd_, tx_iovecs_[sent].iov_base, tx_iovecs_[sent].iov_len, 0,
+                   (const struct sockaddr*)&tx_addresses_[sent], sizeof(struct sockaddr_in)) < 0) {
+            LOG_ERROR("Failed to send batched data: " + std::string(strerror(errno)));
+        }
+    }
+#endif
+    
+    tx_pending_ = 0;
+    for (auto& entry : raw_senders_) {
+        if (entry.second) {
+            sent += entry.second->flush();
+        }
+    }
+    return sent;
+}
+
 bool UdpSocket::is_bound() const {
     std::lock_guard<std::mutex> lock(mutex_);
     return bound_;
@@ -194,37 +475,234 @@ void UdpSocket::set_receive_timeout(int timeout_seconds) {
     }
 }
 
-void UdpSocket::receive_loop() {
-    std::vector<uint8_t> buffer(1500); // Standard MTU
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
+void UdpSocket::enable_reuse_port() {
+#ifdef SO_REUSEPORT
+    if (bound_) {
+        throw UdpSocketException("SO_REUSEPORT must be set before bind");
+    }
+    set_socket_option(SO_REUSEPORT, 1);
+#else
+    throw UdpSocketException("SO_REUSEPORT is not supported on this platform");
+#endif
+}
+
+bool UdpSocket::attach_shard_filter(uint32_t group_size) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    if (group_size < 2) {
+        return false;
+    }
+    
+    // The program sees the UDP payload, i.e. the BOOTP header. chaddr starts at
+    // offset 28; its low four bytes vary most between clients, so use them as
+    // the hash and return the index of the socket in the group.
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, 30 },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog program;
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+    
+    if (setsockopt(socket_fd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+        LOG_WARN("Failed to attach reuseport shard filter: " + std::string(strerror(errno)));
+        return false;
+    }
+    return true;
+#else
+    (void)group_size;
+    return false;
+#endif
+}
+
+void UdpSocket::set_cpu_affinity(int cpu) {
+    cpu_affinity_ = cpu;
+}
+
+void UdpSocket::set_batch_mode(size_t batch_size, std::chrono::microseconds flush_timeout) {
+    if (receiving_) {
+        throw UdpSocketException("Batch mode must be set before receiving starts");
+    }
+    
+    batch_size_ = std::max<size_t>(1, batch_size);
+    flush_timeout_ = flush_timeout;
+    tx_pending_ = 0;
+    
+    tx_storage_.assign(batch_size_ * kMaxDatagramSize, 0);
+    tx_addresses_.assign(batch_size_, sockaddr_in{});
+    tx_iovecs_.assign(batch_size_, iovec{});
+#ifdef __linux__
+    tx_messages_.assign(batch_size_, mmsghdr{});
+    tx_control_.assign(batch_size_, ControlBuffer{});
+#endif
+    for (size_t i = 0; i < batch_size_; ++i) {
+        tx_iovecs_[i].iov_base = tx_storage_.data() + i * kMaxDatagramSize;
+#ifdef __linux__
+        tx_messages_[i].msg_hdr.msg_name = &tx_addresses_[i];
+        tx_messages_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        tx_messages_[i].msg_hdr.msg_iov = &tx_iovecs_[i];
+        tx_messages_[i].msg_hdr.msg_iovlen = 1;
+#endif
+    }
+}
+
+size_t UdpSocket::get_batch_size() const {
+    return batch_size_;
+}
+
+void UdpSocket::drain() {
+    t_receiving_socket = this;
+    
+    bool healthy;
+#ifdef __linux__
+    if (batch_size_ > 1) {
+        healthy = drain_batched();
+    } else
+#endif
+    {
+        healthy = drain_single();
+    }
+    // Replies and raw frames queued while dispatching leave together
+    flush_pending();
+    
+    t_receiving_socket = nullptr;
     
-    while (receiving_) {
-        ssize_t bytes_received = recvfrom(socket_fd_, buffer.data(), buffer.size(), 0,
-                                         (struct sockaddr*)&client_addr, &client_addr_len);
+    if (!healthy && loop_) {
+        // A hard error would otherwise keep the socket readable forever
+        loop_->unwatch(socket_fd_);
+    }
+}
+
+bool UdpSocket::drain_single() {
+    PacketBuffer& buffer = *rx_buffers_[0];
+    
+    for (size_t received = 0; received < kMaxDrainDatagrams && receiving_;) {
+#ifdef __linux__
+        struct msghdr* header = &rx_messages_[0].msg_hdr;
+        header->msg_namelen = sizeof(struct sockaddr_in);
+        header->msg_controllen = sizeof(ControlBuffer);
+        ssize_t bytes_received = recvmsg(socket_fd_, header, MSG_DONTWAIT);
+#else
+        const struct msghdr* header = nullptr;
+        socklen_t client_addr_len = sizeof(struct sockaddr_in);
+        ssize_t bytes_received = recvfrom(socket_fd_, buffer.data(), PacketBuffer::kCapacity, MSG_DONTWAIT,
+                                         (struct sockaddr*)&buffer.peer(), &client_addr_len);
+#endif
         
         if (bytes_received < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;
-            } else if (errno == EINTR) {
+            if (errno == EINTR) {
                 continue;
-            } else {
-                LOG_ERROR("Failed to receive data: " + std::string(strerror(errno)));
-                break;
             }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            LOG_ERROR("Failed to receive data: " + std::string(strerror(errno)));
+            return false;
         }
         
+        ++received;
         if (bytes_received > 0) {
-            std::string client_address = inet_ntoa(client_addr.sin_addr);
-            uint16_t client_port = ntohs(client_addr.sin_port);
-            
-            std::vector<uint8_t> data(buffer.begin(), buffer.begin() + bytes_received);
-            
-            if (callback_) {
-                callback_(data, client_address, client_port);
+            buffer.set_size(static_cast<size_t>(bytes_received));
+            read_ingress(buffer, header);
+            dispatch(buffer);
+        }
+    }
+    return true;
+}
+
+bool UdpSocket::drain_batched() {
+#ifdef __linux__
+    const size_t batch = batch_size_;
+    
+    for (size_t received = 0; received < kMaxDrainDatagrams && receiving_;) {
+        for (size_t i = 0; i < batch; ++i) {
+            rx_messages_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            rx_messages_[i].msg_hdr.msg_controllen = sizeof(ControlBuffer);
+        }
+        
+        int count = recvmmsg(socket_fd_, rx_messages_.data(), static_cast<unsigned int>(batch), MSG_DONTWAIT, nullptr);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            LOG_ERROR("Failed to receive data: " + std::string(strerror(errno)));
+            return false;
+        }
+        
+        for (int i = 0; i < count; ++i) {
+            if (rx_messages_[i].msg_len > 0) {
+                rx_buffers_[i]->set_size(rx_messages_[i].msg_len);
+                read_ingress(*rx_buffers_[i], &rx_messages_[i].msg_hdr);
+                dispatch(*rx_buffers_[i]);
+            }
+        }
+        received += static_cast<size_t>(count);
+        flush_pending();
+        if (static_cast<size_t>(count) < batch) {
+            return true;  // queue drained
+        }
+    }
+#endif
+    return true;
+}
+
+void UdpSocket::dispatch(const PacketBuffer& packet) {
+    if (!callback_) {
+        return;
+    }
+    
+    t_current_ingress = &packet.ingress();
+    try {
+        callback_(packet);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Receive callback failed: " + std::string(e.what()));
+    }
+    t_current_ingress = nullptr;
+}
+
+void UdpSocket::read_ingress(PacketBuffer& packet, const struct msghdr* header) {
+    PacketIngress& ingress = packet.ingress();
+    ingress.socket = this;
+    ingress.interface_index = 0;
+    ingress.local_address = 0;
+    
+#ifdef __linux__
+    if (header && !(header->msg_flags & MSG_CTRUNC)) {
+        for (const struct cmsghdr* cmsg = CMSG_FIRSTHDR(header); cmsg;
+             cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(header), const_cast<struct cmsghdr*>(cmsg))) {
+            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+                const struct in_pktinfo* info = reinterpret_cast<const struct in_pktinfo*>(CMSG_DATA(cmsg));
+                ingress.interface_index = info->ipi_ifindex;
+                ingress.local_address = info->ipi_spec_dst.s_addr;
+                break;
             }
         }
     }
+#else
+    (void)header;
+#endif
+    
+    // Names fit the small-string buffer, so this copy does not allocate
+    ingress.interface_name = interface_name(ingress.interface_index);
+}
+
+const std::string& UdpSocket::interface_name(int index) {
+    static const std::string unknown;
+    if (index <= 0) {
+        return unknown;
+    }
+    auto it = interface_names_.find(index);
+    if (it == interface_names_.end()) {
+        char name[IF_NAMESIZE] = {};
+        if (if_indextoname(static_cast<unsigned int>(index), name) == nullptr) {
+            name[0] = '\0';
+        }
+        it = interface_names_.emplace(index, name).first;
+    }
+    return it->second;
 }
 
 void UdpSocket::close_socket() {
@@ -237,7 +715,7 @@ void UdpSocket::close_socket() {
 
 // DhcpSocketManager implementation
 
-DhcpSocketManager::DhcpSocketManager() = default;
+DhcpSocketManager::DhcpSocketManager() : workers_(1) {}
 
 DhcpSocketManager::~DhcpSocketManager() {
     stop_all();
@@ -247,6 +725,20 @@ void DhcpSocketManager::initialize(const DhcpConfig& config) {
     std::lock_guard<std::mutex> lock(mutex_);
     
     sockets_.clear();
+    loops_.clear();
+    
+    const uint32_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    workers_ = config.worker_threads == 0 ? cpus : config.worker_threads;
+    
+    EventBackendType backend;
+    try {
+        backend = parse_event_backend(config.event_backend);
+    } catch (const EventLoopException& e) {
+        throw UdpSocketException(e.what());
+    }
+    for (uint32_t worker = 0; worker < workers_; ++worker) {
+        loops_.push_back(std::make_unique<EventLoop>(backend, "receive worker " + std::to_string(worker)));
+    }
     
     for (const auto& address : config.listen_addresses) {
         size_t colon_pos = address.find(':');
@@ -257,19 +749,48 @@ void DhcpSocketManager::initialize(const DhcpConfig& config) {
         std::string addr = address.substr(0, colon_pos);
         uint16_t port = static_cast<uint16_t>(std::stoi(address.substr(colon_pos + 1)));
         
-        auto socket = create_socket(addr, port);
-        socket->bind();
-        sockets_.push_back(std::move(socket));
+        // One socket per worker; with SO_REUSEPORT the kernel spreads datagrams
+        // across the group and the worker's loop serves its socket on every address.
+        for (uint32_t worker = 0; worker < workers_; ++worker) {
+            auto socket = create_socket(addr, port);
+            if (workers_ > 1) {
+                socket->enable_reuse_port();
+            }
+            socket->set_raw_unicast(config.raw_unicast_replies);
+            if (config.io_batch_size > 1) {
+                socket->set_batch_mode(config.io_batch_size, std::chrono::microseconds(config.io_flush_timeout_us));
+            }
+            socket->bind();
+            if (workers_ > 1 && worker == 0 && !socket->attach_shard_filter(workers_)) {
+                LOG_WARN("Shard filter unavailable on " + address + ", using kernel flow hash");
+            }
+            sockets_.push_back(std::move(socket));
+        }
     }
     
-    LOG_INFO("Initialized " + std::to_string(sockets_.size()) + " UDP sockets");
+    LOG_INFO("Initialized " + std::to_string(sockets_.size()) + " UDP sockets (" +
+             std::to_string(workers_) + " workers per address, " + loops_.front()->backend_name() + ")");
 }
 
 void DhcpSocketManager::start_all(std::function<void(const std::vector<uint8_t>&, const std::string&, uint16_t)> callback) {
+    start_all(PacketCallback([callback](const PacketBuffer& packet) {
+        char address_buffer[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &packet.peer().sin_addr, address_buffer, sizeof(address_buffer));
+        std::vector<uint8_t> data(packet.data(), packet.data() + packet.size());
+        callback(data, address_buffer, packet.peer_port());
+    }));
+}
+
+void DhcpSocketManager::start_all(PacketCallback callback) {
     std::lock_guard<std::mutex> lock(mutex_);
     
-    for (auto& socket : sockets_) {
-        socket->start_receiving(callback);
+    const uint32_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t worker = 0; worker < loops_.size(); ++worker) {
+        loops_[worker]->start(workers_ > 1 ? static_cast<int>(worker % cpus) : -1);
+    }
+    // Sockets were created address by address, worker by worker
+    for (size_t i = 0; i < sockets_.size(); ++i) {
+        sockets_[i]->start_receiving(callback, *loops_[i % loops_.size()]);
     }
     
     LOG_INFO("Started all UDP sockets");
@@ -281,76 +802,72 @@ void DhcpSocketManager::stop_all() {
     for (auto& socket : sockets_) {
         socket->stop_receiving();
     }
+    for (auto& loop : loops_) {
+        loop->stop();
+    }
     
     LOG_INFO("Stopped all UDP sockets");
 }
 
 ssize_t DhcpSocketManager::send_dhcp_message(const DhcpMessage& message, const std::string& address, uint16_t port) {
-    // Convert DHCP message to bytes (simplified)
-    std::vector<uint8_t> data;
-    data.resize(sizeof(DhcpMessageHeader) + 312); // Header + options
-    
-    // Copy header
-    memcpy(data.data(), &message.header, sizeof(DhcpMessageHeader));
-    
-    // Copy options (simplified)
-    size_t offset = sizeof(DhcpMessageHeader);
-    for (const auto& option : message.options) {
-        if (offset + 2 + option.length > data.size()) {
-            break;
-        }
-        
-        data[offset++] = static_cast<uint8_t>(option.code);
-        data[offset++] = option.length;
-        memcpy(data.data() + offset, option.data.data(), option.length);
-        offset += option.length;
+    ByteView encoded = DhcpMessageWriter::encode(message);
+    return send_dhcp_packet(encoded, address, port);
+}
+
+ssize_t DhcpSocketManager::send_dhcp_packet(ByteView packet, const std::string& address, uint16_t port) {
+    // A reply leaves through the worker socket and interface its request came in on
+    if (const PacketIngress* via = UdpSocket::current_ingress()) {
+        return via->socket->send_to(packet.data(), packet.size(), address, port, *via);
     }
     
-    // Add END option
-    if (offset < data.size()) {
-        data[offset] = static_cast<uint8_t>(DhcpOptionCode::END);
+    if (sockets_.empty()) {
+        throw UdpSocketException("No sockets available");
     }
     
-    // Use first socket for sending
-    if (sockets_.empty()) {
+    return sockets_[0]->send_to(packet.data(), packet.size(), address, port);
+}
+
+ssize_t DhcpSocketManager::send_dhcp_reply(ByteView packet, const ReplyRoute& route) {
+    if (reply_sink_) {
+        reply_sink_(packet, route);
+        return static_cast<ssize_t>(packet.size());
+    }
+    const PacketIngress* via = UdpSocket::current_ingress();
+    if (!via && sockets_.empty()) {
         throw UdpSocketException("No sockets available");
     }
+    UdpSocket& socket = via ? *via->socket : *sockets_[0];
+    
+    if (route.to_hardware && via) {
+        return socket.send_to_hardware(packet.data(), packet.size(), route.hardware, route.address, route.port, *via);
+    }
+    if (route.to_hardware || route.address == INADDR_BROADCAST) {
+        return via ? socket.send_broadcast(packet.data(), packet.size(), route.port, *via)
+                   : socket.send_broadcast(packet.data(), packet.size(), route.port);
+    }
     
-    return sockets_[0]->send_to(data, address, port);
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &route.address, address, sizeof(address));
+    return via ? socket.send_to(packet.data(), packet.size(), address, route.port, *via)
+               : socket.send_to(packet.data(), packet.size(), address, route.port);
+}
+
+void DhcpSocketManager::set_reply_sink(ReplySink sink) {
+    reply_sink_ = std::move(sink);
 }
 
 ssize_t DhcpSocketManager::send_dhcp_broadcast(const DhcpMessage& message, uint16_t port) {
-    // Convert DHCP message to bytes (simplified)
-    std::vector<uint8_t> data;
-    data.resize(sizeof(DhcpMessageHeader) + 312); // Header + options
-    
-    // Copy header
-    memcpy(data.data(), &message.header, sizeof(DhcpMessageHeader));
-    
-    // Copy options (simplified)
-    size_t offset = sizeof(DhcpMessageHeader);
-    for (const auto& option : message.options) {
-        if (offset + 2 + option.length > data.size()) {
-            break;
-        }
-        
-        data[offset++] = static_cast<uint8_t>(option.code);
-        data[offset++] = option.length;
-        memcpy(data.data() + offset, option.data.data(), option.length);
-        offset += option.length;
-    }
+    ByteView encoded = DhcpMessageWriter::encode(message);
     
-    // Add END option
-    if (offset < data.size()) {
-        data[offset] = static_cast<uint8_t>(DhcpOptionCode::END);
+    if (const PacketIngress* via = UdpSocket::current_ingress()) {
+        return via->socket->send_broadcast(encoded.data(), encoded.size(), port, *via);
     }
     
-    // Use first socket for sending
     if (sockets_.empty()) {
         throw UdpSocketException("No sockets available");
     }
     
-    return sockets_[0]->send_broadcast(data, port);
+    return sockets_[0]->send_broadcast(encoded.data(), encoded.size(), port);
 }
 
 bool DhcpSocketManager::is_receiving() const {
@@ -365,6 +882,21 @@ bool DhcpSocketManager::is_receiving() const {
     return false;
 }
 
+size_t DhcpSocketManager::socket_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sockets_.size();
+}
+
+uint32_t DhcpSocketManager::worker_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return workers_;
+}
+
+std::string DhcpSocketManager::event_backend_name() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loops_.empty() ? std::string() : std::string(loops_.front()->backend_name());
+}
+
 std::unique_ptr<UdpSocket> DhcpSocketManager::create_socket(const std::string& address, uint16_t port) {
     return std::make_unique<UdpSocket>(address, port);
 }
@@ -7,7 +7,7 @@
  */
 
 #include "simple-dhcpd/core/options/manager.hpp"
-#include <iostream>
+#include "simple-dhcpd/core/utils/logger.hpp"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
@@ -15,6 +15,211 @@
 
 namespace simple_dhcpd {
 
+namespace {
+const OptionMap& no_options() {
+    static const OptionMap empty;
+    return empty;
+}
+
+bool parse_scope(const std::string& name, CompiledInheritanceRule::Scope& scope) {
+    if (name == "global") {
+        scope = CompiledInheritanceRule::Scope::GLOBAL;
+    } else if (name == "subnet") {
+        scope = CompiledInheritanceRule::Scope::SUBNET;
+    } else if (name == "pool") {
+        scope = CompiledInheritanceRule::Scope::POOL;
+    } else if (name == "host") {
+        scope = CompiledInheritanceRule::Scope::HOST;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Merge scopes into options already holding the template defaults: global,
+ * then inheritance rules, then subnet, pool and host options.
+ */
+void merge_scopes(OptionMap& merged, const OptionMap& global, const OptionMap& subnet,
+                  const OptionMap& pool, const OptionMap* host,
+                  const std::vector<CompiledInheritanceRule>& rules, uint8_t client_class) {
+    for (const auto& option_pair : global) {
+        merged[option_pair.first] = option_pair.second;
+    }
+    
+    for (const auto& rule : rules) {
+        if ((rule.required_class & ~client_class) != 0) {
+            continue;
+        }
+        const OptionMap* source = nullptr;
+        switch (rule.source) {
+            case CompiledInheritanceRule::Scope::GLOBAL: source = &global; break;
+            case CompiledInheritanceRule::Scope::SUBNET: source = &subnet; break;
+            case CompiledInheritanceRule::Scope::POOL: source = &pool; break;
+            case CompiledInheritanceRule::Scope::HOST: source = host; break;
+        }
+        if (!source) {
+            continue;
+        }
+        auto source_it = source->find(rule.option_code);
+        if (source_it != source->end()) {
+            if (rule.inherit) {
+                merged[rule.option_code] = source_it->second;
+            } else if (!rule.override_value.empty()) {
+                merged[rule.option_code] = rule.override_value;
+            }
+        }
+    }
+    
+    for (const auto& option_pair : subnet) {
+        merged[option_pair.first] = option_pair.second;
+    }
+    for (const auto& option_pair : pool) {
+        merged[option_pair.first] = option_pair.second;
+    }
+    if (host) {
+        for (const auto& option_pair : *host) {
+            merged[option_pair.first] = option_pair.second;
+        }
+    }
+}
+}
+
+std::vector<CompiledInheritanceRule> OptionResolutionPlan::compile_rules(
+    const std::vector<OptionInheritanceRule>& rules) {
+    std::vector<CompiledInheritanceRule> compiled;
+    compiled.reserve(rules.size());
+    for (const auto& rule : rules) {
+        CompiledInheritanceRule::Scope source;
+        CompiledInheritanceRule::Scope target;
+        if (!parse_scope(rule.source_scope, source) || !parse_scope(rule.target_scope, target) ||
+            target == CompiledInheritanceRule::Scope::GLOBAL) {
+            continue;
+        }
+        uint8_t required_class = 0;
+        if (rule.condition == "vendor_class") {
+            required_class = HAS_VENDOR_CLASS;
+        } else if (rule.condition == "user_class") {
+            required_class = HAS_USER_CLASS;
+        } else if (!rule.condition.empty()) {
+            required_class = NEVER;
+        }
+        compiled.push_back(CompiledInheritanceRule{source, rule.option_code, rule.inherit, required_class,
+                                                   rule.override_value});
+    }
+    return compiled;
+}
+
+std::shared_ptr<const OptionResolutionPlan> OptionResolutionPlan::compile(
+    const OptionScopes& scopes, const std::vector<OptionInheritanceRule>& rules,
+    const std::vector<std::pair<std::string, OptionMap>>& template_defaults) {
+    auto plan = std::make_shared<OptionResolutionPlan>();
+    plan->rules_ = compile_rules(rules);
+    const size_t vendors = std::max<size_t>(1, template_defaults.size());
+    plan->classes_ = vendors * kClassBits;
+    for (size_t vendor = 1; vendor < template_defaults.size(); ++vendor) {
+        plan->vendor_classes_.emplace(template_defaults[vendor].first, static_cast<uint32_t>(vendor));
+    }
+    
+    auto add_scope = [&](const OptionMap& subnet, const OptionMap& pool) {
+        const uint32_t scope = static_cast<uint32_t>(plan->tables_.size() / plan->classes_);
+        for (size_t vendor = 0; vendor < vendors; ++vendor) {
+            for (uint8_t bits = 0; bits < kClassBits; ++bits) {
+                OptionMap merged = vendor < template_defaults.size() ? template_defaults[vendor].second : OptionMap();
+                merge_scopes(merged, scopes.global, subnet, pool, nullptr, plan->rules_, bits);
+                plan->add_table(merged);
+            }
+        }
+        return scope;
+    };
+    
+    add_scope(no_options(), no_options());
+    std::set<std::string> subnet_names;
+    for (const auto& subnet_pair : scopes.subnets) {
+        subnet_names.insert(subnet_pair.first);
+    }
+    for (const auto& pool_pair : scopes.pools) {
+        subnet_names.insert(pool_pair.first);
+    }
+    for (const auto& name : subnet_names) {
+        auto subnet_it = scopes.subnets.find(name);
+        const OptionMap& subnet = subnet_it != scopes.subnets.end() ? subnet_it->second : no_options();
+        SubnetScope& entry = plan->subnets_[name];
+        entry.scope = add_scope(subnet, no_options());
+        auto pools_it = scopes.pools.find(name);
+        if (pools_it != scopes.pools.end()) {
+            for (const auto& pool_pair : pools_it->second) {
+                entry.pools.emplace_back(pool_pair.first, add_scope(subnet, pool_pair.second));
+            }
+        }
+    }
+    return plan;
+}
+
+void OptionResolutionPlan::add_table(const OptionMap& options) {
+    Table table;
+    table.first = static_cast<uint32_t>(slices_.size());
+    table.slot.fill(0);
+    uint16_t count = 0;
+    for (const auto& option_pair : options) {
+        slices_.push_back(Slice{static_cast<uint32_t>(data_.size()), static_cast<uint32_t>(option_pair.second.size())});
+        data_.insert(data_.end(), option_pair.second.begin(), option_pair.second.end());
+        table.slot[static_cast<uint8_t>(option_pair.first)] = ++count;
+    }
+    tables_.push_back(table);
+}
+
+void OptionResolutionPlan::resolve(const std::vector<DhcpOptionCode>& requested_options,
+                                   const OptionsContext& context, const OptionMap* host_options,
+                                   ResolvedOptions& out) const {
+    out.count_ = 0;
+    if (out.plan_.get() != this) {
+        out.plan_ = shared_from_this();
+    }
+    
+    uint32_t scope = 0;
+    auto subnet_it = subnets_.find(context.subnet_name);
+    if (subnet_it != subnets_.end()) {
+        scope = subnet_it->second.scope;
+        for (const auto& pool : subnet_it->second.pools) {
+            if (pool.first == context.pool_name) {
+                scope = pool.second;
+                break;
+            }
+        }
+    }
+    size_t vendor = 0;
+    if (!context.vendor_class.empty()) {
+        auto vendor_it = vendor_classes_.find(context.vendor_class);
+        if (vendor_it != vendor_classes_.end()) {
+            vendor = vendor_it->second;
+        }
+    }
+    const Table& table = tables_[scope * classes_ + vendor * kClassBits + client_class(context)];
+    
+    uint64_t seen[4] = {0, 0, 0, 0};
+    for (const auto option_code : requested_options) {
+        const uint8_t code = static_cast<uint8_t>(option_code);
+        if (seen[code >> 6] & (1ull << (code & 63))) {
+            continue;
+        }
+        seen[code >> 6] |= 1ull << (code & 63);
+        
+        if (host_options) {
+            auto host_it = host_options->find(option_code);
+            if (host_it != host_options->end()) {
+                out.options_[out.count_++] = ResolvedOption{option_code, host_it->second.data(), host_it->second.size()};
+                continue;
+            }
+        }
+        const uint16_t slot = table.slot[code];
+        if (slot != 0) {
+            const Slice& slice = slices_[table.first + slot - 1];
+            out.options_[out.count_++] = ResolvedOption{option_code, data_.data() + slice.offset, slice.length};
+        }
+    }
+}
+
 DhcpOptionsManager::DhcpOptionsManager() {
     initialize_standard_options();
 }
@@ -29,8 +234,9 @@ void DhcpOptionsManager::register_standard_option(DhcpOptionCode option_code,
     
     auto template_ptr = std::make_shared<OptionTemplate>(template_data);
     standard_options_[option_code] = template_ptr;
+    invalidate_plan();
     
-    std::cout << "INFO: Registered standard option: " + name + " (code " + std::to_string(static_cast<int>(option_code)) + ")" << std::endl;
+    LOG_INFO("Registered standard option: " + name + " (code " + std::to_string(static_cast<int>(option_code)) + ")");
 }
 
 void DhcpOptionsManager::register_vendor_option(DhcpOptionCode option_code, 
@@ -42,9 +248,10 @@ void DhcpOptionsManager::register_vendor_option(DhcpOptionCode option_code,
     
     auto template_ptr = std::make_shared<OptionTemplate>(template_data);
     vendor_options_[vendor_class][option_code] = template_ptr;
+    invalidate_plan();
     
-    std::cout << "INFO: Registered vendor option: " + name + " for vendor " + vendor_class + 
-                 " (code " + std::to_string(static_cast<int>(option_code)) + ")" << std::endl;
+    LOG_INFO("Registered vendor option: " + name + " for vendor " + vendor_class + 
+                 " (code " + std::to_string(static_cast<int>(option_code)) + ")");
 }
 
 void DhcpOptionsManager::register_custom_option(DhcpOptionCode option_code, 
@@ -55,8 +262,9 @@ void DhcpOptionsManager::register_custom_option(DhcpOptionCode option_code,
     
     auto template_ptr = std::make_shared<OptionTemplate>(template_data);
     custom_options_[option_code] = template_ptr;
+    invalidate_plan();
     
-    std::cout << "INFO: Registered custom option: " + name + " (code " + std::to_string(static_cast<int>(option_code)) + ")" << std::endl;
+    LOG_INFO("Registered custom option: " + name + " (code " + std::to_string(static_cast<int>(option_code)) + ")");
 }
 
 std::shared_ptr<OptionTemplate> DhcpOptionsManager::get_option_template(DhcpOptionCode option_code,
@@ -171,6 +379,7 @@ void DhcpOptionsManager::set_custom_validator(DhcpOptionCode option_code,
 void DhcpOptionsManager::add_inheritance_rule(const OptionInheritanceRule& rule) {
     std::lock_guard<std::mutex> lock(mutex_);
     inheritance_rules_.push_back(rule);
+    invalidate_plan();
 }
 
 void DhcpOptionsManager::remove_inheritance_rule(const std::string& source_scope,
@@ -186,6 +395,7 @@ void DhcpOptionsManager::remove_inheritance_rule(const std::string& source_scope
                        rule.option_code == option_code;
             }),
         inheritance_rules_.end());
+    invalidate_plan();
 }
 
 std::vector<OptionInheritanceRule> DhcpOptionsManager::get_inheritance_rules() {
@@ -200,68 +410,11 @@ std::map<DhcpOptionCode, std::vector<uint8_t>> DhcpOptionsManager::apply_inherit
     const std::map<DhcpOptionCode, std::vector<uint8_t>>& host_options,
     const OptionsContext& context) {
     
+    // Rules come decoded from the published plan, so no lock and no scope name compares
+    const auto plan = resolution_plan();
     std::map<DhcpOptionCode, std::vector<uint8_t>> final_options;
-    
-    // Start with global options
-    final_options = global_options;
-    
-    // Apply inheritance rules
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (const auto& rule : inheritance_rules_) {
-        if (!check_inheritance_condition(rule, context)) {
-            continue;
-        }
-        
-        std::map<DhcpOptionCode, std::vector<uint8_t>>* source_options = nullptr;
-        std::map<DhcpOptionCode, std::vector<uint8_t>>* target_options = nullptr;
-        
-        // Determine source options
-        if (rule.source_scope == "global") {
-            source_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&global_options);
-        } else if (rule.source_scope == "subnet") {
-            source_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&subnet_options);
-        } else if (rule.source_scope == "pool") {
-            source_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&pool_options);
-        } else if (rule.source_scope == "host") {
-            source_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&host_options);
-        }
-        
-        // Determine target options
-        if (rule.target_scope == "subnet") {
-            target_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&subnet_options);
-        } else if (rule.target_scope == "pool") {
-            target_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&pool_options);
-        } else if (rule.target_scope == "host") {
-            target_options = const_cast<std::map<DhcpOptionCode, std::vector<uint8_t>>*>(&host_options);
-        }
-        
-        if (source_options && target_options) {
-            auto source_it = source_options->find(rule.option_code);
-            if (source_it != source_options->end()) {
-                if (rule.inherit) {
-                    final_options[rule.option_code] = source_it->second;
-                } else if (!rule.override_value.empty()) {
-                    final_options[rule.option_code] = rule.override_value;
-                }
-            }
-        }
-    }
-    
-    // Apply subnet options
-    for (const auto& option_pair : subnet_options) {
-        final_options[option_pair.first] = option_pair.second;
-    }
-    
-    // Apply pool options
-    for (const auto& option_pair : pool_options) {
-        final_options[option_pair.first] = option_pair.second;
-    }
-    
-    // Apply host options (highest priority)
-    for (const auto& option_pair : host_options) {
-        final_options[option_pair.first] = option_pair.second;
-    }
-    
+    merge_scopes(final_options, global_options, subnet_options, pool_options, &host_options,
+                 plan->rules(), OptionResolutionPlan::client_class(context));
     return final_options;
 }
 
@@ -273,7 +426,7 @@ std::string DhcpOptionsManager::create_template(const std::string& name,
     std::string template_id = "template_" + std::to_string(std::time(nullptr));
     option_templates_[template_id] = options;
     
-    std::cout << "INFO: Created option template: " + name + " (ID: " + template_id + ")" << std::endl;
+    LOG_INFO("Created option template: " + name + " (ID: " + template_id + ")");
     
     return template_id;
 }
@@ -319,18 +472,56 @@ std::map<DhcpOptionCode, std::vector<uint8_t>> DhcpOptionsManager::process_clien
     const std::vector<DhcpOptionCode>& requested_options,
     const OptionsContext& context) {
     
-    std::map<DhcpOptionCode, std::vector<uint8_t>> response_options;
+    ResolvedOptions resolved;
+    process_client_request(requested_options, context, nullptr, resolved);
     
-    for (const auto& option_code : requested_options) {
-        auto template_ptr = get_option_template(option_code, context.vendor_class);
-        if (template_ptr && !template_ptr->default_value.empty()) {
-            response_options[option_code] = template_ptr->default_value;
-        }
+    std::map<DhcpOptionCode, std::vector<uint8_t>> response_options;
+    for (const auto& option : resolved) {
+        response_options[option.code].assign(option.data, option.data + option.length);
     }
     
     return response_options;
 }
 
+void DhcpOptionsManager::process_client_request(const std::vector<DhcpOptionCode>& requested_options,
+                                                const OptionsContext& context,
+                                                const OptionMap* host_options,
+                                                ResolvedOptions& out) {
+    resolution_plan()->resolve(requested_options, context, host_options, out);
+}
+
+void DhcpOptionsManager::set_global_options(const OptionMap& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scopes_.global = options;
+    invalidate_plan();
+}
+
+void DhcpOptionsManager::set_subnet_options(const std::string& subnet_name, const OptionMap& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scopes_.subnets[subnet_name] = options;
+    invalidate_plan();
+}
+
+void DhcpOptionsManager::set_pool_options(const std::string& subnet_name, const std::string& pool_name,
+                                          const OptionMap& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scopes_.pools[subnet_name][pool_name] = options;
+    invalidate_plan();
+}
+
+std::shared_ptr<const OptionResolutionPlan> DhcpOptionsManager::resolution_plan() {
+    auto plan = std::atomic_load(&plan_);
+    if (plan) {
+        return plan;
+    }
+    return compile_resolution_plan();
+}
+
+std::shared_ptr<const OptionResolutionPlan> DhcpOptionsManager::compile_resolution_plan() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compile_plan_locked();
+}
+
 std::vector<uint8_t> DhcpOptionsManager::generate_option_82(const std::string& circuit_id,
                                                            const std::string& remote_id,
                                                            const std::string& subscriber_id) {
@@ -390,45 +581,62 @@ std::map<uint8_t, std::vector<uint8_t>> DhcpOptionsManager::parse_option_82(
 
 bool DhcpOptionsManager::load_configuration(const std::string& config_file) {
     // TODO: Implement configuration loading
-    std::cout << "INFO: Loading options configuration from: " + config_file << std::endl;
+    LOG_INFO("Loading options configuration from: " + config_file);
     return true;
 }
 
 bool DhcpOptionsManager::save_configuration(const std::string& config_file) {
     // TODO: Implement configuration saving
-    std::cout << "INFO: Saving options configuration to: " + config_file << std::endl;
+    LOG_INFO("Saving options configuration to: " + config_file);
     return true;
 }
 
 void DhcpOptionsManager::reset_to_defaults() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    standard_options_.clear();
-    vendor_options_.clear();
-    custom_options_.clear();
-    inheritance_rules_.clear();
-    option_templates_.clear();
-    custom_validators_.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        standard_options_.clear();
+        vendor_options_.clear();
+        custom_options_.clear();
+        inheritance_rules_.clear();
+        option_templates_.clear();
+        custom_validators_.clear();
+        scopes_ = OptionScopes();
+        invalidate_plan();
+    }
     
+    // Registration takes mutex_ itself
     initialize_standard_options();
     
-    std::cout << "INFO: Reset options manager to defaults" << std::endl;
+    LOG_INFO("Reset options manager to defaults");
 }
 
 std::map<DhcpOptionCode, size_t> DhcpOptionsManager::get_option_usage_stats() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return option_usage_stats_;
+    const auto counts = option_usage_stats_.snapshot();
+    std::map<DhcpOptionCode, size_t> usage;
+    for (size_t code = 0; code < counts.size(); ++code) {
+        if (counts[code] != 0) {
+            usage[static_cast<DhcpOptionCode>(code)] = counts[code];
+        }
+    }
+    return usage;
 }
 
 std::map<std::string, size_t> DhcpOptionsManager::get_validation_stats() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return validation_stats_;
+    static const char* const names[] = {"valid", "invalid", "errors", "warnings"};
+    const auto counts = validation_stats_.snapshot();
+    std::map<std::string, size_t> stats;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] != 0) {
+            stats[names[i]] = counts[i];
+        }
+    }
+    return stats;
 }
 
 void DhcpOptionsManager::clear_statistics() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    option_usage_stats_.clear();
-    validation_stats_.clear();
+    option_usage_stats_.reset();
+    validation_stats_.reset();
 }
 
 void DhcpOptionsManager::initialize_standard_options() {
@@ -559,41 +767,52 @@ OptionValidationResult DhcpOptionsManager::validate_range(DhcpOptionCode option_
     return OptionValidationResult(true);
 }
 
-bool DhcpOptionsManager::check_inheritance_condition(const OptionInheritanceRule& rule,
-                                                    const OptionsContext& context) {
-    if (rule.condition.empty()) {
-        return true;
-    }
-    
-    // Simple condition checking - can be extended
-    if (rule.condition == "vendor_class" && !context.vendor_class.empty()) {
-        return true;
-    }
-    
-    if (rule.condition == "user_class" && !context.user_class.empty()) {
-        return true;
+std::shared_ptr<const OptionResolutionPlan> DhcpOptionsManager::compile_plan_locked() {
+    // Template defaults per vendor class, looked up standard, then vendor, then custom;
+    // the first template found for a code decides, even without a default value
+    std::vector<std::pair<std::string, OptionMap>> template_defaults(1);
+    for (const auto& vendor_pair : vendor_options_) {
+        template_defaults.emplace_back(vendor_pair.first, OptionMap());
+    }
+    for (size_t vendor = 0; vendor < template_defaults.size(); ++vendor) {
+        OptionMap& defaults = template_defaults[vendor].second;
+        std::set<DhcpOptionCode> decided;
+        auto add_defaults = [&](const std::map<DhcpOptionCode, std::shared_ptr<OptionTemplate>>& templates) {
+            for (const auto& template_pair : templates) {
+                if (decided.insert(template_pair.first).second && !template_pair.second->default_value.empty()) {
+                    defaults[template_pair.first] = template_pair.second->default_value;
+                }
+            }
+        };
+        add_defaults(standard_options_);
+        if (vendor > 0) {
+            add_defaults(vendor_options_.at(template_defaults[vendor].first));
+        }
+        add_defaults(custom_options_);
     }
     
-    return false;
+    auto plan = OptionResolutionPlan::compile(scopes_, inheritance_rules_, template_defaults);
+    std::atomic_store(&plan_, plan);
+    return plan;
+}
+
+void DhcpOptionsManager::invalidate_plan() {
+    std::atomic_store(&plan_, std::shared_ptr<const OptionResolutionPlan>());
 }
 
 void DhcpOptionsManager::update_usage_stats(DhcpOptionCode option_code) {
-    option_usage_stats_[option_code]++;
+    option_usage_stats_.increment(option_code);
 }
 
 void DhcpOptionsManager::update_validation_stats(const OptionValidationResult& result) {
-    if (result.valid) {
-        validation_stats_["valid"]++;
-    } else {
-        validation_stats_["invalid"]++;
-    }
+    validation_stats_.increment(result.valid ? ValidationCounter::VALID : ValidationCounter::INVALID);
     
     if (!result.error_message.empty()) {
-        validation_stats_["errors"]++;
+        validation_stats_.increment(ValidationCounter::ERRORS);
     }
     
     if (!result.warning_message.empty()) {
-        validation_stats_["warnings"]++;
+        validation_stats_.increment(ValidationCounter::WARNINGS);
     }
 }
 
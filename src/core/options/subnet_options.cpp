@@ -0,0 +1,123 @@
+/**
+ * @file options/subnet_options.cpp
+ * @brief Pre-encoded per-subnet reply options implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/options/subnet_options.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <algorithm>
+#include <cstring>
+#include <arpa/inet.h>
+
+namespace simple_dhcpd {
+
+namespace {
+
+void append_option(std::vector<uint8_t>& out, DhcpOptionCode code, const uint8_t* data, size_t length) {
+    out.push_back(static_cast<uint8_t>(code));
+    out.push_back(static_cast<uint8_t>(length));
+    out.insert(out.end(), data, data + length);
+}
+
+void append_u32(std::vector<uint8_t>& out, DhcpOptionCode code, uint32_t value) {
+    const uint32_t be = htonl(value);
+    append_option(out, code, reinterpret_cast<const uint8_t*>(&be), sizeof(be));
+}
+
+void append_ip(std::vector<uint8_t>& out, DhcpOptionCode code, IpAddress address) {
+    append_option(out, code, reinterpret_cast<const uint8_t*>(&address), sizeof(address));
+}
+
+void put_u32(uint8_t* option, uint32_t value) {
+    const uint32_t be = htonl(value);
+    std::memcpy(option + 2, &be, sizeof(be));
+}
+
+void put_ip(uint8_t* option, IpAddress address) {
+    std::memcpy(option + 2, &address, sizeof(address));
+}
+
+/**
+ * Copy encoded options into a reply: one memcpy when the range fits the
+ * options field, otherwise option by option so the writer can overload.
+ */
+uint8_t* place(DhcpMessageWriter& writer, const uint8_t* data, size_t length) {
+    uint8_t* out = writer.reserve(length);
+    if (out) {
+        std::memcpy(out, data, length);
+        return out;
+    }
+
+    size_t offset = 0;
+    while (offset + 2 <= length) {
+        const uint8_t option_length = data[offset + 1];
+        writer.add_option(static_cast<DhcpOptionCode>(data[offset]), data + offset + 2, option_length);
+        offset += 2 + option_length;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+CompiledSubnetOptions::CompiledSubnetOptions() : server_id_(0) {}
+
+CompiledSubnetOptions CompiledSubnetOptions::compile(const DhcpSubnet& subnet, IpAddress server_id) {
+    CompiledSubnetOptions compiled;
+    compiled.server_id_ = server_id;
+
+    std::vector<uint8_t>& out = compiled.bytes_;
+    append_ip(out, DhcpOptionCode::SERVER_IDENTIFIER, server_id);
+    append_u32(out, DhcpOptionCode::IP_ADDRESS_LEASE_TIME, subnet.lease_time);
+    append_u32(out, DhcpOptionCode::RENEWAL_TIME, subnet.lease_time / 2);
+    append_u32(out, DhcpOptionCode::REBINDING_TIME, static_cast<uint32_t>((static_cast<uint64_t>(subnet.lease_time) * 7) / 8));
+
+    append_ip(out, DhcpOptionCode::SUBNET_MASK, subnet_mask_for_prefix(subnet.prefix_length));
+    if (subnet.gateway != 0) {
+        append_ip(out, DhcpOptionCode::ROUTER, subnet.gateway);
+    }
+    if (!subnet.dns_servers.empty()) {
+        // Option 6 holds at most 63 addresses in a single instance
+        const size_t count = std::min<size_t>(subnet.dns_servers.size(), 63);
+        append_option(out, DhcpOptionCode::DOMAIN_SERVER,
+                      reinterpret_cast<const uint8_t*>(subnet.dns_servers.data()), count * sizeof(IpAddress));
+    }
+    if (!subnet.domain_name.empty()) {
+        const size_t length = std::min<size_t>(subnet.domain_name.size(), 255);
+        append_option(out, DhcpOptionCode::DOMAIN_NAME,
+                      reinterpret_cast<const uint8_t*>(subnet.domain_name.data()), length);
+    }
+
+    return compiled;
+}
+
+void CompiledSubnetOptions::write(DhcpMessageWriter& writer, uint32_t lease_time, IpAddress server_id) const {
+    uint8_t* out = writer.reserve(bytes_.size());
+    if (!out) {
+        // Rare: the blob does not fit in one piece; patch a copy and spread it
+        std::vector<uint8_t> patched(bytes_);
+        put_ip(patched.data() + kServerIdOffset, server_id);
+        put_u32(patched.data() + kLeaseTimeOffset, lease_time);
+        put_u32(patched.data() + kRenewalOffset, lease_time / 2);
+        put_u32(patched.data() + kRebindingOffset, static_cast<uint32_t>((static_cast<uint64_t>(lease_time) * 7) / 8));
+        place(writer, patched.data(), patched.size());
+        return;
+    }
+
+    std::memcpy(out, bytes_.data(), bytes_.size());
+    put_ip(out + kServerIdOffset, server_id);
+    put_u32(out + kLeaseTimeOffset, lease_time);
+    put_u32(out + kRenewalOffset, lease_time / 2);
+    put_u32(out + kRebindingOffset, static_cast<uint32_t>((static_cast<uint64_t>(lease_time) * 7) / 8));
+}
+
+void CompiledSubnetOptions::write_without_lease(DhcpMessageWriter& writer, IpAddress server_id) const {
+    writer.add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, server_id);
+    if (bytes_.size() > kSubnetOptionsOffset) {
+        place(writer, bytes_.data() + kSubnetOptionsOffset, bytes_.size() - kSubnetOptionsOffset);
+    }
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,72 @@
+/**
+ * @file utils/crc32.cpp
+ * @brief CRC-32 implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/utils/crc32.hpp"
+#include <array>
+#include <cstring>
+
+namespace simple_dhcpd {
+
+namespace {
+using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+// tables[k][b] is the CRC of byte b followed by k zero bytes, for slicing-by-8
+Tables make_tables() {
+    Tables tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+        }
+        tables[0][i] = value;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t k = 1; k < tables.size(); ++k) {
+            tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+inline bool little_endian() {
+    const uint16_t probe = 1;
+    uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+}
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc) {
+    static const Tables kTables = make_tables();
+    static const bool kLittleEndian = little_endian();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+
+    // Eight bytes per step; snapshots checksum tens of megabytes at startup
+    if (kLittleEndian) {
+        while (size >= 8) {
+            uint32_t low;
+            uint32_t high;
+            std::memcpy(&low, bytes, 4);
+            std::memcpy(&high, bytes + 4, 4);
+            low ^= crc;
+            crc = kTables[7][low & 0xFF] ^ kTables[6][(low >> 8) & 0xFF] ^
+                  kTables[5][(low >> 16) & 0xFF] ^ kTables[4][low >> 24] ^
+                  kTables[3][high & 0xFF] ^ kTables[2][(high >> 8) & 0xFF] ^
+                  kTables[1][(high >> 16) & 0xFF] ^ kTables[0][high >> 24];
+            bytes += 8;
+            size -= 8;
+        }
+    }
+    for (size_t i = 0; i < size; ++i) {
+        crc = kTables[0][(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,75 @@
+/**
+ * @file utils/durable_file.cpp
+ * @brief Crash-safe file writing helpers implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/utils/durable_file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace simple_dhcpd {
+
+bool write_fully(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t written = ::write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void sync_parent_directory(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    const int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+bool replace_file_durably(const std::string& path, std::initializer_list<std::string_view> parts, std::string& error) {
+    const std::string temporary = path + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "Cannot create " + temporary + ": " + std::strerror(errno);
+        return false;
+    }
+
+    bool written = true;
+    for (const auto& part : parts) {
+        if (!write_fully(fd, part.data(), part.size())) {
+            written = false;
+            break;
+        }
+    }
+    if (!written || ::fdatasync(fd) != 0) {
+        error = "Cannot write " + temporary + ": " + std::strerror(errno);
+        ::close(fd);
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    ::close(fd);
+
+    if (::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "Cannot replace " + path + ": " + std::strerror(errno);
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    sync_parent_directory(path);
+    return true;
+}
+
+} // namespace simple_dhcpd
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <ctime>
 #include <cstring>
+#include <cstdio>
 
 namespace simple_dhcpd {
 
@@ -17,7 +18,9 @@ namespace simple_dhcpd {
 std::unique_ptr<Logger> g_logger = nullptr;
 
 Logger::Logger(const std::string& log_file, LogLevel level)
-    : log_file_(log_file), level_(level), console_output_(true), file_output_(!log_file.empty()) {
+    : log_file_(log_file), level_(level), console_output_(true), file_output_(!log_file.empty()),
+      async_(false), policy_(LogOverflowPolicy::DROP), flush_interval_(100), stopping_(false),
+      wake_requested_(false), written_(0), reported_drops_(0), accepted_(0), dropped_(0), producers_(0) {
     if (file_output_) {
         file_stream_ = std::make_unique<std::ofstream>(log_file_, std::ios::app);
         if (!file_stream_->is_open()) {
@@ -28,23 +31,22 @@ Logger::Logger(const std::string& log_file, LogLevel level)
 }
 
 Logger::~Logger() {
+    stop_async();
     if (file_stream_ && file_stream_->is_open()) {
         file_stream_->close();
     }
 }
 
 void Logger::set_level(LogLevel level) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    level_ = level;
+    level_.store(level, std::memory_order_relaxed);
 }
 
 LogLevel Logger::get_level() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return level_;
+    return level_.load(std::memory_order_relaxed);
 }
 
 void Logger::log(LogLevel level, const std::string& message) {
-    if (level < level_) {
+    if (!is_enabled(level)) {
         return;
     }
     
@@ -72,16 +74,21 @@ void Logger::fatal(const std::string& message) {
 }
 
 void Logger::set_console_output(bool enable) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    console_output_ = enable;
+    console_output_.store(enable);
 }
 
 void Logger::set_file_output(bool enable) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    file_output_ = enable;
+    file_output_.store(enable);
 }
 
 void Logger::flush() {
+    if (is_async()) {
+        const uint64_t target = accepted_.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(writer_mutex_);
+        wake_requested_ = true;
+        writer_cv_.notify_one();
+        written_cv_.wait(lock, [&] { return written_ >= target || stopping_; });
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     if (file_stream_ && file_stream_->is_open()) {
         file_stream_->flush();
@@ -91,18 +98,28 @@ void Logger::flush() {
 }
 
 std::string Logger::get_timestamp() const {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
+    // The date and time only change once a second; keep them per thread so
+    // localtime_r runs once a second rather than once a line
+    thread_local std::time_t cached_second = -1;
+    thread_local char cached_text[24];
     
-    std::ostringstream oss;
-    oss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-    oss << '.' << std::setfill('0') << std::setw(3) << ms.count();
-    return oss.str();
+    const auto now = std::chrono::system_clock::now();
+    const std::time_t second = std::chrono::system_clock::to_time_t(now);
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()).count() % 1000;
+    if (second != cached_second) {
+        std::tm local{};
+        localtime_r(&second, &local);
+        std::strftime(cached_text, sizeof(cached_text), "%Y-%m-%d %H:%M:%S", &local);
+        cached_second = second;
+    }
+    
+    char text[32];
+    std::snprintf(text, sizeof(text), "%s.%03d", cached_text, static_cast<int>(ms));
+    return text;
 }
 
-std::string Logger::get_level_string(LogLevel level) const {
+const char* Logger::get_level_string(LogLevel level) const {
     switch (level) {
         case LogLevel::DEBUG: return "DEBUG";
         case LogLevel::INFO:  return "INFO ";
@@ -114,26 +131,154 @@ std::string Logger::get_level_string(LogLevel level) const {
 }
 
 void Logger::write_log(LogLevel level, const std::string& message) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    const std::string timestamp = get_timestamp();
+    const char* level_str = get_level_string(level);
+    
+    LogRecord record;
+    record.level = level;
+    record.line.reserve(timestamp.size() + message.size() + 12);
+    record.line.append("[").append(timestamp).append("] [").append(level_str).append("] ");
+    record.line.append(message).push_back('\n');
     
-    std::string timestamp = get_timestamp();
-    std::string level_str = get_level_string(level);
-    std::string log_line = "[" + timestamp + "] [" + level_str + "] " + message;
+    // stop_async() waits for producers_ to drain before it frees the queue
+    producers_.fetch_add(1);
+    if (async_.load()) {
+        enqueue(record);
+        producers_.fetch_sub(1);
+        return;
+    }
+    producers_.fetch_sub(1);
     
-    if (console_output_) {
-        if (level >= LogLevel::ERROR) {
-            std::cerr << log_line << std::endl;
-        } else {
-            std::cout << log_line << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (level >= LogLevel::ERROR) {
+        write_batch("", record.line, record.line);
+    } else {
+        write_batch(record.line, "", record.line);
+    }
+}
+
+void Logger::enqueue(LogRecord& record) {
+    while (!queue_->try_push(record)) {
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            wake_requested_ = true;
+        }
+        writer_cv_.notify_one();
+        if (policy_ == LogOverflowPolicy::DROP) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+    accepted_.fetch_add(1, std::memory_order_release);
+}
+
+void Logger::write_batch(const std::string& out, const std::string& err, const std::string& file) {
+    if (console_output_.load(std::memory_order_relaxed)) {
+        if (!out.empty()) {
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            std::cout.flush();
+        }
+        if (!err.empty()) {
+            std::cerr.write(err.data(), static_cast<std::streamsize>(err.size()));
         }
     }
     
-    if (file_output_ && file_stream_ && file_stream_->is_open()) {
-        *file_stream_ << log_line << std::endl;
+    if (!file.empty() && file_output_.load(std::memory_order_relaxed) && file_stream_ && file_stream_->is_open()) {
+        file_stream_->write(file.data(), static_cast<std::streamsize>(file.size()));
         file_stream_->flush();
     }
 }
 
+void Logger::start_async(size_t buffer_lines, std::chrono::milliseconds flush_interval, LogOverflowPolicy policy) {
+    stop_async();
+    
+    queue_ = std::make_unique<BoundedMpscQueue<LogRecord>>(buffer_lines);
+    policy_ = policy;
+    flush_interval_ = flush_interval;
+    stopping_ = false;
+    wake_requested_ = false;
+    written_ = accepted_.load();
+    writer_thread_ = std::thread(&Logger::writer_loop, this);
+    async_.store(true, std::memory_order_release);
+}
+
+void Logger::stop_async() {
+    if (!writer_thread_.joinable()) {
+        return;
+    }
+    
+    // New lines go straight to the outputs again; the writer drains the rest
+    // once no producer can still be pushing
+    async_.store(false);
+    while (producers_.load() != 0) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        stopping_ = true;
+    }
+    writer_cv_.notify_one();
+    writer_thread_.join();
+    queue_.reset();
+    written_cv_.notify_all();
+}
+
+void Logger::writer_loop() {
+    std::string out;
+    std::string err;
+    std::string file;
+    LogRecord record;
+    
+    for (;;) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(writer_mutex_);
+            writer_cv_.wait_for(lock, flush_interval_, [this] { return stopping_ || wake_requested_; });
+            wake_requested_ = false;
+            stopping = stopping_;
+        }
+        
+        uint64_t batch = 0;
+        while (queue_->try_pop(record)) {
+            ++batch;
+            if (record.level >= LogLevel::ERROR) {
+                err += record.line;
+            } else {
+                out += record.line;
+            }
+            file += record.line;
+        }
+        
+        const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_drops_) {
+            std::string notice = "[" + get_timestamp() + "] [WARN ] Log buffer full, dropped " +
+                                 std::to_string(dropped - reported_drops_) + " lines\n";
+            out += notice;
+            file += notice;
+            reported_drops_ = dropped;
+        }
+        
+        if (!file.empty()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            write_batch(out, err, file);
+            out.clear();
+            err.clear();
+            file.clear();
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            written_ += batch;
+        }
+        written_cv_.notify_all();
+        
+        if (stopping) {
+            return;
+        }
+    }
+}
+
 void init_logger(const std::string& log_file, LogLevel level) {
     g_logger = std::make_unique<Logger>(log_file, level);
 }
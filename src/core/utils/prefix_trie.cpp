@@ -0,0 +1,80 @@
+/**
+ * @file utils/prefix_trie.cpp
+ * @brief IPv4 longest-prefix-match trie implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/core/utils/prefix_trie.hpp"
+#include <arpa/inet.h>
+
+namespace simple_dhcpd {
+
+Ipv4PrefixTrie::Ipv4PrefixTrie() : size_(0) {
+    clear();
+}
+
+bool Ipv4PrefixTrie::insert(IpAddress network, uint8_t prefix_length, uint32_t value) {
+    if (prefix_length > 32) {
+        prefix_length = 32;
+    }
+
+    const uint32_t bits = ntohl(network);
+    uint32_t node = 0;
+    for (uint8_t depth = 0; depth < prefix_length; ++depth) {
+        const uint32_t bit = (bits >> (31 - depth)) & 1u;
+        if (nodes_[node].child[bit] == kNoNode) {
+            nodes_[node].child[bit] = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back(Node{{kNoNode, kNoNode}, kNoValue});
+        }
+        node = nodes_[node].child[bit];
+    }
+
+    if (nodes_[node].value != kNoValue) {
+        return false;
+    }
+    nodes_[node].value = value;
+    ++size_;
+    return true;
+}
+
+uint32_t Ipv4PrefixTrie::lookup(IpAddress address) const {
+    const uint32_t bits = ntohl(address);
+    uint32_t best = nodes_[0].value;
+    uint32_t node = 0;
+    for (int depth = 0; depth < 32; ++depth) {
+        node = nodes_[node].child[(bits >> (31 - depth)) & 1u];
+        if (node == kNoNode) {
+            break;
+        }
+        if (nodes_[node].value != kNoValue) {
+            best = nodes_[node].value;
+        }
+    }
+    return best;
+}
+
+uint32_t Ipv4PrefixTrie::find_exact(IpAddress network, uint8_t prefix_length) const {
+    if (prefix_length > 32) {
+        prefix_length = 32;
+    }
+
+    const uint32_t bits = ntohl(network);
+    uint32_t node = 0;
+    for (uint8_t depth = 0; depth < prefix_length; ++depth) {
+        node = nodes_[node].child[(bits >> (31 - depth)) & 1u];
+        if (node == kNoNode) {
+            return kNoValue;
+        }
+    }
+    return nodes_[node].value;
+}
+
+void Ipv4PrefixTrie::clear() {
+    nodes_.clear();
+    nodes_.push_back(Node{{kNoNode, kNoNode}, kNoValue});
+    size_ = 0;
+}
+
+} // namespace simple_dhcpd
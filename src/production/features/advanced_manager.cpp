@@ -8,24 +8,35 @@
 
 #include "simple-dhcpd/production/features/advanced_manager.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
-#include <iostream>
+#include "simple-dhcpd/core/utils/logger.hpp"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <random>
 #include <iomanip>
 #include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace simple_dhcpd {
 
 AdvancedLeaseManager::AdvancedLeaseManager(const DhcpConfig& config, const std::string& database_path)
-    : LeaseManager(config), database_path_(database_path), conflict_strategy_(ConflictResolutionStrategy::REJECT),
+    : LeaseManager(config), database_path_(database_path), detected_conflicts_(kConflictQueueSize),
+      history_(std::make_unique<LeaseHistory>(config.lease_history_depth, config.lease_history_file)),
+      conflict_strategy_(ConflictResolutionStrategy::REJECT),
       auto_save_interval_(std::chrono::seconds(300)), cleanup_interval_(std::chrono::seconds(60)),
-      conflict_detection_enabled_(true), auto_save_enabled_(true) {
+      conflict_detection_enabled_(true), auto_save_enabled_(true), conflict_wake_fds_{-1, -1},
+      conflict_signalled_(false), conflicts_dropped_(0), reported_conflict_drops_(0) {
     
+    if (::pipe2(conflict_wake_fds_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw LeaseManagerException("Failed to create conflict wake pipe: " + std::string(strerror(errno)));
+    }
     if (!database_path_.empty()) {
         load_database();
     }
+    observe_changes_ = true;    // after loading: restored leases are not new changes
     
     start();
 }
@@ -35,6 +46,8 @@ AdvancedLeaseManager::~AdvancedLeaseManager() {
     if (!database_path_.empty()) {
         save_database();
     }
+    ::close(conflict_wake_fds_[0]);
+    ::close(conflict_wake_fds_[1]);
 }
 
 bool AdvancedLeaseManager::add_static_lease(const StaticLease& static_lease) {
@@ -64,8 +77,8 @@ bool AdvancedLeaseManager::add_static_lease(const StaticLease& static_lease) {
     sp->is_active = true;
     add_lease(sp);
 
-    std::cout << "INFO: Added static lease: " << mac_to_string(static_lease.mac_address) <<
-                 " -> " << ip_to_string(static_lease.ip_address) << std::endl;
+    LOG_INFO("Added static lease: " << mac_to_string(static_lease.mac_address) <<
+                 " -> " << ip_to_string(static_lease.ip_address));
 
     return true;
 }
@@ -87,7 +100,7 @@ bool AdvancedLeaseManager::remove_static_lease(const MacAddress& mac_address) {
     
     static_leases_.erase(it);
     
-    std::cout << "INFO: Removed static lease: " << mac_to_string(mac_address) << std::endl;
+    LOG_INFO("Removed static lease: " << mac_to_string(mac_address));
     
     return true;
 }
@@ -126,16 +139,15 @@ bool AdvancedLeaseManager::update_static_lease(const MacAddress& mac_address, co
     *(it->second) = static_lease;
     
     // Update corresponding dynamic lease
-    auto dynamic_lease = get_lease_by_mac(mac_address);
-    if (dynamic_lease) {
-        dynamic_lease->ip_address = static_lease.ip_address;
-        dynamic_lease->hostname = static_lease.hostname;
-        dynamic_lease->lease_time = static_lease.lease_time;
-        dynamic_lease->options = static_lease.options;
-        dynamic_lease->expires_at = dynamic_lease->allocated_at + static_lease.lease_time;
-    }
+    modify_lease(mac_address, [&static_lease](DhcpLease& dynamic_lease) {
+        dynamic_lease.ip_address = static_lease.ip_address;
+        dynamic_lease.hostname = static_lease.hostname;
+        dynamic_lease.lease_time = static_lease.lease_time;
+        dynamic_lease.options = static_lease.options;
+        dynamic_lease.expires_at = dynamic_lease.allocated_at + static_lease.lease_time;
+    });
     
-    std::cout << "INFO: Updated static lease: " << mac_to_string(mac_address) << std::endl;
+    LOG_INFO("Updated static lease: " << mac_to_string(mac_address));
     
     return true;
 }
@@ -149,40 +161,38 @@ ConflictResolutionStrategy AdvancedLeaseManager::get_conflict_resolution_strateg
 }
 
 bool AdvancedLeaseManager::resolve_lease_conflict(const LeaseConflict& conflict) {
-    std::lock_guard<std::mutex> lock(conflicts_mutex_);
-    
     switch (conflict_strategy_) {
         case ConflictResolutionStrategy::REJECT:
-            std::cout << "WARNING: Lease conflict rejected: " << conflict.reason << std::endl;
+            LOG_WARN("Lease conflict rejected: " << conflict.reason);
             return false;
             
-        case ConflictResolutionStrategy::REPLACE: {
-            // Remove existing lease and allow new one
-            auto existing_lease = get_lease_by_mac(conflict.existing_mac);
-            if (existing_lease) {
-                release_lease(conflict.existing_mac, existing_lease->ip_address);
-                std::cout << "INFO: Replaced existing lease due to conflict: " << 
-                           mac_to_string(conflict.existing_mac) << std::endl;
+        case ConflictResolutionStrategy::REPLACE:
+            // Free the address for the requesting client's next attempt, unless the holder moved on
+            if (release_lease(conflict.existing_mac, conflict.ip_address)) {
+                LOG_INFO("Replaced existing lease due to conflict: " << 
+                           mac_to_string(conflict.existing_mac));
             }
             return true;
-        }
         
         case ConflictResolutionStrategy::EXTEND: {
             // Extend existing lease
-            auto existing_lease = get_lease_by_mac(conflict.existing_mac);
-            if (existing_lease) {
-                existing_lease->expires_at = std::chrono::system_clock::now() + 
-                                           std::chrono::seconds(3600); // Extend by 1 hour
-                std::cout << "INFO: Extended existing lease due to conflict: " << 
-                           mac_to_string(conflict.existing_mac) << std::endl;
+            const bool extended = modify_lease(conflict.existing_mac, [](DhcpLease& existing_lease) {
+                existing_lease.expires_at = std::chrono::system_clock::now() + 
+                                            std::chrono::seconds(3600); // Extend by 1 hour
+            });
+            if (extended) {
+                LOG_INFO("Extended existing lease due to conflict: " << 
+                           mac_to_string(conflict.existing_mac));
             }
             return false;
         }
         
-        case ConflictResolutionStrategy::NEGOTIATE:
+        case ConflictResolutionStrategy::NEGOTIATE: {
             // Add to pending conflicts for manual resolution
-            pending_conflicts_.push(conflict);
-            std::cout << "WARNING: Lease conflict queued for negotiation: " << conflict.reason << std::endl;
+            std::lock_guard<std::mutex> lock(conflicts_mutex_);
+            pending_conflicts_.push_back(conflict);
+        }
+            LOG_WARN("Lease conflict queued for negotiation: " << conflict.reason);
             return false;
     }
     
@@ -193,15 +203,13 @@ std::vector<LeaseConflict> AdvancedLeaseManager::get_pending_conflicts() {
     std::lock_guard<std::mutex> lock(conflicts_mutex_);
     
     std::vector<LeaseConflict> result;
-    while (!pending_conflicts_.empty()) {
-        result.push_back(pending_conflicts_.front());
-        pending_conflicts_.pop();
-    }
+    result.swap(pending_conflicts_);
     
     return result;
 }
 
 void AdvancedLeaseManager::set_conflict_callback(std::function<void(const LeaseConflict&)> callback) {
+    std::lock_guard<std::mutex> lock(conflicts_mutex_);
     conflict_callback_ = callback;
 }
 
@@ -229,24 +237,7 @@ DhcpLease AdvancedLeaseManager::allocate_lease_advanced(const MacAddress& mac_ad
         return lease;
     }
     
-    // Check for conflicts
-    if (conflict_detection_enabled_) {
-        auto existing_lease = get_lease_by_ip(requested_ip);
-        if (existing_lease && existing_lease->mac_address != mac_address) {
-            LeaseConflict conflict(existing_lease->mac_address, mac_address, requested_ip,
-                                 "IP address already allocated to different client");
-            
-            if (conflict_callback_) {
-                conflict_callback_(conflict);
-            }
-            
-            if (!resolve_lease_conflict(conflict)) {
-                throw LeaseManagerException("Lease conflict: " + conflict.reason);
-            }
-        }
-    }
-    
-    // Use base class allocation for dynamic leases
+    // Use base class allocation for dynamic leases; it reports a conflict through address_conflict()
     return allocate_lease(mac_address, requested_ip, subnet_name);
 }
 
@@ -276,7 +267,7 @@ void AdvancedLeaseManager::load_database() {
     
     std::ifstream file(database_path_);
     if (!file.is_open()) {
-        std::cout << "WARNING: Could not open lease database: " << database_path_ << std::endl;
+        LOG_WARN("Could not open lease database: " << database_path_);
         return;
     }
     
@@ -305,11 +296,11 @@ void AdvancedLeaseManager::load_database() {
                 static_leases_[static_lease.mac_address] = std::make_shared<StaticLease>(static_lease);
             }
         } catch (const std::exception& e) {
-            std::cout << "ERROR: Error parsing lease database line: " << line << " - " << e.what() << std::endl;
+            LOG_ERROR("Error parsing lease database line: " << line << " - " << e.what());
         }
     }
     
-    std::cout << "INFO: Loaded lease database: " << database_path_ << std::endl;
+    LOG_INFO("Loaded lease database: " << database_path_);
 }
 
 void AdvancedLeaseManager::save_database() {
@@ -321,7 +312,7 @@ void AdvancedLeaseManager::save_database() {
     
     std::ofstream file(database_path_);
     if (!file.is_open()) {
-        std::cout << "ERROR: Could not open lease database for writing: " << database_path_ << std::endl;
+        LOG_ERROR("Could not open lease database for writing: " << database_path_);
         return;
     }
     
@@ -329,9 +320,12 @@ void AdvancedLeaseManager::save_database() {
     file << "# Generated: " << std::time(nullptr) << "\n\n";
     
     // Save dynamic leases
-    auto active_leases = get_active_leases();
-    for (const auto& lease : active_leases) {
-        file << "LEASE:" << serialize_lease(*lease) << "\n";
+    LeaseCursor cursor;
+    std::vector<DhcpLease> chunk;
+    while (read_leases(cursor, chunk, kReadChunk) > 0) {
+        for (const auto& lease : chunk) {
+            file << "LEASE:" << serialize_lease(lease) << "\n";
+        }
     }
     
     // Save static leases
@@ -340,7 +334,7 @@ void AdvancedLeaseManager::save_database() {
         file << "STATIC:" << serialize_static_lease(*pair.second) << "\n";
     }
     
-    std::cout << "INFO: Saved lease database: " << database_path_ << std::endl;
+    LOG_INFO("Saved lease database: " << database_path_);
 }
 
 bool AdvancedLeaseManager::backup_database(const std::string& backup_path) {
@@ -354,10 +348,10 @@ bool AdvancedLeaseManager::backup_database(const std::string& backup_path) {
         
         dest << source.rdbuf();
         
-        std::cout << "INFO: Database backup created: " << backup_path << std::endl;
+        LOG_INFO("Database backup created: " << backup_path);
         return true;
     } catch (const std::exception& e) {
-        std::cout << "ERROR: Database backup failed: " << e.what() << std::endl;
+        LOG_ERROR("Database backup failed: " << e.what());
         return false;
     }
 }
@@ -372,10 +366,10 @@ bool AdvancedLeaseManager::restore_database(const std::string& backup_path) {
         // Reload database
         load_database();
         
-        std::cout << "INFO: Database restored from: " << backup_path << std::endl;
+        LOG_INFO("Database restored from: " << backup_path);
         return true;
     } catch (const std::exception& e) {
-        std::cout << "ERROR: Database restore failed: " << e.what() << std::endl;
+        LOG_ERROR("Database restore failed: " << e.what());
         return false;
     }
 }
@@ -384,19 +378,26 @@ bool AdvancedLeaseManager::compact_database() {
     // Remove expired leases and clean up database
     cleanup_expired_leases();
     
+    // Fold the lease journal into its snapshot
+    try {
+        compact_journal();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Journal compaction failed: " << e.what());
+        return false;
+    }
+    
     // Save cleaned database
     save_database();
     
-    std::cout << "INFO: Database compacted" << std::endl;
+    LOG_INFO("Database compacted");
     return true;
 }
 
 LeaseDatabaseStats AdvancedLeaseManager::get_database_statistics() const {
     LeaseDatabaseStats stats;
     
-    auto active_leases = get_active_leases();
-    stats.total_leases = active_leases.size();
-    stats.active_leases = active_leases.size();
+    stats.total_leases = active_lease_count();
+    stats.active_leases = stats.total_leases;
     
     std::lock_guard<std::mutex> static_lock(static_leases_mutex_);
     stats.static_leases = static_leases_.size();
@@ -420,22 +421,15 @@ LeaseDatabaseStats AdvancedLeaseManager::get_database_statistics() const {
 std::map<std::string, double> AdvancedLeaseManager::get_subnet_utilization() {
     std::map<std::string, double> utilization;
     
-    for (const auto& subnet : config_.subnets) {
-        utilization[subnet.name] = calculate_subnet_utilization(subnet);
+    for (const auto& usage : get_pool_usage()) {
+        utilization[usage.subnet_name] = calculate_subnet_utilization(usage);
     }
     
     return utilization;
 }
 
-std::vector<DhcpLease> AdvancedLeaseManager::get_lease_history(IpAddress ip_address) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = lease_history_.find(ip_address);
-    if (it != lease_history_.end()) {
-        return it->second;
-    }
-    
-    return {};
+std::vector<LeaseHistoryRecord> AdvancedLeaseManager::get_lease_history(IpAddress ip_address) {
+    return history_->get(ip_address);
 }
 
 std::vector<std::shared_ptr<DhcpLease>> AdvancedLeaseManager::get_leases_expiring_soon(std::chrono::seconds time_window) {
@@ -444,10 +438,13 @@ std::vector<std::shared_ptr<DhcpLease>> AdvancedLeaseManager::get_leases_expirin
     
     std::vector<std::shared_ptr<DhcpLease>> expiring_leases;
     
-    auto active_leases = get_active_leases();
-    for (const auto& lease : active_leases) {
-        if (lease->expires_at <= expiration_threshold) {
-            expiring_leases.push_back(lease);
+    LeaseCursor cursor;
+    std::vector<DhcpLease> chunk;
+    while (read_leases(cursor, chunk, kReadChunk) > 0) {
+        for (auto& lease : chunk) {
+            if (lease.expires_at <= expiration_threshold) {
+                expiring_leases.push_back(std::make_shared<DhcpLease>(std::move(lease)));
+            }
         }
     }
     
@@ -482,78 +479,82 @@ void AdvancedLeaseManager::set_conflict_detection_enabled(bool enabled) {
     conflict_detection_enabled_ = enabled;
 }
 
-void AdvancedLeaseManager::auto_save_worker() {
-    while (running_ && auto_save_enabled_) {
-        std::this_thread::sleep_for(auto_save_interval_);
-        
-        if (running_ && auto_save_enabled_) {
-            save_database();
-        }
+void AdvancedLeaseManager::schedule_maintenance() {
+    LeaseManager::schedule_maintenance();
+    if (auto_save_enabled_ && !database_path_.empty()) {
+        add_maintenance_timer(auto_save_interval_, [this]() { auto_save_tick(); });
     }
+    add_maintenance_timer(cleanup_interval_, [this]() { enhanced_cleanup_tick(); });
+    add_maintenance_watch(conflict_wake_fds_[0], [this]() { drain_conflicts(); });
 }
 
-void AdvancedLeaseManager::enhanced_cleanup_worker() {
-    while (running_) {
-        std::this_thread::sleep_for(cleanup_interval_);
-        
-        if (running_) {
-            cleanup_expired_leases();
-            
-            // Clean up old conflict history
-            std::lock_guard<std::mutex> lock(conflicts_mutex_);
-            auto cutoff_time = std::chrono::system_clock::now() - std::chrono::hours(24);
-            conflict_history_.erase(
-                std::remove_if(conflict_history_.begin(), conflict_history_.end(),
-                    [cutoff_time](const LeaseConflict& conflict) {
-                        return conflict.conflict_time < cutoff_time;
-                    }),
-                conflict_history_.end());
-        }
+void AdvancedLeaseManager::auto_save_tick() {
+    if (auto_save_enabled_) {
+        save_database();
     }
 }
 
-void AdvancedLeaseManager::conflict_resolution_worker() {
-    while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        
-        if (running_) {
-            std::vector<LeaseConflict> pending;
-            {
-                std::lock_guard<std::mutex> lock(conflicts_mutex_);
-                while (!pending_conflicts_.empty()) {
-                    pending.push_back(pending_conflicts_.front());
-                    pending_conflicts_.pop();
-                }
-            }
-            
-            for (const auto& conflict : pending) {
-                // Auto-resolve conflicts based on strategy
-                if (conflict_strategy_ == ConflictResolutionStrategy::NEGOTIATE) {
-                    // For now, just log and add to history
-                    std::cout << "WARNING: Unresolved conflict: " << conflict.reason << std::endl;
-                }
-                
-                std::lock_guard<std::mutex> lock(conflicts_mutex_);
-                conflict_history_.push_back(conflict);
-            }
+void AdvancedLeaseManager::enhanced_cleanup_tick() {
+    cleanup_expired_leases();
+    history_->flush();
+    
+    // Clean up old conflict history
+    std::lock_guard<std::mutex> lock(conflicts_mutex_);
+    auto cutoff_time = std::chrono::system_clock::now() - std::chrono::hours(24);
+    conflict_history_.erase(
+        std::remove_if(conflict_history_.begin(), conflict_history_.end(),
+            [cutoff_time](const LeaseConflict& conflict) {
+                return conflict.conflict_time < cutoff_time;
+            }),
+        conflict_history_.end());
+}
+
+void AdvancedLeaseManager::address_conflict(const MacAddress& holder, const MacAddress& requester,
+                                            IpAddress ip_address) {
+    if (!conflict_detection_enabled_) {
+        return;
+    }
+    LeaseConflict conflict(holder, requester, ip_address, "IP address already allocated to different client");
+    conflict.resolution = conflict_strategy_;
+    if (!detected_conflicts_.try_push(conflict)) {
+        conflicts_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // One wake byte per drain; the drain clears the flag before it pops
+    if (!conflict_signalled_.exchange(true)) {
+        const char byte = 1;
+        while (::write(conflict_wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
         }
     }
 }
 
-bool AdvancedLeaseManager::detect_conflicts(const DhcpLease& lease) {
-    // Check for IP conflicts
-    auto existing_lease = get_lease_by_ip(lease.ip_address);
-    if (existing_lease && existing_lease->mac_address != lease.mac_address) {
-        return true;
+void AdvancedLeaseManager::drain_conflicts() {
+    char drain[64];
+    while (::read(conflict_wake_fds_[0], drain, sizeof(drain)) > 0) {
     }
+    conflict_signalled_.store(false);
     
-    // Check for MAC conflicts
-    auto existing_mac_lease = get_lease_by_mac(lease.mac_address);
-    if (existing_mac_lease && existing_mac_lease->ip_address != lease.ip_address) {
-        return true;
+    std::function<void(const LeaseConflict&)> callback;
+    {
+        std::lock_guard<std::mutex> lock(conflicts_mutex_);
+        callback = conflict_callback_;
+    }
+    LeaseConflict conflict;
+    while (detected_conflicts_.try_pop(conflict)) {
+        if (callback) {
+            callback(conflict);
+        }
+        resolve_lease_conflict(conflict);
+        
+        std::lock_guard<std::mutex> lock(conflicts_mutex_);
+        conflict_history_.push_back(conflict);
     }
     
-    return false;
+    const uint64_t dropped = conflicts_dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_conflict_drops_) {
+        LOG_WARN("Lease conflict queue full, " << (dropped - reported_conflict_drops_) << " conflicts not resolved");
+        reported_conflict_drops_ = dropped;
+    }
 }
 
 IpAddress AdvancedLeaseManager::find_best_available_ip(const DhcpSubnet& subnet, IpAddress preferred_ip) {
@@ -565,32 +566,16 @@ IpAddress AdvancedLeaseManager::find_best_available_ip(const DhcpSubnet& subnet,
     return find_available_ip(subnet);
 }
 
-double AdvancedLeaseManager::calculate_subnet_utilization(const DhcpSubnet& subnet) {
-    auto subnet_leases = get_leases_for_subnet(subnet.name);
-    
-    // Calculate total available IPs in subnet
-    uint32_t total_ips = subnet.range_end - subnet.range_start + 1;
-    
-    // Subtract excluded ranges
-    for (const auto& range : subnet.exclusions) {
-        total_ips -= (range.second - range.first + 1);
-    }
-    
-    if (total_ips == 0) {
+double AdvancedLeaseManager::calculate_subnet_utilization(const PoolUsage& usage) {
+    if (usage.addresses == 0) {
         return 0.0;
     }
     
-    return (double)subnet_leases.size() / total_ips * 100.0;
+    return (double)(usage.addresses - usage.free) / usage.addresses * 100.0;
 }
 
-void AdvancedLeaseManager::add_to_history(const DhcpLease& lease) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    lease_history_[lease.ip_address].push_back(lease);
-    
-    // Keep only last 10 entries per IP
-    if (lease_history_[lease.ip_address].size() > 10) {
-        lease_history_[lease.ip_address].erase(lease_history_[lease.ip_address].begin());
-    }
+void AdvancedLeaseManager::lease_changed(JournalOp op, const DhcpLease& lease) {
+    history_->record(op, lease);
 }
 
 std::string AdvancedLeaseManager::serialize_lease(const DhcpLease& lease) {
@@ -0,0 +1,283 @@
+/**
+ * @file production/security/event_log.cpp
+ * @brief Security event history and dispatcher implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/production/security/event_log.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include <algorithm>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr std::chrono::milliseconds kDeliveryInterval(100);
+
+const char* level_name(ThreatLevel level) {
+    switch (level) {
+        case ThreatLevel::LOW: return "LOW";
+        case ThreatLevel::MEDIUM: return "MEDIUM";
+        case ThreatLevel::HIGH: return "HIGH";
+        case ThreatLevel::CRITICAL: return "CRITICAL";
+    }
+    return "UNKNOWN";
+}
+
+bool same_event(const SecurityEvent& a, const SecurityEvent& b) {
+    return a.level == b.level && a.description == b.description && a.client_mac == b.client_mac &&
+           a.client_ip == b.client_ip && a.source_interface == b.source_interface;
+}
+}
+
+SecurityEventLog::SecurityEventLog(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)), head_(0), overwritten_(0) {
+}
+
+void SecurityEventLog::append(const SecurityEvent& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t position;
+    if (events_.size() < capacity_) {
+        events_.push_back(event);
+        position = events_.size() - 1;
+    } else {
+        events_[head_] = event;
+        head_ = (head_ + 1) % capacity_;
+        ++overwritten_;
+        position = capacity_ - 1;
+    }
+    // Late arrivals are only a few positions out of place
+    while (position > 0 && events_[slot(position - 1)].timestamp > events_[slot(position)].timestamp) {
+        std::swap(events_[slot(position - 1)], events_[slot(position)]);
+        --position;
+    }
+}
+
+size_t SecurityEventLog::bound(std::chrono::system_clock::time_point time, bool upper) const {
+    size_t low = 0;
+    size_t high = events_.size();
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        const auto timestamp = events_[slot(middle)].timestamp;
+        if (upper ? timestamp <= time : timestamp < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+std::vector<SecurityEvent> SecurityEventLog::query(std::chrono::system_clock::time_point start_time,
+                                                   std::chrono::system_clock::time_point end_time,
+                                                   SecurityEventType event_type) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<SecurityEvent> result;
+    if (events_.empty() || start_time > end_time) {
+        return result;
+    }
+    const size_t first = bound(start_time, false);
+    const size_t last = bound(end_time, true);
+    if (event_type == SecurityEventType::ANY) {
+        result.reserve(last - first);
+    }
+    for (size_t position = first; position < last; ++position) {
+        const SecurityEvent& event = events_[slot(position)];
+        if (event_type == SecurityEventType::ANY || event.type == event_type) {
+            result.push_back(event);
+        }
+    }
+    return result;
+}
+
+void SecurityEventLog::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    head_ = 0;
+}
+
+size_t SecurityEventLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_.size();
+}
+
+uint64_t SecurityEventLog::overwritten() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return overwritten_;
+}
+
+SecurityEventDispatcher::SecurityEventDispatcher(size_t queue_size, std::chrono::milliseconds coalesce_window)
+    : queue_(queue_size), coalesce_window_(coalesce_window), running_(false), producers_(0),
+      stopping_(false), wake_requested_(false), flush_requested_(false), delivered_(0),
+      accepted_(0), dropped_(0), coalesced_(0) {
+}
+
+SecurityEventDispatcher::~SecurityEventDispatcher() {
+    stop();
+}
+
+void SecurityEventDispatcher::set_callback(Callback callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    callback_ = std::move(callback);
+}
+
+void SecurityEventDispatcher::post(const SecurityEvent& event) {
+    // stop() waits for producers_ to drain before the thread exits
+    producers_.fetch_add(1);
+    if (running_.load()) {
+        auto pending = std::make_unique<SecurityEvent>(event);
+        if (queue_.try_push(pending)) {
+            accepted_.fetch_add(1, std::memory_order_release);
+        } else {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        producers_.fetch_sub(1);
+        return;
+    }
+    producers_.fetch_sub(1);
+    deliver(event);
+}
+
+void SecurityEventDispatcher::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+        wake_requested_ = false;
+        flush_requested_ = false;
+        delivered_ = accepted_.load();
+    }
+    thread_ = std::thread(&SecurityEventDispatcher::run, this);
+    running_.store(true);
+}
+
+void SecurityEventDispatcher::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    running_.store(false);
+    while (producers_.load() != 0) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+    delivered_cv_.notify_all();
+}
+
+void SecurityEventDispatcher::flush() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    const uint64_t target = accepted_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex_);
+    flush_requested_ = true;
+    wake_requested_ = true;
+    wake_cv_.notify_one();
+    delivered_cv_.wait(lock, [this, target] {
+        return (delivered_ >= target && !flush_requested_) || stopping_;
+    });
+}
+
+void SecurityEventDispatcher::run() {
+    uint64_t reported_drops = dropped_.load(std::memory_order_relaxed);
+    std::unique_ptr<SecurityEvent> event;
+    const auto interval = std::min(coalesce_window_, kDeliveryInterval);
+
+    for (;;) {
+        bool stopping;
+        bool flushing;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_cv_.wait_for(lock, interval, [this] { return stopping_ || wake_requested_; });
+            wake_requested_ = false;
+            stopping = stopping_;
+            flushing = flush_requested_;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        uint64_t batch = 0;
+        while (queue_.try_pop(event)) {
+            ++batch;
+            dispatch(std::move(event), now);
+        }
+        close_windows(now, stopping || flushing);
+
+        const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_drops) {
+            LOG_WARN("Security event queue full, " << (dropped - reported_drops) << " events not delivered");
+            reported_drops = dropped;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            delivered_ += batch;
+            if (flushing) {
+                flush_requested_ = false;
+            }
+        }
+        delivered_cv_.notify_all();
+
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+void SecurityEventDispatcher::dispatch(std::unique_ptr<SecurityEvent> event,
+                                       std::chrono::steady_clock::time_point now) {
+    const size_t type = static_cast<size_t>(event->type);
+    if (type >= kEventTypes) {
+        deliver(*event);
+        return;
+    }
+    Repeats& repeats = repeats_[type];
+    if (repeats.last && now - repeats.since < coalesce_window_ && same_event(*repeats.last, *event)) {
+        ++repeats.count;
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    close_window(repeats);
+    deliver(*event);
+    repeats.last = std::move(event);
+    repeats.since = now;
+    repeats.count = 0;
+}
+
+void SecurityEventDispatcher::close_windows(std::chrono::steady_clock::time_point now, bool force) {
+    for (Repeats& repeats : repeats_) {
+        if (repeats.last && (force || now - repeats.since >= coalesce_window_)) {
+            close_window(repeats);
+        }
+    }
+}
+
+void SecurityEventDispatcher::close_window(Repeats& repeats) {
+    if (repeats.last && repeats.count > 0) {
+        SecurityEvent summary = *repeats.last;
+        summary.description += " (repeated " + std::to_string(repeats.count) + " times)";
+        summary.additional_data["repeat_count"] = std::to_string(repeats.count);
+        summary.timestamp = std::chrono::system_clock::now();
+        deliver(summary);
+    }
+    repeats.last.reset();
+    repeats.count = 0;
+}
+
+void SecurityEventDispatcher::deliver(const SecurityEvent& event) {
+    {
+        std::lock_guard<std::mutex> lock(callback_mutex_);
+        if (callback_) {
+            callback_(event);
+        }
+    }
+    LOG_WARN("Security Event [" << level_name(event.level) << "]: " << event.description);
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,298 @@
+/**
+ * @file production/security/filter_table.cpp
+ * @brief Compiled MAC and IP filter rules implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/production/security/filter_table.hpp"
+#include "simple-dhcpd/production/security/manager.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <map>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr size_t kMacNibbles = 12;
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Lowercase, without ':' and '-', as the rules have always been compared
+std::string normalize(const std::string& text) {
+    std::string normalized;
+    normalized.reserve(text.size());
+    for (char c : text) {
+        if (c == ':' || c == '-') {
+            continue;
+        }
+        normalized.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+    }
+    return normalized;
+}
+
+uint64_t mac_value(const MacAddress& mac_address) {
+    uint64_t value = 0;
+    for (uint8_t byte : mac_address) {
+        value = (value << 8) | byte;
+    }
+    return value;
+}
+
+void mac_text(const MacAddress& mac_address, char* text) {
+    for (size_t i = 0; i < mac_address.size(); ++i) {
+        text[2 * i] = kHexDigits[mac_address[i] >> 4];
+        text[2 * i + 1] = kHexDigits[mac_address[i] & 0x0F];
+    }
+    text[kMacNibbles] = '\0';
+}
+
+// '*' matches any run, '?' any one character
+bool glob_match(const char* pattern, const char* text) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*text) {
+        if (*pattern == '?' || *pattern == *text) {
+            ++pattern;
+            ++text;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = text;
+        } else if (star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        ++pattern;
+    }
+    return *pattern == '\0';
+}
+
+bool is_hex(const std::string& text, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        if (hex_value(text[i]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t hex_prefix(const std::string& text, size_t nibbles) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < nibbles; ++i) {
+        value = (value << 4) | static_cast<uint64_t>(hex_value(text[i]));
+    }
+    return value;
+}
+
+bool expired(bool expires, std::chrono::system_clock::time_point expires_at,
+             std::chrono::system_clock::time_point now) {
+    return expires && expires_at < now;
+}
+
+FilterMatch verdict(bool allow) {
+    return allow ? FilterMatch::ALLOW : FilterMatch::DENY;
+}
+}
+
+MacFilterTable::MacFilterTable(const std::vector<MacFilterRule>& rules) {
+    for (const auto& source : rules) {
+        if (!source.enabled) {
+            continue;
+        }
+        const uint32_t position = static_cast<uint32_t>(rules_.size());
+        Rule rule;
+        rule.allow = source.allow;
+        rule.expires = source.expires != std::chrono::system_clock::time_point::max();
+        rule.expires_at = source.expires;
+        rule.pattern = normalize(source.mac_address);
+        any_expiry_ = any_expiry_ || rule.expires;
+
+        const std::string& pattern = rule.pattern;
+        if (pattern.size() == kMacNibbles && is_hex(pattern, 0, kMacNibbles)) {
+            exact_.emplace(hex_prefix(pattern, kMacNibbles), position);
+        } else if (!pattern.empty() && pattern.back() == '*' && pattern.size() - 1 <= kMacNibbles &&
+                   is_hex(pattern, 0, pattern.size() - 1)) {
+            const uint32_t nibbles = static_cast<uint32_t>(pattern.size() - 1);
+            auto it = std::find_if(prefixes_.begin(), prefixes_.end(),
+                                   [nibbles](const PrefixMap& map) { return map.nibbles == nibbles; });
+            if (it == prefixes_.end()) {
+                prefixes_.push_back(PrefixMap{nibbles, {}});
+                it = std::prev(prefixes_.end());
+            }
+            it->rules.emplace(hex_prefix(pattern, nibbles), position);
+        } else {
+            globs_.push_back(position);
+        }
+        rules_.push_back(std::move(rule));
+    }
+}
+
+bool MacFilterTable::parse(const std::string& text, MacAddress& mac_address) {
+    size_t nibbles = 0;
+    uint64_t value = 0;
+    for (char c : text) {
+        if (c == ':' || c == '-') {
+            continue;
+        }
+        const int digit = hex_value(c);
+        if (digit < 0 || nibbles == kMacNibbles) {
+            return false;
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit);
+        ++nibbles;
+    }
+    if (nibbles != kMacNibbles) {
+        return false;
+    }
+    for (size_t i = mac_address.size(); i-- > 0; value >>= 8) {
+        mac_address[i] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+FilterMatch MacFilterTable::match(const MacAddress& mac_address) const {
+    if (rules_.empty()) {
+        return FilterMatch::NONE;
+    }
+    const uint64_t address = mac_value(mac_address);
+    uint32_t best = kNoRule;
+    auto it = exact_.find(address);
+    if (it != exact_.end()) {
+        best = it->second;
+    }
+    for (const auto& map : prefixes_) {
+        auto prefix = map.rules.find(map.nibbles == 0 ? 0 : address >> (4 * (kMacNibbles - map.nibbles)));
+        if (prefix != map.rules.end()) {
+            best = std::min(best, prefix->second);
+        }
+    }
+    if (!globs_.empty() && globs_.front() < best) {
+        char text[kMacNibbles + 1];
+        mac_text(mac_address, text);
+        for (uint32_t position : globs_) {
+            if (position >= best) {
+                break;
+            }
+            if (glob_match(rules_[position].pattern.c_str(), text)) {
+                best = position;
+                break;
+            }
+        }
+    }
+    if (best == kNoRule) {
+        return FilterMatch::NONE;
+    }
+
+    const Rule& rule = rules_[best];
+    if (any_expiry_ && expired(rule.expires, rule.expires_at, std::chrono::system_clock::now())) {
+        // Not swept yet: fall back to the rule-by-rule order
+        char text[kMacNibbles + 1];
+        mac_text(mac_address, text);
+        return scan(text);
+    }
+    return verdict(rule.allow);
+}
+
+FilterMatch MacFilterTable::match_text(const std::string& text) const {
+    if (rules_.empty()) {
+        return FilterMatch::NONE;
+    }
+    return scan(normalize(text));
+}
+
+FilterMatch MacFilterTable::scan(const std::string& text) const {
+    const auto now = std::chrono::system_clock::now();
+    for (const auto& rule : rules_) {
+        if (!expired(rule.expires, rule.expires_at, now) && glob_match(rule.pattern.c_str(), text.c_str())) {
+            return verdict(rule.allow);
+        }
+    }
+    return FilterMatch::NONE;
+}
+
+IpFilterTable::IpFilterTable(const std::vector<IpFilterRule>& rules) {
+    // First position for each distinct prefix, shortest prefixes first
+    std::map<std::pair<uint8_t, IpAddress>, uint32_t> prefixes;
+    for (const auto& source : rules) {
+        if (!source.enabled) {
+            continue;
+        }
+        const uint32_t position = static_cast<uint32_t>(rules_.size());
+        Rule rule{source.ip_address, source.ip_mask, source.allow,
+                  source.expires != std::chrono::system_clock::time_point::max(), source.expires};
+        any_expiry_ = any_expiry_ || rule.expires;
+        rules_.push_back(rule);
+
+        const uint32_t mask = rule.mask == 0 ? 0xFFFFFFFFu : ntohl(rule.mask);
+        const uint32_t host_bits = ~mask;
+        if ((host_bits & (host_bits + 1)) != 0) {
+            masked_.push_back(position);
+            continue;
+        }
+        const uint8_t prefix_length = static_cast<uint8_t>(__builtin_popcount(mask));
+        const IpAddress network = rule.address & htonl(mask);
+        prefixes.emplace(std::make_pair(prefix_length, network), position);
+    }
+
+    for (const auto& entry : prefixes) {
+        // Every shorter prefix containing this one is already in the trie,
+        // and the deepest of them carries the lowest position on its path
+        const uint32_t ancestor = trie_.lookup(entry.first.second);
+        trie_.insert(entry.first.second, entry.first.first, std::min(entry.second, ancestor));
+    }
+}
+
+FilterMatch IpFilterTable::match(IpAddress ip_address) const {
+    if (rules_.empty()) {
+        return FilterMatch::NONE;
+    }
+    uint32_t best = trie_.lookup(ip_address);
+    for (uint32_t position : masked_) {
+        if (position >= best) {
+            break;
+        }
+        const Rule& rule = rules_[position];
+        if ((ip_address & rule.mask) == (rule.address & rule.mask)) {
+            best = position;
+            break;
+        }
+    }
+    if (best == Ipv4PrefixTrie::kNoValue) {
+        return FilterMatch::NONE;
+    }
+
+    const Rule& rule = rules_[best];
+    if (any_expiry_ && expired(rule.expires, rule.expires_at, std::chrono::system_clock::now())) {
+        return scan(ip_address);
+    }
+    return verdict(rule.allow);
+}
+
+FilterMatch IpFilterTable::scan(IpAddress ip_address) const {
+    const auto now = std::chrono::system_clock::now();
+    for (const auto& rule : rules_) {
+        if (expired(rule.expires, rule.expires_at, now)) {
+            continue;
+        }
+        const bool matches = rule.mask != 0 ? (ip_address & rule.mask) == (rule.address & rule.mask)
+                                            : ip_address == rule.address;
+        if (matches) {
+            return verdict(rule.allow);
+        }
+    }
+    return FilterMatch::NONE;
+}
+
+} // namespace simple_dhcpd
@@ -8,20 +8,56 @@
 
 #include "simple-dhcpd/production/security/manager.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
-#include <iostream>
+#include "simple-dhcpd/core/utils/logger.hpp"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
-#include <regex>
 #include <openssl/sha.h>
 #include <openssl/hmac.h>
 #include <json/json.h>
 
 namespace simple_dhcpd {
 
+namespace {
+enum class StatKind { NEUTRAL, ALLOWED, BLOCKED };
+
+struct StatInfo {
+    const char* name;
+    StatKind kind;      // counted into allowed_requests or blocked_requests
+    bool logged;        // worth a warning each time
+};
+
+// Indexed by SecurityCounter, up to the first event counter
+const StatInfo kStatInfo[] = {
+    {"mac_allowed", StatKind::ALLOWED, false},
+    {"mac_blocked", StatKind::BLOCKED, true},
+    {"ip_allowed", StatKind::ALLOWED, false},
+    {"ip_blocked", StatKind::BLOCKED, true},
+    {"rate_limit_allowed", StatKind::ALLOWED, false},
+    {"rate_limit_blocked", StatKind::BLOCKED, true},
+    {"rate_limit_exceeded", StatKind::BLOCKED, true},
+    {"option_82_allowed", StatKind::ALLOWED, false},
+    {"option_82_valid", StatKind::NEUTRAL, false},
+    {"option_82_missing", StatKind::NEUTRAL, false},
+    {"option_82_invalid", StatKind::BLOCKED, false},
+    {"option_82_incomplete", StatKind::NEUTRAL, false},
+    {"auth_success", StatKind::NEUTRAL, false},
+    {"auth_failed", StatKind::NEUTRAL, false},
+    {"auth_client_not_found", StatKind::NEUTRAL, false},
+    {"auth_client_disabled", StatKind::NEUTRAL, false},
+    {"auth_client_expired", StatKind::NEUTRAL, false},
+    {"auth_data_missing", StatKind::NEUTRAL, false},
+};
+constexpr size_t kCountedStats = sizeof(kStatInfo) / sizeof(kStatInfo[0]);
+}
+
 DhcpSecurityManager::DhcpSecurityManager() 
     : dhcp_snooping_enabled_(false), option_82_validation_enabled_(false),
-      authentication_enabled_(false), running_(false) {
+      authentication_enabled_(false), running_(false),
+      stats_reset_time_(std::chrono::system_clock::now()),
+      mac_filter_table_(std::make_shared<MacFilterTable>()),
+      ip_filter_table_(std::make_shared<IpFilterTable>()),
+      relay_table_(std::make_shared<RelayAgentTable>()) {
 }
 
 DhcpSecurityManager::~DhcpSecurityManager() {
@@ -30,7 +66,7 @@ DhcpSecurityManager::~DhcpSecurityManager() {
 
 void DhcpSecurityManager::set_dhcp_snooping_enabled(bool enabled) {
     dhcp_snooping_enabled_ = enabled;
-    std::cout << "INFO: DHCP snooping " << (enabled ? "enabled" : "disabled") << std::endl;
+    LOG_INFO("DHCP snooping " << (enabled ? "enabled" : "disabled"));
 }
 
 bool DhcpSecurityManager::is_dhcp_snooping_enabled() const {
@@ -40,13 +76,13 @@ bool DhcpSecurityManager::is_dhcp_snooping_enabled() const {
 void DhcpSecurityManager::add_trusted_interface(const std::string& interface_name) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     trusted_interfaces_.insert(interface_name);
-    std::cout << "INFO: Added trusted interface: " << interface_name << std::endl;
+    LOG_INFO("Added trusted interface: " << interface_name);
 }
 
 void DhcpSecurityManager::remove_trusted_interface(const std::string& interface_name) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     trusted_interfaces_.erase(interface_name);
-    std::cout << "INFO: Removed trusted interface: " << interface_name << std::endl;
+    LOG_INFO("Removed trusted interface: " << interface_name);
 }
 
 bool DhcpSecurityManager::is_interface_trusted(const std::string& interface_name) const {
@@ -55,23 +91,46 @@ bool DhcpSecurityManager::is_interface_trusted(const std::string& interface_name
 }
 
 void DhcpSecurityManager::add_snooping_binding(const DhcpSnoopingBinding& binding) {
+    SnoopingKey key{{}, binding.ip_address};
+    if (!MacFilterTable::parse(binding.mac_address, key.mac_address)) {
+        LOG_WARN("Ignoring snooping binding with invalid MAC address: " << binding.mac_address);
+        return;
+    }
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    snooping_bindings_.push_back(binding);
-    std::cout << "INFO: Added snooping binding: " << binding.mac_address << " -> " << 
-                 ip_to_string(binding.ip_address) << " on " << binding.interface << std::endl;
+    const auto inserted = snooping_index_.emplace(key, snooping_bindings_.size());
+    if (inserted.second) {
+        snooping_bindings_.push_back(binding);
+    } else {
+        snooping_bindings_[inserted.first->second] = binding;
+    }
+    LOG_INFO("Added snooping binding: " << binding.mac_address << " -> " << 
+                 ip_to_string(binding.ip_address) << " on " << binding.interface);
 }
 
 void DhcpSecurityManager::remove_snooping_binding(const std::string& mac_address, const IpAddress& ip_address) {
+    SnoopingKey key{{}, ip_address};
+    if (!MacFilterTable::parse(mac_address, key.mac_address)) {
+        return;
+    }
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     
-    snooping_bindings_.erase(
-        std::remove_if(snooping_bindings_.begin(), snooping_bindings_.end(),
-            [&](const DhcpSnoopingBinding& binding) {
-                return binding.mac_address == mac_address && binding.ip_address == ip_address;
-            }),
-        snooping_bindings_.end());
+    const auto it = snooping_index_.find(key);
+    if (it == snooping_index_.end()) {
+        return;
+    }
+    // Move the last binding into the gap
+    const size_t position = it->second;
+    snooping_index_.erase(it);
+    if (position + 1 != snooping_bindings_.size()) {
+        DhcpSnoopingBinding& moved = snooping_bindings_.back();
+        SnoopingKey moved_key{{}, moved.ip_address};
+        MacFilterTable::parse(moved.mac_address, moved_key.mac_address);
+        snooping_index_[moved_key] = position;
+        snooping_bindings_[position] = std::move(moved);
+    }
+    snooping_bindings_.pop_back();
     
-    std::cout << "INFO: Removed snooping binding: " << mac_address << " -> " << ip_to_string(ip_address) << std::endl;
+    LOG_INFO("Removed snooping binding: " << mac_address << " -> " << ip_to_string(ip_address));
 }
 
 std::vector<DhcpSnoopingBinding> DhcpSecurityManager::get_snooping_bindings() {
@@ -96,19 +155,17 @@ bool DhcpSecurityManager::validate_dhcp_message(const DhcpMessage& message, cons
     
     // Validate against snooping bindings
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    for (const auto& binding : snooping_bindings_) {
-        if (binding.mac_address == mac_to_string(message.client_mac) && 
-            binding.ip_address == message.client_ip) {
-            // Ensure binding's learned interface matches the source interface
-            if (binding.interface == source_interface) {
+    const auto it = snooping_index_.find(SnoopingKey{message.client_mac, message.client_ip});
+    if (it != snooping_index_.end()) {
+        // Ensure binding's learned interface matches the source interface
+        if (snooping_bindings_[it->second].interface == source_interface) {
             return true;
-            }
-            report_security_event(SecurityEvent(SecurityEventType::SUSPICIOUS_ACTIVITY, ThreatLevel::MEDIUM,
-                                                "Snooping binding interface mismatch",
-                                                mac_to_string(message.client_mac),
-                                                ip_to_string(message.client_ip), source_interface));
-            return false;
         }
+        report_security_event(SecurityEvent(SecurityEventType::SUSPICIOUS_ACTIVITY, ThreatLevel::MEDIUM,
+                                            "Snooping binding interface mismatch",
+                                            mac_to_string(message.client_mac),
+                                            ip_to_string(message.client_ip), source_interface));
+        return false;
     }
     
     // Classify event based on message type
@@ -130,8 +187,9 @@ bool DhcpSecurityManager::validate_dhcp_message(const DhcpMessage& message, cons
 void DhcpSecurityManager::add_mac_filter_rule(const MacFilterRule& rule) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     mac_filter_rules_.push_back(rule);
-    std::cout << "INFO: Added MAC filter rule: " << rule.mac_address << " (" << 
-                 (rule.allow ? "allow" : "deny") << ")" << std::endl;
+    rebuild_filter_tables();
+    LOG_INFO("Added MAC filter rule: " << rule.mac_address << " (" << 
+                 (rule.allow ? "allow" : "deny") << ")");
 }
 
 void DhcpSecurityManager::remove_mac_filter_rule(const std::string& mac_address) {
@@ -143,32 +201,35 @@ void DhcpSecurityManager::remove_mac_filter_rule(const std::string& mac_address)
                 return rule.mac_address == mac_address;
             }),
         mac_filter_rules_.end());
+    rebuild_filter_tables();
     
-    std::cout << "INFO: Removed MAC filter rule: " << mac_address << std::endl;
+    LOG_INFO("Removed MAC filter rule: " << mac_address);
 }
 
-bool DhcpSecurityManager::check_mac_address(const std::string& mac_address) {
+void DhcpSecurityManager::set_mac_filter_rules(const std::vector<MacFilterRule>& rules) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    for (const auto& rule : mac_filter_rules_) {
-        if (!rule.enabled) {
-            continue;
-        }
-        
-        // Check if rule has expired
-        if (rule.expires < std::chrono::system_clock::now()) {
-            continue;
-        }
-        
-        if (mac_matches_rule(mac_address, rule)) {
-            update_security_stats(rule.allow ? "mac_allowed" : "mac_blocked");
-            return rule.allow;
-        }
+    mac_filter_rules_ = rules;
+    rebuild_filter_tables();
+    LOG_INFO("Loaded " << rules.size() << " MAC filter rules");
+}
+
+bool DhcpSecurityManager::check_mac_address(const std::string& mac_address) {
+    const std::shared_ptr<const MacFilterTable> table = std::atomic_load(&mac_filter_table_);
+    MacAddress binary;
+    if (MacFilterTable::parse(mac_address, binary)) {
+        return apply_mac_filter_match(table->match(binary));
     }
-    
+    return apply_mac_filter_match(table->match_text(mac_address));
+}
+
+bool DhcpSecurityManager::check_mac_address(const MacAddress& mac_address) {
+    return apply_mac_filter_match(std::atomic_load(&mac_filter_table_)->match(mac_address));
+}
+
+bool DhcpSecurityManager::apply_mac_filter_match(FilterMatch match) {
     // Default allow if no rules match
-    update_security_stats("mac_allowed");
-    return true;
+    update_security_stats(match == FilterMatch::DENY ? SecurityCounter::MAC_BLOCKED : SecurityCounter::MAC_ALLOWED);
+    return match != FilterMatch::DENY;
 }
 
 std::vector<MacFilterRule> DhcpSecurityManager::get_mac_filter_rules() {
@@ -179,8 +240,9 @@ std::vector<MacFilterRule> DhcpSecurityManager::get_mac_filter_rules() {
 void DhcpSecurityManager::add_ip_filter_rule(const IpFilterRule& rule) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     ip_filter_rules_.push_back(rule);
-    std::cout << "INFO: Added IP filter rule: " << ip_to_string(rule.ip_address) << " (" << 
-                 (rule.allow ? "allow" : "deny") << ")" << std::endl;
+    rebuild_filter_tables();
+    LOG_INFO("Added IP filter rule: " << ip_to_string(rule.ip_address) << " (" << 
+                 (rule.allow ? "allow" : "deny") << ")");
 }
 
 void DhcpSecurityManager::remove_ip_filter_rule(const IpAddress& ip_address) {
@@ -192,32 +254,23 @@ void DhcpSecurityManager::remove_ip_filter_rule(const IpAddress& ip_address) {
                 return rule.ip_address == ip_address;
             }),
         ip_filter_rules_.end());
+    rebuild_filter_tables();
     
-    std::cout << "INFO: Removed IP filter rule: " << ip_to_string(ip_address) << std::endl;
+    LOG_INFO("Removed IP filter rule: " << ip_to_string(ip_address));
 }
 
-bool DhcpSecurityManager::check_ip_address(const IpAddress& ip_address) {
+void DhcpSecurityManager::set_ip_filter_rules(const std::vector<IpFilterRule>& rules) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    for (const auto& rule : ip_filter_rules_) {
-        if (!rule.enabled) {
-            continue;
-        }
-        
-        // Check if rule has expired
-        if (rule.expires < std::chrono::system_clock::now()) {
-            continue;
-        }
-        
-        if (ip_matches_rule(ip_address, rule)) {
-            update_security_stats(rule.allow ? "ip_allowed" : "ip_blocked");
-            return rule.allow;
-        }
-    }
-    
+    ip_filter_rules_ = rules;
+    rebuild_filter_tables();
+    LOG_INFO("Loaded " << rules.size() << " IP filter rules");
+}
+
+bool DhcpSecurityManager::check_ip_address(const IpAddress& ip_address) {
+    const FilterMatch match = std::atomic_load(&ip_filter_table_)->match(ip_address);
     // Default allow if no rules match
-    update_security_stats("ip_allowed");
-    return true;
+    update_security_stats(match == FilterMatch::DENY ? SecurityCounter::IP_BLOCKED : SecurityCounter::IP_ALLOWED);
+    return match != FilterMatch::DENY;
 }
 
 std::vector<IpFilterRule> DhcpSecurityManager::get_ip_filter_rules() {
@@ -228,9 +281,10 @@ std::vector<IpFilterRule> DhcpSecurityManager::get_ip_filter_rules() {
 void DhcpSecurityManager::add_rate_limit_rule(const RateLimitRule& rule) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     rate_limit_rules_.push_back(rule);
-    std::cout << "INFO: Added rate limit rule: " << rule.identifier << " (" << 
+    rate_limiter_.set_rules(rate_limit_rules_);
+    LOG_INFO("Added rate limit rule: " << rule.identifier << " (" << 
                  std::to_string(rule.max_requests) << " requests per " << 
-                 std::to_string(rule.time_window.count()) << " seconds)" << std::endl;
+                 std::to_string(rule.time_window.count()) << " seconds)");
 }
 
 void DhcpSecurityManager::remove_rate_limit_rule(const std::string& identifier, const std::string& identifier_type) {
@@ -242,75 +296,38 @@ void DhcpSecurityManager::remove_rate_limit_rule(const std::string& identifier,
                 return rule.identifier == identifier && rule.identifier_type == identifier_type;
             }),
         rate_limit_rules_.end());
+    rate_limiter_.set_rules(rate_limit_rules_);
     
-    std::cout << "INFO: Removed rate limit rule: " << identifier << " (" << identifier_type << ")" << std::endl;
+    LOG_INFO("Removed rate limit rule: " << identifier << " (" << identifier_type << ")");
 }
 
 bool DhcpSecurityManager::check_rate_limit(const std::string& identifier, const std::string& identifier_type) {
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    // Find applicable rate limit rule
-    RateLimitRule* applicable_rule = nullptr;
-    for (auto& rule : rate_limit_rules_) {
-        if (!rule.enabled) {
-            continue;
-        }
-        
-        if (rule.identifier_type == identifier_type && 
-            (rule.identifier == identifier || rule.identifier == "*")) {
-            applicable_rule = &rule;
-            break;
-        }
-    }
-    
-    if (!applicable_rule) {
-        // No rate limiting rule applies
-        update_security_stats("rate_limit_allowed");
-        return true;
-    }
-    
-    // Check if rule has expired
-    if (applicable_rule->expires < std::chrono::system_clock::now()) {
-        update_security_stats("rate_limit_allowed");
-        return true;
-    }
-    
-    // Get or create rate limit tracker
-    std::string tracker_key = identifier_type + ":" + identifier;
-    auto& tracker = rate_limit_trackers_[tracker_key];
-    
-    auto now = std::chrono::system_clock::now();
-    
-    // Clean up old requests outside the time window
-    auto cutoff_time = now - applicable_rule->time_window;
-    tracker.requests.erase(
-        std::remove_if(tracker.requests.begin(), tracker.requests.end(),
-            [&](const std::chrono::system_clock::time_point& request_time) {
-                return request_time < cutoff_time;
-            }),
-        tracker.requests.end());
-    
-    // Check if currently blocked
-    if (tracker.blocked_until > now) {
-        update_security_stats("rate_limit_blocked");
-        report_security_event(SecurityEvent(SecurityEventType::RATE_LIMIT_EXCEEDED, ThreatLevel::MEDIUM,
-                                            "Rate limit active: request blocked", identifier));
-        return false;
-    }
-    
-    // Check if we're within the rate limit
-    if (tracker.requests.size() >= applicable_rule->max_requests) {
-        tracker.blocked_until = now + applicable_rule->block_duration;
-        update_security_stats("rate_limit_exceeded");
-        report_security_event(SecurityEvent(SecurityEventType::RATE_LIMIT_EXCEEDED, ThreatLevel::MEDIUM,
-                                            "Rate limit exceeded: activating block window", identifier));
-        return false;
+    return apply_rate_limit_verdict(rate_limiter_.check(identifier, identifier_type), identifier);
+}
+
+bool DhcpSecurityManager::check_rate_limit(const MacAddress& mac_address) {
+    // Only denials carry the MAC into a security event
+    const RateLimitVerdict verdict = rate_limiter_.check(mac_address);
+    const bool denied = verdict == RateLimitVerdict::EXCEEDED || verdict == RateLimitVerdict::BLOCKED;
+    return apply_rate_limit_verdict(verdict, denied ? mac_to_string(mac_address) : std::string());
+}
+
+bool DhcpSecurityManager::apply_rate_limit_verdict(RateLimitVerdict verdict, const std::string& identifier) {
+    switch (verdict) {
+        case RateLimitVerdict::BLOCKED:
+            update_security_stats(SecurityCounter::RATE_LIMIT_BLOCKED);
+            report_security_event(SecurityEvent(SecurityEventType::RATE_LIMIT_EXCEEDED, ThreatLevel::MEDIUM,
+                                                "Rate limit active: request blocked", identifier));
+            return false;
+        case RateLimitVerdict::EXCEEDED:
+            update_security_stats(SecurityCounter::RATE_LIMIT_EXCEEDED);
+            report_security_event(SecurityEvent(SecurityEventType::RATE_LIMIT_EXCEEDED, ThreatLevel::MEDIUM,
+                                                "Rate limit exceeded: activating block window", identifier));
+            return false;
+        default:
+            update_security_stats(SecurityCounter::RATE_LIMIT_ALLOWED);
+            return true;
     }
-    
-    // Add current request
-    tracker.requests.push_back(now);
-    update_security_stats("rate_limit_allowed");
-    return true;
 }
 
 std::vector<RateLimitRule> DhcpSecurityManager::get_rate_limit_rules() {
@@ -320,7 +337,7 @@ std::vector<RateLimitRule> DhcpSecurityManager::get_rate_limit_rules() {
 
 void DhcpSecurityManager::set_option_82_validation_enabled(bool enabled) {
     option_82_validation_enabled_ = enabled;
-    std::cout << "INFO: Option 82 validation " << (enabled ? "enabled" : "disabled") << std::endl;
+    LOG_INFO("Option 82 validation " << (enabled ? "enabled" : "disabled"));
 }
 
 bool DhcpSecurityManager::is_option_82_validation_enabled() const {
@@ -329,27 +346,19 @@ bool DhcpSecurityManager::is_option_82_validation_enabled() const {
 
 bool DhcpSecurityManager::validate_option_82(const std::vector<uint8_t>& option_82_data, 
                                             const std::string& source_interface) {
+    return validate_option_82(ByteView(option_82_data), source_interface);
+}
+
+bool DhcpSecurityManager::validate_option_82(ByteView option_82_data, const std::string& source_interface) {
     if (!option_82_validation_enabled_) {
         return true;
     }
     
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
     // Check if Option 82 is required for this interface
-    bool required = false;
-    for (const auto& rule : option_82_rules_) {
-        if (!rule.enabled) {
-            continue;
-        }
-        if (rule.interface == source_interface || rule.interface == "*") {
-            required = rule.required;
-            break;
-        }
-    }
-    
-    if (!required) {
+    const std::shared_ptr<const RelayAgentTable> table = std::atomic_load(&relay_table_);
+    if (!table->required(source_interface)) {
         // Option 82 not required for this interface
-        update_security_stats("option_82_allowed");
+        update_security_stats(SecurityCounter::OPTION_82_ALLOWED);
         report_security_event(SecurityEvent(SecurityEventType::SUSPICIOUS_ACTIVITY, ThreatLevel::LOW,
                                             "Option 82 not required on interface",
                                             "", "", source_interface));
@@ -358,8 +367,8 @@ bool DhcpSecurityManager::validate_option_82(const std::vector<uint8_t>& option_
     
     // Validate Option 82 data
     if (option_82_data.empty()) {
-        update_security_stats("option_82_missing");
-        std::cout << "WARNING: Option 82 required but missing for interface " << source_interface << std::endl;
+        update_security_stats(SecurityCounter::OPTION_82_MISSING);
+        LOG_WARN("Option 82 required but missing for interface " << source_interface);
         report_security_event(SecurityEvent(SecurityEventType::INVALID_OPTION_82, ThreatLevel::MEDIUM,
                                             "Option 82 required but missing", "", "", source_interface));
         return false;
@@ -367,48 +376,31 @@ bool DhcpSecurityManager::validate_option_82(const std::vector<uint8_t>& option_
     
     // Basic Option 82 validation (circuit-id and remote-id)
     if (option_82_data.size() < 4) {
-        update_security_stats("option_82_invalid");
-        std::cout << "WARNING: Option 82 data too short for interface " << source_interface << std::endl;
+        update_security_stats(SecurityCounter::OPTION_82_INVALID);
+        LOG_WARN("Option 82 data too short for interface " << source_interface);
         report_security_event(SecurityEvent(SecurityEventType::INVALID_OPTION_82, ThreatLevel::MEDIUM,
                                             "Option 82 data too short", "", "", source_interface));
         return false;
     }
     
-    // Check for valid sub-options
-    size_t pos = 0;
-    bool has_circuit_id = false;
-    bool has_remote_id = false;
-    
-    while (pos < option_82_data.size()) {
-        if (pos + 2 > option_82_data.size()) {
-            break; // Not enough data for sub-option header
-        }
-        
-        uint8_t sub_option = option_82_data[pos];
-        uint8_t length = option_82_data[pos + 1];
-        
-        if (pos + 2 + length > option_82_data.size()) {
-            break; // Not enough data for sub-option content
-        }
-        
-        if (sub_option == 1) { // Circuit ID
-            has_circuit_id = true;
-        } else if (sub_option == 2) { // Remote ID
-            has_remote_id = true;
-        }
-        
-        pos += 2 + length;
+    RelayAgentOption relay;
+    if (!RelayAgentOption::parse(option_82_data, relay)) {
+        update_security_stats(SecurityCounter::OPTION_82_INCOMPLETE);
+        LOG_WARN("Option 82 missing required sub-options for interface " << source_interface);
+        report_security_event(SecurityEvent(SecurityEventType::INVALID_OPTION_82, ThreatLevel::MEDIUM,
+                                            "Option 82 missing required sub-options", "", "", source_interface));
+        return false;
     }
     
-    if (!has_circuit_id || !has_remote_id) {
-        update_security_stats("option_82_incomplete");
-        std::cout << "WARNING: Option 82 missing required sub-options for interface " << source_interface << std::endl;
+    if (table->has_trusted_agents() && !table->trusts(relay.circuit_id, relay.remote_id)) {
+        update_security_stats(SecurityCounter::OPTION_82_INVALID);
+        LOG_WARN("Option 82 from untrusted relay agent on interface " << source_interface);
         report_security_event(SecurityEvent(SecurityEventType::INVALID_OPTION_82, ThreatLevel::MEDIUM,
-                                            "Option 82 missing required sub-options", "", "", source_interface));
+                                            "Option 82 from untrusted relay agent", "", "", source_interface));
         return false;
     }
     
-    update_security_stats("option_82_valid");
+    update_security_stats(SecurityCounter::OPTION_82_VALID);
     report_security_event(SecurityEvent(SecurityEventType::SUSPICIOUS_ACTIVITY, ThreatLevel::LOW,
                                         "Option 82 validation passed", "", "", source_interface));
     return true;
@@ -418,11 +410,13 @@ bool DhcpSecurityManager::validate_option_82(const std::vector<uint8_t>& option_
 void DhcpSecurityManager::add_option_82_rule(const Option82Rule& rule) {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     option_82_rules_.push_back(rule);
+    rebuild_relay_table();
 }
 
 void DhcpSecurityManager::clear_option_82_rules() {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     option_82_rules_.clear();
+    rebuild_relay_table();
 }
 
 std::vector<Option82Rule> DhcpSecurityManager::get_option_82_rules() const {
@@ -437,11 +431,13 @@ void DhcpSecurityManager::set_option_82_required_for_interface(const std::string
         if (rule.interface == interface) {
             rule.required = required;
             rule.enabled = true;
+            rebuild_relay_table();
             return;
         }
     }
     // Otherwise add
     option_82_rules_.push_back(Option82Rule{interface, required, true});
+    rebuild_relay_table();
 }
 
 void DhcpSecurityManager::add_trusted_relay_agent(const std::string& circuit_id, const std::string& remote_id) {
@@ -454,7 +450,8 @@ void DhcpSecurityManager::add_trusted_relay_agent(const std::string& circuit_id,
     agent.created_at = std::chrono::system_clock::now();
     
     trusted_relay_agents_.push_back(agent);
-    std::cout << "INFO: Added trusted relay agent: circuit_id=" << circuit_id << ", remote_id=" << remote_id << std::endl;
+    rebuild_relay_table();
+    LOG_INFO("Added trusted relay agent: circuit_id=" << circuit_id << ", remote_id=" << remote_id);
 }
 
 void DhcpSecurityManager::remove_trusted_relay_agent(const std::string& circuit_id, const std::string& remote_id) {
@@ -466,13 +463,14 @@ void DhcpSecurityManager::remove_trusted_relay_agent(const std::string& circuit_
                 return agent.circuit_id == circuit_id && agent.remote_id == remote_id;
             }),
         trusted_relay_agents_.end());
+    rebuild_relay_table();
     
-    std::cout << "INFO: Removed trusted relay agent: circuit_id=" << circuit_id << ", remote_id=" << remote_id << std::endl;
+    LOG_INFO("Removed trusted relay agent: circuit_id=" << circuit_id << ", remote_id=" << remote_id);
 }
 
 void DhcpSecurityManager::set_authentication_enabled(bool enabled) {
     authentication_enabled_ = enabled;
-    std::cout << "INFO: Authentication " << (enabled ? "enabled" : "disabled") << std::endl;
+    LOG_INFO("Authentication " << (enabled ? "enabled" : "disabled"));
 }
 
 bool DhcpSecurityManager::is_authentication_enabled() const {
@@ -481,7 +479,7 @@ bool DhcpSecurityManager::is_authentication_enabled() const {
 
 void DhcpSecurityManager::set_authentication_key(const std::string& key) {
     authentication_key_ = key;
-    std::cout << "INFO: Authentication key updated" << std::endl;
+    LOG_INFO("Authentication key updated");
 }
 
 bool DhcpSecurityManager::validate_client_authentication(const std::string& client_mac, 
@@ -495,28 +493,28 @@ bool DhcpSecurityManager::validate_client_authentication(const std::string& clie
     // Find client credentials
     auto it = client_credentials_.find(client_mac);
     if (it == client_credentials_.end()) {
-        update_security_stats("auth_client_not_found");
-        std::cout << "WARNING: Authentication failed - client not found: " << client_mac << std::endl;
+        update_security_stats(SecurityCounter::AUTH_CLIENT_NOT_FOUND);
+        LOG_WARN("Authentication failed - client not found: " << client_mac);
         return false;
     }
     
     const auto& credentials = it->second;
     
     if (!credentials.enabled) {
-        update_security_stats("auth_client_disabled");
-        std::cout << "WARNING: Authentication failed - client disabled: " << client_mac << std::endl;
+        update_security_stats(SecurityCounter::AUTH_CLIENT_DISABLED);
+        LOG_WARN("Authentication failed - client disabled: " << client_mac);
         return false;
     }
     
     if (credentials.expires < std::chrono::system_clock::now()) {
-        update_security_stats("auth_client_expired");
-        std::cout << "WARNING: Authentication failed - client expired: " << client_mac << std::endl;
+        update_security_stats(SecurityCounter::AUTH_CLIENT_EXPIRED);
+        LOG_WARN("Authentication failed - client expired: " << client_mac);
         return false;
     }
     
     if (auth_data.empty()) {
-        update_security_stats("auth_data_missing");
-        std::cout << "WARNING: Authentication failed - no auth data for client: " << client_mac << std::endl;
+        update_security_stats(SecurityCounter::AUTH_DATA_MISSING);
+        LOG_WARN("Authentication failed - no auth data for client: " << client_mac);
         return false;
     }
     
@@ -526,89 +524,90 @@ bool DhcpSecurityManager::validate_client_authentication(const std::string& clie
     for (int offset : offsets) {
         const auto ts = now + std::chrono::seconds(offset);
         if (validate_auth_hash(client_mac, auth_data, ts)) {
-    update_security_stats("auth_success");
-    std::cout << "INFO: Client authenticated successfully: " << client_mac << std::endl;
+    update_security_stats(SecurityCounter::AUTH_SUCCESS);
+    LOG_INFO("Client authenticated successfully: " << client_mac);
     return true;
         }
     }
 
-    update_security_stats("auth_failed");
-    std::cout << "WARNING: Authentication failed - invalid HMAC for client: " << client_mac << std::endl;
+    update_security_stats(SecurityCounter::AUTH_FAILED);
+    LOG_WARN("Authentication failed - invalid HMAC for client: " << client_mac);
     return false;
 }
 
 void DhcpSecurityManager::report_security_event(const SecurityEvent& event) {
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    security_events_.push_back(event);
-    
-    // Update statistics
-    security_stats_.total_events++;
-    security_stats_.events_by_level[static_cast<int>(event.level)]++;
-    security_stats_.events_by_type[static_cast<int>(event.type)]++;
-    
-    // Call callback if set
-    if (security_event_callback_) {
-        security_event_callback_(event);
-    }
-    
-    // Log the event
-    std::string level_str;
-    switch (event.level) {
-        case ThreatLevel::LOW: level_str = "LOW"; break;
-        case ThreatLevel::MEDIUM: level_str = "MEDIUM"; break;
-        case ThreatLevel::HIGH: level_str = "HIGH"; break;
-        case ThreatLevel::CRITICAL: level_str = "CRITICAL"; break;
+    counters_.increment(static_cast<SecurityCounter>(
+        static_cast<size_t>(SecurityCounter::EVENTS_LOW) + static_cast<size_t>(event.level)));
+    if (event.type != SecurityEventType::ANY) {
+        counters_.increment(static_cast<SecurityCounter>(
+            static_cast<size_t>(SecurityCounter::EVENTS_UNAUTHORIZED_DHCP_SERVER) + static_cast<size_t>(event.type)));
     }
     
-    std::cout << "WARNING: Security Event [" << level_str << "]: " << event.description << std::endl;
+    security_events_.append(event);
+    event_dispatcher_.post(event);
 }
 
 void DhcpSecurityManager::set_security_event_callback(std::function<void(const SecurityEvent&)> callback) {
-    security_event_callback_ = callback;
+    event_dispatcher_.set_callback(std::move(callback));
+}
+
+void DhcpSecurityManager::flush_security_events() {
+    event_dispatcher_.flush();
 }
 
 std::vector<SecurityEvent> DhcpSecurityManager::get_security_events(
     std::chrono::system_clock::time_point start_time,
     std::chrono::system_clock::time_point end_time,
     SecurityEventType event_type) {
-    
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    std::vector<SecurityEvent> result;
-    for (const auto& event : security_events_) {
-        if (event.timestamp < start_time || event.timestamp > end_time) {
+    return security_events_.query(start_time, end_time, event_type);
+}
+
+SecurityStats DhcpSecurityManager::get_security_statistics() const {
+    const auto counts = counters_.snapshot();
+    SecurityStats stats{};
+    for (size_t i = 0; i < kCountedStats; ++i) {
+        if (counts[i] == 0) {
             continue;
         }
-        if (event_type != SecurityEventType::ANY && event.type != event_type) {
-            continue;
+        stats.stats[kStatInfo[i].name] = counts[i];
+        if (kStatInfo[i].kind == StatKind::BLOCKED) {
+            stats.blocked_requests += counts[i];
+        } else if (kStatInfo[i].kind == StatKind::ALLOWED) {
+            stats.allowed_requests += counts[i];
         }
-        result.push_back(event);
     }
+    for (size_t level = 0; level < 4; ++level) {
+        stats.events_by_level[level] = counts[static_cast<size_t>(SecurityCounter::EVENTS_LOW) + level];
+        stats.total_events += stats.events_by_level[level];
+    }
+    for (size_t type = 0; type < 8; ++type) {
+        stats.events_by_type[type] = counts[static_cast<size_t>(SecurityCounter::EVENTS_UNAUTHORIZED_DHCP_SERVER) + type];
+    }
+    stats.stats["events_overwritten"] = security_events_.overwritten();
+    stats.stats["events_coalesced"] = event_dispatcher_.coalesced();
+    stats.stats["events_undelivered"] = event_dispatcher_.dropped();
     
-    return result;
-}
-
-SecurityStats DhcpSecurityManager::get_security_statistics() const {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    return security_stats_;
+    stats.last_reset = stats_reset_time_;
+    return stats;
 }
 
 void DhcpSecurityManager::clear_security_statistics() {
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    security_stats_ = SecurityStats{};
-    security_stats_.last_reset = std::chrono::system_clock::now();
+    counters_.reset();
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        stats_reset_time_ = std::chrono::system_clock::now();
+    }
     
-    std::cout << "INFO: Security statistics cleared" << std::endl;
+    LOG_INFO("Security statistics cleared");
 }
 
 bool DhcpSecurityManager::load_security_configuration(const std::string& config_file) {
-    std::cout << "INFO: Loading security configuration from: " << config_file << std::endl;
+    LOG_INFO("Loading security configuration from: " << config_file);
 
     std::ifstream file(config_file);
     if (!file.is_open()) {
-        std::cerr << "ERROR: Cannot open security configuration: " << config_file << std::endl;
+        LOG_ERROR("Cannot open security configuration: " << config_file);
         return false;
     }
     std::stringstream buffer; buffer << file.rdbuf(); file.close();
@@ -631,7 +630,8 @@ bool DhcpSecurityManager::load_security_configuration(const std::string& config_
             Json::Value root;
             Json::CharReaderBuilder b; std::string errs; std::istringstream in(content);
             if (!Json::parseFromStream(b, in, &root, &errs)) {
-                std::cerr << "ERROR: Security JSON parse error: " << errs << std::endl;
+                LOG_ERROR("Security JSON parse error: " << errs);
+                rebuild_relay_table();
                 return false;
             }
             const Json::Value& opt82 = root.isMember("option_82") ? root["option_82"] : Json::Value(Json::nullValue);
@@ -699,17 +699,19 @@ bool DhcpSecurityManager::load_security_configuration(const std::string& config_
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "ERROR: Failed loading security configuration: " << e.what() << std::endl;
+        LOG_ERROR("Failed loading security configuration: " << e.what());
+        rebuild_relay_table();
         return false;
     }
+    rebuild_relay_table();
 
-    std::cout << "INFO: Security configuration loaded (" << option_82_rules_.size() << " opt82 rules, "
-              << trusted_relay_agents_.size() << " trusted relays)" << std::endl;
+    LOG_INFO("Security configuration loaded (" << option_82_rules_.size() << " opt82 rules, "
+              << trusted_relay_agents_.size() << " trusted relays)");
     return true;
 }
 
 bool DhcpSecurityManager::save_security_configuration(const std::string& config_file) {
-    std::cout << "INFO: Saving security configuration to: " << config_file << std::endl;
+    LOG_INFO("Saving security configuration to: " << config_file);
     Json::Value root;
     Json::Value opt82(Json::objectValue);
     opt82["enabled"] = static_cast<bool>(option_82_validation_enabled_);
@@ -739,10 +741,22 @@ void DhcpSecurityManager::start() {
         return;
     }
     
+    own_loop_ = std::make_unique<EventLoop>(EventBackendType::AUTO, "security cleanup");
+    own_loop_->start();
+    start(*own_loop_);
+}
+
+void DhcpSecurityManager::start(EventLoop& loop) {
+    if (running_) {
+        return;
+    }
+    
     running_ = true;
-    cleanup_thread_ = std::thread(&DhcpSecurityManager::cleanup_worker, this);
+    event_dispatcher_.start();
+    cleanup_loop_ = &loop;
+    cleanup_timer_ = loop.add_timer(kCleanupInterval, [this]() { cleanup_expired_items(); });
     
-    std::cout << "INFO: Security manager started" << std::endl;
+    LOG_INFO("Security manager started");
 }
 
 void DhcpSecurityManager::stop() {
@@ -752,11 +766,16 @@ void DhcpSecurityManager::stop() {
     
     running_ = false;
     
-    if (cleanup_thread_.joinable()) {
-        cleanup_thread_.join();
+    // Returns once a running cleanup has finished
+    cleanup_loop_->cancel_timer(cleanup_timer_);
+    cleanup_loop_ = nullptr;
+    if (own_loop_) {
+        own_loop_->stop();
+        own_loop_.reset();
     }
+    event_dispatcher_.stop();
     
-    std::cout << "INFO: Security manager stopped" << std::endl;
+    LOG_INFO("Security manager stopped");
 }
 
 void DhcpSecurityManager::cleanup_expired_items() {
@@ -794,83 +813,13 @@ void DhcpSecurityManager::cleanup_expired_items() {
             [&](const RateLimitRule& rule) { return rule.expires < now; }),
         rate_limit_rules_.end());
 
-    // Clean old entries from trackers and drop blocked entries that have unblocked
-    for (auto it = rate_limit_trackers_.begin(); it != rate_limit_trackers_.end(); ) {
-        auto& tracker = it->second;
-        // Drop request timestamps older than 1 hour
-        const auto cutoff = now - std::chrono::hours(1);
-        tracker.requests.erase(
-            std::remove_if(tracker.requests.begin(), tracker.requests.end(),
-                [&](const auto& t) { return t < cutoff; }),
-            tracker.requests.end());
-
-        // Remove empty trackers that are not blocked
-        if (tracker.requests.empty() && tracker.blocked_until <= now) {
-            it = rate_limit_trackers_.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
-
-void DhcpSecurityManager::cleanup_worker() {
-    last_security_cleanup_ = std::chrono::steady_clock::now();
-    while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        if (!running_) {
-            break;
-        }
-        const auto now = std::chrono::steady_clock::now();
-        if (now - last_security_cleanup_ < std::chrono::minutes(5)) {
-            continue;
-        }
-        last_security_cleanup_ = now;
-        cleanup_expired_items();
-    }
+    rate_limiter_.set_rules(rate_limit_rules_);
+    rebuild_filter_tables();
+    rebuild_relay_table();
 }
 
 // Helper method implementations
 
-bool DhcpSecurityManager::update_rate_limit_tracker(const std::string& identifier, const std::string& identifier_type) {
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    
-    auto now = std::chrono::system_clock::now();
-    std::string tracker_key = identifier_type + ":" + identifier;
-    auto& tracker = rate_limit_trackers_[tracker_key];
-    
-    // Clean up old entries (older than 1 hour)
-    auto cutoff = now - std::chrono::hours(1);
-    tracker.requests.erase(std::remove_if(tracker.requests.begin(), tracker.requests.end(),
-        [cutoff](const auto& entry) { return entry < cutoff; }), tracker.requests.end());
-    
-    // Add current request
-    tracker.requests.push_back(now);
-    
-    // Check rate limits
-    auto minute_ago = now - std::chrono::minutes(1);
-    auto hour_ago = now - std::chrono::hours(1);
-    
-    size_t requests_last_minute = std::count_if(tracker.requests.begin(), tracker.requests.end(),
-        [minute_ago](const auto& entry) { return entry >= minute_ago; });
-    
-    size_t requests_last_hour = std::count_if(tracker.requests.begin(), tracker.requests.end(),
-        [hour_ago](const auto& entry) { return entry >= hour_ago; });
-    
-    // Check if limits are exceeded (using default values for now)
-    const size_t max_requests_per_minute = 100;
-    const size_t max_requests_per_hour = 1000;
-    
-    if (requests_last_minute > max_requests_per_minute || 
-        requests_last_hour > max_requests_per_hour) {
-        std::cout << "WARNING: Rate limit exceeded for " << identifier_type 
-                  << " " << identifier << " (minute: " << requests_last_minute 
-                  << ", hour: " << requests_last_hour << ")" << std::endl;
-        return false;
-    }
-    
-    return true;
-}
-
 std::string DhcpSecurityManager::generate_auth_hash(const std::string& client_mac, 
                                                    std::chrono::system_clock::time_point timestamp) {
     // HMAC-SHA256 over (client_mac | timestamp_seconds) using authentication_key_
@@ -935,66 +884,35 @@ bool DhcpSecurityManager::validate_auth_hash(const std::string& client_mac,
     return provided_hex == expected_hex;
 }
 
-void DhcpSecurityManager::update_security_stats(const std::string& stat_name) {
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    security_stats_.stats[stat_name]++;
-    
-    // Update specific counters
-    if (stat_name.find("blocked") != std::string::npos || 
-        stat_name.find("exceeded") != std::string::npos ||
-        stat_name.find("invalid") != std::string::npos) {
-        security_stats_.blocked_requests++;
-    } else if (stat_name.find("allowed") != std::string::npos) {
-        security_stats_.allowed_requests++;
-    }
+void DhcpSecurityManager::update_security_stats(SecurityCounter counter) {
+    static_assert(kCountedStats == static_cast<size_t>(SecurityCounter::EVENTS_LOW),
+                  "kStatInfo must name every request counter");
+    counters_.increment(counter);
     
     // Log significant security events
-    if (stat_name.find("blocked") != std::string::npos || 
-        stat_name.find("exceeded") != std::string::npos) {
-        std::cout << "SECURITY: " << stat_name << " (total: " << security_stats_.stats[stat_name] << ")" << std::endl;
+    if (kStatInfo[static_cast<size_t>(counter)].logged) {
+        LOG_WARN("SECURITY: " << kStatInfo[static_cast<size_t>(counter)].name);
     }
 }
 
-bool DhcpSecurityManager::mac_matches_rule(const std::string& mac_address, const MacFilterRule& rule) {
-    // Normalize: lowercase and remove separators
-    auto normalize = [](std::string s) {
-        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-        s.erase(std::remove(s.begin(), s.end(), ':'), s.end());
-        s.erase(std::remove(s.begin(), s.end(), '-'), s.end());
-        return s;
-    };
-    const std::string target = normalize(mac_address);
-    std::string pattern = normalize(rule.mac_address);
+void DhcpSecurityManager::rebuild_filter_tables() {
+    std::atomic_store(&mac_filter_table_, std::shared_ptr<const MacFilterTable>(
+        std::make_shared<MacFilterTable>(mac_filter_rules_)));
+    std::atomic_store(&ip_filter_table_, std::shared_ptr<const IpFilterTable>(
+        std::make_shared<IpFilterTable>(ip_filter_rules_)));
+}
 
-    if (pattern == "*" || pattern == target) {
-        return true;
-    }
-    
-    // Wildcard to regex: '*' -> ".*", '?' -> '.'
-    std::string regex_str;
-    regex_str.reserve(pattern.size() * 2);
-    regex_str.push_back('^');
-    for (char c : pattern) {
-        if (c == '*') { regex_str += ".*"; }
-        else if (c == '?') { regex_str += '.'; }
-        else if (std::isalnum(static_cast<unsigned char>(c))) { regex_str.push_back(c); }
-        else { regex_str.push_back('\\'); regex_str.push_back(c); }
-    }
-    regex_str.push_back('$');
-    try {
-        std::regex re(regex_str);
-        return std::regex_match(target, re);
-    } catch (...) {
-            return false;
-    }
+void DhcpSecurityManager::rebuild_relay_table() {
+    std::atomic_store(&relay_table_, std::shared_ptr<const RelayAgentTable>(
+        std::make_shared<RelayAgentTable>(option_82_rules_, trusted_relay_agents_)));
 }
 
-bool DhcpSecurityManager::ip_matches_rule(const IpAddress& ip_address, const IpFilterRule& rule) {
-    // Apply mask if provided, else exact match
-    if (rule.ip_mask != 0) {
-        return (ip_address & rule.ip_mask) == (rule.ip_address & rule.ip_mask);
+size_t DhcpSecurityManager::SnoopingKeyHash::operator()(const SnoopingKey& key) const {
+    uint64_t value = key.ip_address;
+    for (uint8_t byte : key.mac_address) {
+        value = (value << 8 | value >> 56) ^ byte;
     }
-    return rule.ip_address == ip_address;
+    return static_cast<size_t>(value * 0x9E3779B97F4A7C15ull);
 }
 
 } // namespace simple_dhcpd
\ No newline at end of file
@@ -0,0 +1,228 @@
+/**
+ * @file production/security/rate_limiter.cpp
+ * @brief Token-bucket rate limiter implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/production/security/rate_limiter.hpp"
+#include "simple-dhcpd/production/security/manager.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr uint64_t kMacTag = 1ull << 56;
+constexpr uint64_t kIpTag = 2ull << 56;
+constexpr uint64_t kNameTag = 3ull << 56;
+const std::string kMacType = "mac";
+
+uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+uint64_t fnv1a(const std::string& text, uint64_t hash = 0xcbf29ce484222325ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool parse_mac(const std::string& text, MacAddress& mac_address) {
+    unsigned int bytes[6];
+    char tail;
+    if (std::sscanf(text.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x%c", &bytes[0], &bytes[1], &bytes[2],
+                    &bytes[3], &bytes[4], &bytes[5], &tail) != 6) {
+        return false;
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        mac_address[i] = static_cast<uint8_t>(bytes[i]);
+    }
+    return true;
+}
+}
+
+RateLimiter::RateLimiter(size_t capacity)
+    : rules_(std::make_shared<RuleSet>()), shard_count_(kShards), sets_per_shard_(1), evictions_(0) {
+    const size_t sets_needed = (std::max<size_t>(capacity, 1) + kWays - 1) / kWays;
+    while (sets_per_shard_ * shard_count_ < sets_needed) {
+        sets_per_shard_ <<= 1;
+    }
+    shards_.reset(new Shard[shard_count_]);
+    for (size_t i = 0; i < shard_count_; ++i) {
+        shards_[i].entries.assign(sets_per_shard_ * kWays, Entry{0, 0, 0});
+    }
+}
+
+uint64_t RateLimiter::mac_key(const MacAddress& mac_address) {
+    uint64_t key = 0;
+    for (uint8_t byte : mac_address) {
+        key = (key << 8) | byte;
+    }
+    return kMacTag | key;
+}
+
+uint64_t RateLimiter::identifier_key(const std::string& identifier, const std::string& identifier_type) {
+    if (identifier_type == kMacType) {
+        MacAddress mac_address;
+        if (parse_mac(identifier, mac_address)) {
+            return mac_key(mac_address);
+        }
+    } else if (identifier_type == "ip") {
+        in_addr address;
+        if (inet_pton(AF_INET, identifier.c_str(), &address) == 1) {
+            return kIpTag | address.s_addr;
+        }
+    }
+    // Other types, or text that does not parse: hash type and identifier together
+    const uint64_t hash = fnv1a(identifier, fnv1a(identifier_type + ":"));
+    return kNameTag | (hash & ((1ull << 56) - 1));
+}
+
+void RateLimiter::set_rules(const std::vector<RateLimitRule>& rules) {
+    auto compiled = std::make_shared<RuleSet>();
+    compiled->limits.reserve(rules.size());
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const RateLimitRule& rule = rules[i];
+        const int64_t window_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(rule.time_window).count();
+        Limit limit{};
+        limit.deny_all = rule.max_requests == 0;
+        limit.interval_ns = limit.deny_all ? 0 : std::max<int64_t>(window_ns / static_cast<int64_t>(rule.max_requests), 1);
+        limit.tolerance_ns = limit.deny_all ? 0 : limit.interval_ns * static_cast<int64_t>(rule.max_requests - 1);
+        limit.block_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(rule.block_duration).count();
+        limit.expires = rule.expires;
+        compiled->limits.push_back(limit);
+
+        if (!rule.enabled) {
+            continue;
+        }
+        const uint32_t position = static_cast<uint32_t>(i);
+        if (rule.identifier == "*") {
+            compiled->wildcard.emplace(rule.identifier_type, position);
+        } else {
+            compiled->exact.emplace(identifier_key(rule.identifier, rule.identifier_type), position);
+        }
+    }
+    std::atomic_store(&rules_, std::shared_ptr<const RuleSet>(std::move(compiled)));
+}
+
+const RateLimiter::Limit* RateLimiter::resolve(const RuleSet& rules, uint64_t key,
+                                               const std::string& identifier_type) const {
+    uint32_t position = std::numeric_limits<uint32_t>::max();
+    if (!rules.exact.empty()) {
+        auto it = rules.exact.find(key);
+        if (it != rules.exact.end()) {
+            position = it->second;
+        }
+    }
+    if (!rules.wildcard.empty()) {
+        auto it = rules.wildcard.find(identifier_type);
+        if (it != rules.wildcard.end()) {
+            position = std::min(position, it->second);
+        }
+    }
+    if (position == std::numeric_limits<uint32_t>::max()) {
+        return nullptr;
+    }
+    const Limit& limit = rules.limits[position];
+    if (limit.expires != std::chrono::system_clock::time_point::max() &&
+        limit.expires < std::chrono::system_clock::now()) {
+        return nullptr;
+    }
+    return &limit;
+}
+
+RateLimitVerdict RateLimiter::check(const MacAddress& mac_address, Clock::time_point now) {
+    const std::shared_ptr<const RuleSet> rules = std::atomic_load(&rules_);
+    if (rules->limits.empty()) {
+        return RateLimitVerdict::UNLIMITED;
+    }
+    const uint64_t key = mac_key(mac_address);
+    const Limit* limit = resolve(*rules, key, kMacType);
+    return limit ? consume(key, *limit, now) : RateLimitVerdict::UNLIMITED;
+}
+
+RateLimitVerdict RateLimiter::check(const std::string& identifier, const std::string& identifier_type,
+                                    Clock::time_point now) {
+    const std::shared_ptr<const RuleSet> rules = std::atomic_load(&rules_);
+    if (rules->limits.empty()) {
+        return RateLimitVerdict::UNLIMITED;
+    }
+    const uint64_t key = identifier_key(identifier, identifier_type);
+    const Limit* limit = resolve(*rules, key, identifier_type);
+    return limit ? consume(key, *limit, now) : RateLimitVerdict::UNLIMITED;
+}
+
+RateLimitVerdict RateLimiter::consume(uint64_t key, const Limit& limit, Clock::time_point now) {
+    const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    const uint64_t hash = mix(key);
+    Shard& shard = shards_[(hash >> 32) % shard_count_];
+    Entry* set = &shard.entries[(hash & (sets_per_shard_ - 1)) * kWays];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry* entry = nullptr;
+    Entry* victim = set;
+    int64_t victim_busy_until = std::numeric_limits<int64_t>::max();
+    for (size_t way = 0; way < kWays; ++way) {
+        Entry& candidate = set[way];
+        if (candidate.key == key) {
+            entry = &candidate;
+            break;
+        }
+        // Prefer empty slots, then the client whose state matters least:
+        // once both times are in the past it is no different from a new one
+        const int64_t busy_until = candidate.key == 0 ? std::numeric_limits<int64_t>::min()
+                                                      : std::max(candidate.tat_ns, candidate.blocked_until_ns);
+        if (busy_until < victim_busy_until) {
+            victim = &candidate;
+            victim_busy_until = busy_until;
+        }
+    }
+    if (!entry) {
+        if (victim->key != 0 && victim_busy_until > now_ns) {
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+        *victim = Entry{key, 0, 0};
+        entry = victim;
+    }
+
+    if (entry->blocked_until_ns > now_ns) {
+        return RateLimitVerdict::BLOCKED;
+    }
+    const int64_t tat = std::max(entry->tat_ns, now_ns);
+    if (limit.deny_all || tat - now_ns > limit.tolerance_ns) {
+        entry->blocked_until_ns = now_ns + limit.block_ns;
+        return RateLimitVerdict::EXCEEDED;
+    }
+    entry->tat_ns = tat + limit.interval_ns;
+    return RateLimitVerdict::ALLOWED;
+}
+
+void RateLimiter::clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        std::fill(shards_[i].entries.begin(), shards_[i].entries.end(), Entry{0, 0, 0});
+    }
+}
+
+size_t RateLimiter::size() const {
+    size_t occupied = 0;
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        occupied += std::count_if(shards_[i].entries.begin(), shards_[i].entries.end(),
+                                  [](const Entry& entry) { return entry.key != 0; });
+    }
+    return occupied;
+}
+
+} // namespace simple_dhcpd
@@ -0,0 +1,114 @@
+/**
+ * @file production/security/relay_table.cpp
+ * @brief Compiled Option 82 rules and trusted relay agents implementation
+ * @author SimpleDaemons
+ * @copyright 2024 SimpleDaemons
+ * @license Apache-2.0
+ */
+
+#include "simple-dhcpd/production/security/relay_table.hpp"
+#include "simple-dhcpd/production/security/manager.hpp"
+#include <cstring>
+
+namespace simple_dhcpd {
+
+namespace {
+constexpr uint8_t kCircuitIdSubOption = 1;
+constexpr uint8_t kRemoteIdSubOption = 2;
+
+uint64_t fnv1a(ByteView bytes, uint64_t hash) {
+    for (uint8_t byte : bytes) {
+        hash ^= byte;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool same_bytes(const std::string& text, ByteView bytes) {
+    return text.size() == bytes.size() && (bytes.empty() || std::memcmp(text.data(), bytes.data(), bytes.size()) == 0);
+}
+
+ByteView text_view(const std::string& text) {
+    return ByteView(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+}
+
+bool RelayAgentOption::parse(ByteView data, RelayAgentOption& option) {
+    option = RelayAgentOption();
+    size_t pos = 0;
+    while (pos + 2 <= data.size()) {
+        const uint8_t sub_option = data[pos];
+        const uint8_t length = data[pos + 1];
+        if (pos + 2 + length > data.size()) {
+            break;
+        }
+        if (sub_option == kCircuitIdSubOption && !option.has_circuit_id) {
+            option.circuit_id = data.subview(pos + 2, length);
+            option.has_circuit_id = true;
+        } else if (sub_option == kRemoteIdSubOption && !option.has_remote_id) {
+            option.remote_id = data.subview(pos + 2, length);
+            option.has_remote_id = true;
+        }
+        pos += 2 + length;
+    }
+    return option.has_circuit_id && option.has_remote_id;
+}
+
+RelayAgentTable::RelayAgentTable(const std::vector<Option82Rule>& rules,
+                                 const std::vector<TrustedRelayAgent>& agents) {
+    rule_required_.reserve(rules.size());
+    for (const Option82Rule& rule : rules) {
+        const uint32_t position = static_cast<uint32_t>(rule_required_.size());
+        rule_required_.push_back(rule.required);
+        if (!rule.enabled) {
+            continue;
+        }
+        if (rule.interface == "*") {
+            if (wildcard_ == kNoRule) {
+                wildcard_ = position;
+            }
+        } else {
+            interfaces_.emplace(rule.interface, position);     // keeps the first rule
+        }
+    }
+
+    agents_.reserve(agents.size());
+    for (const TrustedRelayAgent& agent : agents) {
+        if (!agent.enabled) {
+            continue;
+        }
+        agent_index_.emplace(agent_key(text_view(agent.circuit_id), text_view(agent.remote_id)),
+                             static_cast<uint32_t>(agents_.size()));
+        agents_.push_back(Agent{agent.circuit_id, agent.remote_id});
+    }
+}
+
+bool RelayAgentTable::required(const std::string& interface_name) const {
+    uint32_t position = wildcard_;
+    const auto it = interfaces_.find(interface_name);
+    if (it != interfaces_.end() && it->second < position) {
+        position = it->second;
+    }
+    return position != kNoRule && rule_required_[position];
+}
+
+bool RelayAgentTable::trusts(ByteView circuit_id, ByteView remote_id) const {
+    const auto range = agent_index_.equal_range(agent_key(circuit_id, remote_id));
+    for (auto it = range.first; it != range.second; ++it) {
+        const Agent& agent = agents_[it->second];
+        if (same_bytes(agent.circuit_id, circuit_id) && same_bytes(agent.remote_id, remote_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t RelayAgentTable::agent_key(ByteView circuit_id, ByteView remote_id) {
+    // The length keeps ("ab", "c") and ("a", "bc") apart
+    const uint8_t length = static_cast<uint8_t>(circuit_id.size());
+    uint64_t hash = fnv1a(circuit_id, 0xcbf29ce484222325ull);
+    hash = fnv1a(ByteView(&length, 1), hash);
+    return fnv1a(remote_id, hash);
+}
+
+} // namespace simple_dhcpd
@@ -11,6 +11,8 @@
 #include <sstream>
 #include <filesystem>
 #include "simple-dhcpd/core/config/manager.hpp"
+#include "simple-dhcpd/core/config/subnet_index.hpp"
+#include "simple-dhcpd/core/utils/utils.hpp"
 #include "simple-dhcpd/core/types.hpp"
 
 using namespace simple_dhcpd;
@@ -275,3 +277,90 @@ TEST_F(ConfigErrorTest, InvalidSubnetRange) {
 
     std::filesystem::remove(config_file);
 }
+
+TEST(SubnetIndexTest, LongestPrefixMatch) {
+    std::vector<DhcpSubnet> subnets(4);
+    subnets[0].name = "campus";
+    subnets[0].network = string_to_ip("10.0.0.0");
+    subnets[0].prefix_length = 8;
+    subnets[1].name = "building";
+    subnets[1].network = string_to_ip("10.1.0.0");
+    subnets[1].prefix_length = 16;
+    subnets[2].name = "floor";
+    subnets[2].network = string_to_ip("10.1.2.0");
+    subnets[2].prefix_length = 24;
+    // No prefix length: indexed by the prefix covering its range
+    subnets[3].name = "lab";
+    subnets[3].range_start = string_to_ip("192.168.5.100");
+    subnets[3].range_end = string_to_ip("192.168.5.200");
+
+    SubnetIndex index;
+    index.build(subnets);
+    EXPECT_EQ(index.size(), 4u);
+
+    EXPECT_EQ(index.find_by_address(string_to_ip("10.1.2.1")), 2u);
+    EXPECT_EQ(index.find_by_address(string_to_ip("10.1.3.1")), 1u);
+    EXPECT_EQ(index.find_by_address(string_to_ip("10.200.0.1")), 0u);
+    EXPECT_EQ(index.find_by_address(string_to_ip("192.168.5.150")), 3u);
+    EXPECT_EQ(index.find_by_address(string_to_ip("172.16.0.1")), kNoSubnet);
+
+    EXPECT_EQ(index.find_by_name("floor"), 2u);
+    EXPECT_EQ(index.find_by_name("missing"), kNoSubnet);
+}
+
+TEST(SubnetIndexTest, DuplicatePrefixKeepsFirst) {
+    Ipv4PrefixTrie trie;
+    EXPECT_TRUE(trie.insert(string_to_ip("10.0.0.0"), 24, 7));
+    EXPECT_FALSE(trie.insert(string_to_ip("10.0.0.99"), 24, 8));
+    EXPECT_EQ(trie.lookup(string_to_ip("10.0.0.5")), 7u);
+    EXPECT_EQ(trie.find_exact(string_to_ip("10.0.0.0"), 24), 7u);
+    EXPECT_EQ(trie.find_exact(string_to_ip("10.0.0.0"), 16), Ipv4PrefixTrie::kNoValue);
+    EXPECT_EQ(trie.size(), 1u);
+}
+
+TEST(SubnetTableTest, UpdateKeepsIdsByName) {
+    std::vector<DhcpSubnet> subnets(3);
+    const char* names[] = {"alpha", "beta", "gamma"};
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        subnets[i].name = names[i];
+        subnets[i].network = string_to_ip("10.0." + std::to_string(i) + ".0");
+        subnets[i].prefix_length = 24;
+        subnets[i].range_start = string_to_ip("10.0." + std::to_string(i) + ".10");
+        subnets[i].range_end = string_to_ip("10.0." + std::to_string(i) + ".20");
+    }
+    auto table = SubnetTable::build(subnets);
+    EXPECT_EQ(table->size(), 3u);
+    EXPECT_EQ(table->default_id(), 0u);
+
+    // Drop alpha, widen beta, change gamma's lease time, add delta first
+    std::vector<DhcpSubnet> reloaded = {subnets[2], subnets[1]};
+    reloaded[0].lease_time = 600;
+    reloaded[1].range_end = string_to_ip("10.0.1.30");
+    DhcpSubnet delta;
+    delta.name = "delta";
+    delta.network = string_to_ip("10.0.9.0");
+    delta.prefix_length = 24;
+    reloaded.insert(reloaded.begin(), delta);
+
+    auto next = table->update(reloaded);
+    EXPECT_EQ(next->slots(), 4u);
+    EXPECT_EQ(next->size(), 3u);
+    EXPECT_TRUE(next->retired(0));
+    EXPECT_EQ(next->find(0), nullptr);
+    EXPECT_EQ(next->change(0), SubnetChange::REMOVED);
+    EXPECT_EQ(next->change(1), SubnetChange::POOL);
+    EXPECT_EQ(next->change(2), SubnetChange::SETTINGS);
+    EXPECT_EQ(next->change(3), SubnetChange::ADDED);
+    EXPECT_EQ(next->subnet(2).lease_time, 600u);
+    EXPECT_EQ(next->default_id(), 3u);
+
+    EXPECT_EQ(next->index().find_by_name("beta"), 1u);
+    EXPECT_EQ(next->index().find_by_address(string_to_ip("10.0.2.15")), 2u);
+    EXPECT_EQ(next->index().find_by_address(string_to_ip("10.0.0.15")), kNoSubnet);
+
+    // Reloading the same file again changes nothing
+    auto same = next->update(reloaded);
+    for (SubnetId id = 1; id < same->slots(); ++id) {
+        EXPECT_EQ(same->change(id), SubnetChange::UNCHANGED);
+    }
+}
@@ -111,10 +111,12 @@ TEST_F(HighRequestRateTest, RPSLimitTest) {
 TEST_F(HighRequestRateTest, RPSStabilityTest) {
     // Test stability under sustained load
     const int iterations = 5;
-    const int requests_per_iteration = 2000;
+    // Large enough that one iteration outlasts scheduler jitter
+    const int requests_per_iteration = 20000;
     std::vector<double> rps_measurements;
 
-    for (int iter = 0; iter < iterations; ++iter) {
+    // Iteration -1 warms caches and the allocator and is not measured
+    for (int iter = -1; iter < iterations; ++iter) {
         auto start = high_resolution_clock::now();
 
         for (int i = 0; i < requests_per_iteration; ++i) {
@@ -138,10 +140,13 @@ TEST_F(HighRequestRateTest, RPSStabilityTest) {
         }
 
         auto end = high_resolution_clock::now();
-        auto duration = duration_cast<milliseconds>(end - start);
-        const auto ms = std::max<int64_t>(1, duration.count());
-        double rps = (requests_per_iteration * 1000.0) / static_cast<double>(ms);
-        rps_measurements.push_back(rps);
+        // An iteration takes well under a millisecond, so time it in microseconds
+        auto duration = duration_cast<microseconds>(end - start);
+        const auto us = std::max<int64_t>(1, duration.count());
+        double rps = (requests_per_iteration * 1000000.0) / static_cast<double>(us);
+        if (iter >= 0) {
+            rps_measurements.push_back(rps);
+        }
     }
 
     // Calculate variance
@@ -10,7 +10,35 @@
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <fstream>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#ifdef __linux__
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#endif
 #include "simple-dhcpd/core/network/udp_socket.hpp"
+#include "simple-dhcpd/core/network/event_loop.hpp"
+#include "simple-dhcpd/core/network/raw_sender.hpp"
+#include "simple-dhcpd/core/network/pcap_reader.hpp"
+#include "simple-dhcpd/core/network/metrics_exporter.hpp"
+#include "simple-dhcpd/core/network/ping_check.hpp"
+#include "simple-dhcpd/core/network/ddns.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
 
 using namespace simple_dhcpd;
@@ -110,7 +138,555 @@ TEST_F(UdpSocketTest, SocketExceptionOnReceiveWithoutBind) {
     }, UdpSocketException);
 }
 
+TEST_F(UdpSocketTest, PacketBufferPoolRecycles) {
+    PacketBufferPool pool(2);
+    EXPECT_EQ(pool.capacity(), 2u);
+
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+    EXPECT_FALSE(pool.acquire());
+
+    first->set_size(PacketBuffer::kCapacity + 100);
+    EXPECT_EQ(first->size(), PacketBuffer::kCapacity);
+
+    PacketBuffer* recycled = first.get();
+    first.reset();
+    auto third = pool.acquire();
+    EXPECT_EQ(third.get(), recycled);
+    EXPECT_EQ(third->size(), 0u);
+}
+
+TEST_F(UdpSocketTest, PacketCallbackReceive) {
+    UdpSocket server("127.0.0.1", 6782);
+    UdpSocket client("127.0.0.1", 6783);
+    server.bind();
+    client.bind();
+
+    std::mutex received_mutex;
+    std::vector<uint8_t> received_data;
+    uint16_t received_port = 0;
+    IpAddress received_address = 0;
+
+    server.start_receiving(PacketCallback([&](const PacketBuffer& packet) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received_data.assign(packet.view().begin(), packet.view().end());
+        received_port = packet.peer_port();
+        received_address = packet.peer_address();
+    }));
+
+    std::vector<uint8_t> test_data = {0x10, 0x20, 0x30};
+    client.send_to(test_data, "127.0.0.1", 6782);
+
+    for (int i = 0; i < 50; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(received_mutex);
+            if (!received_data.empty()) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    server.stop_receiving();
+
+    EXPECT_EQ(received_data, test_data);
+    EXPECT_EQ(received_port, 6783);
+    EXPECT_EQ(received_address, string_to_ip("127.0.0.1"));
+}
+
+TEST_F(UdpSocketTest, BatchedSendReceive) {
+    UdpSocket server("127.0.0.1", 6780);
+    UdpSocket client("127.0.0.1", 6781);
+    server.set_batch_mode(16, std::chrono::microseconds(500));
+    EXPECT_EQ(server.get_batch_size(), 16u);
+    server.bind();
+    client.bind();
+
+    // Echo every datagram back; replies are queued on the receive thread and
+    // leave in sendmmsg batches.
+    server.start_receiving([&](const std::vector<uint8_t>& data, const std::string& addr, uint16_t port) {
+        server.send_to(data, addr, port);
+    });
+
+    std::mutex echo_mutex;
+    std::set<uint8_t> echoed;
+    client.start_receiving([&](const std::vector<uint8_t>& data, const std::string&, uint16_t) {
+        std::lock_guard<std::mutex> lock(echo_mutex);
+        ASSERT_EQ(data.size(), 3u);
+        EXPECT_EQ(data[1], 0xAB);
+        echoed.insert(data[0]);
+    });
+
+    const int datagrams = 100;
+    for (int i = 0; i < datagrams; ++i) {
+        std::vector<uint8_t> payload = {static_cast<uint8_t>(i), 0xAB, 0xCD};
+        client.send_to(payload, "127.0.0.1", 6780);
+    }
+
+    for (int i = 0; i < 50; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(echo_mutex);
+            if (echoed.size() == static_cast<size_t>(datagrams)) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    server.stop_receiving();
+    client.stop_receiving();
+    EXPECT_EQ(echoed.size(), static_cast<size_t>(datagrams));
+}
+
+TEST_F(UdpSocketTest, ReusePortWorkersKeepClientOnOneSocket) {
+    DhcpConfig config;
+    config.listen_addresses = {"127.0.0.1:6776"};
+    config.worker_threads = 4;
+
+    DhcpSocketManager manager;
+    ASSERT_NO_THROW(manager.initialize(config));
+    EXPECT_EQ(manager.worker_count(), 4u);
+    EXPECT_EQ(manager.socket_count(), 4u);
+
+    std::mutex seen_mutex;
+    std::map<uint8_t, std::set<std::thread::id>> threads_by_client;
+    std::atomic<int> received(0);
+
+    manager.start_all([&](const std::vector<uint8_t>& data, const std::string&, uint16_t) {
+        std::lock_guard<std::mutex> lock(seen_mutex);
+        threads_by_client[data[offsetof(DhcpMessageHeader, chaddr) + 5]].insert(std::this_thread::get_id());
+        received++;
+    });
+
+    UdpSocket client("127.0.0.1", 6777);
+    client.bind();
+
+    const int clients = 16;
+    const int packets_per_client = 4;
+    for (int round = 0; round < packets_per_client; ++round) {
+        for (int i = 0; i < clients; ++i) {
+            std::vector<uint8_t> packet(sizeof(DhcpMessageHeader), 0);
+            DhcpMessageHeader* header = reinterpret_cast<DhcpMessageHeader*>(packet.data());
+            header->op = 1;
+            header->htype = 1;
+            header->hlen = 6;
+            header->chaddr[4] = 0x42;
+            header->chaddr[5] = static_cast<uint8_t>(i);
+            client.send_to(packet, "127.0.0.1", 6776);
+        }
+    }
+
+    for (int i = 0; i < 50 && received.load() < clients * packets_per_client; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    manager.stop_all();
+
+    EXPECT_EQ(received.load(), clients * packets_per_client);
+    for (const auto& entry : threads_by_client) {
+        EXPECT_EQ(entry.second.size(), 1u) << "client " << static_cast<int>(entry.first)
+                                           << " was served by several workers";
+    }
+}
+
+TEST_F(UdpSocketTest, SocketManagerReceivesAfterRestart) {
+    DhcpConfig config;
+    config.listen_addresses = {"127.0.0.1:6786"};
+    config.worker_threads = 2;
+    config.io_batch_size = 8;
+
+    DhcpSocketManager manager;
+    ASSERT_NO_THROW(manager.initialize(config));
+    UdpSocket client("127.0.0.1", 6787);
+    client.bind();
+    std::vector<uint8_t> packet(sizeof(DhcpMessageHeader), 0);
+
+    // As DhcpServer::stop() then start(): the same sockets receive again
+    std::atomic<int> received(0);
+    for (int cycle = 1; cycle <= 3; ++cycle) {
+        manager.start_all(PacketCallback([&](const PacketBuffer&) { received++; }));
+        for (int i = 0; i < 4; ++i) {
+            client.send_to(packet, "127.0.0.1", 6786);
+        }
+        for (int i = 0; i < 50 && received.load() < cycle * 4; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        manager.stop_all();
+        EXPECT_EQ(received.load(), cycle * 4) << "cycle " << cycle;
+    }
+}
+
 // IP Address Validation Tests
+TEST_F(UdpSocketTest, RepliesLeaveThroughIngressSocket) {
+    DhcpConfig config;
+    config.listen_addresses = {"127.0.0.1:6781", "127.0.0.1:6782"};
+
+    DhcpSocketManager manager;
+    ASSERT_NO_THROW(manager.initialize(config));
+
+    std::mutex seen_mutex;
+    PacketIngress seen;
+    manager.start_all(PacketCallback([&](const PacketBuffer& packet) {
+        {
+            std::lock_guard<std::mutex> lock(seen_mutex);
+            seen = packet.ingress();
+        }
+        manager.send_dhcp_packet(packet.view(), "127.0.0.1", packet.peer_port());
+    }));
+
+    UdpSocket client("127.0.0.1", 6783);
+    client.bind();
+    std::atomic<int> reply_port(0);
+    client.start_receiving(PacketCallback([&](const PacketBuffer& packet) { reply_port = packet.peer_port(); }));
+
+    std::vector<uint8_t> packet(32, 0x11);
+    client.send_to(packet, "127.0.0.1", 6782);
+    for (int i = 0; i < 50 && reply_port.load() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    client.stop_receiving();
+    manager.stop_all();
+
+    // The reply comes from the socket the request reached, not the first one
+    EXPECT_EQ(reply_port.load(), 6782);
+    std::lock_guard<std::mutex> lock(seen_mutex);
+    ASSERT_NE(seen.socket, nullptr);
+    EXPECT_EQ(seen.socket->get_port(), 6782);
+#ifdef __linux__
+    EXPECT_GT(seen.interface_index, 0);
+    EXPECT_FALSE(seen.interface_name.empty());
+    EXPECT_EQ(seen.local_address, string_to_ip("127.0.0.1"));
+#endif
+    EXPECT_EQ(UdpSocket::current_ingress(), nullptr);
+}
+
+TEST(EventLoopTest, WatchTimersAndPostOnEachBackend) {
+    for (EventBackendType type : {EventBackendType::EPOLL, EventBackendType::POLL}) {
+        EventLoop loop(type, "test loop");
+        loop.start();
+
+        int fds[2];
+        ASSERT_EQ(pipe(fds), 0);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        std::atomic<int> readable(0);
+        loop.watch(fds[0], [&]() {
+            char byte;
+            while (read(fds[0], &byte, 1) == 1) {
+                readable++;
+            }
+        });
+
+        std::atomic<int> ticks(0);
+        EventLoop::TimerId timer = loop.add_timer(std::chrono::milliseconds(5), [&]() { ticks++; });
+        std::atomic<bool> posted_on_loop(false);
+        loop.post([&]() { posted_on_loop = loop.in_loop_thread(); });
+
+        ASSERT_EQ(write(fds[1], "ab", 2), 2);
+        for (int i = 0; i < 100 && (readable.load() < 2 || ticks.load() < 3); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_EQ(readable.load(), 2) << loop.backend_name();
+        EXPECT_GE(ticks.load(), 3) << loop.backend_name();
+        EXPECT_TRUE(posted_on_loop.load()) << loop.backend_name();
+
+        // Nothing runs for an unwatched descriptor or a cancelled timer
+        loop.unwatch(fds[0]);
+        loop.cancel_timer(timer);
+        const int ticks_after_cancel = ticks.load();
+        ASSERT_EQ(write(fds[1], "c", 1), 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        EXPECT_EQ(readable.load(), 2) << loop.backend_name();
+        EXPECT_EQ(ticks.load(), ticks_after_cancel) << loop.backend_name();
+
+        loop.stop();
+        close(fds[0]);
+        close(fds[1]);
+    }
+    EXPECT_THROW(parse_event_backend("io_uring"), EventLoopException);
+}
+
+TEST_F(UdpSocketTest, SocketsShareOneEventLoop) {
+    EventLoop loop;
+    loop.start();
+
+    UdpSocket first("127.0.0.1", 6778);
+    UdpSocket second("127.0.0.1", 6779);
+    first.bind();
+    second.bind();
+
+    std::mutex seen_mutex;
+    std::set<std::thread::id> threads;
+    std::atomic<int> received(0);
+    auto callback = PacketCallback([&](const PacketBuffer&) {
+        std::lock_guard<std::mutex> lock(seen_mutex);
+        threads.insert(std::this_thread::get_id());
+        received++;
+    });
+    first.start_receiving(callback, loop);
+    second.start_receiving(callback, loop);
+
+    UdpSocket client("127.0.0.1", 6780);
+    client.bind();
+    std::vector<uint8_t> packet(32, 0x5a);
+    for (int i = 0; i < 10; ++i) {
+        client.send_to(packet, "127.0.0.1", 6778);
+        client.send_to(packet, "127.0.0.1", 6779);
+    }
+
+    for (int i = 0; i < 50 && received.load() < 20; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    first.stop_receiving();
+    second.stop_receiving();
+    loop.stop();
+
+    EXPECT_EQ(received.load(), 20);
+    EXPECT_EQ(threads.size(), 1u);
+}
+
+TEST(EventLoopTest, StopsFromItsOwnCallback) {
+    std::atomic<bool> ran(false);
+    {
+        EventLoop loop(EventBackendType::AUTO, "test loop");
+        loop.start();
+        loop.post([&]() { loop.stop(); });
+        for (int i = 0; i < 100 && loop.is_running(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_FALSE(loop.is_running());
+
+        // Restarting joins the stopped thread first
+        loop.start();
+        loop.post([&]() { ran = true; loop.stop(); });
+        for (int i = 0; i < 100 && !ran.load(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        // The destructor joins the thread that stopped itself
+    }
+    EXPECT_TRUE(ran.load());
+}
+
+TEST_F(UdpSocketTest, StopsReceivingFromItsCallback) {
+    std::atomic<int> received(0);
+    {
+        UdpSocket server("127.0.0.1", 6784);
+        server.bind();
+        server.start_receiving(PacketCallback([&](const PacketBuffer&) {
+            received++;
+            server.stop_receiving();
+        }));
+
+        UdpSocket client("127.0.0.1", 6785);
+        client.bind();
+        std::vector<uint8_t> packet(32, 0x5a);
+        client.send_to(packet, "127.0.0.1", 6784);
+        for (int i = 0; i < 50 && received.load() < 1; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_FALSE(server.is_receiving());
+
+        // Receiving again reuses the loop stopped under the callback
+        server.start_receiving(PacketCallback([&](const PacketBuffer&) { received++; }));
+        client.send_to(packet, "127.0.0.1", 6784);
+        for (int i = 0; i < 50 && received.load() < 2; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    EXPECT_EQ(received.load(), 2);
+}
+
+// One's complement sum over a checksummed block folds to 0xffff
+static uint16_t ones_sum(const uint8_t* data, size_t length, uint32_t sum = 0) {
+    for (size_t i = 0; i + 1 < length; i += 2) {
+        sum += static_cast<uint32_t>(data[i]) << 8 | data[i + 1];
+    }
+    if (length & 1) {
+        sum += static_cast<uint32_t>(data[length - 1]) << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+TEST(RawFrameSenderTest, BuildsChecksummedFrame) {
+    const MacAddress source = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const MacAddress client = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    const std::vector<uint8_t> payload = {'o', 'f', 'f', 'e', 'r'};
+    uint8_t frame[128];
+    const size_t length = RawFrameSender::build_frame(
+        frame, sizeof(frame), source, client, inet_addr("192.168.1.1"), 67, inet_addr("192.168.1.100"), 68,
+        ByteView(payload.data(), payload.size()));
+    ASSERT_EQ(length, RawFrameSender::kHeaderSize + payload.size());
+
+    EXPECT_EQ(0, std::memcmp(frame, client.data(), 6));
+    EXPECT_EQ(0, std::memcmp(frame + 6, source.data(), 6));
+    EXPECT_EQ(frame[12], 0x08);
+    EXPECT_EQ(frame[13], 0x00);
+
+    const uint8_t* ip = frame + 14;
+    EXPECT_EQ(ip[0], 0x45);
+    EXPECT_EQ(ip[9], 17);
+    EXPECT_EQ((ip[2] << 8) | ip[3], 20 + 8 + static_cast<int>(payload.size()));
+    EXPECT_EQ(ones_sum(ip, 20), 0xffff);
+
+    const uint8_t* udp = ip + 20;
+    EXPECT_EQ((udp[0] << 8) | udp[1], 67);
+    EXPECT_EQ((udp[2] << 8) | udp[3], 68);
+    const size_t udp_length = 8 + payload.size();
+    EXPECT_EQ(static_cast<size_t>((udp[4] << 8) | udp[5]), udp_length);
+    EXPECT_EQ(0, std::memcmp(udp + 8, payload.data(), payload.size()));
+    const uint32_t pseudo = ones_sum(ip + 12, 8) + 17 + static_cast<uint32_t>(udp_length);
+    EXPECT_EQ(ones_sum(udp, udp_length, pseudo), 0xffff);
+
+    EXPECT_EQ(RawFrameSender::build_frame(frame, RawFrameSender::kHeaderSize + 2, source, client, 0, 67, 0, 68,
+                                          ByteView(payload.data(), payload.size())), 0u);
+}
+
+#ifdef __linux__
+TEST(RawFrameSenderTest, TransmitsThroughLoopbackRing) {
+    const int loopback_index = static_cast<int>(if_nametoindex("lo"));
+    std::unique_ptr<RawFrameSender> sender;
+    try {
+        sender = std::make_unique<RawFrameSender>(loopback_index, 4);
+    } catch (const RawSocketException& e) {
+        GTEST_SKIP() << "No packet socket here: " << e.what();
+    }
+
+    // Routing drops 127/8 arriving without a route, so watch the link instead of a UDP socket
+    const int sniffer = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    ASSERT_GE(sniffer, 0);
+    struct sockaddr_ll link;
+    std::memset(&link, 0, sizeof(link));
+    link.sll_family = AF_PACKET;
+    link.sll_protocol = htons(ETH_P_ALL);
+    link.sll_ifindex = loopback_index;
+    ASSERT_EQ(bind(sniffer, reinterpret_cast<struct sockaddr*>(&link), sizeof(link)), 0);
+    struct timeval timeout = {0, 200000};
+    setsockopt(sniffer, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // More datagrams than slots: a full ring waits for the kernel and reuses them
+    const std::vector<uint8_t> payload(300, 0x42);
+    const IpAddress loopback = inet_addr("127.0.0.1");
+    const MacAddress no_mac{};
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_TRUE(sender->queue(no_mac, loopback, 6782, loopback, 6781, ByteView(payload.data(), payload.size())));
+    }
+    EXPECT_GT(sender->flush(), 0u);
+    EXPECT_EQ(sender->pending(), 0u);
+
+    int seen = 0;
+    uint8_t frame[2048];
+    for (;;) {
+        struct sockaddr_ll from;
+        socklen_t from_length = sizeof(from);
+        const ssize_t length = recvfrom(sniffer, frame, sizeof(frame), 0,
+                                        reinterpret_cast<struct sockaddr*>(&from), &from_length);
+        if (length < 0) {
+            break;
+        }
+        if (from.sll_pkttype == PACKET_OUTGOING &&
+            static_cast<size_t>(length) == RawFrameSender::kHeaderSize + payload.size() &&
+            frame[34] == (6782 >> 8) && frame[35] == (6782 & 0xff) &&
+            std::memcmp(frame + RawFrameSender::kHeaderSize, payload.data(), payload.size()) == 0) {
+            ++seen;
+        }
+    }
+    close(sniffer);
+    EXPECT_EQ(seen, 6);
+}
+#endif
+
+// Classic pcap file in host byte order with microsecond timestamps
+static void write_pcap(const std::string& path, uint32_t link_type,
+                       const std::vector<std::pair<uint32_t, std::vector<uint8_t>>>& frames) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    const uint32_t magic = 0xa1b2c3d4;
+    const uint16_t version[2] = {2, 4};
+    const uint32_t rest[4] = {0, 0, 65535, link_type};
+    file.write(reinterpret_cast<const char*>(&magic), 4);
+    file.write(reinterpret_cast<const char*>(version), 4);
+    file.write(reinterpret_cast<const char*>(rest), 16);
+    for (const auto& frame : frames) {
+        const uint32_t header[4] = {1700000000 + frame.first / 1000000, frame.first % 1000000,
+                                    static_cast<uint32_t>(frame.second.size()),
+                                    static_cast<uint32_t>(frame.second.size())};
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(frame.second.data()), static_cast<std::streamsize>(frame.second.size()));
+    }
+}
+
+static std::vector<uint8_t> udp_frame(const std::vector<uint8_t>& payload, uint16_t destination_port) {
+    const MacAddress relay = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const MacAddress server = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    std::vector<uint8_t> frame(RawFrameSender::kHeaderSize + payload.size());
+    frame.resize(RawFrameSender::build_frame(frame.data(), frame.size(), relay, server, inet_addr("10.1.0.1"), 67,
+                                             inet_addr("10.0.0.1"), destination_port,
+                                             ByteView(payload.data(), payload.size())));
+    return frame;
+}
+
+TEST(PcapReaderTest, ReadsUdpDatagramsAndSkipsTheRest) {
+    const std::vector<uint8_t> first = {'d', 'i', 's', 'c'};
+    const std::vector<uint8_t> second = {'r', 'e', 'q'};
+
+    std::vector<uint8_t> tagged = udp_frame(second, 67);
+    const uint8_t vlan[4] = {0x81, 0x00, 0x00, 0x2a};
+    tagged.insert(tagged.begin() + 12, vlan, vlan + 4);
+
+    std::vector<uint8_t> arp = udp_frame(first, 67);
+    arp[12] = 0x08;
+    arp[13] = 0x06;
+
+    std::vector<uint8_t> fragment = udp_frame(first, 67);
+    fragment[14 + 6] |= 0x20;    // more fragments
+
+    const std::string path = "/tmp/simple-dhcpd-test-capture.pcap";
+    write_pcap(path, 1, {{0, udp_frame(first, 67)}, {250, arp}, {500, fragment}, {1500000, tagged}});
+
+    PcapReader reader(path);
+    EXPECT_EQ(reader.link_type(), 1u);
+    PcapDatagram datagram;
+    ASSERT_TRUE(reader.next(datagram));
+    EXPECT_EQ(datagram.timestamp_ns, 1700000000ull * 1000000000ull);
+    EXPECT_EQ(datagram.source, inet_addr("10.1.0.1"));
+    EXPECT_EQ(datagram.destination, inet_addr("10.0.0.1"));
+    EXPECT_EQ(datagram.source_port, 67);
+    EXPECT_EQ(datagram.destination_port, 67);
+    EXPECT_EQ(std::vector<uint8_t>(datagram.payload.begin(), datagram.payload.end()), first);
+
+    ASSERT_TRUE(reader.next(datagram));
+    EXPECT_EQ(datagram.timestamp_ns, 1700000001ull * 1000000000ull + 500000000ull);
+    EXPECT_EQ(std::vector<uint8_t>(datagram.payload.begin(), datagram.payload.end()), second);
+    EXPECT_FALSE(reader.next(datagram));
+    EXPECT_EQ(reader.frames(), 4u);
+    EXPECT_EQ(reader.skipped(), 2u);
+
+    // Linux cooked capture: 16-byte header ending in the protocol
+    std::vector<uint8_t> cooked(16, 0);
+    cooked[14] = 0x08;
+    const std::vector<uint8_t> ethernet = udp_frame(first, 68);
+    cooked.insert(cooked.end(), ethernet.begin() + 14, ethernet.end());
+    ASSERT_TRUE(PcapReader::decode_frame(113, cooked.data(), cooked.size(), datagram));
+    EXPECT_EQ(datagram.destination_port, 68);
+    EXPECT_FALSE(PcapReader::decode_frame(113, cooked.data(), cooked.size() - 1, datagram));
+    std::remove(path.c_str());
+}
+
+TEST(PcapReaderTest, RejectsOtherFormats) {
+    const std::string path = "/tmp/simple-dhcpd-test-capture.pcapng";
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        const uint32_t block[6] = {0x0a0d0d0a, 28, 0x1a2b3c4d, 1, 0, 0};
+        file.write(reinterpret_cast<const char*>(block), sizeof(block));
+    }
+    EXPECT_THROW(PcapReader reader(path), PcapReaderException);
+    write_pcap(path, 105, {});    // 802.11
+    EXPECT_THROW(PcapReader reader(path), PcapReaderException);
+    EXPECT_THROW(PcapReader reader("/nonexistent/capture.pcap"), PcapReaderException);
+    std::remove(path.c_str());
+}
+
 class IpValidationTest : public ::testing::Test {
 protected:
     void SetUp() override {}
@@ -190,3 +766,307 @@ TEST_F(NetworkInterfaceTest, AnyInterface) {
     EXPECT_NO_THROW(socket.bind());
     EXPECT_TRUE(socket.is_bound());
 }
+
+// Metrics Exporter Tests
+namespace {
+std::string http_get(uint16_t port, const std::string& request_line) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::string response;
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+        const std::string request = request_line + "\r\nHost: localhost\r\n\r\n";
+        ::send(fd, request.data(), request.size(), 0);
+        char chunk[1024];
+        ssize_t n;
+        while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+            response.append(chunk, static_cast<size_t>(n));
+        }
+    }
+    ::close(fd);
+    return response;
+}
+}
+
+TEST(MetricsExporterTest, TextFormatEscapesLabels) {
+    MetricsText text;
+    text.family("test_total", "counter", "Test counter");
+    text.sample("test_total", uint64_t(42), {{"subnet", "lab \"a\"\\b"}, {"type", "x"}});
+    text.sample("test_ratio", 0.25);
+    EXPECT_EQ(text.str(),
+              "# HELP test_total Test counter\n"
+              "# TYPE test_total counter\n"
+              "test_total{subnet=\"lab \\\"a\\\"\\\\b\",type=\"x\"} 42\n"
+              "test_ratio 0.25\n");
+}
+
+TEST(MetricsExporterTest, ServesMetricsOverHttp) {
+    std::atomic<int> renders{0};
+    MetricsExporter exporter("127.0.0.1", 0, [&renders]() {
+        ++renders;
+        return std::string("simple_dhcpd_requests_total 7\n");
+    });
+    exporter.start();
+    ASSERT_NE(exporter.port(), 0);
+
+    const std::string ok = http_get(exporter.port(), "GET /metrics HTTP/1.1");
+    EXPECT_EQ(ok.compare(0, 15, "HTTP/1.1 200 OK"), 0) << ok;
+    EXPECT_NE(ok.find("Content-Type: text/plain; version=0.0.4"), std::string::npos);
+    EXPECT_NE(ok.find("\r\n\r\nsimple_dhcpd_requests_total 7\n"), std::string::npos);
+
+    const std::string missing = http_get(exporter.port(), "GET /other HTTP/1.1");
+    EXPECT_EQ(missing.compare(0, 12, "HTTP/1.1 404"), 0) << missing;
+    EXPECT_EQ(renders.load(), 1);
+    EXPECT_EQ(exporter.scrapes(), 1u);
+
+    // A second bind to the same port fails with the module's exception
+    MetricsExporter clash("127.0.0.1", exporter.port(), []() { return std::string(); });
+    EXPECT_THROW(clash.start(), MetricsExporterException);
+
+    exporter.stop();
+    EXPECT_TRUE(http_get(exporter.port(), "GET /metrics HTTP/1.1").empty());
+}
+
+TEST(PingCheckTest, EchoRequestChecksumFolds) {
+    const std::vector<uint8_t> request = PingChecker::build_echo_request(0x1234, 0xfffe);
+    ASSERT_EQ(request.size(), 16u);
+    EXPECT_EQ(request[0], 8);
+    EXPECT_EQ(request[4], 0x12);
+    EXPECT_EQ(request[7], 0xfe);
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < request.size(); i += 2) {
+        sum += static_cast<uint32_t>(request[i] << 8 | request[i + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    EXPECT_EQ(sum, 0xffffu);
+}
+
+TEST(PingCheckTest, ProbesAndCachesResults) {
+    EventLoop loop;
+    loop.start();
+    PingChecker checker(loop, std::chrono::milliseconds(200), std::chrono::seconds(60));
+    try {
+        checker.start();
+    } catch (const PingCheckException& e) {
+        GTEST_SKIP() << e.what();
+    }
+
+    const IpAddress loopback = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(checker.cached(loopback), PingStatus::UNKNOWN);
+
+    std::mutex mutex;
+    std::vector<bool> results;
+    auto done = [&](bool in_use) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.push_back(in_use);
+    };
+    ASSERT_TRUE(checker.probe(loopback, done));
+    // A second probe waits for the same reply, unless the first was answered already
+    ASSERT_TRUE(checker.probe(loopback, done));
+    for (int i = 0; i < 100; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (results.size() == 2) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(results.size(), 2u);
+        if (!results[0]) {
+            GTEST_SKIP() << "loopback does not answer ping here";
+        }
+        EXPECT_TRUE(results[1]);
+    }
+    EXPECT_GE(checker.probes_sent(), 1u);
+    EXPECT_EQ(checker.probes_answered(), checker.probes_sent());
+    EXPECT_EQ(checker.cached(loopback), PingStatus::IN_USE);
+    EXPECT_EQ(checker.cache_hits(), 1u);
+
+    checker.stop();
+    EXPECT_FALSE(checker.probe(loopback, done));
+    loop.stop();
+}
+
+TEST(PingCheckTest, UnansweredProbeTimesOut) {
+    EventLoop loop;
+    loop.start();
+    PingChecker checker(loop, std::chrono::milliseconds(50), std::chrono::seconds(60));
+    try {
+        checker.start();
+    } catch (const PingCheckException& e) {
+        GTEST_SKIP() << e.what();
+    }
+
+    // TEST-NET-2 (RFC 5737) is not assigned on the public internet
+    IpAddress unused = 0;
+    ASSERT_EQ(inet_pton(AF_INET, "198.51.100.1", &unused), 1);
+    std::atomic<int> answers{-1};
+    if (!checker.probe(unused, [&](bool in_use) { answers = in_use ? 1 : 0; })) {
+        GTEST_SKIP() << "no route for the probe";
+    }
+    for (int i = 0; i < 100 && answers.load() < 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (answers.load() == 1) {
+        GTEST_SKIP() << "198.51.100.1 answers ping on this network";
+    }
+    EXPECT_EQ(answers.load(), 0);
+    EXPECT_EQ(checker.probes_timed_out(), 1u);
+    EXPECT_EQ(checker.cached(unused), PingStatus::FREE);
+    checker.stop();
+    loop.stop();
+}
+
+TEST(DdnsTest, HostLabelAndReverseName) {
+    const std::string host = "My_Laptop-.corp.example";
+    EXPECT_EQ(DdnsUpdater::host_label(ByteView(reinterpret_cast<const uint8_t*>(host.data()), host.size())),
+              "mylaptop");
+    const std::string junk = "--_--";
+    EXPECT_EQ(DdnsUpdater::host_label(ByteView(reinterpret_cast<const uint8_t*>(junk.data()), junk.size())), "");
+    EXPECT_EQ(DdnsUpdater::reverse_name(string_to_ip("192.168.1.10")), "10.1.168.192.in-addr.arpa");
+
+    std::vector<uint8_t> wire;
+    DdnsUpdater::append_name(wire, "a.bc.");
+    EXPECT_EQ(wire, (std::vector<uint8_t>{1, 'a', 2, 'b', 'c', 0}));
+    EXPECT_THROW(DdnsUpdater::append_name(wire, "a..b"), DdnsException);
+
+    std::vector<uint8_t> secret;
+    ASSERT_TRUE(DdnsUpdater::decode_base64("MDEyMzQ1\nNjc4OQ==", secret));
+    EXPECT_EQ(std::string(secret.begin(), secret.end()), "0123456789");
+    EXPECT_FALSE(DdnsUpdater::decode_base64("abc", secret));
+}
+
+TEST(DdnsTest, SignAppendsVerifiableTsig) {
+    const std::vector<uint8_t> secret = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<uint8_t> message = {0x12, 0x34, 0x28, 0, 0, 1, 0, 0, 0, 0, 0, 0};
+    DdnsUpdater::append_name(message, "example.test");
+    message.insert(message.end(), {0, 6, 0, 1});
+    const std::vector<uint8_t> unsigned_message = message;
+    DdnsUpdater::sign(message, "DHCP-Key", secret, 0x0102030405ull);
+    EXPECT_EQ(message[11], 1);  // ARCOUNT
+
+    // Rebuild the RFC 8945 digest input and compare MACs
+    std::vector<uint8_t> digest = unsigned_message;
+    DdnsUpdater::append_name(digest, "dhcp-key");
+    digest.insert(digest.end(), {0, 255, 0, 0, 0, 0});
+    DdnsUpdater::append_name(digest, "hmac-sha256");
+    digest.insert(digest.end(), {0, 1, 2, 3, 4, 5, 0x01, 0x2c, 0, 0, 0, 0});
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_size = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()), digest.data(), digest.size(), mac, &mac_size);
+    ASSERT_EQ(mac_size, 32u);
+
+    std::vector<uint8_t> expected;
+    DdnsUpdater::append_name(expected, "dhcp-key");
+    expected.insert(expected.end(), {0, 250, 0, 255, 0, 0, 0, 0});
+    std::vector<uint8_t> rdata;
+    DdnsUpdater::append_name(rdata, "hmac-sha256");
+    rdata.insert(rdata.end(), {0, 1, 2, 3, 4, 5, 0x01, 0x2c, 0, 32});
+    rdata.insert(rdata.end(), mac, mac + mac_size);
+    rdata.insert(rdata.end(), {0x12, 0x34, 0, 0, 0, 0});
+    expected.push_back(0);
+    expected.push_back(static_cast<uint8_t>(rdata.size()));
+    expected.insert(expected.end(), rdata.begin(), rdata.end());
+    ASSERT_EQ(message.size(), unsigned_message.size() + expected.size());
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), message.begin() + unsigned_message.size()));
+}
+
+TEST(DdnsTest, SendsCoalescedSignedUpdates) {
+    // A DNS server that answers every framed UPDATE with NOERROR
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(::bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(::listen(listener, 4), 0);
+    socklen_t addr_length = sizeof(addr);
+    ASSERT_EQ(::getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &addr_length), 0);
+
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> received;
+    std::thread server([&]() {
+        const int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        for (;;) {
+            uint8_t length[2];
+            if (::recv(fd, length, 2, MSG_WAITALL) != 2) {
+                break;
+            }
+            std::vector<uint8_t> message(static_cast<size_t>(length[0] << 8 | length[1]));
+            if (::recv(fd, message.data(), message.size(), MSG_WAITALL) != static_cast<ssize_t>(message.size())) {
+                break;
+            }
+            const uint8_t reply[14] = {0, 12, message[0], message[1], 0xa8, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                received.push_back(std::move(message));
+            }
+            ::send(fd, reply, sizeof(reply), MSG_NOSIGNAL);
+        }
+        ::close(fd);
+    });
+
+    DhcpConfig config;
+    config.ddns_server = "127.0.0.1";
+    config.ddns_port = ntohs(addr.sin_port);
+    config.ddns_forward_zone = "example.test";
+    config.ddns_reverse_zone = "168.192.in-addr.arpa";
+    config.ddns_tsig_key = "dhcp-key";
+    config.ddns_tsig_secret = "MDEyMzQ1Njc4OWFiY2RlZg==";
+    DdnsUpdater updater(config);
+
+    const auto wait_for = [&updater](uint64_t records) {
+        for (int i = 0; i < 500 && updater.get_statistics().records_updated < records; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return updater.get_statistics().records_updated;
+    };
+
+    // Queued before the thread runs, so both land in the same drain
+    const IpAddress ip = string_to_ip("192.168.1.10");
+    ASSERT_TRUE(updater.add("laptop", ip));
+    ASSERT_TRUE(updater.add("desktop", ip));
+    EXPECT_FALSE(updater.add("", ip));
+    updater.start();
+    EXPECT_EQ(wait_for(1), 1u);
+    EXPECT_EQ(updater.get_statistics().coalesced, 1u);
+
+    // Registered already: no message
+    ASSERT_TRUE(updater.add("desktop", ip));
+    ASSERT_TRUE(updater.remove(ip));
+    EXPECT_EQ(wait_for(2), 2u);
+
+    const DdnsStats stats = updater.get_statistics();
+    EXPECT_EQ(stats.queue_depth, 0u);
+    EXPECT_EQ(stats.latency_count, 2u);
+    EXPECT_EQ(stats.failures, 0u);
+    updater.stop();
+    server.join();
+    ::close(listener);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(received.size(), 4u);   // forward and reverse, add then remove
+    EXPECT_EQ(stats.updates_sent, 4u);
+    const std::string desktop = "\x07" "desktop";
+    const std::string laptop = "\x06" "laptop";
+    for (const auto& message : received) {
+        ASSERT_GE(message.size(), 12u);
+        EXPECT_EQ(message[2] >> 3, 5);      // opcode UPDATE
+        EXPECT_EQ(message[11], 1);          // the TSIG record
+        const std::string text(message.begin(), message.end());
+        EXPECT_EQ(text.find(laptop), std::string::npos);
+        EXPECT_NE(text.find("hmac-sha256"), std::string::npos);
+    }
+    EXPECT_NE(std::string(received[0].begin(), received[0].end()).find(desktop), std::string::npos);
+}
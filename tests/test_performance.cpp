@@ -9,14 +9,36 @@
 #include <gtest/gtest.h>
 #include <chrono>
 #include <vector>
+#include <set>
 #include <thread>
+#include <mutex>
 #include <atomic>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <cstdio>
+#include <fstream>
 #include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
+#include "simple-dhcpd/core/options/subnet_options.hpp"
+#include "simple-dhcpd/core/options/manager.hpp"
 #include "simple-dhcpd/core/types.hpp"
 #include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/lease/lease_store.hpp"
+#include "simple-dhcpd/core/lease/journal.hpp"
+#include "simple-dhcpd/core/lease/snapshot.hpp"
 #include "simple-dhcpd/core/config/manager.hpp"
+#include "simple-dhcpd/core/config/subnet_index.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
+#include "simple-dhcpd/core/utils/stat_counters.hpp"
+#include "simple-dhcpd/core/utils/latency_histogram.hpp"
+#include "simple-dhcpd/core/network/udp_socket.hpp"
+#include "simple-dhcpd/production/security/rate_limiter.hpp"
+#include "simple-dhcpd/production/security/filter_table.hpp"
+#include "simple-dhcpd/production/security/manager.hpp"
+#include <sys/socket.h>
 
 using namespace simple_dhcpd;
 using namespace std::chrono;
@@ -95,6 +117,246 @@ TEST_F(ThroughputTest, MessageParsingThroughput) {
     std::cout << "Message parsing throughput: " << rps << " messages/sec" << std::endl;
 }
 
+TEST_F(ThroughputTest, MessageViewParsingThroughput) {
+    std::vector<uint8_t> discover(sizeof(DhcpMessageHeader) + 64, 0);
+    DhcpMessageHeader* header = reinterpret_cast<DhcpMessageHeader*>(discover.data());
+    header->op = 1;
+    header->htype = 1;
+    header->hlen = 6;
+
+    // A typical DISCOVER: type, client id, requested IP, hostname, PRL, max size, vendor class
+    size_t offset = sizeof(DhcpMessageHeader);
+    const uint8_t options[] = {
+        99, 130, 83, 99,
+        53, 1, 1,
+        61, 7, 1, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+        50, 4, 10, 0, 0, 42,
+        12, 6, 'c', 'l', 'i', 'e', 'n', 't',
+        55, 8, 1, 3, 6, 15, 28, 42, 51, 58,
+        57, 2, 0x05, 0xDC,
+        60, 8, 'M', 'S', 'F', 'T', ' ', '5', '.', '0',
+        255
+    };
+    ASSERT_LE(offset + sizeof(options), discover.size());
+    memcpy(discover.data() + offset, options, sizeof(options));
+
+    const int iterations = 100000;
+
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        DhcpMessage message = DhcpParser::parse_message(discover);
+        ASSERT_EQ(message.message_type, DhcpMessageType::DISCOVER);
+    }
+    double owned_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        DhcpMessageView view(discover.data(), discover.size());
+        ASSERT_TRUE(view.has_option(DhcpOptionCode::PARAMETER_REQUEST_LIST));
+    }
+    double view_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+    double owned_rps = (iterations * 1000000.0) / std::max(1.0, owned_us);
+    double view_rps = (iterations * 1000000.0) / std::max(1.0, view_us);
+
+    EXPECT_GT(view_rps, 100000.0) << "View parsing throughput: " << view_rps << " messages/sec";
+
+    std::cout << "Owning parse throughput: " << owned_rps << " messages/sec" << std::endl;
+    std::cout << "View parse throughput: " << view_rps << " messages/sec" << std::endl;
+}
+
+TEST_F(ThroughputTest, ReplyEncodingThroughput) {
+    const DhcpSubnet& subnet = config_manager_->get_config().subnets[0];
+    DhcpMessageBuilder builder;
+    builder.set_message_type(DhcpMessageType::OFFER)
+           .set_transaction_id(0x12345678)
+           .set_client_mac({0x00, 0x11, 0x22, 0x33, 0x44, 0x55})
+           .set_your_ip(string_to_ip("10.0.0.42"))
+           .set_server_ip(string_to_ip("10.0.0.1"))
+           .add_option(DhcpOptionCode::DHCP_MESSAGE_TYPE,
+                       std::vector<uint8_t>{message_type_to_option_value(DhcpMessageType::OFFER)})
+           .add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, string_to_ip("10.0.0.1"))
+           .add_option(DhcpOptionCode::SUBNET_MASK, ip_to_bytes_be(subnet_mask_for_prefix(subnet.prefix_length)))
+           .add_option(DhcpOptionCode::ROUTER, ip_to_bytes_be(string_to_ip("10.0.0.1")))
+           .add_option(DhcpOptionCode::DOMAIN_SERVER, std::vector<uint8_t>{8, 8, 8, 8, 8, 8, 4, 4})
+           .add_option(DhcpOptionCode::DOMAIN_NAME, std::string("example.com"))
+           .add_option(DhcpOptionCode::IP_ADDRESS_LEASE_TIME, uint32_to_option_bytes(subnet.lease_time))
+           .add_option(DhcpOptionCode::RENEWAL_TIME, uint32_to_option_bytes(subnet.lease_time / 2))
+           .add_option(DhcpOptionCode::REBINDING_TIME, uint32_to_option_bytes(subnet.lease_time * 7 / 8));
+    DhcpMessage offer = builder.build();
+    DhcpMessage ack = offer;
+    ack.message_type = DhcpMessageType::ACK;
+    ack.options[0].data[0] = message_type_to_option_value(DhcpMessageType::ACK);
+
+    const int iterations = 100000;
+    size_t bytes = 0;
+
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        bytes += DhcpMessageWriter::encode((i & 1) ? ack : offer).size();
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    double eps = (iterations * 1000000.0) / std::max<int64_t>(1, duration.count());
+    EXPECT_GT(bytes, 0u);
+    EXPECT_GT(eps, 100000.0) << "OFFER/ACK encode throughput: " << eps << " messages/sec";
+
+    std::cout << "OFFER/ACK encode throughput: " << eps << " messages/sec" << std::endl;
+}
+
+TEST_F(ThroughputTest, CompiledSubnetOptionsThroughput) {
+    DhcpSubnet subnet = config_manager_->get_config().subnets[0];
+    subnet.gateway = string_to_ip("10.0.0.1");
+    subnet.dns_servers = {string_to_ip("8.8.8.8"), string_to_ip("8.8.4.4")};
+    subnet.domain_name = "example.com";
+    const IpAddress sid = string_to_ip("10.0.0.1");
+    const CompiledSubnetOptions compiled = CompiledSubnetOptions::compile(subnet, sid);
+
+    DhcpMessageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.op = 2;
+    header.htype = 1;
+    header.hlen = 6;
+
+    const int iterations = 100000;
+    size_t builder_bytes = 0;
+    size_t blob_bytes = 0;
+
+    // Per-reply option vectors, as the server built them before
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        DhcpMessageBuilder builder;
+        builder.set_message_type(DhcpMessageType::OFFER)
+               .set_your_ip(string_to_ip("10.0.0.42"))
+               .set_server_ip(sid)
+               .add_option(DhcpOptionCode::DHCP_MESSAGE_TYPE,
+                           std::vector<uint8_t>{message_type_to_option_value(DhcpMessageType::OFFER)})
+               .add_option_ip(DhcpOptionCode::SERVER_IDENTIFIER, sid)
+               .add_option(DhcpOptionCode::SUBNET_MASK, ip_to_bytes_be(subnet_mask_for_prefix(subnet.prefix_length)))
+               .add_option(DhcpOptionCode::ROUTER, ip_to_bytes_be(subnet.gateway))
+               .add_option(DhcpOptionCode::DOMAIN_SERVER, std::vector<uint8_t>{8, 8, 8, 8, 8, 8, 4, 4})
+               .add_option(DhcpOptionCode::DOMAIN_NAME, subnet.domain_name)
+               .add_option(DhcpOptionCode::IP_ADDRESS_LEASE_TIME, uint32_to_option_bytes(subnet.lease_time))
+               .add_option(DhcpOptionCode::RENEWAL_TIME, uint32_to_option_bytes(subnet.lease_time / 2))
+               .add_option(DhcpOptionCode::REBINDING_TIME, uint32_to_option_bytes(subnet.lease_time * 7 / 8));
+        builder_bytes += DhcpMessageWriter::encode(builder.build()).size();
+    }
+    auto builder_duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        DhcpMessageWriter& writer = DhcpMessageWriter::for_current_thread();
+        header.yiaddr = string_to_ip("10.0.0.42");
+        writer.begin(header);
+        writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(DhcpMessageType::OFFER));
+        compiled.write(writer, subnet.lease_time, sid);
+        blob_bytes += writer.finish().size();
+    }
+    auto blob_duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    double builder_rate = (iterations * 1000000.0) / std::max<int64_t>(1, builder_duration.count());
+    double blob_rate = (iterations * 1000000.0) / std::max<int64_t>(1, blob_duration.count());
+    EXPECT_GT(builder_bytes, 0u);
+    EXPECT_GT(blob_bytes, 0u);
+    EXPECT_GT(blob_rate, 100000.0) << "Compiled options reply rate: " << blob_rate << " replies/sec";
+
+    std::cout << "Builder reply rate: " << builder_rate << " replies/sec" << std::endl;
+    std::cout << "Compiled options reply rate: " << blob_rate << " replies/sec" << std::endl;
+}
+
+TEST_F(ThroughputTest, OptionResolutionPlanThroughput) {
+    DhcpOptionsManager options;
+    OptionMap global = {{DhcpOptionCode::DOMAIN_SERVER, {8, 8, 8, 8, 8, 8, 4, 4}},
+                        {DhcpOptionCode::DOMAIN_NAME, {'e', 'x', 'a', 'm', 'p', 'l', 'e'}},
+                        {DhcpOptionCode::NTP_SERVERS, {10, 0, 0, 123}}};
+    options.set_global_options(global);
+    std::map<std::string, OptionMap> subnets;
+    for (int i = 0; i < 64; ++i) {
+        const std::string name = "subnet-" + std::to_string(i);
+        subnets[name] = {{DhcpOptionCode::ROUTER, {10, static_cast<uint8_t>(i), 0, 1}}};
+        options.set_subnet_options(name, subnets[name]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        OptionInheritanceRule rule("global", "subnet", DhcpOptionCode::NTP_SERVERS, i % 2 == 0);
+        rule.condition = i % 4 == 0 ? "vendor_class" : "";
+        options.add_inheritance_rule(rule);
+    }
+    const OptionMap host = {{DhcpOptionCode::HOST_NAME, {'h', 'o', 's', 't'}}};
+    const std::vector<DhcpOptionCode> requested = {DhcpOptionCode::SUBNET_MASK, DhcpOptionCode::ROUTER,
+                                                   DhcpOptionCode::DOMAIN_SERVER, DhcpOptionCode::DOMAIN_NAME,
+                                                   DhcpOptionCode::HOST_NAME, DhcpOptionCode::NTP_SERVERS};
+    OptionsContext context;
+    context.vendor_class = "MSFT 5.0";
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 64; ++i) {
+        names.push_back("subnet-" + std::to_string(i));
+    }
+    const int iterations = 100000;
+    size_t merged_options = 0;
+    size_t resolved_options = 0;
+
+    // Merging the scope maps per client, as before
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        context.subnet_name = names[i & 63];
+        const OptionMap merged = options.apply_inheritance(global, subnets[context.subnet_name], {}, host, context);
+        for (const auto code : requested) {
+            merged_options += merged.count(code);
+        }
+    }
+    auto merge_duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    ResolvedOptions resolved;
+    start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        context.subnet_name = names[i & 63];
+        options.process_client_request(requested, context, &host, resolved);
+        resolved_options += resolved.size();
+    }
+    auto plan_duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    double merge_rate = (iterations * 1000000.0) / std::max<int64_t>(1, merge_duration.count());
+    double plan_rate = (iterations * 1000000.0) / std::max<int64_t>(1, plan_duration.count());
+    EXPECT_EQ(merged_options, resolved_options);
+    EXPECT_GT(plan_rate, 100000.0) << "Plan resolution rate: " << plan_rate << " requests/sec";
+
+    std::cout << "Per-request merge rate: " << merge_rate << " requests/sec" << std::endl;
+    std::cout << "Plan resolution rate: " << plan_rate << " requests/sec" << std::endl;
+}
+
+TEST_F(ThroughputTest, SubnetLookupThroughput) {
+    // Relay-fed deployment: thousands of /24s selected by giaddr
+    const size_t subnet_count = 3000;
+    std::vector<DhcpSubnet> subnets(subnet_count);
+    for (size_t i = 0; i < subnet_count; ++i) {
+        subnets[i].name = "relay-" + std::to_string(i);
+        subnets[i].network = htonl(0x0A000000u | static_cast<uint32_t>(i << 8));
+        subnets[i].prefix_length = 24;
+        subnets[i].range_start = htonl(ntohl(subnets[i].network) + 10);
+        subnets[i].range_end = htonl(ntohl(subnets[i].network) + 250);
+    }
+
+    SubnetIndex index;
+    index.build(subnets);
+
+    const int iterations = 200000;
+    uint64_t checksum = 0;
+
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        const uint32_t subnet = static_cast<uint32_t>((i * 7919) % subnet_count);
+        checksum += index.find_by_address(htonl(0x0A000000u | (subnet << 8) | 1u));
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    double lps = (iterations * 1000000.0) / std::max<int64_t>(1, duration.count());
+    EXPECT_GT(checksum, 0u);
+    EXPECT_GT(lps, 1000000.0) << "Subnet lookup throughput: " << lps << " lookups/sec";
+
+    std::cout << "Subnet lookup throughput (" << subnet_count << " subnets): " << lps << " lookups/sec" << std::endl;
+}
+
 TEST_F(ThroughputTest, LeaseAllocationThroughput) {
     const DhcpSubnet& subnet = config_manager_->get_config().subnets[0];
     const int iterations = 1000;
@@ -120,6 +382,293 @@ TEST_F(ThroughputTest, LeaseAllocationThroughput) {
     std::cout << "Lease allocation throughput: " << leases_per_sec << " leases/sec" << std::endl;
 }
 
+TEST_F(ThroughputTest, JournalGroupCommitThroughput) {
+    const std::string path = "/tmp/simple-dhcpd-perf-journal";
+    std::remove(path.c_str());
+
+    const int threads = 8;
+    const int per_thread = 250;
+    uint64_t records = 0;
+    uint64_t commits = 0;
+    auto start = high_resolution_clock::now();
+    {
+        LeaseJournal journal(path);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&journal, t] {
+                DhcpLease lease;
+                lease.mac_address = {0x02, 0x00, 0x00, 0x00, static_cast<uint8_t>(t), 0x00};
+                lease.is_active = true;
+                for (int i = 0; i < per_thread; ++i) {
+                    // Every caller waits for its own record, as allocate_lease does
+                    lease.mac_address[5] = static_cast<uint8_t>(i);
+                    lease.ip_address = htonl(0x0A000000u + static_cast<uint32_t>(t * per_thread + i));
+                    journal.wait_durable(journal.append(JournalOp::ALLOCATE, lease));
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        records = journal.record_count();
+        commits = journal.commit_count();
+    }
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start);
+
+    EXPECT_EQ(records, static_cast<uint64_t>(threads * per_thread));
+    EXPECT_EQ(LeaseJournal::replay(path, nullptr), records);
+    // Concurrent waiters share fdatasync rounds
+    EXPECT_LT(commits, records) << "Commits: " << commits << " for " << records << " records";
+
+    double records_per_sec = (records * 1000000.0) / std::max<int64_t>(duration.count(), 1);
+    std::cout << "Journal group commit: " << records_per_sec << " durable records/sec, "
+              << (static_cast<double>(records) / std::max<uint64_t>(commits, 1)) << " records/fdatasync" << std::endl;
+    std::remove(path.c_str());
+}
+
+TEST_F(ThroughputTest, AsyncLoggingThroughput) {
+    const std::string path = "/tmp/simple-dhcpd-perf-log";
+    const int threads = 4;
+    const int per_thread = 5000;
+
+    // Time how long the logging threads are held up, with and without a writer thread
+    auto run = [&](bool async) {
+        std::remove(path.c_str());
+        Logger logger(path, LogLevel::INFO);
+        logger.set_console_output(false);
+        if (async) {
+            logger.start_async(threads * per_thread, std::chrono::milliseconds(100), LogOverflowPolicy::BLOCK);
+        }
+        auto start = high_resolution_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&logger, per_thread, t] {
+                for (int i = 0; i < per_thread; ++i) {
+                    logger.info("Received DHCP DISCOVER from 02:00:00:00:00:" + std::to_string(t) +
+                                " (0.0.0.0) #" + std::to_string(i));
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        logger.flush();
+        EXPECT_EQ(logger.dropped_count(), 0u);
+        return std::max<int64_t>(duration.count(), 1);
+    };
+
+    const int64_t sync_us = run(false);
+    const int64_t async_us = run(true);
+    std::remove(path.c_str());
+
+    const double lines = threads * per_thread;
+    std::cout << "Logging: sync " << (lines * 1000000.0 / sync_us) << " lines/sec, async "
+              << (lines * 1000000.0 / async_us) << " lines/sec" << std::endl;
+    // Callers no longer wait on the file stream lock and a flush per line
+    EXPECT_LT(async_us, sync_us);
+}
+
+TEST_F(ThroughputTest, RateLimiterThroughput) {
+    RateLimiter limiter;
+    limiter.set_rules({RateLimitRule{"*", "mac", 10, std::chrono::seconds(1)}});
+
+    // A spoofed-MAC flood: every request from a client not seen recently
+    const int threads = 4;
+    const int per_thread = 250000;
+    std::atomic<uint64_t> denied{0};
+    auto start = high_resolution_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&limiter, &denied, per_thread, t] {
+            uint64_t local_denied = 0;
+            for (int i = 0; i < per_thread; ++i) {
+                const MacAddress mac = {0x06, static_cast<uint8_t>(t), static_cast<uint8_t>(i >> 16),
+                                        static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i), 0x00};
+                if (limiter.check(mac) != RateLimitVerdict::ALLOWED) {
+                    ++local_denied;
+                }
+            }
+            denied += local_denied;
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    const double checks_per_sec = (threads * per_thread * 1000000.0) / std::max<int64_t>(duration.count(), 1);
+    EXPECT_EQ(denied.load(), 0u);
+    EXPECT_LE(limiter.size(), RateLimiter::kDefaultCapacity);
+    EXPECT_GT(checks_per_sec, 500000.0) << "Rate limiter: " << checks_per_sec << " checks/sec";
+    std::cout << "Rate limiter: " << checks_per_sec << " checks/sec, " << limiter.evictions()
+              << " evictions, " << limiter.size() << " tracked" << std::endl;
+}
+
+TEST_F(ThroughputTest, MacFilterLookupWithLargeRuleSet) {
+    // A NAC-sized list: 50k exact entries behind a few OUI rules
+    std::vector<MacFilterRule> rules;
+    rules.emplace_back("00:00:5e:*", false, "deny VRRP OUI");
+    rules.emplace_back("02:00:00:*", true, "allow lab OUI");
+    for (uint32_t i = 0; i < 50000; ++i) {
+        char mac[18];
+        std::snprintf(mac, sizeof(mac), "0a:%02x:%02x:%02x:00:01", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+        rules.emplace_back(mac, i % 2 == 0, "nac");
+    }
+    rules.emplace_back("*", false, "default deny");
+
+    auto build_start = high_resolution_clock::now();
+    MacFilterTable table(rules);
+    auto build_ms = duration_cast<milliseconds>(high_resolution_clock::now() - build_start).count();
+
+    const int iterations = 1000000;
+    uint64_t allowed = 0;
+    uint64_t expected = 0;
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        const uint32_t n = static_cast<uint32_t>(i) % 60000;
+        const MacAddress mac = {0x0a, static_cast<uint8_t>(n >> 16), static_cast<uint8_t>(n >> 8),
+                                static_cast<uint8_t>(n), 0x00, 0x01};
+        allowed += table.match(mac) == FilterMatch::ALLOW;
+        // Even entries allow; MACs past the list fall to the default deny
+        expected += n < 50000 && n % 2 == 0;
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    EXPECT_EQ(allowed, expected);
+    const double lookups_per_sec = (iterations * 1000000.0) / std::max<int64_t>(duration.count(), 1);
+    EXPECT_GT(lookups_per_sec, 1000000.0) << "MAC filter: " << lookups_per_sec << " lookups/sec";
+    std::cout << "MAC filter (" << rules.size() << " rules, built in " << build_ms << " ms): "
+              << lookups_per_sec << " lookups/sec" << std::endl;
+}
+
+TEST_F(ThroughputTest, SecurityEventFloodThroughput) {
+    DhcpSecurityManager manager;
+    std::atomic<uint64_t> callbacks{0};
+    manager.set_security_event_callback([&callbacks](const SecurityEvent&) { ++callbacks; });
+    manager.start();
+
+    // A rate-limit storm: the same few events over and over from every worker
+    const int threads = 4;
+    const int per_thread = 50000;
+    auto start = high_resolution_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&manager, per_thread, t] {
+            const std::string mac = "02:00:00:00:00:0" + std::to_string(t);
+            for (int i = 0; i < per_thread; ++i) {
+                manager.report_security_event(SecurityEvent(SecurityEventType::RATE_LIMIT_EXCEEDED,
+                                                            ThreatLevel::MEDIUM, "Rate limit exceeded", mac));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    manager.flush_security_events();
+
+    // The newest hundred events out of a full history
+    const auto history = manager.get_security_events();
+    const auto since = history[history.size() - 100].timestamp;
+    const auto query_start = high_resolution_clock::now();
+    const int queries = 1000;
+    size_t returned = 0;
+    for (int i = 0; i < queries; ++i) {
+        returned += manager.get_security_events(since, system_clock::now(), SecurityEventType::ANY).size();
+    }
+    auto query_duration = duration_cast<microseconds>(high_resolution_clock::now() - query_start);
+
+    const double events_per_sec = (threads * per_thread * 1000000.0) / std::max<int64_t>(duration.count(), 1);
+    EXPECT_EQ(history.size(), SecurityEventLog::kDefaultCapacity);
+    EXPECT_LT(callbacks.load(), static_cast<uint64_t>(threads * per_thread / 10));
+    EXPECT_GT(events_per_sec, 50000.0) << "Security events: " << events_per_sec << " events/sec";
+    std::cout << "Security events: " << events_per_sec << " events/sec, " << callbacks.load()
+              << " deliveries, " << (query_duration.count() / queries) << " us per range query ("
+              << returned / queries << " events)" << std::endl;
+    manager.stop();
+}
+
+TEST_F(ThroughputTest, StatCountersThroughput) {
+    enum class Counter { REQUESTS, REPLIES, COUNT };
+    const int threads = 4;
+    const int per_thread = 1000000;
+
+    // The old scheme: one struct behind one mutex
+    std::mutex stats_mutex;
+    uint64_t locked_counts[2] = {0, 0};
+    auto locked_start = high_resolution_clock::now();
+    {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&stats_mutex, &locked_counts, per_thread] {
+                for (int i = 0; i < per_thread; ++i) {
+                    std::lock_guard<std::mutex> lock(stats_mutex);
+                    ++locked_counts[i & 1];
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    auto locked_duration = duration_cast<microseconds>(high_resolution_clock::now() - locked_start);
+
+    StatCounters<Counter> counters;
+    auto start = high_resolution_clock::now();
+    {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&counters, per_thread] {
+                for (int i = 0; i < per_thread; ++i) {
+                    counters.increment((i & 1) ? Counter::REPLIES : Counter::REQUESTS);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    const auto totals = counters.snapshot();
+    EXPECT_EQ(totals[0] + totals[1], static_cast<uint64_t>(threads * per_thread));
+    EXPECT_EQ(locked_counts[0] + locked_counts[1], static_cast<uint64_t>(threads * per_thread));
+    const double locked_per_sec = (threads * per_thread * 1000000.0) / std::max<int64_t>(locked_duration.count(), 1);
+    const double per_sec = (threads * per_thread * 1000000.0) / std::max<int64_t>(duration.count(), 1);
+    EXPECT_GT(per_sec, 1000000.0) << "Stat counters: " << per_sec << " increments/sec";
+    std::cout << "Stat counters: " << per_sec << " increments/sec (mutex: " << locked_per_sec << ")" << std::endl;
+}
+
+TEST_F(ThroughputTest, PipelineLatencyOverhead) {
+    // What the instrumentation adds to one DISCOVER: five marks and a total
+    PipelineLatency latency;
+    const int packets = 1000000;
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < packets; ++i) {
+        latency.begin();
+        latency.set_message_type(DhcpMessageType::DISCOVER);
+        latency.mark(PipelineStage::PARSE);
+        latency.mark(PipelineStage::SECURITY);
+        latency.mark(PipelineStage::LEASE);
+        latency.mark(PipelineStage::REPLY);
+        latency.mark(PipelineStage::SEND);
+        latency.finish();
+    }
+    auto duration = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+    const double ns_per_packet = static_cast<double>(duration.count()) / packets;
+    EXPECT_LT(ns_per_packet, 5000.0) << "Pipeline latency: " << ns_per_packet << " ns/packet";
+    std::cout << "Pipeline latency instrumentation: " << ns_per_packet << " ns/packet" << std::endl;
+    for (const auto& summary : latency.summaries()) {
+        if (summary.stage == "total") {
+            std::cout << "  " << summary.message_type << " total p50 " << summary.p50_ns << " ns, p99 "
+                      << summary.p99_ns << " ns" << std::endl;
+        }
+    }
+}
+
 // Performance Test: Latency
 class LatencyTest : public ::testing::Test {
 protected:
@@ -204,6 +753,109 @@ protected:
     std::unique_ptr<LeaseManager> lease_manager_;
 };
 
+/**
+ * @brief Lease manager with the expiry pass exposed
+ */
+class SweepableLeaseManager : public LeaseManager {
+public:
+    using LeaseManager::LeaseManager;
+    using LeaseManager::cleanup_expired_leases;
+};
+
+TEST_F(LatencyTest, ExpiryPassCost) {
+    DhcpConfig config;
+    config.enable_logging = false;
+    DhcpSubnet subnet;
+    subnet.name = "pool-16";
+    subnet.network = string_to_ip("10.20.0.0");
+    subnet.prefix_length = 16;
+    subnet.range_start = string_to_ip("10.20.0.1");
+    subnet.range_end = string_to_ip("10.20.255.254");
+    subnet.lease_time = 3600;
+    config.subnets.push_back(subnet);
+
+    SweepableLeaseManager manager(config);
+    const uint32_t lease_count = 60000;
+    for (uint32_t i = 0; i < lease_count; ++i) {
+        manager.allocate_lease(MacAddress{0x02, 0x00, 0x00, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)},
+                               0, subnet.name);
+    }
+
+    // No lease is due: a pass only peeks at each shard's earliest deadline
+    const int passes = 100;
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < passes; ++i) {
+        manager.cleanup_expired_leases();
+    }
+    const double pass_us = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0 / passes;
+
+    EXPECT_EQ(manager.get_statistics().active_leases, lease_count);
+    EXPECT_LT(pass_us, 1000.0) << "Expiry pass over " << lease_count << " leases: " << pass_us << " us";
+
+    std::cout << "Expiry pass with " << lease_count << " leases, none due: " << pass_us << " us" << std::endl;
+}
+
+TEST_F(LatencyTest, AllocationLatencyByUtilization) {
+    DhcpConfig config;
+    config.enable_logging = false;
+    DhcpSubnet subnet;
+    subnet.name = "pool-16";
+    subnet.network = string_to_ip("10.10.0.0");
+    subnet.prefix_length = 16;
+    subnet.range_start = string_to_ip("10.10.0.1");
+    subnet.range_end = string_to_ip("10.10.255.254");
+    subnet.lease_time = 3600;
+    config.subnets.push_back(subnet);
+
+    LeaseManager manager(config);
+    const size_t pool_size = ntohl(subnet.range_end) - ntohl(subnet.range_start) + 1;
+    auto mac_for = [](uint32_t n) {
+        return MacAddress{0x02, 0x00, static_cast<uint8_t>(n >> 24), static_cast<uint8_t>(n >> 16),
+                          static_cast<uint8_t>(n >> 8), static_cast<uint8_t>(n)};
+    };
+
+    // Fill the pool, then release a scattered subset to reach each utilization
+    std::vector<DhcpLease> leases;
+    leases.reserve(pool_size);
+    for (uint32_t i = 0; i < pool_size; ++i) {
+        leases.push_back(manager.allocate_lease(mac_for(i), 0, subnet.name));
+    }
+    std::vector<size_t> order(pool_size);
+    for (size_t i = 0; i < pool_size; ++i) {
+        order[i] = (i * 40503) % pool_size;  // 40503 is coprime with 65534
+    }
+
+    size_t released = 0;
+    uint32_t next_mac = static_cast<uint32_t>(pool_size);
+    for (int utilization : {99, 90, 50}) {
+        const size_t target_free = pool_size * (100 - utilization) / 100;
+        while (released < target_free) {
+            const DhcpLease& lease = leases[order[released++]];
+            manager.release_lease(lease.mac_address, lease.ip_address);
+        }
+
+        // Allocate and release again so utilization stays put while measuring
+        const int iterations = 2000;
+        std::vector<int64_t> samples;
+        samples.reserve(iterations);
+        for (int i = 0; i < iterations; ++i) {
+            const MacAddress mac = mac_for(next_mac++);
+            auto start = high_resolution_clock::now();
+            DhcpLease lease = manager.allocate_lease(mac, 0, subnet.name);
+            samples.push_back(duration_cast<nanoseconds>(high_resolution_clock::now() - start).count());
+            manager.release_lease(mac, lease.ip_address);
+        }
+        std::sort(samples.begin(), samples.end());
+        const double p50_us = samples[samples.size() / 2] / 1000.0;
+        const double p99_us = samples[samples.size() * 99 / 100] / 1000.0;
+
+        EXPECT_LT(p99_us, 1000.0) << "Allocation p99 at " << utilization << "% utilization: " << p99_us << " us";
+
+        std::cout << "Allocation latency at " << utilization << "% utilization: p50 " << p50_us
+                  << " us, p99 " << p99_us << " us" << std::endl;
+    }
+}
+
 TEST_F(ResourceUsageTest, MemoryUsagePerLease) {
     const DhcpSubnet& subnet = config_manager_->get_config().subnets[0];
     const int num_leases = 100;
@@ -229,6 +881,148 @@ TEST_F(ResourceUsageTest, MemoryUsagePerLease) {
     }
 }
 
+TEST_F(ResourceUsageTest, LeaseTableMemoryAndLookup) {
+    const uint32_t lease_count = 500000;
+    const int lookups = 1000000;
+    const auto now = system_clock::now();
+    auto mac_for = [](uint32_t i) {
+        return MacAddress{0x02, 0x00, 0x00, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)};
+    };
+
+    LeaseStore store;
+    AddressIndex owners;
+    std::map<MacAddress, std::shared_ptr<DhcpLease>> map_by_mac;
+    std::map<IpAddress, std::shared_ptr<DhcpLease>> map_by_ip;
+    for (uint32_t i = 0; i < lease_count; ++i) {
+        auto lease = std::make_shared<DhcpLease>();
+        lease->mac_address = mac_for(i);
+        lease->ip_address = htonl(0x0A000000u + i);
+        lease->hostname = "host-" + std::to_string(i);
+        lease->lease_start = now;
+        lease->lease_end = now + seconds(3600);
+        lease->lease_time = seconds(3600);
+        lease->lease_type = LeaseType::DYNAMIC;
+        lease->is_active = true;
+        store.put(*lease);
+        owners.insert(lease->ip_address, lease->mac_address);
+        map_by_mac.emplace(lease->mac_address, lease);
+        map_by_ip.emplace(lease->ip_address, lease);
+    }
+
+    // Lookups in a scattered order so neither table gets a warm path
+    uint64_t checksum = 0;
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        const LeaseRecord* record = store.find(mac_for((uint32_t(i) * 7919u) % lease_count));
+        checksum += record ? record->ip_address : 0;
+    }
+    const double store_mac_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / double(lookups);
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        MacAddress owner;
+        checksum += owners.find(htonl(0x0A000000u + (uint32_t(i) * 7919u) % lease_count), owner) ? owner[5] : 0;
+    }
+    const double store_ip_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / double(lookups);
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        auto it = map_by_mac.find(mac_for((uint32_t(i) * 7919u) % lease_count));
+        checksum += it != map_by_mac.end() ? it->second->ip_address : 0;
+    }
+    const double map_mac_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / double(lookups);
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        auto it = map_by_ip.find(htonl(0x0A000000u + (uint32_t(i) * 7919u) % lease_count));
+        checksum += it != map_by_ip.end() ? it->second->mac_address[5] : 0;
+    }
+    const double map_ip_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / double(lookups);
+
+    const double store_bytes = double(store.memory_usage() + owners.memory_usage()) / lease_count;
+    // Tree node header is four words; make_shared adds a two-counter control block
+    const double map_bytes = double(sizeof(DhcpLease)) + 2 * sizeof(long) +
+                             (4 * sizeof(void*) + sizeof(MacAddress) + sizeof(std::shared_ptr<DhcpLease>)) +
+                             (4 * sizeof(void*) + sizeof(IpAddress) + sizeof(std::shared_ptr<DhcpLease>));
+
+    EXPECT_GT(checksum, 0u);
+    EXPECT_EQ(store.size(), lease_count);
+    EXPECT_LT(store_bytes, map_bytes) << "Lease store: " << store_bytes << " bytes/lease";
+    EXPECT_LT(store_mac_ns, 2000.0) << "Lease store MAC lookup: " << store_mac_ns << " ns";
+
+    std::cout << "Lease table (" << lease_count << " leases): store " << store_bytes
+              << " bytes/lease, MAC lookup " << store_mac_ns << " ns, IP lookup " << store_ip_ns << " ns" << std::endl;
+    std::cout << "Lease table (" << lease_count << " leases): std::map + shared_ptr ~" << map_bytes
+              << " bytes/lease, MAC lookup " << map_mac_ns << " ns, IP lookup " << map_ip_ns << " ns" << std::endl;
+}
+
+TEST_F(ResourceUsageTest, SnapshotStartupWithMillionLeases) {
+    const uint32_t lease_count = 1000000;
+    const uint32_t text_count = 100000;
+    const std::string snapshot_path = "/tmp/simple-dhcpd-perf-snapshot";
+    const std::string text_path = "/tmp/simple-dhcpd-perf-leases.txt";
+
+    DhcpConfig config = config_manager_->get_config();
+    config.subnets[0].network = string_to_ip("10.0.0.0");
+    config.subnets[0].prefix_length = 12;
+    config.subnets[0].range_start = string_to_ip("10.0.0.1");
+    config.subnets[0].range_end = string_to_ip("10.15.255.254");
+
+    const auto now = system_clock::now();
+    auto lease_for = [now](uint32_t i) {
+        DhcpLease lease;
+        lease.mac_address = MacAddress{0x02, 0x00, 0x00, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)};
+        lease.ip_address = htonl(0x0A000001u + i);
+        lease.hostname = "host-" + std::to_string(i);
+        lease.lease_start = now;
+        lease.lease_end = now + seconds(3600);
+        lease.lease_type = LeaseType::DYNAMIC;
+        lease.is_active = true;
+        return lease;
+    };
+    {
+        LeaseSnapshotWriter writer;
+        writer.reserve(lease_count);
+        std::ofstream text(text_path);
+        for (uint32_t i = 0; i < lease_count; ++i) {
+            const DhcpLease lease = lease_for(i);
+            writer.add(lease);
+            if (i < text_count) {
+                text << mac_to_string(lease.mac_address) << " " << ip_to_string(lease.ip_address) << " "
+                     << lease.hostname << " " << system_clock::to_time_t(lease.lease_start) << " "
+                     << system_clock::to_time_t(lease.lease_end) << "\n";
+            }
+        }
+        writer.write(snapshot_path);
+    }
+
+    auto start = high_resolution_clock::now();
+    LeaseManager restored(config);
+    ASSERT_TRUE(restored.load_snapshot(snapshot_path));
+    const double snapshot_ms = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+    EXPECT_EQ(restored.get_statistics().active_leases, lease_count);
+    auto probe = restored.get_lease_by_ip(htonl(0x0A000001u + 123456));
+    ASSERT_NE(probe, nullptr);
+    EXPECT_EQ(probe->hostname, "host-123456");
+
+    start = high_resolution_clock::now();
+    LeaseManager imported(config);
+    imported.load_leases(text_path);
+    const double text_ms = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+    EXPECT_EQ(imported.get_statistics().active_leases, text_count);
+
+    // The absolute target (well under a second per million) holds for optimized
+    // builds; unoptimized ones are only held to beating the text import
+    const double text_per_million_ms = text_ms * (lease_count / text_count);
+    EXPECT_LT(snapshot_ms, text_per_million_ms) << "Snapshot load of " << lease_count << " leases: " << snapshot_ms << " ms";
+    std::cout << "Snapshot startup: " << lease_count << " leases in " << snapshot_ms << " ms; text import: "
+              << text_count << " leases in " << text_ms << " ms (~" << text_per_million_ms << " ms per million)"
+              << std::endl;
+
+    std::remove(snapshot_path.c_str());
+    std::remove(text_path.c_str());
+}
+
 TEST_F(ResourceUsageTest, ConcurrentLeaseAllocation) {
     const DhcpSubnet& subnet = config_manager_->get_config().subnets[0];
     const int num_threads = 4;
@@ -269,3 +1063,144 @@ TEST_F(ResourceUsageTest, ConcurrentLeaseAllocation) {
     std::cout << "Concurrent lease allocation: " << success_count.load()
               << " leases in " << duration.count() << " ms" << std::endl;
 }
+
+// Performance Test: Socket I/O
+TEST_F(ResourceUsageTest, ShardedReadsDuringAllocation) {
+    DhcpConfig config;
+    config.enable_logging = false;
+    const int subnet_count = 4;
+    for (int n = 0; n < subnet_count; ++n) {
+        DhcpSubnet subnet;
+        subnet.name = "shard-" + std::to_string(n);
+        subnet.network = htonl(0x0A140000u | (static_cast<uint32_t>(n) << 12));
+        subnet.prefix_length = 20;
+        subnet.range_start = htonl(ntohl(subnet.network) + 1);
+        subnet.range_end = htonl(ntohl(subnet.network) + 4094);
+        subnet.lease_time = 3600;
+        config.subnets.push_back(subnet);
+    }
+    LeaseManager manager(config);
+
+    // Two allocators per subnet race on the same pool; readers run throughout
+    const int allocators = subnet_count * 2;
+    const int leases_per_thread = 1000;
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> reads(0);
+    std::vector<std::vector<IpAddress>> allocated(allocators);
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&, r]() {
+            uint64_t local = 0;
+            uint32_t n = static_cast<uint32_t>(r);
+            while (!done.load(std::memory_order_relaxed)) {
+                MacAddress mac = {0x02, static_cast<uint8_t>(n % allocators), 0, 0,
+                                  static_cast<uint8_t>((n / allocators) >> 8), static_cast<uint8_t>(n / allocators)};
+                (void)manager.get_lease_by_mac(mac);
+                (void)manager.get_lease_by_ip(htonl(0x0A140001u + (n % 16000)));
+                (void)manager.get_statistics();
+                n = n * 1103515245u + 12345u;
+                local += 3;
+            }
+            reads += local;
+        });
+    }
+
+    auto start = high_resolution_clock::now();
+    std::vector<std::thread> writers;
+    for (int t = 0; t < allocators; ++t) {
+        writers.emplace_back([&, t]() {
+            const std::string subnet_name = "shard-" + std::to_string(t % subnet_count);
+            for (int i = 0; i < leases_per_thread; ++i) {
+                MacAddress mac = {0x02, static_cast<uint8_t>(t), 0, 0,
+                                  static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i)};
+                allocated[t].push_back(manager.allocate_lease(mac, 0, subnet_name).ip_address);
+            }
+        });
+    }
+    for (auto& w : writers) {
+        w.join();
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    done = true;
+    for (auto& r : readers) {
+        r.join();
+    }
+
+    std::set<IpAddress> unique;
+    for (const auto& ips : allocated) {
+        unique.insert(ips.begin(), ips.end());
+    }
+    EXPECT_EQ(unique.size(), static_cast<size_t>(allocators * leases_per_thread));
+    EXPECT_EQ(manager.get_statistics().active_leases, static_cast<uint64_t>(allocators * leases_per_thread));
+
+    const double seconds = std::max<int64_t>(1, duration.count()) / 1000000.0;
+    std::cout << "Sharded lease manager: " << (allocators * leases_per_thread) / seconds
+              << " allocations/sec with " << reads.load() / seconds << " concurrent reads/sec" << std::endl;
+}
+
+class SocketIoTest : public ::testing::Test {
+protected:
+    /**
+     * Echo datagrams through a loopback server socket and return the round
+     * trip rate in packets per second. The client keeps a bounded window in
+     * flight so neither socket buffer overflows.
+     */
+    double measure_echo_pps(uint16_t server_port, uint16_t client_port, size_t batch_size) {
+        UdpSocket server("127.0.0.1", server_port);
+        UdpSocket client("127.0.0.1", client_port);
+        server.set_socket_option(SO_RCVBUF, 1 << 20);
+        client.set_socket_option(SO_RCVBUF, 1 << 20);
+        if (batch_size > 1) {
+            server.set_batch_mode(batch_size, microseconds(200));
+        }
+        server.bind();
+        client.bind();
+
+        server.start_receiving([&](const std::vector<uint8_t>& data, const std::string& addr, uint16_t port) {
+            server.send_to(data, addr, port);
+        });
+
+        std::atomic<int> echoed(0);
+        client.start_receiving([&](const std::vector<uint8_t>&, const std::string&, uint16_t) {
+            echoed++;
+        });
+
+        const int total = 20000;
+        const int window = 256;
+        std::vector<uint8_t> payload(300, 0x5A);
+
+        auto start = high_resolution_clock::now();
+        for (int sent = 0; sent < total; ++sent) {
+            auto wait_start = high_resolution_clock::now();
+            while (sent - echoed.load() >= window &&
+                   high_resolution_clock::now() - wait_start < milliseconds(200)) {
+                std::this_thread::yield();
+            }
+            client.send_to(payload, "127.0.0.1", server_port);
+        }
+        auto wait_start = high_resolution_clock::now();
+        while (echoed.load() < total && high_resolution_clock::now() - wait_start < seconds(1)) {
+            std::this_thread::sleep_for(microseconds(100));
+        }
+        auto end = high_resolution_clock::now();
+
+        server.stop_receiving();
+        client.stop_receiving();
+
+        auto duration = duration_cast<microseconds>(end - start);
+        return (echoed.load() * 1000000.0) / std::max<int64_t>(1, duration.count());
+    }
+};
+
+TEST_F(SocketIoTest, BatchedVersusPerPacketThroughput) {
+    double per_packet_pps = measure_echo_pps(6790, 6791, 1);
+    double batched_pps = measure_echo_pps(6792, 6793, 32);
+
+    EXPECT_GT(per_packet_pps, 1000.0) << "Per-packet echo throughput: " << per_packet_pps << " packets/sec";
+    EXPECT_GT(batched_pps, 1000.0) << "Batched echo throughput: " << batched_pps << " packets/sec";
+
+    std::cout << "Per-packet echo throughput: " << per_packet_pps << " packets/sec" << std::endl;
+    std::cout << "Batched (32) echo throughput: " << batched_pps << " packets/sec ("
+              << (batched_pps / per_packet_pps) << "x)" << std::endl;
+}
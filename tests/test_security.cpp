@@ -7,7 +7,11 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <mutex>
 #include "simple-dhcpd/production/security/manager.hpp"
+#include "simple-dhcpd/production/security/rate_limiter.hpp"
+#include "simple-dhcpd/production/security/filter_table.hpp"
+#include <arpa/inet.h>
 
 using namespace simple_dhcpd;
 
@@ -46,6 +50,67 @@ TEST_F(SecurityTest, IpFilterAllowDenyExact) {
     EXPECT_FALSE(manager->check_ip_address(0x0A000001));
 }
 
+TEST_F(SecurityTest, MacFilterTableKeepsFirstMatchOrder) {
+    MacFilterRule disabled{"00:11:22:33:44:55", true, "disabled"};
+    disabled.enabled = false;
+    MacFilterRule expired{"00:11:22:33:44:66", true, "expired",
+                          std::chrono::system_clock::now() - std::chrono::seconds(1)};
+    MacFilterTable table({
+        disabled,
+        MacFilterRule{"00-11-22-00-00-01", true, "exact, dashes"},
+        MacFilterRule{"00:11:22:*", false, "deny OUI"},
+        expired,
+        MacFilterRule{"00:11:22:33:44:55", true, "shadowed by the OUI"},
+        MacFilterRule{"aa:bb:cc:dd:e?:*", false, "glob"},
+        MacFilterRule{"AA:BB:*", true, "allow prefix"},
+        MacFilterRule{"*", false, "deny everything else"}
+    });
+
+    EXPECT_EQ(table.match({0x00, 0x11, 0x22, 0x00, 0x00, 0x01}), FilterMatch::ALLOW);
+    EXPECT_EQ(table.match({0x00, 0x11, 0x22, 0x33, 0x44, 0x55}), FilterMatch::DENY);
+    EXPECT_EQ(table.match({0x00, 0x11, 0x22, 0x33, 0x44, 0x66}), FilterMatch::DENY);
+    EXPECT_EQ(table.match({0xaa, 0xbb, 0xcc, 0xdd, 0xe1, 0x00}), FilterMatch::DENY);
+    EXPECT_EQ(table.match({0xaa, 0xbb, 0xcc, 0xdd, 0xf1, 0x00}), FilterMatch::ALLOW);
+    EXPECT_EQ(table.match({0x02, 0x00, 0x00, 0x00, 0x00, 0x01}), FilterMatch::DENY);
+
+    // Text lookups parse to the same binary key
+    MacAddress parsed;
+    ASSERT_TRUE(MacFilterTable::parse("AA:bb:CC:dd:F1:00", parsed));
+    EXPECT_EQ(table.match(parsed), FilterMatch::ALLOW);
+    EXPECT_FALSE(MacFilterTable::parse("aa:bb:cc", parsed));
+    EXPECT_FALSE(MacFilterTable::parse("aa:bb:cc:dd:ee:gg", parsed));
+
+    // Expired rules are skipped, so the next rule decides
+    MacFilterTable expiring({expired, MacFilterRule{"00:11:22:33:44:66", false, "deny"}});
+    EXPECT_EQ(expiring.match({0x00, 0x11, 0x22, 0x33, 0x44, 0x66}), FilterMatch::DENY);
+    EXPECT_EQ(MacFilterTable().match({0x00, 0x11, 0x22, 0x33, 0x44, 0x66}), FilterMatch::NONE);
+}
+
+TEST_F(SecurityTest, IpFilterTableKeepsFirstMatchAcrossPrefixes) {
+    IpFilterTable table({
+        IpFilterRule{htonl(0x0A000000), htonl(0xFF000000), false, "deny 10/8"},
+        IpFilterRule{htonl(0x0A010000), htonl(0xFFFF0000), true, "10.1/16, shadowed"},
+        IpFilterRule{htonl(0xC0A80105), 0, true, "allow 192.168.1.5"},
+        IpFilterRule{htonl(0xC0A80100), htonl(0xFFFFFF00), false, "deny 192.168.1/24"},
+        IpFilterRule{htonl(0xC0A80000), htonl(0xFFFF0000), true, "allow 192.168/16"},
+        IpFilterRule{htonl(0xAC100001), htonl(0xFFFF00FF), false, "non-contiguous: 172.16.x.1"}
+    });
+
+    EXPECT_EQ(table.match(htonl(0x0A010203)), FilterMatch::DENY);
+    EXPECT_EQ(table.match(htonl(0xC0A80105)), FilterMatch::ALLOW);
+    EXPECT_EQ(table.match(htonl(0xC0A80106)), FilterMatch::DENY);
+    EXPECT_EQ(table.match(htonl(0xC0A80206)), FilterMatch::ALLOW);
+    EXPECT_EQ(table.match(htonl(0xAC100901)), FilterMatch::DENY);
+    EXPECT_EQ(table.match(htonl(0xAC100902)), FilterMatch::NONE);
+    EXPECT_EQ(table.match(htonl(0x08080808)), FilterMatch::NONE);
+
+    // The manager publishes a new table on every change
+    manager->set_ip_filter_rules({IpFilterRule{htonl(0x0A000000), htonl(0xFF000000), false, "deny 10/8"}});
+    EXPECT_FALSE(manager->check_ip_address(htonl(0x0A000001)));
+    manager->remove_ip_filter_rule(htonl(0x0A000000));
+    EXPECT_TRUE(manager->check_ip_address(htonl(0x0A000001)));
+}
+
 TEST_F(SecurityTest, RateLimitBasic) {
     RateLimitRule per_mac{"00:11:22:33:44:55", "mac", 3, std::chrono::seconds(1)};
     manager->add_rate_limit_rule(per_mac);
@@ -57,6 +122,156 @@ TEST_F(SecurityTest, RateLimitBasic) {
     EXPECT_FALSE(manager->check_rate_limit("00:11:22:33:44:55", "mac"));
 }
 
+TEST_F(SecurityTest, RateLimitTokenBucketRefills) {
+    RateLimiter limiter(1024);
+    limiter.set_rules({
+        RateLimitRule{"00:11:22:33:44:55", "mac", 3, std::chrono::seconds(1), std::chrono::seconds(0)},
+        RateLimitRule{"*", "mac", 1, std::chrono::seconds(10)}
+    });
+    const MacAddress client = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    const auto t0 = RateLimiter::Clock::now();
+
+    // Burst of max_requests, then one token per window / max_requests
+    EXPECT_EQ(limiter.check(client, t0), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check(client, t0), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check(client, t0), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check(client, t0), RateLimitVerdict::EXCEEDED);
+    EXPECT_EQ(limiter.check(client, t0 + std::chrono::milliseconds(100)), RateLimitVerdict::EXCEEDED);
+    EXPECT_EQ(limiter.check(client, t0 + std::chrono::milliseconds(340)), RateLimitVerdict::ALLOWED);
+
+    // The exact rule comes first; text and binary keys are the same client
+    EXPECT_EQ(limiter.check("00:11:22:33:44:55", "mac", t0 + std::chrono::seconds(2)), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check("00:11:22:33:44:55", "mac", t0 + std::chrono::seconds(2)), RateLimitVerdict::ALLOWED);
+
+    // Everyone else falls to the wildcard and its 300 s block window
+    EXPECT_EQ(limiter.check("AA:BB:CC:00:00:01", "mac", t0), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check("aa:bb:cc:00:00:01", "mac", t0), RateLimitVerdict::EXCEEDED);
+    EXPECT_EQ(limiter.check("aa:bb:cc:00:00:01", "mac", t0 + std::chrono::seconds(60)), RateLimitVerdict::BLOCKED);
+    EXPECT_EQ(limiter.check("aa:bb:cc:00:00:01", "mac", t0 + std::chrono::seconds(301)), RateLimitVerdict::ALLOWED);
+
+    // No rule for this type
+    EXPECT_EQ(limiter.check("eth0", "interface", t0), RateLimitVerdict::UNLIMITED);
+}
+
+TEST_F(SecurityTest, RateLimiterTableStaysBoundedUnderSpoofedMacs) {
+    RateLimiter limiter(4096);
+    limiter.set_rules({RateLimitRule{"*", "mac", 2, std::chrono::seconds(1)}});
+    const auto now = RateLimiter::Clock::now();
+
+    const MacAddress attacker = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    EXPECT_EQ(limiter.check(attacker, now), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check(attacker, now), RateLimitVerdict::ALLOWED);
+    EXPECT_EQ(limiter.check(attacker, now), RateLimitVerdict::EXCEEDED);
+
+    for (uint32_t i = 0; i < 200000; ++i) {
+        const MacAddress spoofed = {0x06, static_cast<uint8_t>(i >> 24), static_cast<uint8_t>(i >> 16),
+                                    static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i), 0x00};
+        limiter.check(spoofed, now);
+    }
+
+    EXPECT_EQ(limiter.capacity(), 4096u);
+    EXPECT_LE(limiter.size(), limiter.capacity());
+    EXPECT_GT(limiter.evictions(), 0u);
+    // Live clients are evicted before the blocked one
+    EXPECT_EQ(limiter.check(attacker, now + std::chrono::seconds(1)), RateLimitVerdict::BLOCKED);
+}
+
+TEST_F(SecurityTest, SecurityEventLogKeepsNewestEventsInTimeOrder) {
+    SecurityEventLog log(8);
+    const auto t0 = std::chrono::system_clock::now();
+    for (int i = 0; i < 20; ++i) {
+        SecurityEvent event(i % 2 ? SecurityEventType::MAC_SPOOFING : SecurityEventType::RATE_LIMIT_EXCEEDED,
+                            ThreatLevel::MEDIUM, "event " + std::to_string(i));
+        event.timestamp = t0 + std::chrono::seconds(i);
+        log.append(event);
+    }
+    // Reported late, stamped before the newest event
+    SecurityEvent late(SecurityEventType::MAC_SPOOFING, ThreatLevel::LOW, "late");
+    late.timestamp = t0 + std::chrono::milliseconds(17500);
+    log.append(late);
+
+    EXPECT_EQ(log.size(), 8u);
+    EXPECT_EQ(log.overwritten(), 13u);
+
+    auto all = log.query(std::chrono::system_clock::time_point::min(),
+                         std::chrono::system_clock::time_point::max(), SecurityEventType::ANY);
+    ASSERT_EQ(all.size(), 8u);
+    EXPECT_EQ(all.front().description, "event 13");
+    for (size_t i = 1; i < all.size(); ++i) {
+        EXPECT_LE(all[i - 1].timestamp, all[i].timestamp);
+    }
+
+    // Both bounds are inclusive
+    auto range = log.query(t0 + std::chrono::seconds(15), t0 + std::chrono::seconds(18), SecurityEventType::ANY);
+    ASSERT_EQ(range.size(), 5u);
+    EXPECT_EQ(range.front().description, "event 15");
+    EXPECT_EQ(range[3].description, "late");
+    EXPECT_EQ(range.back().description, "event 18");
+
+    auto spoofing = log.query(t0 + std::chrono::seconds(15), t0 + std::chrono::seconds(18),
+                              SecurityEventType::MAC_SPOOFING);
+    ASSERT_EQ(spoofing.size(), 3u);
+    EXPECT_EQ(spoofing[2].description, "late");
+}
+
+TEST_F(SecurityTest, SecurityEventsAreDeliveredInBackgroundAndCoalesced) {
+    std::vector<SecurityEvent> delivered;
+    std::mutex delivered_mutex;
+    manager->set_security_event_callback([&](const SecurityEvent& event) {
+        std::lock_guard<std::mutex> lock(delivered_mutex);
+        delivered.push_back(event);
+    });
+    manager->start();
+
+    for (int i = 0; i < 100; ++i) {
+        manager->report_security_event(SecurityEvent(SecurityEventType::RATE_LIMIT_EXCEEDED,
+                                                     ThreatLevel::MEDIUM, "flood", "02:00:00:00:00:01"));
+    }
+    manager->report_security_event(SecurityEvent(SecurityEventType::MAC_SPOOFING, ThreatLevel::HIGH, "spoof"));
+    manager->flush_security_events();
+
+    // History and statistics see every event; delivery sees one plus a summary
+    EXPECT_EQ(manager->get_security_events().size(), 101u);
+    EXPECT_EQ(manager->get_security_events(std::chrono::system_clock::time_point::min(),
+                                           std::chrono::system_clock::time_point::max(),
+                                           SecurityEventType::MAC_SPOOFING).size(), 1u);
+    SecurityStats stats = manager->get_security_statistics();
+    EXPECT_EQ(stats.events_by_type[static_cast<int>(SecurityEventType::RATE_LIMIT_EXCEEDED)], 100u);
+    EXPECT_EQ(stats.stats["events_coalesced"], 99u);
+
+    std::lock_guard<std::mutex> lock(delivered_mutex);
+    ASSERT_EQ(delivered.size(), 3u);
+    EXPECT_EQ(delivered[0].description, "flood");
+    EXPECT_EQ(delivered[1].description, "spoof");
+    EXPECT_EQ(delivered[2].additional_data["repeat_count"], "99");
+}
+
+TEST_F(SecurityTest, SecurityStatisticsAggregateNamedCounters) {
+    manager->add_mac_filter_rule(MacFilterRule{"aa:bb:cc:*", false, "deny"});
+    const MacAddress denied = {0xaa, 0xbb, 0xcc, 0x00, 0x00, 0x01};
+    const MacAddress allowed = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    EXPECT_FALSE(manager->check_mac_address(denied));
+    EXPECT_FALSE(manager->check_mac_address(denied));
+    EXPECT_TRUE(manager->check_mac_address(allowed));
+    manager->report_security_event(SecurityEvent(SecurityEventType::MAC_SPOOFING, ThreatLevel::HIGH, "spoof"));
+
+    SecurityStats stats = manager->get_security_statistics();
+    EXPECT_EQ(stats.stats["mac_blocked"], 2u);
+    EXPECT_EQ(stats.stats["mac_allowed"], 1u);
+    EXPECT_EQ(stats.stats.count("ip_blocked"), 0u);
+    EXPECT_EQ(stats.blocked_requests, 2u);
+    EXPECT_EQ(stats.allowed_requests, 1u);
+    EXPECT_EQ(stats.total_events, 1u);
+    EXPECT_EQ(stats.events_by_level[static_cast<int>(ThreatLevel::HIGH)], 1u);
+    EXPECT_EQ(stats.events_by_type[static_cast<int>(SecurityEventType::MAC_SPOOFING)], 1u);
+
+    manager->clear_security_statistics();
+    stats = manager->get_security_statistics();
+    EXPECT_EQ(stats.blocked_requests, 0u);
+    EXPECT_EQ(stats.total_events, 0u);
+    EXPECT_EQ(stats.stats.count("mac_blocked"), 0u);
+}
+
 TEST_F(SecurityTest, Option82ValidationRequiredAndPresent) {
     manager->set_option_82_validation_enabled(true);
     // Add a rule requiring Option82 on interface "eth0"
@@ -79,3 +294,61 @@ TEST_F(SecurityTest, Option82ValidationRequiredAndPresent) {
 }
 
 
+TEST_F(SecurityTest, RelayAgentTableFollowsRuleOrderAndTrustedAgents) {
+    const std::vector<uint8_t> option82 = {1, 2, 'c', '1', 2, 3, 'r', 'e', 'm'};
+    RelayAgentOption relay;
+    ASSERT_TRUE(RelayAgentOption::parse(option82, relay));
+    EXPECT_EQ(relay.circuit_id.data(), option82.data() + 2);     // views into the option
+    EXPECT_EQ(relay.circuit_id.size(), 2u);
+    EXPECT_EQ(relay.remote_id.data(), option82.data() + 6);
+    EXPECT_EQ(relay.remote_id.size(), 3u);
+    RelayAgentOption truncated;
+    EXPECT_FALSE(RelayAgentOption::parse(ByteView(option82.data(), 4), truncated));
+    EXPECT_TRUE(truncated.has_circuit_id);
+
+    Option82Rule disabled{"eth1", false, false};
+    RelayAgentTable table({disabled, Option82Rule{"eth0", false}, Option82Rule{"*", true},
+                           Option82Rule{"eth1", false}},
+                          {TrustedRelayAgent{"c1", "rem"}, TrustedRelayAgent{"c1", "off", false}});
+    EXPECT_FALSE(table.required("eth0"));
+    EXPECT_TRUE(table.required("eth1"));      // the "*" rule comes first
+    EXPECT_TRUE(table.required("eth2"));
+    EXPECT_TRUE(table.trusts(relay.circuit_id, relay.remote_id));
+    const std::string off = "off";
+    EXPECT_FALSE(table.trusts(relay.circuit_id, ByteView(reinterpret_cast<const uint8_t*>(off.data()), off.size())));
+
+    // The manager refuses packets from relays it does not trust once any are configured
+    manager->set_option_82_validation_enabled(true);
+    manager->set_option_82_required_for_interface("eth0", true);
+    EXPECT_TRUE(manager->validate_option_82(option82, "eth0"));
+    manager->add_trusted_relay_agent("c2", "rem");
+    EXPECT_FALSE(manager->validate_option_82(option82, "eth0"));
+    manager->add_trusted_relay_agent("c1", "rem");
+    EXPECT_TRUE(manager->validate_option_82(option82, "eth0"));
+    EXPECT_TRUE(manager->validate_option_82(std::vector<uint8_t>(), "eth9"));
+}
+
+TEST_F(SecurityTest, SnoopingBindingsAreIndexedByMacAndIp) {
+    manager->set_dhcp_snooping_enabled(true);
+    for (int i = 0; i < 3; ++i) {
+        manager->add_snooping_binding(DhcpSnoopingBinding("00:11:22:33:44:5" + std::to_string(i),
+                                                          htonl(0x0A000001 + i), "eth0", std::chrono::seconds(3600)));
+    }
+    manager->add_snooping_binding(DhcpSnoopingBinding("not a mac", htonl(0x0A000009), "eth0", std::chrono::seconds(60)));
+    EXPECT_EQ(manager->get_snooping_bindings().size(), 3u);
+
+    DhcpMessage message;
+    message.message_type = DhcpMessageType::REQUEST;
+    message.client_mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x52};
+    message.client_ip = htonl(0x0A000003);
+    EXPECT_TRUE(manager->validate_dhcp_message(message, "eth0"));
+    EXPECT_FALSE(manager->validate_dhcp_message(message, "eth1"));
+
+    // Removing a binding keeps the others reachable
+    manager->remove_snooping_binding("00:11:22:33:44:50", htonl(0x0A000001));
+    EXPECT_EQ(manager->get_snooping_bindings().size(), 2u);
+    EXPECT_TRUE(manager->validate_dhcp_message(message, "eth0"));
+    message.client_mac[5] = 0x50;
+    message.client_ip = htonl(0x0A000001);
+    EXPECT_FALSE(manager->validate_dhcp_message(message, "eth0"));
+}
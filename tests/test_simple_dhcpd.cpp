@@ -9,11 +9,43 @@
 #include <gtest/gtest.h>
 #include <vector>
 #include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <future>
+#include <csignal>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "simple-dhcpd/core/parser.hpp"
+#include "simple-dhcpd/core/message_writer.hpp"
+#include "simple-dhcpd/core/reply_cache.hpp"
+#include "simple-dhcpd/core/early_drop.hpp"
+#include "simple-dhcpd/core/server.hpp"
+#include "simple-dhcpd/core/options/subnet_options.hpp"
+#include "simple-dhcpd/core/options/manager.hpp"
 #include "simple-dhcpd/core/types.hpp"
 #include "simple-dhcpd/core/utils/utils.hpp"
 #include "simple-dhcpd/core/lease/manager.hpp"
+#include "simple-dhcpd/core/lease/address_pool.hpp"
+#include "simple-dhcpd/core/lease/lease_store.hpp"
+#include "simple-dhcpd/core/lease/expiry_heap.hpp"
+#include "simple-dhcpd/core/lease/journal.hpp"
+#include "simple-dhcpd/core/lease/snapshot.hpp"
+#include "simple-dhcpd/core/lease/replication.hpp"
+#include "simple-dhcpd/core/lease/lease_history.hpp"
+#include "simple-dhcpd/core/lease/leasequery.hpp"
 #include "simple-dhcpd/core/config/manager.hpp"
+#include "simple-dhcpd/core/utils/logger.hpp"
+#include "simple-dhcpd/core/utils/stat_counters.hpp"
+#include "simple-dhcpd/core/utils/latency_histogram.hpp"
+#include "simple-dhcpd/production/features/advanced_manager.hpp"
 
 using namespace simple_dhcpd;
 
@@ -106,6 +138,28 @@ TEST_F(DhcpParserTest, BasicMessageParsing) {
     EXPECT_EQ(message.header.hlen, 6); // MAC address length
 }
 
+TEST_F(DhcpParserTest, EarlyDropChecksRawHeader) {
+    const std::vector<uint8_t> discover = create_mock_dhcp_discover();
+    EXPECT_EQ(EarlyDropFilter::check_header(discover.data(), discover.size()), EarlyDropReason::NONE);
+    const MacAddress expected = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    EXPECT_EQ(EarlyDropFilter::chaddr(discover.data()), expected);
+    
+    EXPECT_EQ(EarlyDropFilter::check_header(discover.data(), sizeof(DhcpMessageHeader)), EarlyDropReason::TRUNCATED);
+    
+    std::vector<uint8_t> packet = discover;
+    packet[offsetof(DhcpMessageHeader, op)] = 2;
+    EXPECT_EQ(EarlyDropFilter::check_header(packet.data(), packet.size()), EarlyDropReason::NOT_REQUEST);
+    
+    packet = discover;
+    packet[offsetof(DhcpMessageHeader, hlen)] = 16;
+    EXPECT_EQ(EarlyDropFilter::check_header(packet.data(), packet.size()), EarlyDropReason::BAD_HARDWARE);
+    
+    packet = discover;
+    packet[sizeof(DhcpMessageHeader)] = 0;
+    EXPECT_EQ(EarlyDropFilter::check_header(packet.data(), packet.size()), EarlyDropReason::BAD_MAGIC_COOKIE);
+    EXPECT_STREQ(early_drop_reason_name(EarlyDropReason::RATE_LIMIT), "rate_limit");
+}
+
 TEST_F(DhcpParserTest, MessageGeneration) {
     // Create a DHCP Offer message using the builder
     DhcpMessageBuilder builder;
@@ -169,7 +223,365 @@ TEST_F(DhcpParserTest, OptionHandling) {
     EXPECT_EQ(router->length, 4);
 }
 
+TEST_F(DhcpParserTest, PacketBufferParsing) {
+    std::vector<uint8_t> data = create_mock_dhcp_discover();
+    
+    PacketBufferPool pool(2);
+    PacketBufferPool::Handle packet = pool.acquire();
+    ASSERT_TRUE(packet);
+    EXPECT_EQ(pool.available(), 1u);
+    
+    memcpy(packet->data(), data.data(), data.size());
+    packet->set_size(data.size());
+    packet->peer().sin_port = htons(68);
+    EXPECT_EQ(packet->view().size(), data.size());
+    EXPECT_EQ(packet->peer_port(), 68);
+    
+    DhcpMessage message = DhcpParser::parse_message(*packet);
+    EXPECT_EQ(message.message_type, DhcpMessageType::DISCOVER);
+    EXPECT_EQ(message.header.xid, htonl(0x12345678));
+    
+    packet.reset();
+    EXPECT_EQ(pool.available(), 2u);
+}
+
+TEST_F(DhcpParserTest, MessageViewLookup) {
+    std::vector<uint8_t> data = create_mock_dhcp_discover();
+    
+    DhcpMessageView view(data.data(), data.size());
+    EXPECT_EQ(view.message_type(), DhcpMessageType::DISCOVER);
+    EXPECT_EQ(view.xid(), htonl(0x12345678));
+    EXPECT_EQ(view.client_mac(), (MacAddress{0x00, 0x11, 0x22, 0x33, 0x44, 0x55}));
+    EXPECT_EQ(view.option_count(), 2u);
+    
+    // Option payloads point into the original buffer
+    ByteView client_id = view.option_data(DhcpOptionCode::CLIENT_IDENTIFIER);
+    ASSERT_EQ(client_id.size(), 7u);
+    EXPECT_GE(client_id.data(), data.data());
+    EXPECT_LT(client_id.data(), data.data() + data.size());
+    EXPECT_EQ(client_id[0], 1);
+    EXPECT_FALSE(view.has_option(DhcpOptionCode::ROUTER));
+    EXPECT_TRUE(view.option_data(DhcpOptionCode::ROUTER).empty());
+    
+    // Converting view matches the owning parser
+    DhcpMessage owned = view.to_message();
+    DhcpMessage parsed = DhcpParser::parse_message(data);
+    ASSERT_EQ(owned.options.size(), parsed.options.size());
+    for (size_t i = 0; i < owned.options.size(); ++i) {
+        EXPECT_EQ(owned.options[i].code, parsed.options[i].code);
+        EXPECT_EQ(owned.options[i].data, parsed.options[i].data);
+    }
+    EXPECT_EQ(owned.client_mac, parsed.client_mac);
+    
+    EXPECT_THROW(DhcpMessageView(data.data(), 100), DhcpParserException);
+}
+
+TEST_F(DhcpParserTest, MessageViewIndexesEveryOptionOfAFullPacket) {
+    std::vector<uint8_t> data = create_mock_dhcp_discover();
+    size_t end = sizeof(DhcpMessageHeader) + 4;
+    while (data[end] != static_cast<uint8_t>(DhcpOptionCode::END)) {
+        end += 2 + data[end + 1];
+    }
+    data.resize(end);
+    
+    // Empty options, many per code and split like RFC 3396 long options, fill the packet
+    size_t added = 0;
+    while (data.size() + 3 <= PacketBuffer::kCapacity) {
+        data.push_back(static_cast<uint8_t>(224 + added % 8));
+        data.push_back(0);
+        ++added;
+    }
+    data.push_back(static_cast<uint8_t>(DhcpOptionCode::END));
+    ASSERT_GT(added, 96u);
+    
+    DhcpMessageView view(data.data(), data.size());
+    EXPECT_EQ(view.message_type(), DhcpMessageType::DISCOVER);
+    EXPECT_EQ(view.option_count(), 2u + added);
+    EXPECT_TRUE(view.has_option(static_cast<DhcpOptionCode>(231)));
+    EXPECT_EQ(view.to_message().options.size(), DhcpParser::parse_message(data).options.size());
+}
+
+TEST_F(DhcpParserTest, MessageViewOptionOverload) {
+    std::vector<uint8_t> data = create_mock_dhcp_discover();
+    DhcpMessageHeader* header = reinterpret_cast<DhcpMessageHeader*>(data.data());
+    
+    // Move the message type into the file field and flag it with option 52
+    size_t offset = sizeof(DhcpMessageHeader) + 4;
+    data[offset++] = static_cast<uint8_t>(DhcpOptionCode::OPTION_OVERLOAD);
+    data[offset++] = 1;
+    data[offset++] = 1;
+    data[offset++] = static_cast<uint8_t>(DhcpOptionCode::END);
+    
+    header->file[0] = static_cast<uint8_t>(DhcpOptionCode::DHCP_MESSAGE_TYPE);
+    header->file[1] = 1;
+    header->file[2] = static_cast<uint8_t>(DhcpMessageType::REQUEST);
+    header->file[3] = static_cast<uint8_t>(DhcpOptionCode::END);
+    
+    DhcpMessageView view(data.data(), data.size());
+    EXPECT_EQ(view.message_type(), DhcpMessageType::REQUEST);
+    EXPECT_TRUE(view.has_option(DhcpOptionCode::OPTION_OVERLOAD));
+}
+
+TEST_F(DhcpParserTest, WriterOptionOverload) {
+    DhcpMessageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.op = 2;
+    header.htype = 1;
+    header.hlen = 6;
+    
+    std::array<uint8_t, 1500> buffer;
+    DhcpMessageWriter writer(buffer.data(), buffer.size());
+    writer.begin(header);
+    writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(DhcpMessageType::OFFER));
+    
+    // 300 + 100 bytes cannot share the 312-octet options field
+    std::vector<uint8_t> large(250, 0xAA);
+    std::vector<uint8_t> medium(100, 0xBB);
+    writer.add_option(DhcpOptionCode::VENDOR_SPECIFIC, large);
+    writer.add_option(DhcpOptionCode::DOMAIN_NAME, medium);
+    ByteView encoded = writer.finish();
+    
+    EXPECT_LE(encoded.size(), DhcpMessageWriter::kDefaultMaxSize);
+    EXPECT_EQ(writer.overload(), 1);
+    
+    DhcpMessageView view(encoded.data(), encoded.size());
+    EXPECT_EQ(view.message_type(), DhcpMessageType::OFFER);
+    EXPECT_EQ(view.option_data(DhcpOptionCode::VENDOR_SPECIFIC).size(), 250u);
+    ASSERT_EQ(view.option_data(DhcpOptionCode::DOMAIN_NAME).size(), 100u);
+    EXPECT_EQ(view.option_data(DhcpOptionCode::DOMAIN_NAME)[0], 0xBB);
+    
+    // Nothing is dropped silently once every area is full
+    writer.begin(header);
+    writer.add_option(DhcpOptionCode::VENDOR_SPECIFIC, large);
+    writer.add_option(DhcpOptionCode::DOMAIN_NAME, medium);
+    writer.add_option(DhcpOptionCode::HOST_NAME, std::vector<uint8_t>(60, 0xCC));
+    EXPECT_THROW(writer.add_option(DhcpOptionCode::NIS_DOMAIN, medium), DhcpParserException);
+}
+
+TEST_F(DhcpParserTest, CompiledSubnetOptions) {
+    DhcpSubnet subnet;
+    subnet.network = string_to_ip("10.1.0.0");
+    subnet.prefix_length = 16;
+    subnet.gateway = string_to_ip("10.1.0.1");
+    subnet.dns_servers = {string_to_ip("8.8.8.8"), string_to_ip("8.8.4.4")};
+    subnet.domain_name = "example.com";
+    subnet.lease_time = 3600;
+    
+    CompiledSubnetOptions options = CompiledSubnetOptions::compile(subnet, string_to_ip("10.1.0.1"));
+    auto read_u32 = [](ByteView data) -> uint32_t {
+        return data.size() == 4 ? (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) |
+                                  (uint32_t(data[2]) << 8) | uint32_t(data[3]) : 0;
+    };
+    EXPECT_EQ(options.server_id(), string_to_ip("10.1.0.1"));
+    
+    DhcpMessageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.op = 2;
+    
+    std::array<uint8_t, 1500> buffer;
+    DhcpMessageWriter writer(buffer.data(), buffer.size());
+    writer.begin(header);
+    writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(DhcpMessageType::ACK));
+    options.write(writer, 7200, string_to_ip("10.1.0.2"));
+    ByteView encoded = writer.finish();
+    
+    // Lease-dependent values are patched per reply, the rest comes from the blob
+    DhcpMessageView view(encoded.data(), encoded.size());
+    ByteView sid = view.option_data(DhcpOptionCode::SERVER_IDENTIFIER);
+    ASSERT_EQ(sid.size(), 4u);
+    IpAddress sid_value;
+    memcpy(&sid_value, sid.data(), 4);
+    EXPECT_EQ(sid_value, string_to_ip("10.1.0.2"));
+    EXPECT_EQ(read_u32(view.option_data(DhcpOptionCode::IP_ADDRESS_LEASE_TIME)), 7200u);
+    EXPECT_EQ(read_u32(view.option_data(DhcpOptionCode::RENEWAL_TIME)), 3600u);
+    EXPECT_EQ(read_u32(view.option_data(DhcpOptionCode::REBINDING_TIME)), 6300u);
+    ByteView mask = view.option_data(DhcpOptionCode::SUBNET_MASK);
+    ASSERT_EQ(mask.size(), 4u);
+    EXPECT_EQ(mask[0], 255);
+    EXPECT_EQ(mask[1], 255);
+    EXPECT_EQ(mask[2], 0);
+    EXPECT_EQ(view.option_data(DhcpOptionCode::DOMAIN_SERVER).size(), 8u);
+    EXPECT_EQ(view.option_data(DhcpOptionCode::DOMAIN_NAME).size(), subnet.domain_name.size());
+    
+    // DHCPINFORM replies carry the subnet options but no lease times
+    writer.begin(header);
+    writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(DhcpMessageType::ACK));
+    options.write_without_lease(writer, options.server_id());
+    encoded = writer.finish();
+    DhcpMessageView inform(encoded.data(), encoded.size());
+    EXPECT_TRUE(inform.has_option(DhcpOptionCode::SERVER_IDENTIFIER));
+    EXPECT_TRUE(inform.has_option(DhcpOptionCode::ROUTER));
+    EXPECT_FALSE(inform.has_option(DhcpOptionCode::IP_ADDRESS_LEASE_TIME));
+    EXPECT_FALSE(inform.has_option(DhcpOptionCode::RENEWAL_TIME));
+}
+
 // Test Lease Manager
+TEST(ReplyCacheTest, AnswersRetransmissionsUntilExpiryOrRelease) {
+    ReplyCache cache(64, std::chrono::milliseconds(3000));
+    const auto now = ReplyCache::Clock::now();
+    const MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    const std::vector<uint8_t> offer = {2, 1, 6, 0, 0xde, 0xad};
+    const std::vector<uint8_t> ack = {2, 1, 6, 0, 0xbe, 0xef};
+    cache.store(mac, 0x1234, DhcpMessageType::DISCOVER, offer, now);
+    cache.store(mac, 0x1234, DhcpMessageType::REQUEST, ack, now);
+    
+    ReplyCache::Buffer out;
+    ASSERT_EQ(cache.lookup(mac, 0x1234, DhcpMessageType::DISCOVER, out, now), offer.size());
+    EXPECT_EQ(std::vector<uint8_t>(out.begin(), out.begin() + offer.size()), offer);
+    ASSERT_EQ(cache.lookup(mac, 0x1234, DhcpMessageType::REQUEST, out, now), ack.size());
+    EXPECT_EQ(out[5], 0xef);
+    
+    // Another transaction or another client misses
+    EXPECT_EQ(cache.lookup(mac, 0x1235, DhcpMessageType::DISCOVER, out, now), 0u);
+    MacAddress other = mac;
+    other[5] = 0x56;
+    EXPECT_EQ(cache.lookup(other, 0x1234, DhcpMessageType::DISCOVER, out, now), 0u);
+    EXPECT_EQ(cache.hits(), 2u);
+    EXPECT_EQ(cache.misses(), 2u);
+    
+    // Entries expire after the TTL
+    EXPECT_EQ(cache.lookup(mac, 0x1234, DhcpMessageType::DISCOVER, out, now + std::chrono::seconds(4)), 0u);
+    
+    // RELEASE/DECLINE drop every reply of the client
+    cache.store(other, 7, DhcpMessageType::DISCOVER, offer, now);
+    cache.invalidate(mac);
+    EXPECT_EQ(cache.lookup(mac, 0x1234, DhcpMessageType::REQUEST, out, now), 0u);
+    EXPECT_EQ(cache.lookup(other, 7, DhcpMessageType::DISCOVER, out, now), offer.size());
+    
+    // Oversized replies are not kept, and the table stays bounded
+    cache.store(mac, 9, DhcpMessageType::DISCOVER, std::vector<uint8_t>(ReplyCache::kMaxReplySize + 1, 0), now);
+    EXPECT_EQ(cache.lookup(mac, 9, DhcpMessageType::DISCOVER, out, now), 0u);
+    MacAddress flood = mac;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        flood[3] = static_cast<uint8_t>(i >> 8);
+        flood[4] = static_cast<uint8_t>(i);
+        cache.store(flood, i, DhcpMessageType::DISCOVER, offer, now);
+    }
+    size_t kept = 0;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        flood[3] = static_cast<uint8_t>(i >> 8);
+        flood[4] = static_cast<uint8_t>(i);
+        kept += cache.lookup(flood, i, DhcpMessageType::DISCOVER, out, now) > 0 ? 1 : 0;
+    }
+    EXPECT_LE(kept, cache.capacity());
+    EXPECT_GT(kept, 0u);
+}
+
+TEST(DhcpServerTest, ReplayAnswersThroughTheSink) {
+    std::vector<std::vector<uint8_t>> replies;
+    std::vector<ReplyRoute> routes;
+    DhcpServer server;
+    server.enable_replay([&](ByteView packet, const ReplyRoute& route) {
+        replies.emplace_back(packet.begin(), packet.end());
+        routes.push_back(route);
+    });
+    server.initialize();
+    EXPECT_THROW(server.enable_replay([](ByteView, const ReplyRoute&) {}), DhcpServerException);
+
+    const MacAddress mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x07};
+    auto replay = [&](DhcpMessageBuilder& builder) {
+        DhcpMessage message = builder.build();
+        message.header.op = 1;
+        const std::vector<uint8_t> encoded = DhcpParser::generate_message(message);
+        PacketBuffer packet;
+        std::memcpy(packet.data(), encoded.data(), encoded.size());
+        packet.set_size(encoded.size());
+        packet.peer().sin_family = AF_INET;
+        server.replay_packet(packet);
+    };
+
+    DhcpMessageBuilder discover;
+    discover.set_message_type(DhcpMessageType::DISCOVER).set_transaction_id(0x1001).set_client_mac(mac);
+    replay(discover);
+    ASSERT_EQ(replies.size(), 1u);
+    const DhcpMessageView offer(replies[0].data(), replies[0].size());
+    EXPECT_EQ(offer.message_type(), DhcpMessageType::OFFER);
+    EXPECT_EQ(offer.xid(), 0x1001u);
+    EXPECT_TRUE(is_ip_in_subnet(offer.header().yiaddr, string_to_ip("192.168.1.0"), 24));
+    EXPECT_EQ(routes[0].port, 68);
+
+    DhcpMessageBuilder request;
+    request.set_message_type(DhcpMessageType::REQUEST).set_transaction_id(0x1002).set_client_mac(mac)
+           .add_option_ip(DhcpOptionCode::REQUESTED_IP_ADDRESS, ntohl(offer.header().yiaddr));
+    const ByteView server_id = offer.option_data(DhcpOptionCode::SERVER_IDENTIFIER);
+    request.add_option(DhcpOptionCode::SERVER_IDENTIFIER, std::vector<uint8_t>(server_id.begin(), server_id.end()));
+    replay(request);
+    ASSERT_EQ(replies.size(), 2u);
+    const DhcpMessageView ack(replies[1].data(), replies[1].size());
+    EXPECT_EQ(ack.message_type(), DhcpMessageType::ACK);
+    EXPECT_EQ(ack.header().yiaddr, offer.header().yiaddr);
+
+    const DhcpStats stats = server.get_statistics();
+    EXPECT_EQ(stats.discover_count, 1u);
+    EXPECT_EQ(stats.request_count, 1u);
+    EXPECT_FALSE(server.is_running());
+}
+
+TEST(OptionsManagerTest, ResolutionPlanMatchesInheritance) {
+    DhcpOptionsManager options;
+    const std::vector<uint8_t> global_dns = {8, 8, 8, 8};
+    const std::vector<uint8_t> office_dns = {10, 0, 0, 53};
+    const std::vector<uint8_t> lab_router = {10, 0, 9, 1};
+    const std::vector<uint8_t> vendor_ntp = {10, 0, 0, 123};
+    options.set_global_options({{DhcpOptionCode::DOMAIN_SERVER, global_dns},
+                                {DhcpOptionCode::DOMAIN_NAME, {'c', 'o', 'r', 'p'}}});
+    options.set_subnet_options("office", {{DhcpOptionCode::DOMAIN_SERVER, office_dns}});
+    options.set_pool_options("office", "lab", {{DhcpOptionCode::ROUTER, lab_router}});
+    OptionInheritanceRule rule("global", "subnet", DhcpOptionCode::NTP_SERVERS, false);
+    rule.condition = "vendor_class";
+    rule.override_value = vendor_ntp;
+    options.add_inheritance_rule(rule);
+    options.set_global_options({{DhcpOptionCode::DOMAIN_SERVER, global_dns},
+                                {DhcpOptionCode::DOMAIN_NAME, {'c', 'o', 'r', 'p'}},
+                                {DhcpOptionCode::NTP_SERVERS, {1, 2, 3, 4}}});
+    
+    const std::vector<DhcpOptionCode> requested = {DhcpOptionCode::DOMAIN_SERVER, DhcpOptionCode::ROUTER,
+                                                   DhcpOptionCode::NTP_SERVERS, DhcpOptionCode::DOMAIN_NAME,
+                                                   DhcpOptionCode::ROUTER};
+    OptionsContext context;
+    context.subnet_name = "office";
+    context.pool_name = "lab";
+    ResolvedOptions resolved;
+    options.process_client_request(requested, context, nullptr, resolved);
+    ASSERT_EQ(resolved.size(), 4u);
+    EXPECT_EQ(resolved[0].code, DhcpOptionCode::DOMAIN_SERVER);
+    EXPECT_EQ(std::vector<uint8_t>(resolved[0].data, resolved[0].data + resolved[0].length), office_dns);
+    EXPECT_EQ(std::vector<uint8_t>(resolved[1].data, resolved[1].data + resolved[1].length), lab_router);
+    EXPECT_EQ(resolved.find(DhcpOptionCode::NTP_SERVERS)->length, 4u);
+    EXPECT_EQ(resolved.find(DhcpOptionCode::NTP_SERVERS)->data[0], 1);
+    
+    // The rule only applies to clients sending a vendor class
+    context.vendor_class = "MSFT 5.0";
+    options.process_client_request(requested, context, nullptr, resolved);
+    const ResolvedOption* ntp = resolved.find(DhcpOptionCode::NTP_SERVERS);
+    ASSERT_NE(ntp, nullptr);
+    EXPECT_EQ(std::vector<uint8_t>(ntp->data, ntp->data + ntp->length), vendor_ntp);
+    
+    // Host options win; an unknown pool resolves as its subnet
+    const OptionMap host = {{DhcpOptionCode::DOMAIN_SERVER, {1, 1, 1, 1}}};
+    context.pool_name = "missing";
+    options.process_client_request(requested, context, &host, resolved);
+    EXPECT_EQ(resolved.find(DhcpOptionCode::DOMAIN_SERVER)->data[0], 1);
+    EXPECT_EQ(resolved.find(DhcpOptionCode::ROUTER), nullptr);
+    
+    // The plan agrees with merging the scopes per request
+    const OptionMap merged = options.apply_inheritance(
+        {{DhcpOptionCode::DOMAIN_SERVER, global_dns}, {DhcpOptionCode::DOMAIN_NAME, {'c', 'o', 'r', 'p'}},
+         {DhcpOptionCode::NTP_SERVERS, {1, 2, 3, 4}}},
+        {{DhcpOptionCode::DOMAIN_SERVER, office_dns}}, {}, host, context);
+    for (const auto& option : resolved) {
+        ASSERT_TRUE(merged.count(option.code));
+        EXPECT_EQ(std::vector<uint8_t>(option.data, option.data + option.length), merged.at(option.code));
+    }
+    
+    // Changing a scope publishes a new plan; the resolved views keep the old one alive
+    const auto before = options.resolution_plan();
+    options.set_subnet_options("office", {});
+    EXPECT_NE(options.resolution_plan(), before);
+    EXPECT_EQ(resolved.find(DhcpOptionCode::DOMAIN_SERVER)->data[0], 1);
+    EXPECT_EQ(options.process_client_request(requested, context).at(DhcpOptionCode::DOMAIN_SERVER), global_dns);
+}
+
 class LeaseManagerTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -246,6 +658,567 @@ TEST_F(LeaseManagerTest, LeaseRenewal) {
     EXPECT_GT(renewed_lease.lease_start, lease.lease_start);
 }
 
+TEST_F(LeaseManagerTest, AddressPoolBitmap) {
+    DhcpSubnet subnet;
+    subnet.range_start = string_to_ip("10.0.0.1");
+    subnet.range_end = string_to_ip("10.0.0.130");
+    subnet.exclusions.push_back({string_to_ip("10.0.0.2"), string_to_ip("10.0.0.3")});
+    
+    AddressPool pool(subnet);
+    EXPECT_EQ(pool.size(), 130u);
+    EXPECT_EQ(pool.free_count(), 128u);
+    EXPECT_FALSE(pool.is_free(string_to_ip("10.0.0.2")));
+    EXPECT_FALSE(pool.contains(string_to_ip("10.0.0.131")));
+    
+    // Exclusions are skipped and the cursor rotates past handed-out addresses
+    EXPECT_EQ(pool.find_free(), string_to_ip("10.0.0.1"));
+    pool.mark_used(string_to_ip("10.0.0.1"));
+    EXPECT_EQ(pool.find_free(), string_to_ip("10.0.0.4"));
+    pool.mark_free(string_to_ip("10.0.0.1"));
+    EXPECT_EQ(pool.find_free(), string_to_ip("10.0.0.5"));
+    
+    // Freeing an excluded address does not make it available
+    pool.mark_free(string_to_ip("10.0.0.3"));
+    EXPECT_FALSE(pool.is_free(string_to_ip("10.0.0.3")));
+    
+    // The search wraps around to addresses below the cursor
+    for (uint32_t host = 4; host <= 130; ++host) {
+        pool.mark_used(htonl(ntohl(string_to_ip("10.0.0.0")) + host));
+    }
+    EXPECT_EQ(pool.free_count(), 1u);
+    EXPECT_EQ(pool.find_free(), string_to_ip("10.0.0.1"));
+    pool.mark_used(string_to_ip("10.0.0.1"));
+    EXPECT_EQ(pool.find_free(), 0u);
+}
+
+TEST_F(LeaseManagerTest, LeaseStoreRoundTrip) {
+    LeaseStore store;
+    AddressIndex owners;
+    const auto now = std::chrono::system_clock::now();
+    
+    // Enough clients to grow both tables several times
+    for (uint32_t i = 0; i < 1000; ++i) {
+        DhcpLease lease;
+        lease.mac_address = {0x02, 0x00, 0x00, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)};
+        lease.ip_address = htonl(0x0A000000u + i);
+        lease.hostname = i % 2 ? "host-" + std::to_string(i) : "";
+        lease.client_id = "shared-id";
+        lease.lease_start = now;
+        lease.lease_end = now + std::chrono::seconds(3600);
+        lease.lease_time = std::chrono::seconds(3600);
+        lease.lease_type = LeaseType::DYNAMIC;
+        lease.is_active = true;
+        if (i == 7) {
+            lease.options[DhcpOptionCode::DOMAIN_NAME] = {'l', 'a', 'n'};
+        }
+        store.put(lease);
+        EXPECT_TRUE(owners.insert(lease.ip_address, lease.mac_address));
+    }
+    EXPECT_EQ(store.size(), 1000u);
+    EXPECT_EQ(owners.size(), 1000u);
+    
+    MacAddress mac7 = {0x02, 0x00, 0x00, 0x00, 0x00, 0x07};
+    const LeaseRecord* record = store.find(mac7);
+    ASSERT_NE(record, nullptr);
+    DhcpLease loaded = store.load(*record);
+    EXPECT_EQ(loaded.hostname, "host-7");
+    EXPECT_EQ(loaded.client_id, "shared-id");
+    EXPECT_TRUE(loaded.lease_start == now);
+    EXPECT_EQ(loaded.lease_time.count(), 3600);
+    EXPECT_EQ(loaded.options.size(), 1u);
+    EXPECT_TRUE(loaded.is_active);
+    
+    MacAddress owner;
+    ASSERT_TRUE(owners.find(htonl(0x0A000007u), owner));
+    EXPECT_EQ(owner, mac7);
+    EXPECT_FALSE(owners.erase(htonl(0x0A000007u), MacAddress{}));
+    
+    // Every other record removed; probing must still reach the survivors
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        MacAddress mac = {0x02, 0x00, 0x00, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)};
+        EXPECT_TRUE(store.erase(mac));
+        EXPECT_TRUE(owners.erase(htonl(0x0A000000u + i), mac));
+    }
+    EXPECT_EQ(store.size(), 500u);
+    EXPECT_EQ(owners.size(), 500u);
+    size_t sharing = 0;
+    store.for_each_client_id("shared-id", [&](const LeaseRecord& shared) {
+        EXPECT_EQ(store.load(shared).client_id, "shared-id");
+        ++sharing;
+    });
+    EXPECT_EQ(sharing, 500u);
+    store.for_each_client_id("other-id", [&](const LeaseRecord&) { ADD_FAILURE(); });
+    for (uint32_t i = 1; i < 1000; i += 2) {
+        MacAddress mac = {0x02, 0x00, 0x00, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)};
+        record = store.find(mac);
+        ASSERT_NE(record, nullptr);
+        EXPECT_EQ(record->ip_address, htonl(0x0A000000u + i));
+        EXPECT_EQ(store.load(*record).hostname, "host-" + std::to_string(i));
+        EXPECT_TRUE(owners.contains(htonl(0x0A000000u + i)));
+    }
+    EXPECT_EQ(store.find(MacAddress{0x02, 0, 0, 0, 0, 0}), nullptr);
+    EXPECT_FALSE(owners.contains(htonl(0x0A000000u)));
+    
+    // Freed slots are reused in place
+    DhcpLease lease;
+    lease.mac_address = {0x02, 0xFF, 0x00, 0x00, 0x00, 0x01};
+    lease.ip_address = htonl(0x0B000001u);
+    const size_t memory = store.memory_usage();
+    store.put(lease);
+    EXPECT_EQ(store.memory_usage(), memory);
+    EXPECT_EQ(store.find(lease.mac_address)->ip_address, lease.ip_address);
+}
+
+TEST_F(LeaseManagerTest, ExpiryHeapOrdering) {
+    ExpiryHeap heap;
+    for (uint32_t id = 0; id < 100; ++id) {
+        heap.schedule(id, 1000 - int64_t(id) * 7 % 1000);
+    }
+    heap.schedule(50, 5);      // moved earlier
+    heap.schedule(0, 100000);  // moved later
+    heap.cancel(10);
+    heap.cancel(10);
+    EXPECT_EQ(heap.size(), 99u);
+    EXPECT_FALSE(heap.contains(10));
+    EXPECT_EQ(heap.top(), 50u);
+    
+    int64_t previous = heap.top_deadline();
+    uint32_t last = 0;
+    while (!heap.empty()) {
+        EXPECT_LE(previous, heap.top_deadline());
+        previous = heap.top_deadline();
+        last = heap.top();
+        heap.cancel(last);
+    }
+    EXPECT_EQ(last, 0u);
+}
+
+/**
+ * @brief Lease manager with the expiry pass exposed
+ */
+class SweepableLeaseManager : public LeaseManager {
+public:
+    using LeaseManager::LeaseManager;
+    using LeaseManager::cleanup_expired_leases;
+};
+
+TEST_F(LeaseManagerTest, ExpiryPassPopsOnlyDueLeases) {
+    DhcpConfig expiring = create_test_config();
+    DhcpSubnet instant = expiring.subnets[0];
+    instant.name = "instant";
+    instant.network = string_to_ip("192.168.2.0");
+    instant.range_start = string_to_ip("192.168.2.100");
+    instant.range_end = string_to_ip("192.168.2.200");
+    instant.lease_time = 0;
+    expiring.subnets.push_back(instant);
+    
+    SweepableLeaseManager sweeper(expiring);
+    std::vector<DhcpLease> expired;
+    sweeper.set_lease_expiration_callback([&expired](const DhcpLease& lease) { expired.push_back(lease); });
+    
+    MacAddress kept = {0x00, 0x11, 0x22, 0x33, 0x44, 0x01};
+    MacAddress dropped = {0x00, 0x11, 0x22, 0x33, 0x44, 0x02};
+    DhcpLease kept_lease = sweeper.allocate_lease(kept, 0, "test-subnet");
+    DhcpLease dropped_lease = sweeper.allocate_lease(dropped, 0, "instant");
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    
+    sweeper.cleanup_expired_leases();
+    ASSERT_EQ(expired.size(), 1u);
+    EXPECT_EQ(expired[0].mac_address, dropped);
+    EXPECT_FALSE(expired[0].is_active);
+    EXPECT_EQ(sweeper.get_lease_by_mac(dropped), nullptr);
+    EXPECT_TRUE(sweeper.is_ip_available(dropped_lease.ip_address, "instant"));
+    ASSERT_NE(sweeper.get_lease_by_mac(kept), nullptr);
+    EXPECT_EQ(sweeper.get_statistics().active_leases, 1u);
+    
+    // Nothing else is due
+    sweeper.cleanup_expired_leases();
+    EXPECT_EQ(expired.size(), 1u);
+    EXPECT_EQ(sweeper.get_lease_by_ip(kept_lease.ip_address)->mac_address, kept);
+}
+
+TEST_F(LeaseManagerTest, JournalReplayStopsAtTornRecord) {
+    const std::string path = "/tmp/simple-dhcpd-test-journal-torn";
+    std::remove(path.c_str());
+    
+    DhcpLease lease;
+    lease.mac_address = {0x00, 0x11, 0x22, 0x33, 0x44, 0x10};
+    lease.ip_address = string_to_ip("192.168.1.110");
+    lease.hostname = "printer";
+    lease.client_id = "client-10";
+    lease.lease_start = std::chrono::system_clock::now();
+    lease.lease_end = lease.lease_start + std::chrono::hours(1);
+    lease.lease_type = LeaseType::STATIC;
+    lease.is_static = true;
+    lease.is_active = true;
+    {
+        LeaseJournal journal(path);
+        journal.append(JournalOp::ALLOCATE, lease);
+        journal.append(JournalOp::RENEW, lease);
+        journal.wait_durable(journal.append(JournalOp::RELEASE, lease));
+        EXPECT_EQ(journal.record_count(), 3u);
+    }
+    uint64_t intact = 0;
+    std::vector<JournalOp> ops;
+    LeaseJournal::replay(path, [&](JournalOp op, const DhcpLease& replayed) {
+        ops.push_back(op);
+        EXPECT_EQ(replayed.mac_address, lease.mac_address);
+        EXPECT_EQ(replayed.ip_address, lease.ip_address);
+        EXPECT_EQ(replayed.hostname, "printer");
+        EXPECT_EQ(replayed.client_id, "client-10");
+        EXPECT_EQ(replayed.lease_end, lease.lease_end);
+        EXPECT_TRUE(replayed.is_static);
+    }, &intact);
+    EXPECT_EQ(ops, (std::vector<JournalOp>{JournalOp::ALLOCATE, JournalOp::RENEW, JournalOp::RELEASE}));
+    
+    // A crash mid-write leaves half a record behind
+    std::string torn;
+    LeaseJournal::encode(JournalOp::EXPIRE, lease, torn);
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out.write(torn.data(), static_cast<std::streamsize>(torn.size() / 2));
+    }
+    EXPECT_EQ(LeaseJournal::replay(path, nullptr), 3u);
+    {
+        LeaseJournal reopened(path);
+        EXPECT_EQ(reopened.size_bytes(), intact);
+        reopened.wait_durable(reopened.append(JournalOp::EXPIRE, lease));
+    }
+    EXPECT_EQ(LeaseJournal::replay(path, nullptr), 4u);
+    std::remove(path.c_str());
+}
+
+namespace {
+/** Makes writes past a file size fail with EFBIG, as a full disk would, until destroyed */
+class FileSizeLimit {
+public:
+    explicit FileSizeLimit(rlim_t bytes) {
+        previous_handler_ = std::signal(SIGXFSZ, SIG_IGN);
+        getrlimit(RLIMIT_FSIZE, &previous_);
+        struct rlimit limit = previous_;
+        limit.rlim_cur = bytes;
+        setrlimit(RLIMIT_FSIZE, &limit);
+    }
+    ~FileSizeLimit() {
+        setrlimit(RLIMIT_FSIZE, &previous_);
+        std::signal(SIGXFSZ, previous_handler_);
+    }
+
+private:
+    struct rlimit previous_;
+    void (*previous_handler_)(int);
+};
+}
+
+TEST_F(LeaseManagerTest, JournalRetriesFailedWritesWithoutAcknowledging) {
+    const std::string path = "/tmp/simple-dhcpd-test-journal-full";
+    std::remove(path.c_str());
+    
+    DhcpLease lease;
+    lease.mac_address = {0x00, 0x11, 0x22, 0x33, 0x44, 0x30};
+    lease.ip_address = string_to_ip("192.168.1.130");
+    lease.hostname = "scanner";
+    lease.lease_start = std::chrono::system_clock::now();
+    lease.lease_end = lease.lease_start + std::chrono::hours(1);
+    lease.is_active = true;
+    std::string record;
+    LeaseJournal::encode(JournalOp::ALLOCATE, lease, record);
+    {
+        LeaseJournal journal(path);
+        journal.wait_durable(journal.append(JournalOp::ALLOCATE, lease));
+        const uint64_t committed = journal.size_bytes();
+        
+        std::future<void> durable;
+        {
+            // Room for half a record: the first write is torn, then fails
+            FileSizeLimit limit(committed + record.size() / 2);
+            const uint64_t sequence = journal.append(JournalOp::RENEW, lease);
+            durable = std::async(std::launch::async, [&journal, sequence]() { journal.wait_durable(sequence); });
+            EXPECT_EQ(durable.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+            EXPECT_GE(journal.write_failure_count(), 1u);
+            EXPECT_THROW(journal.rotate(path + ".old"), LeaseJournalException);
+        }
+        // Space is back: the retry commits the record
+        ASSERT_EQ(durable.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        durable.get();
+        EXPECT_EQ(journal.size_bytes(), committed + record.size());
+        journal.wait_durable(journal.append(JournalOp::RELEASE, lease));
+    }
+    
+    uint64_t intact = 0;
+    std::vector<JournalOp> ops;
+    LeaseJournal::replay(path, [&](JournalOp op, const DhcpLease&) { ops.push_back(op); }, &intact);
+    EXPECT_EQ(ops, (std::vector<JournalOp>{JournalOp::ALLOCATE, JournalOp::RENEW, JournalOp::RELEASE}));
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    EXPECT_EQ(static_cast<uint64_t>(file.tellg()), intact);
+    EXPECT_EQ(::access((path + ".old").c_str(), F_OK), -1);
+    std::remove(path.c_str());
+}
+
+TEST_F(LeaseManagerTest, JournalCompactionRetriesFailedRotation) {
+    const std::string path = "/tmp/simple-dhcpd-test-journal-rotate";
+    for (const std::string& file : {path, path + ".snapshot", path + ".old"}) {
+        std::remove(file.c_str());
+    }
+    
+    MacAddress first = {0x00, 0x11, 0x22, 0x33, 0x44, 0x31};
+    MacAddress second = {0x00, 0x11, 0x22, 0x33, 0x44, 0x32};
+    {
+        LeaseManager writer(config);
+        writer.open_journal(path);
+        writer.allocate_lease(first, 0, "test-subnet");
+        {
+            // The fresh journal cannot take its header
+            FileSizeLimit limit(4);
+            EXPECT_THROW(writer.compact_journal(), LeaseJournalException);
+        }
+        // The journal kept its file and name; nothing is deleted under it
+        EXPECT_EQ(::access((path + ".old").c_str(), F_OK), -1);
+        writer.allocate_lease(second, 0, "test-subnet");
+        EXPECT_EQ(LeaseJournal::replay(path, nullptr), 2u);
+        EXPECT_TRUE(writer.compact_journal());
+        writer.stop();
+    }
+    
+    LeaseManager reader(config);
+    reader.open_journal(path);
+    EXPECT_NE(reader.get_lease_by_mac(first), nullptr);
+    EXPECT_NE(reader.get_lease_by_mac(second), nullptr);
+    reader.stop();
+    for (const std::string& file : {path, path + ".snapshot", path + ".old"}) {
+        std::remove(file.c_str());
+    }
+}
+
+TEST_F(LeaseManagerTest, JournalRestoresLeasesAcrossCompaction) {
+    const std::string path = "/tmp/simple-dhcpd-test-journal-compact";
+    for (const std::string& file : {path, path + ".snapshot", path + ".old"}) {
+        std::remove(file.c_str());
+    }
+    
+    MacAddress kept = {0x00, 0x11, 0x22, 0x33, 0x44, 0x21};
+    MacAddress released = {0x00, 0x11, 0x22, 0x33, 0x44, 0x22};
+    MacAddress late = {0x00, 0x11, 0x22, 0x33, 0x44, 0x23};
+    IpAddress kept_ip = 0;
+    IpAddress released_ip = 0;
+    IpAddress late_ip = 0;
+    {
+        LeaseManager writer(config);
+        writer.open_journal(path);
+        kept_ip = writer.allocate_lease(kept, 0, "test-subnet").ip_address;
+        released_ip = writer.allocate_lease(released, 0, "test-subnet").ip_address;
+        EXPECT_TRUE(writer.release_lease(released, released_ip));
+        EXPECT_TRUE(writer.compact_journal());
+        
+        // Changes after the compaction land in the fresh journal
+        late_ip = writer.allocate_lease(late, 0, "test-subnet").ip_address;
+        writer.renew_lease(kept, kept_ip);
+    }
+    EXPECT_EQ(LeaseSnapshot(path + ".snapshot").size(), 1u);
+    EXPECT_EQ(LeaseJournal::replay(path, nullptr), 2u);
+    
+    LeaseManager reader(config);
+    reader.open_journal(path);
+    ASSERT_NE(reader.get_lease_by_mac(kept), nullptr);
+    EXPECT_EQ(reader.get_lease_by_ip(kept_ip)->mac_address, kept);
+    EXPECT_EQ(reader.get_lease_by_ip(late_ip)->mac_address, late);
+    EXPECT_EQ(reader.get_lease_by_mac(released), nullptr);
+    EXPECT_TRUE(reader.is_ip_available(released_ip, "test-subnet"));
+    EXPECT_FALSE(reader.is_ip_available(kept_ip, "test-subnet"));
+    EXPECT_EQ(reader.get_statistics().active_leases, 2u);
+    
+    reader.stop();
+    for (const std::string& file : {path, path + ".snapshot", path + ".old"}) {
+        std::remove(file.c_str());
+    }
+}
+
+TEST_F(LeaseManagerTest, SnapshotRoundTripAndValidation) {
+    const std::string path = "/tmp/simple-dhcpd-test-snapshot";
+    std::remove(path.c_str());
+    EXPECT_FALSE(manager->load_snapshot(path));
+    
+    std::vector<MacAddress> macs;
+    for (uint8_t i = 0; i < 20; ++i) {
+        // Allocation order differs from MAC order, which the file is sorted by
+        macs.push_back({0x00, 0x11, 0x22, 0x33, static_cast<uint8_t>(0x60 - i), i});
+        manager->allocate_lease(macs.back(), 0, "test-subnet");
+    }
+    manager->save_snapshot(path);
+    
+    {
+        LeaseSnapshot snapshot(path);
+        ASSERT_EQ(snapshot.size(), macs.size());
+        for (size_t i = 1; i < snapshot.size(); ++i) {
+            EXPECT_LT(snapshot.record(i - 1).mac_address, snapshot.record(i).mac_address);
+        }
+        const SnapshotRecord* found = snapshot.find(macs[7]);
+        ASSERT_NE(found, nullptr);
+        EXPECT_EQ(found->ip_address, manager->get_lease_by_mac(macs[7])->ip_address);
+        EXPECT_EQ(snapshot.find({0x02, 0, 0, 0, 0, 0}), nullptr);
+    }
+    
+    LeaseManager restored(config);
+    EXPECT_TRUE(restored.load_snapshot(path));
+    EXPECT_EQ(restored.get_statistics().active_leases, macs.size());
+    for (const auto& mac : macs) {
+        auto original = manager->get_lease_by_mac(mac);
+        auto loaded = restored.get_lease_by_mac(mac);
+        ASSERT_NE(loaded, nullptr);
+        EXPECT_EQ(loaded->ip_address, original->ip_address);
+        EXPECT_EQ(loaded->lease_end, original->lease_end);
+        EXPECT_FALSE(restored.is_ip_available(loaded->ip_address, "test-subnet"));
+    }
+    
+    // Flip one byte inside the records
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(sizeof(SnapshotHeader) + 90);
+        char byte = 0;
+        file.read(&byte, 1);
+        byte ^= 0x40;
+        file.seekp(sizeof(SnapshotHeader) + 90);
+        file.write(&byte, 1);
+    }
+    EXPECT_THROW(LeaseSnapshot snapshot(path), LeaseSnapshotException);
+    LeaseManager rejected(config);
+    EXPECT_THROW(rejected.load_snapshot(path), LeaseSnapshotException);
+    std::remove(path.c_str());
+}
+
+TEST_F(LeaseManagerTest, DeclinedAddressNotReoffered) {
+    const IpAddress declined = string_to_ip("192.168.1.100");
+    manager->add_declined_ip(declined, std::chrono::seconds(60));
+    
+    MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x66};
+    DhcpLease lease = manager->allocate_lease(mac, 0, "test-subnet");
+    EXPECT_NE(lease.ip_address, declined);
+    EXPECT_FALSE(manager->is_ip_available(declined, "test-subnet"));
+}
+
+TEST_F(LeaseManagerTest, PoolUsageFollowsAllocations) {
+    auto usage = manager->get_pool_usage();
+    ASSERT_EQ(usage.size(), 1u);
+    EXPECT_EQ(usage[0].subnet_name, "test-subnet");
+    EXPECT_EQ(usage[0].addresses, 101u);
+    EXPECT_EQ(usage[0].free, 101u);
+    
+    MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x00};
+    std::vector<DhcpLease> leases;
+    for (uint8_t i = 0; i < 3; ++i) {
+        mac[5] = i;
+        leases.push_back(manager->allocate_lease(mac, 0, "test-subnet"));
+    }
+    manager->add_declined_ip(string_to_ip("192.168.1.200"), std::chrono::seconds(60));
+    EXPECT_EQ(manager->get_pool_usage()[0].free, 97u);
+    
+    mac[5] = 0;
+    EXPECT_TRUE(manager->release_lease(mac, leases[0].ip_address));
+    EXPECT_EQ(manager->get_pool_usage()[0].free, 98u);
+    
+    // Exclusions shrink the pool instead of counting as used
+    DhcpConfig excluded = config;
+    excluded.subnets[0].exclusions.push_back({string_to_ip("192.168.1.100"), string_to_ip("192.168.1.109")});
+    LeaseManager other(excluded);
+    usage = other.get_pool_usage();
+    EXPECT_EQ(usage[0].addresses, 91u);
+    EXPECT_EQ(usage[0].free, 91u);
+}
+
+TEST_F(LeaseManagerTest, OffersHoldAddressesUntilRequest) {
+    const std::chrono::seconds hold(60);
+    MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x00};
+    const DhcpLease offer = manager->reserve_offer(mac, 0, 0, hold);
+    EXPECT_FALSE(offer.is_active);
+    EXPECT_EQ(manager->get_lease_by_mac(mac), nullptr);
+    EXPECT_FALSE(manager->is_ip_available(offer.ip_address, "test-subnet"));
+    EXPECT_EQ(manager->reserve_offer(mac, 0, 0, hold).ip_address, offer.ip_address);
+    
+    MacAddress other = mac;
+    other[5] = 1;
+    EXPECT_NE(manager->reserve_offer(other, offer.ip_address, 0, hold).ip_address, offer.ip_address);
+    auto usage = manager->get_pool_usage();
+    EXPECT_EQ(usage[0].offered, 2u);
+    EXPECT_EQ(usage[0].free, 99u);
+    
+    // REQUEST turns the offer into the lease, on the offered address
+    EXPECT_EQ(manager->allocate_lease(mac, 0, "test-subnet").ip_address, offer.ip_address);
+    usage = manager->get_pool_usage();
+    EXPECT_EQ(usage[0].offered, 1u);
+    EXPECT_EQ(usage[0].free, 99u);
+    EXPECT_EQ(manager->reserve_offer(mac, 0, 0, hold).ip_address, offer.ip_address);
+    EXPECT_EQ(manager->get_pool_usage()[0].offered, 1u);
+    
+    // An offer nobody requests returns its address to the pool
+    other[5] = 2;
+    const DhcpLease lapsed = manager->reserve_offer(other, 0, 0, std::chrono::seconds(0));
+    EXPECT_TRUE(manager->is_ip_available(lapsed.ip_address, "test-subnet"));
+    
+    // A DISCOVER flood exhausts the pool without creating a single lease
+    size_t offered = 0;
+    for (uint32_t i = 3; i < 200; ++i) {
+        other[4] = static_cast<uint8_t>(i >> 8);
+        other[5] = static_cast<uint8_t>(i);
+        try {
+            manager->reserve_offer(other, 0, 0, hold);
+            ++offered;
+        } catch (const LeaseManagerException&) {
+            break;
+        }
+    }
+    EXPECT_EQ(offered, 99u);
+    EXPECT_EQ(manager->get_active_leases().size(), 1u);
+    EXPECT_EQ(manager->get_pool_usage()[0].free, 0u);
+}
+
+TEST_F(LeaseManagerTest, ReconfigureKeepsLeases) {
+    MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x00};
+    std::vector<DhcpLease> leases;
+    for (uint8_t i = 0; i < 3; ++i) {
+        mac[5] = i;
+        leases.push_back(manager->allocate_lease(mac, 0, "test-subnet"));
+    }
+    
+    // Shrink the range, then add a second subnet
+    DhcpConfig reloaded = config;
+    reloaded.subnets[0].range_end = string_to_ip("192.168.1.150");
+    DhcpSubnet guest;
+    guest.name = "guest-subnet";
+    guest.network = string_to_ip("192.168.2.0");
+    guest.range_start = string_to_ip("192.168.2.10");
+    guest.range_end = string_to_ip("192.168.2.19");
+    guest.lease_time = 600;
+    reloaded.subnets.push_back(guest);
+    manager->reconfigure(reloaded);
+    
+    auto usage = manager->get_pool_usage();
+    ASSERT_EQ(usage.size(), 2u);
+    EXPECT_EQ(usage[0].addresses, 51u);
+    EXPECT_EQ(usage[0].free, 48u);
+    EXPECT_EQ(usage[1].subnet_name, "guest-subnet");
+    EXPECT_EQ(usage[1].free, 10u);
+    
+    mac[5] = 1;
+    auto lease = manager->get_lease_by_mac(mac);
+    ASSERT_NE(lease, nullptr);
+    EXPECT_EQ(lease->ip_address, leases[1].ip_address);
+    EXPECT_FALSE(manager->is_ip_available(leases[1].ip_address, "test-subnet"));
+    mac[5] = 9;
+    EXPECT_EQ(ip_to_string(manager->allocate_lease(mac, 0, "guest-subnet").ip_address).substr(0, 10), "192.168.2.");
+    
+    // Removing a subnet retires its pool and keeps the other's id
+    DhcpConfig removed;
+    removed.enable_logging = false;
+    removed.subnets.push_back(guest);
+    manager->reconfigure(removed);
+    usage = manager->get_pool_usage();
+    ASSERT_EQ(usage.size(), 1u);
+    EXPECT_EQ(usage[0].subnet_name, "guest-subnet");
+    mac[5] = 10;
+    EXPECT_THROW(manager->allocate_lease(mac, 0, "test-subnet"), LeaseManagerException);
+    EXPECT_EQ(manager->subnet_table()->index().find_by_name("guest-subnet"), 1u);
+}
+
 TEST_F(LeaseManagerTest, LeaseRelease) {
     // Test MAC address
     MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
@@ -268,3 +1241,639 @@ TEST_F(LeaseManagerTest, LeaseRelease) {
         EXPECT_FALSE(released_lease->is_active);
     }
 }
+
+TEST_F(LeaseManagerTest, ReplicatedChangesKeepTheNewestLease) {
+    MacAddress local = {0x00, 0x11, 0x22, 0x33, 0x44, 0x61};
+    MacAddress remote = {0x00, 0x11, 0x22, 0x33, 0x44, 0x62};
+    DhcpLease mine = manager->allocate_lease(local, 0, "test-subnet");
+    
+    // The peer handed the same address out earlier: the local lease stays
+    DhcpLease theirs = mine;
+    theirs.mac_address = remote;
+    theirs.lease_start = mine.lease_start - std::chrono::seconds(10);
+    EXPECT_FALSE(manager->apply_replicated(JournalOp::ALLOCATE, theirs));
+    EXPECT_EQ(manager->get_lease_by_ip(mine.ip_address)->mac_address, local);
+    
+    // A later lease from the peer takes the address over
+    theirs.lease_start = mine.lease_start + std::chrono::seconds(10);
+    EXPECT_TRUE(manager->apply_replicated(JournalOp::ALLOCATE, theirs));
+    EXPECT_EQ(manager->get_lease_by_mac(local), nullptr);
+    EXPECT_EQ(manager->get_lease_by_ip(mine.ip_address)->mac_address, remote);
+    
+    // A release older than the lease held here is ignored
+    DhcpLease stale = theirs;
+    stale.lease_start = theirs.lease_start - std::chrono::seconds(1);
+    EXPECT_FALSE(manager->apply_replicated(JournalOp::RELEASE, stale));
+    EXPECT_TRUE(manager->apply_replicated(JournalOp::RELEASE, theirs));
+    EXPECT_TRUE(manager->is_ip_available(mine.ip_address, "test-subnet"));
+    
+    // Applied changes are not reported back to the change listener
+    size_t reported = 0;
+    manager->set_change_listener([&reported](JournalOp, const DhcpLease&) { ++reported; });
+    EXPECT_TRUE(manager->apply_replicated(JournalOp::ALLOCATE, theirs));
+    manager->release_lease(remote, theirs.ip_address);
+    EXPECT_EQ(reported, 1u);
+    manager->set_change_listener(nullptr);
+}
+
+TEST_F(LeaseManagerTest, AllocationMaskSplitsThePool) {
+    DhcpSubnet subnet;
+    subnet.range_start = string_to_ip("10.0.0.1");
+    subnet.range_end = string_to_ip("10.0.0.8");
+    AddressPool pool(subnet);
+    EXPECT_EQ(pool.find_free(0xAAAAAAAAAAAAAAAAull), string_to_ip("10.0.0.2"));
+    pool.mark_used(string_to_ip("10.0.0.2"));
+    EXPECT_EQ(pool.find_free(0xAAAAAAAAAAAAAAAAull), string_to_ip("10.0.0.4"));
+    
+    // Odd offsets only; the manager falls back to the rest once they run out
+    manager->set_allocation_mask(0xAAAAAAAAAAAAAAAAull);
+    std::vector<IpAddress> allocated;
+    for (uint8_t i = 0; i < 51; ++i) {
+        allocated.push_back(manager->allocate_lease({0x02, 0, 0, 0, 0x71, i}, 0, "test-subnet").ip_address);
+    }
+    for (size_t i = 0; i < 50; ++i) {
+        EXPECT_EQ((ntohl(allocated[i]) - ntohl(config.subnets[0].range_start)) % 2, 1u);
+    }
+    EXPECT_EQ((ntohl(allocated[50]) - ntohl(config.subnets[0].range_start)) % 2, 0u);
+}
+
+TEST_F(LeaseManagerTest, HistoryRingSpillsOlderChanges) {
+    const std::string path = "/tmp/simple-dhcpd-test-history";
+    std::remove(path.c_str());
+    
+    DhcpLease lease;
+    lease.mac_address = {0x00, 0x11, 0x22, 0x33, 0x44, 0x20};
+    lease.ip_address = string_to_ip("192.168.1.120");
+    DhcpLease other = lease;
+    other.ip_address = string_to_ip("192.168.1.121");
+    const auto start = std::chrono::system_clock::now();
+    
+    // Without a file only the newest `depth` changes are kept
+    {
+        LeaseHistory history(3);
+        for (int i = 0; i < 5; ++i) {
+            lease.lease_start = start + std::chrono::seconds(i);
+            history.record(i == 0 ? JournalOp::ALLOCATE : JournalOp::RENEW, lease);
+        }
+        const auto kept = history.get(lease.ip_address);
+        ASSERT_EQ(kept.size(), 3u);
+        EXPECT_EQ(kept.front().lease_start, LeaseRecord::to_ticks(start + std::chrono::seconds(2)));
+        EXPECT_EQ(kept.back().lease_start, LeaseRecord::to_ticks(start + std::chrono::seconds(4)));
+        EXPECT_TRUE(history.get(other.ip_address).empty());
+        EXPECT_EQ(history.addresses(), 1u);
+    }
+    
+    // With one, older changes come back from it ahead of the ring, and survive a reopen
+    {
+        LeaseHistory history(2, path);
+        for (int i = 0; i < 5; ++i) {
+            lease.lease_start = start + std::chrono::seconds(i);
+            history.record(JournalOp::RENEW, lease);
+            history.record(JournalOp::RENEW, other);
+        }
+        history.record(JournalOp::RELEASE, lease);
+        const auto all = history.get(lease.ip_address);
+        ASSERT_EQ(all.size(), 6u);
+        for (int i = 0; i < 5; ++i) {
+            EXPECT_EQ(all[i].lease_start, LeaseRecord::to_ticks(start + std::chrono::seconds(i)));
+            EXPECT_EQ(all[i].mac_address, lease.mac_address);
+        }
+        EXPECT_EQ(all.back().event, JournalOp::RELEASE);
+        EXPECT_EQ(history.get(other.ip_address).size(), 5u);
+    }
+    {
+        LeaseHistory reopened(2, path);
+        EXPECT_EQ(reopened.get(lease.ip_address).size(), 4u);
+    }
+    std::remove(path.c_str());
+}
+
+TEST_F(LeaseManagerTest, AdvancedManagerRecordsLeaseHistory) {
+    manager->stop();
+    AdvancedLeaseManager advanced(config);
+    MacAddress mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x30};
+    DhcpLease lease = advanced.allocate_lease(mac, 0, "test-subnet");
+    advanced.renew_lease(mac, lease.ip_address);
+    advanced.release_lease(mac, lease.ip_address);
+    
+    const auto history = advanced.get_lease_history(lease.ip_address);
+    ASSERT_EQ(history.size(), 3u);
+    EXPECT_EQ(history[0].event, JournalOp::ALLOCATE);
+    EXPECT_EQ(history[1].event, JournalOp::RENEW);
+    EXPECT_EQ(history[2].event, JournalOp::RELEASE);
+    EXPECT_EQ(history[2].mac_address, mac);
+}
+
+TEST_F(LeaseManagerTest, AdvancedManagerResolvesConflictsOnTheMaintenanceLoop) {
+    manager->stop();
+    AdvancedLeaseManager advanced(config);
+    advanced.set_conflict_resolution_strategy(ConflictResolutionStrategy::REPLACE);
+    std::mutex mutex;
+    std::condition_variable seen_cv;
+    std::vector<LeaseConflict> seen;
+    advanced.set_conflict_callback([&](const LeaseConflict& conflict) {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen.push_back(conflict);
+        seen_cv.notify_all();
+    });
+    
+    const MacAddress holder = {0x00, 0x11, 0x22, 0x33, 0x44, 0x31};
+    const MacAddress requester = {0x00, 0x11, 0x22, 0x33, 0x44, 0x32};
+    const DhcpLease lease = advanced.allocate_lease(holder, 0, "test-subnet");
+    EXPECT_THROW(advanced.allocate_lease(requester, lease.ip_address, "test-subnet"), LeaseManagerException);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(seen_cv.wait_for(lock, std::chrono::seconds(2), [&] { return !seen.empty(); }));
+        EXPECT_EQ(seen[0].existing_mac, holder);
+        EXPECT_EQ(seen[0].conflicting_mac, requester);
+        EXPECT_EQ(seen[0].ip_address, lease.ip_address);
+        EXPECT_EQ(seen[0].resolution, ConflictResolutionStrategy::REPLACE);
+    }
+    
+    // REPLACE releases the holder's lease, so the requester's next attempt gets the address
+    const auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 200 && advanced.get_conflicts_in_range(now - std::chrono::hours(1),
+                                                                now + std::chrono::hours(1)).empty(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(advanced.get_conflicts_in_range(now - std::chrono::hours(1), now + std::chrono::hours(1)).size(), 1u);
+    EXPECT_EQ(advanced.get_lease_by_mac(holder), nullptr);
+    EXPECT_EQ(advanced.allocate_lease(requester, lease.ip_address, "test-subnet").ip_address, lease.ip_address);
+    EXPECT_EQ(advanced.conflicts_dropped(), 0u);
+}
+
+TEST_F(LeaseManagerTest, ReadLeasesWalksEveryLeaseOnce) {
+    std::set<IpAddress> allocated;
+    for (uint8_t i = 0; i < 80; ++i) {
+        const MacAddress mac = {0x02, 0x00, 0x00, 0x00, 0x01, i};
+        allocated.insert(manager->allocate_lease(mac, 0, "test-subnet").ip_address);
+    }
+    ASSERT_EQ(allocated.size(), 80u);
+    
+    LeaseCursor cursor;
+    std::vector<DhcpLease> chunk;
+    std::multiset<IpAddress> seen;
+    size_t reads = 0;
+    while (manager->read_leases(cursor, chunk, 7) > 0) {
+        EXPECT_LE(chunk.size(), 7u);
+        for (const DhcpLease& lease : chunk) {
+            seen.insert(lease.ip_address);
+        }
+        ++reads;
+    }
+    EXPECT_TRUE(cursor.done());
+    EXPECT_GE(reads, 80u / 7);
+    EXPECT_EQ(std::set<IpAddress>(seen.begin(), seen.end()), allocated);
+    EXPECT_EQ(seen.size(), allocated.size());
+    
+    EXPECT_EQ(manager->get_leases_for_subnet("test-subnet").size(), 80u);
+    EXPECT_TRUE(manager->get_leases_for_subnet("no-such-subnet").empty());
+    EXPECT_TRUE(manager->is_pool_address(string_to_ip("192.168.1.150")));
+    EXPECT_FALSE(manager->is_pool_address(string_to_ip("192.168.1.50")));
+    EXPECT_FALSE(manager->is_pool_address(string_to_ip("10.0.0.1")));
+}
+
+namespace {
+// Encode a query from a relay agent; the bytes stay valid until the next call
+DhcpMessageView leasequery(DhcpMessageType type, IpAddress ciaddr, const MacAddress* mac,
+                           const std::string& client_id = "") {
+    static uint8_t buffer[DhcpMessageWriter::kDefaultMaxSize];
+    DhcpMessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.op = 1;
+    header.htype = 1;
+    header.xid = 0x4C51;
+    header.ciaddr = ciaddr;
+    header.giaddr = string_to_ip("192.168.1.1");
+    if (mac) {
+        header.hlen = 6;
+        std::memcpy(header.chaddr, mac->data(), mac->size());
+    }
+    DhcpMessageWriter writer(buffer, sizeof(buffer));
+    writer.begin(header);
+    writer.add_option_u8(DhcpOptionCode::DHCP_MESSAGE_TYPE, message_type_to_option_value(type));
+    if (!client_id.empty()) {
+        writer.add_option(DhcpOptionCode::CLIENT_IDENTIFIER, reinterpret_cast<const uint8_t*>(client_id.data()),
+                          client_id.size());
+    }
+    const ByteView query = writer.finish();
+    return DhcpMessageView(query.data(), query.size());
+}
+
+DhcpMessageView view_of(ByteView reply) {
+    return DhcpMessageView(reply.data(), reply.size());
+}
+}
+
+TEST_F(LeaseManagerTest, LeasequeryAnswersFromTheTable) {
+    const MacAddress first = {0x02, 0x00, 0x00, 0x00, 0x02, 0x01};
+    const MacAddress second = {0x02, 0x00, 0x00, 0x00, 0x02, 0x02};
+    const MacAddress stranger = {0x02, 0x00, 0x00, 0x00, 0x02, 0x03};
+    const DhcpLease lease = manager->allocate_lease(first, 0, "test-subnet");
+    manager->allocate_lease(second, 0, "test-subnet");
+    const IpAddress server_id = string_to_ip("192.168.1.1");
+    LeasequeryResponder responder(*manager, server_id);
+    DhcpMessageWriter& writer = DhcpMessageWriter::for_current_thread();
+    
+    // By address and by MAC: the lease, with its client and remaining time
+    for (bool by_mac : {false, true}) {
+        const DhcpMessageView reply = view_of(responder.answer(
+            leasequery(DhcpMessageType::LEASEQUERY, by_mac ? 0 : lease.ip_address, by_mac ? &first : nullptr),
+            writer));
+        EXPECT_EQ(reply.message_type(), DhcpMessageType::LEASEACTIVE);
+        EXPECT_EQ(reply.xid(), 0x4C51u);
+        EXPECT_EQ(reply.client_ip(), lease.ip_address);
+        EXPECT_EQ(reply.client_mac(), first);
+        EXPECT_EQ(reply.option_data(DhcpOptionCode::IP_ADDRESS_LEASE_TIME).size(), 4u);
+        EXPECT_TRUE(reply.has_option(DhcpOptionCode::LAST_TRANSACTION_TIME));
+    }
+    
+    // A free pool address is ours but unassigned; anything else is unknown
+    const auto answer_type = [&](IpAddress ciaddr, const MacAddress* mac) {
+        return view_of(responder.answer(leasequery(DhcpMessageType::LEASEQUERY, ciaddr, mac), writer)).message_type();
+    };
+    EXPECT_EQ(answer_type(string_to_ip("192.168.1.199"), nullptr), DhcpMessageType::LEASEUNASSIGNED);
+    EXPECT_EQ(answer_type(string_to_ip("10.0.0.1"), nullptr), DhcpMessageType::LEASEUNKNOWN);
+    EXPECT_EQ(answer_type(0, &stranger), DhcpMessageType::LEASEUNKNOWN);
+    
+    // By client identifier, through the index
+    DhcpLease identified = lease;
+    identified.mac_address = stranger;
+    identified.ip_address = string_to_ip("192.168.1.150");
+    identified.client_id = std::string("\x01\x02\x00\x00\x00\x02\x03", 7);
+    ASSERT_TRUE(manager->apply_replicated(JournalOp::ALLOCATE, identified));
+    const DhcpMessageView by_client_id = view_of(responder.answer(
+        leasequery(DhcpMessageType::LEASEQUERY, 0, nullptr, identified.client_id), writer));
+    EXPECT_EQ(by_client_id.message_type(), DhcpMessageType::LEASEACTIVE);
+    EXPECT_EQ(by_client_id.client_ip(), identified.ip_address);
+    EXPECT_EQ(view_of(responder.answer(leasequery(DhcpMessageType::LEASEQUERY, 0, nullptr, "unknown-id"), writer))
+                  .message_type(), DhcpMessageType::LEASEUNKNOWN);
+    ASSERT_TRUE(manager->release_lease(stranger, identified.ip_address));
+    EXPECT_EQ(manager->get_lease_by_client_id(identified.client_id), nullptr);
+    
+    // A bulk query naming nothing gets every lease, then DONE
+    std::vector<DhcpMessageType> types;
+    std::set<IpAddress> addresses;
+    const size_t sent = responder.answer_bulk(leasequery(DhcpMessageType::BULKLEASEQUERY, 0, nullptr),
+                                              [&](ByteView reply) {
+        const DhcpMessageView view = view_of(reply);
+        types.push_back(view.message_type());
+        if (view.message_type() == DhcpMessageType::LEASEACTIVE) {
+            addresses.insert(view.client_ip());
+            EXPECT_EQ(view.option_data(DhcpOptionCode::DHCP_STATE).size(), 1u);
+        }
+        return true;
+    });
+    EXPECT_EQ(sent, 2u);
+    ASSERT_EQ(types.size(), 3u);
+    EXPECT_EQ(types.back(), DhcpMessageType::LEASEQUERYDONE);
+    EXPECT_EQ(addresses.size(), 2u);
+    EXPECT_EQ(addresses.count(lease.ip_address), 1u);
+}
+
+TEST_F(LeaseManagerTest, BulkLeasequeryOverTcp) {
+    for (uint8_t i = 0; i < 20; ++i) {
+        const MacAddress mac = {0x02, 0x00, 0x00, 0x00, 0x03, i};
+        manager->allocate_lease(mac, 0, "test-subnet");
+    }
+    LeasequeryResponder responder(*manager, string_to_ip("192.168.1.1"));
+    BulkLeasequeryServer server("127.0.0.1", 0, responder);
+    server.start();
+    ASSERT_NE(server.port(), 0);
+    
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server.port());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+    
+    const ByteView query = leasequery(DhcpMessageType::BULKLEASEQUERY, 0, nullptr).raw();
+    const uint16_t length = htons(static_cast<uint16_t>(query.size()));
+    ASSERT_EQ(::send(fd, &length, sizeof(length), 0), static_cast<ssize_t>(sizeof(length)));
+    ASSERT_EQ(::send(fd, query.data(), query.size(), 0), static_cast<ssize_t>(query.size()));
+    
+    // Length-prefixed replies; the connection stays open after DONE
+    size_t active = 0;
+    bool done = false;
+    std::vector<uint8_t> message;
+    while (!done) {
+        uint16_t prefix;
+        if (::recv(fd, &prefix, sizeof(prefix), MSG_WAITALL) != static_cast<ssize_t>(sizeof(prefix))) {
+            break;
+        }
+        message.resize(ntohs(prefix));
+        if (::recv(fd, message.data(), message.size(), MSG_WAITALL) != static_cast<ssize_t>(message.size())) {
+            break;
+        }
+        const DhcpMessageView reply(message.data(), message.size());
+        active += reply.message_type() == DhcpMessageType::LEASEACTIVE;
+        done = reply.message_type() == DhcpMessageType::LEASEQUERYDONE;
+    }
+    ::close(fd);
+    server.stop();
+    
+    EXPECT_TRUE(done);
+    EXPECT_EQ(active, 20u);
+    EXPECT_EQ(server.queries(), 1u);
+    EXPECT_EQ(server.leases_sent(), 20u);
+}
+
+TEST(LeaseReplicatorTest, LoadBalanceHashSplitsClients) {
+    // Pearson's hash of RFC 3074: the key length seeds it and bytes are taken last to first
+    const uint8_t one = 0;
+    EXPECT_EQ(LeaseReplicator::load_balance_hash(nullptr, 0), 0);
+    EXPECT_EQ(LeaseReplicator::load_balance_hash(&one, 1), 175);
+    
+    DhcpConfig config;
+    config.enable_logging = false;
+    LeaseManager leases(config);
+    LeaseReplicator primary(leases, FailoverRole::PRIMARY, "127.0.0.1", 0, 128);
+    size_t primary_clients = 0;
+    for (uint32_t i = 0; i < 4096; ++i) {
+        const MacAddress mac = {0x02, 0x00, 0x00, static_cast<uint8_t>(i >> 16), static_cast<uint8_t>(i >> 8),
+                                static_cast<uint8_t>(i)};
+        EXPECT_TRUE(primary.serves(mac));  // peer down: every client
+        primary_clients += LeaseReplicator::load_balance_hash(mac.data(), mac.size()) < 128;
+    }
+    EXPECT_GT(primary_clients, 4096u * 2 / 5);
+    EXPECT_LT(primary_clients, 4096u * 3 / 5);
+    
+    EXPECT_EQ(LeaseReplicator::parse_role("secondary"), FailoverRole::SECONDARY);
+    EXPECT_THROW(LeaseReplicator::parse_role("backup"), LeaseReplicationException);
+    EXPECT_THROW(LeaseReplicator(leases, FailoverRole::PRIMARY, "peer.example", 647, 128), LeaseReplicationException);
+}
+
+TEST(LeaseReplicatorTest, PeersResyncAndStreamChanges) {
+    DhcpConfig config;
+    config.enable_logging = false;
+    DhcpSubnet subnet;
+    subnet.name = "shared";
+    subnet.network = string_to_ip("10.30.0.0");
+    subnet.prefix_length = 24;
+    subnet.range_start = string_to_ip("10.30.0.10");
+    subnet.range_end = string_to_ip("10.30.0.250");
+    subnet.lease_time = 3600;
+    config.subnets.push_back(subnet);
+    LeaseManager primary_leases(config);
+    LeaseManager secondary_leases(config);
+    
+    auto wait_for = [](const std::function<bool()>& done) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!done() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return done();
+    };
+    
+    // A lease made before the peers meet reaches the other side by resync
+    const MacAddress early = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const DhcpLease early_lease = secondary_leases.allocate_lease(early, 0, "shared");
+    
+    LeaseReplicator secondary(secondary_leases, FailoverRole::SECONDARY, "127.0.0.1", 0, 128);
+    secondary.start();
+    LeaseReplicator primary(primary_leases, FailoverRole::PRIMARY, "127.0.0.1", secondary.port(), 128);
+    primary.start();
+    ASSERT_TRUE(wait_for([&] { return primary.peer_up() && secondary.peer_up(); }));
+    ASSERT_TRUE(wait_for([&] { return primary_leases.get_lease_by_mac(early) != nullptr; }));
+    EXPECT_EQ(primary_leases.get_lease_by_mac(early)->ip_address, early_lease.ip_address);
+    
+    // Each client is served by exactly one side while both are up
+    for (uint8_t i = 0; i < 64; ++i) {
+        const MacAddress mac = {0x02, 0x00, 0x00, 0x00, 0x01, i};
+        EXPECT_NE(primary.serves(mac), secondary.serves(mac));
+    }
+    
+    // Live changes stream both ways, from disjoint halves of the pool
+    std::vector<DhcpLease> primary_made;
+    for (uint8_t i = 0; i < 20; ++i) {
+        primary_made.push_back(primary_leases.allocate_lease({0x02, 0x00, 0x00, 0x00, 0x02, i}, 0, "shared"));
+        secondary_leases.allocate_lease({0x02, 0x00, 0x00, 0x00, 0x03, i}, 0, "shared");
+    }
+    primary_leases.release_lease(primary_made[0].mac_address, primary_made[0].ip_address);
+    ASSERT_TRUE(wait_for([&] {
+        return primary_leases.get_statistics().active_leases == 40 && secondary_leases.get_statistics().active_leases == 40;
+    }));
+    EXPECT_EQ(secondary_leases.get_lease_by_mac(primary_made[0].mac_address), nullptr);
+    for (size_t i = 1; i < primary_made.size(); ++i) {
+        EXPECT_EQ((ntohl(primary_made[i].ip_address) - ntohl(subnet.range_start)) % 2, 0u);
+        auto copy = secondary_leases.get_lease_by_mac(primary_made[i].mac_address);
+        ASSERT_NE(copy, nullptr);
+        EXPECT_EQ(copy->ip_address, primary_made[i].ip_address);
+        EXPECT_EQ(secondary_leases.get_lease_by_ip(primary_made[i].ip_address)->mac_address, primary_made[i].mac_address);
+    }
+    ASSERT_TRUE(wait_for([&] {
+        return primary.get_statistics().records_acked == primary.get_statistics().records_sent;
+    }));
+    EXPECT_GE(primary.get_statistics().records_received, 21u);
+    
+    // The survivor takes over every client
+    secondary.stop();
+    ASSERT_TRUE(wait_for([&] { return !primary.peer_up(); }));
+    EXPECT_TRUE(primary.serves({0x02, 0x00, 0x00, 0x00, 0x01, 0x00}));
+    EXPECT_TRUE(primary.serves({0x02, 0x00, 0x00, 0x00, 0x01, 0x01}));
+    primary.stop();
+}
+
+// Test async logging
+class LoggerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        log_path = "/tmp/simple-dhcpd-test-async.log";
+        std::remove(log_path.c_str());
+    }
+    
+    void TearDown() override {
+        std::remove(log_path.c_str());
+    }
+    
+    std::vector<std::string> read_lines() {
+        std::vector<std::string> lines;
+        std::ifstream in(log_path);
+        std::string line;
+        while (std::getline(in, line)) {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+    
+    std::string log_path;
+};
+
+TEST_F(LoggerTest, AsyncWriterKeepsEveryLineInOrder) {
+    const int threads = 4;
+    const int per_thread = 500;
+    {
+        Logger logger(log_path, LogLevel::DEBUG);
+        logger.set_console_output(false);
+        logger.start_async(64, std::chrono::milliseconds(10000), LogOverflowPolicy::BLOCK);
+        ASSERT_TRUE(logger.is_async());
+        
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&logger, t]() {
+                for (int i = 0; i < per_thread; ++i) {
+                    logger.info("thread " + std::to_string(t) + " line " + std::to_string(i));
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        
+        // flush() must not wait for the 10 s interval
+        logger.flush();
+        EXPECT_EQ(read_lines().size(), static_cast<size_t>(threads * per_thread));
+        EXPECT_EQ(logger.dropped_count(), 0u);
+    }
+    
+    std::vector<int> next(threads, 0);
+    for (const auto& line : read_lines()) {
+        ASSERT_NE(line.find("[INFO ] thread "), std::string::npos) << line;
+        int t = -1;
+        int i = -1;
+        ASSERT_EQ(std::sscanf(line.c_str() + line.find("thread "), "thread %d line %d", &t, &i), 2);
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, threads);
+        EXPECT_EQ(i, next[t]++);
+    }
+    for (int t = 0; t < threads; ++t) {
+        EXPECT_EQ(next[t], per_thread);
+    }
+}
+
+TEST_F(LoggerTest, DropPolicyCountsDiscardedLines) {
+    const size_t total = 2000;
+    uint64_t dropped = 0;
+    {
+        Logger logger(log_path, LogLevel::INFO);
+        logger.set_console_output(false);
+        logger.start_async(4, std::chrono::milliseconds(10000), LogOverflowPolicy::DROP);
+        for (size_t i = 0; i < total; ++i) {
+            logger.warn("line " + std::to_string(i));
+        }
+        logger.stop_async();
+        EXPECT_FALSE(logger.is_async());
+        dropped = logger.dropped_count();
+    }
+    EXPECT_GT(dropped, 0u);
+    
+    size_t written = 0;
+    size_t notices = 0;
+    for (const auto& line : read_lines()) {
+        if (line.find("Log buffer full, dropped") != std::string::npos) {
+            ++notices;
+        } else {
+            ++written;
+        }
+    }
+    EXPECT_EQ(written + dropped, total);
+    EXPECT_GT(notices, 0u);
+}
+
+TEST_F(LoggerTest, DisabledLevelSkipsFormatting) {
+    init_logger("", LogLevel::WARN);
+    g_logger->set_console_output(false);
+    
+    int formatted = 0;
+    auto expensive = [&formatted]() {
+        ++formatted;
+        return std::string("value");
+    };
+    LOG_DEBUG("debug " << expensive());
+    LOG_INFO("info " << expensive());
+    EXPECT_EQ(formatted, 0);
+    LOG_ERROR("error " << expensive());
+    EXPECT_EQ(formatted, 1);
+    
+    g_logger.reset();
+}
+
+enum class TestCounter { HITS, MISSES, COUNT };
+
+TEST(StatCountersTest, PerThreadSlotsSumAndReset) {
+    // More threads than slots, so some share one
+    StatCounters<TestCounter, 2, 4> counters;
+    const int threads = 8;
+    const int per_thread = 10000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&counters, per_thread, t] {
+            for (int i = 0; i < per_thread; ++i) {
+                counters.increment(TestCounter::HITS);
+            }
+            counters.increment(TestCounter::MISSES, static_cast<uint64_t>(t));
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    auto totals = counters.snapshot();
+    EXPECT_EQ(totals[0], static_cast<uint64_t>(threads * per_thread));
+    EXPECT_EQ(counters.get(TestCounter::MISSES), 28u);
+
+    counters.reset();
+    EXPECT_EQ(counters.get(TestCounter::HITS), 0u);
+    counters.increment(TestCounter::HITS, 5);
+    EXPECT_EQ(counters.snapshot()[0], 5u);
+}
+
+TEST(LatencyHistogramTest, PercentilesStayWithinBucketPrecision) {
+    // Every bucket's range maps back to itself
+    for (uint64_t value : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456ull, (1ull << 32) - 1}) {
+        const size_t index = LatencyHistogram::bucket_index(value);
+        EXPECT_GE(LatencyHistogram::bucket_upper(index), value);
+        EXPECT_EQ(LatencyHistogram::bucket_index(LatencyHistogram::bucket_upper(index)), index);
+    }
+    EXPECT_EQ(LatencyHistogram::bucket_index(1ull << 40), LatencyHistogram::kBuckets - 1);
+
+    LatencyHistogram histogram;
+    for (uint64_t ns = 1; ns <= 10000; ++ns) {
+        histogram.record(ns);
+    }
+    EXPECT_EQ(histogram.count(), 10000u);
+    EXPECT_EQ(histogram.max(), 10000u);
+    EXPECT_EQ(histogram.sum(), 10000u * 10001u / 2);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile(0.5)), 5000.0, 5000.0 / 16);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile(0.99)), 9900.0, 9900.0 / 16);
+    EXPECT_EQ(histogram.percentile(1.0), 10000u);
+
+    histogram.reset();
+    EXPECT_EQ(histogram.count(), 0u);
+    EXPECT_EQ(histogram.percentile(0.5), 0u);
+}
+
+#if SIMPLE_DHCPD_LATENCY_HISTOGRAMS
+TEST(LatencyHistogramTest, PipelineRecordsStagesByMessageType) {
+    PipelineLatency latency;
+    for (int i = 0; i < 3; ++i) {
+        latency.begin();
+        latency.set_message_type(DhcpMessageType::DISCOVER);
+        latency.mark(PipelineStage::PARSE);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        latency.mark(PipelineStage::LEASE);
+        latency.finish();
+    }
+    latency.begin();
+    latency.mark(PipelineStage::PARSE);
+    latency.finish();
+
+    const auto& lease = latency.histogram(DhcpMessageType::DISCOVER, PipelineStage::LEASE);
+    EXPECT_EQ(lease.count(), 3u);
+    EXPECT_GE(lease.percentile(0.5), 1000000u);
+    EXPECT_GE(latency.histogram(DhcpMessageType::DISCOVER, PipelineStage::TOTAL).max(), lease.max());
+    EXPECT_EQ(latency.histogram(DhcpMessageType::REQUEST, PipelineStage::LEASE).count(), 0u);
+
+    // DISCOVER parse, lease, total; then the unparsed packet's parse and total
+    const auto summaries = latency.summaries();
+    ASSERT_EQ(summaries.size(), 5u);
+    EXPECT_EQ(summaries[1].message_type, "DISCOVER");
+    EXPECT_EQ(summaries[1].stage, "lease");
+    EXPECT_EQ(summaries[1].count, 3u);
+    EXPECT_EQ(summaries[3].message_type, "OTHER");
+
+    latency.reset();
+    EXPECT_TRUE(latency.summaries().empty());
+}
+#endif